@@ -466,6 +466,7 @@ JavaDynArray * jda_find(void * arr) {
     return NULL;
 }
 
+#ifndef __x86_64__
 va_list _AtoV(int dummy, ...) {
     va_list args1;
     va_start(args1, dummy);
@@ -474,3 +475,4 @@ va_list _AtoV(int dummy, ...) {
     va_end(args1);
     return args2;
 }
+#endif
@@ -140,7 +140,13 @@ JavaDynArray * jda_find(void * arr);
  * Helper macros / functions
  */
 
+#ifdef __x86_64__
+// va_list is an array there and can't be returned. Only the host build
+// (scripts/host) targets it, and it makes no Call*MethodA calls.
+#define _AtoV(dummy, ...) NULL
+#else
 va_list _AtoV(int dummy, ...);
+#endif
 
 #define getFieldValueById(jtype, fieldtype, containertype, container, containersize, id, defaultval) ({ \
   for (int i = 0; i < nameToFieldId_size() / sizeof(NameToFieldID); i++) { \
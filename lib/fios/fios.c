@@ -14,18 +14,14 @@
 #include <so_util/so_util.h>
 
 #define MAX_PATH_LENGTH 256
-#define RAMCACHEBLOCKSIZE (128 * 1024)
 #define PSARCCACHEBLOCKSIZE (192 * 1024)
-#define RAMCACHEBLOCKNUM 512
 
 static int64_t g_OpStorage[SCE_FIOS_OP_STORAGE_SIZE(64, MAX_PATH_LENGTH) / sizeof(int64_t) + 1];
 static int64_t g_ChunkStorage[SCE_FIOS_CHUNK_STORAGE_SIZE(1024) / sizeof(int64_t) + 1];
 static int64_t g_FHStorage[SCE_FIOS_FH_STORAGE_SIZE(1024, MAX_PATH_LENGTH) / sizeof(int64_t) + 1];
 static int64_t g_DHStorage[SCE_FIOS_DH_STORAGE_SIZE(32, MAX_PATH_LENGTH) / sizeof(int64_t) + 1];
 
-static SceFiosRamCacheContext g_RamCacheContext = SCE_FIOS_RAM_CACHE_CONTEXT_INITIALIZER;
 static SceFiosPsarcDearchiverContext g_PsarcContext;
-static char *g_RamCacheWorkBuffer;
 static int32_t g_TexturesHandle;
 static SceFiosBuffer g_MountBuffer;
 
@@ -51,26 +47,14 @@ int fios_init(void) {
     params.threadPriority[SCE_FIOS_CALLBACK_THREAD] = 191;
     params.threadPriority[SCE_FIOS_DECOMPRESSOR_THREAD] = 191;
 
+    // Reads are cached by the loader's own block cache (utils/blockcache.c)
     res = sceFiosInitialize(&params);
     if (res < 0)
         return res;
 
-    g_RamCacheWorkBuffer = memalign(8, RAMCACHEBLOCKNUM * RAMCACHEBLOCKSIZE);
-    if (!g_RamCacheWorkBuffer)
-        return -1;
-
-    g_RamCacheContext.pPath = DATA_PATH;
-    g_RamCacheContext.pWorkBuffer = g_RamCacheWorkBuffer;
-    g_RamCacheContext.workBufferSize = RAMCACHEBLOCKNUM * RAMCACHEBLOCKSIZE;
-    g_RamCacheContext.blockSize = RAMCACHEBLOCKSIZE;
-    res = sceFiosIOFilterAdd(0, sceFiosIOFilterCache, &g_RamCacheContext);
-    if (res < 0)
-        return res;
-
     return 0;
 }
 
 void fios_terminate(void) {
     sceFiosTerminate();
-    free(g_RamCacheWorkBuffer);
 }
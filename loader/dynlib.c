@@ -38,7 +38,16 @@
 #include "reimpl/io.h"
 #include "reimpl/log.h"
 #include "reimpl/env.h"
+#include "reimpl/fastmath.h"
+#include "reimpl/glmatrix.h"
+#include "reimpl/glmipmap.h"
+#include "reimpl/glprogram.h"
+#include "reimpl/glstate.h"
+#include "reimpl/gltexture.h"
+#include "reimpl/gltrace.h"
+#include "reimpl/glvbo.h"
 #include "reimpl/mem.h"
+#include "reimpl/strmem.h"
 #include <sys/socket.h>
 #include <netdb.h>
 #include <wchar.h>
@@ -115,13 +124,19 @@ extern const short *BIONIC_toupper_tab_;
 static FILE __sF_fake[3];
 
 void glDrawElementsHook(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices) {
-    if (mode != GL_POINTS)
+    if (mode != GL_POINTS) {
+        glmatrix_flush();
+        glvbo_prepare_draw_elements(count, type, indices);
         glDrawElements(mode, count, type, indices);
+    }
 }
 
 void glDrawArraysHook(GLenum mode, GLint first, GLsizei count) {
-    if (mode != GL_POINTS)
+    if (mode != GL_POINTS) {
+        glmatrix_flush();
+        glvbo_prepare_draw_arrays(first, count);
         glDrawArrays(mode, first, count);
+    }
 }
 
 int pthread_cond_timedwait_relative_np_soloader() {
@@ -139,39 +154,10 @@ int __errno_fake() {
     return __errno();
 }
 
-GLint glGetUniformLocation_hook(GLuint program, const GLchar *name) {
-	if (!strcmp(name, "texture"))
-		return glGetUniformLocation(program, "_texture");
-	return glGetUniformLocation(program, name);
-}
-
-void glGetActiveUniform_hook(GLuint program, GLuint index, GLsizei bufSize, GLsizei *length, GLint *size, GLenum *type, GLchar *name) {
-	glGetActiveUniform(program, index, bufSize, length, size, type, name);
-	if (!strcmp(name, "BoneMatrices")) {
-		*type = GL_FLOAT_MAT4;
-		*size = 48;
-	}
-	if (!strcmp(name, "_texture")) {
-		strcpy(name, "texture");
-		if (length)
-			*length = *length - 1;
-	}
-}
-
-void glTexImage2D_hook(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *data) {
-    if (level == 0)
-        glTexImage2D(target, level, internalFormat, width, height, border, format, type, data);
-}
-
-void glCompressedTexImage2D_hook(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const void *data) {
-    if (level == 0)
-        glCompressedTexImage2D(target, level, internalformat, width, height, border, imageSize, data);
-}
-
 so_default_dynlib default_dynlib[] = {
-        { "glCompressedTexImage2D", (uintptr_t)&glCompressedTexImage2D },
-        { "glGenerateMipmap", (uintptr_t)&glGenerateMipmap }, // nuke mips
-        { "glTexImage2D", (uintptr_t)&glTexImage2D },
+        { "glCompressedTexImage2D", (uintptr_t)&glCompressedTexImage2D_soloader },
+        { "glGenerateMipmap", (uintptr_t)&glGenerateMipmap_soloader }, // nuke mips
+        { "glTexImage2D", (uintptr_t)&glTexImage2D_soloader },
         { "__aeabi_atexit", (uintptr_t)&__aeabi_atexit },
         { "__aeabi_d2f", (uintptr_t)&__aeabi_d2f },
         { "__aeabi_d2iz", (uintptr_t)&__aeabi_d2iz },
@@ -233,7 +219,7 @@ so_default_dynlib default_dynlib[] = {
         { "asinf", (uintptr_t)&asinf },
         { "atan", (uintptr_t)&atan },
         { "atan2", (uintptr_t)&atan2 },
-        { "atan2f", (uintptr_t)&atan2f },
+        { "atan2f", (uintptr_t)&atan2f_soloader },
         { "atanf", (uintptr_t)&atanf },
         { "atoi", (uintptr_t)&atoi },
         { "bind", (uintptr_t)&bind},
@@ -241,54 +227,54 @@ so_default_dynlib default_dynlib[] = {
         { "ceilf", (uintptr_t)&ceilf },
         { "chdir", (uintptr_t)&chdir},
         { "clock", (uintptr_t)&clock },
-        { "close", (uintptr_t)&close},
+        { "close", (uintptr_t)&close_soloader },
         { "cos", (uintptr_t)&cos },
-        { "cosf", (uintptr_t)&cosf },
+        { "cosf", (uintptr_t)&cosf_soloader },
         { "cosh", (uintptr_t)&cosh},
         { "difftime", (uintptr_t)&difftime},
         { "exit", (uintptr_t)&exit },
-        { "expf", (uintptr_t)&expf },
+        { "expf", (uintptr_t)&expf_soloader },
         { "fclose", (uintptr_t)&fclose_soloader },
         { "fcntl", (uintptr_t)&fcntl_soloader },
-        { "ferror", (uintptr_t)&sceLibcBridge_ferror},
-        { "fflush", (uintptr_t)&sceLibcBridge_fflush},
-        { "fgetc", (uintptr_t)&sceLibcBridge_fgetc },
-        { "fgetpos", (uintptr_t)&sceLibcBridge_fgetpos},
-        { "fgets", (uintptr_t)&sceLibcBridge_fgets},
+        { "ferror", (uintptr_t)&ferror_soloader },
+        { "fflush", (uintptr_t)&fflush_soloader },
+        { "fgetc", (uintptr_t)&fgetc_soloader },
+        { "fgetpos", (uintptr_t)&fgetpos_soloader },
+        { "fgets", (uintptr_t)&fgets_soloader },
         { "floor", (uintptr_t)&floor },
         { "floorf", (uintptr_t)&floorf },
         { "fmod", (uintptr_t)&fmod },
         { "fmodf", (uintptr_t)&fmodf },
         { "fopen", (uintptr_t)&fopen_soloader },
-        { "fprintf", (uintptr_t)&sceLibcBridge_fprintf },
-        { "fputc", (uintptr_t)&sceLibcBridge_fputc},
-        { "fputs", (uintptr_t)&sceLibcBridge_fputs},
-        { "fread", (uintptr_t)&sceLibcBridge_fread },
+        { "fprintf", (uintptr_t)&fprintf_soloader },
+        { "fputc", (uintptr_t)&fputc_soloader },
+        { "fputs", (uintptr_t)&fputs_soloader },
+        { "fread", (uintptr_t)&fread_soloader },
         { "free", (uintptr_t)&free },
         { "freeaddrinfo", (uintptr_t)&freeaddrinfo},
-        { "freopen", (uintptr_t)&freopen},
+        { "freopen", (uintptr_t)&freopen_soloader },
         { "frexpf", (uintptr_t)&frexpf},
-        { "fscanf", (uintptr_t)&sceLibcBridge_fscanf},
-        { "fseek", (uintptr_t)&sceLibcBridge_fseek },
-        { "fsetpos", (uintptr_t)&sceLibcBridge_fsetpos},
+        { "fscanf", (uintptr_t)&fscanf_soloader },
+        { "fseek", (uintptr_t)&fseek_soloader },
+        { "fsetpos", (uintptr_t)&fsetpos_soloader },
         { "fstat", (uintptr_t)&fstat_soloader},
-        { "ftell", (uintptr_t)&sceLibcBridge_ftell },
-        { "fwrite", (uintptr_t)&sceLibcBridge_fwrite },
+        { "ftell", (uintptr_t)&ftell_soloader },
+        { "fwrite", (uintptr_t)&fwrite_soloader },
         { "getaddrinfo", (uintptr_t)&getaddrinfo},
-        { "getc", (uintptr_t)&sceLibcBridge_getc},
+        { "getc", (uintptr_t)&getc_soloader },
         { "getenv", (uintptr_t)&ret0 },
         { "gethostname", (uintptr_t)&gethostname },
         { "gettimeofday", (uintptr_t)&gettimeofday },
-        { "glActiveTexture", (uintptr_t)&glActiveTexture },
+        { "glActiveTexture", (uintptr_t)&glActiveTexture_soloader },
         { "glAlphaFunc", (uintptr_t)&glAlphaFunc },
         { "glAttachShader", (uintptr_t)&glAttachShader},
-        { "glBindBuffer", (uintptr_t)&glBindBuffer },
+        { "glBindBuffer", (uintptr_t)&glBindBuffer_soloader },
         { "glBindFramebuffer", (uintptr_t)&glBindFramebuffer},
         { "glBindRenderbuffer", (uintptr_t)&glBindRenderbuffer },
-        { "glBindTexture", (uintptr_t)&glBindTexture },
+        { "glBindTexture", (uintptr_t)&glBindTexture_soloader },
         { "glBlendColor", (uintptr_t)&ret0 },
         { "glBlendEquation", (uintptr_t)&glBlendEquation },
-        { "glBlendFunc", (uintptr_t)&glBlendFunc },
+        { "glBlendFunc", (uintptr_t)&glBlendFunc_soloader },
         { "glBufferData", (uintptr_t)&glBufferData },
         { "glBufferSubData", (uintptr_t)&glBufferSubData },
         { "glCheckFramebufferStatus", (uintptr_t)&glCheckFramebufferStatus },
@@ -296,54 +282,54 @@ so_default_dynlib default_dynlib[] = {
         { "glClearColor", (uintptr_t)&glClearColor },
         { "glClearDepthf", (uintptr_t)&glClearDepthf },
         { "glClearStencil", (uintptr_t)&glClearStencil },
-        { "glClientActiveTexture", (uintptr_t)&glClientActiveTexture },
-        { "glClipPlanef", (uintptr_t)&glClipPlanef },
+        { "glClientActiveTexture", (uintptr_t)&glClientActiveTexture_soloader },
+        { "glClipPlanef", (uintptr_t)&glClipPlanef_soloader },
         { "glColor4f", (uintptr_t)&glColor4f },
         { "glColor4ub", (uintptr_t)&glColor4ub },
         { "glColorMask", (uintptr_t)&glColorMask },
-        { "glColorPointer", (uintptr_t)&glColorPointer },
+        { "glColorPointer", (uintptr_t)&glColorPointer_soloader },
         { "glCompileShader", (uintptr_t)&glCompileShaderHook },
         { "glCompressedTexSubImage2D", (uintptr_t)&ret0},
         { "glCopyTexImage2D", (uintptr_t)&ret0 },
-        { "glCopyTexSubImage2D", (uintptr_t)&glCopyTexSubImage2D },
+        { "glCopyTexSubImage2D", (uintptr_t)&glCopyTexSubImage2D_soloader },
         { "glCreateProgram", (uintptr_t)&glCreateProgram},
         { "glCreateShader", (uintptr_t)&glCreateShader },
-        { "glCullFace", (uintptr_t)&glCullFace },
-        { "glDeleteBuffers", (uintptr_t)&glDeleteBuffers },
+        { "glCullFace", (uintptr_t)&glCullFace_soloader },
+        { "glDeleteBuffers", (uintptr_t)&glDeleteBuffers_soloader },
         { "glDeleteFramebuffers", (uintptr_t)&glDeleteFramebuffers },
-        { "glDeleteProgram", (uintptr_t)&glDeleteProgram},
+        { "glDeleteProgram", (uintptr_t)&glDeleteProgram_soloader },
         { "glDeleteRenderbuffers", (uintptr_t)&glDeleteRenderbuffers },
         { "glDeleteShader", (uintptr_t)&glDeleteShader },
-        { "glDeleteTextures", (uintptr_t)&glDeleteTextures },
+        { "glDeleteTextures", (uintptr_t)&glDeleteTextures_soloader },
         { "glDepthFunc", (uintptr_t)&glDepthFunc },
-        { "glDepthMask", (uintptr_t)&glDepthMask },
+        { "glDepthMask", (uintptr_t)&glDepthMask_soloader },
         { "glDepthRangef", (uintptr_t)&glDepthRangef },
-        { "glDisable", (uintptr_t)&glDisable },
-        { "glDisableClientState", (uintptr_t)&glDisableClientState },
-        { "glDisableVertexAttribArray", (uintptr_t)&glDisableVertexAttribArray },
+        { "glDisable", (uintptr_t)&glDisable_soloader },
+        { "glDisableClientState", (uintptr_t)&glDisableClientState_soloader },
+        { "glDisableVertexAttribArray", (uintptr_t)&glDisableVertexAttribArray_soloader },
         { "glDrawArrays", (uintptr_t)&glDrawArraysHook },
         { "glDrawElements", (uintptr_t)&glDrawElementsHook },
-        { "glEnable", (uintptr_t)&glEnable },
-        { "glEnableClientState", (uintptr_t)&glEnableClientState },
-        { "glEnableVertexAttribArray", (uintptr_t)&glEnableVertexAttribArray},
+        { "glEnable", (uintptr_t)&glEnable_soloader },
+        { "glEnableClientState", (uintptr_t)&glEnableClientState_soloader },
+        { "glEnableVertexAttribArray", (uintptr_t)&glEnableVertexAttribArray_soloader },
         { "glFlush", (uintptr_t)&glFlush},
         { "glFogf", (uintptr_t)&glFogf },
         { "glFogfv", (uintptr_t)&glFogfv },
         { "glFramebufferRenderbuffer", (uintptr_t)&glFramebufferRenderbuffer },
-        { "glFramebufferTexture2D", (uintptr_t)&glFramebufferTexture2D},
+        { "glFramebufferTexture2D", (uintptr_t)&glFramebufferTexture2D_soloader },
         { "glFrontFace", (uintptr_t)&glFrontFace },
-        { "glFrustumf", (uintptr_t)&glFrustumf },
+        { "glFrustumf", (uintptr_t)&glFrustumf_soloader },
         { "glGenBuffers", (uintptr_t)&glGenBuffers },
         { "glGenFramebuffers", (uintptr_t)&glGenFramebuffers},
         { "glGenRenderbuffers", (uintptr_t)&glGenRenderbuffers},
         { "glGenTextures", (uintptr_t)&glGenTextures },
         { "glGetActiveAttrib", (uintptr_t)&glGetActiveAttrib},
-        { "glGetActiveUniform", (uintptr_t)&glGetActiveUniform_hook},
-        { "glGetAttribLocation", (uintptr_t)&glGetAttribLocation },
+        { "glGetActiveUniform", (uintptr_t)&glGetActiveUniform_soloader },
+        { "glGetAttribLocation", (uintptr_t)&glGetAttribLocation_soloader },
         { "glGetBooleanv", (uintptr_t)&glGetBooleanv },
         { "glGetError", (uintptr_t)&glGetError },
-        { "glGetFloatv", (uintptr_t)&glGetFloatv },
-        { "glGetIntegerv", (uintptr_t)&glGetIntegerv },
+        { "glGetFloatv", (uintptr_t)&glGetFloatv_soloader },
+        { "glGetIntegerv", (uintptr_t)&glGetIntegerv_soloader },
         { "glGetPointerv", (uintptr_t)&glGetPointerv },
         { "glGetProgramInfoLog", (uintptr_t)&glGetProgramInfoLog},
         { "glGetProgramiv", (uintptr_t)&glGetProgramiv},
@@ -351,49 +337,49 @@ so_default_dynlib default_dynlib[] = {
         { "glGetShaderiv", (uintptr_t)&glGetShaderiv},
         { "glGetString", (uintptr_t)&glGetString },
         { "glGetTexEnviv", (uintptr_t)&glGetTexEnviv },
-        { "glGetUniformLocation", (uintptr_t)&glGetUniformLocation_hook },
+        { "glGetUniformLocation", (uintptr_t)&glGetUniformLocation_soloader },
         { "glHint", (uintptr_t)&glHint },
         { "glIsEnabled", (uintptr_t)&glIsEnabled },
         { "glLightf", (uintptr_t)&ret0 },
-        { "glLightfv", (uintptr_t)&glLightfv },
+        { "glLightfv", (uintptr_t)&glLightfv_soloader },
         { "glLightModelfv", (uintptr_t)&glLightModelfv },
         { "glLineWidth", (uintptr_t)&glLineWidth },
-        { "glLinkProgram", (uintptr_t)&glLinkProgram},
-        { "glLoadIdentity", (uintptr_t)&glLoadIdentity },
-        { "glLoadMatrixf", (uintptr_t)&glLoadMatrixf },
+        { "glLinkProgram", (uintptr_t)&glLinkProgram_soloader },
+        { "glLoadIdentity", (uintptr_t)&glLoadIdentity_soloader },
+        { "glLoadMatrixf", (uintptr_t)&glLoadMatrixf_soloader },
         { "glMaterialf", (uintptr_t)&ret0 },
         { "glMaterialfv", (uintptr_t)&glMaterialfv },
-        { "glMatrixMode", (uintptr_t)&glMatrixMode },
-        { "glMultMatrixf", (uintptr_t)&glMultMatrixf },
+        { "glMatrixMode", (uintptr_t)&glMatrixMode_soloader },
+        { "glMultMatrixf", (uintptr_t)&glMultMatrixf_soloader },
         { "glNormal3f", (uintptr_t)&glNormal3f },
-        { "glNormalPointer", (uintptr_t)&glNormalPointer },
-        { "glOrthox", (uintptr_t)&glOrthox },
-        { "glPixelStorei", (uintptr_t)&glPixelStorei },
+        { "glNormalPointer", (uintptr_t)&glNormalPointer_soloader },
+        { "glOrthox", (uintptr_t)&glOrthox_soloader },
+        { "glPixelStorei", (uintptr_t)&glPixelStorei_soloader },
         { "glPointParameterf", (uintptr_t)&ret0 },
         { "glPointSize", (uintptr_t)&glPointSize },
         { "glPolygonOffset", (uintptr_t)&glPolygonOffset },
-        { "glPopMatrix", (uintptr_t)&glPopMatrix },
-        { "glPushMatrix", (uintptr_t)&glPushMatrix },
+        { "glPopMatrix", (uintptr_t)&glPopMatrix_soloader },
+        { "glPushMatrix", (uintptr_t)&glPushMatrix_soloader },
         { "glReadPixels", (uintptr_t)&glReadPixels },
         { "glRenderbufferStorage", (uintptr_t)&glRenderbufferStorage},
-        { "glRotatef", (uintptr_t)&glRotatef },
+        { "glRotatef", (uintptr_t)&glRotatef_soloader },
         { "glSampleCoverage", (uintptr_t)&ret0},
-        { "glScalef", (uintptr_t)&glScalef },
+        { "glScalef", (uintptr_t)&glScalef_soloader },
         { "glScissor", (uintptr_t)&glScissor },
         { "glShadeModel", (uintptr_t)&ret0 },
         { "glShaderSource", (uintptr_t)&glShaderSourceHook },
         { "glStencilFunc", (uintptr_t)&glStencilFunc },
         { "glStencilMask", (uintptr_t)&glStencilMask },
         { "glStencilOp", (uintptr_t)&glStencilOp },
-        { "glTexCoordPointer", (uintptr_t)&glTexCoordPointer },
+        { "glTexCoordPointer", (uintptr_t)&glTexCoordPointer_soloader },
         { "glTexEnvf", (uintptr_t)&glTexEnvf },
         { "glTexEnvfv", (uintptr_t)&glTexEnvfv },
         { "glTexEnvi", (uintptr_t)&glTexEnvi },
-        { "glTexParameterf", (uintptr_t)&glTexParameterf },
-        { "glTexParameteri", (uintptr_t)&glTexParameteri },
-        { "glTexParameterx", (uintptr_t)&glTexParameterx },
-        { "glTexSubImage2D", (uintptr_t)&glTexSubImage2D },
-        { "glTranslatef", (uintptr_t)&glTranslatef },
+        { "glTexParameterf", (uintptr_t)&glTexParameterf_soloader },
+        { "glTexParameteri", (uintptr_t)&glTexParameteri_soloader },
+        { "glTexParameterx", (uintptr_t)&glTexParameterx_soloader },
+        { "glTexSubImage2D", (uintptr_t)&glTexSubImage2D_soloader },
+        { "glTranslatef", (uintptr_t)&glTranslatef_soloader },
         { "glUniform1f", (uintptr_t)&glUniform1f },
         { "glUniform1fv", (uintptr_t)&glUniform1fv},
         { "glUniform1i", (uintptr_t)&glUniform1i},
@@ -405,10 +391,10 @@ so_default_dynlib default_dynlib[] = {
         { "glUniform4fv", (uintptr_t)&glUniform4fv},
         { "glUniform4iv", (uintptr_t)&glUniform4iv },
         { "glUniformMatrix4fv", (uintptr_t)&glUniformMatrix4fv},
-        { "glUseProgram", (uintptr_t)&glUseProgram },
+        { "glUseProgram", (uintptr_t)&glUseProgram_soloader },
         { "glVertexAttrib4f", (uintptr_t)&glVertexAttrib4f},
-        { "glVertexAttribPointer", (uintptr_t)&glVertexAttribPointer},
-        { "glVertexPointer", (uintptr_t)&glVertexPointer },
+        { "glVertexAttribPointer", (uintptr_t)&glVertexAttribPointer_soloader },
+        { "glVertexPointer", (uintptr_t)&glVertexPointer_soloader },
         { "glViewport", (uintptr_t)&glViewport },
         { "gmtime", (uintptr_t)&gmtime},
         { "iswalpha", (uintptr_t)&iswalpha},
@@ -423,16 +409,16 @@ so_default_dynlib default_dynlib[] = {
         { "ldexpf", (uintptr_t)&ldexpf},
         { "localtime", (uintptr_t)&localtime},
         { "log10", (uintptr_t)&log10},
-        { "logf", (uintptr_t)&logf },
+        { "logf", (uintptr_t)&logf_soloader },
         { "longjmp", (uintptr_t)&sceLibcBridge_longjmp},
         { "lrand48", (uintptr_t)&lrand48 },
-        { "lseek", (uintptr_t)&lseek},
-        { "malloc", (uintptr_t)&malloc },
-        { "memchr", (uintptr_t)&memchr},
-        { "memcmp", (uintptr_t)&memcmp },
-        { "memcpy", (uintptr_t)&memcpy },
-        { "memmove", (uintptr_t)&memmove },
-        { "memset", (uintptr_t)&memset },
+        { "lseek", (uintptr_t)&lseek_soloader },
+        { "malloc", (uintptr_t)&malloc_soloader },
+        { "memchr", (uintptr_t)&memchr_soloader },
+        { "memcmp", (uintptr_t)&memcmp_soloader },
+        { "memcpy", (uintptr_t)&memcpy_soloader },
+        { "memmove", (uintptr_t)&memmove_soloader },
+        { "memset", (uintptr_t)&memset_soloader },
         { "mktime", (uintptr_t)&mktime},
         { "mmap", (uintptr_t)&mmap},
         { "modff", (uintptr_t)&modff},
@@ -440,7 +426,7 @@ so_default_dynlib default_dynlib[] = {
         { "nanosleep", (uintptr_t)&nanosleep },
         { "open", (uintptr_t)&open_soloader },
         { "pow", (uintptr_t)&pow },
-        { "powf", (uintptr_t)&powf },
+        { "powf", (uintptr_t)&powf_soloader },
         { "printf", (uintptr_t)&sceClibPrintf },
         { "pthread_attr_destroy", (uintptr_t)&pthread_attr_destroy_soloader },
         { "pthread_attr_init", (uintptr_t)&pthread_attr_init_soloader },
@@ -473,46 +459,47 @@ so_default_dynlib default_dynlib[] = {
         { "pthread_setname_np", (uintptr_t)&pthread_setname_np_soloader },
         { "pthread_setschedparam", (uintptr_t)&pthread_setschedparam_soloader },
         { "pthread_setspecific", (uintptr_t)&pthread_setspecific },
-        { "putc", (uintptr_t)&putc},
+        { "putc", (uintptr_t)&fputc_soloader },
         { "putchar", (uintptr_t)&putchar},
         { "puts", (uintptr_t)&puts },
         { "qsort", (uintptr_t)&sceLibcBridge_qsort},
-        { "read", (uintptr_t)&read},
-        { "realloc", (uintptr_t)&realloc},
+        { "read", (uintptr_t)&read_soloader },
+        { "realloc", (uintptr_t)&realloc_soloader },
         { "recvfrom", (uintptr_t)&recvfrom},
-        { "remove", (uintptr_t)&remove },
-        { "rename", (uintptr_t)&rename },
+        { "remove", (uintptr_t)&remove_soloader },
+        { "rename", (uintptr_t)&rename_soloader },
         { "sched_yield", (uintptr_t)&sched_yield},
         { "select", (uintptr_t)&select},
         { "sendto", (uintptr_t)&sendto},
         { "setjmp", (uintptr_t)&sceLibcBridge_setjmp},
         { "setlocale", (uintptr_t)&ret0},
         { "setsockopt", (uintptr_t)&setsockopt},
-        { "setvbuf", (uintptr_t)&setvbuf},
+        { "setvbuf", (uintptr_t)&setvbuf_soloader },
         { "sin", (uintptr_t)&sin },
-        { "sinf", (uintptr_t)&sinf },
+        { "sinf", (uintptr_t)&sinf_soloader },
+        { "sincosf", (uintptr_t)&sincosf_soloader },
         { "sinh", (uintptr_t)&sinh},
         { "snprintf", (uintptr_t)&snprintf },
         { "socket", (uintptr_t)&socket},
         { "sprintf", (uintptr_t)&sprintf },
-        { "sqrt", (uintptr_t)&sqrt },
-        { "sqrtf", (uintptr_t)&sqrtf },
+        { "sqrt", (uintptr_t)&sqrt_soloader },
+        { "sqrtf", (uintptr_t)&sqrtf_soloader },
         { "srand48", (uintptr_t)&srand48 },
         { "sscanf", (uintptr_t)&sceLibcBridge_sscanf },
         { "strcasecmp", (uintptr_t)&strcasecmp },
         { "strcat", (uintptr_t)&strcat },
         { "strchr", (uintptr_t)&strchr },
-        { "strcmp", (uintptr_t)&strcmp },
+        { "strcmp", (uintptr_t)&strcmp_soloader },
         { "strcoll", (uintptr_t)&strcoll},
         { "strcpy", (uintptr_t)&strcpy },
         { "strcspn", (uintptr_t)&strcspn},
         { "strdup", (uintptr_t)&strdup },
         { "strerror", (uintptr_t)&strerror},
         { "strftime", (uintptr_t)&strftime},
-        { "strlen", (uintptr_t)&strlen },
+        { "strlen", (uintptr_t)&strlen_soloader },
         { "strncasecmp", (uintptr_t)&strncasecmp},
         { "strncat", (uintptr_t)&strncat},
-        { "strncmp", (uintptr_t)&strncmp },
+        { "strncmp", (uintptr_t)&strncmp_soloader },
         { "strncpy", (uintptr_t)&strncpy},
         { "strpbrk", (uintptr_t)&strpbrk },
         { "strrchr", (uintptr_t)&strrchr},
@@ -532,8 +519,8 @@ so_default_dynlib default_dynlib[] = {
         { "towlower", (uintptr_t)&towlower},
         { "towupper", (uintptr_t)&towupper},
         { "uname", (uintptr_t)&uname_fake },
-        { "ungetc", (uintptr_t)&sceLibcBridge_ungetc},
-        { "unlink", (uintptr_t)&unlink},
+        { "ungetc", (uintptr_t)&ungetc_soloader },
+        { "unlink", (uintptr_t)&unlink_soloader },
         { "usleep", (uintptr_t)&usleep},
         { "vsnprintf", (uintptr_t)&vsnprintf},
         { "vsprintf", (uintptr_t)&vsprintf },
@@ -553,11 +540,13 @@ void resolve_imports(so_module* mod) {
     __sF_fake[1] = *stdout;
     __sF_fake[2] = *stderr;
 
+    // Levels above 0 are dropped by the texture upload hooks in that case
     if (setting_enableMipMaps == false) {
-        default_dynlib[0].func = (uintptr_t)&glCompressedTexImage2D_hook;
         default_dynlib[1].func = (uintptr_t)&ret0;
-        default_dynlib[2].func = (uintptr_t)&glTexImage2D_hook;
     }
 
+    gltrace_install(default_dynlib,
+                    sizeof(default_dynlib) / sizeof(default_dynlib[0]));
+
     so_resolve(mod, default_dynlib, sizeof(default_dynlib), 0);
 }
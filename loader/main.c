@@ -11,12 +11,17 @@
  * of the MIT license. See the LICENSE file for details.
  */
 
+#include "patch.h"
+#include "utils/clockgov.h"
 #include "utils/init.h"
 #include "utils/glutil.h"
 #include "reimpl/controls.h"
+#include "utils/logger.h"
+#include "utils/prefetch.h"
 #include "utils/settings.h"
 
 #include <psp2/kernel/threadmgr.h>
+#include <psp2/power.h>
 
 #include <FalsoJNI/FalsoJNI.h>
 #include <so_util/so_util.h>
@@ -28,6 +33,29 @@ int sceLibcHeapSize = 4 * 1024 * 1024;
 
 so_module so_mod;
 
+static clockgov clocks;
+static uint32_t last_frame_start;
+
+static void clocks_apply(const clockgov_clocks * c) {
+    scePowerSetArmClockFrequency(c->arm);
+    scePowerSetBusClockFrequency(c->bus);
+    scePowerSetGpuClockFrequency(c->gpu);
+    scePowerSetGpuXbarClockFrequency(c->xbar);
+    logv_debug("[clocks] ARM %u, bus %u, GPU %u, xbar %u MHz", c->arm, c->bus, c->gpu, c->xbar);
+}
+
+// The frame that started at `frame_start` is rendered, the FPS lock wait is still ahead
+static void frame_rendered(uint32_t frame_start) {
+    uint32_t work_us = sceKernelGetProcessTimeLow() - frame_start;
+    uint32_t frame_us = frame_start - last_frame_start; // previous frame, whole
+    last_frame_start = frame_start;
+
+    patch__graphics_frame(work_us);
+    prefetch_frame();
+    if (setting_dynamicClocks)
+        clockgov_frame(&clocks, work_us, frame_us, patch__menu_frame());
+}
+
 int main(int argc, char* argv[]) {
     soloader_init_all();
 
@@ -49,11 +77,17 @@ int main(int argc, char* argv[]) {
     Java_com_gameloft_android_ANMP_GloftSDHM_Game_nativeInit();
     Java_com_gameloft_android_ANMP_GloftSDHM_GameRenderer_nativeResize(&jni, NULL, 960, 544);
 
+    if (setting_dynamicClocks)
+        clockgov_init(&clocks, setting_fpsLock > 0 ? (float)setting_fpsLock : 30.f, clocks_apply);
+    last_frame_start = sceKernelGetProcessTimeLow();
+
     if (setting_fpsLock == 0 || setting_fpsLock == 30) {
         while (1) {
+            uint32_t frame_start = sceKernelGetProcessTimeLow();
             controls_poll();
             Java_com_gameloft_android_ANMP_GloftSDHM_GameRenderer_nativeRender();
-            vglSwapBuffers(0);
+            frame_rendered(frame_start);
+            gl_swap();
         }
     }
 
@@ -62,8 +96,10 @@ int main(int argc, char* argv[]) {
         uint32_t delta = (1000000 / (setting_fpsLock+1));
 
         while (1) {
+            uint32_t frame_start = sceKernelGetProcessTimeLow();
             controls_poll();
             Java_com_gameloft_android_ANMP_GloftSDHM_GameRenderer_nativeRender();
+            frame_rendered(frame_start);
 
             while (sceKernelGetProcessTimeLow() - last_render_time < delta) {
                 sched_yield();
@@ -71,7 +107,7 @@ int main(int argc, char* argv[]) {
 
             last_render_time = sceKernelGetProcessTimeLow();
 
-            vglSwapBuffers(0);
+            gl_swap();
         }
     }
 
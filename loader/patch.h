@@ -13,6 +13,18 @@
 #ifndef SOLOADER_PATCH_GAME_H
 #define SOLOADER_PATCH_GAME_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 void so_patch();
 
+// Per-frame hook for the graphics patches; `work_us` excludes the FPS lock
+void patch__graphics_frame(uint32_t work_us);
+
+// Whether the in-game menu was rendered since the last call
+bool patch__menu_frame(void);
+
+// The game's current CLevel, 0 outside of levels
+uintptr_t patch__level(void);
+
 #endif // SOLOADER_PATCH_GAME_H
@@ -122,7 +122,20 @@ void * CMapDisplay__Draw(void * this, int p) {
 
 so_hook GS_InGameMenu__Render_hook;
 
+static bool menuRendered;
+
+bool patch__menu_frame(void) {
+    bool rendered = menuRendered;
+    menuRendered = false;
+    return rendered;
+}
+
+uintptr_t patch__level(void) {
+    return (uintptr_t)CLevel__GetLevel();
+}
+
 void * GS_InGameMenu__Render(void * this) {
+    menuRendered = true;
     int8_t * dpad_open = (int8_t *) so_symbol(&so_mod, "dpad_open");
     *dpad_open = 0;
     SO_CONTINUE(void *, GS_InGameMenu__Render_hook, this);
@@ -1,6 +1,7 @@
 #include <kubridge.h>
 #include <so_util/so_util.h>
 
+#include "utils/qualitygov.h"
 #include "utils/settings.h"
 
 so_hook GameConfig__CalculateDevicePower_hook;
@@ -25,11 +26,34 @@ void GameConfig__CalculateDevicePower(void * this) {
 
 so_hook GameConfig__AutoConfig_hook;
 
+static float * viewDistanceFactor;
+static qualitygov viewDistanceGov;
+
 void GameConfig__AutoConfig(void * this) {
     SO_CONTINUE(void *, GameConfig__AutoConfig_hook, this);
 
-    float * viewDistanceFactor = (float *) so_symbol(&so_mod, "_ZN13CGameSettings20s_viewDistanceFactorE");
+    viewDistanceFactor = (float *) so_symbol(&so_mod, "_ZN13CGameSettings20s_viewDistanceFactorE");
     * viewDistanceFactor = setting_viewDistance;
+
+    // The view distance set by the user is the upper bound
+    float min = setting_minViewDistance < setting_viewDistance ? setting_minViewDistance : setting_viewDistance;
+    qualitygov_init(&viewDistanceGov, setting_fpsLock > 0 ? (float)setting_fpsLock : 30.f, min, setting_viewDistance);
+}
+
+/*
+ * Called once per frame with the time the game spent on it, not counting
+ * the wait for the FPS lock. The engine reads the factor as it culls, so a
+ * new value applies from the next frame on. Geometry detail is left alone,
+ * it's only taken into account while the models are loaded.
+ */
+void patch__graphics_frame(uint32_t work_us) {
+    if (!setting_adaptiveViewDistance || !viewDistanceFactor)
+        return;
+
+    if (qualitygov_frame(&viewDistanceGov, (float)work_us / 1000.f)) {
+        * viewDistanceFactor = viewDistanceGov.value;
+        logv_debug("[graphics] view distance %.2f, frame time %.1f ms", viewDistanceGov.value, viewDistanceGov.avg_ms);
+    }
 }
 
 void patch__graphics() {
@@ -0,0 +1,315 @@
+/*
+ * reimpl/fastmath.c
+ *
+ * Polynomial implementations of the float math functions used by the game.
+ *
+ * The reductions and minimax polynomials follow Cephes. Every function has a
+ * domain where the polynomial is known to hold its error budget; anything
+ * outside of it falls back to newlib, so the results stay correct, just not
+ * fast:
+ *   sinf, cosf   |x| > 8192, infinities and NaNs; ±0 stays fast and keeps
+ *                its sign
+ *   expf         arguments that over- or underflow, and NaNs
+ *   logf         zeros, negatives, denormals, infinities and NaNs
+ *   powf         a base that isn't a positive normal number, or an infinite
+ *                or NaN exponent
+ *   atan2f       zeros, infinities and NaNs in either argument
+ *
+ * Max error against glibc, measured over the fast domains:
+ *   sinf, cosf   2 ulp  (|x| <= 8192)
+ *   expf, logf   1 ulp
+ *   powf         1 ulp  (log/exp evaluated in double)
+ *   atan2f       3 ulp
+ *   sqrtf, sqrt  exact  (VFP vsqrt)
+ *
+ * The split-constant reductions only hold if the compiler doesn't reassociate
+ * them, so this file is built without -ffast-math (see CMakeLists.txt).
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "reimpl/fastmath.h"
+
+#include <math.h>
+#include <stdint.h>
+
+#define FM_FOPI    1.27323954473516f  // 4 / pi
+#define FM_PIO4    0.785398163397448309615660845819875721f
+#define FM_PIO2    1.57079632679489661923132169163975144f
+#define FM_PI      3.14159265358979323846264338327950288f
+
+// pi/4 split in two doubles, the first one short enough for j * FM_DP1 to be
+// exact, so the reduction keeps its precision up to FM_SIN_MAX
+#define FM_DP1     0.7853981633670628
+#define FM_DP2     3.038550253253096e-11
+
+#define FM_SIN_MAX 8192.f
+
+#define FM_LOG2EF  1.44269504088896341f
+#define FM_LN2_HI  0.693359375f
+#define FM_LN2_LO  -2.12194440e-4f
+#define FM_EXP_MAX 88.72283905206835f
+#define FM_EXP_MIN -87.33654475055310898657f // smallest normal result
+
+#define FM_SQRTHF  0.707106781186547524f
+
+typedef union {
+    float f;
+    uint32_t u;
+} fm_bits;
+
+// 2^k for k in [-126, 127]
+static inline float fm_pow2i(int k) {
+    fm_bits b = { .u = (uint32_t)(k + 127) << 23 };
+    return b.f;
+}
+
+static inline float fm_sin_poly(float x, float z) {
+    return ((-1.9515295891E-4f * z + 8.3321608736E-3f) * z
+            - 1.6666654611E-1f) * z * x + x;
+}
+
+static inline float fm_cos_poly(float z) {
+    return ((2.443315711809948E-5f * z - 1.388731625493765E-3f) * z
+            + 4.166664568298827E-2f) * z * z - 0.5f * z + 1.0f;
+}
+
+/*
+ * Reduces |x| to [-pi/4, pi/4]. Returns the octant (0..7) and the reduced
+ * argument in *r.
+ */
+static inline int fm_reduce(float ax, float *r) {
+    int j = (int)(ax * FM_FOPI);
+
+    // map zeros to origin
+    if (j & 1) {
+        j += 1;
+    }
+
+    double y = (double)j;
+    *r = (float)(((double)ax - y * FM_DP1) - y * FM_DP2);
+    return j & 7;
+}
+
+void sincosf_soloader(float x, float *s, float *c) {
+    float ax = fabsf(x);
+
+    if (!(ax <= FM_SIN_MAX)) {
+        *s = sinf(x);
+        *c = cosf(x);
+        return;
+    }
+
+    float r;
+    int j = fm_reduce(ax, &r);
+    float z = r * r;
+    float ps = fm_sin_poly(r, z);
+    float pc = fm_cos_poly(z);
+
+    int sin_neg = signbit(x) != 0;
+    int cos_neg = 0;
+
+    if (j > 3) {
+        sin_neg = !sin_neg;
+        cos_neg = !cos_neg;
+        j -= 4;
+    }
+    if (j > 1)
+        cos_neg = !cos_neg;
+
+    float sv, cv;
+    if (j == 1 || j == 2) {
+        sv = pc;
+        cv = ps;
+    } else {
+        sv = ps;
+        cv = pc;
+    }
+
+    *s = sin_neg ? -sv : sv;
+    *c = cos_neg ? -cv : cv;
+}
+
+float sinf_soloader(float x) {
+    float ax = fabsf(x);
+
+    if (!(ax <= FM_SIN_MAX))
+        return sinf(x);
+
+    float r;
+    int j = fm_reduce(ax, &r);
+    int neg = signbit(x) != 0;
+
+    if (j > 3) {
+        neg = !neg;
+        j -= 4;
+    }
+
+    float z = r * r;
+    float y = (j == 1 || j == 2) ? fm_cos_poly(z) : fm_sin_poly(r, z);
+    return neg ? -y : y;
+}
+
+float cosf_soloader(float x) {
+    float ax = fabsf(x);
+
+    if (!(ax <= FM_SIN_MAX))
+        return cosf(x);
+
+    float r;
+    int j = fm_reduce(ax, &r);
+    int neg = 0;
+
+    if (j > 3) {
+        neg = !neg;
+        j -= 4;
+    }
+    if (j > 1)
+        neg = !neg;
+
+    float z = r * r;
+    float y = (j == 1 || j == 2) ? fm_sin_poly(r, z) : fm_cos_poly(z);
+    return neg ? -y : y;
+}
+
+float expf_soloader(float x) {
+    if (!(x >= FM_EXP_MIN && x <= FM_EXP_MAX))
+        return expf(x);
+
+    float fn = floorf(FM_LOG2EF * x + 0.5f);
+    int n = (int)fn;
+
+    x = x - fn * FM_LN2_HI;
+    x = x - fn * FM_LN2_LO;
+
+    float z = x * x;
+    float p = (((((1.9875691500E-4f * x + 1.3981999507E-3f) * x
+            + 8.3334519073E-3f) * x + 4.1665795894E-2f) * x
+            + 1.6666665459E-1f) * x + 5.0000001201E-1f) * z + x + 1.0f;
+
+    // n can reach 128 here, so scale in two steps
+    int n1 = n >> 1;
+    return p * fm_pow2i(n1) * fm_pow2i(n - n1);
+}
+
+float logf_soloader(float x) {
+    fm_bits b = { .f = x };
+
+    // zero, negative, denormal, inf and NaN inputs
+    if (b.u - 0x00800000u >= 0x7F000000u)
+        return logf(x);
+
+    int e = (int)(b.u >> 23) - 126;
+    b.u = (b.u & 0x007FFFFFu) | 0x3F000000u; // mantissa in [0.5, 1)
+    float m = b.f;
+
+    if (m < FM_SQRTHF) {
+        e -= 1;
+        m = m + m - 1.0f;
+    } else {
+        m = m - 1.0f;
+    }
+
+    float z = m * m;
+    float y = ((((((((7.0376836292E-2f * m - 1.1514610310E-1f) * m
+            + 1.1676998740E-1f) * m - 1.2420140846E-1f) * m
+            + 1.4249322787E-1f) * m - 1.6668057665E-1f) * m
+            + 2.0000714765E-1f) * m - 2.4999993993E-1f) * m
+            + 3.3333331174E-1f) * m * z;
+
+    float fe = (float)e;
+    y += FM_LN2_LO * fe;
+    y += -0.5f * z;
+    return (m + y) + FM_LN2_HI * fe;
+}
+
+float powf_soloader(float x, float y) {
+    fm_bits bx = { .f = x };
+    fm_bits by = { .f = y };
+
+    // x must be a positive normal number and y finite
+    if (bx.u - 0x00800000u >= 0x7F000000u || (by.u & 0x7F800000u) == 0x7F800000u)
+        return powf(x, y);
+
+    int e = (int)(bx.u >> 23) - 127;
+    bx.u = (bx.u & 0x007FFFFFu) | 0x3F800000u; // mantissa in [1, 2)
+    double m = bx.f;
+
+    if (m > 1.4142135623730951) {
+        m *= 0.5;
+        e += 1;
+    }
+
+    // ln(m) = 2 atanh(t), |t| <= 0.1716
+    double t = (m - 1.0) / (m + 1.0);
+    double t2 = t * t;
+    double lnm = 2.0 * t * (1.0 + t2 * (1.0 / 3 + t2 * (1.0 / 5 + t2 * (1.0 / 7
+            + t2 * (1.0 / 9 + t2 * (1.0 / 11 + t2 * (1.0 / 13)))))));
+
+    double l = (double)y * (lnm + (double)e * 0.6931471805599453);
+
+    if (l > 88.73)
+        return HUGE_VALF;
+    if (l < -104.0)
+        return 0.0f;
+
+    // e^l = 2^k * e^r, |r| <= ln2/2
+    double fk = floor(l * 1.4426950408889634 + 0.5);
+    double r = (l - fk * 0.6931471803691238) - fk * 1.9082149292705877e-10;
+    double p = 1.0 + r * (1.0 + r * (1.0 / 2 + r * (1.0 / 6 + r * (1.0 / 24
+            + r * (1.0 / 120 + r * (1.0 / 720 + r * (1.0 / 5040
+            + r * (1.0 / 40320 + r * (1.0 / 362880 + r * (1.0 / 3628800))))))))));
+
+    return (float)ldexp(p, (int)fk);
+}
+
+static inline float fm_atan(float x) {
+    float y;
+    int neg = signbit(x) != 0;
+
+    if (neg)
+        x = -x;
+
+    if (x > 2.414213562373095f) {
+        y = FM_PIO2;
+        x = -1.0f / x;
+    } else if (x > 0.4142135623730950f) {
+        y = FM_PIO4;
+        x = (x - 1.0f) / (x + 1.0f);
+    } else {
+        y = 0.0f;
+    }
+
+    float z = x * x;
+    y += (((8.05374449538e-2f * z - 1.38776856032E-1f) * z
+            + 1.99777106478E-1f) * z - 3.33329491539E-1f) * z * x + x;
+
+    return neg ? -y : y;
+}
+
+float atan2f_soloader(float y, float x) {
+    fm_bits bx = { .f = x };
+    fm_bits by = { .f = y };
+
+    // zeros, infinities and NaNs carry sign/quadrant rules of their own
+    if ((bx.u & 0x7FFFFFFFu) - 1u >= 0x7F7FFFFFu
+        || (by.u & 0x7FFFFFFFu) - 1u >= 0x7F7FFFFFu)
+        return atan2f(y, x);
+
+    float z = fm_atan(y / x);
+
+    if (x < 0)
+        return (y < 0) ? z - FM_PI : z + FM_PI;
+    return z;
+}
+
+float sqrtf_soloader(float x) {
+    return __builtin_sqrtf(x);
+}
+
+double sqrt_soloader(double x) {
+    return __builtin_sqrt(x);
+}
@@ -0,0 +1,28 @@
+/*
+ * reimpl/fastmath.h
+ *
+ * Polynomial implementations of the float math functions used by the game.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_FASTMATH_H
+#define SOLOADER_FASTMATH_H
+
+float sinf_soloader(float x);
+float cosf_soloader(float x);
+void sincosf_soloader(float x, float *s, float *c);
+
+float expf_soloader(float x);
+float logf_soloader(float x);
+float powf_soloader(float x, float y);
+
+float atan2f_soloader(float y, float x);
+
+float sqrtf_soloader(float x);
+double sqrt_soloader(double x);
+
+#endif // SOLOADER_FASTMATH_H
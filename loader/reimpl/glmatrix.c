@@ -0,0 +1,377 @@
+/*
+ * reimpl/glmatrix.c
+ *
+ * CPU-side fixed-function matrix stack. Matrices are only handed over to
+ * vitaGL when something actually consumes them (draw calls, lights, clip
+ * planes, queries).
+ *
+ * The engine rebuilds its modelview with long Push/Translate/Rotate/Pop
+ * sequences, many of which never reach a draw call or end up producing the
+ * matrix that is already loaded. Keeping the stacks here turns every such
+ * call into a few NEON instructions, and a flush uploads only what really
+ * changed. GL_TEXTURE matrices are per texture unit in GLES1 and rarely used,
+ * so that mode is passed straight through to vitaGL.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "reimpl/glmatrix.h"
+
+#include <arm_neon.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "reimpl/fastmath.h"
+#include "utils/logger.h"
+
+#define GLMATRIX_STACK_DEPTH 32
+
+#define DEG2RAD 0.01745329251994329577f
+
+#define MAT4_IDENTITY { 1.f, 0.f, 0.f, 0.f, \
+                        0.f, 1.f, 0.f, 0.f, \
+                        0.f, 0.f, 1.f, 0.f, \
+                        0.f, 0.f, 0.f, 1.f }
+
+// Column-major, as in GL
+typedef struct mat4 {
+    float m[16];
+} __attribute__((aligned(16))) mat4;
+
+typedef struct glmatrix_stack {
+    GLenum mode;
+    int top;
+    bool dirty;
+    bool uploaded_valid;
+    mat4 uploaded;
+    mat4 stack[GLMATRIX_STACK_DEPTH];
+} glmatrix_stack;
+
+static glmatrix_stack s_modelview = {
+        .mode = GL_MODELVIEW,
+        .dirty = true,
+        .stack[0] = { MAT4_IDENTITY },
+};
+
+static glmatrix_stack s_projection = {
+        .mode = GL_PROJECTION,
+        .dirty = true,
+        .stack[0] = { MAT4_IDENTITY },
+};
+
+// Matrix mode as seen by the game
+static GLenum s_mode = GL_MODELVIEW;
+// Stack for s_mode; NULL when the mode is passed through to vitaGL
+static glmatrix_stack * s_current = &s_modelview;
+// Matrix mode currently set in vitaGL
+static GLenum s_gl_mode = GL_MODELVIEW;
+
+static inline void gl_set_mode(GLenum mode) {
+    if (s_gl_mode != mode) {
+        glMatrixMode(mode);
+        s_gl_mode = mode;
+    }
+}
+
+/*
+ * out = a * b. out may alias either operand: all of a is loaded up front,
+ * and each column of b is consumed before the same column of out is stored.
+ */
+static inline void mat4_mul(float *out, const float *a, const float *b) {
+    float32x4_t a0 = vld1q_f32(a);
+    float32x4_t a1 = vld1q_f32(a + 4);
+    float32x4_t a2 = vld1q_f32(a + 8);
+    float32x4_t a3 = vld1q_f32(a + 12);
+
+    for (int i = 0; i < 4; i++) {
+        float32x4_t bi = vld1q_f32(b + 4 * i);
+        float32x4_t r = vmulq_lane_f32(a0, vget_low_f32(bi), 0);
+        r = vmlaq_lane_f32(r, a1, vget_low_f32(bi), 1);
+        r = vmlaq_lane_f32(r, a2, vget_high_f32(bi), 0);
+        r = vmlaq_lane_f32(r, a3, vget_high_f32(bi), 1);
+        vst1q_f32(out + 4 * i, r);
+    }
+}
+
+// m = m * T(x, y, z): only the last column changes
+static inline void mat4_translate(float *m, float x, float y, float z) {
+    float32x4_t r = vld1q_f32(m + 12);
+    r = vmlaq_n_f32(r, vld1q_f32(m), x);
+    r = vmlaq_n_f32(r, vld1q_f32(m + 4), y);
+    r = vmlaq_n_f32(r, vld1q_f32(m + 8), z);
+    vst1q_f32(m + 12, r);
+}
+
+// m = m * S(x, y, z)
+static inline void mat4_scale(float *m, float x, float y, float z) {
+    vst1q_f32(m, vmulq_n_f32(vld1q_f32(m), x));
+    vst1q_f32(m + 4, vmulq_n_f32(vld1q_f32(m + 4), y));
+    vst1q_f32(m + 8, vmulq_n_f32(vld1q_f32(m + 8), z));
+}
+
+// m = m * R(angle, x, y, z), angle in degrees
+static inline void mat4_rotate(float *m, float angle, float x, float y,
+                               float z) {
+    float len = sqrtf_soloader(x * x + y * y + z * z);
+    if (len == 0.f)
+        return;
+
+    x /= len;
+    y /= len;
+    z /= len;
+
+    float s, c;
+    sincosf_soloader(angle * DEG2RAD, &s, &c);
+    float ic = 1.f - c;
+
+    mat4 r = {{
+        x * x * ic + c,     y * x * ic + z * s, x * z * ic - y * s, 0.f,
+        x * y * ic - z * s, y * y * ic + c,     y * z * ic + x * s, 0.f,
+        x * z * ic + y * s, y * z * ic - x * s, z * z * ic + c,     0.f,
+        0.f,                0.f,                0.f,                1.f,
+    }};
+
+    mat4_mul(m, m, r.m);
+}
+
+static inline float * top(glmatrix_stack * s) {
+    return s->stack[s->top].m;
+}
+
+static void flush_stack(glmatrix_stack * s) {
+    if (!s->dirty)
+        return;
+
+    s->dirty = false;
+
+    // Push/modify/Pop sequences often land on the matrix that's already there
+    if (s->uploaded_valid && memcmp(top(s), s->uploaded.m, sizeof(mat4)) == 0)
+        return;
+
+    gl_set_mode(s->mode);
+    glLoadMatrixf(top(s));
+    s->uploaded = s->stack[s->top];
+    s->uploaded_valid = true;
+}
+
+void glmatrix_flush(void) {
+    flush_stack(&s_projection);
+    flush_stack(&s_modelview);
+}
+
+void glMatrixMode_soloader(GLenum mode) {
+    s_mode = mode;
+
+    switch (mode) {
+        case GL_MODELVIEW:
+            s_current = &s_modelview;
+            break;
+        case GL_PROJECTION:
+            s_current = &s_projection;
+            break;
+        default:
+            s_current = NULL;
+            break;
+    }
+}
+
+void glLoadIdentity_soloader(void) {
+    if (!s_current) {
+        gl_set_mode(s_mode);
+        glLoadIdentity();
+        return;
+    }
+
+    static const mat4 identity = { MAT4_IDENTITY };
+    s_current->stack[s_current->top] = identity;
+    s_current->dirty = true;
+}
+
+void glLoadMatrixf_soloader(const GLfloat *m) {
+    if (!s_current) {
+        gl_set_mode(s_mode);
+        glLoadMatrixf(m);
+        return;
+    }
+
+    memcpy(top(s_current), m, sizeof(mat4));
+    s_current->dirty = true;
+}
+
+void glMultMatrixf_soloader(const GLfloat *m) {
+    if (!s_current) {
+        gl_set_mode(s_mode);
+        glMultMatrixf(m);
+        return;
+    }
+
+    // The game's pointer isn't necessarily 16-byte aligned
+    mat4 tmp;
+    memcpy(tmp.m, m, sizeof(mat4));
+    mat4_mul(top(s_current), top(s_current), tmp.m);
+    s_current->dirty = true;
+}
+
+void glPushMatrix_soloader(void) {
+    if (!s_current) {
+        gl_set_mode(s_mode);
+        glPushMatrix();
+        return;
+    }
+
+    if (s_current->top + 1 >= GLMATRIX_STACK_DEPTH) {
+        logv_error("glPushMatrix: stack overflow (mode 0x%x)", s_mode);
+        return;
+    }
+
+    s_current->stack[s_current->top + 1] = s_current->stack[s_current->top];
+    s_current->top++;
+}
+
+void glPopMatrix_soloader(void) {
+    if (!s_current) {
+        gl_set_mode(s_mode);
+        glPopMatrix();
+        return;
+    }
+
+    if (s_current->top == 0) {
+        logv_error("glPopMatrix: stack underflow (mode 0x%x)", s_mode);
+        return;
+    }
+
+    s_current->top--;
+    s_current->dirty = true;
+}
+
+void glRotatef_soloader(GLfloat angle, GLfloat x, GLfloat y, GLfloat z) {
+    if (!s_current) {
+        gl_set_mode(s_mode);
+        glRotatef(angle, x, y, z);
+        return;
+    }
+
+    mat4_rotate(top(s_current), angle, x, y, z);
+    s_current->dirty = true;
+}
+
+void glTranslatef_soloader(GLfloat x, GLfloat y, GLfloat z) {
+    if (!s_current) {
+        gl_set_mode(s_mode);
+        glTranslatef(x, y, z);
+        return;
+    }
+
+    mat4_translate(top(s_current), x, y, z);
+    s_current->dirty = true;
+}
+
+void glScalef_soloader(GLfloat x, GLfloat y, GLfloat z) {
+    if (!s_current) {
+        gl_set_mode(s_mode);
+        glScalef(x, y, z);
+        return;
+    }
+
+    mat4_scale(top(s_current), x, y, z);
+    s_current->dirty = true;
+}
+
+void glFrustumf_soloader(GLfloat left, GLfloat right, GLfloat bottom,
+                         GLfloat top_, GLfloat near, GLfloat far) {
+    if (!s_current) {
+        gl_set_mode(s_mode);
+        glFrustumf(left, right, bottom, top_, near, far);
+        return;
+    }
+
+    mat4 f = {{
+        2.f * near / (right - left), 0.f, 0.f, 0.f,
+        0.f, 2.f * near / (top_ - bottom), 0.f, 0.f,
+        (right + left) / (right - left), (top_ + bottom) / (top_ - bottom),
+                -(far + near) / (far - near), -1.f,
+        0.f, 0.f, -2.f * far * near / (far - near), 0.f,
+    }};
+
+    mat4_mul(top(s_current), top(s_current), f.m);
+    s_current->dirty = true;
+}
+
+void glOrthox_soloader(GLfixed left, GLfixed right, GLfixed bottom,
+                       GLfixed top_, GLfixed near, GLfixed far) {
+    if (!s_current) {
+        gl_set_mode(s_mode);
+        glOrthox(left, right, bottom, top_, near, far);
+        return;
+    }
+
+    float l = (float)left / 65536.f;
+    float r = (float)right / 65536.f;
+    float b = (float)bottom / 65536.f;
+    float t = (float)top_ / 65536.f;
+    float n = (float)near / 65536.f;
+    float f = (float)far / 65536.f;
+
+    mat4 o = {{
+        2.f / (r - l), 0.f, 0.f, 0.f,
+        0.f, 2.f / (t - b), 0.f, 0.f,
+        0.f, 0.f, -2.f / (f - n), 0.f,
+        -(r + l) / (r - l), -(t + b) / (t - b), -(f + n) / (f - n), 1.f,
+    }};
+
+    mat4_mul(top(s_current), top(s_current), o.m);
+    s_current->dirty = true;
+}
+
+void glLightfv_soloader(GLenum light, GLenum pname, const GLfloat *params) {
+    // Positions and directions are transformed by the current modelview
+    if (pname == GL_POSITION || pname == GL_SPOT_DIRECTION)
+        glmatrix_flush();
+    glLightfv(light, pname, params);
+}
+
+void glClipPlanef_soloader(GLenum plane, const GLfloat *equation) {
+    glmatrix_flush();
+    glClipPlanef(plane, equation);
+}
+
+void glGetFloatv_soloader(GLenum pname, GLfloat *data) {
+    switch (pname) {
+        case GL_MODELVIEW_MATRIX:
+            memcpy(data, top(&s_modelview), sizeof(mat4));
+            return;
+        case GL_PROJECTION_MATRIX:
+            memcpy(data, top(&s_projection), sizeof(mat4));
+            return;
+        case GL_MATRIX_MODE:
+            *data = (GLfloat)s_mode;
+            return;
+        default:
+            glmatrix_flush();
+            gl_set_mode(s_mode);
+            glGetFloatv(pname, data);
+            return;
+    }
+}
+
+void glGetIntegerv_soloader(GLenum pname, GLint *data) {
+    switch (pname) {
+        case GL_MATRIX_MODE:
+            *data = (GLint)s_mode;
+            return;
+        case GL_MODELVIEW_STACK_DEPTH:
+            *data = s_modelview.top + 1;
+            return;
+        case GL_PROJECTION_STACK_DEPTH:
+            *data = s_projection.top + 1;
+            return;
+        default:
+            glmatrix_flush();
+            gl_set_mode(s_mode);
+            glGetIntegerv(pname, data);
+            return;
+    }
+}
@@ -0,0 +1,47 @@
+/*
+ * reimpl/glmatrix.h
+ *
+ * CPU-side fixed-function matrix stack. Matrices are only handed over to
+ * vitaGL when something actually consumes them (draw calls, lights, clip
+ * planes, queries).
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_GLMATRIX_H
+#define SOLOADER_GLMATRIX_H
+
+#include <vitaGL.h>
+
+void glMatrixMode_soloader(GLenum mode);
+void glLoadIdentity_soloader(void);
+void glLoadMatrixf_soloader(const GLfloat *m);
+void glMultMatrixf_soloader(const GLfloat *m);
+void glPushMatrix_soloader(void);
+void glPopMatrix_soloader(void);
+
+void glRotatef_soloader(GLfloat angle, GLfloat x, GLfloat y, GLfloat z);
+void glTranslatef_soloader(GLfloat x, GLfloat y, GLfloat z);
+void glScalef_soloader(GLfloat x, GLfloat y, GLfloat z);
+
+void glFrustumf_soloader(GLfloat left, GLfloat right, GLfloat bottom,
+                         GLfloat top, GLfloat near, GLfloat far);
+void glOrthox_soloader(GLfixed left, GLfixed right, GLfixed bottom,
+                       GLfixed top, GLfixed near, GLfixed far);
+
+// Consumers of the current modelview matrix
+void glLightfv_soloader(GLenum light, GLenum pname, const GLfloat *params);
+void glClipPlanef_soloader(GLenum plane, const GLfloat *equation);
+void glGetFloatv_soloader(GLenum pname, GLfloat *data);
+void glGetIntegerv_soloader(GLenum pname, GLint *data);
+
+/*
+ * Upload modelview/projection matrices that changed since the last flush.
+ * Must be called before every draw call.
+ */
+void glmatrix_flush(void);
+
+#endif // SOLOADER_GLMATRIX_H
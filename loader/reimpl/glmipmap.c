@@ -0,0 +1,308 @@
+/*
+ * reimpl/glmipmap.c
+ *
+ * Mip chains for uncompressed textures, generated on the CPU the first time
+ * a texture is uploaded and cached on disk afterwards.
+ *
+ * Without mips, every minified texture is sampled at full resolution, which
+ * costs a lot of memory bandwidth on the distant geometry. When mipmapping
+ * is enabled, each level 0 upload of an 8-bit-per-channel GL_TEXTURE_2D is
+ * followed by the rest of its chain, built with a 2x2 box filter (NEON for
+ * RGBA). Chains of larger textures are stored under the hash128 of the base
+ * level, so later boots only read them back. Levels the game uploads itself
+ * still go through and replace ours, and glGenerateMipmap is skipped for
+ * textures that already have a chain. Chains are tracked per GL texture,
+ * which a texture name may share with others (see reimpl/gltexture.c).
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "reimpl/glmipmap.h"
+
+#include <arm_neon.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reimpl/glstate.h"
+#include "reimpl/gltexture.h"
+#include "utils/hash.h"
+#include "utils/logger.h"
+#include "utils/utils.h"
+
+#define GLMIPMAP_MAGIC      "MIPC"
+#define GLMIPMAP_VERSION    1
+#define GLMIPMAP_MAX_SIZE   2048
+#define GLMIPMAP_CACHE_MIN  (16 * 1024) // bytes; smaller chains are rebuilt
+#define GLMIPMAP_NAMES      8192 // as GLTEXTURE_NAMES in gltexture.c
+
+typedef struct glmipmap_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+    uint32_t levels;
+} glmipmap_header;
+
+// Bit per GL texture: whether its current image came with a chain
+static uint32_t s_has_chain[GLMIPMAP_NAMES / 32];
+
+static uint32_t s_built;
+static uint32_t s_loaded;
+
+static inline uint32_t bytes_per_pixel(GLenum format, GLenum type) {
+    if (type != GL_UNSIGNED_BYTE)
+        return 0;
+
+    switch (format) {
+        case GL_RGBA: return 4;
+        case GL_RGB: return 3;
+        case GL_LUMINANCE_ALPHA: return 2;
+        case GL_LUMINANCE:
+        case GL_ALPHA: return 1;
+        default: return 0;
+    }
+}
+
+// Rows are padded to GL_UNPACK_ALIGNMENT, for the game's image and ours
+static inline uint32_t row_stride(uint32_t width, uint32_t bpp,
+                                  uint32_t align) {
+    return (width * bpp + align - 1) & ~(align - 1);
+}
+
+static inline uint32_t mip_dim(uint32_t d, uint32_t level) {
+    d >>= level;
+    return d ? d : 1;
+}
+
+static uint32_t chain_levels(uint32_t width, uint32_t height) {
+    uint32_t d = width > height ? width : height;
+    uint32_t levels = 0;
+    while (d > 1) {
+        d >>= 1;
+        levels++;
+    }
+    return levels;
+}
+
+// Size of levels 1 .. levels
+static size_t chain_size(uint32_t width, uint32_t height, uint32_t bpp,
+                         uint32_t align, uint32_t levels) {
+    size_t size = 0;
+    for (uint32_t l = 1; l <= levels; l++) {
+        size += (size_t)row_stride(mip_dim(width, l), bpp, align)
+                * mip_dim(height, l);
+    }
+    return size;
+}
+
+static inline void set_has_chain(uint32_t texture, bool has) {
+    if (texture >= GLMIPMAP_NAMES)
+        return;
+    if (has)
+        s_has_chain[texture >> 5] |= 1u << (texture & 31);
+    else
+        s_has_chain[texture >> 5] &= ~(1u << (texture & 31));
+}
+
+static inline bool has_chain(uint32_t texture) {
+    if (texture >= GLMIPMAP_NAMES)
+        return false;
+    return s_has_chain[texture >> 5] & (1u << (texture & 31));
+}
+
+// Four RGBA pixels from two rows of eight
+static inline void box_rgba4(const uint8_t * r0, const uint8_t * r1,
+                             uint8_t * out) {
+    uint32x4x2_t a = vld2q_u32((const uint32_t *)r0); // even, odd pixels
+    uint32x4x2_t b = vld2q_u32((const uint32_t *)r1);
+    uint8x16_t a0 = vreinterpretq_u8_u32(a.val[0]);
+    uint8x16_t a1 = vreinterpretq_u8_u32(a.val[1]);
+    uint8x16_t b0 = vreinterpretq_u8_u32(b.val[0]);
+    uint8x16_t b1 = vreinterpretq_u8_u32(b.val[1]);
+
+    uint16x8_t lo = vaddq_u16(vaddl_u8(vget_low_u8(a0), vget_low_u8(a1)),
+                              vaddl_u8(vget_low_u8(b0), vget_low_u8(b1)));
+    uint16x8_t hi = vaddq_u16(vaddl_u8(vget_high_u8(a0), vget_high_u8(a1)),
+                              vaddl_u8(vget_high_u8(b0), vget_high_u8(b1)));
+
+    vst1q_u8(out, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+}
+
+/*
+ * Halves the image with a rounded 2x2 average. An odd last row or column
+ * is averaged with itself.
+ */
+static void downsample(const uint8_t * src, uint32_t width, uint32_t height,
+                       uint32_t bpp, uint32_t align, uint8_t * dst) {
+    uint32_t dw = mip_dim(width, 1);
+    uint32_t dh = mip_dim(height, 1);
+    uint32_t src_stride = row_stride(width, bpp, align);
+    uint32_t dst_stride = row_stride(dw, bpp, align);
+    // Output pixels whose both source columns exist
+    uint32_t pairs = width >> 1;
+
+    for (uint32_t y = 0; y < dh; y++) {
+        const uint8_t * r0 = src + (size_t)(y * 2) * src_stride;
+        const uint8_t * r1 = (y * 2 + 1 < height) ? r0 + src_stride : r0;
+        uint8_t * out = dst + (size_t)y * dst_stride;
+        uint32_t x = 0;
+
+        if (bpp == 4) {
+            for (; x + 4 <= pairs; x += 4)
+                box_rgba4(r0 + x * 8, r1 + x * 8, out + x * 4);
+        }
+
+        for (; x < dw; x++) {
+            uint32_t x0 = x * 2 * bpp;
+            uint32_t x1 = (x * 2 + 1 < width) ? x0 + bpp : x0;
+            for (uint32_t c = 0; c < bpp; c++) {
+                out[x * bpp + c] = (r0[x0 + c] + r0[x1 + c] + r1[x0 + c]
+                                    + r1[x1 + c] + 2) >> 2;
+            }
+        }
+    }
+}
+
+// The chain is laid out with the alignment too, so it's part of the key
+static void chain_key(const void * data, uint32_t width, uint32_t height,
+                      GLenum format, uint32_t bpp, uint32_t align,
+                      char * key) {
+    uint32_t desc[4] = { width, height, format, align };
+    uint8_t digest[HASH128_SIZE];
+
+    hash128_ctx ctx;
+    hash128_init(&ctx);
+    hash128_update(&ctx, desc, sizeof(desc));
+    hash128_update(&ctx, data, glstate_unpack_size(width, height, bpp));
+    hash128_final(&ctx, digest);
+    hex_encode(digest, HASH128_SIZE, key);
+}
+
+static void chain_path(char * out, size_t size, const char * key) {
+    snprintf(out, size, DATA_PATH"mips/%c%c/%s.mip", key[0], key[1], key);
+}
+
+static bool chain_load(const char * path, const glmipmap_header * expected,
+                       uint8_t * chain, size_t size) {
+    FILE * f = fopen(path, "rb");
+    if (!f)
+        return false;
+
+    glmipmap_header h;
+    bool ok = fread(&h, sizeof(h), 1, f) == 1
+              && memcmp(&h, expected, sizeof(h)) == 0
+              && fread(chain, 1, size, f) == size;
+    fclose(f);
+    return ok;
+}
+
+static void chain_store(const char * path, const glmipmap_header * header,
+                        const uint8_t * chain, size_t size) {
+    mkpath((char *)path, 0777);
+    FILE * f = fopen(path, "wb");
+    if (!f)
+        return;
+
+    bool ok = fwrite(header, sizeof(*header), 1, f) == 1
+              && fwrite(chain, 1, size, f) == size;
+    fclose(f);
+
+    // A partial file would just fail to load, but don't leave it around
+    if (!ok)
+        remove(path);
+}
+
+static bool upload_chain(GLenum target, GLint internalFormat, GLsizei width,
+                         GLsizei height, GLenum format, GLenum type,
+                         const GLvoid *data) {
+    uint32_t bpp = bytes_per_pixel(format, type);
+    if (!bpp || !data || width > GLMIPMAP_MAX_SIZE
+        || height > GLMIPMAP_MAX_SIZE)
+        return false;
+
+    uint32_t levels = chain_levels(width, height);
+    if (levels == 0)
+        return false;
+
+    uint32_t align = glstate_unpack_alignment();
+    size_t size = chain_size(width, height, bpp, align, levels);
+    uint8_t * chain = malloc(size);
+    if (!chain)
+        return false;
+
+    bool cache = size >= GLMIPMAP_CACHE_MIN;
+    glmipmap_header header;
+    char path[128];
+
+    if (cache) {
+        char key[HASH128_HEX_LEN + 1];
+        chain_key(data, width, height, format, bpp, align, key);
+        chain_path(path, sizeof(path), key);
+
+        memcpy(header.magic, GLMIPMAP_MAGIC, 4);
+        header.version = GLMIPMAP_VERSION;
+        header.width = width;
+        header.height = height;
+        header.format = format;
+        header.levels = levels;
+    }
+
+    if (cache && chain_load(path, &header, chain, size)) {
+        s_loaded++;
+    } else {
+        const uint8_t * src = data;
+        uint8_t * dst = chain;
+        for (uint32_t l = 1; l <= levels; l++) {
+            downsample(src, mip_dim(width, l - 1), mip_dim(height, l - 1), bpp,
+                       align, dst);
+            src = dst;
+            dst += (size_t)row_stride(mip_dim(width, l), bpp, align)
+                   * mip_dim(height, l);
+        }
+
+        if (cache)
+            chain_store(path, &header, chain, size);
+        s_built++;
+    }
+
+    const uint8_t * level = chain;
+    for (uint32_t l = 1; l <= levels; l++) {
+        uint32_t w = mip_dim(width, l);
+        uint32_t h = mip_dim(height, l);
+        glTexImage2D(target, l, internalFormat, w, h, 0, format, type, level);
+        level += (size_t)row_stride(w, bpp, align) * h;
+    }
+
+    free(chain);
+
+    if (((s_built + s_loaded) & 63) == 0) {
+        logv_debug("[glmipmap] %u chains built, %u read from the cache",
+                   s_built, s_loaded);
+    }
+    return true;
+}
+
+void glmipmap_upload(GLuint storage, GLenum target, GLint internalFormat,
+                     GLsizei width, GLsizei height, GLenum format, GLenum type,
+                     const GLvoid *data) {
+    set_has_chain(storage, upload_chain(target, internalFormat, width, height,
+                                        format, type, data));
+}
+
+void glmipmap_forget(GLuint storage) {
+    set_has_chain(storage, false);
+}
+
+void glGenerateMipmap_soloader(GLenum target) {
+    uint32_t texture = glstate_bound_texture(target);
+    if (texture != GLSTATE_UNKNOWN && has_chain(gltexture_storage(texture)))
+        return;
+
+    glGenerateMipmap(target);
+}
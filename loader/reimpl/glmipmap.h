@@ -0,0 +1,31 @@
+/*
+ * reimpl/glmipmap.h
+ *
+ * Mip chains for uncompressed textures, generated on the CPU the first time
+ * a texture is uploaded and cached on disk afterwards.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_GLMIPMAP_H
+#define SOLOADER_GLMIPMAP_H
+
+#include <vitaGL.h>
+
+void glGenerateMipmap_soloader(GLenum target);
+
+/*
+ * Upload levels 1 and up for the level 0 image just uploaded to the GL
+ * texture `storage` (see reimpl/gltexture.h), if it's a supported format.
+ */
+void glmipmap_upload(GLuint storage, GLenum target, GLint internalFormat,
+                     GLsizei width, GLsizei height, GLenum format, GLenum type,
+                     const GLvoid *data);
+
+// The GL texture `storage` got a new level 0 image without a chain
+void glmipmap_forget(GLuint storage);
+
+#endif // SOLOADER_GLMIPMAP_H
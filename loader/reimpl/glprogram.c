@@ -0,0 +1,319 @@
+/*
+ * reimpl/glprogram.c
+ *
+ * Per-program cache of uniform and attribute names, built at link time.
+ *
+ * The engine looks uniform locations up by name all the time, and vitaGL
+ * answers each lookup with a linear string search through the program.
+ * Here every active uniform and attribute is reflected once in
+ * glLinkProgram, with the loader's name fix-ups already applied, into a small
+ * hash table per program. Names the program doesn't report as active are
+ * asked from vitaGL on first use and remembered as well, unknown ones
+ * included, so repeated lookups never reach vitaGL. A relink rebuilds the
+ * tables, which also covers program names being reused after a delete.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "reimpl/glprogram.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/logger.h"
+
+#define GLPROGRAM_MAX       512 // power of two
+#define GLPROGRAM_NAME_MAX  256
+
+typedef struct glprogram_name {
+    uint32_t hash;
+    uint32_t len;
+    char * name;
+    GLint location;
+    GLint size;
+    GLenum type;
+} glprogram_name;
+
+typedef struct glprogram_names {
+    glprogram_name * names;
+    uint32_t count;
+    uint32_t capacity;
+    uint16_t * index; // 0 for an empty slot, names[i - 1] otherwise
+    uint32_t index_mask;
+} glprogram_names;
+
+typedef struct glprogram {
+    GLuint id; // 0 for a free slot
+    // uniforms.names[0 .. active_uniforms) are in glGetActiveUniform order
+    uint32_t active_uniforms;
+    glprogram_names uniforms;
+    glprogram_names attribs;
+} glprogram;
+
+static glprogram s_programs[GLPROGRAM_MAX];
+static glprogram * s_last;
+
+static inline uint32_t name_hash(const char * name, uint32_t * len) {
+    uint32_t h = 0x811C9DC5u;
+    const char * p = name;
+    while (*p)
+        h = (h ^ (uint8_t)*p++) * 0x01000193u;
+    *len = p - name;
+    return h;
+}
+
+static glprogram * program_get(GLuint id, bool create) {
+    if (id == 0)
+        return NULL;
+    if (s_last && s_last->id == id)
+        return s_last;
+
+    uint32_t slot = (id * 0x9E3779B1u) >> 23;
+    for (int i = 0; i < GLPROGRAM_MAX; i++) {
+        glprogram * p = &s_programs[(slot + i) & (GLPROGRAM_MAX - 1)];
+        if (p->id == id) {
+            s_last = p;
+            return p;
+        }
+        if (p->id == 0) {
+            if (!create)
+                return NULL;
+            p->id = id;
+            s_last = p;
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+static void names_clear(glprogram_names * n) {
+    for (uint32_t i = 0; i < n->count; i++)
+        free(n->names[i].name);
+    free(n->names);
+    free(n->index);
+    memset(n, 0, sizeof(*n));
+}
+
+static glprogram_name * names_find(const glprogram_names * n, const char * name,
+                                   uint32_t len, uint32_t hash) {
+    if (!n->index)
+        return NULL;
+
+    for (uint32_t i = hash & n->index_mask; n->index[i];
+         i = (i + 1) & n->index_mask) {
+        glprogram_name * e = &n->names[n->index[i] - 1];
+        if (e->hash == hash && e->len == len && memcmp(e->name, name, len) == 0)
+            return e;
+    }
+
+    return NULL;
+}
+
+static void names_reindex(glprogram_names * n, uint32_t slots) {
+    uint16_t * index = calloc(slots, sizeof(uint16_t));
+    if (!index)
+        return;
+
+    free(n->index);
+    n->index = index;
+    n->index_mask = slots - 1;
+
+    for (uint32_t e = 0; e < n->count; e++) {
+        uint32_t i = n->names[e].hash & n->index_mask;
+        while (n->index[i])
+            i = (i + 1) & n->index_mask;
+        n->index[i] = e + 1;
+    }
+}
+
+static void names_add(glprogram_names * n, const char * name, uint32_t len,
+                      uint32_t hash, GLint location, GLint size, GLenum type) {
+    if (n->count == 0xFFFF)
+        return;
+
+    if (n->count == n->capacity) {
+        uint32_t capacity = n->capacity ? n->capacity * 2 : 16;
+        glprogram_name * names = realloc(n->names, capacity * sizeof(*names));
+        if (!names)
+            return;
+        n->names = names;
+        n->capacity = capacity;
+    }
+
+    glprogram_name * e = &n->names[n->count];
+    e->name = malloc(len + 1);
+    if (!e->name)
+        return;
+
+    memcpy(e->name, name, len + 1);
+    e->hash = hash;
+    e->len = len;
+    e->location = location;
+    e->size = size;
+    e->type = type;
+    n->count++;
+
+    // Keep the load factor at or below 1/2
+    uint32_t slots = n->index ? n->index_mask + 1 : 0;
+    if (n->count * 2 > slots) {
+        names_reindex(n, slots ? slots * 2 : 32);
+    } else {
+        uint32_t i = hash & n->index_mask;
+        while (n->index[i])
+            i = (i + 1) & n->index_mask;
+        n->index[i] = n->count;
+    }
+}
+
+/*
+ * vitaGL renames "texture" (reserved in CG) to "_texture", and reports the
+ * bone palette as a single matrix. The game expects neither.
+ */
+static void fixup_active_uniform(GLchar * name, GLsizei * length, GLint * size,
+                                 GLenum * type) {
+    if (!strcmp(name, "BoneMatrices")) {
+        *type = GL_FLOAT_MAT4;
+        *size = 48;
+    }
+    if (!strcmp(name, "_texture")) {
+        strcpy(name, "texture");
+        if (length)
+            *length = *length - 1;
+    }
+}
+
+void glLinkProgram_soloader(GLuint program) {
+    glLinkProgram(program);
+
+    glprogram * p = program_get(program, true);
+    if (!p) {
+        logv_error("glLinkProgram: more than %i programs, %u not cached",
+                   GLPROGRAM_MAX, program);
+        return;
+    }
+
+    names_clear(&p->uniforms);
+    names_clear(&p->attribs);
+    p->active_uniforms = 0;
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE)
+        return;
+
+    char name[GLPROGRAM_NAME_MAX];
+    GLsizei length;
+    GLint size;
+    GLenum type;
+    uint32_t len;
+
+    GLint count = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    for (GLint i = 0; i < count; i++) {
+        length = 0;
+        name[0] = '\0';
+        glGetActiveUniform(program, i, sizeof(name), &length, &size, &type,
+                           name);
+        GLint location = glGetUniformLocation(program, name);
+        fixup_active_uniform(name, &length, &size, &type);
+
+        uint32_t hash = name_hash(name, &len);
+        names_add(&p->uniforms, name, len, hash, location, size, type);
+    }
+    // Only complete if every active uniform made it in
+    if (p->uniforms.count == (uint32_t)count)
+        p->active_uniforms = count;
+
+    count = 0;
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+    for (GLint i = 0; i < count; i++) {
+        length = 0;
+        name[0] = '\0';
+        glGetActiveAttrib(program, i, sizeof(name), &length, &size, &type,
+                          name);
+        GLint location = glGetAttribLocation(program, name);
+
+        uint32_t hash = name_hash(name, &len);
+        names_add(&p->attribs, name, len, hash, location, size, type);
+    }
+}
+
+GLint glGetUniformLocation_soloader(GLuint program, const GLchar *name) {
+    uint32_t len;
+    uint32_t hash = name_hash(name, &len);
+
+    glprogram * p = program_get(program, false);
+    if (p) {
+        glprogram_name * e = names_find(&p->uniforms, name, len, hash);
+        if (e)
+            return e->location;
+    }
+
+    GLint location = glGetUniformLocation(program, strcmp(name, "texture")
+                                                   ? name : "_texture");
+    if (p)
+        names_add(&p->uniforms, name, len, hash, location, 0, 0);
+    return location;
+}
+
+GLint glGetAttribLocation_soloader(GLuint program, const GLchar *name) {
+    uint32_t len;
+    uint32_t hash = name_hash(name, &len);
+
+    glprogram * p = program_get(program, false);
+    if (p) {
+        glprogram_name * e = names_find(&p->attribs, name, len, hash);
+        if (e)
+            return e->location;
+    }
+
+    GLint location = glGetAttribLocation(program, name);
+    if (p)
+        names_add(&p->attribs, name, len, hash, location, 0, 0);
+    return location;
+}
+
+static void copy_name(GLchar * dst, GLsizei bufSize, GLsizei * length,
+                      const char * src, uint32_t len) {
+    if (bufSize <= 0) {
+        if (length)
+            *length = 0;
+        return;
+    }
+
+    uint32_t n = len < (uint32_t)bufSize - 1 ? len : (uint32_t)bufSize - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+    if (length)
+        *length = n;
+}
+
+void glGetActiveUniform_soloader(GLuint program, GLuint index, GLsizei bufSize,
+                                 GLsizei *length, GLint *size, GLenum *type,
+                                 GLchar *name) {
+    glprogram * p = program_get(program, false);
+    if (!p || index >= p->active_uniforms) {
+        // The whole name is needed to fix it up, the game's buffer may be
+        // shorter
+        char full[GLPROGRAM_NAME_MAX];
+        GLsizei full_length = -1;
+        full[0] = '\0';
+        glGetActiveUniform(program, index, sizeof(full), &full_length, size,
+                           type, full);
+        if (full_length < 0)
+            return; // index out of range, nothing was written
+        fixup_active_uniform(full, &full_length, size, type);
+        copy_name(name, bufSize, length, full, full_length);
+        return;
+    }
+
+    const glprogram_name * e = &p->uniforms.names[index];
+    *size = e->size;
+    *type = e->type;
+    copy_name(name, bufSize, length, e->name, e->len);
+}
@@ -0,0 +1,26 @@
+/*
+ * reimpl/glprogram.h
+ *
+ * Per-program cache of uniform and attribute names, built at link time.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_GLPROGRAM_H
+#define SOLOADER_GLPROGRAM_H
+
+#include <vitaGL.h>
+
+void glLinkProgram_soloader(GLuint program);
+
+GLint glGetUniformLocation_soloader(GLuint program, const GLchar *name);
+GLint glGetAttribLocation_soloader(GLuint program, const GLchar *name);
+
+void glGetActiveUniform_soloader(GLuint program, GLuint index, GLsizei bufSize,
+                                 GLsizei *length, GLint *size, GLenum *type,
+                                 GLchar *name);
+
+#endif // SOLOADER_GLPROGRAM_H
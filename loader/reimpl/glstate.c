@@ -0,0 +1,314 @@
+/*
+ * reimpl/glstate.c
+ *
+ * Shadow copy of the most frequently set GL state, used to drop calls that
+ * wouldn't change anything before they reach vitaGL.
+ *
+ * The engine re-applies its whole material state for every draw call, and
+ * each of these calls costs a trip through vitaGL's own state handling even
+ * when nothing changes. Every cached value starts out (and is reset to)
+ * "unknown", in which case the call always goes through and the result is
+ * remembered.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "reimpl/glstate.h"
+
+#include <string.h>
+
+#include "reimpl/gltexture.h"
+#include "utils/logger.h"
+
+#define GLSTATE_TEXTURE_UNITS   16
+#define GLSTATE_LOG_INTERVAL    300 // frames
+
+enum {
+    TEX_TARGET_2D,
+    TEX_TARGET_CUBE,
+    TEX_TARGET_NUM
+};
+
+enum {
+    BUF_TARGET_ARRAY,
+    BUF_TARGET_ELEMENT,
+    BUF_TARGET_NUM
+};
+
+enum {
+    CAP_BLEND,
+    CAP_DEPTH_TEST,
+    CAP_CULL_FACE,
+    CAP_ALPHA_TEST,
+    CAP_SCISSOR_TEST,
+    CAP_STENCIL_TEST,
+    CAP_POLYGON_OFFSET_FILL,
+    CAP_FOG,
+    CAP_LIGHTING,
+    CAP_NUM
+};
+
+static struct {
+    uint32_t active_unit; // index, not GL_TEXTUREi
+    uint32_t texture[GLSTATE_TEXTURE_UNITS][TEX_TARGET_NUM];
+    int8_t texture_2d_enabled[GLSTATE_TEXTURE_UNITS];
+    uint32_t buffer[BUF_TARGET_NUM];
+    uint32_t program;
+    int8_t caps[CAP_NUM];
+    uint32_t blend_src;
+    uint32_t blend_dst;
+    uint32_t depth_mask;
+    uint32_t cull_face;
+} s_state;
+
+// Not shadowed state: the game sets it for its uploads, not per draw
+static uint32_t s_unpack_alignment = 4;
+
+static uint32_t s_dropped_frame;
+static uint32_t s_dropped_last;
+static uint64_t s_dropped_total;
+static uint32_t s_frames;
+
+static inline int tex_target_index(GLenum target) {
+    switch (target) {
+        case GL_TEXTURE_2D: return TEX_TARGET_2D;
+        case GL_TEXTURE_CUBE_MAP: return TEX_TARGET_CUBE;
+        default: return -1;
+    }
+}
+
+static inline int buf_target_index(GLenum target) {
+    switch (target) {
+        case GL_ARRAY_BUFFER: return BUF_TARGET_ARRAY;
+        case GL_ELEMENT_ARRAY_BUFFER: return BUF_TARGET_ELEMENT;
+        default: return -1;
+    }
+}
+
+static inline int cap_index(GLenum cap) {
+    switch (cap) {
+        case GL_BLEND: return CAP_BLEND;
+        case GL_DEPTH_TEST: return CAP_DEPTH_TEST;
+        case GL_CULL_FACE: return CAP_CULL_FACE;
+        case GL_ALPHA_TEST: return CAP_ALPHA_TEST;
+        case GL_SCISSOR_TEST: return CAP_SCISSOR_TEST;
+        case GL_STENCIL_TEST: return CAP_STENCIL_TEST;
+        case GL_POLYGON_OFFSET_FILL: return CAP_POLYGON_OFFSET_FILL;
+        case GL_FOG: return CAP_FOG;
+        case GL_LIGHTING: return CAP_LIGHTING;
+        default: return -1;
+    }
+}
+
+// Returns 1 if the value is already current, otherwise stores it
+static inline int filter_u32(uint32_t *cached, uint32_t value) {
+    if (*cached == value) {
+        s_dropped_frame++;
+        return 1;
+    }
+    *cached = value;
+    return 0;
+}
+
+static inline int filter_i8(int8_t *cached, int8_t value) {
+    if (*cached == value) {
+        s_dropped_frame++;
+        return 1;
+    }
+    *cached = value;
+    return 0;
+}
+
+void glstate_invalidate(void) {
+    memset(&s_state, 0xFF, sizeof(s_state));
+}
+
+void glstate_frame_end(void) {
+    s_dropped_last = s_dropped_frame;
+    s_dropped_total += s_dropped_frame;
+    s_dropped_frame = 0;
+
+    if (++s_frames % GLSTATE_LOG_INTERVAL == 0) {
+        logv_debug("[glstate] dropped %u calls last frame, %llu over %u frames",
+                   s_dropped_last, s_dropped_total, s_frames);
+    }
+}
+
+uint32_t glstate_bound_buffer(GLenum target) {
+    int t = buf_target_index(target);
+    return t < 0 ? GLSTATE_UNKNOWN : s_state.buffer[t];
+}
+
+uint32_t glstate_bound_texture(GLenum target) {
+    int t = tex_target_index(target);
+    uint32_t unit = s_state.active_unit;
+    if (t < 0 || unit >= GLSTATE_TEXTURE_UNITS)
+        return GLSTATE_UNKNOWN;
+    return s_state.texture[unit][t];
+}
+
+uint32_t glstate_unpack_alignment(void) {
+    return s_unpack_alignment;
+}
+
+size_t glstate_unpack_size(uint32_t width, uint32_t height, uint32_t bpp) {
+    if (!width || !height)
+        return 0;
+
+    size_t stride = (width * bpp + s_unpack_alignment - 1)
+                    & ~(size_t)(s_unpack_alignment - 1);
+    return stride * (height - 1) + (size_t)width * bpp;
+}
+
+uint32_t glstate_dropped_last_frame(void) {
+    return s_dropped_last;
+}
+
+void glActiveTexture_soloader(GLenum texture) {
+    uint32_t unit = texture - GL_TEXTURE0;
+    if (unit >= GLSTATE_TEXTURE_UNITS) {
+        s_state.active_unit = GLSTATE_UNKNOWN;
+        glActiveTexture(texture);
+        return;
+    }
+
+    if (!filter_u32(&s_state.active_unit, unit))
+        glActiveTexture(texture);
+}
+
+void glBindTexture_soloader(GLenum target, GLuint texture) {
+    int t = tex_target_index(target);
+    uint32_t unit = s_state.active_unit;
+
+    if (t < 0 || unit >= GLSTATE_TEXTURE_UNITS) {
+        gltexture_bind(target, texture);
+        return;
+    }
+
+    if (!filter_u32(&s_state.texture[unit][t], texture))
+        gltexture_bind(target, texture);
+}
+
+void glBindBuffer_soloader(GLenum target, GLuint buffer) {
+    int t = buf_target_index(target);
+
+    if (t < 0) {
+        glBindBuffer(target, buffer);
+        return;
+    }
+
+    if (!filter_u32(&s_state.buffer[t], buffer))
+        glBindBuffer(target, buffer);
+}
+
+void glUseProgram_soloader(GLuint program) {
+    if (!filter_u32(&s_state.program, program))
+        glUseProgram(program);
+}
+
+static void set_cap(GLenum cap, int8_t enabled) {
+    int8_t * cached = NULL;
+
+    if (cap == GL_TEXTURE_2D) {
+        // GLES1 texturing is enabled per texture unit
+        if (s_state.active_unit < GLSTATE_TEXTURE_UNITS)
+            cached = &s_state.texture_2d_enabled[s_state.active_unit];
+    } else {
+        int c = cap_index(cap);
+        if (c >= 0)
+            cached = &s_state.caps[c];
+    }
+
+    if (cached && filter_i8(cached, enabled))
+        return;
+
+    if (enabled)
+        glEnable(cap);
+    else
+        glDisable(cap);
+}
+
+void glEnable_soloader(GLenum cap) {
+    set_cap(cap, 1);
+}
+
+void glDisable_soloader(GLenum cap) {
+    set_cap(cap, 0);
+}
+
+void glBlendFunc_soloader(GLenum sfactor, GLenum dfactor) {
+    if (s_state.blend_src == sfactor && s_state.blend_dst == dfactor) {
+        s_dropped_frame++;
+        return;
+    }
+
+    s_state.blend_src = sfactor;
+    s_state.blend_dst = dfactor;
+    glBlendFunc(sfactor, dfactor);
+}
+
+void glDepthMask_soloader(GLboolean flag) {
+    if (!filter_u32(&s_state.depth_mask, flag ? GL_TRUE : GL_FALSE))
+        glDepthMask(flag);
+}
+
+void glCullFace_soloader(GLenum mode) {
+    if (!filter_u32(&s_state.cull_face, mode))
+        glCullFace(mode);
+}
+
+void glPixelStorei_soloader(GLenum pname, GLint param) {
+    if (pname == GL_UNPACK_ALIGNMENT
+        && (param == 1 || param == 2 || param == 4 || param == 8))
+        s_unpack_alignment = param;
+
+    glPixelStorei(pname, param);
+}
+
+void glDeleteTextures_soloader(GLsizei n, const GLuint *textures) {
+    /*
+     * GL reverts a deleted texture's bindings to 0, but gltexture may keep
+     * the GL texture alive: an alias leaves its image's storage bound, and
+     * a storage that still hosts another name's image isn't deleted at all
+     * until that name lets go of it. So the bindings of both the name and
+     * its storage become unknown rather than 0.
+     */
+    for (GLsizei i = 0; i < n; i++) {
+        if (textures[i] == 0)
+            continue;
+        GLuint storage = gltexture_storage(textures[i]);
+        for (int u = 0; u < GLSTATE_TEXTURE_UNITS; u++) {
+            for (int t = 0; t < TEX_TARGET_NUM; t++) {
+                if (s_state.texture[u][t] == textures[i]
+                    || s_state.texture[u][t] == storage)
+                    s_state.texture[u][t] = GLSTATE_UNKNOWN;
+            }
+        }
+    }
+
+    gltexture_delete(n, textures);
+}
+
+void glDeleteBuffers_soloader(GLsizei n, const GLuint *buffers) {
+    for (GLsizei i = 0; i < n; i++) {
+        if (buffers[i] == 0)
+            continue;
+        for (int t = 0; t < BUF_TARGET_NUM; t++) {
+            if (s_state.buffer[t] == buffers[i])
+                s_state.buffer[t] = 0;
+        }
+    }
+
+    glDeleteBuffers(n, buffers);
+}
+
+void glDeleteProgram_soloader(GLuint program) {
+    // The name may get reused by the next glCreateProgram
+    if (program != 0 && s_state.program == program)
+        s_state.program = GLSTATE_UNKNOWN;
+
+    glDeleteProgram(program);
+}
@@ -0,0 +1,70 @@
+/*
+ * reimpl/glstate.h
+ *
+ * Shadow copy of the most frequently set GL state, used to drop calls that
+ * wouldn't change anything before they reach vitaGL.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_GLSTATE_H
+#define SOLOADER_GLSTATE_H
+
+#include <vitaGL.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define GLSTATE_UNKNOWN 0xFFFFFFFFu
+
+void glActiveTexture_soloader(GLenum texture);
+void glBindTexture_soloader(GLenum target, GLuint texture);
+void glBindBuffer_soloader(GLenum target, GLuint buffer);
+void glUseProgram_soloader(GLuint program);
+void glEnable_soloader(GLenum cap);
+void glDisable_soloader(GLenum cap);
+void glBlendFunc_soloader(GLenum sfactor, GLenum dfactor);
+void glDepthMask_soloader(GLboolean flag);
+void glCullFace_soloader(GLenum mode);
+void glPixelStorei_soloader(GLenum pname, GLint param);
+
+void glDeleteTextures_soloader(GLsizei n, const GLuint *textures);
+void glDeleteBuffers_soloader(GLsizei n, const GLuint *buffers);
+void glDeleteProgram_soloader(GLuint program);
+
+/*
+ * Forget everything known about the GL state. Must be called whenever the
+ * state may have changed behind our back (context creation, MakeCurrent).
+ */
+void glstate_invalidate(void);
+
+// Frame boundary: rolls the per-frame counters
+void glstate_frame_end(void);
+
+/*
+ * Buffer bound to GL_ARRAY_BUFFER / GL_ELEMENT_ARRAY_BUFFER, or
+ * GLSTATE_UNKNOWN if it hasn't been set since the last invalidate.
+ */
+uint32_t glstate_bound_buffer(GLenum target);
+
+/*
+ * Texture bound to GL_TEXTURE_2D / GL_TEXTURE_CUBE_MAP on the active unit,
+ * or GLSTATE_UNKNOWN.
+ */
+uint32_t glstate_bound_texture(GLenum target);
+
+// GL_UNPACK_ALIGNMENT, as the game last set it (4 until then)
+uint32_t glstate_unpack_alignment(void);
+
+/*
+ * Bytes a `width` x `height` upload of `bpp`-byte pixels reads from the
+ * client: rows padded to the unpack alignment, except the last one.
+ */
+size_t glstate_unpack_size(uint32_t width, uint32_t height, uint32_t bpp);
+
+// Number of calls dropped during the last complete frame
+uint32_t glstate_dropped_last_frame(void);
+
+#endif // SOLOADER_GLSTATE_H
@@ -0,0 +1,641 @@
+/*
+ * reimpl/gltexture.c
+ *
+ * Texture uploads: identical images uploaded to different texture names
+ * share one GL texture.
+ *
+ * The engine uploads the same image more than once, e.g. UI atlases that
+ * every level loads again under a new texture name. Each level 0 upload to
+ * a GL_TEXTURE_2D is keyed by the hash128 of its data and parameters; if a
+ * live texture already holds that image, the name is pointed at that
+ * texture instead of getting a copy. Texture names are translated wherever
+ * the game passes one to GL (bind, delete, framebuffer attachment).
+ *
+ * Images live in "storage" textures with a reference count. A storage is
+ * normally the GL texture of the name that uploaded the image first. If that
+ * name is deleted or respecified while others still use its image, the GL
+ * texture is kept for them, and the name itself moves to a texture of our
+ * own. A GL texture is only deleted once neither the game nor a shared
+ * image uses it, so vitaGL never hands out a name the game still holds.
+ *
+ * Sampler parameters are per texture name in GL, so they are recorded per
+ * name and re-applied to a shared storage when a name using it is bound.
+ *
+ * Images are only shared while they stay as uploaded: a partial update
+ * takes the image out of the index. A name updating an image that others
+ * share first gets a copy of its own, made on the GPU through a framebuffer
+ * (with a fresh mip chain), so the update doesn't reach them. Images that
+ * can't be copied that way (compressed, or a format vitaGL can't render
+ * to) are updated for every name, with a warning. Single-colour fills, the
+ * usual starting point of render-to and streamed textures, are never
+ * shared.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "reimpl/gltexture.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "reimpl/glmipmap.h"
+#include "reimpl/glstate.h"
+#include "utils/hash.h"
+#include "utils/logger.h"
+#include "utils/settings.h"
+
+#define GLTEXTURE_NAMES     8192 // texture names handled; larger ones pass
+#define GLTEXTURE_IMAGES    2048
+#define GLTEXTURE_BUCKETS   1024 // power of two
+#define GLTEXTURE_LOG_EVERY 32   // shared uploads
+
+enum {
+    PARAM_MIN_FILTER,
+    PARAM_MAG_FILTER,
+    PARAM_WRAP_S,
+    PARAM_WRAP_T,
+    PARAM_NUM
+};
+
+enum {
+    NAME_OURS = 1,  // created here to hold an image, not known to the game
+    NAME_DEAD = 2,  // deleted by the game, kept while its image is shared
+    NAME_ALIAS = 4  // level 0 upload was matched with an existing image
+};
+
+typedef struct texture_image {
+    uint8_t key[HASH128_SIZE];
+    GLuint storage; // 0 for a free entry
+    uint32_t refs;  // texture names using it
+    uint32_t bytes;
+    uint16_t width;
+    uint16_t height;
+    uint32_t internal_format;
+    uint32_t format; // 0 for a compressed image
+    uint32_t type;
+    uint16_t next;  // in the bucket, or in the free list; index + 1
+    bool keyed;     // findable by key
+    uint16_t params[PARAM_NUM]; // currently set on the storage
+} texture_image;
+
+typedef struct texture_name {
+    GLuint storage;             // 0 for the name's own GL texture
+    uint16_t image;             // image the name uses; index + 1
+    uint16_t hosts;             // image stored in this GL texture; index + 1
+    uint16_t params[PARAM_NUM]; // 0 for the GL default
+    uint8_t flags;
+} texture_name;
+
+static texture_name s_names[GLTEXTURE_NAMES];
+static texture_image s_images[GLTEXTURE_IMAGES];
+static uint16_t s_buckets[GLTEXTURE_BUCKETS];
+static uint16_t s_free;
+static bool s_free_init;
+
+static uint32_t s_shared_uploads;
+static uint64_t s_saved_bytes;
+static bool s_warned_update;
+
+static const GLenum param_names[PARAM_NUM] = {
+    GL_TEXTURE_MIN_FILTER,
+    GL_TEXTURE_MAG_FILTER,
+    GL_TEXTURE_WRAP_S,
+    GL_TEXTURE_WRAP_T
+};
+
+static const GLenum param_defaults[PARAM_NUM] = {
+    GL_NEAREST_MIPMAP_LINEAR,
+    GL_LINEAR,
+    GL_REPEAT,
+    GL_REPEAT
+};
+
+static inline texture_name * name_get(GLuint texture) {
+    return (texture != 0 && texture < GLTEXTURE_NAMES) ? &s_names[texture]
+                                                       : NULL;
+}
+
+static inline texture_image * image_get(uint16_t image) {
+    return image ? &s_images[image - 1] : NULL;
+}
+
+static inline GLuint name_storage(GLuint texture, const texture_name * n) {
+    return n->storage ? n->storage : texture;
+}
+
+static inline int param_index(GLenum pname) {
+    switch (pname) {
+        case GL_TEXTURE_MIN_FILTER: return PARAM_MIN_FILTER;
+        case GL_TEXTURE_MAG_FILTER: return PARAM_MAG_FILTER;
+        case GL_TEXTURE_WRAP_S: return PARAM_WRAP_S;
+        case GL_TEXTURE_WRAP_T: return PARAM_WRAP_T;
+        default: return -1;
+    }
+}
+
+static inline uint32_t bucket_of(const uint8_t * key) {
+    uint32_t h;
+    memcpy(&h, key, sizeof(h));
+    return h & (GLTEXTURE_BUCKETS - 1);
+}
+
+static texture_image * image_find(const uint8_t * key) {
+    for (uint16_t i = s_buckets[bucket_of(key)]; i; i = s_images[i - 1].next) {
+        if (memcmp(s_images[i - 1].key, key, HASH128_SIZE) == 0)
+            return &s_images[i - 1];
+    }
+    return NULL;
+}
+
+static uint16_t image_alloc(const uint8_t * key, GLuint storage,
+                            uint32_t bytes) {
+    if (!s_free_init) {
+        for (uint16_t i = 0; i < GLTEXTURE_IMAGES; i++)
+            s_images[i].next = (i + 1 < GLTEXTURE_IMAGES) ? i + 2 : 0;
+        s_free = 1;
+        s_free_init = true;
+    }
+
+    uint16_t i = s_free;
+    if (!i)
+        return 0;
+
+    texture_image * img = &s_images[i - 1];
+    s_free = img->next;
+
+    memcpy(img->key, key, HASH128_SIZE);
+    img->storage = storage;
+    img->refs = 1;
+    img->bytes = bytes;
+    memset(img->params, 0, sizeof(img->params));
+
+    uint32_t b = bucket_of(key);
+    img->next = s_buckets[b];
+    img->keyed = true;
+    s_buckets[b] = i;
+    return i;
+}
+
+// The image no longer matches its key
+static void image_unkey(texture_image * img) {
+    if (!img->keyed)
+        return;
+
+    uint16_t * link = &s_buckets[bucket_of(img->key)];
+    while (*link && &s_images[*link - 1] != img)
+        link = &s_images[*link - 1].next;
+    if (*link)
+        *link = img->next;
+    img->next = 0;
+    img->keyed = false;
+}
+
+static void image_free(uint16_t i) {
+    texture_image * img = &s_images[i - 1];
+    image_unkey(img);
+
+    texture_name * host = name_get(img->storage);
+    if (host && host->hosts == i)
+        host->hosts = 0;
+
+    img->storage = 0;
+    img->next = s_free;
+    s_free = i;
+}
+
+// Something stopped using the GL texture `storage`; delete it if unused
+static void storage_unref(GLuint storage) {
+    texture_name * s = name_get(storage);
+    if (s && (!(s->flags & (NAME_OURS | NAME_DEAD)) || s->hosts))
+        return;
+
+    // Storages past the name table can only be ours
+    glDeleteTextures(1, &storage);
+    if (s)
+        memset(s, 0, sizeof(*s));
+}
+
+// The name stops using its current image
+static void name_release(GLuint texture, texture_name * n) {
+    GLuint storage = name_storage(texture, n);
+    texture_image * img = image_get(n->image);
+
+    if (img) {
+        if (img->refs > 1)
+            s_saved_bytes -= img->bytes;
+        if (--img->refs == 0)
+            image_free(n->image);
+        n->image = 0;
+    }
+
+    n->storage = 0;
+    n->flags &= ~NAME_ALIAS;
+    if (storage != texture)
+        storage_unref(storage);
+}
+
+static void apply_params(GLenum target, const texture_name * n,
+                         texture_image * img) {
+    for (int p = 0; p < PARAM_NUM; p++) {
+        if (img->params[p] == n->params[p])
+            continue;
+        img->params[p] = n->params[p];
+        glTexParameteri(target, param_names[p],
+                        n->params[p] ? n->params[p] : param_defaults[p]);
+    }
+}
+
+static inline uint32_t bytes_per_pixel(GLenum format, GLenum type) {
+    switch (type) {
+        case GL_UNSIGNED_SHORT_5_6_5:
+        case GL_UNSIGNED_SHORT_4_4_4_4:
+        case GL_UNSIGNED_SHORT_5_5_5_1:
+            return 2;
+        case GL_UNSIGNED_BYTE:
+            break;
+        default:
+            return 0;
+    }
+
+    switch (format) {
+        case GL_RGBA: return 4;
+        case GL_RGB: return 3;
+        case GL_LUMINANCE_ALPHA: return 2;
+        case GL_LUMINANCE:
+        case GL_ALPHA: return 1;
+        default: return 0;
+    }
+}
+
+// A single colour repeated, e.g. a cleared render target or stream buffer
+static bool is_fill(const uint8_t * data, uint32_t size, uint32_t bpp) {
+    return size > bpp && memcmp(data, data + bpp, size - bpp) == 0;
+}
+
+static void image_key(const uint32_t * desc, size_t desc_len,
+                      const void * data, uint32_t size, uint8_t * key) {
+    hash128_ctx ctx;
+    hash128_init(&ctx);
+    hash128_update(&ctx, desc, desc_len);
+    hash128_update(&ctx, data, size);
+    hash128_final(&ctx, key);
+}
+
+/*
+ * Points the bound name at an existing copy of the image if there is one.
+ * Otherwise makes sure the name has a storage of its own to upload to, and
+ * returns false.
+ */
+static bool share_or_prepare(GLenum target, GLuint texture, texture_name * n,
+                             const uint8_t * key, bool keyed,
+                             uint16_t * image) {
+    bool moved = n->storage != 0;
+    name_release(texture, n);
+
+    texture_image * img = keyed ? image_find(key) : NULL;
+    if (img) {
+        n->storage = (img->storage == texture) ? 0 : img->storage;
+        n->image = img - s_images + 1;
+        n->flags |= NAME_ALIAS;
+        img->refs++;
+        s_saved_bytes += img->bytes;
+
+        glBindTexture(target, img->storage);
+        apply_params(target, n, img);
+
+        if (++s_shared_uploads % GLTEXTURE_LOG_EVERY == 0) {
+            logv_info("[gltexture] %u uploads shared, %llu KB saved now",
+                      s_shared_uploads, s_saved_bytes / 1024);
+        }
+        return true;
+    }
+
+    GLuint storage = texture;
+    if (n->hosts) {
+        // Others still use the image in our GL texture
+        glGenTextures(1, &storage);
+        texture_name * s = name_get(storage);
+        if (s)
+            s->flags = NAME_OURS;
+        n->storage = storage;
+    }
+
+    // A texture the name wasn't using has none of its parameters; its own
+    // one may have been left with another name's while it was elsewhere
+    glBindTexture(target, storage);
+    if (n->hosts || moved) {
+        for (int p = 0; p < PARAM_NUM; p++) {
+            glTexParameteri(target, param_names[p],
+                            n->params[p] ? n->params[p] : param_defaults[p]);
+        }
+    }
+
+    *image = 0;
+    if (keyed)
+        *image = image_alloc(key, storage, 0);
+    return false;
+}
+
+static void track_image(GLuint texture, texture_name * n, uint16_t image,
+                        uint32_t bytes, GLsizei width, GLsizei height,
+                        GLint internalFormat, GLenum format, GLenum type) {
+    texture_image * img = image_get(image);
+    texture_name * host = img ? name_get(img->storage) : NULL;
+
+    // Only images whose storage has a name entry can be shared
+    if (!img || !host) {
+        if (img)
+            image_free(image);
+        return;
+    }
+
+    img->bytes = bytes;
+    img->width = (uint16_t)width;
+    img->height = (uint16_t)height;
+    img->internal_format = internalFormat;
+    img->format = format;
+    img->type = type;
+    memcpy(img->params, n->params, sizeof(img->params));
+    host->hosts = image;
+    n->image = image;
+}
+
+// Level 0 of the storage of `img`, copied into the new GL texture `dst`
+static bool image_copy(const texture_image * img, GLuint dst) {
+    if (!img->format)
+        return false;
+
+    GLint prev = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prev);
+
+    GLuint fb;
+    glGenFramebuffers(1, &fb);
+    glBindFramebuffer(GL_FRAMEBUFFER, fb);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           img->storage, 0);
+
+    bool ok = glCheckFramebufferStatus(GL_FRAMEBUFFER)
+              == GL_FRAMEBUFFER_COMPLETE;
+    if (ok) {
+        glBindTexture(GL_TEXTURE_2D, dst);
+        glTexImage2D(GL_TEXTURE_2D, 0, img->internal_format, img->width,
+                     img->height, 0, img->format, img->type, NULL);
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, img->width,
+                            img->height);
+        if (setting_enableMipMaps)
+            glGenerateMipmap(GL_TEXTURE_2D);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, prev);
+    glDeleteFramebuffers(1, &fb);
+    return ok;
+}
+
+/*
+ * Moves the bound name off the shared image `img` to a copy of its own.
+ * False if it couldn't be copied; the name is left as it was.
+ */
+static bool image_detach(GLenum target, GLuint texture, texture_name * n,
+                         texture_image * img) {
+    GLuint storage;
+    glGenTextures(1, &storage);
+    if (!image_copy(img, storage)) {
+        glDeleteTextures(1, &storage);
+        glBindTexture(target, name_storage(texture, n));
+        return false;
+    }
+
+    // The name's own GL texture may be the one holding the shared image;
+    // then it stays with the others, like in share_or_prepare()
+    name_release(texture, n);
+    texture_name * s = name_get(storage);
+    if (s)
+        s->flags = NAME_OURS;
+    n->storage = storage;
+
+    glmipmap_forget(storage);
+    for (int p = 0; p < PARAM_NUM; p++) {
+        glTexParameteri(target, param_names[p],
+                        n->params[p] ? n->params[p] : param_defaults[p]);
+    }
+    glBindTexture(target, storage);
+    return true;
+}
+
+// The bound name is about to get an update that changes its image
+static void image_update(GLenum target) {
+    GLuint texture = glstate_bound_texture(target);
+    if (target != GL_TEXTURE_2D || texture == GLSTATE_UNKNOWN)
+        return;
+
+    texture_name * n = name_get(texture);
+    texture_image * img = n ? image_get(n->image) : NULL;
+    if (!img)
+        return;
+
+    // The others keep the image as uploaded, so it stays findable
+    if (img->refs > 1 && image_detach(target, texture, n, img))
+        return;
+
+    image_unkey(img);
+    if (img->refs > 1 && !s_warned_update) {
+        log_warn("[gltexture] a shared texture is being updated");
+        s_warned_update = true;
+    }
+}
+
+void glTexImage2D_soloader(GLenum target, GLint level, GLint internalFormat,
+                           GLsizei width, GLsizei height, GLint border,
+                           GLenum format, GLenum type, const GLvoid *data) {
+    if (level > 0 && !setting_enableMipMaps)
+        return;
+
+    GLuint texture = glstate_bound_texture(target);
+    texture_name * n = (target == GL_TEXTURE_2D) ? name_get(texture) : NULL;
+
+    if (!n || texture == GLSTATE_UNKNOWN) {
+        glTexImage2D(target, level, internalFormat, width, height, border,
+                     format, type, data);
+        if (level == 0 && setting_enableMipMaps && texture != GLSTATE_UNKNOWN
+            && target == GL_TEXTURE_2D)
+            glmipmap_upload(texture, target, internalFormat, width, height,
+                            format, type, data);
+        return;
+    }
+
+    if (level > 0) {
+        // Levels derive from the base image, which the storage already has
+        if (!(n->flags & NAME_ALIAS))
+            glTexImage2D(target, level, internalFormat, width, height, border,
+                         format, type, data);
+        return;
+    }
+
+    // What the upload reads; the same bytes are another image with other
+    // row padding, so the alignment goes in the key
+    uint32_t bpp = bytes_per_pixel(format, type);
+    uint32_t align = glstate_unpack_alignment();
+    uint32_t size = glstate_unpack_size(width, height, bpp);
+    bool keyed = data && bpp && !is_fill(data, size, bpp);
+
+    uint8_t key[HASH128_SIZE];
+    if (keyed) {
+        uint32_t desc[] = { 0, internalFormat, width, height, format, type,
+                            align };
+        image_key(desc, sizeof(desc), data, size, key);
+    }
+
+    uint16_t image;
+    if (share_or_prepare(target, texture, n, key, keyed, &image))
+        return;
+
+    glTexImage2D(target, level, internalFormat, width, height, border, format,
+                 type, data);
+    if (setting_enableMipMaps)
+        glmipmap_upload(name_storage(texture, n), target, internalFormat,
+                        width, height, format, type, data);
+    else
+        glmipmap_forget(name_storage(texture, n));
+
+    track_image(texture, n, image, size, width, height, internalFormat, format,
+                type);
+}
+
+void glCompressedTexImage2D_soloader(GLenum target, GLint level,
+                                     GLenum internalformat, GLsizei width,
+                                     GLsizei height, GLint border,
+                                     GLsizei imageSize, const void *data) {
+    if (level > 0 && !setting_enableMipMaps)
+        return;
+
+    GLuint texture = glstate_bound_texture(target);
+    texture_name * n = (target == GL_TEXTURE_2D) ? name_get(texture) : NULL;
+
+    if (!n || texture == GLSTATE_UNKNOWN) {
+        glCompressedTexImage2D(target, level, internalformat, width, height,
+                               border, imageSize, data);
+        if (level == 0 && texture != GLSTATE_UNKNOWN)
+            glmipmap_forget(texture);
+        return;
+    }
+
+    if (level > 0) {
+        if (!(n->flags & NAME_ALIAS))
+            glCompressedTexImage2D(target, level, internalformat, width,
+                                   height, border, imageSize, data);
+        return;
+    }
+
+    bool keyed = data && imageSize > 0;
+    uint8_t key[HASH128_SIZE];
+    if (keyed) {
+        uint32_t desc[] = { 1, internalformat, width, height, imageSize };
+        image_key(desc, sizeof(desc), data, imageSize, key);
+    }
+
+    uint16_t image;
+    if (share_or_prepare(target, texture, n, key, keyed, &image))
+        return;
+
+    glCompressedTexImage2D(target, level, internalformat, width, height,
+                           border, imageSize, data);
+    glmipmap_forget(name_storage(texture, n));
+    track_image(texture, n, image, imageSize, width, height, internalformat, 0,
+                0);
+}
+
+void glTexSubImage2D_soloader(GLenum target, GLint level, GLint xoffset,
+                              GLint yoffset, GLsizei width, GLsizei height,
+                              GLenum format, GLenum type, const GLvoid *pixels) {
+    image_update(target);
+    glTexSubImage2D(target, level, xoffset, yoffset, width, height, format,
+                    type, pixels);
+}
+
+void glCopyTexSubImage2D_soloader(GLenum target, GLint level, GLint xoffset,
+                                  GLint yoffset, GLint x, GLint y,
+                                  GLsizei width, GLsizei height) {
+    image_update(target);
+    glCopyTexSubImage2D(target, level, xoffset, yoffset, x, y, width, height);
+}
+
+static void set_param(GLenum target, GLenum pname, GLint param) {
+    int p = param_index(pname);
+    GLuint texture = glstate_bound_texture(target);
+    texture_name * n = (target == GL_TEXTURE_2D && texture != GLSTATE_UNKNOWN)
+                       ? name_get(texture) : NULL;
+    if (p < 0 || !n)
+        return;
+
+    n->params[p] = (uint16_t)param;
+    texture_image * img = image_get(n->image);
+    if (img)
+        img->params[p] = (uint16_t)param;
+}
+
+void glTexParameteri_soloader(GLenum target, GLenum pname, GLint param) {
+    set_param(target, pname, param);
+    glTexParameteri(target, pname, param);
+}
+
+void glTexParameterf_soloader(GLenum target, GLenum pname, GLfloat param) {
+    set_param(target, pname, (GLint)param);
+    glTexParameterf(target, pname, param);
+}
+
+void glTexParameterx_soloader(GLenum target, GLenum pname, GLfixed param) {
+    // Enum values are passed as they are, not as 16.16
+    set_param(target, pname, param);
+    glTexParameterx(target, pname, param);
+}
+
+void glFramebufferTexture2D_soloader(GLenum target, GLenum attachment,
+                                     GLenum textarget, GLuint texture,
+                                     GLint level) {
+    glFramebufferTexture2D(target, attachment, textarget,
+                           gltexture_storage(texture), level);
+}
+
+GLuint gltexture_storage(GLuint texture) {
+    texture_name * n = name_get(texture);
+    return n ? name_storage(texture, n) : texture;
+}
+
+void gltexture_bind(GLenum target, GLuint texture) {
+    texture_name * n = name_get(texture);
+    if (!n) {
+        glBindTexture(target, texture);
+        return;
+    }
+
+    texture_image * img = image_get(n->image);
+    // The image may still have the parameters of a name that used it last
+    glBindTexture(target, name_storage(texture, n));
+    if (img)
+        apply_params(target, n, img);
+}
+
+void gltexture_delete(GLsizei n, const GLuint *textures) {
+    for (GLsizei i = 0; i < n; i++) {
+        GLuint texture = textures[i];
+        texture_name * t = name_get(texture);
+        if (!t) {
+            if (texture != 0)
+                glDeleteTextures(1, &texture);
+            continue;
+        }
+
+        name_release(texture, t);
+        memset(t->params, 0, sizeof(t->params));
+
+        if (t->hosts) {
+            t->flags = NAME_DEAD;
+        } else {
+            glDeleteTextures(1, &texture);
+            memset(t, 0, sizeof(*t));
+        }
+    }
+}
@@ -0,0 +1,47 @@
+/*
+ * reimpl/gltexture.h
+ *
+ * Texture uploads: identical images uploaded to different texture names
+ * share one GL texture.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_GLTEXTURE_H
+#define SOLOADER_GLTEXTURE_H
+
+#include <vitaGL.h>
+
+void glTexImage2D_soloader(GLenum target, GLint level, GLint internalFormat,
+                           GLsizei width, GLsizei height, GLint border,
+                           GLenum format, GLenum type, const GLvoid *data);
+void glCompressedTexImage2D_soloader(GLenum target, GLint level,
+                                     GLenum internalformat, GLsizei width,
+                                     GLsizei height, GLint border,
+                                     GLsizei imageSize, const void *data);
+void glTexSubImage2D_soloader(GLenum target, GLint level, GLint xoffset,
+                              GLint yoffset, GLsizei width, GLsizei height,
+                              GLenum format, GLenum type, const GLvoid *pixels);
+void glCopyTexSubImage2D_soloader(GLenum target, GLint level, GLint xoffset,
+                                  GLint yoffset, GLint x, GLint y,
+                                  GLsizei width, GLsizei height);
+void glTexParameteri_soloader(GLenum target, GLenum pname, GLint param);
+void glTexParameterf_soloader(GLenum target, GLenum pname, GLfloat param);
+void glTexParameterx_soloader(GLenum target, GLenum pname, GLfixed param);
+void glFramebufferTexture2D_soloader(GLenum target, GLenum attachment,
+                                     GLenum textarget, GLuint texture,
+                                     GLint level);
+
+// GL texture that holds the image of the given texture name
+GLuint gltexture_storage(GLuint texture);
+
+// Bind the storage of `texture`; used by glBindTexture_soloader
+void gltexture_bind(GLenum target, GLuint texture);
+
+// Delete texture names; used by glDeleteTextures_soloader
+void gltexture_delete(GLsizei n, const GLuint *textures);
+
+#endif // SOLOADER_GLTEXTURE_H
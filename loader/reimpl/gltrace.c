@@ -0,0 +1,643 @@
+/*
+ * reimpl/gltrace.c
+ *
+ * Recorder for the GL command stream issued by the game. Captures
+ * GLTRACE_FRAMES frames into DATA_PATH"gltrace.bin", to be inspected with
+ * scripts/gltrace.py or replayed on the host with scripts/gltrace_replay.c.
+ *
+ * With the softfp ABI every GL argument (floats included) travels as a
+ * 32-bit word in r0-r3 or on the stack, and no GL entry point takes more
+ * than nine of them. That lets one generic C thunk per table slot record
+ * the raw words and forward them to the original function, whatever its
+ * real signature is. Functions that pass data by pointer additionally get
+ * the referenced bytes recorded, and so do client-side vertex arrays and
+ * indices at draw time.
+ *
+ * Trace layout (little-endian):
+ *   header   "GLTR", u32 version, u32 function count,
+ *            then per function: u8 name length, name bytes
+ *   CALL     u8 1, u8 0, u16 function, u32 args[9], u32 ret,
+ *            u32 start (us since capture start), u32 duration (us);
+ *            args past the real arity and ret of void functions are junk
+ *   DATA     u8 2, u8 slot, u16 0, u32 length, bytes padded to 4;
+ *            belongs to the preceding CALL. slot < 8 is the argument the
+ *            pointer came from, slot >= 16 is a client array (SLOT_*).
+ *   FRAME    u8 3, u8 0, u16 0, u32 frame number
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "reimpl/gltrace.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <psp2/kernel/processmgr.h>
+#include <vitaGL.h>
+
+#include "utils/logger.h"
+
+#ifndef GLTRACE_SKIP_FRAMES
+#define GLTRACE_SKIP_FRAMES 0
+#endif
+
+#define GLTRACE_PATH         DATA_PATH"gltrace.bin"
+#define GLTRACE_VERSION      1
+#define GLTRACE_MAX_FUNCS    160
+#define GLTRACE_BUFFER_SIZE  (48 * 1024 * 1024)
+#define GLTRACE_ATTRIBS      16
+#define GLTRACE_TEX_UNITS    8
+#define GLTRACE_ARGS         9
+#define GLTRACE_CALL_SIZE    (4 + GLTRACE_ARGS * 4 + 12)
+
+// An argument word holding an address
+#define ARG_PTR(word)        ((const void *)(uintptr_t)(word))
+
+enum {
+    REC_CALL = 1,
+    REC_DATA = 2,
+    REC_FRAME = 3,
+};
+
+// DATA slots for client arrays
+enum {
+    SLOT_VERTEX = 16,
+    SLOT_NORMAL,
+    SLOT_COLOR,
+    SLOT_TEXCOORD,                                 // + texture unit
+    SLOT_ATTRIB = SLOT_TEXCOORD + GLTRACE_TEX_UNITS, // + attribute index
+};
+
+typedef enum {
+    P_NONE,
+    P_BUFFER_DATA,
+    P_BUFFER_SUBDATA,
+    P_TEX_IMAGE,
+    P_TEX_SUBIMAGE,
+    P_COMPRESSED_TEX_IMAGE,
+    P_MATRIX,
+    P_VEC4_ARG1,
+    P_VEC4_ARG2,
+    P_UNIFORM1V,
+    P_UNIFORM2V,
+    P_UNIFORM3V,
+    P_UNIFORM4V,
+    P_UNIFORM_MATRIX4,
+    P_SHADER_SOURCE,
+    P_NAME_ARG1,
+    P_GEN_NAMES,
+    P_DRAW_ARRAYS,
+    P_DRAW_ELEMENTS,
+    // State the recorder has to follow to know what a draw call reads
+    P_BIND_BUFFER,
+    P_PIXEL_STORE,
+    P_VERTEX_POINTER,
+    P_NORMAL_POINTER,
+    P_COLOR_POINTER,
+    P_TEXCOORD_POINTER,
+    P_ATTRIB_POINTER,
+    P_CLIENT_ACTIVE_TEXTURE,
+    P_ENABLE_CLIENT_STATE,
+    P_DISABLE_CLIENT_STATE,
+    P_ENABLE_ATTRIB,
+    P_DISABLE_ATTRIB,
+} gltrace_payload;
+
+static const struct {
+    const char * name;
+    gltrace_payload payload;
+} s_payloads[] = {
+        { "glBufferData", P_BUFFER_DATA },
+        { "glBufferSubData", P_BUFFER_SUBDATA },
+        { "glTexImage2D", P_TEX_IMAGE },
+        { "glTexSubImage2D", P_TEX_SUBIMAGE },
+        { "glCompressedTexImage2D", P_COMPRESSED_TEX_IMAGE },
+        { "glLoadMatrixf", P_MATRIX },
+        { "glMultMatrixf", P_MATRIX },
+        { "glClipPlanef", P_VEC4_ARG1 },
+        { "glFogfv", P_VEC4_ARG1 },
+        { "glLightModelfv", P_VEC4_ARG1 },
+        { "glLightfv", P_VEC4_ARG2 },
+        { "glMaterialfv", P_VEC4_ARG2 },
+        { "glTexEnvfv", P_VEC4_ARG2 },
+        { "glUniform1fv", P_UNIFORM1V },
+        { "glUniform1iv", P_UNIFORM1V },
+        { "glUniform2fv", P_UNIFORM2V },
+        { "glUniform2iv", P_UNIFORM2V },
+        { "glUniform3fv", P_UNIFORM3V },
+        { "glUniform3iv", P_UNIFORM3V },
+        { "glUniform4fv", P_UNIFORM4V },
+        { "glUniform4iv", P_UNIFORM4V },
+        { "glUniformMatrix4fv", P_UNIFORM_MATRIX4 },
+        { "glShaderSource", P_SHADER_SOURCE },
+        { "glGetUniformLocation", P_NAME_ARG1 },
+        { "glGetAttribLocation", P_NAME_ARG1 },
+        { "glGenBuffers", P_GEN_NAMES },
+        { "glGenFramebuffers", P_GEN_NAMES },
+        { "glGenRenderbuffers", P_GEN_NAMES },
+        { "glGenTextures", P_GEN_NAMES },
+        { "glDrawArrays", P_DRAW_ARRAYS },
+        { "glDrawElements", P_DRAW_ELEMENTS },
+        { "glBindBuffer", P_BIND_BUFFER },
+        { "glPixelStorei", P_PIXEL_STORE },
+        { "glVertexPointer", P_VERTEX_POINTER },
+        { "glNormalPointer", P_NORMAL_POINTER },
+        { "glColorPointer", P_COLOR_POINTER },
+        { "glTexCoordPointer", P_TEXCOORD_POINTER },
+        { "glVertexAttribPointer", P_ATTRIB_POINTER },
+        { "glClientActiveTexture", P_CLIENT_ACTIVE_TEXTURE },
+        { "glEnableClientState", P_ENABLE_CLIENT_STATE },
+        { "glDisableClientState", P_DISABLE_CLIENT_STATE },
+        { "glEnableVertexAttribArray", P_ENABLE_ATTRIB },
+        { "glDisableVertexAttribArray", P_DISABLE_ATTRIB },
+};
+
+typedef uint32_t (*gltrace_fn)(uint32_t, uint32_t, uint32_t, uint32_t,
+                               uint32_t, uint32_t, uint32_t, uint32_t,
+                               uint32_t);
+
+static struct {
+    const char * name;
+    gltrace_fn orig;
+    gltrace_payload payload;
+} s_funcs[GLTRACE_MAX_FUNCS];
+
+static int s_funcs_num;
+
+typedef struct client_array {
+    bool enabled;
+    int size;
+    GLenum type;
+    int stride;
+    uintptr_t ptr;
+    GLuint buffer; // array buffer bound when the pointer was set
+} client_array;
+
+static struct {
+    GLuint array_buffer;
+    GLuint element_buffer;
+    int unpack_alignment;
+    int client_unit;
+    client_array vertex;
+    client_array normal;
+    client_array color;
+    client_array texcoord[GLTRACE_TEX_UNITS];
+    client_array attrib[GLTRACE_ATTRIBS];
+} s_client = { .unpack_alignment = 4 };
+
+static enum {
+    TRACE_WAITING,
+    TRACE_CAPTURING,
+    TRACE_DONE,
+} s_status;
+
+static uint8_t * s_buf;
+static size_t s_len;
+static bool s_overflow;
+static uint32_t s_frame;
+static uint32_t s_time_base;
+
+static void * reserve(size_t size) {
+    if (s_overflow || s_len + size > GLTRACE_BUFFER_SIZE) {
+        s_overflow = true;
+        return NULL;
+    }
+    void * ret = s_buf + s_len;
+    s_len += size;
+    return ret;
+}
+
+static void emit_data(uint8_t slot, const void * data, uint32_t len) {
+    if (!data || len == 0)
+        return;
+
+    uint8_t * rec = reserve(8 + ((len + 3) & ~3u));
+    if (!rec)
+        return;
+
+    rec[0] = REC_DATA;
+    rec[1] = slot;
+    rec[2] = rec[3] = 0;
+    memcpy(rec + 4, &len, 4);
+    memcpy(rec + 8, data, len);
+}
+
+static uint32_t type_size(GLenum type) {
+    switch (type) {
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE:
+            return 1;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+        case GL_HALF_FLOAT:
+            return 2;
+        default:
+            return 4;
+    }
+}
+
+static uint32_t pixel_size(GLenum format, GLenum type) {
+    switch (type) {
+        case GL_UNSIGNED_SHORT_5_6_5:
+        case GL_UNSIGNED_SHORT_4_4_4_4:
+        case GL_UNSIGNED_SHORT_5_5_5_1:
+            return 2;
+        default:
+            break;
+    }
+
+    uint32_t comps;
+    switch (format) {
+        case GL_RGBA: comps = 4; break;
+        case GL_RGB: comps = 3; break;
+        case GL_LUMINANCE_ALPHA: comps = 2; break;
+        default: comps = 1; break;
+    }
+    return comps * type_size(type);
+}
+
+static uint32_t image_size(uint32_t w, uint32_t h, GLenum format, GLenum type) {
+    uint32_t a = s_client.unpack_alignment;
+    uint32_t row = (w * pixel_size(format, type) + a - 1) / a * a;
+    return row * h;
+}
+
+static void emit_client_array(uint8_t slot, const client_array * arr,
+                              uint32_t first, uint32_t last) {
+    if (!arr->enabled || arr->buffer != 0 || !arr->ptr)
+        return;
+
+    uint32_t elem = arr->size * type_size(arr->type);
+    uint32_t stride = arr->stride ? arr->stride : elem;
+    uint32_t len = (last - first) * stride + elem;
+    emit_data(slot, (const void *)(arr->ptr + first * stride), len);
+}
+
+// Records the client-side vertex data a draw call reads, vertices [first, last]
+static void emit_client_arrays(uint32_t first, uint32_t last) {
+    emit_client_array(SLOT_VERTEX, &s_client.vertex, first, last);
+    emit_client_array(SLOT_NORMAL, &s_client.normal, first, last);
+    emit_client_array(SLOT_COLOR, &s_client.color, first, last);
+    for (int i = 0; i < GLTRACE_TEX_UNITS; i++)
+        emit_client_array(SLOT_TEXCOORD + i, &s_client.texcoord[i], first, last);
+    for (int i = 0; i < GLTRACE_ATTRIBS; i++)
+        emit_client_array(SLOT_ATTRIB + i, &s_client.attrib[i], first, last);
+}
+
+static client_array * client_state_array(GLenum array) {
+    switch (array) {
+        case GL_VERTEX_ARRAY: return &s_client.vertex;
+        case GL_NORMAL_ARRAY: return &s_client.normal;
+        case GL_COLOR_ARRAY: return &s_client.color;
+        case GL_TEXTURE_COORD_ARRAY: return &s_client.texcoord[s_client.client_unit];
+        default: return NULL;
+    }
+}
+
+static void set_pointer(client_array * arr, int size, GLenum type, int stride,
+                        uintptr_t ptr) {
+    arr->size = size;
+    arr->type = type;
+    arr->stride = stride;
+    arr->ptr = ptr;
+    arr->buffer = s_client.array_buffer;
+}
+
+// Client-side state has to be followed even while not capturing
+static void track_state(gltrace_payload p, const uint32_t * a) {
+    client_array * arr;
+
+    switch (p) {
+        case P_BIND_BUFFER:
+            if (a[0] == GL_ARRAY_BUFFER)
+                s_client.array_buffer = a[1];
+            else if (a[0] == GL_ELEMENT_ARRAY_BUFFER)
+                s_client.element_buffer = a[1];
+            break;
+        case P_PIXEL_STORE:
+            if (a[0] == GL_UNPACK_ALIGNMENT)
+                s_client.unpack_alignment = (int)a[1];
+            break;
+        case P_VERTEX_POINTER:
+            set_pointer(&s_client.vertex, (int)a[0], a[1], (int)a[2], a[3]);
+            break;
+        case P_NORMAL_POINTER:
+            set_pointer(&s_client.normal, 3, a[0], (int)a[1], a[2]);
+            break;
+        case P_COLOR_POINTER:
+            set_pointer(&s_client.color, (int)a[0], a[1], (int)a[2], a[3]);
+            break;
+        case P_TEXCOORD_POINTER:
+            set_pointer(&s_client.texcoord[s_client.client_unit], (int)a[0],
+                        a[1], (int)a[2], a[3]);
+            break;
+        case P_ATTRIB_POINTER:
+            if (a[0] < GLTRACE_ATTRIBS)
+                set_pointer(&s_client.attrib[a[0]], (int)a[1], a[2], (int)a[4],
+                            a[5]);
+            break;
+        case P_CLIENT_ACTIVE_TEXTURE:
+            if (a[0] - GL_TEXTURE0 < GLTRACE_TEX_UNITS)
+                s_client.client_unit = (int)(a[0] - GL_TEXTURE0);
+            break;
+        case P_ENABLE_CLIENT_STATE:
+        case P_DISABLE_CLIENT_STATE:
+            arr = client_state_array(a[0]);
+            if (arr)
+                arr->enabled = (p == P_ENABLE_CLIENT_STATE);
+            break;
+        case P_ENABLE_ATTRIB:
+        case P_DISABLE_ATTRIB:
+            if (a[0] < GLTRACE_ATTRIBS)
+                s_client.attrib[a[0]].enabled = (p == P_ENABLE_ATTRIB);
+            break;
+        default:
+            break;
+    }
+}
+
+static void emit_uniform(const uint32_t * a, uint32_t floats) {
+    emit_data(2, ARG_PTR(a[2]), a[1] * floats * 4);
+}
+
+static void emit_shader_source(const uint32_t * a) {
+    GLsizei count = (GLsizei)a[1];
+    const char * const * strings = (const char * const *)ARG_PTR(a[2]);
+    const GLint * lengths = (const GLint *)ARG_PTR(a[3]);
+
+    // All the strings go into one record, the way GL concatenates them
+    uint32_t total = 0;
+    for (GLsizei i = 0; i < count; i++)
+        total += (lengths && lengths[i] >= 0) ? lengths[i] : strlen(strings[i]);
+
+    uint8_t * rec = reserve(8 + ((total + 3) & ~3u));
+    if (!rec)
+        return;
+
+    rec[0] = REC_DATA;
+    rec[1] = 2;
+    rec[2] = rec[3] = 0;
+    memcpy(rec + 4, &total, 4);
+
+    uint8_t * out = rec + 8;
+    for (GLsizei i = 0; i < count; i++) {
+        uint32_t len = (lengths && lengths[i] >= 0) ? lengths[i]
+                                                    : strlen(strings[i]);
+        memcpy(out, strings[i], len);
+        out += len;
+    }
+}
+
+static void emit_draw_elements(const uint32_t * a) {
+    uint32_t count = a[1];
+    GLenum type = a[2];
+    const void * indices = ARG_PTR(a[3]);
+
+    // Indices in a buffer object: neither they nor the range are known here
+    if (s_client.element_buffer != 0 || !indices || count == 0)
+        return;
+
+    uint32_t lo = 0xFFFFFFFFu, hi = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t idx;
+        switch (type) {
+            case GL_UNSIGNED_BYTE: idx = ((const uint8_t *)indices)[i]; break;
+            case GL_UNSIGNED_SHORT: idx = ((const uint16_t *)indices)[i]; break;
+            default: idx = ((const uint32_t *)indices)[i]; break;
+        }
+        if (idx < lo) lo = idx;
+        if (idx > hi) hi = idx;
+    }
+
+    emit_data(3, indices, count * type_size(type));
+    emit_client_arrays(lo, hi);
+}
+
+// Records the memory referenced by the arguments, before the call
+static void emit_payload(gltrace_payload p, const uint32_t * a) {
+    switch (p) {
+        case P_BUFFER_DATA:
+            emit_data(2, ARG_PTR(a[2]), a[1]);
+            break;
+        case P_BUFFER_SUBDATA:
+            emit_data(3, ARG_PTR(a[3]), a[2]);
+            break;
+        case P_TEX_IMAGE:
+            emit_data(8, ARG_PTR(a[8]), image_size(a[3], a[4], a[6], a[7]));
+            break;
+        case P_TEX_SUBIMAGE:
+            emit_data(8, ARG_PTR(a[8]), image_size(a[4], a[5], a[6], a[7]));
+            break;
+        case P_COMPRESSED_TEX_IMAGE:
+            emit_data(7, ARG_PTR(a[7]), a[6]);
+            break;
+        case P_MATRIX:
+            emit_data(0, ARG_PTR(a[0]), 16 * sizeof(GLfloat));
+            break;
+        case P_VEC4_ARG1:
+            emit_data(1, ARG_PTR(a[1]), 4 * sizeof(GLfloat));
+            break;
+        case P_VEC4_ARG2:
+            emit_data(2, ARG_PTR(a[2]), 4 * sizeof(GLfloat));
+            break;
+        case P_UNIFORM1V:
+            emit_uniform(a, 1);
+            break;
+        case P_UNIFORM2V:
+            emit_uniform(a, 2);
+            break;
+        case P_UNIFORM3V:
+            emit_uniform(a, 3);
+            break;
+        case P_UNIFORM4V:
+            emit_uniform(a, 4);
+            break;
+        case P_UNIFORM_MATRIX4:
+            emit_data(3, ARG_PTR(a[3]), a[1] * 16 * sizeof(GLfloat));
+            break;
+        case P_SHADER_SOURCE:
+            emit_shader_source(a);
+            break;
+        case P_NAME_ARG1:
+            if (a[1])
+                emit_data(1, ARG_PTR(a[1]), strlen(ARG_PTR(a[1])) + 1);
+            break;
+        case P_DRAW_ARRAYS:
+            if (a[2] > 0)
+                emit_client_arrays(a[1], a[1] + a[2] - 1);
+            break;
+        case P_DRAW_ELEMENTS:
+            emit_draw_elements(a);
+            break;
+        default:
+            break;
+    }
+}
+
+static uint32_t gltrace_call(int i, uint32_t * a) {
+    gltrace_payload p = s_funcs[i].payload;
+    track_state(p, a);
+
+    if (s_status != TRACE_CAPTURING)
+        return s_funcs[i].orig(a[0], a[1], a[2], a[3], a[4], a[5], a[6],
+                               a[7], a[8]);
+
+    // The buffer never moves, so ret and duration can be filled in after
+    uint8_t * rec = reserve(GLTRACE_CALL_SIZE);
+
+    if (rec) {
+        uint16_t id = (uint16_t)i;
+        uint32_t t = sceKernelGetProcessTimeLow() - s_time_base;
+        rec[0] = REC_CALL;
+        rec[1] = 0;
+        memcpy(rec + 2, &id, 2);
+        memcpy(rec + 4, a, GLTRACE_ARGS * 4);
+        memcpy(rec + 8 + GLTRACE_ARGS * 4, &t, 4);
+    }
+
+    emit_payload(p, a);
+
+    uint32_t start = sceKernelGetProcessTimeLow();
+    uint32_t ret = s_funcs[i].orig(a[0], a[1], a[2], a[3], a[4], a[5], a[6],
+                                   a[7], a[8]);
+    uint32_t duration = sceKernelGetProcessTimeLow() - start;
+
+    if (rec) {
+        memcpy(rec + 4 + GLTRACE_ARGS * 4, &ret, 4);
+        memcpy(rec + 12 + GLTRACE_ARGS * 4, &duration, 4);
+    }
+
+    // Names produced by glGen* are needed to map IDs on replay
+    if (p == P_GEN_NAMES)
+        emit_data(1, ARG_PTR(a[1]), a[0] * sizeof(GLuint));
+
+    return ret;
+}
+
+#define THUNK(i) \
+    static uint32_t gltrace_thunk_##i(uint32_t a0, uint32_t a1, uint32_t a2, \
+                                      uint32_t a3, uint32_t a4, uint32_t a5, \
+                                      uint32_t a6, uint32_t a7, uint32_t a8) { \
+        uint32_t a[GLTRACE_ARGS] = { a0, a1, a2, a3, a4, a5, a6, a7, a8 }; \
+        return gltrace_call(i, a); \
+    }
+
+#define THUNK10(n) THUNK(n##0) THUNK(n##1) THUNK(n##2) THUNK(n##3) THUNK(n##4) \
+                   THUNK(n##5) THUNK(n##6) THUNK(n##7) THUNK(n##8) THUNK(n##9)
+
+#define THUNK_PTR(i) (uintptr_t)&gltrace_thunk_##i,
+#define THUNK_PTR10(n) THUNK_PTR(n##0) THUNK_PTR(n##1) THUNK_PTR(n##2) \
+                       THUNK_PTR(n##3) THUNK_PTR(n##4) THUNK_PTR(n##5) \
+                       THUNK_PTR(n##6) THUNK_PTR(n##7) THUNK_PTR(n##8) \
+                       THUNK_PTR(n##9)
+
+THUNK10() THUNK10(1) THUNK10(2) THUNK10(3) THUNK10(4) THUNK10(5) THUNK10(6)
+THUNK10(7) THUNK10(8) THUNK10(9) THUNK10(10) THUNK10(11) THUNK10(12)
+THUNK10(13) THUNK10(14) THUNK10(15)
+
+static const uintptr_t s_thunks[GLTRACE_MAX_FUNCS] = {
+        THUNK_PTR10() THUNK_PTR10(1) THUNK_PTR10(2) THUNK_PTR10(3)
+        THUNK_PTR10(4) THUNK_PTR10(5) THUNK_PTR10(6) THUNK_PTR10(7)
+        THUNK_PTR10(8) THUNK_PTR10(9) THUNK_PTR10(10) THUNK_PTR10(11)
+        THUNK_PTR10(12) THUNK_PTR10(13) THUNK_PTR10(14) THUNK_PTR10(15)
+};
+
+void gltrace_install(so_default_dynlib * dynlib, int count) {
+    if (GLTRACE_FRAMES <= 0)
+        return;
+
+    s_buf = malloc(GLTRACE_BUFFER_SIZE);
+    if (!s_buf) {
+        log_error("[gltrace] could not allocate the trace buffer");
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (strncmp(dynlib[i].symbol, "gl", 2) != 0)
+            continue;
+
+        if (s_funcs_num == GLTRACE_MAX_FUNCS) {
+            logv_error("[gltrace] more than %i GL functions, %s not traced",
+                       GLTRACE_MAX_FUNCS, dynlib[i].symbol);
+            continue;
+        }
+
+        int f = s_funcs_num++;
+        s_funcs[f].name = dynlib[i].symbol;
+        s_funcs[f].orig = (gltrace_fn)dynlib[i].func;
+        s_funcs[f].payload = P_NONE;
+
+        for (int j = 0; j < sizeof(s_payloads) / sizeof(s_payloads[0]); j++) {
+            if (strcmp(s_payloads[j].name, dynlib[i].symbol) == 0) {
+                s_funcs[f].payload = s_payloads[j].payload;
+                break;
+            }
+        }
+
+        dynlib[i].func = s_thunks[f];
+    }
+
+    logv_info("[gltrace] tracing %i GL functions", s_funcs_num);
+}
+
+static void write_trace() {
+    FILE * f = fopen(GLTRACE_PATH, "wb");
+    if (!f) {
+        log_error("[gltrace] could not open " GLTRACE_PATH);
+        return;
+    }
+
+    uint32_t header[3];
+    memcpy(&header[0], "GLTR", 4);
+    header[1] = GLTRACE_VERSION;
+    header[2] = s_funcs_num;
+    fwrite(header, sizeof(header), 1, f);
+
+    for (int i = 0; i < s_funcs_num; i++) {
+        uint8_t len = (uint8_t)strlen(s_funcs[i].name);
+        fwrite(&len, 1, 1, f);
+        fwrite(s_funcs[i].name, 1, len, f);
+    }
+
+    fwrite(s_buf, 1, s_len, f);
+    fclose(f);
+
+    logv_info("[gltrace] wrote %u frames, %u bytes to " GLTRACE_PATH,
+              s_frame, (unsigned)s_len);
+}
+
+void gltrace_frame_end(void) {
+    if (!s_buf || s_status == TRACE_DONE)
+        return;
+
+    s_frame++;
+
+    if (s_status == TRACE_WAITING) {
+        if (s_frame > GLTRACE_SKIP_FRAMES) {
+            s_status = TRACE_CAPTURING;
+            s_frame = 0;
+            s_time_base = sceKernelGetProcessTimeLow();
+        }
+        return;
+    }
+
+    uint8_t * rec = reserve(8);
+    if (rec) {
+        rec[0] = REC_FRAME;
+        rec[1] = rec[2] = rec[3] = 0;
+        memcpy(rec + 4, &s_frame, 4);
+    }
+
+    if (s_frame >= GLTRACE_FRAMES || s_overflow) {
+        if (s_overflow)
+            log_warn("[gltrace] trace buffer full, stopping early");
+        s_status = TRACE_DONE;
+        write_trace();
+        free(s_buf);
+        s_buf = NULL;
+    }
+}
@@ -0,0 +1,32 @@
+/*
+ * reimpl/gltrace.h
+ *
+ * Recorder for the GL command stream issued by the game. Captures
+ * GLTRACE_FRAMES frames into DATA_PATH"gltrace.bin", to be inspected with
+ * scripts/gltrace.py.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_GLTRACE_H
+#define SOLOADER_GLTRACE_H
+
+#include <so_util/so_util.h>
+
+#ifndef GLTRACE_FRAMES
+#define GLTRACE_FRAMES 0
+#endif
+
+/*
+ * Redirect every gl* entry of the dynlib table through a recording thunk.
+ * Does nothing unless the loader was built with GLTRACE_FRAMES > 0.
+ */
+void gltrace_install(so_default_dynlib * dynlib, int count);
+
+// Frame boundary. Writes the trace out once GLTRACE_FRAMES are captured.
+void gltrace_frame_end(void);
+
+#endif // SOLOADER_GLTRACE_H
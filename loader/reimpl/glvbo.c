@@ -0,0 +1,544 @@
+/*
+ * reimpl/glvbo.c
+ *
+ * Promotion of stable client-side vertex arrays into cached GL buffers.
+ *
+ * Most of the game's geometry is drawn from client memory, and vitaGL has
+ * to copy every client array into GPU-visible memory on each draw call.
+ * Pointers set without a bound GL_ARRAY_BUFFER are therefore not passed on
+ * right away: at draw time, the range the draw reads is looked up in a cache
+ * keyed by pointer and length, and validated against a hash of its contents.
+ * A range that is seen unchanged in two different frames gets uploaded into
+ * its own buffer, and from then on is drawn from it for as long as the hash
+ * keeps matching. Ranges the game rewrites in place simply fail the hash and
+ * take the copy path again; the ones that keep changing stop being hashed
+ * for a while.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "reimpl/glvbo.h"
+
+#include <arm_neon.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "reimpl/glstate.h"
+#include "utils/logger.h"
+
+#define GLVBO_TEX_UNITS        8
+#define GLVBO_ATTRIBS          16
+#define GLVBO_CACHE_SIZE       1024 // entries, power of two
+#define GLVBO_CACHE_WAYS       8    // slots probed per lookup
+#define GLVBO_MAX_BYTES        (12 * 1024 * 1024)
+#define GLVBO_MIN_BYTES        64
+#define GLVBO_EVICT_AGE        300 // frames without use
+#define GLVBO_VOLATILE_CHANGES 4   // content changes before backing off
+#define GLVBO_VOLATILE_FRAMES  120
+#define GLVBO_LOG_INTERVAL     300 // frames
+
+typedef enum {
+    ARRAY_VERTEX,
+    ARRAY_NORMAL,
+    ARRAY_COLOR,
+    ARRAY_TEXCOORD,
+    ARRAY_ATTRIB,
+} glvbo_kind;
+
+typedef struct glvbo_array {
+    bool enabled;
+    bool client;    // pointer is client memory, not yet given to vitaGL
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    GLsizei stride;
+    const uint8_t * ptr;
+
+    // What vitaGL was last given for this array
+    bool sent_valid;
+    GLuint sent_buffer;
+    const void * sent_ptr;
+} glvbo_array;
+
+typedef struct glvbo_entry {
+    const uint8_t * ptr; // NULL for a free slot
+    uint32_t len;
+    uint64_t hash;
+    GLuint buffer;       // 0 until promoted
+    uint32_t stable;     // frames the contents were seen unchanged
+    uint32_t changes;    // consecutive content changes
+    uint32_t last_frame;
+    uint32_t skip_until; // frame until which the range isn't hashed
+} glvbo_entry;
+
+static glvbo_array s_vertex;
+static glvbo_array s_normal;
+static glvbo_array s_color;
+static glvbo_array s_texcoord[GLVBO_TEX_UNITS];
+static glvbo_array s_attrib[GLVBO_ATTRIBS];
+
+// Client texture unit as seen by the game, and as set in vitaGL
+static uint32_t s_client_unit;
+static uint32_t s_gl_client_unit;
+
+static glvbo_entry s_cache[GLVBO_CACHE_SIZE];
+static uint32_t s_cache_bytes;
+static uint32_t s_frame;
+
+static struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t copies;
+    uint32_t promotions;
+    uint32_t evictions;
+} s_stats;
+
+/*
+ * 64-bit content hash. Four independent 32-bit multiply-rotate lanes keep
+ * the NEON pipeline busy; a range is 16-byte blocks plus a scalar tail.
+ */
+static uint64_t hash_range(const uint8_t * p, uint32_t len) {
+    static const uint32_t seed[4] = {
+            0x243F6A88u, 0x85A308D3u, 0x13198A2Eu, 0x03707344u
+    };
+    const uint32x4_t prime = vdupq_n_u32(0x9E3779B1u);
+    uint32x4_t h = vld1q_u32(seed);
+
+    uint32_t blocks = len / 16;
+    for (uint32_t i = 0; i < blocks; i++, p += 16) {
+        uint32x4_t w = vreinterpretq_u32_u8(vld1q_u8(p));
+        h = veorq_u32(h, w);
+        h = vorrq_u32(vshlq_n_u32(h, 13), vshrq_n_u32(h, 19));
+        h = vmulq_u32(h, prime);
+    }
+
+    uint32_t lanes[4];
+    vst1q_u32(lanes, h);
+
+    uint32_t tail = len ^ 0xC2B2AE35u;
+    for (uint32_t i = 0; i < (len & 15); i++)
+        tail = (tail ^ p[i]) * 0x01000193u;
+
+    uint32_t lo = (lanes[0] ^ tail) * 0x85EBCA6Bu + lanes[1];
+    uint32_t hi = (lanes[2] ^ (tail >> 7)) * 0xC2B2AE35u + lanes[3];
+    lo ^= hi >> 15;
+    hi ^= lo >> 13;
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint32_t type_size(GLenum type) {
+    switch (type) {
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE:
+            return 1;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+        case GL_HALF_FLOAT:
+            return 2;
+        default:
+            return 4;
+    }
+}
+
+static inline uint32_t cache_slot(const uint8_t * ptr, uint32_t len) {
+    uint32_t k = (uint32_t)(uintptr_t)ptr ^ (len * 0x9E3779B1u);
+    k ^= k >> 16;
+    k *= 0x85EBCA6Bu;
+    k ^= k >> 13;
+    return k & (GLVBO_CACHE_SIZE - 1);
+}
+
+static void forget_sent_pointers(void) {
+    s_vertex.sent_valid = false;
+    s_normal.sent_valid = false;
+    s_color.sent_valid = false;
+    for (int i = 0; i < GLVBO_TEX_UNITS; i++)
+        s_texcoord[i].sent_valid = false;
+    for (int i = 0; i < GLVBO_ATTRIBS; i++)
+        s_attrib[i].sent_valid = false;
+}
+
+static void drop_buffer(glvbo_entry * e) {
+    if (!e->buffer)
+        return;
+
+    glDeleteBuffers_soloader(1, &e->buffer);
+    e->buffer = 0;
+    s_cache_bytes -= e->len;
+    s_stats.evictions++;
+    // The buffer may still be what some array points at
+    forget_sent_pointers();
+}
+
+static void release_entry(glvbo_entry * e) {
+    drop_buffer(e);
+    memset(e, 0, sizeof(*e));
+}
+
+/*
+ * Probes a fixed window, so that freeing a slot never breaks the lookup of
+ * another entry. Returns the matching entry, or a free / least recently used
+ * slot of the window to (re)use. Entries used this frame are never given
+ * away, since a pending draw may still reference their buffer; NULL is
+ * returned if that's all the window holds.
+ */
+static glvbo_entry * cache_lookup(const uint8_t * ptr, uint32_t len,
+                                  bool * found) {
+    uint32_t slot = cache_slot(ptr, len);
+    glvbo_entry * victim = NULL;
+
+    for (int i = 0; i < GLVBO_CACHE_WAYS; i++) {
+        glvbo_entry * e = &s_cache[(slot + i) & (GLVBO_CACHE_SIZE - 1)];
+        if (e->ptr == ptr && e->len == len) {
+            *found = true;
+            return e;
+        }
+        if (!victim || (victim->ptr && (!e->ptr ||
+                                        e->last_frame < victim->last_frame)))
+            victim = e;
+    }
+
+    *found = false;
+    if (victim->ptr && victim->last_frame == s_frame)
+        return NULL;
+    return victim;
+}
+
+/*
+ * Returns the buffer to draw the range from, or 0 if it has to be copied
+ * from client memory this time.
+ */
+static GLuint cached_buffer(const uint8_t * ptr, uint32_t len) {
+    if (len < GLVBO_MIN_BYTES)
+        return 0;
+
+    bool found;
+    glvbo_entry * e = cache_lookup(ptr, len, &found);
+
+    if (!e)
+        return 0;
+
+    if (!found) {
+        release_entry(e);
+        e->ptr = ptr;
+        e->len = len;
+        e->hash = hash_range(ptr, len);
+        e->last_frame = s_frame;
+        s_stats.misses++;
+        return 0;
+    }
+
+    if (s_frame < e->skip_until) {
+        e->last_frame = s_frame;
+        return 0;
+    }
+
+    uint64_t hash = hash_range(ptr, len);
+
+    if (hash != e->hash) {
+        e->hash = hash;
+        e->stable = 0;
+        e->last_frame = s_frame;
+        if (++e->changes >= GLVBO_VOLATILE_CHANGES) {
+            e->changes = 0;
+            e->skip_until = s_frame + GLVBO_VOLATILE_FRAMES;
+        }
+        s_stats.misses++;
+        // Earlier draws of this frame may still read the old contents, so
+        // the buffer isn't refilled in place; it gets promoted again later
+        drop_buffer(e);
+        return 0;
+    }
+
+    e->changes = 0;
+    if (e->last_frame != s_frame) {
+        e->stable++;
+        e->last_frame = s_frame;
+    }
+
+    if (e->buffer) {
+        s_stats.hits++;
+        return e->buffer;
+    }
+
+    if (e->stable < 1 || s_cache_bytes + len > GLVBO_MAX_BYTES) {
+        s_stats.misses++;
+        return 0;
+    }
+
+    glGenBuffers(1, &e->buffer);
+    glBindBuffer_soloader(GL_ARRAY_BUFFER, e->buffer);
+    glBufferData(GL_ARRAY_BUFFER, len, ptr, GL_STATIC_DRAW);
+    s_cache_bytes += len;
+    s_stats.promotions++;
+    return e->buffer;
+}
+
+static void send_pointer(glvbo_kind kind, uint32_t index, glvbo_array * a,
+                         GLuint buffer, const void * ptr) {
+    if (a->sent_valid && a->sent_buffer == buffer && a->sent_ptr == ptr)
+        return;
+
+    if (buffer != GLSTATE_UNKNOWN)
+        glBindBuffer_soloader(GL_ARRAY_BUFFER, buffer);
+
+    switch (kind) {
+        case ARRAY_VERTEX:
+            glVertexPointer(a->size, a->type, a->stride, ptr);
+            break;
+        case ARRAY_NORMAL:
+            glNormalPointer(a->type, a->stride, ptr);
+            break;
+        case ARRAY_COLOR:
+            glColorPointer(a->size, a->type, a->stride, ptr);
+            break;
+        case ARRAY_TEXCOORD:
+            if (s_gl_client_unit != index) {
+                glClientActiveTexture(GL_TEXTURE0 + index);
+                s_gl_client_unit = index;
+            }
+            glTexCoordPointer(a->size, a->type, a->stride, ptr);
+            break;
+        case ARRAY_ATTRIB:
+            glVertexAttribPointer(index, a->size, a->type, a->normalized,
+                                  a->stride, ptr);
+            break;
+    }
+
+    a->sent_valid = true;
+    a->sent_buffer = buffer;
+    a->sent_ptr = ptr;
+}
+
+static void prepare_array(glvbo_kind kind, uint32_t index, glvbo_array * a,
+                          bool ranged, uint32_t last) {
+    if (!a->enabled || !a->client)
+        return;
+
+    GLuint buffer = 0;
+
+    if (ranged && a->ptr) {
+        uint32_t elem = a->size * type_size(a->type);
+        uint32_t stride = a->stride ? (uint32_t)a->stride : elem;
+        // Cached from the array's start so that the pointer maps to offset 0
+        buffer = cached_buffer(a->ptr, last * stride + elem);
+    }
+
+    if (buffer) {
+        send_pointer(kind, index, a, buffer, NULL);
+    } else {
+        s_stats.copies++;
+        send_pointer(kind, index, a, 0, a->ptr);
+    }
+}
+
+/*
+ * Vertices [0, last] of every enabled client array are read. ranged is
+ * false when that range isn't known, which always means the copy path.
+ */
+static void prepare_draw(bool ranged, uint32_t last) {
+    uint32_t bound = glstate_bound_buffer(GL_ARRAY_BUFFER);
+    if (bound == GLSTATE_UNKNOWN) {
+        // Client arrays are sent with 0 bound, so the game's binding has to
+        // be known to be restored afterwards
+        GLint b = 0;
+        glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &b);
+        glBindBuffer_soloader(GL_ARRAY_BUFFER, b);
+        bound = b;
+    }
+
+    prepare_array(ARRAY_VERTEX, 0, &s_vertex, ranged, last);
+    prepare_array(ARRAY_NORMAL, 0, &s_normal, ranged, last);
+    prepare_array(ARRAY_COLOR, 0, &s_color, ranged, last);
+    for (uint32_t i = 0; i < GLVBO_TEX_UNITS; i++)
+        prepare_array(ARRAY_TEXCOORD, i, &s_texcoord[i], ranged, last);
+    for (uint32_t i = 0; i < GLVBO_ATTRIBS; i++)
+        prepare_array(ARRAY_ATTRIB, i, &s_attrib[i], ranged, last);
+
+    // Pointers are resolved when set, so the game's bindings can go back now
+    glBindBuffer_soloader(GL_ARRAY_BUFFER, bound);
+    if (s_gl_client_unit != s_client_unit) {
+        glClientActiveTexture(GL_TEXTURE0 + s_client_unit);
+        s_gl_client_unit = s_client_unit;
+    }
+}
+
+void glvbo_prepare_draw_arrays(GLint first, GLsizei count) {
+    if (count <= 0)
+        return;
+    prepare_draw(true, first + count - 1);
+}
+
+void glvbo_prepare_draw_elements(GLsizei count, GLenum type,
+                                 const void *indices) {
+    // Indices inside a buffer object can't be scanned for their range
+    if (glstate_bound_buffer(GL_ELEMENT_ARRAY_BUFFER) != 0 || !indices ||
+        count <= 0) {
+        prepare_draw(false, 0);
+        return;
+    }
+
+    uint32_t last = 0;
+    switch (type) {
+        case GL_UNSIGNED_BYTE: {
+            const uint8_t * idx = indices;
+            for (GLsizei i = 0; i < count; i++)
+                if (idx[i] > last) last = idx[i];
+            break;
+        }
+        case GL_UNSIGNED_SHORT: {
+            const uint16_t * idx = indices;
+            for (GLsizei i = 0; i < count; i++)
+                if (idx[i] > last) last = idx[i];
+            break;
+        }
+        default: {
+            const uint32_t * idx = indices;
+            for (GLsizei i = 0; i < count; i++)
+                if (idx[i] > last) last = idx[i];
+            break;
+        }
+    }
+
+    prepare_draw(true, last);
+}
+
+/*
+ * A pointer set while a buffer is bound is resolved against that buffer, so
+ * it has to go to vitaGL immediately. The same goes for any pointer set
+ * while the binding is unknown, in which case it's passed on as is.
+ */
+static void set_pointer(glvbo_kind kind, uint32_t index, glvbo_array * a,
+                        GLint size, GLenum type, GLboolean normalized,
+                        GLsizei stride, const void * ptr) {
+    a->size = size;
+    a->type = type;
+    a->normalized = normalized;
+    a->stride = stride;
+    a->ptr = ptr;
+
+    GLuint bound = glstate_bound_buffer(GL_ARRAY_BUFFER);
+    a->client = (bound == 0);
+    a->sent_valid = false;
+
+    if (!a->client)
+        send_pointer(kind, index, a, bound, ptr);
+}
+
+void glVertexPointer_soloader(GLint size, GLenum type, GLsizei stride,
+                              const void *pointer) {
+    set_pointer(ARRAY_VERTEX, 0, &s_vertex, size, type, GL_FALSE, stride,
+                pointer);
+}
+
+void glNormalPointer_soloader(GLenum type, GLsizei stride,
+                              const void *pointer) {
+    set_pointer(ARRAY_NORMAL, 0, &s_normal, 3, type, GL_FALSE, stride,
+                pointer);
+}
+
+void glColorPointer_soloader(GLint size, GLenum type, GLsizei stride,
+                             const void *pointer) {
+    set_pointer(ARRAY_COLOR, 0, &s_color, size, type, GL_FALSE, stride,
+                pointer);
+}
+
+void glTexCoordPointer_soloader(GLint size, GLenum type, GLsizei stride,
+                                const void *pointer) {
+    set_pointer(ARRAY_TEXCOORD, s_client_unit, &s_texcoord[s_client_unit],
+                size, type, GL_FALSE, stride, pointer);
+}
+
+void glVertexAttribPointer_soloader(GLuint index, GLint size, GLenum type,
+                                    GLboolean normalized, GLsizei stride,
+                                    const void *pointer) {
+    if (index >= GLVBO_ATTRIBS) {
+        glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+        return;
+    }
+
+    set_pointer(ARRAY_ATTRIB, index, &s_attrib[index], size, type, normalized,
+                stride, pointer);
+}
+
+void glClientActiveTexture_soloader(GLenum texture) {
+    uint32_t unit = texture - GL_TEXTURE0;
+    if (unit >= GLVBO_TEX_UNITS) {
+        logv_error("glClientActiveTexture: unsupported unit 0x%x", texture);
+        return;
+    }
+
+    s_client_unit = unit;
+    if (s_gl_client_unit != unit) {
+        glClientActiveTexture(texture);
+        s_gl_client_unit = unit;
+    }
+}
+
+static glvbo_array * client_state_array(GLenum array) {
+    switch (array) {
+        case GL_VERTEX_ARRAY: return &s_vertex;
+        case GL_NORMAL_ARRAY: return &s_normal;
+        case GL_COLOR_ARRAY: return &s_color;
+        case GL_TEXTURE_COORD_ARRAY: return &s_texcoord[s_client_unit];
+        default: return NULL;
+    }
+}
+
+void glEnableClientState_soloader(GLenum array) {
+    glvbo_array * a = client_state_array(array);
+    if (a)
+        a->enabled = true;
+    glEnableClientState(array);
+}
+
+void glDisableClientState_soloader(GLenum array) {
+    glvbo_array * a = client_state_array(array);
+    if (a)
+        a->enabled = false;
+    glDisableClientState(array);
+}
+
+void glEnableVertexAttribArray_soloader(GLuint index) {
+    if (index < GLVBO_ATTRIBS)
+        s_attrib[index].enabled = true;
+    glEnableVertexAttribArray(index);
+}
+
+void glDisableVertexAttribArray_soloader(GLuint index) {
+    if (index < GLVBO_ATTRIBS)
+        s_attrib[index].enabled = false;
+    glDisableVertexAttribArray(index);
+}
+
+void glvbo_invalidate(void) {
+    /*
+     * vitaGL has the one context, so its client texture unit stays what it
+     * was, and so does ours; only the pointers are sent again.
+     */
+    forget_sent_pointers();
+}
+
+void glvbo_frame_end(void) {
+    s_frame++;
+
+    // Amortized aging: one slice of the cache per frame
+    const uint32_t slice = GLVBO_CACHE_SIZE / 64;
+    uint32_t start = (s_frame % 64) * slice;
+    for (uint32_t i = start; i < start + slice; i++) {
+        glvbo_entry * e = &s_cache[i];
+        if (e->ptr && s_frame - e->last_frame > GLVBO_EVICT_AGE)
+            release_entry(e);
+    }
+
+    if (s_frame % GLVBO_LOG_INTERVAL == 0) {
+        logv_debug("[glvbo] %u hits, %u misses, %u copies, %u promoted, "
+                   "%u evicted, %u KiB cached", s_stats.hits, s_stats.misses,
+                   s_stats.copies, s_stats.promotions, s_stats.evictions,
+                   s_cache_bytes / 1024);
+        memset(&s_stats, 0, sizeof(s_stats));
+    }
+}
@@ -0,0 +1,50 @@
+/*
+ * reimpl/glvbo.h
+ *
+ * Promotion of stable client-side vertex arrays into cached GL buffers.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_GLVBO_H
+#define SOLOADER_GLVBO_H
+
+#include <vitaGL.h>
+
+void glVertexPointer_soloader(GLint size, GLenum type, GLsizei stride,
+                              const void *pointer);
+void glNormalPointer_soloader(GLenum type, GLsizei stride,
+                              const void *pointer);
+void glColorPointer_soloader(GLint size, GLenum type, GLsizei stride,
+                             const void *pointer);
+void glTexCoordPointer_soloader(GLint size, GLenum type, GLsizei stride,
+                                const void *pointer);
+void glVertexAttribPointer_soloader(GLuint index, GLint size, GLenum type,
+                                    GLboolean normalized, GLsizei stride,
+                                    const void *pointer);
+
+void glClientActiveTexture_soloader(GLenum texture);
+void glEnableClientState_soloader(GLenum array);
+void glDisableClientState_soloader(GLenum array);
+void glEnableVertexAttribArray_soloader(GLuint index);
+void glDisableVertexAttribArray_soloader(GLuint index);
+
+/*
+ * Hand the client arrays a draw call is about to read over to vitaGL,
+ * either as a cached buffer or as plain client memory. Must be called right
+ * before the corresponding glDraw*.
+ */
+void glvbo_prepare_draw_arrays(GLint first, GLsizei count);
+void glvbo_prepare_draw_elements(GLsizei count, GLenum type,
+                                 const void *indices);
+
+// Forget all pointers sent to vitaGL (context creation, MakeCurrent)
+void glvbo_invalidate(void);
+
+// Frame boundary: ages the cache and rolls the statistics
+void glvbo_frame_end(void);
+
+#endif // SOLOADER_GLVBO_H
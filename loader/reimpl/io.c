@@ -13,15 +13,30 @@
 
 #include "reimpl/io.h"
 
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/unistd.h>
 #include <stdlib.h>
 #include <dirent.h>
+#include <psp2/io/fcntl.h>
 #include <psp2/kernel/threadmgr.h>
 #include <libc_bridge/libc_bridge.h>
 
+#include "reimpl/iotrace.h"
+#include "utils/blockcache.h"
+#include "utils/dirtree.h"
+#include "utils/filemap.h"
 #include "utils/logger.h"
+#include "utils/mounts.h"
+#include "utils/negcache.h"
+#include "utils/prefetch.h"
+#include "utils/rastream.h"
+#include "utils/utils.h"
+#include "utils/writebehind.h"
+#include "utils/zipvfs.h"
 
 #define MUSL_O_WRONLY         01
 #define MUSL_O_RDWR           02
@@ -53,18 +68,8 @@ int oflags_newlib_to_oflags_musl(int flags)
     return out;
 }
 
-dirent64_bionic * dirent_newlib_to_dirent_bionic(struct dirent* dirent_newlib) {
-    dirent64_bionic * ret = malloc(sizeof(dirent64_bionic));
-    strncpy(ret->d_name, dirent_newlib->d_name, sizeof(ret->d_name));
-    ret->d_off = 0;
-    ret->d_reclen = 0;
-    ret->d_type = SCE_S_ISDIR(dirent_newlib->d_stat.st_mode) ? DT_DIR : DT_REG;
-    return ret;
-}
-
 void stat_newlib_to_stat_bionic(struct stat * src, stat64_bionic * dst) {
-    if (!src) return;
-    if (!dst) dst = malloc(sizeof(stat64_bionic));
+    if (!src || !dst) return;
 
     dst->st_dev = src->st_dev;
     dst->st_ino = src->st_ino;
@@ -84,71 +89,232 @@ void stat_newlib_to_stat_bionic(struct stat * src, stat64_bionic * dst) {
     dst->st_ctime_nsec = 0;
 }
 
+// Entries returned by readdir() for directories served from the snapshot
+static struct dirent dirtree_entries[DIRTREE_MAX_DIRS];
+
 struct dirent * readdir_soloader(DIR * dir) {
-    struct dirent* ret = readdir(dir);
+    struct dirent* ret;
+
+    if (dirtree_owns(dir)) {
+        dirtree_dir * d = (dirtree_dir *)dir;
+        ret = &dirtree_entries[dirtree_slot(d)];
+        bool is_dir;
+        if (dirtree_readdir(d, ret->d_name, sizeof(ret->d_name), &is_dir))
+            ret->d_stat.st_mode = is_dir ? SCE_S_IFDIR : SCE_S_IFREG;
+        else
+            ret = NULL;
+    } else {
+        ret = readdir(dir);
+    }
+
     log_debug("[io] readdir()");
     return ret;
 }
 
 int readdir_r_soloader(DIR *dirp, dirent64_bionic *entry, dirent64_bionic **result) {
-    struct dirent dirent_tmp;
-    struct dirent* pdirent_tmp;
-
-    int ret = readdir_r(dirp, &dirent_tmp, &pdirent_tmp);
-
-    if (ret == 0) {
-        dirent64_bionic* entry_tmp = dirent_newlib_to_dirent_bionic(&dirent_tmp);
-        memcpy(entry, entry_tmp, sizeof(dirent64_bionic));
-        *result = (pdirent_tmp != NULL) ? entry : NULL;
-        free(entry_tmp);
+    int ret = 0;
+
+    if (dirtree_owns(dirp)) {
+        bool is_dir;
+        if (dirtree_readdir((dirtree_dir *)dirp, entry->d_name,
+                            sizeof(entry->d_name), &is_dir)) {
+            entry->d_off = 0;
+            entry->d_reclen = 0;
+            entry->d_type = is_dir ? DT_DIR : DT_REG;
+            *result = entry;
+        } else {
+            *result = NULL;
+        }
+    } else {
+        struct dirent dirent_tmp;
+        struct dirent* pdirent_tmp;
+
+        ret = readdir_r(dirp, &dirent_tmp, &pdirent_tmp);
+
+        if (ret == 0 && pdirent_tmp) {
+            strncpy(entry->d_name, dirent_tmp.d_name, sizeof(entry->d_name));
+            entry->d_off = 0;
+            entry->d_reclen = 0;
+            entry->d_type = SCE_S_ISDIR(dirent_tmp.d_stat.st_mode) ? DT_DIR : DT_REG;
+            *result = entry;
+        } else if (ret == 0) {
+            *result = NULL;
+        }
     }
 
     log_debug("[io] readdir_r()");
     return ret;
 }
 
+// Where the next read from `f` starts, for the trace
+static int64_t file_pos(FILE * f) {
+    if (rastream_owns(f))
+        return rastream_tell((rastream *)f);
+    if (zipvfs_owns(f))
+        return zipvfs_tell((zipvfs_file *)f);
+    if (writebehind_owns(f))
+        return writebehind_tell((writebehind_file *)f);
+    return sceLibcBridge_ftell(f);
+}
+
+static int64_t fd_pos(int fd) {
+    zipvfs_file * zf = zipvfs_from_fd(fd);
+    return zf ? zipvfs_tell(zf) : lseek(fd, 0, SEEK_CUR);
+}
+
+// The new contents of a file written behind are on the card
+void writebehind_committed(const char * path) {
+    negcache_forget(path);
+    blockcache_forget(path);
+    filemap_forget(path);
+}
+
 int fopenc = 0;
 
 FILE *fopen_soloader(char *fname, char *mode) {
-    char fopen_path_real[1024];
-
-    if (sceClibStrncmp(fname, "/sdcard/Android/data", 20) == 0) {
-        sceClibSnprintf(fopen_path_real, sizeof(fopen_path_real), "ux0:data/backstab/%s", fname + 20);
-    } else if (strncmp(fname, "/sdcard", 7) == 0) {
-        sceClibSnprintf(fopen_path_real, sizeof(fopen_path_real), "ux0:data/backstab/com.gameloft.android.ANMP.GloftSDHM/files/%s", fname + 7);
-    } else {
-        sceClibSnprintf(fopen_path_real, sizeof(fopen_path_real), "ux0:data/backstab/com.gameloft.android.ANMP.GloftSDHM/files/%s", fname);
+    char fopen_path_real[PATH_MAX];
+    if (!mounts_translate(fname, fopen_path_real, sizeof(fopen_path_real)))
+        return NULL;
+
+    bool writing = strpbrk(mode, "wa+") != NULL;
+    FILE* ret = NULL;
+    uint64_t t = iotrace_start();
+    writebehind_sync(fopen_path_real);
+
+    if (writing) {
+        ret = (FILE *)writebehind_open(fopen_path_real, mode);
+        if (!ret)
+            ret = sceLibcBridge_fopen(fopen_path_real, mode);
+        negcache_forget(fopen_path_real);
+        blockcache_forget(fopen_path_real);
+        filemap_forget(fopen_path_real);
+        if (ret)
+            dirtree_created(fopen_path_real);
+    } else if (!negcache_missing(fopen_path_real)) {
+        // The snapshot knows what isn't on the card without asking it
+        bool missing = dirtree_lookup(fopen_path_real, NULL) == DIRTREE_MISSING;
+
+        // Text reads too: fscanf() reaches our streams through
+        // fscanf_soloader(), and the card does no newline translation
+        if (!missing) {
+            errno = 0;
+            ret = (FILE *)rastream_open(fopen_path_real);
+            missing = !ret && errno == ENOENT;
+        }
+        if (!ret && !missing)
+            ret = sceLibcBridge_fopen(fopen_path_real, mode);
+
+        // Files that weren't extracted may still be in the .apk
+        if (!ret)
+            ret = (FILE *)zipvfs_open(fopen_path_real);
+
+        if (ret)
+            prefetch_opened(fopen_path_real, (uintptr_t)ret,
+                            rastream_owns(ret) || zipvfs_owns(ret));
+
+        // SceLibc doesn't tell why it failed
+        if (!ret && (missing || !file_exists(fopen_path_real)))
+            negcache_add(fopen_path_real);
     }
 
-    FILE* ret = sceLibcBridge_fopen(fopen_path_real, mode);
     if (ret) fopenc++;
+    iotrace_open(t, fopen_path_real, (uintptr_t)ret);
     logv_debug("[io] fopen:%i(%s): 0x%x", fopenc, fopen_path_real, ret);
     return ret;
 }
 
 
 int open_soloader(char *_fname, int flags) {
+    char real_fname[PATH_MAX];
+    if (!mounts_translate(_fname, real_fname, sizeof(real_fname)))
+        return -1;
+
     flags = oflags_newlib_to_oflags_musl(flags);
-    int ret = open(_fname, flags);
-    logv_debug("[io] open(%s, %x): %i", _fname, flags, ret);
+    bool reading = (flags & O_ACCMODE) == O_RDONLY && !(flags & O_CREAT);
+    uint64_t t = iotrace_start();
+    writebehind_sync(real_fname);
+
+    if (reading && negcache_missing(real_fname)) {
+        iotrace_open(t, real_fname, 0);
+        errno = ENOENT;
+        return -1;
+    }
+
+    int ret = -1;
+    int err = ENOENT;
+    if (!reading || dirtree_lookup(real_fname, NULL) != DIRTREE_MISSING) {
+        ret = open(real_fname, flags);
+        err = errno;
+    }
+
+    if (!reading) {
+        negcache_forget(real_fname);
+        blockcache_forget(real_fname);
+        filemap_forget(real_fname);
+        if (ret >= 0)
+            dirtree_created(real_fname);
+    } else if (ret < 0) {
+        zipvfs_file * zf = zipvfs_open(real_fname);
+        if (zf)
+            ret = zipvfs_fd(zf);
+        else if (err == ENOENT)
+            negcache_add(real_fname);
+    }
+
+    // Plain read()s go around the block cache
+    if (reading && ret >= 0)
+        prefetch_opened(real_fname, ret, zipvfs_from_fd(ret) != NULL);
+
+    if (ret >= 0)
+        filemap_opened(ret, real_fname);
+
+    iotrace_open(t, real_fname, ret >= 0 ? (uintptr_t)ret : 0);
+    logv_debug("[io] open(%s, %x): %i", real_fname, flags, ret);
     return ret;
 }
 
 int read_soloader(int fd, void * buf, size_t nbyte) {
-    int ret = read(fd, buf, nbyte);
+    uint64_t t = iotrace_start();
+    int64_t pos = t || prefetch_tracking() ? fd_pos(fd) : -1;
+
+    zipvfs_file * zf = zipvfs_from_fd(fd);
+    int ret = zf ? (int)zipvfs_read(zf, buf, nbyte) : read(fd, buf, nbyte);
+    if (ret > 0)
+        prefetch_read(fd, pos, ret);
+    iotrace_op_done(t, IOTRACE_READ, fd, pos, nbyte, ret);
     logv_debug("[io] read(fd#%i, 0x%x, %i): %i", fd, buf, nbyte, ret);
     return ret;
 }
 
 DIR* opendir_soloader(char* _pathname) {
-    DIR* ret = opendir(_pathname);
-    logv_debug("[io] opendir(\"%s\"): 0x%x", _pathname, ret);
+    char pathname[PATH_MAX];
+    if (!mounts_translate(_pathname, pathname, sizeof(pathname)))
+        return NULL;
+
+    // Saves still being committed would be missing from the listing
+    writebehind_sync(NULL);
+
+    DIR* ret = (DIR *)dirtree_opendir(pathname);
+    if (!ret && dirtree_lookup(pathname, NULL) == DIRTREE_MISSING)
+        errno = ENOENT;
+    else if (!ret)
+        ret = opendir(pathname);
+
+    logv_debug("[io] opendir(\"%s\"): 0x%x", pathname, ret);
     return ret;
 }
 
 int fstat_soloader(int fd, void *statbuf) {
     struct stat st;
-    int res = fstat(fd, &st);
+    zipvfs_file * zf = zipvfs_from_fd(fd);
+    if (zf) {
+        memset(&st, 0, sizeof(st));
+        st.st_mode = S_IFREG | 0444;
+        st.st_nlink = 1;
+        st.st_size = zipvfs_size(zf);
+    }
+
+    int res = zf ? 0 : fstat(fd, &st);
     if (res == 0)
         stat_newlib_to_stat_bionic(&st, statbuf);
 
@@ -157,7 +323,10 @@ int fstat_soloader(int fd, void *statbuf) {
 }
 
 int write_soloader(int fd, const void *buf, int count) {
+    uint64_t t = iotrace_start();
+    int64_t pos = t ? fd_pos(fd) : -1;
     int ret = write(fd, buf, count);
+    iotrace_op_done(t, IOTRACE_WRITE, fd, pos, count, ret);
     logv_debug("[io] write(fd#%i, 0x%x, %i): %i", fd, buf, count, ret);
     return ret;
 }
@@ -168,49 +337,483 @@ int fcntl_soloader(int fd, int cmd, ...) {
 }
 
 off_t lseek_soloader(int fildes, off_t offset, int whence) {
-    off_t ret = lseek(fildes, offset, whence);
+    uint64_t t = iotrace_start();
+    zipvfs_file * zf = zipvfs_from_fd(fildes);
+    off_t ret;
+    if (zf)
+        ret = zipvfs_seek(zf, offset, whence) == 0 ? (off_t)zipvfs_tell(zf) : -1;
+    else
+        ret = lseek(fildes, offset, whence);
+    iotrace_op_done(t, IOTRACE_SEEK, fildes, offset, whence, ret);
     logv_debug("[io] lseek(fd#i, %i, %i): %i", fildes, offset, whence, ret);
     return ret;
 }
 
 int close_soloader(int fd) {
-    int ret = close(fd);
+    uint64_t t = iotrace_start();
+    zipvfs_file * zf = zipvfs_from_fd(fd);
+    int ret = 0;
+    if (zf)
+        zipvfs_close(zf);
+    else
+        ret = close(fd);
+    prefetch_closed(fd);
+    filemap_closed(fd);
+    iotrace_op_done(t, IOTRACE_CLOSE, fd, -1, 0, ret);
     logv_debug("[io] close(fd#%i): %i", fd, ret);
     return ret;
 }
 
 int fclose_soloader(FILE * f) {
     fopenc--;
-    int ret = sceLibcBridge_fclose(f);
+    uint64_t t = iotrace_start();
+    int ret = 0;
+    if (rastream_owns(f))
+        rastream_close((rastream *)f);
+    else if (zipvfs_owns(f))
+        zipvfs_close((zipvfs_file *)f);
+    else if (writebehind_owns(f))
+        ret = writebehind_close((writebehind_file *)f);
+    else
+        ret = sceLibcBridge_fclose(f);
+
+    prefetch_closed((uintptr_t)f);
+    iotrace_op_done(t, IOTRACE_CLOSE, (uintptr_t)f, -1, 0, ret);
     //logv_debug("[io] fclose(0x%x): %i", f, ret);
     return ret;
 }
 
 int closedir_soloader(DIR* dir) {
-    int ret = closedir(dir);
+    int ret = 0;
+    if (dirtree_owns(dir))
+        dirtree_closedir((dirtree_dir *)dir);
+    else
+        ret = closedir(dir);
     logv_debug("[io] closedir(0x%x): %i", dir, ret);
     return ret;
 }
 
 int stat_soloader(char *_pathname, stat64_bionic *statbuf) {
+    char pathname[PATH_MAX];
+    if (!mounts_translate(_pathname, pathname, sizeof(pathname)))
+        return -1;
+
+    uint64_t t = iotrace_start();
+    writebehind_sync(pathname);
+    if (negcache_missing(pathname)) {
+        iotrace_stat(t, pathname, -1);
+        errno = ENOENT;
+        return -1;
+    }
+
     struct stat st;
-    int res = stat(_pathname, &st);
+    int res = -1;
+    int err = ENOENT;
+
+    // Files being written to are asked about on the card, for their size
+    dirtree_stat dst;
+    dirtree_result loose = dirtree_lookup(pathname, &dst);
+    if (loose == DIRTREE_FOUND && !dst.stale) {
+        memset(&st, 0, sizeof(st));
+        st.st_mode = dst.dir ? (S_IFDIR | 0777) : (S_IFREG | 0777);
+        st.st_nlink = 1;
+        st.st_size = dst.size;
+        st.st_atime = st.st_mtime = st.st_ctime = dst.mtime;
+        res = 0;
+    } else if (loose != DIRTREE_MISSING) {
+        res = stat(pathname, &st);
+        err = errno;
+    }
+
+    zipvfs_stat zst;
+    if (res != 0 && zipvfs_path_stat(pathname, &zst)) {
+        memset(&st, 0, sizeof(st));
+        st.st_mode = zst.dir ? (S_IFDIR | 0555) : (S_IFREG | 0444);
+        st.st_nlink = 1;
+        st.st_size = zst.size;
+        st.st_atime = st.st_mtime = st.st_ctime = zst.mtime;
+        res = 0;
+    } else if (res != 0 && err == ENOENT) {
+        negcache_add(pathname);
+    }
 
     if (res == 0)
         stat_newlib_to_stat_bionic(&st, statbuf);
 
-    logv_debug("[io] stat(%s): %i", _pathname, res);
+    iotrace_stat(t, pathname, res);
+    logv_debug("[io] stat(%s): %i", pathname, res);
     return res;
 }
 
+int fd_pread(int fd, const char * path, void * dst, uint32_t len,
+             int64_t offset) {
+    zipvfs_file * zf = zipvfs_from_fd(fd);
+    if (zf)
+        return zipvfs_pread(zf, dst, len, offset);
+
+    if (path) {
+        SceUID uid = sceIoOpen(path, SCE_O_RDONLY, 0);
+        if (uid < 0)
+            return -1;
+        int ret = sceIoPread(uid, dst, len, offset);
+        sceIoClose(uid);
+        return ret < 0 ? -1 : ret;
+    }
+
+    off_t pos = lseek(fd, 0, SEEK_CUR);
+    if (pos < 0)
+        return -1;
+
+    int ret = -1;
+    if (lseek(fd, offset, SEEK_SET) == offset)
+        ret = read(fd, dst, len);
+    lseek(fd, pos, SEEK_SET);
+    return ret;
+}
+
+int remove_soloader(const char * pathname) {
+    char real_pathname[PATH_MAX];
+    if (!mounts_translate(pathname, real_pathname, sizeof(real_pathname)))
+        return -1;
+
+    writebehind_sync(real_pathname);
+    int ret = remove(real_pathname);
+    if (ret == 0) {
+        negcache_add(real_pathname);
+        blockcache_forget(real_pathname);
+        filemap_forget(real_pathname);
+        dirtree_removed(real_pathname);
+    }
+
+    logv_debug("[io] remove(%s): %i", real_pathname, ret);
+    return ret;
+}
+
+int unlink_soloader(const char * pathname) {
+    char real_pathname[PATH_MAX];
+    if (!mounts_translate(pathname, real_pathname, sizeof(real_pathname)))
+        return -1;
+
+    writebehind_sync(real_pathname);
+    int ret = unlink(real_pathname);
+    if (ret == 0) {
+        negcache_add(real_pathname);
+        blockcache_forget(real_pathname);
+        filemap_forget(real_pathname);
+        dirtree_removed(real_pathname);
+    }
+
+    logv_debug("[io] unlink(%s): %i", real_pathname, ret);
+    return ret;
+}
+
+int rename_soloader(const char * oldpath, const char * newpath) {
+    char real_oldpath[PATH_MAX];
+    char real_newpath[PATH_MAX];
+    if (!mounts_translate(oldpath, real_oldpath, sizeof(real_oldpath))
+        || !mounts_translate(newpath, real_newpath, sizeof(real_newpath)))
+        return -1;
+
+    writebehind_sync(real_oldpath);
+    writebehind_sync(real_newpath);
+    int ret = rename(real_oldpath, real_newpath);
+
+    // Could have been a directory, with anything under it
+    if (ret == 0) {
+        negcache_clear();
+        blockcache_forget(real_oldpath);
+        blockcache_forget(real_newpath);
+        filemap_forget(real_oldpath);
+        filemap_forget(real_newpath);
+        dirtree_renamed(real_oldpath, real_newpath);
+    }
+
+    logv_debug("[io] rename(%s, %s): %i", real_oldpath, real_newpath, ret);
+    return ret;
+}
+
 int fseeko_soloader(FILE * a, off_t b, int c) {
-    int ret = fseeko(a,b,c);
+    uint64_t t = iotrace_start();
+    int ret;
+    if (rastream_owns(a))
+        ret = rastream_seek((rastream *)a, b, c);
+    else if (writebehind_owns(a))
+        ret = writebehind_seek((writebehind_file *)a, b, c);
+    else
+        ret = zipvfs_owns(a) ? zipvfs_seek((zipvfs_file *)a, b, c) : fseeko(a,b,c);
+    if (t)
+        iotrace_op_done(t, IOTRACE_SEEK, (uintptr_t)a, b, c, ret == 0 ? file_pos(a) : -1);
     logv_debug("[io] fseeko(0x%x, %i, %i): %i", a,b,c,ret);
     return ret;
 }
 
 off_t ftello_soloader(FILE * a) {
-    off_t ret = ftello(a);
+    off_t ret;
+    if (rastream_owns(a))
+        ret = (off_t)rastream_tell((rastream *)a);
+    else if (writebehind_owns(a))
+        ret = (off_t)writebehind_tell((writebehind_file *)a);
+    else
+        ret = zipvfs_owns(a) ? (off_t)zipvfs_tell((zipvfs_file *)a) : ftello(a);
     logv_debug("[io] ftello(0x%x): %i", a, ret);
     return ret;
 }
+
+size_t fread_soloader(void * ptr, size_t size, size_t count, FILE * f) {
+    uint64_t t = iotrace_start();
+    int64_t pos = t || prefetch_tracking() ? file_pos(f) : -1;
+    size_t ret;
+
+    if (rastream_owns(f))
+        ret = size && count ? rastream_read((rastream *)f, ptr, size * count) / size : 0;
+    else if (zipvfs_owns(f))
+        ret = size && count ? zipvfs_read((zipvfs_file *)f, ptr, size * count) / size : 0;
+    else if (writebehind_owns(f))
+        ret = 0; // opened write-only
+    else
+        ret = sceLibcBridge_fread(ptr, size, count, f);
+
+    if (ret)
+        prefetch_read((uintptr_t)f, pos, ret * size);
+    iotrace_op_done(t, IOTRACE_READ, (uintptr_t)f, pos, size * count, ret * size);
+    return ret;
+}
+
+int fseek_soloader(FILE * f, long offset, int whence) {
+    uint64_t t = iotrace_start();
+    int ret;
+    if (rastream_owns(f))
+        ret = rastream_seek((rastream *)f, offset, whence);
+    else if (zipvfs_owns(f))
+        ret = zipvfs_seek((zipvfs_file *)f, offset, whence);
+    else if (writebehind_owns(f))
+        ret = writebehind_seek((writebehind_file *)f, offset, whence);
+    else
+        ret = sceLibcBridge_fseek(f, offset, whence);
+
+    if (t)
+        iotrace_op_done(t, IOTRACE_SEEK, (uintptr_t)f, offset, whence, ret == 0 ? file_pos(f) : -1);
+    return ret;
+}
+
+long ftell_soloader(FILE * f) {
+    if (rastream_owns(f))
+        return (long)rastream_tell((rastream *)f);
+    if (zipvfs_owns(f))
+        return (long)zipvfs_tell((zipvfs_file *)f);
+    if (writebehind_owns(f))
+        return (long)writebehind_tell((writebehind_file *)f);
+    return sceLibcBridge_ftell(f);
+}
+
+int fgetpos_soloader(FILE * f, fpos_t * pos) {
+    if (rastream_owns(f)) {
+        *pos = (fpos_t)rastream_tell((rastream *)f);
+        return 0;
+    }
+    if (zipvfs_owns(f)) {
+        *pos = (fpos_t)zipvfs_tell((zipvfs_file *)f);
+        return 0;
+    }
+    if (writebehind_owns(f)) {
+        *pos = (fpos_t)writebehind_tell((writebehind_file *)f);
+        return 0;
+    }
+    return sceLibcBridge_fgetpos(f, pos);
+}
+
+int fsetpos_soloader(FILE * f, const fpos_t * pos) {
+    uint64_t t = iotrace_start();
+    int ret;
+    if (rastream_owns(f))
+        ret = rastream_seek((rastream *)f, (int64_t)*pos, SEEK_SET);
+    else if (zipvfs_owns(f))
+        ret = zipvfs_seek((zipvfs_file *)f, (int64_t)*pos, SEEK_SET);
+    else if (writebehind_owns(f))
+        ret = writebehind_seek((writebehind_file *)f, (int64_t)*pos, SEEK_SET);
+    else
+        ret = sceLibcBridge_fsetpos(f, pos);
+
+    if (t)
+        iotrace_op_done(t, IOTRACE_SEEK, (uintptr_t)f, (int64_t)*pos, SEEK_SET, ret == 0 ? file_pos(f) : -1);
+    return ret;
+}
+
+int fgetc_soloader(FILE * f) {
+    if (rastream_owns(f))
+        return rastream_getc((rastream *)f);
+    if (zipvfs_owns(f))
+        return zipvfs_getc((zipvfs_file *)f);
+    if (writebehind_owns(f))
+        return EOF;
+    return sceLibcBridge_fgetc(f);
+}
+
+int getc_soloader(FILE * f) {
+    if (rastream_owns(f))
+        return rastream_getc((rastream *)f);
+    if (zipvfs_owns(f))
+        return zipvfs_getc((zipvfs_file *)f);
+    if (writebehind_owns(f))
+        return EOF;
+    return sceLibcBridge_getc(f);
+}
+
+int ungetc_soloader(int c, FILE * f) {
+    if (rastream_owns(f))
+        return rastream_ungetc(c, (rastream *)f);
+    if (zipvfs_owns(f))
+        return zipvfs_ungetc(c, (zipvfs_file *)f);
+    if (writebehind_owns(f))
+        return EOF;
+    return sceLibcBridge_ungetc(c, f);
+}
+
+char * fgets_soloader(char * s, int n, FILE * f) {
+    uint64_t t = iotrace_start();
+    int64_t pos = t || prefetch_tracking() ? file_pos(f) : -1;
+    char * ret;
+    if (rastream_owns(f))
+        ret = rastream_gets(s, n, (rastream *)f);
+    else if (zipvfs_owns(f))
+        ret = zipvfs_gets(s, n, (zipvfs_file *)f);
+    else if (writebehind_owns(f))
+        ret = NULL;
+    else
+        ret = sceLibcBridge_fgets(s, n, f);
+
+    if (ret)
+        prefetch_read((uintptr_t)f, pos, strlen(ret));
+    if (t)
+        iotrace_op_done(t, IOTRACE_READ, (uintptr_t)f, pos, n, ret ? (int32_t)strlen(ret) : 0);
+    return ret;
+}
+
+int ferror_soloader(FILE * f) {
+    if (rastream_owns(f))
+        return rastream_error((rastream *)f);
+    if (zipvfs_owns(f))
+        return zipvfs_error((zipvfs_file *)f);
+    if (writebehind_owns(f))
+        return writebehind_error((writebehind_file *)f);
+    return sceLibcBridge_ferror(f);
+}
+
+int fflush_soloader(FILE * f) {
+    if (rastream_owns(f) || zipvfs_owns(f))
+        return 0;
+    if (writebehind_owns(f))
+        return writebehind_flush((writebehind_file *)f);
+    if (!f)
+        writebehind_sync(NULL);
+    return sceLibcBridge_fflush(f);
+}
+
+int setvbuf_soloader(FILE * f, char * buf, int mode, size_t size) {
+    // Our streams do their own buffering
+    if (rastream_owns(f) || zipvfs_owns(f) || writebehind_owns(f))
+        return 0;
+    return setvbuf(f, buf, mode, size);
+}
+
+static int scan_read(void * cookie, char * buf, int len) {
+    return (int)fread_soloader(buf, 1, len, cookie);
+}
+
+static fpos_t scan_seek(void * cookie, fpos_t offset, int whence) {
+    if (fseek_soloader(cookie, offset, whence) != 0)
+        return -1;
+    return ftell_soloader(cookie);
+}
+
+int fscanf_soloader(FILE * f, const char * format, ...) {
+    // SceLibc has no vfscanf(), and ours can't read its streams directly
+    FILE * scan = funopen(f, scan_read, NULL, scan_seek, NULL);
+    if (!scan)
+        return EOF;
+
+    // Small, as what was read ahead is handed back after every call
+    char buf[128];
+    setvbuf(scan, buf, _IOFBF, sizeof(buf));
+
+    va_list args;
+    va_start(args, format);
+    int ret = vfscanf(scan, format, args);
+    va_end(args);
+
+    long pos = ftell(scan);
+    if (pos >= 0)
+        fseek_soloader(f, pos, SEEK_SET);
+    fclose(scan);
+    return ret;
+}
+
+FILE * freopen_soloader(const char * fname, const char * mode, FILE * f) {
+    if (!rastream_owns(f) && !zipvfs_owns(f) && !writebehind_owns(f))
+        return freopen(fname, mode, f);
+
+    fclose_soloader(f);
+    if (!fname) {
+        errno = EBADF;
+        return NULL;
+    }
+    return fopen_soloader((char *)fname, (char *)mode);
+}
+
+size_t fwrite_soloader(const void * ptr, size_t size, size_t count, FILE * f) {
+    uint64_t t = iotrace_start();
+    int64_t pos = t ? file_pos(f) : -1;
+    size_t ret;
+
+    if (writebehind_owns(f))
+        ret = size && count ? writebehind_write((writebehind_file *)f, ptr, size * count) / size : 0;
+    else
+        ret = sceLibcBridge_fwrite(ptr, size, count, f);
+
+    iotrace_op_done(t, IOTRACE_WRITE, (uintptr_t)f, pos, size * count, ret * size);
+    return ret;
+}
+
+int fputc_soloader(int c, FILE * f) {
+    if (writebehind_owns(f))
+        return writebehind_putc(c, (writebehind_file *)f);
+    return sceLibcBridge_fputc(c, f);
+}
+
+int fputs_soloader(const char * s, FILE * f) {
+    if (writebehind_owns(f))
+        return writebehind_puts(s, (writebehind_file *)f);
+    return sceLibcBridge_fputs(s, f);
+}
+
+int fprintf_soloader(FILE * f, const char * format, ...) {
+    va_list args;
+    va_start(args, format);
+
+    if (writebehind_owns(f)) {
+        int ret = writebehind_vprintf((writebehind_file *)f, format, args);
+        va_end(args);
+        return ret;
+    }
+
+    // SceLibc has no vfprintf()
+    char buf[512];
+    va_list again;
+    va_copy(again, args);
+    int ret = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+
+    char * out = buf;
+    if (ret >= (int)sizeof(buf)) {
+        out = malloc(ret + 1);
+        if (out)
+            vsnprintf(out, ret + 1, format, again);
+    }
+    va_end(again);
+
+    if (!out || (ret > 0 && sceLibcBridge_fwrite(out, 1, ret, f) != (size_t)ret))
+        ret = -1;
+    if (out != buf)
+        free(out);
+    return ret;
+}
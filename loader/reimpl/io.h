@@ -14,6 +14,7 @@
 #ifndef SOLOADER_IO_H
 #define SOLOADER_IO_H
 
+#include <stdint.h>
 #include <stdio.h>
 #include <sys/dirent.h>
 #include <sys/syslimits.h>
@@ -86,6 +87,51 @@ off_t lseek_soloader(int fildes, off_t offset, int whence);
 
 int fcntl_soloader(int fd, int cmd, ...);
 
+/*
+ * Stdio functions that also take the FILE handles of files read from the
+ * .apk (see utils/zipvfs.h).
+ */
+size_t fread_soloader(void * ptr, size_t size, size_t count, FILE * f);
+int fseek_soloader(FILE * f, long offset, int whence);
+long ftell_soloader(FILE * f);
+int fgetpos_soloader(FILE * f, fpos_t * pos);
+int fsetpos_soloader(FILE * f, const fpos_t * pos);
+int fgetc_soloader(FILE * f);
+int getc_soloader(FILE * f);
+int ungetc_soloader(int c, FILE * f);
+char * fgets_soloader(char * s, int n, FILE * f);
+int ferror_soloader(FILE * f);
+int fflush_soloader(FILE * f);
+int setvbuf_soloader(FILE * f, char * buf, int mode, size_t size);
+
+// newlib's vfscanf() over the functions above, for any handle
+int fscanf_soloader(FILE * f, const char * format, ...);
+
+// Reopens handles of ours through fopen_soloader(); others go to newlib
+FILE * freopen_soloader(const char * fname, const char * mode, FILE * f);
+
+// Writes, which may go to files written behind (see utils/writebehind.h)
+size_t fwrite_soloader(const void * ptr, size_t size, size_t count, FILE * f);
+int fputc_soloader(int c, FILE * f);
+int fputs_soloader(const char * s, FILE * f);
+int fprintf_soloader(FILE * f, const char * format, ...);
+
+// For writebehind_init()
+void writebehind_committed(const char * path);
+
 int write_soloader(int fd, const void *buf, int count);
 
+/*
+ * pread() on a descriptor from open_soloader(), opened on `path`, without
+ * touching its position; for mmap(). A real file is read through a handle
+ * of its own, so the game can use the descriptor at the same time. Without
+ * a path, the position is moved and put back, which isn't safe then.
+ */
+int fd_pread(int fd, const char * path, void * dst, uint32_t len,
+             int64_t offset);
+
+int remove_soloader(const char * pathname);
+int unlink_soloader(const char * pathname);
+int rename_soloader(const char * oldpath, const char * newpath);
+
 #endif // SOLOADER_IO_H
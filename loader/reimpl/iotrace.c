@@ -0,0 +1,247 @@
+/*
+ * reimpl/iotrace.c
+ *
+ * Recorder for the file I/O done through our shims. Built in with
+ * IOTRACE=1, writes DATA_PATH"iotrace.bin", to be inspected with
+ * scripts/iotrace.py.
+ *
+ * Shims append fixed-size records to one of two buffers under a lock, which
+ * costs a memcpy; nothing is formatted. A thread swaps the buffers every
+ * IOTRACE_FLUSH_US and writes the full one out with plain sceIo calls, so
+ * the trace doesn't show up in itself. Records that don't fit until the
+ * next swap are dropped and counted instead of blocking the game.
+ *
+ * Paths are identified by their FNV-1a hash. The path itself is only in
+ * OPEN and STAT records; the others take the path of their handle from
+ * the table of open handles kept here.
+ *
+ * Trace layout (little-endian):
+ *   header   "IOTR", u32 version, u32 record size
+ *   record   u8 op, u8 0, u16 path length, u32 thread, u32 path id,
+ *            u32 handle, u64 start (us), i64 offset, u32 size,
+ *            i32 result, u32 duration (us), u32 0,
+ *            then path bytes padded to 4 for OPEN and STAT
+ *   DROPPED  a record with op 0 and the number of records lost in size
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "reimpl/iotrace.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <psp2/io/fcntl.h>
+#include <psp2/kernel/processmgr.h>
+#include <psp2/kernel/threadmgr.h>
+
+#include "utils/logger.h"
+
+#define IOTRACE_PATH        DATA_PATH"iotrace.bin"
+#define IOTRACE_VERSION     1
+#define IOTRACE_BUFFER_SIZE (256 * 1024) // each of the two
+#define IOTRACE_FLUSH_US    (100 * 1000)
+#define IOTRACE_HANDLES     256 // power of two
+#define IOTRACE_PATH_MAX    1024
+#define IOTRACE_STACK_SIZE  (16 * 1024)
+
+typedef struct iotrace_record {
+    uint8_t op;
+    uint8_t pad;
+    uint16_t path_len;
+    uint32_t thread;
+    uint32_t path_id;
+    uint32_t handle;
+    uint64_t start;
+    int64_t offset;
+    uint32_t size;
+    int32_t result;
+    uint32_t duration;
+    uint32_t pad2;
+} iotrace_record;
+
+typedef struct iotrace_handle {
+    uintptr_t handle;
+    uint32_t path_id;
+} iotrace_handle;
+
+static SceKernelLwMutexWork s_lock;
+static bool s_ready;
+static SceUID s_file = -1;
+
+static uint8_t s_buffers[2][IOTRACE_BUFFER_SIZE];
+static int s_active;
+static uint32_t s_len;
+static uint32_t s_dropped;
+
+static iotrace_handle s_handles[IOTRACE_HANDLES];
+
+static uint32_t path_hash(const char * path) {
+    uint32_t h = 0x811C9DC5u;
+    while (*path) {
+        h ^= (uint8_t)*path++;
+        h *= 0x01000193u;
+    }
+    return h;
+}
+
+static inline iotrace_handle * handle_slot(uintptr_t handle) {
+    return &s_handles[(handle ^ (handle >> 8)) & (IOTRACE_HANDLES - 1)];
+}
+
+// With the lock held; false if there's no room for it
+static bool append_dropped(void) {
+    if (s_len + sizeof(iotrace_record) > IOTRACE_BUFFER_SIZE)
+        return false;
+
+    iotrace_record drop;
+    memset(&drop, 0, sizeof(drop));
+    drop.size = s_dropped;
+    memcpy(s_buffers[s_active] + s_len, &drop, sizeof(drop));
+    s_len += sizeof(drop);
+    s_dropped = 0;
+    return true;
+}
+
+// With the lock held
+static void append(const iotrace_record * rec, const char * path) {
+    uint32_t path_size = (rec->path_len + 3) & ~3u;
+    uint32_t size = sizeof(*rec) + path_size;
+
+    if (s_dropped && (s_len + sizeof(*rec) + size > IOTRACE_BUFFER_SIZE
+                      || !append_dropped())) {
+        s_dropped++;
+        return;
+    }
+
+    if (s_len + size > IOTRACE_BUFFER_SIZE) {
+        s_dropped++;
+        return;
+    }
+
+    uint8_t * dst = s_buffers[s_active] + s_len;
+    memcpy(dst, rec, sizeof(*rec));
+    if (path_size) {
+        memset(dst + sizeof(*rec) + path_size - 4, 0, 4);
+        memcpy(dst + sizeof(*rec), path, rec->path_len);
+    }
+    s_len += size;
+}
+
+static void * writer_thread(void * arg) {
+    for (;;) {
+        sceKernelDelayThread(IOTRACE_FLUSH_US);
+
+        sceKernelLockLwMutex(&s_lock, 1, NULL);
+        int full = s_active;
+        uint32_t len = s_len;
+        s_active = !s_active;
+        s_len = 0;
+        if (s_dropped)
+            append_dropped();
+        sceKernelUnlockLwMutex(&s_lock, 1);
+
+        if (len && sceIoWrite(s_file, s_buffers[full], len) != (int)len)
+            log_error("[iotrace] could not write the trace");
+    }
+    return arg;
+}
+
+void iotrace_init(void) {
+    if (!IOTRACE || s_ready)
+        return;
+
+    s_file = sceIoOpen(IOTRACE_PATH, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC,
+                       0777);
+    if (s_file < 0) {
+        log_error("[iotrace] could not create " IOTRACE_PATH);
+        return;
+    }
+
+    uint32_t header[3] = { 0, IOTRACE_VERSION, sizeof(iotrace_record) };
+    memcpy(header, "IOTR", 4);
+    sceIoWrite(s_file, header, sizeof(header));
+
+    if (sceKernelCreateLwMutex(&s_lock, "iotrace_lock", 0, 0, NULL) < 0) {
+        sceIoClose(s_file);
+        return;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, IOTRACE_STACK_SIZE);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    pthread_t thread;
+    if (pthread_create(&thread, &attr, writer_thread, NULL) != 0) {
+        log_error("[iotrace] could not start the writer thread");
+        sceIoClose(s_file);
+    } else {
+        s_ready = true;
+        log_info("[iotrace] recording into " IOTRACE_PATH);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+uint64_t iotrace_start(void) {
+    return s_ready ? sceKernelGetProcessTimeWide() : 0;
+}
+
+static void record(uint64_t start, iotrace_op op, const char * path,
+                   uintptr_t handle, int64_t offset, uint32_t size,
+                   int32_t result) {
+    iotrace_record rec;
+    rec.op = op;
+    rec.pad = 0;
+    rec.path_len = 0;
+    rec.thread = (uint32_t)sceKernelGetThreadId();
+    rec.path_id = 0;
+    rec.handle = (uint32_t)handle;
+    rec.start = start;
+    rec.offset = offset;
+    rec.size = size;
+    rec.result = result;
+    rec.duration = (uint32_t)(sceKernelGetProcessTimeWide() - start);
+    rec.pad2 = 0;
+
+    if (path) {
+        size_t len = strlen(path);
+        rec.path_len = len < IOTRACE_PATH_MAX ? (uint16_t)len : IOTRACE_PATH_MAX;
+        rec.path_id = path_hash(path);
+    }
+
+    sceKernelLockLwMutex(&s_lock, 1, NULL);
+    if (handle) {
+        iotrace_handle * h = handle_slot(handle);
+        if (op == IOTRACE_OPEN) {
+            h->handle = handle;
+            h->path_id = rec.path_id;
+        } else if (h->handle == handle) {
+            rec.path_id = h->path_id;
+            if (op == IOTRACE_CLOSE)
+                h->handle = 0;
+        }
+    }
+    append(&rec, path);
+    sceKernelUnlockLwMutex(&s_lock, 1);
+}
+
+void iotrace_open(uint64_t start, const char * path, uintptr_t handle) {
+    if (s_ready)
+        record(start, IOTRACE_OPEN, path, handle, 0, 0, handle ? 0 : -1);
+}
+
+void iotrace_stat(uint64_t start, const char * path, int32_t result) {
+    if (s_ready)
+        record(start, IOTRACE_STAT, path, 0, -1, 0, result);
+}
+
+void iotrace_op_done(uint64_t start, iotrace_op op, uintptr_t handle,
+                     int64_t offset, uint32_t size, int32_t result) {
+    if (s_ready)
+        record(start, op, NULL, handle, offset, size, result);
+}
@@ -0,0 +1,49 @@
+/*
+ * reimpl/iotrace.h
+ *
+ * Recorder for the file I/O done through our shims. Built in with
+ * IOTRACE=1, writes DATA_PATH"iotrace.bin", to be inspected with
+ * scripts/iotrace.py.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_IOTRACE_H
+#define SOLOADER_IOTRACE_H
+
+#include <stdint.h>
+
+#ifndef IOTRACE
+#define IOTRACE 0
+#endif
+
+typedef enum iotrace_op {
+    IOTRACE_OPEN = 1,   // handle is the result, 0 on failure
+    IOTRACE_READ,
+    IOTRACE_WRITE,
+    IOTRACE_SEEK,       // offset and size are what was asked for (size is
+                        // whence), result is the new position
+    IOTRACE_CLOSE,
+    IOTRACE_STAT,
+} iotrace_op;
+
+// Starts the writer thread. Does nothing unless built with IOTRACE.
+void iotrace_init(void);
+
+// Timestamp to pass to the iotrace_* call made once the operation is done
+uint64_t iotrace_start(void);
+
+void iotrace_open(uint64_t start, const char * path, uintptr_t handle);
+void iotrace_stat(uint64_t start, const char * path, int32_t result);
+
+/*
+ * Any other operation on `handle`. `offset` is the position it started at,
+ * or -1 if unknown.
+ */
+void iotrace_op_done(uint64_t start, iotrace_op op, uintptr_t handle,
+                     int64_t offset, uint32_t size, int32_t result);
+
+#endif // SOLOADER_IOTRACE_H
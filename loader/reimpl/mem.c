@@ -13,23 +13,64 @@
 
 #include "reimpl/mem.h"
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "utils/filemap.h"
+#include "utils/logger.h"
+
+#define MEM_PRESSURE_MAX 4
+
+static mem_pressure_fn s_pressure[MEM_PRESSURE_MAX];
+static int s_pressure_count;
+
+void mem_pressure_add(mem_pressure_fn fn) {
+    if (s_pressure_count < MEM_PRESSURE_MAX)
+        s_pressure[s_pressure_count++] = fn;
+}
+
+// Asks the callbacks for `size` bytes; false if nobody had anything to give
+static bool relieve(size_t size) {
+    size_t freed = 0;
+    for (int i = 0; i < s_pressure_count && freed < size; i++)
+        freed += s_pressure[i](size - freed);
+
+    if (freed)
+        logv_info("[mem] out of memory for %u bytes, freed %u",
+                  (unsigned)size, (unsigned)freed);
+    return freed != 0;
+}
+
+void *malloc_soloader(size_t size) {
+    void *ret = malloc(size);
+    while (!ret && size && relieve(size))
+        ret = malloc(size);
+    return ret;
+}
+
+void *realloc_soloader(void *ptr, size_t size) {
+    void *ret = realloc(ptr, size);
+    while (!ret && size && relieve(size))
+        ret = realloc(ptr, size);
+    return ret;
+}
+
 void *sceClibMemclr(void *dst, SceSize len) {
     return sceClibMemset(dst, 0, len);
 }
 
 void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offs) {
-    if (length <= 0) {
-        return MAP_FAILED;
-    }
-    void* ret= malloc(length);
-    memset(ret, 0, length);
-    return ret;
+    if ((flags & FILEMAP_MAP_SHARED) && (prot & FILEMAP_PROT_WRITE)
+        && !(flags & FILEMAP_MAP_ANONYMOUS))
+        logv_warn("[mem] mmap(fd#%i): writes won't reach the file", fd);
+
+    void *ret = filemap_map(length, prot, flags, fd, offs);
+    logv_debug("[mem] mmap(%u, %x, %x, fd#%i, %i): 0x%x", (unsigned)length,
+               prot, flags, fd, (int)offs, ret);
+    return ret ? ret : MAP_FAILED;
 }
 
 int munmap(void *addr, size_t length) {
-    if (addr) free(addr);
-    return 0;
+    return filemap_unmap(addr, length);
 }
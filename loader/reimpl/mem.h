@@ -20,8 +20,19 @@
 
 #define MAP_FAILED (void*)-1
 
+// Frees at least `bytes` of memory if it can; returns how much it freed
+typedef size_t (*mem_pressure_fn)(size_t bytes);
+
+// Called, in the order added, when the game is about to run out of memory
+void mem_pressure_add(mem_pressure_fn fn);
+
+void *malloc_soloader(size_t size);
+
+void *realloc_soloader(void *ptr, size_t size);
+
 void *sceClibMemclr(void *dst, SceSize len);
 
+// Maps files for real, as copies on the heap; see utils/filemap.h
 void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offs);
 
 int munmap(void *addr, size_t length);
@@ -0,0 +1,329 @@
+/*
+ * reimpl/strmem.c
+ *
+ * NEON implementations of the hot memory and string functions.
+ *
+ * The game calls these on every vertex upload, string table lookup and asset
+ * parse, so they are worth a dedicated path instead of newlib's generic ones.
+ * Sizes below STRMEM_SMALL go through plain byte loops; everything else does
+ * one unaligned 16-byte head/tail pair and aligned 16/64-byte bodies.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "reimpl/strmem.h"
+
+#include <stdint.h>
+#include <arm_neon.h>
+
+#define STRMEM_SMALL     16
+#define STRMEM_PREFETCH  256
+#define STRMEM_PAGE_SIZE 4096
+
+// vld1q_u8(strmem_lead_mask + 16 - n) has its first n bytes cleared
+static const uint8_t strmem_lead_mask[32] = {
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+static inline int vec_any(uint8x16_t v) {
+    uint64x2_t v64 = vreinterpretq_u64_u8(v);
+    return (vgetq_lane_u64(v64, 0) | vgetq_lane_u64(v64, 1)) != 0;
+}
+
+// Index of the first non-zero byte of a comparison mask. Mask must be non-zero.
+static inline unsigned vec_first(uint8x16_t v) {
+    uint64x2_t v64 = vreinterpretq_u64_u8(v);
+    uint64_t lo = vgetq_lane_u64(v64, 0);
+    if (lo)
+        return __builtin_ctzll(lo) >> 3;
+    return 8 + (__builtin_ctzll(vgetq_lane_u64(v64, 1)) >> 3);
+}
+
+// Whether a 16-byte load at p stays within one page
+static inline int vec_page_safe(const void *p) {
+    return ((uintptr_t)p & (STRMEM_PAGE_SIZE - 1)) <= STRMEM_PAGE_SIZE - 16;
+}
+
+static inline void copy_small_fwd(uint8_t *d, const uint8_t *s, size_t n) {
+    while (n--)
+        *d++ = *s++;
+}
+
+static inline void copy_small_bwd(uint8_t *d, const uint8_t *s, size_t n) {
+    while (n--)
+        d[n] = s[n];
+}
+
+/*
+ * Forward copy for n >= 16. Head and tail are loaded before anything is
+ * stored and written last, so this is also safe for overlapping regions
+ * with dst < src.
+ */
+static inline void copy_fwd(uint8_t *d, const uint8_t *s, size_t n) {
+    uint8x16_t head = vld1q_u8(s);
+    uint8x16_t tail = vld1q_u8(s + n - 16);
+
+    size_t skip = 16 - ((uintptr_t)d & 15);
+    uint8_t *dd = d + skip;
+    const uint8_t *ss = s + skip;
+    size_t left = n - skip;
+
+    while (left >= 64) {
+        __builtin_prefetch(ss + STRMEM_PREFETCH);
+        uint8x16_t v0 = vld1q_u8(ss);
+        uint8x16_t v1 = vld1q_u8(ss + 16);
+        uint8x16_t v2 = vld1q_u8(ss + 32);
+        uint8x16_t v3 = vld1q_u8(ss + 48);
+        vst1q_u8(dd, v0);
+        vst1q_u8(dd + 16, v1);
+        vst1q_u8(dd + 32, v2);
+        vst1q_u8(dd + 48, v3);
+        dd += 64;
+        ss += 64;
+        left -= 64;
+    }
+
+    while (left >= 16) {
+        vst1q_u8(dd, vld1q_u8(ss));
+        dd += 16;
+        ss += 16;
+        left -= 16;
+    }
+
+    vst1q_u8(d, head);
+    vst1q_u8(d + n - 16, tail);
+}
+
+// Backward counterpart of copy_fwd() for overlapping regions with dst > src.
+static inline void copy_bwd(uint8_t *d, const uint8_t *s, size_t n) {
+    uint8x16_t head = vld1q_u8(s);
+    uint8x16_t tail = vld1q_u8(s + n - 16);
+
+    size_t skip = (uintptr_t)(d + n) & 15;
+    if (skip == 0)
+        skip = 16;
+    size_t left = n - skip;
+
+    while (left >= 64) {
+        left -= 64;
+        __builtin_prefetch(s + left - STRMEM_PREFETCH);
+        uint8x16_t v0 = vld1q_u8(s + left);
+        uint8x16_t v1 = vld1q_u8(s + left + 16);
+        uint8x16_t v2 = vld1q_u8(s + left + 32);
+        uint8x16_t v3 = vld1q_u8(s + left + 48);
+        vst1q_u8(d + left, v0);
+        vst1q_u8(d + left + 16, v1);
+        vst1q_u8(d + left + 32, v2);
+        vst1q_u8(d + left + 48, v3);
+    }
+
+    while (left >= 16) {
+        left -= 16;
+        vst1q_u8(d + left, vld1q_u8(s + left));
+    }
+
+    vst1q_u8(d + n - 16, tail);
+    vst1q_u8(d, head);
+}
+
+void *memcpy_soloader(void *dst, const void *src, size_t n) {
+    if (n < STRMEM_SMALL)
+        copy_small_fwd(dst, src, n);
+    else
+        copy_fwd(dst, src, n);
+    return dst;
+}
+
+void *memmove_soloader(void *dst, const void *src, size_t n) {
+    // True when dst is below src or the regions don't overlap at all
+    int forward = ((uintptr_t)dst - (uintptr_t)src) >= n;
+
+    if (n < STRMEM_SMALL) {
+        if (forward)
+            copy_small_fwd(dst, src, n);
+        else
+            copy_small_bwd(dst, src, n);
+    } else {
+        if (forward)
+            copy_fwd(dst, src, n);
+        else
+            copy_bwd(dst, src, n);
+    }
+    return dst;
+}
+
+void *memset_soloader(void *dst, int c, size_t n) {
+    uint8_t *d = dst;
+
+    if (n < STRMEM_SMALL) {
+        while (n--)
+            *d++ = (uint8_t)c;
+        return dst;
+    }
+
+    uint8x16_t v = vdupq_n_u8((uint8_t)c);
+    vst1q_u8(d, v);
+    vst1q_u8(d + n - 16, v);
+
+    size_t skip = 16 - ((uintptr_t)d & 15);
+    uint8_t *dd = d + skip;
+    size_t left = n - skip;
+
+    while (left >= 64) {
+        vst1q_u8(dd, v);
+        vst1q_u8(dd + 16, v);
+        vst1q_u8(dd + 32, v);
+        vst1q_u8(dd + 48, v);
+        dd += 64;
+        left -= 64;
+    }
+
+    while (left >= 16) {
+        vst1q_u8(dd, v);
+        dd += 16;
+        left -= 16;
+    }
+
+    return dst;
+}
+
+int memcmp_soloader(const void *s1, const void *s2, size_t n) {
+    const uint8_t *a = s1;
+    const uint8_t *b = s2;
+
+    while (n >= 16) {
+        uint8x16_t ne = vmvnq_u8(vceqq_u8(vld1q_u8(a), vld1q_u8(b)));
+        if (vec_any(ne)) {
+            unsigned i = vec_first(ne);
+            return a[i] - b[i];
+        }
+        a += 16;
+        b += 16;
+        n -= 16;
+    }
+
+    while (n--) {
+        if (*a != *b)
+            return *a - *b;
+        a++;
+        b++;
+    }
+
+    return 0;
+}
+
+void *memchr_soloader(const void *s, int c, size_t n) {
+    const uint8_t *p = s;
+    const uint8_t ch = (uint8_t)c;
+
+    if (n < STRMEM_SMALL) {
+        while (n--) {
+            if (*p == ch)
+                return (void *)p;
+            p++;
+        }
+        return NULL;
+    }
+
+    uint8x16_t needle = vdupq_n_u8(ch);
+    const uint8_t *end = p + n;
+
+    while (end - p >= 16) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(p), needle);
+        if (vec_any(eq))
+            return (void *)(p + vec_first(eq));
+        p += 16;
+    }
+
+    if (p != end) {
+        // Re-check the last 16 bytes; the overlap with the previous block
+        // can't match, since that block was already searched.
+        p = end - 16;
+        uint8x16_t eq = vceqq_u8(vld1q_u8(p), needle);
+        if (vec_any(eq))
+            return (void *)(p + vec_first(eq));
+    }
+
+    return NULL;
+}
+
+size_t strlen_soloader(const char *s) {
+    // Aligned 16-byte loads never cross a page, so reading past the
+    // terminator is harmless.
+    const uint8_t *p = (const uint8_t *)((uintptr_t)s & ~(uintptr_t)15);
+    unsigned lead = (uintptr_t)s & 15;
+    uint8x16_t zero = vdupq_n_u8(0);
+
+    uint8x16_t z = vceqq_u8(vld1q_u8(p), zero);
+    z = vandq_u8(z, vld1q_u8(strmem_lead_mask + 16 - lead));
+
+    while (!vec_any(z)) {
+        p += 16;
+        z = vceqq_u8(vld1q_u8(p), zero);
+    }
+
+    return (size_t)(p + vec_first(z) - (const uint8_t *)s);
+}
+
+int strcmp_soloader(const char *s1, const char *s2) {
+    const uint8_t *a = (const uint8_t *)s1;
+    const uint8_t *b = (const uint8_t *)s2;
+    uint8x16_t zero = vdupq_n_u8(0);
+
+    while (1) {
+        if (vec_page_safe(a) && vec_page_safe(b)) {
+            uint8x16_t va = vld1q_u8(a);
+            uint8x16_t vb = vld1q_u8(b);
+            uint8x16_t stop = vorrq_u8(vmvnq_u8(vceqq_u8(va, vb)),
+                                       vceqq_u8(va, zero));
+            if (vec_any(stop)) {
+                unsigned i = vec_first(stop);
+                return a[i] - b[i];
+            }
+            a += 16;
+            b += 16;
+        } else {
+            // Step bytewise until both pointers are clear of the page end
+            if (*a != *b || !*a)
+                return *a - *b;
+            a++;
+            b++;
+        }
+    }
+}
+
+int strncmp_soloader(const char *s1, const char *s2, size_t n) {
+    const uint8_t *a = (const uint8_t *)s1;
+    const uint8_t *b = (const uint8_t *)s2;
+    uint8x16_t zero = vdupq_n_u8(0);
+
+    while (n) {
+        if (n >= 16 && vec_page_safe(a) && vec_page_safe(b)) {
+            uint8x16_t va = vld1q_u8(a);
+            uint8x16_t vb = vld1q_u8(b);
+            uint8x16_t stop = vorrq_u8(vmvnq_u8(vceqq_u8(va, vb)),
+                                       vceqq_u8(va, zero));
+            if (vec_any(stop)) {
+                unsigned i = vec_first(stop);
+                return a[i] - b[i];
+            }
+            a += 16;
+            b += 16;
+            n -= 16;
+        } else {
+            if (*a != *b || !*a)
+                return *a - *b;
+            a++;
+            b++;
+            n--;
+        }
+    }
+
+    return 0;
+}
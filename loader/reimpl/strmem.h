@@ -0,0 +1,27 @@
+/*
+ * reimpl/strmem.h
+ *
+ * NEON implementations of the hot memory and string functions.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_STRMEM_H
+#define SOLOADER_STRMEM_H
+
+#include <stddef.h>
+
+void *memcpy_soloader(void *dst, const void *src, size_t n);
+void *memmove_soloader(void *dst, const void *src, size_t n);
+void *memset_soloader(void *dst, int c, size_t n);
+int memcmp_soloader(const void *s1, const void *s2, size_t n);
+void *memchr_soloader(const void *s, int c, size_t n);
+
+size_t strlen_soloader(const char *s);
+int strcmp_soloader(const char *s1, const char *s2);
+int strncmp_soloader(const char *s1, const char *s2, size_t n);
+
+#endif // SOLOADER_STRMEM_H
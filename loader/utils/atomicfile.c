@@ -0,0 +1,115 @@
+/*
+ * utils/atomicfile.c
+ *
+ * Replacing whole files so that a crash leaves either the old or the new
+ * contents, never a mix.
+ *
+ * The card can't rename over an existing file, so there is a moment with
+ * no file at the path at all. Writes go through three staging files next
+ * to DATA_PATH instead:
+ *
+ *   1. ATOMICFILE_TARGET gets the path being written,
+ *   2. ATOMICFILE_TEMP gets the data,
+ *   3. the temp file is renamed to ATOMICFILE_READY; from here on the
+ *      write happens whatever comes,
+ *   4. the old file is removed and the ready one renamed into its place,
+ *   5. the target file is removed.
+ *
+ * A ready file is only ever removed by moving it into place. One left over
+ * by a crash or a failed step 4 is moved to the path in the target file
+ * before the next write, or on recovery, and anything else staged is
+ * thrown away.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "utils/atomicfile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ATOMICFILE_TARGET   DATA_PATH".commit.path"
+#define ATOMICFILE_TEMP     DATA_PATH".commit.tmp"
+#define ATOMICFILE_READY    DATA_PATH".commit.new"
+#define ATOMICFILE_LOST     DATA_PATH".commit.lost"
+#define ATOMICFILE_PATH_MAX 1024
+
+static bool write_file(const char * path, const void * data, size_t len) {
+    FILE * f = fopen(path, "wb");
+    if (!f)
+        return false;
+
+    bool ok = len == 0 || fwrite(data, 1, len, f) == len;
+    ok = fclose(f) == 0 && ok;
+    return ok;
+}
+
+static bool exists(const char * path) {
+    FILE * f = fopen(path, "rb");
+    if (f)
+        fclose(f);
+    return f != NULL;
+}
+
+// Steps 4 and 5
+static bool finish(const char * path) {
+    remove(path);
+    if (rename(ATOMICFILE_READY, path) != 0)
+        return false;
+
+    remove(ATOMICFILE_TARGET);
+    return true;
+}
+
+// Commits a ready file left over; false if it's still there
+static bool settle(void) {
+    if (!exists(ATOMICFILE_READY))
+        return true;
+
+    char path[ATOMICFILE_PATH_MAX];
+    size_t len = 0;
+    FILE * target = fopen(ATOMICFILE_TARGET, "rb");
+    if (target) {
+        len = fread(path, 1, sizeof(path) - 1, target);
+        fclose(target);
+    }
+    path[len] = '\0';
+
+    // The target is complete before the data is ready, so this takes a
+    // damaged card; the data is kept aside rather than put anywhere
+    if (len == 0 || strlen(path) != len) {
+        remove(ATOMICFILE_LOST);
+        return rename(ATOMICFILE_READY, ATOMICFILE_LOST) == 0;
+    }
+
+    return finish(path);
+}
+
+bool atomicfile_write(const char * path, const void * data, size_t len) {
+    // The target file still names where a ready file goes
+    if (!settle())
+        return false;
+
+    if (!write_file(ATOMICFILE_TARGET, path, strlen(path))
+        || !write_file(ATOMICFILE_TEMP, data, len)
+        || rename(ATOMICFILE_TEMP, ATOMICFILE_READY) != 0) {
+        remove(ATOMICFILE_TEMP);
+        remove(ATOMICFILE_TARGET);
+        return false;
+    }
+
+    // The next write or recovery takes it from here if this fails
+    return finish(path);
+}
+
+void atomicfile_recover(void) {
+    if (!settle())
+        return;
+
+    remove(ATOMICFILE_TEMP);
+    remove(ATOMICFILE_TARGET);
+}
@@ -0,0 +1,28 @@
+/*
+ * utils/atomicfile.h
+ *
+ * Replacing whole files so that a crash leaves either the old or the new
+ * contents, never a mix.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_ATOMICFILE_H
+#define SOLOADER_ATOMICFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Replaces the file at `path` (a real path, on the same storage as
+ * DATA_PATH) with `len` bytes of `data`. One writer at a time.
+ */
+bool atomicfile_write(const char * path, const void * data, size_t len);
+
+// Finishes or rolls back a write cut short; before anything reads the files
+void atomicfile_recover(void);
+
+#endif // SOLOADER_ATOMICFILE_H
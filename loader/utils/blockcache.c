@@ -0,0 +1,679 @@
+/*
+ * utils/blockcache.c
+ *
+ * Cache of file blocks read from the storage, shared by everything that
+ * reads game data through the loader.
+ *
+ * Blocks are BLOCKCACHE_BLOCK_SIZE bytes of a file, each in its own heap
+ * buffer so the cache can give memory back when asked to. Replacement is
+ * ARC (Megiddo & Modha, "ARC: A Self-Tuning, Low Overhead Replacement
+ * Cache"): blocks used once lately (T1) and more than once (T2) are kept
+ * apart, and the ids of the blocks evicted from each (B1, B2) tell whether
+ * T1 should grow at the expense of T2 or the other way around. A level load
+ * streaming through hundreds of blocks once only churns T1, so what the
+ * game keeps coming back to stays.
+ *
+ * Misses are read from the storage without the lock held; a block being
+ * read can't be evicted, and readers of it wait for it. Prefetched blocks
+ * go into T1 and stay there on their first use, since the prefetch itself
+ * wasn't one.
+ *
+ * Nothing here is specific to the Vita, so it can be run over recorded
+ * traces on a PC (see scripts/blockcache_bench.c).
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "utils/blockcache.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <psp2/kernel/threadmgr.h>
+
+#include "utils/logger.h"
+
+#define NIL (-1)
+
+enum {
+    LIST_T1,    // resident, used once lately
+    LIST_T2,    // resident, used more than once
+    LIST_B1,    // evicted from T1, id only
+    LIST_B2,    // evicted from T2, id only
+    LIST_COUNT,
+    LIST_NONE = LIST_COUNT
+};
+
+typedef struct bc_entry {
+    uint32_t file;      // 0 for a block of a forgotten file
+    uint32_t index;
+    int32_t prev;       // towards the MRU end of its list
+    int32_t next;       // towards the LRU end; links the free entries too
+    int32_t hnext;
+    uint32_t bucket;
+    uint8_t list;
+    bool loading;       // being read from the storage, without the lock
+    bool prefetched;    // read by blockcache_prefetch(), not used since
+    uint32_t len;       // bytes of the block that are in the file
+    uint8_t * data;     // resident entries only
+} bc_entry;
+
+typedef struct bc_list {
+    int32_t head;       // MRU
+    int32_t tail;       // LRU
+    uint32_t size;
+} bc_list;
+
+static SceKernelLwMutexWork s_lock;
+static SceKernelLwCondWork s_loaded;
+static bool s_ready;
+static blockcache_read_fn s_read;
+
+static uint32_t s_capacity;     // in blocks
+static uint32_t s_max_capacity;
+static uint32_t s_target;       // ARC's p: what T1 is aiming for
+static uint32_t s_resident;
+
+static bc_entry * s_entries;    // twice the first capacity, for the ghosts
+static uint32_t s_entry_count;
+static int32_t s_free_entry = NIL;
+static int32_t * s_buckets;
+static uint32_t s_bucket_mask;
+static bc_list s_lists[LIST_COUNT];
+
+static blockcache_stats s_stats;
+
+// Interned paths; a file id is the index + 1
+static char ** s_paths;
+static uint32_t * s_path_hashes;
+static uint32_t s_path_count;
+static uint32_t * s_path_slots; // file id, 0 for an empty slot
+static uint32_t s_path_mask;
+
+static uint32_t path_hash(const char * path) {
+    uint32_t h = 0x811C9DC5u;
+    while (*path) {
+        h ^= (uint8_t)*path++;
+        h *= 0x01000193u;
+    }
+    return h;
+}
+
+static inline uint32_t block_hash(uint32_t file, uint32_t index) {
+    uint32_t h = (file * 0x9E3779B1u) ^ (index * 0x85EBCA77u);
+    return h ^ (h >> 15);
+}
+
+static void list_unlink(bc_entry * e) {
+    if (e->list == LIST_NONE)
+        return;
+
+    bc_list * l = &s_lists[e->list];
+    if (e->prev != NIL)
+        s_entries[e->prev].next = e->next;
+    else
+        l->head = e->next;
+    if (e->next != NIL)
+        s_entries[e->next].prev = e->prev;
+    else
+        l->tail = e->prev;
+
+    l->size--;
+    e->list = LIST_NONE;
+}
+
+static void list_push(int list, bc_entry * e) {
+    bc_list * l = &s_lists[list];
+    int32_t i = (int32_t)(e - s_entries);
+
+    e->prev = NIL;
+    e->next = l->head;
+    if (l->head != NIL)
+        s_entries[l->head].prev = i;
+    else
+        l->tail = i;
+    l->head = i;
+
+    l->size++;
+    e->list = (uint8_t)list;
+}
+
+static void hash_remove(bc_entry * e) {
+    int32_t i = (int32_t)(e - s_entries);
+    int32_t * link = &s_buckets[e->bucket];
+    while (*link != i)
+        link = &s_entries[*link].hnext;
+    *link = e->hnext;
+}
+
+static bc_entry * lookup(uint32_t file, uint32_t index) {
+    int32_t i = s_buckets[block_hash(file, index) & s_bucket_mask];
+    while (i != NIL) {
+        bc_entry * e = &s_entries[i];
+        if (e->file == file && e->index == index)
+            return e;
+        i = e->hnext;
+    }
+    return NULL;
+}
+
+// Takes an entry out of the lists and the table, its buffer is the caller's
+static void entry_drop(bc_entry * e) {
+    list_unlink(e);
+    hash_remove(e);
+    e->next = s_free_entry;
+    s_free_entry = (int32_t)(e - s_entries);
+}
+
+static void drop_lru(int list) {
+    if (s_lists[list].tail != NIL)
+        entry_drop(&s_entries[s_lists[list].tail]);
+}
+
+static bc_entry * entry_new(uint32_t file, uint32_t index) {
+    // Only possible with blocks of forgotten files still loading
+    if (s_free_entry == NIL)
+        drop_lru(s_lists[LIST_B2].size ? LIST_B2 : LIST_B1);
+    if (s_free_entry == NIL)
+        return NULL;
+
+    bc_entry * e = &s_entries[s_free_entry];
+    s_free_entry = e->next;
+
+    e->file = file;
+    e->index = index;
+    e->bucket = block_hash(file, index) & s_bucket_mask;
+    e->hnext = s_buckets[e->bucket];
+    s_buckets[e->bucket] = (int32_t)(e - s_entries);
+    e->list = LIST_NONE;
+    e->loading = false;
+    e->prefetched = false;
+    e->len = 0;
+    e->data = NULL;
+    return e;
+}
+
+// Least recently used block of a resident list that isn't being read
+static bc_entry * victim(int list) {
+    int32_t i = s_lists[list].tail;
+    while (i != NIL && s_entries[i].loading)
+        i = s_entries[i].prev;
+    return i != NIL ? &s_entries[i] : NULL;
+}
+
+/*
+ * ARC's REPLACE: evicts the LRU block of T1 or T2, leaving its id in B1 or
+ * B2, and returns its buffer. NULL if every resident block is loading.
+ */
+static uint8_t * evict(bool in_b2) {
+    uint32_t t1 = s_lists[LIST_T1].size;
+    bool from_t1 = t1 && ((in_b2 && t1 == s_target) || t1 > s_target);
+
+    bc_entry * e = victim(from_t1 ? LIST_T1 : LIST_T2);
+    if (!e) {
+        from_t1 = !from_t1;
+        e = victim(from_t1 ? LIST_T1 : LIST_T2);
+        if (!e)
+            return NULL;
+    }
+
+    uint8_t * data = e->data;
+    e->data = NULL;
+    list_unlink(e);
+    if (e->file)
+        list_push(from_t1 ? LIST_B1 : LIST_B2, e);
+    else
+        entry_drop(e);
+
+    s_resident--;
+    s_stats.evictions++;
+    return data;
+}
+
+static size_t shrink(uint32_t capacity) {
+    size_t freed = 0;
+
+    s_capacity = capacity;
+    if (s_target > capacity)
+        s_target = capacity;
+
+    while (s_resident > capacity) {
+        uint8_t * data = evict(false);
+        if (!data)
+            break;
+        free(data);
+        freed += BLOCKCACHE_BLOCK_SIZE;
+    }
+
+    while (s_lists[LIST_T1].size + s_lists[LIST_B1].size > capacity
+           && s_lists[LIST_B1].size)
+        drop_lru(LIST_B1);
+    while (s_lists[LIST_B1].size + s_lists[LIST_B2].size + s_resident
+           > 2 * capacity) {
+        if (!s_lists[LIST_B1].size && !s_lists[LIST_B2].size)
+            break;
+        drop_lru(s_lists[LIST_B2].size ? LIST_B2 : LIST_B1);
+    }
+    return freed;
+}
+
+/*
+ * Makes room for a block that isn't resident, following ARC, and returns it
+ * loading with a buffer to read into. `ghost` is its entry in B1 or B2, if
+ * any. NULL if there's no buffer to be had.
+ */
+static bc_entry * admit(uint32_t file, uint32_t index, bc_entry * ghost,
+                        bool prefetch) {
+    uint32_t c = s_capacity;
+    bc_list * t1 = &s_lists[LIST_T1];
+    bc_list * b1 = &s_lists[LIST_B1];
+    bc_list * b2 = &s_lists[LIST_B2];
+    uint8_t * data = NULL;
+    bool frequent = false;
+
+    // Left over from a shrink while blocks were loading
+    while (s_resident > c) {
+        uint8_t * extra = evict(false);
+        if (!extra)
+            break;
+        free(extra);
+    }
+
+    if (ghost) {
+        bool in_b2 = ghost->list == LIST_B2;
+
+        // A prefetch says nothing about which list is worth more
+        if (!prefetch) {
+            uint32_t delta;
+            if (in_b2) {
+                delta = b2->size >= b1->size ? 1 : b1->size / b2->size;
+                s_target = s_target > delta ? s_target - delta : 0;
+            } else {
+                delta = b1->size >= b2->size ? 1 : b2->size / b1->size;
+                s_target = s_target + delta < c ? s_target + delta : c;
+            }
+            s_stats.ghost_hits++;
+            frequent = true;
+        }
+
+        entry_drop(ghost);
+        if (s_resident >= c)
+            data = evict(in_b2);
+    } else {
+        uint32_t total = t1->size + s_lists[LIST_T2].size + b1->size + b2->size;
+
+        if (t1->size + b1->size >= c) {
+            if (t1->size < c) {
+                drop_lru(LIST_B1);
+                if (s_resident >= c)
+                    data = evict(false);
+            } else {
+                // T1 alone fills the cache; its LRU block leaves no trace
+                bc_entry * e = victim(LIST_T1);
+                if (e) {
+                    data = e->data;
+                    e->data = NULL;
+                    entry_drop(e);
+                    s_resident--;
+                    s_stats.evictions++;
+                }
+            }
+        } else if (total >= c) {
+            if (total >= 2 * c)
+                drop_lru(LIST_B2);
+            if (s_resident >= c)
+                data = evict(false);
+        }
+    }
+
+    if (!data && s_resident < c) {
+        data = malloc(BLOCKCACHE_BLOCK_SIZE);
+        // The heap is full; settle for what's there
+        if (!data)
+            s_capacity = s_max_capacity = s_resident;
+    }
+    if (!data && s_resident)
+        data = evict(false);
+    if (!data)
+        return NULL;
+
+    bc_entry * e = entry_new(file, index);
+    if (!e) {
+        free(data);
+        return NULL;
+    }
+
+    e->data = data;
+    e->loading = true;
+    e->prefetched = prefetch;
+    list_push(frequent ? LIST_T2 : LIST_T1, e);
+    s_resident++;
+    return e;
+}
+
+/*
+ * With the lock held: the resident block, read from the storage if needed,
+ * or NULL. `*got` is left alone if the block just couldn't be cached, and
+ * set to what the storage returned if it had nothing for it. `*hit` tells
+ * whether the block was there already.
+ */
+static bc_entry * get_block(uint32_t file, int fd, uint32_t index,
+                            bool prefetch, int * got, bool * hit) {
+    for (;;) {
+        if (!s_capacity)
+            return NULL;
+
+        bc_entry * e = lookup(file, index);
+        if (e && (e->list == LIST_T1 || e->list == LIST_T2)) {
+            if (e->loading) {
+                sceKernelWaitLwCond(&s_loaded, NULL);
+                continue;
+            }
+            *hit = true;
+            if (prefetch)
+                return e;
+
+            s_stats.hits++;
+            list_unlink(e);
+            if (e->prefetched) {
+                e->prefetched = false;
+                s_stats.prefetch_hits++;
+                list_push(LIST_T1, e);
+            } else {
+                list_push(LIST_T2, e);
+            }
+            return e;
+        }
+
+        e = admit(file, index, e, prefetch);
+        if (!e)
+            return NULL;
+
+        sceKernelUnlockLwMutex(&s_lock, 1);
+        int n = s_read(fd, e->data, BLOCKCACHE_BLOCK_SIZE,
+                       (int64_t)index * BLOCKCACHE_BLOCK_SIZE);
+        sceKernelLockLwMutex(&s_lock, 1, NULL);
+
+        e->loading = false;
+        sceKernelSignalLwCondAll(&s_loaded);
+
+        if (n <= 0) {
+            free(e->data);
+            e->data = NULL;
+            entry_drop(e);
+            s_resident--;
+            *got = n;
+            return NULL;
+        }
+
+        e->len = (uint32_t)n;
+        s_stats.bytes_read += n;
+        if (prefetch)
+            s_stats.prefetched++;
+        else
+            s_stats.misses++;
+        return e;
+    }
+}
+
+void blockcache_init(blockcache_read_fn read) {
+    s_read = read;
+    if (s_ready)
+        return;
+
+    if (sceKernelCreateLwMutex(&s_lock, "blockcache_lock", 0, 0, NULL) < 0) {
+        log_error("[blockcache] could not create the lock; disabled");
+        return;
+    }
+    if (sceKernelCreateLwCond(&s_loaded, "blockcache_loaded", 0, &s_lock,
+                              NULL) < 0) {
+        log_error("[blockcache] could not create the condition; disabled");
+        sceKernelDeleteLwMutex(&s_lock);
+        return;
+    }
+    s_ready = true;
+}
+
+void blockcache_set_capacity(size_t bytes) {
+    uint32_t blocks = (uint32_t)(bytes / BLOCKCACHE_BLOCK_SIZE);
+    if (!s_ready)
+        return;
+
+    sceKernelLockLwMutex(&s_lock, 1, NULL);
+    if (!s_entries && blocks) {
+        uint32_t count = 2 * blocks;
+        uint32_t buckets = 64;
+        while (buckets < count)
+            buckets *= 2;
+
+        s_entries = malloc(count * sizeof(*s_entries));
+        s_buckets = malloc(buckets * sizeof(*s_buckets));
+        if (!s_entries || !s_buckets) {
+            free(s_entries);
+            free(s_buckets);
+            s_entries = NULL;
+            s_buckets = NULL;
+            sceKernelUnlockLwMutex(&s_lock, 1);
+            return;
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            s_entries[i].list = LIST_NONE;
+            s_entries[i].next = i + 1 < count ? (int32_t)i + 1 : NIL;
+        }
+        s_free_entry = 0;
+        for (uint32_t i = 0; i < buckets; i++)
+            s_buckets[i] = NIL;
+        s_bucket_mask = buckets - 1;
+        s_entry_count = count;
+        for (int l = 0; l < LIST_COUNT; l++)
+            s_lists[l] = (bc_list){ NIL, NIL, 0 };
+        s_max_capacity = blocks;
+    }
+
+    if (blocks > s_max_capacity)
+        blocks = s_max_capacity;
+    if (blocks < s_capacity)
+        shrink(blocks);
+    s_capacity = blocks;
+    sceKernelUnlockLwMutex(&s_lock, 1);
+}
+
+size_t blockcache_release(size_t bytes) {
+    uint32_t blocks = (uint32_t)((bytes + BLOCKCACHE_BLOCK_SIZE - 1)
+                                 / BLOCKCACHE_BLOCK_SIZE);
+    if (!s_ready)
+        return 0;
+
+    sceKernelLockLwMutex(&s_lock, 1, NULL);
+    uint32_t capacity = s_capacity > blocks ? s_capacity - blocks : 0;
+    size_t freed = shrink(capacity);
+    s_max_capacity = capacity;
+    sceKernelUnlockLwMutex(&s_lock, 1);
+    return freed;
+}
+
+static uint32_t path_find(const char * path, uint32_t hash) {
+    if (!s_path_slots)
+        return 0;
+
+    for (uint32_t i = hash & s_path_mask; s_path_slots[i];
+         i = (i + 1) & s_path_mask) {
+        uint32_t id = s_path_slots[i];
+        if (s_path_hashes[id - 1] == hash && strcmp(s_paths[id - 1], path) == 0)
+            return id;
+    }
+    return 0;
+}
+
+static bool path_grow(void) {
+    uint32_t capacity = s_path_mask ? (s_path_mask + 1) / 2 : 0;
+    if (s_path_count < capacity)
+        return true;
+
+    uint32_t new_capacity = capacity ? capacity * 2 : 256;
+    uint32_t slots = new_capacity * 2;
+
+    char ** paths = realloc(s_paths, new_capacity * sizeof(*paths));
+    if (!paths)
+        return false;
+    s_paths = paths;
+
+    uint32_t * hashes = realloc(s_path_hashes, new_capacity * sizeof(*hashes));
+    if (!hashes)
+        return false;
+    s_path_hashes = hashes;
+
+    uint32_t * table = calloc(slots, sizeof(*table));
+    if (!table)
+        return false;
+
+    for (uint32_t id = 1; id <= s_path_count; id++) {
+        uint32_t i = s_path_hashes[id - 1] & (slots - 1);
+        while (table[i])
+            i = (i + 1) & (slots - 1);
+        table[i] = id;
+    }
+    free(s_path_slots);
+    s_path_slots = table;
+    s_path_mask = slots - 1;
+    return true;
+}
+
+uint32_t blockcache_file(const char * path) {
+    if (!s_ready)
+        return 0;
+
+    uint32_t hash = path_hash(path);
+
+    sceKernelLockLwMutex(&s_lock, 1, NULL);
+    uint32_t id = path_find(path, hash);
+    if (!id && path_grow()) {
+        char * copy = strdup(path);
+        if (copy) {
+            s_paths[s_path_count] = copy;
+            s_path_hashes[s_path_count] = hash;
+            id = ++s_path_count;
+
+            uint32_t i = hash & s_path_mask;
+            while (s_path_slots[i])
+                i = (i + 1) & s_path_mask;
+            s_path_slots[i] = id;
+        }
+    }
+    sceKernelUnlockLwMutex(&s_lock, 1);
+    return id;
+}
+
+void blockcache_forget(const char * path) {
+    if (!s_ready)
+        return;
+
+    uint32_t hash = path_hash(path);
+
+    sceKernelLockLwMutex(&s_lock, 1, NULL);
+    uint32_t id = path_find(path, hash);
+    for (uint32_t i = 0; id && i < s_entry_count; i++) {
+        bc_entry * e = &s_entries[i];
+        if (e->list == LIST_NONE || e->file != id)
+            continue;
+
+        // Whoever is reading it still gets it, nobody else will
+        if (e->loading) {
+            e->file = 0;
+            continue;
+        }
+
+        if (e->data) {
+            free(e->data);
+            e->data = NULL;
+            s_resident--;
+        }
+        entry_drop(e);
+    }
+    sceKernelUnlockLwMutex(&s_lock, 1);
+}
+
+int blockcache_pread(uint32_t file, int fd, void * dst, uint32_t len,
+                     int64_t offset) {
+    uint8_t * out = dst;
+    uint32_t done = 0;
+
+    // No cache without a lock: blockcache_file() gave out no ids then
+    if (!file)
+        return s_read(fd, dst, len, offset);
+
+    while (done < len) {
+        int64_t pos = offset + done;
+        uint32_t index = (uint32_t)(pos / BLOCKCACHE_BLOCK_SIZE);
+        uint32_t in = (uint32_t)(pos % BLOCKCACHE_BLOCK_SIZE);
+        int got = 1;
+        bool hit = false;
+
+        sceKernelLockLwMutex(&s_lock, 1, NULL);
+        bc_entry * e = get_block(file, fd, index, false, &got, &hit);
+        if (!e) {
+            sceKernelUnlockLwMutex(&s_lock, 1);
+            if (got <= 0)
+                return done ? (int)done : got;
+
+            // Not cacheable right now, the rest comes straight from the storage
+            got = s_read(fd, out + done, len - done, pos);
+            if (got < 0)
+                return done ? (int)done : got;
+            return (int)(done + got);
+        }
+
+        uint32_t n = in < e->len ? e->len - in : 0;
+        if (n > len - done)
+            n = len - done;
+        memcpy(out + done, e->data + in, n);
+        if (hit)
+            s_stats.bytes_saved += n;
+        // The entry may be evicted and reused as soon as the lock is gone
+        bool end = e->len < BLOCKCACHE_BLOCK_SIZE && in + n >= e->len;
+        sceKernelUnlockLwMutex(&s_lock, 1);
+
+        done += n;
+        if (end)
+            break;
+    }
+    return (int)done;
+}
+
+void blockcache_prefetch(uint32_t file, int fd, int64_t offset,
+                         uint32_t len) {
+    if (!file || !len || offset < 0)
+        return;
+
+    uint32_t first = (uint32_t)(offset / BLOCKCACHE_BLOCK_SIZE);
+    uint32_t last = (uint32_t)((offset + len - 1) / BLOCKCACHE_BLOCK_SIZE);
+
+    sceKernelLockLwMutex(&s_lock, 1, NULL);
+    for (uint32_t index = first; index <= last; index++) {
+        int got = 1;
+        bool hit = false;
+        if (!get_block(file, fd, index, true, &got, &hit))
+            break;
+    }
+    sceKernelUnlockLwMutex(&s_lock, 1);
+}
+
+void blockcache_get_stats(blockcache_stats * stats) {
+    if (!s_ready) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    sceKernelLockLwMutex(&s_lock, 1, NULL);
+    *stats = s_stats;
+    stats->capacity = s_capacity;
+    stats->resident = s_resident;
+    stats->recent = s_lists[LIST_T1].size;
+    stats->target = s_target;
+    sceKernelUnlockLwMutex(&s_lock, 1);
+}
@@ -0,0 +1,76 @@
+/*
+ * utils/blockcache.h
+ *
+ * Cache of file blocks read from the storage, shared by everything that
+ * reads game data through the loader.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_BLOCKCACHE_H
+#define SOLOADER_BLOCKCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BLOCKCACHE_BLOCK_SIZE (128 * 1024)
+
+// Reads from the storage, pread()-like: bytes read, 0 at the end, < 0 on error
+typedef int (*blockcache_read_fn)(int fd, void * dst, uint32_t len,
+                                  int64_t offset);
+
+typedef struct blockcache_stats {
+    uint64_t hits;          // blocks found in memory
+    uint64_t misses;        // blocks read from the storage
+    uint64_t ghost_hits;    // misses on blocks evicted not long ago
+    uint64_t bytes_saved;   // bytes served from memory
+    uint64_t bytes_read;    // bytes read from the storage into the cache
+    uint64_t evictions;
+    uint64_t prefetched;    // blocks read by blockcache_prefetch()
+    uint64_t prefetch_hits; // of those, later asked for by a read
+    uint32_t capacity;      // in blocks
+    uint32_t resident;
+    uint32_t recent;        // resident blocks only used once lately
+    uint32_t target;        // how many of those the policy is aiming for
+} blockcache_stats;
+
+// Works without a capacity; reads just go straight to the storage then
+void blockcache_init(blockcache_read_fn read);
+
+/*
+ * Sets the capacity in bytes, evicting and freeing blocks when shrinking.
+ * The first nonzero capacity is also the most the cache can grow back to.
+ */
+void blockcache_set_capacity(size_t bytes);
+
+/*
+ * Memory-pressure callback: shrinks the cache for good by at least `bytes`
+ * (rounded up to blocks) and returns how much memory was freed.
+ */
+size_t blockcache_release(size_t bytes);
+
+// Id of `path` (a real path) for the calls below; 0 if out of memory
+uint32_t blockcache_file(const char * path);
+
+// The file at `path` changed; cached blocks of it are dropped
+void blockcache_forget(const char * path);
+
+/*
+ * pread() from `fd`, which is open on `file`, through the cache. With
+ * `file` 0 or no capacity it's a plain read.
+ */
+int blockcache_pread(uint32_t file, int fd, void * dst, uint32_t len,
+                     int64_t offset);
+
+/*
+ * Reads the blocks covering `len` bytes at `offset` into the cache without
+ * counting it as a use of them.
+ */
+void blockcache_prefetch(uint32_t file, int fd, int64_t offset, uint32_t len);
+
+void blockcache_get_stats(blockcache_stats * stats);
+
+#endif // SOLOADER_BLOCKCACHE_H
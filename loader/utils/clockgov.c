@@ -0,0 +1,175 @@
+/*
+ * utils/clockgov.c
+ *
+ * Clock governor: picks CPU and GPU clock levels from measured frame costs.
+ *
+ * The loader used to pin the ARM at 444 MHz and the GPU at 222 MHz for the
+ * whole session, menus and pause screens included. Here both are chosen per
+ * window of frames:
+ *
+ * - The CPU cost of a frame is scaled to what it would be at the top ARM
+ *   clock, and the lowest ARM level that keeps the window's peak under 70%
+ *   of the budget is picked. A single frame past 90% raises the ARM level
+ *   right away, ahead of the window.
+ * - The GPU cost can't be measured directly, so the GPU level is probed:
+ *   after a long calm run it goes one step down, and missed frames that the
+ *   CPU can't account for bring it back up. If that happens right after a
+ *   step down, the level below is kept off limits for a while, longer on
+ *   every repeated failure.
+ * - While a menu is on screen neither goes past the middle level, and the
+ *   GPU isn't probed. The levels picked for gameplay apply again as soon
+ *   as a window without the menu ends.
+ *
+ * The policy only talks to the hardware through the apply callback, so it
+ * can be driven by a recorded trace.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "utils/clockgov.h"
+
+#define CLOCKGOV_WINDOW         30  // frames
+#define CLOCKGOV_CPU_TARGET     70  // % of the budget, for the window peak
+#define CLOCKGOV_CPU_URGENT     90  // % of the budget, for a single frame
+#define CLOCKGOV_MISS           110 // % of the budget
+#define CLOCKGOV_MISS_RUN       3   // missed frames per window
+#define CLOCKGOV_CALM_RUN       10  // windows
+#define CLOCKGOV_PROBE          3   // windows
+#define CLOCKGOV_FLOOR_HOLD     60  // windows
+#define CLOCKGOV_FLOOR_HOLD_MAX 960 // windows
+#define CLOCKGOV_MENU_CEILING   1
+
+#define TOP (CLOCKGOV_LEVELS - 1)
+
+static const uint16_t arm_clocks[CLOCKGOV_LEVELS] = { 222, 333, 444 };
+static const uint16_t gpu_clocks[CLOCKGOV_LEVELS] = { 111, 166, 222 };
+static const uint16_t bus_clocks[CLOCKGOV_LEVELS] = { 166, 166, 222 };
+static const uint16_t xbar_clocks[CLOCKGOV_LEVELS] = { 111, 111, 166 };
+
+static inline uint8_t cpu_applied(const clockgov * g) {
+    return (g->in_menu && g->cpu_level > CLOCKGOV_MENU_CEILING)
+           ? CLOCKGOV_MENU_CEILING : g->cpu_level;
+}
+
+static inline uint8_t gpu_applied(const clockgov * g) {
+    return (g->in_menu && g->gpu_level > CLOCKGOV_MENU_CEILING)
+           ? CLOCKGOV_MENU_CEILING : g->gpu_level;
+}
+
+void clockgov_clocks_get(const clockgov * g, clockgov_clocks * out) {
+    uint8_t gpu = gpu_applied(g);
+    out->arm = arm_clocks[cpu_applied(g)];
+    out->bus = bus_clocks[gpu];
+    out->gpu = gpu_clocks[gpu];
+    out->xbar = xbar_clocks[gpu];
+}
+
+static void apply(const clockgov * g) {
+    clockgov_clocks clocks;
+    clockgov_clocks_get(g, &clocks);
+    g->apply(&clocks);
+}
+
+static void window_reset(clockgov * g) {
+    g->frames = 0;
+    g->menu_frames = 0;
+    g->misses = 0;
+    g->cpu_peak_us = 0;
+}
+
+void clockgov_init(clockgov * g, float target_fps, clockgov_apply_fn fn) {
+    g->apply = fn;
+    g->budget_us = (uint32_t)(1000000.f / target_fps);
+    g->cpu_level = TOP;
+    g->gpu_level = TOP;
+    g->gpu_floor = 0;
+    g->in_menu = false;
+    g->calm_windows = 0;
+    g->probe_windows = 0;
+    g->floor_windows = 0;
+    g->floor_backoff = CLOCKGOV_FLOOR_HOLD;
+    window_reset(g);
+    apply(g);
+}
+
+static uint8_t cpu_level_for(const clockgov * g, uint32_t peak_us) {
+    uint64_t limit = (uint64_t)g->budget_us * CLOCKGOV_CPU_TARGET / 100;
+    for (uint8_t l = 0; l < TOP; l++) {
+        if ((uint64_t)peak_us * arm_clocks[TOP] / arm_clocks[l] <= limit)
+            return l;
+    }
+    return TOP;
+}
+
+static void gpu_window(clockgov * g, bool cpu_bound) {
+    if (g->floor_windows && --g->floor_windows == 0)
+        g->gpu_floor = 0;
+
+    if (g->misses >= CLOCKGOV_MISS_RUN && !cpu_bound) {
+        if (g->probe_windows && g->gpu_level < TOP) {
+            // The step down was one too many
+            g->gpu_floor = g->gpu_level + 1;
+            g->floor_windows = g->floor_backoff;
+            if (g->floor_backoff < CLOCKGOV_FLOOR_HOLD_MAX)
+                g->floor_backoff *= 2;
+        }
+        if (g->gpu_level < TOP)
+            g->gpu_level++;
+        g->calm_windows = 0;
+        g->probe_windows = 0;
+        return;
+    }
+
+    if (g->probe_windows)
+        g->probe_windows--;
+
+    if (g->misses) {
+        g->calm_windows = 0;
+        return;
+    }
+
+    if (++g->calm_windows >= CLOCKGOV_CALM_RUN && g->gpu_level > g->gpu_floor) {
+        g->gpu_level--;
+        g->calm_windows = 0;
+        g->probe_windows = CLOCKGOV_PROBE;
+    }
+}
+
+void clockgov_frame(clockgov * g, uint32_t cpu_us, uint32_t frame_us,
+                    bool menu) {
+    uint8_t cpu = cpu_applied(g);
+    uint8_t gpu = gpu_applied(g);
+
+    uint32_t cost = (uint32_t)((uint64_t)cpu_us * arm_clocks[cpu]
+                               / arm_clocks[TOP]);
+    if (cost > g->cpu_peak_us)
+        g->cpu_peak_us = cost;
+    if ((uint64_t)frame_us * 100 > (uint64_t)g->budget_us * CLOCKGOV_MISS)
+        g->misses++;
+    if (menu)
+        g->menu_frames++;
+
+    if ((uint64_t)cpu_us * 100 > (uint64_t)g->budget_us * CLOCKGOV_CPU_URGENT
+        && cpu < TOP) {
+        // Raise what is applied, the menu cap included
+        g->cpu_level = cpu + 1;
+        g->in_menu = false;
+    } else if (++g->frames >= CLOCKGOV_WINDOW) {
+        // Would the peak have been urgent at the clock it ran at?
+        bool cpu_bound = (uint64_t)g->cpu_peak_us * arm_clocks[TOP]
+                         / arm_clocks[cpu] * 100
+                         > (uint64_t)g->budget_us * CLOCKGOV_CPU_URGENT;
+
+        g->cpu_level = cpu_level_for(g, g->cpu_peak_us);
+        g->in_menu = g->menu_frames * 2 > g->frames;
+        if (!g->in_menu)
+            gpu_window(g, cpu_bound);
+        window_reset(g);
+    }
+
+    if (cpu_applied(g) != cpu || gpu_applied(g) != gpu)
+        apply(g);
+}
@@ -0,0 +1,67 @@
+/*
+ * utils/clockgov.h
+ *
+ * Clock governor: picks CPU and GPU clock levels from measured frame costs.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_CLOCKGOV_H
+#define SOLOADER_CLOCKGOV_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CLOCKGOV_LEVELS 3
+
+typedef struct clockgov_clocks {
+    uint16_t arm;
+    uint16_t bus;
+    uint16_t gpu;
+    uint16_t xbar;
+} clockgov_clocks;
+
+// Sets the clocks; only called when they change
+typedef void (*clockgov_apply_fn)(const clockgov_clocks * clocks);
+
+typedef struct clockgov {
+    clockgov_apply_fn apply;
+    uint32_t budget_us;
+
+    uint8_t cpu_level; // 0 is the lowest
+    uint8_t gpu_level;
+    uint8_t gpu_floor; // raised for a while after lowering the GPU failed
+    bool in_menu;      // levels are capped while the last window was a menu
+
+    // Current window
+    uint32_t frames;
+    uint32_t menu_frames;
+    uint32_t misses;
+    uint32_t cpu_peak_us; // highest CPU cost, scaled to the top ARM clock
+
+    uint32_t calm_windows;  // in a row without a missed frame
+    uint32_t probe_windows; // left to judge the last GPU step down
+    uint32_t floor_windows; // left before gpu_floor goes back to 0
+    uint32_t floor_backoff; // windows the floor is held on the next failure
+} clockgov;
+
+/*
+ * Start at the top levels, as the loader always did, and apply them.
+ * `target_fps` sets the frame budget.
+ */
+void clockgov_init(clockgov * g, float target_fps, clockgov_apply_fn apply);
+
+/*
+ * Feed one frame: `cpu_us` is the time the game spent on it, `frame_us`
+ * the whole frame period, and `menu` whether a menu was on screen.
+ */
+void clockgov_frame(clockgov * g, uint32_t cpu_us, uint32_t frame_us,
+                    bool menu);
+
+// Clocks currently applied
+void clockgov_clocks_get(const clockgov * g, clockgov_clocks * out);
+
+#endif // SOLOADER_CLOCKGOV_H
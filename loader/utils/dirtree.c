@@ -0,0 +1,582 @@
+/*
+ * utils/dirtree.c
+ *
+ * In-memory snapshot of a directory tree, kept up to date by the I/O shims.
+ *
+ * The game's data folder is walked once on a background thread at boot.
+ * After that, whether a file under it exists, its size, and the contents
+ * of its directories are answered from memory. This includes the many
+ * optional files that aren't there. Nodes live in one array and are found
+ * by (parent, name) in a chained hash table, so lookups walk the path one
+ * component at a time without building strings or allocating.
+ *
+ * Files created, removed or renamed through our shims update the snapshot.
+ * Files opened for writing are marked stale so that their size is read
+ * from the device again. If the snapshot changes while it's being taken,
+ * it's taken again. If an update can't be applied, the snapshot is
+ * dropped and everything goes to the device as before.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "utils/dirtree.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <psp2/io/dirent.h>
+#include <psp2/io/stat.h>
+#include <psp2/kernel/threadmgr.h>
+
+#include "utils/logger.h"
+
+#define DIRTREE_NONE        0xFFFFFFFFu
+#define DIRTREE_PATH_MAX    1024
+#define DIRTREE_PASSES      3 // snapshots to try while the tree keeps changing
+#define DIRTREE_STACK_SIZE  (64 * 1024)
+
+typedef struct dirtree_node {
+    uint32_t parent;
+    uint32_t first_child;
+    uint32_t next_sibling;
+    uint32_t hash_next;
+    uint32_t name;      // offset in the names arena
+    uint16_t name_len;
+    uint8_t dir;
+    uint8_t stale;
+    uint32_t size;
+    uint32_t mtime;
+} dirtree_node;
+
+typedef struct dirtree {
+    dirtree_node * nodes;
+    uint32_t count;
+    uint32_t cap;
+    char * names;
+    uint32_t names_size;
+    uint32_t names_cap;
+    uint32_t * buckets; // first node of each chain
+    uint32_t bucket_count; // power of two
+} dirtree;
+
+struct dirtree_dir {
+    volatile int used;
+    uint32_t next; // child to return next
+};
+
+static SceKernelLwMutexWork s_lock;
+static bool s_lock_ready;
+
+static dirtree s_tree;
+static bool s_ready;
+static bool s_changed; // since the snapshot being taken started
+
+static char s_root[256];
+static size_t s_root_len;
+
+static dirtree_dir s_dirs[DIRTREE_MAX_DIRS];
+
+static uint32_t child_hash(uint32_t parent, const char * name, size_t len) {
+    uint32_t h = 0x811C9DC5u ^ parent;
+    h *= 0x01000193u;
+    while (len--) {
+        h ^= (uint8_t)*name++;
+        h *= 0x01000193u;
+    }
+    return h;
+}
+
+static uint32_t find_child(const dirtree * t, uint32_t parent,
+                           const char * name, size_t len) {
+    uint32_t h = child_hash(parent, name, len);
+    uint32_t i = t->buckets[h & (t->bucket_count - 1)];
+    for (; i != DIRTREE_NONE; i = t->nodes[i].hash_next) {
+        const dirtree_node * n = &t->nodes[i];
+        if (n->parent == parent && n->name_len == len
+            && memcmp(t->names + n->name, name, len) == 0)
+            return i;
+    }
+    return DIRTREE_NONE;
+}
+
+static void hash_link(dirtree * t, uint32_t i) {
+    dirtree_node * n = &t->nodes[i];
+    uint32_t b = child_hash(n->parent, t->names + n->name, n->name_len)
+                 & (t->bucket_count - 1);
+    n->hash_next = t->buckets[b];
+    t->buckets[b] = i;
+}
+
+static void hash_unlink(dirtree * t, uint32_t i) {
+    dirtree_node * n = &t->nodes[i];
+    uint32_t b = child_hash(n->parent, t->names + n->name, n->name_len)
+                 & (t->bucket_count - 1);
+    uint32_t * link = &t->buckets[b];
+    while (*link != DIRTREE_NONE && *link != i)
+        link = &t->nodes[*link].hash_next;
+    if (*link == i)
+        *link = n->hash_next;
+}
+
+static bool rehash(dirtree * t, uint32_t bucket_count) {
+    uint32_t * buckets = malloc(bucket_count * sizeof(uint32_t));
+    if (!buckets)
+        return false;
+
+    free(t->buckets);
+    t->buckets = buckets;
+    t->bucket_count = bucket_count;
+    memset(buckets, 0xFF, bucket_count * sizeof(uint32_t));
+
+    // Node 0 is the root, which has no parent to be found under
+    for (uint32_t i = 1; i < t->count; i++) {
+        if (t->nodes[i].parent != DIRTREE_NONE)
+            hash_link(t, i);
+    }
+    return true;
+}
+
+static void tree_free(dirtree * t) {
+    free(t->nodes);
+    free(t->names);
+    free(t->buckets);
+    memset(t, 0, sizeof(*t));
+}
+
+static uint32_t tree_add(dirtree * t, uint32_t parent, const char * name,
+                         size_t len, bool dir, uint32_t size, uint32_t mtime) {
+    if (t->count == t->cap) {
+        uint32_t cap = t->cap ? t->cap * 2 : 256;
+        void * p = realloc(t->nodes, cap * sizeof(dirtree_node));
+        if (!p)
+            return DIRTREE_NONE;
+        t->nodes = p;
+        t->cap = cap;
+    }
+    if (t->names_size + len > t->names_cap) {
+        uint32_t cap = t->names_cap ? t->names_cap * 2 : 16 * 1024;
+        while (cap < t->names_size + len)
+            cap *= 2;
+        void * p = realloc(t->names, cap);
+        if (!p)
+            return DIRTREE_NONE;
+        t->names = p;
+        t->names_cap = cap;
+    }
+
+    uint32_t i = t->count++;
+    dirtree_node * n = &t->nodes[i];
+    n->parent = parent;
+    n->first_child = DIRTREE_NONE;
+    n->next_sibling = DIRTREE_NONE;
+    n->hash_next = DIRTREE_NONE;
+    n->name = t->names_size;
+    n->name_len = (uint16_t)len;
+    n->dir = dir;
+    n->stale = 0;
+    n->size = size;
+    n->mtime = mtime;
+
+    if (len) {
+        memcpy(t->names + t->names_size, name, len);
+        t->names_size += len;
+    }
+
+    if (parent != DIRTREE_NONE) {
+        n->next_sibling = t->nodes[parent].first_child;
+        t->nodes[parent].first_child = i;
+
+        // A rehash links in every node, this one included
+        if (t->count <= t->bucket_count)
+            hash_link(t, i);
+        else if (!rehash(t, t->bucket_count * 2))
+            return DIRTREE_NONE;
+    }
+    return i;
+}
+
+/*
+ * Detaches `i` from its parent; whatever is under it becomes unreachable.
+ * The node keeps no parent, so that a rehash doesn't link it back in.
+ */
+static void tree_unlink(dirtree * t, uint32_t i) {
+    dirtree_node * n = &t->nodes[i];
+    uint32_t * link = &t->nodes[n->parent].first_child;
+    while (*link != DIRTREE_NONE && *link != i)
+        link = &t->nodes[*link].next_sibling;
+    if (*link == i)
+        *link = n->next_sibling;
+
+    hash_unlink(t, i);
+    n->parent = DIRTREE_NONE;
+}
+
+static uint32_t unix_time(const SceDateTime * t) {
+    // Days since 1970-01-01 of a proleptic Gregorian date
+    int y = (int)t->year - (t->month <= 2);
+    int era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153 * (t->month + (t->month > 2 ? -3 : 9)) + 2) / 5
+                   + t->day - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    int64_t days = (int64_t)era * 146097 + doe - 719468;
+
+    int64_t secs = days * 86400 + t->hour * 3600 + t->minute * 60 + t->second;
+    return secs < 0 ? 0 : (uint32_t)secs;
+}
+
+static bool scan(dirtree * t, uint32_t node, char * path, size_t len) {
+    SceUID d = sceIoDopen(path);
+    if (d < 0)
+        return false;
+
+    SceIoDirent e;
+    bool ok = true;
+    while (ok && sceIoDread(d, &e) > 0) {
+        size_t name_len = strlen(e.d_name);
+        if (!name_len || strcmp(e.d_name, ".") == 0
+            || strcmp(e.d_name, "..") == 0)
+            continue;
+
+        bool dir = SCE_S_ISDIR(e.d_stat.st_mode);
+        uint32_t child = tree_add(t, node, e.d_name, name_len, dir,
+                                  (uint32_t)e.d_stat.st_size,
+                                  unix_time(&e.d_stat.st_mtime));
+        if (child == DIRTREE_NONE) {
+            ok = false;
+        } else if (dir) {
+            // A directory we can't look into would make its files "missing"
+            if (len + 1 + name_len >= DIRTREE_PATH_MAX) {
+                ok = false;
+                break;
+            }
+            path[len] = '/';
+            memcpy(path + len + 1, e.d_name, name_len + 1);
+            ok = scan(t, child, path, len + 1 + name_len);
+            path[len] = '\0';
+        }
+    }
+
+    sceIoDclose(d);
+    return ok;
+}
+
+static bool take_snapshot(dirtree * t) {
+    char path[DIRTREE_PATH_MAX];
+    memcpy(path, s_root, s_root_len + 1);
+
+    if (!rehash(t, 1024))
+        return false;
+    if (tree_add(t, DIRTREE_NONE, "", 0, true, 0, 0) != 0)
+        return false;
+    return scan(t, 0, path, s_root_len);
+}
+
+static void * build_thread(void * arg) {
+    for (int pass = 0; pass < DIRTREE_PASSES; pass++) {
+        sceKernelLockLwMutex(&s_lock, 1, NULL);
+        s_changed = false;
+        sceKernelUnlockLwMutex(&s_lock, 1);
+
+        dirtree t;
+        memset(&t, 0, sizeof(t));
+        bool ok = take_snapshot(&t);
+
+        sceKernelLockLwMutex(&s_lock, 1, NULL);
+        bool publish = ok && !s_changed;
+        if (publish) {
+            s_tree = t;
+            s_ready = true;
+        }
+        sceKernelUnlockLwMutex(&s_lock, 1);
+
+        if (publish) {
+            logv_info("[dirtree] %s: %u entries", s_root, t.count - 1);
+            return NULL;
+        }
+
+        tree_free(&t);
+        if (!ok)
+            break;
+    }
+
+    logv_warn("[dirtree] could not take a snapshot of %s", s_root);
+    return NULL;
+}
+
+void dirtree_build_async(const char * root) {
+    size_t len = strlen(root);
+    while (len > 1 && root[len - 1] == '/')
+        len--;
+    if (s_lock_ready || len >= sizeof(s_root))
+        return;
+
+    if (sceKernelCreateLwMutex(&s_lock, "dirtree_lock", 0, 0, NULL) < 0)
+        return;
+    s_lock_ready = true;
+
+    memcpy(s_root, root, len);
+    s_root[len] = '\0';
+    s_root_len = len;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, DIRTREE_STACK_SIZE);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    pthread_t thread;
+    if (pthread_create(&thread, &attr, build_thread, NULL) != 0)
+        log_error("[dirtree] could not start the snapshot thread");
+    pthread_attr_destroy(&attr);
+}
+
+static bool under_root(const char * path) {
+    return s_lock_ready && strncmp(path, s_root, s_root_len) == 0
+           && (path[s_root_len] == '/' || path[s_root_len] == '\0');
+}
+
+/*
+ * Node of `path` under the root, or DIRTREE_NONE. `parent` gets the
+ * directory that holds (or would hold) the last component, and `leaf` that
+ * component; parent is DIRTREE_NONE if that directory doesn't exist either.
+ */
+static uint32_t walk(const char * path, uint32_t * parent, const char ** leaf,
+                     size_t * leaf_len) {
+    const char * p = path + s_root_len;
+    uint32_t node = 0;
+
+    *parent = DIRTREE_NONE;
+    *leaf = NULL;
+    *leaf_len = 0;
+
+    while (*p == '/')
+        p++;
+    while (*p) {
+        if (node == DIRTREE_NONE || !s_tree.nodes[node].dir) {
+            *parent = DIRTREE_NONE;
+            return DIRTREE_NONE;
+        }
+
+        const char * seg = p;
+        while (*p && *p != '/')
+            p++;
+
+        *parent = node;
+        *leaf = seg;
+        *leaf_len = p - seg;
+        node = find_child(&s_tree, node, seg, p - seg);
+
+        while (*p == '/')
+            p++;
+    }
+    return node;
+}
+
+// The snapshot no longer matches the device; go back to asking the device
+static void drop(void) {
+    s_ready = false;
+    tree_free(&s_tree);
+    log_warn("[dirtree] snapshot dropped");
+}
+
+dirtree_result dirtree_lookup(const char * path, dirtree_stat * st) {
+    if (!under_root(path))
+        return DIRTREE_UNKNOWN;
+
+    dirtree_result ret = DIRTREE_UNKNOWN;
+
+    sceKernelLockLwMutex(&s_lock, 1, NULL);
+    if (s_ready) {
+        uint32_t parent;
+        const char * leaf;
+        size_t leaf_len;
+        uint32_t n = walk(path, &parent, &leaf, &leaf_len);
+
+        if (n == DIRTREE_NONE) {
+            ret = DIRTREE_MISSING;
+        } else {
+            ret = DIRTREE_FOUND;
+            if (st) {
+                st->dir = s_tree.nodes[n].dir;
+                st->stale = s_tree.nodes[n].stale;
+                st->size = s_tree.nodes[n].size;
+                st->mtime = s_tree.nodes[n].mtime;
+            }
+        }
+    }
+    sceKernelUnlockLwMutex(&s_lock, 1);
+
+    return ret;
+}
+
+// With the lock held; false if the snapshot isn't there to update
+static bool updatable(void) {
+    if (!s_ready) {
+        s_changed = true;
+        return false;
+    }
+    return true;
+}
+
+void dirtree_created(const char * path) {
+    if (!under_root(path))
+        return;
+
+    sceKernelLockLwMutex(&s_lock, 1, NULL);
+    if (updatable()) {
+        uint32_t parent;
+        const char * leaf;
+        size_t leaf_len;
+        uint32_t n = walk(path, &parent, &leaf, &leaf_len);
+
+        if (n != DIRTREE_NONE)
+            s_tree.nodes[n].stale = 1;
+        else if (parent == DIRTREE_NONE)
+            drop();
+        else if ((n = tree_add(&s_tree, parent, leaf, leaf_len, false, 0, 0)) == DIRTREE_NONE)
+            drop();
+        else
+            s_tree.nodes[n].stale = 1;
+    }
+    sceKernelUnlockLwMutex(&s_lock, 1);
+}
+
+void dirtree_removed(const char * path) {
+    if (!under_root(path))
+        return;
+
+    sceKernelLockLwMutex(&s_lock, 1, NULL);
+    if (updatable()) {
+        uint32_t parent;
+        const char * leaf;
+        size_t leaf_len;
+        uint32_t n = walk(path, &parent, &leaf, &leaf_len);
+
+        if (n == 0)
+            drop();
+        else if (n != DIRTREE_NONE)
+            tree_unlink(&s_tree, n);
+    }
+    sceKernelUnlockLwMutex(&s_lock, 1);
+}
+
+void dirtree_renamed(const char * from, const char * to) {
+    bool from_in = under_root(from);
+    bool to_in = under_root(to);
+
+    if (!to_in) {
+        if (from_in)
+            dirtree_removed(from);
+        return;
+    }
+
+    sceKernelLockLwMutex(&s_lock, 1, NULL);
+    if (updatable()) {
+        uint32_t parent, to_parent;
+        const char * leaf;
+        size_t leaf_len;
+        uint32_t n = from_in ? walk(from, &parent, &leaf, &leaf_len)
+                             : DIRTREE_NONE;
+        uint32_t m = walk(to, &to_parent, &leaf, &leaf_len);
+
+        if (n == DIRTREE_NONE || n == 0 || to_parent == DIRTREE_NONE) {
+            // Came from outside, or the snapshot missed it
+            drop();
+        } else if (n != m) {
+            if (m != DIRTREE_NONE)
+                tree_unlink(&s_tree, m);
+            tree_unlink(&s_tree, n);
+
+            // The old name stays in the arena, the new one is appended
+            uint32_t renamed = tree_add(&s_tree, to_parent, leaf, leaf_len,
+                                        s_tree.nodes[n].dir,
+                                        s_tree.nodes[n].size,
+                                        s_tree.nodes[n].mtime);
+            if (renamed == DIRTREE_NONE) {
+                drop();
+            } else {
+                dirtree_node * r = &s_tree.nodes[renamed];
+                r->stale = s_tree.nodes[n].stale;
+                r->first_child = s_tree.nodes[n].first_child;
+                s_tree.nodes[n].first_child = DIRTREE_NONE;
+
+                // Move the children over to the new node
+                for (uint32_t c = r->first_child; c != DIRTREE_NONE;
+                     c = s_tree.nodes[c].next_sibling) {
+                    hash_unlink(&s_tree, c);
+                    s_tree.nodes[c].parent = renamed;
+                    hash_link(&s_tree, c);
+                }
+            }
+        }
+    }
+    sceKernelUnlockLwMutex(&s_lock, 1);
+}
+
+dirtree_dir * dirtree_opendir(const char * path) {
+    if (!under_root(path))
+        return NULL;
+
+    dirtree_dir * d = NULL;
+
+    sceKernelLockLwMutex(&s_lock, 1, NULL);
+    if (s_ready) {
+        uint32_t parent;
+        const char * leaf;
+        size_t leaf_len;
+        uint32_t n = walk(path, &parent, &leaf, &leaf_len);
+
+        if (n != DIRTREE_NONE && s_tree.nodes[n].dir) {
+            for (int i = 0; i < DIRTREE_MAX_DIRS; i++) {
+                if (!s_dirs[i].used) {
+                    d = &s_dirs[i];
+                    d->used = 1;
+                    d->next = s_tree.nodes[n].first_child;
+                    break;
+                }
+            }
+        }
+    }
+    sceKernelUnlockLwMutex(&s_lock, 1);
+
+    return d;
+}
+
+bool dirtree_readdir(dirtree_dir * d, char * name, size_t size, bool * dir) {
+    bool ret = false;
+
+    sceKernelLockLwMutex(&s_lock, 1, NULL);
+    if (s_ready && d->next != DIRTREE_NONE) {
+        const dirtree_node * n = &s_tree.nodes[d->next];
+        size_t len = n->name_len < size - 1 ? n->name_len : size - 1;
+        memcpy(name, s_tree.names + n->name, len);
+        name[len] = '\0';
+        *dir = n->dir;
+        d->next = n->next_sibling;
+        ret = true;
+    }
+    sceKernelUnlockLwMutex(&s_lock, 1);
+
+    return ret;
+}
+
+void dirtree_closedir(dirtree_dir * d) {
+    sceKernelLockLwMutex(&s_lock, 1, NULL);
+    d->used = 0;
+    sceKernelUnlockLwMutex(&s_lock, 1);
+}
+
+bool dirtree_owns(const void * handle) {
+    uintptr_t p = (uintptr_t)handle;
+    uintptr_t base = (uintptr_t)s_dirs;
+    return p >= base && p < base + sizeof(s_dirs)
+           && (p - base) % sizeof(dirtree_dir) == 0;
+}
+
+int dirtree_slot(const dirtree_dir * d) {
+    return (int)(d - s_dirs);
+}
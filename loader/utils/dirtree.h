@@ -0,0 +1,56 @@
+/*
+ * utils/dirtree.h
+ *
+ * In-memory snapshot of a directory tree, kept up to date by the I/O shims.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_DIRTREE_H
+#define SOLOADER_DIRTREE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DIRTREE_MAX_DIRS 16 // open directory handles
+
+typedef enum dirtree_result {
+    DIRTREE_UNKNOWN = 0, // outside the tree, or no snapshot (yet)
+    DIRTREE_MISSING,
+    DIRTREE_FOUND
+} dirtree_result;
+
+typedef struct dirtree_stat {
+    bool dir;
+    bool stale;         // written to since the snapshot; size and mtime are old
+    uint32_t size;
+    uint32_t mtime;     // unix time
+} dirtree_stat;
+
+typedef struct dirtree_dir dirtree_dir;
+
+// Snapshot `root` (a real path, e.g. "ux0:data/x") on a background thread
+void dirtree_build_async(const char * root);
+
+// `st` may be NULL
+dirtree_result dirtree_lookup(const char * path, dirtree_stat * st);
+
+// Updates from the shims, for real paths
+void dirtree_created(const char * path);
+void dirtree_removed(const char * path);
+void dirtree_renamed(const char * from, const char * to);
+
+// NULL if the directory isn't in the snapshot
+dirtree_dir * dirtree_opendir(const char * path);
+bool dirtree_readdir(dirtree_dir * d, char * name, size_t size, bool * dir);
+void dirtree_closedir(dirtree_dir * d);
+bool dirtree_owns(const void * handle);
+
+// 0 .. DIRTREE_MAX_DIRS - 1, for per-handle state kept by the caller
+int dirtree_slot(const dirtree_dir * d);
+
+#endif // SOLOADER_DIRTREE_H
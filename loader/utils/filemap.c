@@ -0,0 +1,277 @@
+/*
+ * utils/filemap.c
+ *
+ * mmap() and munmap() emulated on the heap, for a target without an MMU
+ * the game can use.
+ *
+ * A map is a page-aligned heap block. File maps read the whole range in
+ * when they are made; there are no page faults to do it lazily with.
+ * Read-only maps of the same range of the same file are the same block, so
+ * mapping a file again costs nothing. Writable maps always get a copy of
+ * their own, and MAP_SHARED ones don't write back.
+ *
+ * Every map keeps, per page, how many mmap() calls still have it mapped;
+ * munmap() may cover part of a map, or several. The block is freed when no
+ * page of it is left. Nothing here is specific to the Vita.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "utils/filemap.h"
+
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FILEMAP_FDS 256 // power of two
+
+typedef struct filemap_fd {
+    int fd;
+    char * path;        // NULL for an empty slot
+} filemap_fd;
+
+typedef struct filemap_region {
+    uint8_t * base;
+    uint32_t pages;
+    uint32_t live;      // pages mapped at least once
+    uint16_t * refs;    // per page, how many maps still have it
+    uint32_t maps;      // made of it, for the refs not to overflow
+    char * path;        // of the file for a shareable map, NULL otherwise
+    int64_t offset;
+} filemap_region;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static filemap_read_fn s_read;
+
+static filemap_fd s_fds[FILEMAP_FDS];
+
+static filemap_region * s_regions;
+static uint32_t s_region_count;
+static uint32_t s_region_max;
+
+static inline filemap_fd * fd_slot(int fd) {
+    uint32_t u = (uint32_t)fd;
+    return &s_fds[(u ^ (u >> 8)) & (FILEMAP_FDS - 1)];
+}
+
+void filemap_init(filemap_read_fn read) {
+    s_read = read;
+}
+
+void filemap_opened(int fd, const char * path) {
+    char * copy = strdup(path);
+
+    pthread_mutex_lock(&s_lock);
+    filemap_fd * f = fd_slot(fd);
+    free(f->path);
+    f->fd = fd;
+    f->path = copy;
+    pthread_mutex_unlock(&s_lock);
+}
+
+void filemap_closed(int fd) {
+    pthread_mutex_lock(&s_lock);
+    filemap_fd * f = fd_slot(fd);
+    if (f->path && f->fd == fd) {
+        free(f->path);
+        f->path = NULL;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+void filemap_forget(const char * path) {
+    pthread_mutex_lock(&s_lock);
+    for (uint32_t i = 0; i < s_region_count; i++) {
+        filemap_region * r = &s_regions[i];
+        if (r->path && strcmp(r->path, path) == 0) {
+            free(r->path);
+            r->path = NULL;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+// With the lock held
+static filemap_region * find_shared(const char * path, int64_t offset,
+                                    uint32_t pages) {
+    for (uint32_t i = 0; i < s_region_count; i++) {
+        filemap_region * r = &s_regions[i];
+        if (r->path && r->offset == offset && r->pages == pages
+            && r->maps < UINT16_MAX && strcmp(r->path, path) == 0)
+            return r;
+    }
+    return NULL;
+}
+
+// With the lock held
+static void map_again(filemap_region * r) {
+    for (uint32_t p = 0; p < r->pages; p++)
+        if (r->refs[p]++ == 0)
+            r->live++;
+    r->maps++;
+}
+
+// With the lock held; false if out of memory
+static bool region_add(const filemap_region * r) {
+    if (s_region_count == s_region_max) {
+        uint32_t max = s_region_max ? s_region_max * 2 : 16;
+        filemap_region * regions = realloc(s_regions, max * sizeof(*regions));
+        if (!regions)
+            return false;
+        s_regions = regions;
+        s_region_max = max;
+    }
+    s_regions[s_region_count++] = *r;
+    return true;
+}
+
+static void region_free(filemap_region * r) {
+    free(r->base);
+    free(r->refs);
+    free(r->path);
+}
+
+// Reads whole pages in, zeroing whatever is past the end of the file
+static bool load(uint8_t * dst, size_t size, int fd, const char * path,
+                 int64_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        int got = s_read(fd, path, dst + done, (uint32_t)(size - done),
+                         offset + done);
+        if (got < 0)
+            return false;
+        if (got == 0)
+            break;
+        done += got;
+    }
+    memset(dst + done, 0, size - done);
+    return true;
+}
+
+void * filemap_map(size_t length, int prot, int flags, int fd,
+                   int64_t offset) {
+    // Both bits together are MAP_SHARED_VALIDATE
+    bool anonymous = flags & FILEMAP_MAP_ANONYMOUS;
+    if (!length || (flags & FILEMAP_MAP_FIXED)
+        || !(flags & (FILEMAP_MAP_SHARED | FILEMAP_MAP_PRIVATE))
+        || (!anonymous && (offset < 0 || offset % FILEMAP_PAGE_SIZE))) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    uint64_t pages = ((uint64_t)length + FILEMAP_PAGE_SIZE - 1)
+                     / FILEMAP_PAGE_SIZE;
+    if (pages * FILEMAP_PAGE_SIZE > SIZE_MAX || pages > UINT32_MAX) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    size_t size = (size_t)pages * FILEMAP_PAGE_SIZE;
+
+    filemap_region r = {
+        .pages = (uint32_t)pages,
+        .live = (uint32_t)pages,
+        .maps = 1,
+        .offset = offset,
+    };
+
+    char * path = NULL;
+    if (!anonymous) {
+        pthread_mutex_lock(&s_lock);
+        const filemap_fd * f = fd_slot(fd);
+        if (f->path && f->fd == fd) {
+            filemap_region * shared = NULL;
+            if (!(prot & FILEMAP_PROT_WRITE))
+                shared = find_shared(f->path, offset, r.pages);
+            if (shared) {
+                map_again(shared);
+                uint8_t * base = shared->base;
+                pthread_mutex_unlock(&s_lock);
+                return base;
+            }
+            path = strdup(f->path); // not shareable without it, but fine
+        }
+        pthread_mutex_unlock(&s_lock);
+    }
+
+    // Only read-only maps are shared
+    if (!(prot & FILEMAP_PROT_WRITE))
+        r.path = path;
+
+    r.base = memalign(FILEMAP_PAGE_SIZE, size);
+    r.refs = malloc(r.pages * sizeof(*r.refs));
+    if (!r.base || !r.refs) {
+        if (path != r.path)
+            free(path);
+        region_free(&r);
+        errno = ENOMEM;
+        return NULL;
+    }
+    for (uint32_t p = 0; p < r.pages; p++)
+        r.refs[p] = 1;
+
+    bool loaded = anonymous || load(r.base, size, fd, path, offset);
+    if (anonymous)
+        memset(r.base, 0, size);
+    if (path != r.path)
+        free(path);
+    if (!loaded) {
+        region_free(&r);
+        errno = EBADF;
+        return NULL;
+    }
+
+    pthread_mutex_lock(&s_lock);
+    bool added = region_add(&r);
+    pthread_mutex_unlock(&s_lock);
+
+    if (!added) {
+        region_free(&r);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return r.base;
+}
+
+int filemap_unmap(void * addr, size_t length) {
+    uintptr_t start = (uintptr_t)addr;
+    if (!length || start % FILEMAP_PAGE_SIZE || length > UINTPTR_MAX - start) {
+        errno = EINVAL;
+        return -1;
+    }
+    uintptr_t end = start + length;
+
+    pthread_mutex_lock(&s_lock);
+    for (uint32_t i = 0; i < s_region_count;) {
+        filemap_region * r = &s_regions[i];
+        uintptr_t base = (uintptr_t)r->base;
+        uintptr_t top = base + (uintptr_t)r->pages * FILEMAP_PAGE_SIZE;
+        if (end <= base || start >= top) {
+            i++;
+            continue;
+        }
+
+        // A page partly in the range is unmapped as a whole
+        uint32_t first = start > base ? (start - base) / FILEMAP_PAGE_SIZE : 0;
+        uint32_t last = end < top ? (end - base + FILEMAP_PAGE_SIZE - 1)
+                                    / FILEMAP_PAGE_SIZE
+                                  : r->pages;
+        for (uint32_t p = first; p < last; p++)
+            if (r->refs[p] && --r->refs[p] == 0)
+                r->live--;
+
+        if (r->live) {
+            i++;
+            continue;
+        }
+        region_free(r);
+        s_regions[i] = s_regions[--s_region_count];
+    }
+    pthread_mutex_unlock(&s_lock);
+    return 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * utils/filemap.h
+ *
+ * mmap() and munmap() emulated on the heap, for a target without an MMU
+ * the game can use.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_FILEMAP_H
+#define SOLOADER_FILEMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FILEMAP_PAGE_SIZE 4096
+
+// As the game passes them (same as Linux)
+#define FILEMAP_PROT_WRITE    0x2
+#define FILEMAP_MAP_SHARED    0x01
+#define FILEMAP_MAP_PRIVATE   0x02
+#define FILEMAP_MAP_FIXED     0x10
+#define FILEMAP_MAP_ANONYMOUS 0x20
+
+/*
+ * Reads without moving the file position: bytes read, 0 at the end, < 0 on
+ * error. `path` is what `fd` was opened on, NULL if it isn't known.
+ */
+typedef int (*filemap_read_fn)(int fd, const char * path, void * dst,
+                               uint32_t len, int64_t offset);
+
+void filemap_init(filemap_read_fn read);
+
+// `fd` was opened on `path` (a real path); maps of it can be shared
+void filemap_opened(int fd, const char * path);
+void filemap_closed(int fd);
+
+// The file at `path` changed; maps made from now on read it again
+void filemap_forget(const char * path);
+
+/*
+ * Page-aligned copy of the pages of `fd` covering `length` bytes at
+ * `offset`, zeroed past the end of the file, or zeroed memory for
+ * MAP_ANONYMOUS. Read-only maps of the same pages of a file are the same
+ * memory. NULL with errno set on failure; MAP_FIXED isn't supported.
+ */
+void * filemap_map(size_t length, int prot, int flags, int fd,
+                   int64_t offset);
+
+/*
+ * Unmaps the pages in [addr, addr + length), of any number of maps. Memory
+ * is freed once none of a map's pages are left. 0, or -1 with errno set.
+ */
+int filemap_unmap(void * addr, size_t length);
+
+#endif // SOLOADER_FILEMAP_H
@@ -15,16 +15,24 @@
 
 #include "utils/utils.h"
 #include "utils/dialog.h"
+#include "utils/hash.h"
 #include "utils/logger.h"
+#include "utils/shadermanifest.h"
+
+#include "reimpl/glstate.h"
+#include "reimpl/gltrace.h"
+#include "reimpl/glvbo.h"
 
 #include <stdio.h>
 #include <malloc.h>
 #include <string.h>
 #include <psp2/kernel/sysmem.h>
 #include <psp2/io/stat.h>
+#include <sha1/sha1.h>
 
 #define GLSL_PATH DATA_PATH
 #define GXP_PATH "app0:shaders"
+#define SHADER_MANIFEST_PATH DATA_PATH"gxp/manifest.bin"
 
 void gl_preload() {
     if (!file_exists("ur0:/data/libshacccg.suprx")
@@ -33,6 +41,65 @@ void gl_preload() {
     }
 }
 
+GLboolean skip_next_compile = GL_FALSE;
+static GLboolean compiled_this_frame = GL_FALSE;
+char next_shader_fname[128];
+
+static void gxp_path(char * out, size_t size, const char * key) {
+    snprintf(out, size, DATA_PATH"gxp/%c%c/%s.gxp", key[0], key[1], key);
+}
+
+static bool gxp_cached(const char * key) {
+    char path[128];
+    gxp_path(path, sizeof(path), key);
+    return file_exists(path);
+}
+
+// Binaries used to be named after the SHA1 of the source
+static bool gxp_rekey(const char * sha1, const char * key) {
+    char old_path[128];
+    char new_path[128];
+    gxp_path(old_path, sizeof(old_path), sha1);
+    if (!file_exists(old_path))
+        return false;
+
+    gxp_path(new_path, sizeof(new_path), key);
+    mkpath(new_path, 0777);
+    return rename(old_path, new_path) == 0;
+}
+
+static void save_shader_binary(GLuint shader, const char * path) {
+    void *bin = vglMalloc(32 * 1024);
+    GLsizei len;
+    vglGetShaderBinary(shader, 32 * 1024, &len, bin);
+    FILE *file = fopen(path, "wb");
+    if (file) {
+        fwrite(bin, 1, len, file);
+        fclose(file);
+    }
+    vglFree(bin);
+}
+
+static bool precompile_shader(const char * key, uint32_t type,
+                              const char * src, uint32_t len) {
+    char path[128];
+    gxp_path(path, sizeof(path), key);
+    mkpath(path, 0777);
+
+    GLuint shader = glCreateShader(type);
+    GLint length = (GLint)len;
+    glShaderSource(shader, 1, &src, &length);
+    glCompileShader(shader);
+
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (compiled)
+        save_shader_binary(shader, path);
+
+    glDeleteShader(shader);
+    return compiled;
+}
+
 void gl_init() {
     vglAddSemanticBinding("FogFactor", 0, VGL_TYPE_FOG);
     vglAddSemanticBinding("fogFactor", 0, VGL_TYPE_FOG);
@@ -72,44 +139,105 @@ void gl_init() {
     vglAddSemanticBinding("VarColor", 0, VGL_TYPE_COLOR);
 
     vglInitExtended(0, 960, 544, 6 * 1024 * 1024, SCE_GXM_MULTISAMPLE_4X);
+    glstate_invalidate();
+    glvbo_invalidate();
+
+    shader_manifest_open(SHADER_MANIFEST_PATH, gxp_cached, gxp_rekey);
 }
 
 void gl_swap() {
+    /*
+     * vitaGL can't compile from another thread, so the shaders recorded on
+     * previous boots are compiled here, one per frame, starting with the
+     * splash and menus. Frames where the game compiled one itself are
+     * already late and get skipped.
+     */
+    if (!compiled_this_frame)
+        shader_manifest_precompile_next(precompile_shader);
+    compiled_this_frame = GL_FALSE;
+
+    glstate_frame_end();
+    glvbo_frame_end();
+    gltrace_frame_end();
     vglSwapBuffers(GL_FALSE);
 }
 
-GLboolean skip_next_compile = GL_FALSE;
-char next_shader_fname[128];
+static const char shader_prelude[] =
+        "inline float4 glslTexture2D(samplerCUBE x, float3 s) { return texCUBE(x,s); }\n";
 
-void load_shader(GLuint shader, const char * string, size_t length) {
-    char* sha_name = get_string_sha1((uint8_t*)string, length);
-
-    char gxp_path[128];
-    snprintf(gxp_path, sizeof(gxp_path), DATA_PATH"gxp/%c%c/%s.gxp", sha_name[0], sha_name[1], sha_name);
-
-    FILE *file = fopen(gxp_path, "rb");
-    if (!file) {
-        mkpath(gxp_path, 0777);
-        glShaderSource(shader, 1, &string, &length);
-        snprintf(next_shader_fname, sizeof(next_shader_fname), DATA_PATH"gxp/%c%c/%s.gxp", sha_name[0], sha_name[1], sha_name);
-    } else {
-        fseek(file, 0, SEEK_END);
-        uint32_t size = ftell(file);
-        fseek(file, 0, SEEK_SET);
-
-        char * shaderBuf = malloc(size + 1);
-        fread(shaderBuf, 1, size, file);
-        shaderBuf[size] = 0;
-        fclose(file);
+#define SHADER_PRELUDE_LEN (sizeof(shader_prelude) - 1)
+#define SHADER_FRAGMENTS_MAX 16
 
-        glShaderBinary(1, &shader, 0, shaderBuf, (int32_t)size);
+static inline size_t fragment_length(const GLchar **string,
+                                     const GLint *length, GLsizei i) {
+    return (length && length[i] >= 0) ? (size_t)length[i] : strlen(string[i]);
+}
 
-        if(shaderBuf) free(shaderBuf);
-        skip_next_compile = GL_TRUE;
+// Prelude followed by all the fragments, in one allocation
+static char * assemble_source(GLsizei count, const GLchar **string,
+                              const size_t *lengths, const GLint *_length,
+                              size_t total_length) {
+    char * str = malloc(total_length + 1);
+    if (!str)
+        return NULL;
+
+    memcpy(str, shader_prelude, SHADER_PRELUDE_LEN);
+    size_t l = SHADER_PRELUDE_LEN;
+
+    for (GLsizei i = 0; i < count; ++i) {
+        size_t len = (i < SHADER_FRAGMENTS_MAX)
+                     ? lengths[i] : fragment_length(string, _length, i);
+        memcpy(str + l, string[i], len);
+        l += len;
     }
-    free(sha_name);
+    str[total_length] = '\0';
+    return str;
 }
 
+// SHA1 of the source, the cache key before hash128
+static void legacy_sha1_name(GLsizei count, const GLchar **string,
+                             const size_t *lengths, const GLint *_length,
+                             char * out) {
+    SHA1_CTX ctx;
+    sha1_init(&ctx);
+    sha1_update(&ctx, (const BYTE *)shader_prelude, SHADER_PRELUDE_LEN);
+
+    for (GLsizei i = 0; i < count; ++i) {
+        size_t len = (i < SHADER_FRAGMENTS_MAX)
+                     ? lengths[i] : fragment_length(string, _length, i);
+        sha1_update(&ctx, (const BYTE *)string[i], len);
+    }
+
+    uint8_t digest[SHA1_BLOCK_SIZE];
+    sha1_final(&ctx, digest);
+    hex_encode(digest, SHA1_BLOCK_SIZE, out);
+}
+
+static bool load_shader_binary(GLuint shader, const char * path) {
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    uint32_t size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char * shaderBuf = malloc(size + 1);
+    fread(shaderBuf, 1, size, file);
+    shaderBuf[size] = 0;
+    fclose(file);
+
+    glShaderBinary(1, &shader, 0, shaderBuf, (int32_t)size);
+
+    if(shaderBuf) free(shaderBuf);
+    return true;
+}
+
+/*
+ * The prelude and the fragments are hashed where they are; the complete
+ * source is only put together when it has to be compiled, or recorded in
+ * the shader manifest for the first time.
+ */
 void glShaderSourceHook(GLuint shader, GLsizei count, const GLchar **string,
                         const GLint *_length) {
     if (!string) {
@@ -120,49 +248,67 @@ void glShaderSourceHook(GLuint shader, GLsizei count, const GLchar **string,
         return;
     }
 
-    int total_length = 0;
+    size_t lengths[SHADER_FRAGMENTS_MAX];
+    size_t total_length = SHADER_PRELUDE_LEN;
 
-    for (int i = 0; i < count; ++i) {
-        if (!_length) {
-            total_length += strlen(string[i]);
-        } else {
-            total_length += _length[i];
-        }
+    hash128_ctx ctx;
+    hash128_init(&ctx);
+    hash128_update(&ctx, shader_prelude, SHADER_PRELUDE_LEN);
+
+    for (GLsizei i = 0; i < count; ++i) {
+        size_t len = fragment_length(string, _length, i);
+        if (i < SHADER_FRAGMENTS_MAX)
+            lengths[i] = len;
+        hash128_update(&ctx, string[i], len);
+        total_length += len;
     }
 
-    char * str = malloc(total_length+1);
-    int l = 0;
+    uint8_t digest[HASH128_SIZE];
+    hash128_final(&ctx, digest);
 
-    for (int i = 0; i < count; ++i) {
-        if (!_length) {
-            memcpy(str + l, string[i], strlen(string[i]));
-            l += strlen(string[i]);
-        } else {
-            memcpy(str + l, string[i], _length[i]);
-            l += _length[i];
-        }
+    char key[HASH128_HEX_LEN + 1];
+    hex_encode(digest, HASH128_SIZE, key);
+
+    gxp_path(next_shader_fname, sizeof(next_shader_fname), key);
+
+    bool cached = load_shader_binary(shader, next_shader_fname);
+    if (!cached) {
+        // Pick up a binary cached under the old name, once
+        char sha1[SHA1_BLOCK_SIZE * 2 + 1];
+        legacy_sha1_name(count, string, lengths, _length, sha1);
+        cached = gxp_rekey(sha1, key)
+                 && load_shader_binary(shader, next_shader_fname);
     }
-    str[total_length] = '\0';
+    skip_next_compile = cached ? GL_TRUE : GL_FALSE;
 
-    char * to_append = "inline float4 glslTexture2D(samplerCUBE x, float3 s) { return texCUBE(x,s); }\n";
-    char * str_final = malloc(total_length + 1 + strlen(to_append));
-    sprintf(str_final, "%s%s", to_append, str);
-    free(str);
+    if (cached && shader_manifest_known(key))
+        return;
+
+    char * str = assemble_source(count, string, lengths, _length,
+                                 total_length);
+    if (!str) {
+        log_error("Could not allocate the shader source");
+        return;
+    }
 
-    load_shader(shader, str_final, total_length + strlen(to_append));
-    free(str_final);
+    GLint type = 0;
+    glGetShaderiv(shader, GL_SHADER_TYPE, &type);
+    shader_manifest_record(key, type, str, total_length);
+
+    if (!cached) {
+        mkpath(next_shader_fname, 0777);
+        GLint length = (GLint)total_length;
+        glShaderSource(shader, 1, (const GLchar **)&str, &length);
+    }
+
+    free(str);
 }
 
 void glCompileShaderHook(GLuint shader) {
     if (!skip_next_compile) {
         glCompileShader(shader);
-        void *bin = vglMalloc(32 * 1024);
-        GLsizei len;
-        vglGetShaderBinary(shader, 32 * 1024, &len, bin);
-        FILE *file = fopen(next_shader_fname, "wb");
-        fwrite(bin, 1, len, file);
-        fclose(file);
-        vglFree(bin);
+        save_shader_binary(shader, next_shader_fname);
+        compiled_this_frame = GL_TRUE;
     }
     skip_next_compile = GL_FALSE;
 }
@@ -386,6 +532,8 @@ EGLBoolean eglChooseConfig (EGLDisplay dpy, const EGLint *attrib_list, EGLConfig
 }
 
 EGLContext eglCreateContext(EGLDisplay dpy, EGLConfig config, EGLContext share_context, const EGLint *attrib_list) {
+    glstate_invalidate();
+    glvbo_invalidate();
     return strdup("ctx");
 }
 
@@ -394,6 +542,8 @@ EGLSurface eglCreateWindowSurface(EGLDisplay dpy, EGLConfig config, void * win,
 }
 
 EGLBoolean eglMakeCurrent(EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLContext ctx) {
+    glstate_invalidate();
+    glvbo_invalidate();
     return EGL_TRUE;
 }
 
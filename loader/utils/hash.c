@@ -0,0 +1,158 @@
+/*
+ * utils/hash.c
+ *
+ * Content hashing: a fast 128-bit hash for cache keys, streaming SHA1 for
+ * file integrity, and hex encoding.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "utils/hash.h"
+
+#include <arm_neon.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sha1/sha1.h>
+
+#define PRIME1 0x9E3779B1u
+#define PRIME2 0x85EBCA77u
+#define PRIME3 0xC2B2AE3Du
+#define PRIME5 0x165667B1u
+
+#define SHA1_FILE_CHUNK (8 * 1024)
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static inline uint32_t rotl32(uint32_t x, int r) {
+    return (x << r) | (x >> (32 - r));
+}
+
+static inline uint32_t fmix32(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// lane[i] = rotl(lane[i] + word[i] * PRIME2, 13) * PRIME1, per 16-byte stripe
+static void process_stripes(uint32_t lanes[4], const uint8_t * p,
+                            size_t stripes) {
+    const uint32x4_t p1 = vdupq_n_u32(PRIME1);
+    const uint32x4_t p2 = vdupq_n_u32(PRIME2);
+    uint32x4_t acc = vld1q_u32(lanes);
+
+    while (stripes--) {
+        uint32x4_t w = vreinterpretq_u32_u8(vld1q_u8(p));
+        acc = vmlaq_u32(acc, w, p2);
+        acc = vsriq_n_u32(vshlq_n_u32(acc, 13), acc, 19);
+        acc = vmulq_u32(acc, p1);
+        p += 16;
+    }
+
+    vst1q_u32(lanes, acc);
+}
+
+void hash128_init(hash128_ctx * ctx) {
+    ctx->lanes[0] = PRIME1 + PRIME2;
+    ctx->lanes[1] = PRIME2;
+    ctx->lanes[2] = 0;
+    ctx->lanes[3] = 0u - PRIME1;
+    ctx->buf_len = 0;
+    ctx->total_len = 0;
+}
+
+void hash128_update(hash128_ctx * ctx, const void * data, size_t len) {
+    const uint8_t * p = data;
+    ctx->total_len += len;
+
+    if (ctx->buf_len) {
+        size_t n = 16 - ctx->buf_len;
+        if (n > len)
+            n = len;
+        memcpy(ctx->buf + ctx->buf_len, p, n);
+        ctx->buf_len += n;
+        p += n;
+        len -= n;
+
+        if (ctx->buf_len < 16)
+            return;
+        process_stripes(ctx->lanes, ctx->buf, 1);
+        ctx->buf_len = 0;
+    }
+
+    if (len >= 16) {
+        process_stripes(ctx->lanes, p, len / 16);
+        p += len & ~(size_t)15;
+        len &= 15;
+    }
+
+    memcpy(ctx->buf, p, len);
+    ctx->buf_len = len;
+}
+
+void hash128_final(hash128_ctx * ctx, uint8_t out[HASH128_SIZE]) {
+    uint32_t h[4];
+    memcpy(h, ctx->lanes, sizeof(h));
+
+    for (uint32_t i = 0; i < ctx->buf_len; i++)
+        h[i & 3] = rotl32(h[i & 3] ^ (ctx->buf[i] * PRIME5), 11) * PRIME1;
+
+    h[0] ^= (uint32_t)ctx->total_len;
+    h[1] ^= (uint32_t)(ctx->total_len >> 32) ^ PRIME3;
+
+    // Three rounds are needed for every word to depend on every lane
+    for (int r = 0; r < 3; r++) {
+        h[0] = fmix32(h[0] + h[1]);
+        h[1] = fmix32(h[1] + h[2]);
+        h[2] = fmix32(h[2] + h[3]);
+        h[3] = fmix32(h[3] + h[0]);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        out[i * 4] = (uint8_t)h[i];
+        out[i * 4 + 1] = (uint8_t)(h[i] >> 8);
+        out[i * 4 + 2] = (uint8_t)(h[i] >> 16);
+        out[i * 4 + 3] = (uint8_t)(h[i] >> 24);
+    }
+}
+
+void hash128(const void * data, size_t len, uint8_t out[HASH128_SIZE]) {
+    hash128_ctx ctx;
+    hash128_init(&ctx);
+    hash128_update(&ctx, data, len);
+    hash128_final(&ctx, out);
+}
+
+bool sha1_file(const char * path, uint8_t out[20]) {
+    FILE * f = fopen(path, "rb");
+    if (!f)
+        return false;
+
+    SHA1_CTX ctx;
+    sha1_init(&ctx);
+
+    uint8_t chunk[SHA1_FILE_CHUNK];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        sha1_update(&ctx, chunk, n);
+
+    bool ok = !ferror(f);
+    fclose(f);
+
+    sha1_final(&ctx, out);
+    return ok;
+}
+
+void hex_encode(const uint8_t * data, size_t len, char * out) {
+    for (size_t i = 0; i < len; i++) {
+        out[i * 2] = hex_digits[data[i] >> 4];
+        out[i * 2 + 1] = hex_digits[data[i] & 0x0F];
+    }
+    out[len * 2] = '\0';
+}
@@ -0,0 +1,48 @@
+/*
+ * utils/hash.h
+ *
+ * Content hashing: a fast 128-bit hash for cache keys, streaming SHA1 for
+ * file integrity, and hex encoding.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_HASH_H
+#define SOLOADER_HASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HASH128_SIZE      16
+#define HASH128_HEX_LEN   (HASH128_SIZE * 2)
+
+/*
+ * Non-cryptographic 128-bit hash. Four independent 32-bit lanes consume
+ * 16-byte stripes (one NEON register each), and are cross-mixed at the end
+ * so that every output bit depends on the whole input. Not meant to resist
+ * deliberately crafted collisions.
+ */
+typedef struct hash128_ctx {
+    uint32_t lanes[4];
+    uint8_t buf[16];
+    uint32_t buf_len;
+    uint64_t total_len;
+} hash128_ctx;
+
+void hash128_init(hash128_ctx * ctx);
+void hash128_update(hash128_ctx * ctx, const void * data, size_t len);
+void hash128_final(hash128_ctx * ctx, uint8_t out[HASH128_SIZE]);
+
+void hash128(const void * data, size_t len, uint8_t out[HASH128_SIZE]);
+
+// SHA1 of a file, read in chunks. Returns false if it can't be read.
+bool sha1_file(const char * path, uint8_t out[20]);
+
+// Uppercase hex; `out` must hold len * 2 + 1 bytes
+void hex_encode(const uint8_t * data, size_t len, char * out);
+
+#endif // SOLOADER_HASH_H
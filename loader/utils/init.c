@@ -11,21 +11,34 @@
 
 #include "utils/init.h"
 
+#include "utils/blockcache.h"
 #include "utils/dialog.h"
+#include "utils/dirtree.h"
+#include "utils/filemap.h"
 #include "utils/glutil.h"
 #include "utils/logger.h"
+#include "utils/mounts.h"
+#include "utils/negcache.h"
+#include "utils/prefetch.h"
 #include "utils/utils.h"
 #include "utils/settings.h"
+#include "utils/writebehind.h"
+#include "utils/zipvfs.h"
 
 #include "reimpl/controls.h"
+#include "reimpl/io.h"
+#include "reimpl/iotrace.h"
+#include "reimpl/mem.h"
 
 #include "dynlib.h"
 #include "patch.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #include <psp2/appmgr.h>
 #include <psp2/apputil.h>
+#include <psp2/io/fcntl.h>
 #include <psp2/kernel/clib.h>
 #include <psp2/power.h>
 
@@ -36,8 +49,28 @@
 // Base address for the Android .so to be loaded at
 #define LOAD_ADDRESS 0x98000000
 
+#define APK_SO_NAME "lib/armeabi-v7a/libPirates.so"
+#define FILES_PATH DATA_PATH"com.gameloft.android.ANMP.GloftSDHM/files/"
+
 extern so_module so_mod;
 
+static int device_read(int fd, void * dst, uint32_t len, int64_t offset) {
+    return sceIoPread(fd, dst, len, offset);
+}
+
+void so_load_from_apk() {
+    size_t so_size;
+    void * so_data = zipvfs_load(APK_SO_NAME, &so_size);
+    if (!so_data)
+        fatal_error("Error: could not find %s in %s.", APK_SO_NAME, APK_PATH);
+
+    int ret = so_mem_load(&so_mod, so_data, so_size, LOAD_ADDRESS);
+    free(so_data);
+
+    if (ret < 0)
+        fatal_error("Error: could not load %s from %s.", APK_SO_NAME, APK_PATH);
+}
+
 void soloader_init_all() {
     // Check if we want to start the configurator app
     sceAppUtilInit(&(SceAppUtilInitParam){}, &(SceAppUtilBootParam){});
@@ -64,7 +97,27 @@ void soloader_init_all() {
         fatal_error("Error: kubridge.skprx is not installed.");
     log_info("kubridge check passed.");
 
-    if (!file_exists(SO_PATH)) {
+    iotrace_init();
+
+    // Sized once the settings are in; reads go straight to the card until then
+    blockcache_init(device_read);
+    filemap_init(fd_pread);
+
+    // Relative paths and any unknown ones end up in the files folder too
+    mounts_add("/", FILES_PATH);
+    mounts_add("/sdcard", FILES_PATH);
+    mounts_add("/sdcard/Android/data", DATA_PATH);
+    negcache_init();
+
+    // Saves are committed in the background; one a crash cut short is
+    // finished or rolled back first, before anything lists or reads them
+    writebehind_init(FILES_PATH, writebehind_committed);
+
+    // Files missing from the data folder are read from the .apk, if present
+    if (file_exists(APK_PATH) && zipvfs_mount(APK_PATH, "assets/", FILES_PATH))
+        log_info("zipvfs_mount() passed.");
+
+    if (!file_exists(SO_PATH) && !zipvfs_mounted()) {
         fatal_error("Looks like you haven't installed the data files for this "
                     "port, or they are in an incorrect location. Please make "
                     "sure that you have %s file exactly at that path.", SO_PATH);
@@ -77,12 +130,23 @@ void soloader_init_all() {
         cp("app0:data/control0", DATA_PATH"com.gameloft.android.ANMP.GloftSDHM/files/control0");
     }
 
-    if (so_file_load(&so_mod, SO_PATH, LOAD_ADDRESS) < 0)
-        fatal_error("Error: could not load %s.", SO_PATH);
+    // Listed in the background; until then, lookups go to the card. Not
+    // before the copies above, which don't go through the I/O shims.
+    dirtree_build_async(FILES_PATH);
+
+    if (file_exists(SO_PATH)) {
+        if (so_file_load(&so_mod, SO_PATH, LOAD_ADDRESS) < 0)
+            fatal_error("Error: could not load %s.", SO_PATH);
+    } else {
+        so_load_from_apk();
+    }
 
     settings_load();
     log_info("settings_load() passed.");
 
+    blockcache_set_capacity((size_t)setting_ioCacheSize * 1024 * 1024);
+    mem_pressure_add(blockcache_release);
+
     so_relocate(&so_mod);
     log_info("so_relocate() passed.");
 
@@ -92,6 +156,9 @@ void soloader_init_all() {
     so_patch();
     log_info("so_patch() passed.");
 
+    // Needs the CLevel accessor from the patches
+    prefetch_init(patch__level);
+
     so_flush_caches(&so_mod);
     log_info("so_flush_caches() passed.");
 
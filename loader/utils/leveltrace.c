@@ -0,0 +1,467 @@
+/*
+ * utils/leveltrace.c
+ *
+ * Per-level traces of the data read while a level loads, merged across runs
+ * and replayed ahead of the game to warm the block cache.
+ *
+ * A trace is the list of cache-sized blocks (file, offset / block size) in
+ * the order the game first read them. Nothing in here does any I/O, the
+ * caller feeds reads in and gets blocks to fetch out.
+ *
+ * Layout (little-endian): "LVTR", u32 version, u32 runs, u32 trace count,
+ * then per trace: u32 key, u32 last run, u16 file count, u16 block count,
+ * the files as u16 length + path bytes, and the blocks as u16 file,
+ * u8 misses, u8 0, u32 index.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "utils/leveltrace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LEVELTRACE_MAGIC    "LVTR"
+#define LEVELTRACE_VERSION  1
+#define LEVELTRACE_HEADER   16
+#define LEVELTRACE_PATH_MAX 1024
+
+uint32_t leveltrace_hash(const char * path) {
+    uint32_t h = 0x811C9DC5u;
+    while (*path) {
+        h ^= (uint8_t)*path++;
+        h *= 0x01000193u;
+    }
+    return h;
+}
+
+static inline uint32_t block_slot(uint16_t file, uint32_t index) {
+    uint32_t h = (file * 0x9E3779B1u) ^ (index * 0x85EBCA77u);
+    return (h ^ (h >> 15)) & (LEVELTRACE_SLOTS - 1);
+}
+
+leveltrace * leveltrace_new(uint32_t key) {
+    leveltrace * t = calloc(1, sizeof(*t));
+    if (t)
+        t->key = key;
+    return t;
+}
+
+void leveltrace_free(leveltrace * t) {
+    if (!t)
+        return;
+    for (uint32_t i = 0; i < t->file_count; i++)
+        free(t->files[i]);
+    free(t);
+}
+
+static int file_add(leveltrace * t, const char * path, size_t len,
+                    uint32_t hash) {
+    if (t->file_count == LEVELTRACE_MAX_FILES)
+        return -1;
+
+    char * copy = malloc(len + 1);
+    if (!copy)
+        return -1;
+    memcpy(copy, path, len);
+    copy[len] = '\0';
+
+    t->files[t->file_count] = copy;
+    t->file_hashes[t->file_count] = hash;
+    return t->file_count++;
+}
+
+static int file_find(const leveltrace * t, const char * path,
+                     uint32_t hash) {
+    for (uint32_t i = 0; i < t->file_count; i++) {
+        if (t->file_hashes[i] == hash && strcmp(t->files[i], path) == 0)
+            return (int)i;
+    }
+    return -1;
+}
+
+int leveltrace_file(const leveltrace * t, const char * path) {
+    return file_find(t, path, leveltrace_hash(path));
+}
+
+int leveltrace_file_add(leveltrace * t, const char * path) {
+    uint32_t hash = leveltrace_hash(path);
+    int file = file_find(t, path, hash);
+    return file < 0 ? file_add(t, path, strlen(path), hash) : file;
+}
+
+int leveltrace_find(const leveltrace * t, uint16_t file, uint32_t index) {
+    for (uint32_t i = block_slot(file, index); t->slots[i];
+         i = (i + 1) & (LEVELTRACE_SLOTS - 1)) {
+        const leveltrace_block * b = &t->blocks[t->slots[i] - 1];
+        if (b->file == file && b->index == index)
+            return t->slots[i] - 1;
+    }
+    return -1;
+}
+
+// Not in the trace yet, and it isn't full
+static void block_add(leveltrace * t, uint16_t file, uint32_t index,
+                      uint8_t misses) {
+    uint32_t i = block_slot(file, index);
+    while (t->slots[i])
+        i = (i + 1) & (LEVELTRACE_SLOTS - 1);
+
+    leveltrace_block * b = &t->blocks[t->block_count++];
+    b->file = file;
+    b->misses = misses;
+    b->pad = 0;
+    b->index = index;
+    t->slots[i] = t->block_count;
+}
+
+bool leveltrace_full(const leveltrace * t) {
+    return t->block_count == LEVELTRACE_MAX_BLOCKS;
+}
+
+uint32_t leveltrace_record(leveltrace * t, uint16_t file, int64_t offset,
+                           uint32_t len) {
+    if (offset < 0 || len == 0 || file >= t->file_count)
+        return 0;
+
+    uint32_t first = (uint32_t)(offset / LEVELTRACE_BLOCK_SIZE);
+    uint32_t last = (uint32_t)((offset + len - 1) / LEVELTRACE_BLOCK_SIZE);
+    uint32_t added = 0;
+
+    for (uint32_t index = first; index <= last; index++) {
+        if (leveltrace_find(t, file, index) >= 0)
+            continue;
+        if (leveltrace_full(t))
+            break;
+        block_add(t, file, index, 0);
+        added++;
+    }
+    return added;
+}
+
+// Copies a block of `src` over to `dst`, which must not have it yet
+static void block_copy(leveltrace * dst, const leveltrace * src,
+                       const leveltrace_block * b, uint8_t misses) {
+    int file = leveltrace_file_add(dst, src->files[b->file]);
+    if (file >= 0 && !leveltrace_full(dst))
+        block_add(dst, (uint16_t)file, b->index, misses);
+}
+
+leveltrace * leveltrace_merge(const leveltrace * old, const leveltrace * run) {
+    leveltrace * t = leveltrace_new(run->key);
+    if (!t)
+        return NULL;
+
+    if (!old) {
+        for (uint32_t i = 0; i < run->block_count; i++)
+            block_copy(t, run, &run->blocks[i], 0);
+        return t;
+    }
+
+    /*
+     * Every block only in `old` is anchored after the position in `run` of
+     * the closest block before it that's in both (0 for the front), then
+     * they're bucketed by anchor, keeping their old order.
+     */
+    uint16_t anchors[LEVELTRACE_MAX_BLOCKS];
+    uint16_t stale[LEVELTRACE_MAX_BLOCKS];
+    uint16_t starts[LEVELTRACE_MAX_BLOCKS + 2];
+    uint32_t stale_count = 0;
+    uint32_t room = LEVELTRACE_MAX_BLOCKS - run->block_count;
+    uint16_t anchor = 0;
+
+    memset(starts, 0, sizeof(starts));
+    for (uint32_t i = 0; i < old->block_count; i++) {
+        const leveltrace_block * b = &old->blocks[i];
+        int file = file_find(run, old->files[b->file],
+                             old->file_hashes[b->file]);
+        int pos = file >= 0 ? leveltrace_find(run, (uint16_t)file, b->index) : -1;
+
+        if (pos >= 0) {
+            anchor = (uint16_t)(pos + 1);
+        } else if (b->misses + 1 < LEVELTRACE_MAX_MISSES
+                   && stale_count < room) {
+            anchors[stale_count] = anchor;
+            stale[stale_count++] = (uint16_t)i;
+            starts[anchor + 1]++;
+        }
+    }
+    for (uint32_t a = 1; a <= (uint32_t)run->block_count + 1; a++)
+        starts[a] += starts[a - 1];
+
+    uint16_t order[LEVELTRACE_MAX_BLOCKS];
+    for (uint32_t i = 0; i < stale_count; i++)
+        order[starts[anchors[i]]++] = stale[i];
+
+    // starts[a] is now where bucket a ends
+    uint32_t next = 0;
+    for (uint32_t a = 0; a <= run->block_count; a++) {
+        if (a > 0)
+            block_copy(t, run, &run->blocks[a - 1], 0);
+        for (; next < starts[a]; next++) {
+            const leveltrace_block * b = &old->blocks[order[next]];
+            block_copy(t, old, b, b->misses + 1);
+        }
+    }
+    return t;
+}
+
+leveltrace * leveltrace_set_get(const leveltrace_set * set, uint32_t key) {
+    for (uint32_t i = 0; i < set->count; i++) {
+        if (set->traces[i]->key == key)
+            return set->traces[i];
+    }
+    return NULL;
+}
+
+void leveltrace_set_put(leveltrace_set * set, leveltrace * t) {
+    t->last_run = ++set->runs;
+
+    uint32_t slot = set->count;
+    for (uint32_t i = 0; i < set->count; i++) {
+        if (set->traces[i]->key == t->key) {
+            slot = i;
+            break;
+        }
+    }
+
+    if (slot == LEVELTRACE_MAX_LEVELS) {
+        slot = 0;
+        for (uint32_t i = 1; i < set->count; i++) {
+            if (set->traces[i]->last_run < set->traces[slot]->last_run)
+                slot = i;
+        }
+    }
+
+    if (slot < set->count) {
+        if (set->traces[slot] != t)
+            leveltrace_free(set->traces[slot]);
+    } else {
+        set->count++;
+    }
+    set->traces[slot] = t;
+}
+
+void leveltrace_set_clear(leveltrace_set * set) {
+    for (uint32_t i = 0; i < set->count; i++)
+        leveltrace_free(set->traces[i]);
+    set->count = 0;
+    set->runs = 0;
+}
+
+static inline uint8_t * put(uint8_t * p, const void * v, size_t len) {
+    memcpy(p, v, len);
+    return p + len;
+}
+
+uint8_t * leveltrace_set_save(const leveltrace_set * set, size_t * len) {
+    size_t size = LEVELTRACE_HEADER;
+    for (uint32_t i = 0; i < set->count; i++) {
+        const leveltrace * t = set->traces[i];
+        size += 12 + t->block_count * 8;
+        for (uint32_t f = 0; f < t->file_count; f++)
+            size += 2 + strlen(t->files[f]);
+    }
+
+    uint8_t * out = malloc(size);
+    if (!out)
+        return NULL;
+
+    uint32_t version = LEVELTRACE_VERSION;
+    uint8_t * p = put(out, LEVELTRACE_MAGIC, 4);
+    p = put(p, &version, 4);
+    p = put(p, &set->runs, 4);
+    p = put(p, &set->count, 4);
+
+    for (uint32_t i = 0; i < set->count; i++) {
+        const leveltrace * t = set->traces[i];
+        p = put(p, &t->key, 4);
+        p = put(p, &t->last_run, 4);
+        p = put(p, &t->file_count, 2);
+        p = put(p, &t->block_count, 2);
+        for (uint32_t f = 0; f < t->file_count; f++) {
+            uint16_t path_len = (uint16_t)strlen(t->files[f]);
+            p = put(p, &path_len, 2);
+            p = put(p, t->files[f], path_len);
+        }
+        for (uint32_t b = 0; b < t->block_count; b++)
+            p = put(p, &t->blocks[b], 8);
+    }
+
+    *len = size;
+    return out;
+}
+
+typedef struct reader {
+    const uint8_t * p;
+    const uint8_t * end;
+} reader;
+
+static inline bool get(reader * r, void * v, size_t len) {
+    if ((size_t)(r->end - r->p) < len)
+        return false;
+    memcpy(v, r->p, len);
+    r->p += len;
+    return true;
+}
+
+static leveltrace * load_trace(reader * r) {
+    uint32_t key, last_run;
+    uint16_t file_count, block_count;
+    if (!get(r, &key, 4) || !get(r, &last_run, 4) || !get(r, &file_count, 2)
+        || !get(r, &block_count, 2) || file_count > LEVELTRACE_MAX_FILES
+        || block_count > LEVELTRACE_MAX_BLOCKS)
+        return NULL;
+
+    leveltrace * t = leveltrace_new(key);
+    if (!t)
+        return NULL;
+    t->last_run = last_run;
+
+    for (uint32_t f = 0; f < file_count; f++) {
+        uint16_t path_len;
+        if (!get(r, &path_len, 2) || path_len == 0
+            || path_len >= LEVELTRACE_PATH_MAX
+            || (size_t)(r->end - r->p) < path_len) {
+            leveltrace_free(t);
+            return NULL;
+        }
+
+        char path[LEVELTRACE_PATH_MAX];
+        memcpy(path, r->p, path_len);
+        path[path_len] = '\0';
+        r->p += path_len;
+        if (file_add(t, path, path_len, leveltrace_hash(path)) < 0) {
+            leveltrace_free(t);
+            return NULL;
+        }
+    }
+
+    for (uint32_t i = 0; i < block_count; i++) {
+        leveltrace_block b;
+        if (!get(r, &b, 8) || b.file >= file_count
+            || leveltrace_find(t, b.file, b.index) >= 0) {
+            leveltrace_free(t);
+            return NULL;
+        }
+        block_add(t, b.file, b.index, b.misses);
+    }
+    return t;
+}
+
+bool leveltrace_set_load(leveltrace_set * set, const uint8_t * data,
+                         size_t len) {
+    leveltrace_set_clear(set);
+
+    reader r = { data, data + len };
+    char magic[4];
+    uint32_t version, runs, count;
+    if (!get(&r, magic, 4) || memcmp(magic, LEVELTRACE_MAGIC, 4) != 0
+        || !get(&r, &version, 4) || version != LEVELTRACE_VERSION
+        || !get(&r, &runs, 4) || !get(&r, &count, 4)
+        || count > LEVELTRACE_MAX_LEVELS)
+        return false;
+
+    for (uint32_t i = 0; i < count; i++) {
+        leveltrace * t = load_trace(&r);
+        if (!t || leveltrace_set_get(set, t->key)) {
+            leveltrace_free(t);
+            leveltrace_set_clear(set);
+            return false;
+        }
+        set->traces[set->count++] = t;
+    }
+
+    if (r.p != r.end) {
+        leveltrace_set_clear(set);
+        return false;
+    }
+    set->runs = runs;
+    return true;
+}
+
+static inline bool bit_get(const uint32_t * bits, uint32_t i) {
+    return bits[i >> 5] & (1u << (i & 31));
+}
+
+static inline void bit_set(uint32_t * bits, uint32_t i) {
+    bits[i >> 5] |= 1u << (i & 31);
+}
+
+void leveltrace_sched_start(leveltrace_sched * s, const leveltrace * t,
+                            uint32_t ahead) {
+    memset(s, 0, sizeof(*s));
+    s->trace = t;
+    s->ahead = ahead < LEVELTRACE_AHEAD ? ahead : LEVELTRACE_AHEAD;
+}
+
+// Marks a position done, returning its block to the read-ahead budget
+static void sched_done(leveltrace_sched * s, uint32_t pos) {
+    if (bit_get(s->done, pos))
+        return;
+    bit_set(s->done, pos);
+    if (bit_get(s->sent, pos))
+        s->outstanding--;
+}
+
+void leveltrace_sched_read(leveltrace_sched * s, uint16_t file,
+                           int64_t offset, uint32_t len) {
+    if (!s->trace || offset < 0 || len == 0)
+        return;
+
+    uint32_t first = (uint32_t)(offset / LEVELTRACE_BLOCK_SIZE);
+    uint32_t last = (uint32_t)((offset + len - 1) / LEVELTRACE_BLOCK_SIZE);
+    for (uint32_t index = first; index <= last; index++) {
+        int pos = leveltrace_find(s->trace, file, index);
+        if (pos < 0)
+            continue;
+
+        sched_done(s, pos);
+        if ((uint32_t)pos >= s->progress)
+            s->progress = pos + 1;
+    }
+
+    /*
+     * What the game is well past already either isn't needed this time or
+     * would only compete with it; fetched or not, it's written off.
+     */
+    for (; s->retired + LEVELTRACE_BEHIND < s->progress; s->retired++)
+        sched_done(s, s->retired);
+}
+
+leveltrace_next leveltrace_sched_next(leveltrace_sched * s,
+                                      leveltrace_run * run) {
+    const leveltrace * t = s->trace;
+    if (!t)
+        return LEVELTRACE_DONE;
+
+    while (s->next < t->block_count && bit_get(s->done, s->next))
+        s->next++;
+    if (s->next >= t->block_count)
+        return LEVELTRACE_DONE;
+    if (s->outstanding >= s->ahead)
+        return LEVELTRACE_WAIT;
+
+    const leveltrace_block * b = &t->blocks[s->next];
+    run->file = b->file;
+    run->index = b->index;
+    run->count = 0;
+
+    // Blocks that follow each other in the file as well go out together
+    while (s->next < t->block_count && run->count < LEVELTRACE_RUN_BLOCKS
+           && s->outstanding < s->ahead) {
+        b = &t->blocks[s->next];
+        if (bit_get(s->done, s->next) || b->file != run->file
+            || b->index != run->index + run->count)
+            break;
+
+        bit_set(s->sent, s->next);
+        s->outstanding++;
+        s->next++;
+        run->count++;
+    }
+    return LEVELTRACE_RUN;
+}
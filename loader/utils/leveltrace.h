@@ -0,0 +1,153 @@
+/*
+ * utils/leveltrace.h
+ *
+ * Per-level traces of the data read while a level loads, merged across runs
+ * and replayed ahead of the game to warm the block cache.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_LEVELTRACE_H
+#define SOLOADER_LEVELTRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "utils/blockcache.h"
+
+// Anything finer than a cache block is cached the same
+#define LEVELTRACE_BLOCK_SIZE  BLOCKCACHE_BLOCK_SIZE
+
+#define LEVELTRACE_MAX_BLOCKS  384
+#define LEVELTRACE_MAX_FILES   256
+#define LEVELTRACE_MAX_LEVELS  64
+#define LEVELTRACE_SLOTS       1024 // power of two, over twice the blocks
+
+// Runs in a row a block may go unread before it's dropped from its trace
+#define LEVELTRACE_MAX_MISSES  3
+
+// Most blocks fetched and not read by the game yet, with a cache big enough
+#define LEVELTRACE_AHEAD       256
+
+// Blocks this far behind the furthest one the game read are given up on
+#define LEVELTRACE_BEHIND      16
+
+// Most blocks handed out at once
+#define LEVELTRACE_RUN_BLOCKS  4
+
+typedef struct leveltrace_block {
+    uint16_t file;
+    uint8_t misses;
+    uint8_t pad;
+    uint32_t index;     // offset / LEVELTRACE_BLOCK_SIZE
+} leveltrace_block;
+
+typedef struct leveltrace {
+    uint32_t key;       // hash of the first path opened in the level
+    uint32_t last_run;  // set stamp of the run that last updated it
+
+    uint16_t file_count;
+    uint16_t block_count;
+    char * files[LEVELTRACE_MAX_FILES];
+    uint32_t file_hashes[LEVELTRACE_MAX_FILES];
+
+    // In the order the game first read them
+    leveltrace_block blocks[LEVELTRACE_MAX_BLOCKS];
+
+    // Position + 1 of each block by (file, index); 0 for an empty slot
+    uint16_t slots[LEVELTRACE_SLOTS];
+} leveltrace;
+
+typedef struct leveltrace_set {
+    uint32_t runs;
+    uint32_t count;
+    leveltrace * traces[LEVELTRACE_MAX_LEVELS];
+} leveltrace_set;
+
+typedef enum leveltrace_next {
+    LEVELTRACE_RUN,     // fetch what was handed out
+    LEVELTRACE_WAIT,    // far enough ahead, wait for the game to catch up
+    LEVELTRACE_DONE,
+} leveltrace_next;
+
+typedef struct leveltrace_run {
+    uint16_t file;
+    uint32_t index;
+    uint32_t count;
+} leveltrace_run;
+
+typedef struct leveltrace_sched {
+    const leveltrace * trace;
+    uint32_t next;        // first position not handed out or skipped yet
+    uint32_t progress;    // one past the furthest position the game read
+    uint32_t retired;     // positions below are done, read or not
+    uint32_t outstanding; // handed out and not done yet
+    uint32_t ahead;       // most outstanding at once
+    uint32_t done[(LEVELTRACE_MAX_BLOCKS + 31) / 32]; // read, or given up on
+    uint32_t sent[(LEVELTRACE_MAX_BLOCKS + 31) / 32];
+} leveltrace_sched;
+
+uint32_t leveltrace_hash(const char * path);
+
+// NULL if out of memory
+leveltrace * leveltrace_new(uint32_t key);
+void leveltrace_free(leveltrace * t);
+
+// Index of `path` in the file table, -1 if it isn't there
+int leveltrace_file(const leveltrace * t, const char * path);
+
+// Same, adding `path` if needed; -1 if the table is full
+int leveltrace_file_add(leveltrace * t, const char * path);
+
+// Position of the block, -1 if it isn't in the trace
+int leveltrace_find(const leveltrace * t, uint16_t file, uint32_t index);
+
+/*
+ * Appends the blocks covering `len` bytes at `offset` of `file` that aren't
+ * in the trace yet. Returns how many were new; fewer once the trace is full.
+ */
+uint32_t leveltrace_record(leveltrace * t, uint16_t file, int64_t offset,
+                           uint32_t len);
+
+bool leveltrace_full(const leveltrace * t);
+
+/*
+ * Combines what a level read this time (`run`) with what it read before
+ * (`old`, may be NULL). The order of `run` wins; blocks only in `old` keep
+ * their place after the block they used to follow, until they have been
+ * missed LEVELTRACE_MAX_MISSES times. NULL if out of memory.
+ */
+leveltrace * leveltrace_merge(const leveltrace * old, const leveltrace * run);
+
+leveltrace * leveltrace_set_get(const leveltrace_set * set, uint32_t key);
+
+// Takes `t` over, replacing the trace with its key or the least recent one
+void leveltrace_set_put(leveltrace_set * set, leveltrace * t);
+
+void leveltrace_set_clear(leveltrace_set * set);
+
+/*
+ * Serializes the set into a malloc'd buffer, NULL if out of memory.
+ * Loading replaces the contents; false if `data` is damaged, leaving the
+ * set empty.
+ */
+uint8_t * leveltrace_set_save(const leveltrace_set * set, size_t * len);
+bool leveltrace_set_load(leveltrace_set * set, const uint8_t * data,
+                         size_t len);
+
+// Keeps at most `ahead` blocks (up to LEVELTRACE_AHEAD) outstanding
+void leveltrace_sched_start(leveltrace_sched * s, const leveltrace * t,
+                            uint32_t ahead);
+
+// The game read `len` bytes at `offset` of `file` (an index in the trace)
+void leveltrace_sched_read(leveltrace_sched * s, uint16_t file,
+                           int64_t offset, uint32_t len);
+
+leveltrace_next leveltrace_sched_next(leveltrace_sched * s,
+                                      leveltrace_run * run);
+
+#endif // SOLOADER_LEVELTRACE_H
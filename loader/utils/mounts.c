@@ -0,0 +1,250 @@
+/*
+ * utils/mounts.c
+ *
+ * Translation of the paths the game uses on Android to paths on the Vita.
+ *
+ * Paths are normalized first (repeated slashes, "." and ".." segments), so
+ * that "/sdcard//Android/./data" matches the same mount as
+ * "/sdcard/Android/data", then the longest mount prefix that ends on a
+ * segment boundary is replaced with its root. The game opens the same few
+ * hundred files over and over, so results are kept in a direct-mapped cache
+ * keyed by the untouched path.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "utils/mounts.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <psp2/kernel/threadmgr.h>
+
+#include "utils/logger.h"
+
+#define MOUNTS_MAX          8
+#define MOUNTS_CACHE_SIZE   512 // power of two
+#define MOUNTS_PATH_MAX     1024
+
+typedef struct mount {
+    char * prefix; // normalized, no trailing slash unless it's "/"
+    size_t prefix_len;
+    char * root;
+    size_t root_len;
+} mount;
+
+typedef struct cached_path {
+    uint32_t hash;
+    char * path;
+    char * real;
+} cached_path;
+
+// Longest prefix first
+static mount s_mounts[MOUNTS_MAX];
+static int s_mount_count;
+
+static cached_path s_cache[MOUNTS_CACHE_SIZE];
+static SceKernelLwMutexWork s_cache_lock;
+static bool s_cache_lock_ready;
+
+static uint32_t path_hash(const char * path) {
+    uint32_t h = 0x811C9DC5u;
+    while (*path) {
+        h ^= (uint8_t)*path++;
+        h *= 0x01000193u;
+    }
+    return h;
+}
+
+static bool has_device(const char * path) {
+    const char * colon = strchr(path, ':');
+    const char * slash = strchr(path, '/');
+    return colon && (!slash || colon < slash);
+}
+
+/*
+ * Normalized `path` into `out`, returns its length or -1 if it doesn't fit.
+ * Paths without a device become absolute; ".." stops at the root.
+ */
+static int normalize(const char * path, char * out, size_t size) {
+    const char * p = path;
+    size_t n = 0;
+
+    if (has_device(path)) {
+        size_t len = strchr(path, ':') - path + 1;
+        if (path[len] == '/')
+            len++;
+        if (len >= size)
+            return -1;
+        memcpy(out, path, len);
+        n = len;
+        p += len;
+    } else {
+        if (size < 2)
+            return -1;
+        out[n++] = '/';
+    }
+
+    size_t base = n;
+    while (*p) {
+        while (*p == '/')
+            p++;
+        if (!*p)
+            break;
+
+        const char * seg = p;
+        while (*p && *p != '/')
+            p++;
+        size_t len = p - seg;
+
+        if (len == 1 && seg[0] == '.')
+            continue;
+
+        if (len == 2 && seg[0] == '.' && seg[1] == '.') {
+            while (n > base && out[n - 1] != '/')
+                n--;
+            if (n > base)
+                n--;
+            continue;
+        }
+
+        if (n + 1 + len >= size)
+            return -1;
+        if (n > base)
+            out[n++] = '/';
+        memcpy(out + n, seg, len);
+        n += len;
+    }
+
+    out[n] = '\0';
+    return (int)n;
+}
+
+static bool translate(const char * path, char * out, size_t size) {
+    char norm[MOUNTS_PATH_MAX];
+    int len = normalize(path, norm, sizeof(norm));
+    if (len < 0)
+        return false;
+
+    if (norm[0] == '/') {
+        for (int i = 0; i < s_mount_count; i++) {
+            const mount * m = &s_mounts[i];
+            if (strncmp(norm, m->prefix, m->prefix_len) != 0)
+                continue;
+
+            const char * rest = norm + m->prefix_len;
+            if (m->prefix_len > 1 && *rest != '/' && *rest != '\0')
+                continue;
+            while (*rest == '/')
+                rest++;
+
+            size_t rest_len = len - (rest - norm);
+            bool sep = rest_len && m->root_len && m->root[m->root_len - 1] != '/';
+            if (m->root_len + sep + rest_len >= size)
+                return false;
+
+            memcpy(out, m->root, m->root_len);
+            if (sep)
+                out[m->root_len] = '/';
+            memcpy(out + m->root_len + sep, rest, rest_len + 1);
+            return true;
+        }
+    }
+
+    if ((size_t)len >= size)
+        return false;
+    memcpy(out, norm, len + 1);
+    return true;
+}
+
+static void cache_clear(void) {
+    for (int i = 0; i < MOUNTS_CACHE_SIZE; i++) {
+        free(s_cache[i].path);
+        free(s_cache[i].real);
+        s_cache[i].path = NULL;
+        s_cache[i].real = NULL;
+    }
+}
+
+bool mounts_add(const char * prefix, const char * root) {
+    if (s_mount_count == MOUNTS_MAX)
+        return false;
+
+    if (!s_cache_lock_ready) {
+        if (sceKernelCreateLwMutex(&s_cache_lock, "mounts_lock", 0, 0, NULL) < 0)
+            return false;
+        s_cache_lock_ready = true;
+    }
+
+    char norm[MOUNTS_PATH_MAX];
+    if (has_device(prefix) || normalize(prefix, norm, sizeof(norm)) < 0)
+        return false;
+
+    mount m;
+    m.prefix = strdup(norm);
+    m.prefix_len = strlen(norm);
+    m.root = strdup(root);
+    m.root_len = strlen(root);
+    if (!m.prefix || !m.root) {
+        free(m.prefix);
+        free(m.root);
+        return false;
+    }
+
+    int i = s_mount_count++;
+    while (i > 0 && s_mounts[i - 1].prefix_len < m.prefix_len) {
+        s_mounts[i] = s_mounts[i - 1];
+        i--;
+    }
+    s_mounts[i] = m;
+
+    sceKernelLockLwMutex(&s_cache_lock, 1, NULL);
+    cache_clear();
+    sceKernelUnlockLwMutex(&s_cache_lock, 1);
+
+    logv_info("[mounts] %s -> %s", m.prefix, root);
+    return true;
+}
+
+bool mounts_translate(const char * path, char * out, size_t size) {
+    if (!s_cache_lock_ready)
+        return translate(path, out, size);
+
+    uint32_t hash = path_hash(path);
+    cached_path * c = &s_cache[hash & (MOUNTS_CACHE_SIZE - 1)];
+
+    sceKernelLockLwMutex(&s_cache_lock, 1, NULL);
+    if (c->path && c->hash == hash && strcmp(c->path, path) == 0) {
+        size_t len = strlen(c->real);
+        bool fits = len < size;
+        if (fits)
+            memcpy(out, c->real, len + 1);
+        sceKernelUnlockLwMutex(&s_cache_lock, 1);
+        return fits;
+    }
+    sceKernelUnlockLwMutex(&s_cache_lock, 1);
+
+    if (!translate(path, out, size))
+        return false;
+
+    char * path_copy = strdup(path);
+    char * real_copy = strdup(out);
+    if (!path_copy || !real_copy) {
+        free(path_copy);
+        free(real_copy);
+        return true;
+    }
+
+    sceKernelLockLwMutex(&s_cache_lock, 1, NULL);
+    free(c->path);
+    free(c->real);
+    c->hash = hash;
+    c->path = path_copy;
+    c->real = real_copy;
+    sceKernelUnlockLwMutex(&s_cache_lock, 1);
+    return true;
+}
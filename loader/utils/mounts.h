@@ -0,0 +1,28 @@
+/*
+ * utils/mounts.h
+ *
+ * Translation of the paths the game uses on Android to paths on the Vita.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_MOUNTS_H
+#define SOLOADER_MOUNTS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Serve the Android path `prefix` (e.g. "/sdcard") from `root`
+ * (e.g. "ux0:data/backstab/"). The longest matching prefix wins. Relative
+ * paths are relative to "/", paths with a device ("ux0:...") are left as is.
+ */
+bool mounts_add(const char * prefix, const char * root);
+
+// Real path of `path` into `out`; false if it doesn't fit
+bool mounts_translate(const char * path, char * out, size_t size);
+
+#endif // SOLOADER_MOUNTS_H
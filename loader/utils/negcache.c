@@ -0,0 +1,154 @@
+/*
+ * utils/negcache.c
+ *
+ * Cache of paths known not to exist.
+ *
+ * The game probes lots of optional files (localized variants, patches,
+ * configs) that aren't there, and does so again every time it loads
+ * something. Each of those probes is a round-trip to the memory card. The
+ * I/O shims record confirmed misses here and check them first, so a repeated
+ * probe only costs a hash lookup. Whatever our shims create or rename drops
+ * the affected entries.
+ *
+ * Entries keep the whole path, so a hash collision can't hide a file that
+ * exists. The table is direct-mapped: a colliding path just evicts the
+ * older one.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "utils/negcache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <psp2/kernel/threadmgr.h>
+
+#include "utils/logger.h"
+
+#define NEGCACHE_SIZE 2048 // power of two
+
+typedef struct negcache_entry {
+    uint32_t hash;
+    char * path;
+} negcache_entry;
+
+static negcache_entry s_entries[NEGCACHE_SIZE];
+static SceKernelLwMutexWork s_lock;
+static bool s_ready;
+static negcache_stats s_stats;
+
+static uint32_t path_hash(const char * path) {
+    uint32_t h = 0x811C9DC5u;
+    while (*path) {
+        h ^= (uint8_t)*path++;
+        h *= 0x01000193u;
+    }
+    return h;
+}
+
+static inline negcache_entry * slot(uint32_t hash) {
+    return &s_entries[hash & (NEGCACHE_SIZE - 1)];
+}
+
+static inline bool matches(const negcache_entry * e, uint32_t hash,
+                           const char * path) {
+    return e->path && e->hash == hash && strcmp(e->path, path) == 0;
+}
+
+static void evict(negcache_entry * e) {
+    if (e->path) {
+        free(e->path);
+        e->path = NULL;
+        s_stats.entries--;
+    }
+}
+
+void negcache_init(void) {
+    if (s_ready)
+        return;
+
+    if (sceKernelCreateLwMutex(&s_lock, "negcache_lock", 0, 0, NULL) < 0) {
+        log_error("[negcache] could not create the lock; disabled");
+        return;
+    }
+    s_ready = true;
+}
+
+bool negcache_missing(const char * path) {
+    if (!s_ready)
+        return false;
+
+    uint32_t hash = path_hash(path);
+    negcache_entry * e = slot(hash);
+
+    sceKernelLockLwMutex(&s_lock, 1, NULL);
+    bool missing = matches(e, hash, path);
+    if (missing)
+        s_stats.hits++;
+    else
+        s_stats.misses++;
+    uint32_t hits = s_stats.hits;
+    sceKernelUnlockLwMutex(&s_lock, 1);
+
+    if (missing && (hits & 1023) == 0) {
+        logv_debug("[negcache] %u probes of missing files skipped, %u entries",
+                   hits, s_stats.entries);
+    }
+    return missing;
+}
+
+void negcache_add(const char * path) {
+    if (!s_ready)
+        return;
+
+    uint32_t hash = path_hash(path);
+    char * copy = strdup(path);
+    if (!copy)
+        return;
+
+    sceKernelLockLwMutex(&s_lock, 1, NULL);
+    negcache_entry * e = slot(hash);
+    evict(e);
+    e->hash = hash;
+    e->path = copy;
+    s_stats.entries++;
+    sceKernelUnlockLwMutex(&s_lock, 1);
+}
+
+void negcache_forget(const char * path) {
+    if (!s_ready)
+        return;
+
+    uint32_t hash = path_hash(path);
+    negcache_entry * e = slot(hash);
+
+    sceKernelLockLwMutex(&s_lock, 1, NULL);
+    if (matches(e, hash, path))
+        evict(e);
+    sceKernelUnlockLwMutex(&s_lock, 1);
+}
+
+void negcache_clear(void) {
+    if (!s_ready)
+        return;
+
+    sceKernelLockLwMutex(&s_lock, 1, NULL);
+    for (int i = 0; i < NEGCACHE_SIZE; i++)
+        evict(&s_entries[i]);
+    sceKernelUnlockLwMutex(&s_lock, 1);
+}
+
+void negcache_get_stats(negcache_stats * stats) {
+    if (!s_ready) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    sceKernelLockLwMutex(&s_lock, 1, NULL);
+    *stats = s_stats;
+    sceKernelUnlockLwMutex(&s_lock, 1);
+}
@@ -0,0 +1,40 @@
+/*
+ * utils/negcache.h
+ *
+ * Cache of paths known not to exist.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_NEGCACHE_H
+#define SOLOADER_NEGCACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct negcache_stats {
+    uint32_t hits;      // lookups answered without touching the storage
+    uint32_t misses;    // lookups that had to go to the storage
+    uint32_t entries;
+} negcache_stats;
+
+void negcache_init(void);
+
+// Whether `path` (a real path) is known not to exist
+bool negcache_missing(const char * path);
+
+// `path` was just found not to exist
+void negcache_add(const char * path);
+
+// `path` may exist now
+void negcache_forget(const char * path);
+
+// Anything may exist now, e.g. after a directory was renamed
+void negcache_clear(void);
+
+void negcache_get_stats(negcache_stats * stats);
+
+#endif // SOLOADER_NEGCACHE_H
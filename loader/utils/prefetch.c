@@ -0,0 +1,362 @@
+/*
+ * utils/prefetch.c
+ *
+ * Learns what each level reads while it loads and, on later loads of the
+ * same level, reads it ahead into the block cache.
+ *
+ * A level starts when the game's current CLevel changes to a new one, as
+ * seen on every open and every frame. From then on the blocks it reads are
+ * recorded (see leveltrace.c) until PREFETCH_SETTLE_FRAMES frames go by
+ * without a new one, or the level changes again. Levels are told apart by
+ * the first file opened after they start; what they read through the block
+ * cache is merged into DATA_PATH"prefetch.bin".
+ *
+ * When a level with a trace starts, the prefetch thread reads its blocks
+ * into the block cache at the lowest priority, in the recorded order and
+ * never further ahead of the game than half the cache; files that aren't
+ * on the card come from the .apk, see zipvfs_prefetch(). How well the
+ * cache did is logged once the level has loaded.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "utils/prefetch.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <psp2/io/fcntl.h>
+#include <psp2/kernel/threadmgr.h>
+
+#include "utils/atomicfile.h"
+#include "utils/blockcache.h"
+#include "utils/leveltrace.h"
+#include "utils/logger.h"
+#include "utils/zipvfs.h"
+
+#define PREFETCH_PATH          DATA_PATH"prefetch.bin"
+#define PREFETCH_HANDLES       256 // power of two
+#define PREFETCH_SETTLE_FRAMES 90
+#define PREFETCH_PRIORITY      191 // lowest a user thread can have
+#define PREFETCH_PATH_MAX      1024
+#define PREFETCH_STACK_SIZE    (16 * 1024)
+
+typedef struct prefetch_handle {
+    uintptr_t handle;
+    char * path;
+    uint32_t gen;           // the indices below are for this s_gen
+    int16_t run_file;       // in s_run, -1 if not in it
+    int16_t sched_file;     // in the trace being prefetched, -1 if not in it
+} prefetch_handle;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_wake = PTHREAD_COND_INITIALIZER;
+static bool s_ready;
+static volatile bool s_tracking;
+
+static prefetch_level_fn s_level_fn;
+static uintptr_t s_level;
+static uint32_t s_gen = 1; // bumped whenever s_run or the schedule change
+
+static leveltrace_set s_set;
+static leveltrace * s_run;  // being recorded; its key is 0 until known
+static uint32_t s_new_blocks;
+static uint32_t s_quiet_frames;
+static leveltrace_sched s_sched;
+static bool s_save;
+
+static prefetch_handle s_handles[PREFETCH_HANDLES];
+
+// Owned by the prefetch thread
+static char s_open_path[PREFETCH_PATH_MAX];
+static uint32_t s_open_file;
+static SceUID s_fd = -1;
+
+static inline prefetch_handle * handle_slot(uintptr_t handle) {
+    return &s_handles[(handle ^ (handle >> 8)) & (PREFETCH_HANDLES - 1)];
+}
+
+// With the lock held
+static void changed(void) {
+    s_gen++;
+    s_tracking = s_run || s_sched.trace;
+}
+
+// With the lock held; the cache keeps half for what the game reads meanwhile
+static void sched_start(const leveltrace * t) {
+    blockcache_stats stats;
+    blockcache_get_stats(&stats);
+    leveltrace_sched_start(&s_sched, t, stats.capacity / 2);
+}
+
+static void log_stats(void) {
+    blockcache_stats st;
+    blockcache_get_stats(&st);
+
+    uint64_t uses = st.hits + st.misses;
+    logv_info("[prefetch] cache: %u%% of %llu blocks hit, %llu MB saved, "
+              "%u/%u prefetched blocks used, %u/%u resident",
+              uses ? (unsigned)(st.hits * 100 / uses) : 0,
+              (unsigned long long)uses,
+              (unsigned long long)(st.bytes_saved >> 20),
+              (unsigned)st.prefetch_hits, (unsigned)st.prefetched,
+              st.resident, st.capacity);
+}
+
+// With the lock held; learns what the level read and stops recording
+static void finish_run(void) {
+    if (!s_run)
+        return;
+
+    if (s_run->key && s_run->block_count) {
+        leveltrace * old = leveltrace_set_get(&s_set, s_run->key);
+        leveltrace * merged = leveltrace_merge(old, s_run);
+        if (merged) {
+            if (old && s_sched.trace == old)
+                sched_start(NULL);
+            leveltrace_set_put(&s_set, merged);
+            s_save = true;
+            pthread_cond_signal(&s_wake);
+            logv_info("[prefetch] level %08x read %u blocks, %u kept",
+                      s_run->key, s_run->block_count, merged->block_count);
+        }
+        log_stats();
+    }
+
+    leveltrace_free(s_run);
+    s_run = NULL;
+    changed();
+}
+
+// With the lock held
+static void check_level(void) {
+    uintptr_t level = s_level_fn();
+    if (level == s_level)
+        return;
+
+    finish_run();
+    sched_start(NULL);
+    s_level = level;
+    if (level) {
+        s_run = leveltrace_new(0);
+        s_new_blocks = 0;
+        s_quiet_frames = 0;
+    }
+    changed();
+}
+
+static void load(void) {
+    FILE * f = fopen(PREFETCH_PATH, "rb");
+    if (!f)
+        return;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t * data = malloc(size > 0 ? size : 1);
+    bool ok = data && fread(data, 1, size, f) == (size_t)size
+              && leveltrace_set_load(&s_set, data, size);
+    fclose(f);
+    free(data);
+
+    if (ok)
+        logv_info("[prefetch] %u levels known", s_set.count);
+    else
+        log_error("[prefetch] " PREFETCH_PATH " is damaged, starting over");
+}
+
+// A crash halfway leaves the old traces, not a damaged file
+static void save(const uint8_t * data, size_t len) {
+    if (!atomicfile_write(PREFETCH_PATH, data, len))
+        log_error("[prefetch] could not write " PREFETCH_PATH);
+}
+
+static void fetch(const char * path, const leveltrace_run * run) {
+    if (strcmp(path, s_open_path) != 0) {
+        if (s_fd >= 0)
+            sceIoClose(s_fd);
+        s_fd = sceIoOpen(path, SCE_O_RDONLY, 0);
+        s_open_file = blockcache_file(path);
+        strcpy(s_open_path, path);
+    }
+
+    int64_t offset = (int64_t)run->index * LEVELTRACE_BLOCK_SIZE;
+    uint32_t len = run->count * LEVELTRACE_BLOCK_SIZE;
+    if (s_fd >= 0)
+        blockcache_prefetch(s_open_file, s_fd, offset, len);
+    else
+        zipvfs_prefetch(path, offset, len);
+}
+
+static void * prefetch_thread(void * arg) {
+    sceKernelChangeThreadPriority(0, PREFETCH_PRIORITY);
+
+    pthread_mutex_lock(&s_lock);
+    for (;;) {
+        if (s_save) {
+            s_save = false;
+            size_t len;
+            uint8_t * data = leveltrace_set_save(&s_set, &len);
+            pthread_mutex_unlock(&s_lock);
+
+            if (data)
+                save(data, len);
+            free(data);
+
+            pthread_mutex_lock(&s_lock);
+            continue;
+        }
+
+        leveltrace_run run;
+        leveltrace_next next = leveltrace_sched_next(&s_sched, &run);
+        if (next == LEVELTRACE_RUN) {
+            char path[PREFETCH_PATH_MAX];
+            strcpy(path, s_sched.trace->files[run.file]);
+            pthread_mutex_unlock(&s_lock);
+
+            fetch(path, &run);
+
+            pthread_mutex_lock(&s_lock);
+            continue;
+        }
+
+        if (next == LEVELTRACE_DONE && s_fd >= 0) {
+            pthread_mutex_unlock(&s_lock);
+            sceIoClose(s_fd);
+            s_fd = -1;
+            s_open_path[0] = '\0';
+            pthread_mutex_lock(&s_lock);
+            continue;
+        }
+
+        pthread_cond_wait(&s_wake, &s_lock);
+    }
+    return arg;
+}
+
+void prefetch_init(prefetch_level_fn level) {
+    if (s_ready)
+        return;
+
+    load();
+    s_level_fn = level;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, PREFETCH_STACK_SIZE);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    pthread_t thread;
+    if (pthread_create(&thread, &attr, prefetch_thread, NULL) != 0) {
+        log_error("[prefetch] could not start the prefetch thread");
+        leveltrace_set_clear(&s_set);
+    } else {
+        s_ready = true;
+    }
+    pthread_attr_destroy(&attr);
+}
+
+void prefetch_opened(const char * path, uintptr_t handle, bool cached) {
+    if (!s_ready)
+        return;
+
+    char * copy = cached ? strdup(path) : NULL;
+
+    pthread_mutex_lock(&s_lock);
+    check_level();
+
+    if (s_run && !s_run->key) {
+        s_run->key = leveltrace_hash(path);
+        leveltrace * t = leveltrace_set_get(&s_set, s_run->key);
+        if (t) {
+            sched_start(t);
+            pthread_cond_signal(&s_wake);
+            logv_info("[prefetch] level %08x, prefetching %u blocks",
+                      t->key, t->block_count);
+        }
+        changed();
+    }
+
+    prefetch_handle * h = handle_slot(handle);
+    if (copy || h->handle == handle) {
+        free(h->path);
+        h->handle = copy ? handle : 0;
+        h->path = copy;
+        h->gen = 0;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+void prefetch_read(uintptr_t handle, int64_t offset, uint32_t len) {
+    if (!s_tracking || offset < 0 || len == 0)
+        return;
+
+    pthread_mutex_lock(&s_lock);
+    prefetch_handle * h = handle_slot(handle);
+    if (h->handle != handle || !h->path) {
+        pthread_mutex_unlock(&s_lock);
+        return;
+    }
+
+    if (h->gen != s_gen) {
+        h->gen = s_gen;
+        h->run_file = s_run ? leveltrace_file_add(s_run, h->path) : -1;
+        h->sched_file = s_sched.trace ? leveltrace_file(s_sched.trace, h->path)
+                                      : -1;
+    }
+
+    if (h->run_file >= 0 && s_run)
+        s_new_blocks += leveltrace_record(s_run, h->run_file, offset, len);
+
+    if (h->sched_file >= 0 && s_sched.trace) {
+        bool waiting = s_sched.outstanding >= s_sched.ahead;
+        leveltrace_sched_read(&s_sched, h->sched_file, offset, len);
+        if (waiting && s_sched.outstanding < s_sched.ahead)
+            pthread_cond_signal(&s_wake);
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+void prefetch_closed(uintptr_t handle) {
+    if (!s_ready)
+        return;
+
+    pthread_mutex_lock(&s_lock);
+    prefetch_handle * h = handle_slot(handle);
+    if (h->handle == handle) {
+        free(h->path);
+        h->path = NULL;
+        h->handle = 0;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+bool prefetch_tracking(void) {
+    return s_tracking;
+}
+
+void prefetch_frame(void) {
+    if (!s_ready)
+        return;
+
+    pthread_mutex_lock(&s_lock);
+    check_level();
+
+    // The level is done loading once it stops asking for anything new
+    if (s_run && s_run->key) {
+        s_quiet_frames = s_new_blocks ? 0 : s_quiet_frames + 1;
+        if (s_quiet_frames >= PREFETCH_SETTLE_FRAMES) {
+            finish_run();
+            sched_start(NULL);
+            changed();
+        }
+    }
+    s_new_blocks = 0;
+    pthread_mutex_unlock(&s_lock);
+}
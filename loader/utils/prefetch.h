@@ -0,0 +1,43 @@
+/*
+ * utils/prefetch.h
+ *
+ * Learns what each level reads while it loads and, on later loads of the
+ * same level, reads it ahead into the block cache.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_PREFETCH_H
+#define SOLOADER_PREFETCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The game's current level, 0 outside of levels
+typedef uintptr_t (*prefetch_level_fn)(void);
+
+// Loads what was learned so far and starts the prefetch thread
+void prefetch_init(prefetch_level_fn level);
+
+/*
+ * `path` (a real path) was opened for reading as `handle`. Only what is
+ * read through the block cache (`cached`) is learned; blocks prefetched for
+ * anything else would be read from the card a second time.
+ */
+void prefetch_opened(const char * path, uintptr_t handle, bool cached);
+
+// `len` bytes were read at `offset` through `handle`
+void prefetch_read(uintptr_t handle, int64_t offset, uint32_t len);
+
+void prefetch_closed(uintptr_t handle);
+
+// Whether prefetch_read() wants offsets right now; they may cost a seek
+bool prefetch_tracking(void);
+
+// Once per rendered frame
+void prefetch_frame(void);
+
+#endif // SOLOADER_PREFETCH_H
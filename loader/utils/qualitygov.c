@@ -0,0 +1,87 @@
+/*
+ * utils/qualitygov.c
+ *
+ * Frame time governor: nudges a quality value between two bounds to keep
+ * the measured frame time within a budget.
+ *
+ * Frame times are smoothed and judged once per window of frames. Quality
+ * goes down after a couple of windows over budget, and only comes back up
+ * after a longer run of windows with clear headroom, in smaller steps, so
+ * that the value doesn't oscillate around the point where the budget is
+ * just met. After every change a few windows are skipped while the new
+ * value takes effect. Nothing here depends on the platform, so it can be
+ * driven by a recorded frame time trace.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "utils/qualitygov.h"
+
+#define QUALITYGOV_WINDOW     30    // frames
+#define QUALITYGOV_SMOOTHING  0.125f
+#define QUALITYGOV_SPIKE      4.0f  // frame times are capped at this x budget
+#define QUALITYGOV_HEADROOM   0.80f // of the budget, needed to raise quality
+#define QUALITYGOV_OVER_RUN   2     // windows
+#define QUALITYGOV_UNDER_RUN  6     // windows
+#define QUALITYGOV_STEP_DOWN  0.10f
+#define QUALITYGOV_STEP_UP    0.05f
+#define QUALITYGOV_SETTLE     2     // windows
+
+void qualitygov_init(qualitygov * g, float target_fps, float min, float max) {
+    g->budget_ms = 1000.f / target_fps;
+    g->min = min;
+    g->max = max;
+    g->value = max;
+    g->avg_ms = g->budget_ms;
+    g->frames = 0;
+    g->streak = 0;
+    g->settle = 0;
+}
+
+bool qualitygov_frame(qualitygov * g, float frame_ms) {
+    // Loading screens and the like would drag the average for seconds
+    float cap = g->budget_ms * QUALITYGOV_SPIKE;
+    if (frame_ms > cap)
+        frame_ms = cap;
+    g->avg_ms += (frame_ms - g->avg_ms) * QUALITYGOV_SMOOTHING;
+
+    if (++g->frames < QUALITYGOV_WINDOW)
+        return false;
+    g->frames = 0;
+
+    if (g->settle) {
+        g->settle--;
+        return false;
+    }
+
+    if (g->avg_ms > g->budget_ms)
+        g->streak = g->streak > 0 ? g->streak + 1 : 1;
+    else if (g->avg_ms < g->budget_ms * QUALITYGOV_HEADROOM)
+        g->streak = g->streak < 0 ? g->streak - 1 : -1;
+    else
+        g->streak = 0;
+
+    float value = g->value;
+    if (g->streak >= QUALITYGOV_OVER_RUN)
+        value -= QUALITYGOV_STEP_DOWN;
+    else if (g->streak <= -QUALITYGOV_UNDER_RUN)
+        value += QUALITYGOV_STEP_UP;
+    else
+        return false;
+
+    if (value < g->min)
+        value = g->min;
+    if (value > g->max)
+        value = g->max;
+
+    g->streak = 0;
+    if (value == g->value)
+        return false;
+
+    g->value = value;
+    g->settle = QUALITYGOV_SETTLE;
+    return true;
+}
@@ -0,0 +1,39 @@
+/*
+ * utils/qualitygov.h
+ *
+ * Frame time governor: nudges a quality value between two bounds to keep
+ * the measured frame time within a budget.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_QUALITYGOV_H
+#define SOLOADER_QUALITYGOV_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct qualitygov {
+    float budget_ms; // frame time to hold
+    float min;
+    float max;
+    float value;     // current quality, higher costs more
+    float avg_ms;    // smoothed frame time
+    uint32_t frames; // in the current window
+    int32_t streak;  // windows over budget in a row (> 0) or under (< 0)
+    uint32_t settle; // windows to skip while the last change takes effect
+} qualitygov;
+
+// Starts at `max`, the quality the user asked for
+void qualitygov_init(qualitygov * g, float target_fps, float min, float max);
+
+/*
+ * Feed the time one frame took. Returns true when `value` has changed and
+ * should be applied.
+ */
+bool qualitygov_frame(qualitygov * g, float frame_ms);
+
+#endif // SOLOADER_QUALITYGOV_H
@@ -0,0 +1,469 @@
+/*
+ * utils/rastream.c
+ *
+ * Read-only file streams with large pooled buffers and read-ahead.
+ *
+ * The engine streams its assets with lots of small fread()s and fgetc()s.
+ * Through SceLibc each of those ends up as a small read from the memory
+ * card. Streams here read the file in RASTREAM_BUF_SIZE chunks instead,
+ * into buffers taken from one arena shared by all streams. Once a few reads
+ * in a row continue where the previous one stopped, the next chunk is read
+ * on the I/O thread while the game is still busy with the current one.
+ * Reads at least a buffer long skip the buffers and go straight into the
+ * caller's memory.
+ *
+ * Every stream has up to two buffers: the one reads are served from, and
+ * the one being read ahead into. Only the latter is ever touched by the I/O
+ * thread. Like a FILE, a stream is used by one thread at a time.
+ *
+ * All reads go through the block cache, so streams reopened on the same
+ * file don't go back to the card for what was just read.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "utils/rastream.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <psp2/io/fcntl.h>
+
+#include "utils/blockcache.h"
+#include "utils/logger.h"
+
+#define RASTREAM_MAX_FILES  16
+#define RASTREAM_BUF_SIZE   (64 * 1024)
+#define RASTREAM_BUFFERS    32 // in the arena; at most 32, one bit each
+#define RASTREAM_SEQUENTIAL 2  // reads in a row before reading ahead
+#define RASTREAM_STACK_SIZE (16 * 1024)
+#define RASTREAM_ENOENT     ((SceUID)0x80010002) // SceIo's ENOENT
+
+typedef enum rastream_buf_state {
+    BUF_EMPTY = 0,
+    BUF_PENDING,    // queued for, or being read on, the I/O thread
+    BUF_READY
+} rastream_buf_state;
+
+typedef struct rastream_buf {
+    uint8_t * data;     // NULL until taken from the arena
+    int64_t start;      // bytes [start, start + len) of the file
+    uint32_t len;
+    volatile int state;
+} rastream_buf;
+
+struct rastream {
+    volatile int used;
+    SceUID fd;
+    uint32_t file;      // for the block cache
+    int64_t size;
+    int64_t pos;
+    int unget;
+    bool eof;
+    bool error;
+
+    rastream_buf buf[2];
+    int cur;            // buffer reads are served from; never pending
+    int64_t last_end;   // where the previous read stopped
+    int sequential;     // reads in a row that started at last_end
+};
+
+static rastream s_streams[RASTREAM_MAX_FILES];
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t s_done = PTHREAD_COND_INITIALIZER;
+static bool s_ready;
+
+static uint8_t * s_arena;
+static uint32_t s_free; // bit per free buffer in the arena
+
+typedef struct rastream_request {
+    SceUID fd;
+    uint32_t file;
+    rastream_buf * buf;
+} rastream_request;
+
+// Read-ahead requests; a stream has at most one in flight
+static rastream_request s_queue[RASTREAM_MAX_FILES];
+static int s_queue_head;
+static int s_queue_len;
+
+static void * io_thread(void * arg) {
+    pthread_mutex_lock(&s_lock);
+    for (;;) {
+        while (!s_queue_len)
+            pthread_cond_wait(&s_queued, &s_lock);
+
+        rastream_request r = s_queue[s_queue_head];
+        s_queue_head = (s_queue_head + 1) % RASTREAM_MAX_FILES;
+        s_queue_len--;
+
+        rastream_buf * b = r.buf;
+        pthread_mutex_unlock(&s_lock);
+
+        int got = blockcache_pread(r.file, r.fd, b->data, b->len, b->start);
+
+        pthread_mutex_lock(&s_lock);
+        if (got > 0) {
+            b->len = got;
+            b->state = BUF_READY;
+        } else {
+            b->state = BUF_EMPTY;
+        }
+        pthread_cond_broadcast(&s_done);
+    }
+    return arg;
+}
+
+// With the lock held
+static bool init(void) {
+    if (s_ready)
+        return true;
+
+    s_arena = malloc(RASTREAM_BUFFERS * RASTREAM_BUF_SIZE);
+    if (!s_arena) {
+        log_error("[rastream] could not allocate the buffers");
+        return false;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, RASTREAM_STACK_SIZE);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    pthread_t thread;
+    int ret = pthread_create(&thread, &attr, io_thread, NULL);
+    pthread_attr_destroy(&attr);
+
+    if (ret != 0) {
+        log_error("[rastream] could not start the I/O thread");
+        free(s_arena);
+        s_arena = NULL;
+        return false;
+    }
+
+    s_free = RASTREAM_BUFFERS == 32 ? 0xFFFFFFFFu
+                                    : (1u << RASTREAM_BUFFERS) - 1;
+    s_ready = true;
+    return true;
+}
+
+// With the lock held
+static uint8_t * buf_take(void) {
+    if (!s_free)
+        return NULL;
+
+    int i = __builtin_ctz(s_free);
+    s_free &= ~(1u << i);
+    return s_arena + (size_t)i * RASTREAM_BUF_SIZE;
+}
+
+// With the lock held
+static void buf_give(uint8_t * data) {
+    if (data)
+        s_free |= 1u << ((data - s_arena) / RASTREAM_BUF_SIZE);
+}
+
+rastream * rastream_open(const char * path) {
+    rastream * s = NULL;
+    for (int i = 0; i < RASTREAM_MAX_FILES; i++) {
+        if (__sync_bool_compare_and_swap(&s_streams[i].used, 0, 1)) {
+            s = &s_streams[i];
+            break;
+        }
+    }
+    if (!s)
+        return NULL;
+
+    pthread_mutex_lock(&s_lock);
+    uint8_t * data = init() ? buf_take() : NULL;
+    pthread_mutex_unlock(&s_lock);
+
+    if (!data) {
+        __sync_lock_release(&s->used);
+        return NULL;
+    }
+
+    SceUID fd = sceIoOpen(path, SCE_O_RDONLY, 0);
+    int64_t size = fd >= 0 ? sceIoLseek(fd, 0, SCE_SEEK_END) : -1;
+    if (size < 0) {
+        if (fd >= 0)
+            sceIoClose(fd);
+        else if (fd == RASTREAM_ENOENT)
+            errno = ENOENT;
+
+        pthread_mutex_lock(&s_lock);
+        buf_give(data);
+        pthread_mutex_unlock(&s_lock);
+        __sync_lock_release(&s->used);
+        return NULL;
+    }
+
+    s->fd = fd;
+    s->file = blockcache_file(path);
+    s->size = size;
+    s->pos = 0;
+    s->unget = -1;
+    s->eof = false;
+    s->error = false;
+    memset(s->buf, 0, sizeof(s->buf));
+    s->buf[0].data = data;
+    s->cur = 0;
+    s->last_end = 0;
+    s->sequential = 0;
+    return s;
+}
+
+void rastream_close(rastream * s) {
+    pthread_mutex_lock(&s_lock);
+    while (s->buf[0].state == BUF_PENDING || s->buf[1].state == BUF_PENDING)
+        pthread_cond_wait(&s_done, &s_lock);
+    buf_give(s->buf[0].data);
+    buf_give(s->buf[1].data);
+    pthread_mutex_unlock(&s_lock);
+
+    sceIoClose(s->fd);
+    __sync_lock_release(&s->used);
+}
+
+bool rastream_owns(const void * handle) {
+    uintptr_t p = (uintptr_t)handle;
+    uintptr_t base = (uintptr_t)s_streams;
+    return p >= base && p < base + sizeof(s_streams)
+           && (p - base) % sizeof(rastream) == 0;
+}
+
+static inline bool covers(const rastream_buf * b, int64_t pos) {
+    return pos >= b->start && pos < b->start + b->len;
+}
+
+// Buffer holding the byte at s->pos, waiting for the read-ahead if needed
+static rastream_buf * buffer_at(rastream * s) {
+    rastream_buf * b = &s->buf[s->cur];
+    if (b->state == BUF_READY && covers(b, s->pos))
+        return b;
+
+    b = &s->buf[!s->cur];
+
+    pthread_mutex_lock(&s_lock);
+    if (b->state == BUF_PENDING && covers(b, s->pos)) {
+        while (b->state == BUF_PENDING)
+            pthread_cond_wait(&s_done, &s_lock);
+    }
+    bool hit = b->state == BUF_READY && covers(b, s->pos);
+    pthread_mutex_unlock(&s_lock);
+
+    if (!hit)
+        return NULL;
+    s->cur = !s->cur;
+    return b;
+}
+
+// Reads the chunk at s->pos, which is before the end, into the current buffer
+static bool fill(rastream * s) {
+    rastream_buf * b = &s->buf[s->cur];
+    int64_t left = s->size - s->pos;
+    uint32_t n = left < RASTREAM_BUF_SIZE ? (uint32_t)left : RASTREAM_BUF_SIZE;
+
+    int got = blockcache_pread(s->file, s->fd, b->data, n, s->pos);
+    if (got <= 0) {
+        b->state = BUF_EMPTY;
+        s->error = true;
+        return false;
+    }
+
+    b->start = s->pos;
+    b->len = got;
+    b->state = BUF_READY;
+    return true;
+}
+
+// Queues the chunk after the one being read, if the reads look sequential
+static void read_ahead(rastream * s) {
+    if (s->sequential < RASTREAM_SEQUENTIAL)
+        return;
+
+    const rastream_buf * b = &s->buf[s->cur];
+    int64_t next = s->pos;
+    if (b->state == BUF_READY && covers(b, s->pos))
+        next = b->start + b->len;
+    if (next >= s->size)
+        return;
+
+    rastream_buf * ahead = &s->buf[!s->cur];
+
+    pthread_mutex_lock(&s_lock);
+    if (ahead->state == BUF_PENDING
+        || (ahead->state == BUF_READY && covers(ahead, next))) {
+        pthread_mutex_unlock(&s_lock);
+        return;
+    }
+
+    if (!ahead->data)
+        ahead->data = buf_take();
+    if (ahead->data) {
+        int64_t left = s->size - next;
+        ahead->start = next;
+        ahead->len = left < RASTREAM_BUF_SIZE ? (uint32_t)left
+                                              : RASTREAM_BUF_SIZE;
+        ahead->state = BUF_PENDING;
+
+        rastream_request * r =
+            &s_queue[(s_queue_head + s_queue_len) % RASTREAM_MAX_FILES];
+        r->fd = s->fd;
+        r->file = s->file;
+        r->buf = ahead;
+        s_queue_len++;
+        pthread_cond_signal(&s_queued);
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+size_t rastream_read(rastream * s, void * dst, size_t len) {
+    uint8_t * out = dst;
+    size_t done = 0;
+
+    if (!len)
+        return 0;
+
+    if (s->pos == s->last_end) {
+        if (s->sequential < RASTREAM_SEQUENTIAL)
+            s->sequential++;
+    } else {
+        s->sequential = 0;
+    }
+
+    if (s->unget >= 0) {
+        out[done++] = (uint8_t)s->unget;
+        s->unget = -1;
+        s->pos++;
+    }
+
+    while (done < len) {
+        if (s->pos >= s->size) {
+            s->eof = true;
+            break;
+        }
+
+        int64_t left = s->size - s->pos;
+        size_t want = len - done;
+        if ((int64_t)want > left)
+            want = (size_t)left;
+
+        rastream_buf * b = buffer_at(s);
+        if (b) {
+            size_t n = b->start + b->len - s->pos;
+            if (n > want)
+                n = want;
+            memcpy(out + done, b->data + (s->pos - b->start), n);
+            s->pos += n;
+            done += n;
+            continue;
+        }
+
+        // Large reads skip the buffers
+        if (want >= RASTREAM_BUF_SIZE) {
+            int got = blockcache_pread(s->file, s->fd, out + done, want,
+                                       s->pos);
+            if (got <= 0) {
+                s->error = true;
+                break;
+            }
+            s->pos += got;
+            done += got;
+            continue;
+        }
+
+        if (!fill(s))
+            break;
+    }
+
+    s->last_end = s->pos;
+    read_ahead(s);
+    return done;
+}
+
+int rastream_seek(rastream * s, int64_t offset, int whence) {
+    int64_t pos;
+    switch (whence) {
+        case SEEK_SET: pos = offset; break;
+        case SEEK_CUR: pos = s->pos + offset; break;
+        case SEEK_END: pos = s->size + offset; break;
+        default: return -1;
+    }
+
+    if (pos < 0)
+        return -1;
+
+    s->pos = pos;
+    s->unget = -1;
+    s->eof = false;
+    return 0;
+}
+
+int64_t rastream_tell(const rastream * s) {
+    return s->pos;
+}
+
+int64_t rastream_size(const rastream * s) {
+    return s->size;
+}
+
+int rastream_getc(rastream * s) {
+    // Straight from the buffer, unless the read has to go further
+    const rastream_buf * b = &s->buf[s->cur];
+    if (s->unget < 0 && s->pos == s->last_end && b->state == BUF_READY
+        && covers(b, s->pos)) {
+        uint8_t c = b->data[s->pos - b->start];
+        s->last_end = ++s->pos;
+        return c;
+    }
+
+    uint8_t c;
+    return rastream_read(s, &c, 1) ? c : EOF;
+}
+
+int rastream_ungetc(int c, rastream * s) {
+    if (c == EOF || s->unget >= 0 || s->pos == 0)
+        return EOF;
+
+    s->unget = (uint8_t)c;
+    s->pos--;
+    s->eof = false;
+    return (uint8_t)c;
+}
+
+char * rastream_gets(char * str, int n, rastream * s) {
+    if (n <= 0)
+        return NULL;
+
+    int i = 0;
+    while (i < n - 1) {
+        int c = rastream_getc(s);
+        if (c == EOF)
+            break;
+        str[i++] = (char)c;
+        if (c == '\n')
+            break;
+    }
+
+    if (i == 0 && n > 1)
+        return NULL;
+    str[i] = '\0';
+    return str;
+}
+
+bool rastream_eof(const rastream * s) {
+    return s->eof;
+}
+
+bool rastream_error(const rastream * s) {
+    return s->error;
+}
@@ -0,0 +1,42 @@
+/*
+ * utils/rastream.h
+ *
+ * Read-only file streams with large pooled buffers and read-ahead.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_RASTREAM_H
+#define SOLOADER_RASTREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct rastream rastream;
+
+/*
+ * NULL with errno set to ENOENT if `path` (a real path) doesn't exist, or
+ * with errno untouched if there's no free stream or buffer for it.
+ */
+rastream * rastream_open(const char * path);
+void rastream_close(rastream * s);
+
+// Whether `handle`, as seen by the game, is one of ours
+bool rastream_owns(const void * handle);
+
+size_t rastream_read(rastream * s, void * dst, size_t len);
+int rastream_seek(rastream * s, int64_t offset, int whence);
+int64_t rastream_tell(const rastream * s);
+int64_t rastream_size(const rastream * s);
+
+int rastream_getc(rastream * s);
+int rastream_ungetc(int c, rastream * s);
+char * rastream_gets(char * str, int n, rastream * s);
+bool rastream_eof(const rastream * s);
+bool rastream_error(const rastream * s);
+
+#endif // SOLOADER_RASTREAM_H
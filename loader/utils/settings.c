@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "settings.h"
+#include "atomicfile.h"
 
 #define CONFIG_FILE_PATH DATA_PATH"config.txt"
 
@@ -23,6 +24,10 @@ int setting_gfxDetail;
 int setting_geometryDetail;
 bool setting_enableMipMaps;
 float setting_viewDistance;
+bool setting_adaptiveViewDistance;
+float setting_minViewDistance;
+bool setting_dynamicClocks;
+int setting_ioCacheSize;
 
 void settings_reset() {
     setting_leftStickDeadZone = 0.11f;
@@ -32,6 +37,10 @@ void settings_reset() {
     setting_geometryDetail = 0;
     setting_enableMipMaps = false;
     setting_viewDistance = 0.80f;
+    setting_adaptiveViewDistance = false;
+    setting_minViewDistance = 0.60f;
+    setting_dynamicClocks = true;
+    setting_ioCacheSize = 32;
 }
 
 void settings_load() {
@@ -51,22 +60,37 @@ void settings_load() {
             else if (strcmp("geometryDetail", buffer) == 0) setting_geometryDetail = (int)value;
             else if (strcmp("enableMipMaps", buffer) == 0) setting_enableMipMaps = (bool)value;
             else if (strcmp("viewDistance", buffer) == 0) setting_viewDistance = ((float)value / 100.f);
+            else if (strcmp("adaptiveViewDistance", buffer) == 0) setting_adaptiveViewDistance = (bool)value;
+            else if (strcmp("minViewDistance", buffer) == 0) setting_minViewDistance = ((float)value / 100.f);
+            else if (strcmp("dynamicClocks", buffer) == 0) setting_dynamicClocks = (bool)value;
+            else if (strcmp("ioCacheSize", buffer) == 0) setting_ioCacheSize = (int)value;
         }
         fclose(config);
     }
 }
 
+static void put(char * buf, size_t size, size_t * len, const char * key, int value) {
+    if (*len < size)
+        *len += snprintf(buf + *len, size - *len, "%s %d\n", key, value);
+}
+
+// Written whole, so that a crash can't leave a config cut in half
 void settings_save() {
-    FILE *config = fopen(CONFIG_FILE_PATH, "w+");
+    char config[1024];
+    size_t len = 0;
 
-    if (config) {
-        fprintf(config, "%s %d\n", "leftStickDeadZone", (int)(setting_leftStickDeadZone * 100.f));
-        fprintf(config, "%s %d\n", "rightStickDeadZone", (int)(setting_rightStickDeadZone * 100.f));
-        fprintf(config, "%s %d\n", "fpsLock", (int)setting_fpsLock);
-        fprintf(config, "%s %d\n", "gfxDetail", (int)setting_gfxDetail);
-        fprintf(config, "%s %d\n", "geometryDetail", (int)setting_geometryDetail);
-        fprintf(config, "%s %d\n", "enableMipMaps", (int)setting_enableMipMaps);
-        fprintf(config, "%s %d\n", "viewDistance", (int)(setting_viewDistance * 100.f));
-        fclose(config);
-    }
+    put(config, sizeof(config), &len, "leftStickDeadZone", (int)(setting_leftStickDeadZone * 100.f));
+    put(config, sizeof(config), &len, "rightStickDeadZone", (int)(setting_rightStickDeadZone * 100.f));
+    put(config, sizeof(config), &len, "fpsLock", (int)setting_fpsLock);
+    put(config, sizeof(config), &len, "gfxDetail", (int)setting_gfxDetail);
+    put(config, sizeof(config), &len, "geometryDetail", (int)setting_geometryDetail);
+    put(config, sizeof(config), &len, "enableMipMaps", (int)setting_enableMipMaps);
+    put(config, sizeof(config), &len, "viewDistance", (int)(setting_viewDistance * 100.f));
+    put(config, sizeof(config), &len, "adaptiveViewDistance", (int)setting_adaptiveViewDistance);
+    put(config, sizeof(config), &len, "minViewDistance", (int)(setting_minViewDistance * 100.f));
+    put(config, sizeof(config), &len, "dynamicClocks", (int)setting_dynamicClocks);
+    put(config, sizeof(config), &len, "ioCacheSize", (int)setting_ioCacheSize);
+
+    if (len < sizeof(config))
+        atomicfile_write(CONFIG_FILE_PATH, config, len);
 }
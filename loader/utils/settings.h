@@ -24,6 +24,10 @@ extern int setting_gfxDetail;
 extern int setting_geometryDetail;
 extern bool setting_enableMipMaps;
 extern float setting_viewDistance;
+extern bool setting_adaptiveViewDistance;
+extern float setting_minViewDistance;
+extern bool setting_dynamicClocks;
+extern int setting_ioCacheSize;
 
 void settings_load();
 void settings_save();
@@ -0,0 +1,349 @@
+/*
+ * utils/shadermanifest.c
+ *
+ * Manifest of the shader sources submitted by the game, used to fill the
+ * gxp cache ahead of time on later boots.
+ *
+ * Layout: "SHMF", u32 version, then one record per distinct source:
+ * char key[32] (hex hash128), u32 shader type, u32 length, source bytes.
+ * Records are only ever appended. Version 1 manifests were keyed by SHA1
+ * and are rewritten in place the first time they're opened.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "utils/shadermanifest.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/hash.h"
+#include "utils/logger.h"
+#include "utils/utils.h"
+
+#define MANIFEST_MAGIC    "SHMF"
+#define MANIFEST_VERSION  2
+#define MANIFEST_HEADER   8
+#define KEY_HEX_LEN       HASH128_HEX_LEN
+#define RECORD_HEADER     (KEY_HEX_LEN + 8)
+
+#define V1_SHA_HEX_LEN    40
+#define V1_RECORD_HEADER  (V1_SHA_HEX_LEN + 8)
+
+typedef struct manifest_entry {
+    const char * key;
+    uint32_t type;
+    const char * src;
+    uint32_t len;
+} manifest_entry;
+
+static char * s_path;
+static shader_manifest_cached_fn s_cached;
+
+// Manifest contents, kept around while queued entries point into them
+static uint8_t * s_data;
+static manifest_entry * s_queue;
+static uint32_t s_queue_len;
+static uint32_t s_queue_next;
+
+// Set of keys already in the manifest; first byte 0 for an empty slot
+static char (* s_known)[KEY_HEX_LEN];
+static uint32_t s_known_count;
+static uint32_t s_known_mask;
+
+static inline uint32_t key_slot(const char * key) {
+    // The hash is uniformly distributed already
+    uint32_t h = 0;
+    for (int i = 0; i < 8; i++)
+        h = (h << 4) | (uint32_t)(key[i] & 0x0F);
+    return h ^ (uint32_t)key[8];
+}
+
+static bool known_has(const char * key) {
+    if (!s_known)
+        return false;
+
+    for (uint32_t i = key_slot(key) & s_known_mask; s_known[i][0];
+         i = (i + 1) & s_known_mask) {
+        if (memcmp(s_known[i], key, KEY_HEX_LEN) == 0)
+            return true;
+    }
+    return false;
+}
+
+static void known_insert(char (* table)[KEY_HEX_LEN], uint32_t mask,
+                         const char * key) {
+    uint32_t i = key_slot(key) & mask;
+    while (table[i][0])
+        i = (i + 1) & mask;
+    memcpy(table[i], key, KEY_HEX_LEN);
+}
+
+static void known_add(const char * key) {
+    uint32_t slots = s_known ? s_known_mask + 1 : 0;
+
+    // Keep the load factor at or below 1/2
+    if ((s_known_count + 1) * 2 > slots) {
+        uint32_t new_slots = slots ? slots * 2 : 256;
+        char (* table)[KEY_HEX_LEN] = calloc(new_slots, KEY_HEX_LEN);
+
+        if (table) {
+            for (uint32_t i = 0; i < slots; i++) {
+                if (s_known[i][0])
+                    known_insert(table, new_slots - 1, s_known[i]);
+            }
+            free(s_known);
+            s_known = table;
+            s_known_mask = new_slots - 1;
+        }
+    }
+
+    // Without a table, or with a full one, the entry just isn't deduplicated
+    if (!s_known || s_known_count > s_known_mask)
+        return;
+
+    known_insert(s_known, s_known_mask, key);
+    s_known_count++;
+}
+
+static void write_header(FILE * f) {
+    uint32_t version = MANIFEST_VERSION;
+    fwrite(MANIFEST_MAGIC, 1, 4, f);
+    fwrite(&version, sizeof(version), 1, f);
+}
+
+// Rewrites the manifest as its first `len` bytes (or just a header)
+static void rewrite(const uint8_t * data, size_t len) {
+    FILE * f = fopen(s_path, "wb");
+    if (!f)
+        return;
+
+    if (len >= MANIFEST_HEADER)
+        fwrite(data, 1, len, f);
+    else
+        write_header(f);
+    fclose(f);
+}
+
+static void queue_push(const manifest_entry * e) {
+    if ((s_queue_len & (s_queue_len - 1)) == 0) {
+        uint32_t capacity = s_queue_len ? s_queue_len * 2 : 64;
+        manifest_entry * queue = realloc(s_queue, capacity * sizeof(*queue));
+        if (!queue)
+            return;
+        s_queue = queue;
+    }
+    s_queue[s_queue_len++] = *e;
+}
+
+/*
+ * Re-keys a version 1 manifest in memory and writes it back as the current
+ * version; `rekey` gets every old SHA1 with its new key so cached binaries
+ * can follow. Returns the new size, or 0 if the manifest is to start over.
+ */
+static size_t migrate_v1(size_t size, shader_manifest_rekey_fn rekey) {
+    // Keys are shorter than SHA1s, so the result always fits in place
+    uint8_t * out = malloc(size);
+    if (!out)
+        return 0;
+
+    memcpy(out, MANIFEST_MAGIC, 4);
+    uint32_t version = MANIFEST_VERSION;
+    memcpy(out + 4, &version, sizeof(version));
+
+    size_t off = MANIFEST_HEADER;
+    size_t out_len = MANIFEST_HEADER;
+    uint32_t count = 0;
+    uint32_t moved = 0;
+
+    while (off + V1_RECORD_HEADER <= size) {
+        uint32_t len;
+        memcpy(&len, s_data + off + V1_SHA_HEX_LEN + 4, 4);
+        if (len > size - off - V1_RECORD_HEADER)
+            break;
+
+        const uint8_t * src = s_data + off + V1_RECORD_HEADER;
+        uint8_t digest[HASH128_SIZE];
+        char key[KEY_HEX_LEN + 1];
+        char sha1[V1_SHA_HEX_LEN + 1];
+
+        hash128(src, len, digest);
+        hex_encode(digest, HASH128_SIZE, key);
+        memcpy(sha1, s_data + off, V1_SHA_HEX_LEN);
+        sha1[V1_SHA_HEX_LEN] = '\0';
+        if (rekey(sha1, key))
+            moved++;
+
+        memcpy(out + out_len, key, KEY_HEX_LEN);
+        memcpy(out + out_len + KEY_HEX_LEN, s_data + off + V1_SHA_HEX_LEN, 8);
+        memcpy(out + out_len + RECORD_HEADER, src, len);
+        out_len += RECORD_HEADER + len;
+        off += V1_RECORD_HEADER + len;
+        count++;
+    }
+
+    free(s_data);
+    s_data = out;
+    rewrite(s_data, out_len);
+
+    logv_info("[shadermanifest] migrated %u entries to version %i, "
+              "%u cached binaries renamed", count, MANIFEST_VERSION, moved);
+    return out_len;
+}
+
+void shader_manifest_open(const char * path, shader_manifest_cached_fn cached,
+                          shader_manifest_rekey_fn rekey) {
+    free(s_path);
+    free(s_data);
+    free(s_queue);
+    free(s_known);
+    s_data = NULL;
+    s_queue = NULL;
+    s_known = NULL;
+    s_queue_len = s_queue_next = s_known_count = s_known_mask = 0;
+
+    s_path = strdup(path);
+    s_cached = cached;
+
+    FILE * f = fopen(path, "rb");
+    if (!f)
+        return;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    s_data = malloc(size > 0 ? size : 1);
+    if (!s_data || fread(s_data, 1, size, f) != (size_t)size) {
+        fclose(f);
+        free(s_data);
+        s_data = NULL;
+        return;
+    }
+    fclose(f);
+
+    uint32_t version = 0;
+    if (size >= MANIFEST_HEADER)
+        memcpy(&version, s_data + 4, sizeof(version));
+
+    if (size >= MANIFEST_HEADER && memcmp(s_data, MANIFEST_MAGIC, 4) == 0
+        && version == 1) {
+        size = migrate_v1(size, rekey);
+        version = size ? MANIFEST_VERSION : 0;
+    }
+
+    if (size < MANIFEST_HEADER || memcmp(s_data, MANIFEST_MAGIC, 4) != 0
+        || version != MANIFEST_VERSION) {
+        log_error("[shadermanifest] unknown manifest format, starting over");
+        rewrite(NULL, 0);
+        free(s_data);
+        s_data = NULL;
+        return;
+    }
+
+    size_t off = MANIFEST_HEADER;
+    while (off + RECORD_HEADER <= (size_t)size) {
+        manifest_entry e;
+        e.key = (const char *)s_data + off;
+        memcpy(&e.type, s_data + off + KEY_HEX_LEN, 4);
+        memcpy(&e.len, s_data + off + KEY_HEX_LEN + 4, 4);
+        e.src = (const char *)s_data + off + RECORD_HEADER;
+
+        if (e.len > (size_t)size - off - RECORD_HEADER)
+            break;
+
+        if (!known_has(e.key)) {
+            char key[KEY_HEX_LEN + 1];
+            memcpy(key, e.key, KEY_HEX_LEN);
+            key[KEY_HEX_LEN] = '\0';
+
+            known_add(e.key);
+            if (!cached(key))
+                queue_push(&e);
+        }
+        off += RECORD_HEADER + e.len;
+    }
+
+    if (off != (size_t)size) {
+        logv_error("[shadermanifest] dropping %u damaged bytes at the end",
+                   (unsigned)(size - off));
+        rewrite(s_data, off);
+    }
+
+    logv_info("[shadermanifest] %u shaders known, %u to precompile",
+              s_known_count, s_queue_len);
+
+    if (s_queue_len == 0) {
+        free(s_data);
+        s_data = NULL;
+    }
+}
+
+void shader_manifest_record(const char * key, uint32_t type, const char * src,
+                            uint32_t len) {
+    if (!s_path || known_has(key))
+        return;
+
+    FILE * f = fopen(s_path, "ab");
+    if (!f) {
+        mkpath(s_path, 0777);
+        f = fopen(s_path, "ab");
+        if (!f)
+            return;
+    }
+
+    fseek(f, 0, SEEK_END);
+    if (ftell(f) == 0)
+        write_header(f);
+
+    fwrite(key, 1, KEY_HEX_LEN, f);
+    fwrite(&type, sizeof(type), 1, f);
+    fwrite(&len, sizeof(len), 1, f);
+    fwrite(src, 1, len, f);
+    fclose(f);
+
+    known_add(key);
+}
+
+bool shader_manifest_known(const char * key) {
+    return known_has(key);
+}
+
+bool shader_manifest_precompile_next(shader_manifest_compile_fn compile) {
+    while (s_queue_next < s_queue_len) {
+        const manifest_entry * e = &s_queue[s_queue_next++];
+
+        char key[KEY_HEX_LEN + 1];
+        memcpy(key, e->key, KEY_HEX_LEN);
+        key[KEY_HEX_LEN] = '\0';
+
+        // The game may have needed it before its turn came
+        if (s_cached(key))
+            continue;
+
+        if (!compile(key, e->type, e->src, e->len))
+            logv_error("[shadermanifest] could not precompile %s", key);
+        break;
+    }
+
+    if (s_queue_next < s_queue_len)
+        return true;
+
+    if (s_data) {
+        log_info("[shadermanifest] precompilation done");
+        free(s_queue);
+        free(s_data);
+        s_queue = NULL;
+        s_data = NULL;
+        s_queue_len = s_queue_next = 0;
+    }
+    return false;
+}
+
+uint32_t shader_manifest_pending(void) {
+    return s_queue_len - s_queue_next;
+}
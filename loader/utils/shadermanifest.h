@@ -0,0 +1,61 @@
+/*
+ * utils/shadermanifest.h
+ *
+ * Manifest of the shader sources submitted by the game, used to fill the
+ * gxp cache ahead of time on later boots.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_SHADERMANIFEST_H
+#define SOLOADER_SHADERMANIFEST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Entries are keyed by the hex hash128 (utils/hash.h) of the complete
+ * source, HASH128_HEX_LEN characters.
+ */
+
+// Returns whether the compiled binary for the given key is already cached
+typedef bool (*shader_manifest_cached_fn)(const char * key);
+
+// Compiles the source and stores the binary; returns false on failure
+typedef bool (*shader_manifest_compile_fn)(const char * key, uint32_t type,
+                                           const char * src, uint32_t len);
+
+/*
+ * Called for each entry of an old SHA1-keyed manifest as it is migrated;
+ * returns whether a cached binary was moved to the new key
+ */
+typedef bool (*shader_manifest_rekey_fn)(const char * sha1, const char * key);
+
+/*
+ * Load the manifest at `path` and queue every entry `cached` says is
+ * missing from the cache. A damaged tail, e.g. from a crash mid-append,
+ * is cut off.
+ */
+void shader_manifest_open(const char * path, shader_manifest_cached_fn cached,
+                          shader_manifest_rekey_fn rekey);
+
+// Whether the key is already in the manifest
+bool shader_manifest_known(const char * key);
+
+// Append the source to the manifest, unless its key is already there
+void shader_manifest_record(const char * key, uint32_t type, const char * src,
+                            uint32_t len);
+
+/*
+ * Compile the next queued entry, if any. Returns false once the queue is
+ * empty.
+ */
+bool shader_manifest_precompile_next(shader_manifest_compile_fn compile);
+
+// Number of entries still queued for precompilation
+uint32_t shader_manifest_pending(void);
+
+#endif // SOLOADER_SHADERMANIFEST_H
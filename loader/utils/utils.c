@@ -11,6 +11,7 @@
  */
 
 #include "utils/utils.h"
+#include "utils/hash.h"
 #include "logger.h"
 
 #include <psp2/io/stat.h>
@@ -129,40 +130,25 @@ bool is_dir(char* path) {
 }
 
 char * get_string_sha1(uint8_t* buf, long size) {
-    uint8_t sha1[20];
+    uint8_t sha1[SHA1_BLOCK_SIZE];
     SHA1_CTX ctx;
     sha1_init(&ctx);
     sha1_update(&ctx, (uint8_t *)buf, size);
     sha1_final(&ctx, (uint8_t *)sha1);
 
-    char hash[42];
-    memset(hash, 0, sizeof(hash));
-
-    int i;
-    for (i = 0; i < 20; i++) {
-        char string[4];
-        sprintf(string, "%02X", sha1[i]);
-        strcat(hash, string);
-    }
-
-    hash[41] = '\0';
+    char hash[SHA1_BLOCK_SIZE * 2 + 1];
+    hex_encode(sha1, SHA1_BLOCK_SIZE, hash);
     return strdup(hash);
 }
 
 char * get_file_sha1(const char* path) {
-    FILE *f = fopen(path, "rb");
-    if (!f) return NULL;
-
-    fseek(f, 0, SEEK_END);
-    long size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    void *buf = malloc(size);
-    fread(buf, 1, size, f);
-    fclose(f);
+    uint8_t sha1[SHA1_BLOCK_SIZE];
+    if (!sha1_file(path, sha1))
+        return NULL;
 
-    char * ret = get_string_sha1(buf, size);
-    free(buf);
-    return ret;
+    char hash[SHA1_BLOCK_SIZE * 2 + 1];
+    hex_encode(sha1, SHA1_BLOCK_SIZE, hash);
+    return strdup(hash);
 }
 
 int mkpath(char* file_path, mode_t mode) {
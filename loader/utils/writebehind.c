@@ -0,0 +1,387 @@
+/*
+ * utils/writebehind.c
+ *
+ * Files written in memory and committed to the card in the background.
+ *
+ * Saving through SceLibc stalls the game for as long as the card takes,
+ * and a crash halfway leaves a damaged save. Files the game opens for
+ * writing under the root are kept in memory instead, and fclose() only
+ * hands them to the commit thread, which replaces the file on the card
+ * atomically (see atomicfile.c). A file closed again before its previous
+ * contents were committed only gets committed once, with the latest.
+ *
+ * fflush() is the game asking for the data to be safe, so it commits right
+ * away and waits. Opening, stat()ing, removing or renaming a path first
+ * waits for its commits; exit() waits for all of them.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "utils/writebehind.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/atomicfile.h"
+#include "utils/logger.h"
+
+#define WRITEBEHIND_MAX_FILES   16
+#define WRITEBEHIND_MIN_SIZE    (16 * 1024)
+#define WRITEBEHIND_MAX_PENDING (16 * 1024 * 1024) // then fclose() waits
+#define WRITEBEHIND_PRINTF_SIZE 512
+#define WRITEBEHIND_STACK_SIZE  (16 * 1024)
+
+struct writebehind_file {
+    volatile int used;
+    char * path;
+    uint8_t * data;
+    size_t len;         // of the file so far
+    size_t size;        // of data
+    size_t pos;
+    bool dirty;         // changed since it was last committed
+    bool incomplete;    // a write failed, so the data is missing some
+    bool error;
+};
+
+typedef struct writebehind_commit {
+    struct writebehind_commit * next;
+    char * path;
+    uint8_t * data;
+    size_t len;
+} writebehind_commit;
+
+static writebehind_file s_files[WRITEBEHIND_MAX_FILES];
+
+static char s_root[256];
+static size_t s_root_len;
+static writebehind_committed_fn s_committed;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t s_done = PTHREAD_COND_INITIALIZER;
+static bool s_ready;
+
+static writebehind_commit * s_head;
+static writebehind_commit * s_tail;
+static const char * s_current;  // being committed by the thread
+static writebehind_commit * s_flushing;
+static size_t s_pending;        // bytes queued
+
+// One commit at a time, the thread's or a flush's
+static pthread_mutex_t s_commit_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool commit(const char * path, const void * data, size_t len) {
+    pthread_mutex_lock(&s_commit_lock);
+    bool ok = atomicfile_write(path, data, len);
+    pthread_mutex_unlock(&s_commit_lock);
+
+    if (ok && s_committed)
+        s_committed(path);
+    if (!ok)
+        logv_error("[writebehind] could not write %s", path);
+    return ok;
+}
+
+// With the lock held
+static bool busy(const char * path) {
+    if (s_current && (!path || strcmp(s_current, path) == 0))
+        return true;
+
+    for (const writebehind_commit * c = s_head; c; c = c->next)
+        if (!path || strcmp(c->path, path) == 0)
+            return true;
+    for (const writebehind_commit * c = s_flushing; c; c = c->next)
+        if (!path || strcmp(c->path, path) == 0)
+            return true;
+    return false;
+}
+
+static void * commit_thread(void * arg) {
+    pthread_mutex_lock(&s_lock);
+    for (;;) {
+        while (!s_head)
+            pthread_cond_wait(&s_queued, &s_lock);
+
+        writebehind_commit * c = s_head;
+        s_head = c->next;
+        if (!s_head)
+            s_tail = NULL;
+        s_current = c->path;
+        pthread_mutex_unlock(&s_lock);
+
+        commit(c->path, c->data, c->len);
+
+        pthread_mutex_lock(&s_lock);
+        s_current = NULL;
+        s_pending -= c->len;
+        pthread_cond_broadcast(&s_done);
+
+        free(c->path);
+        free(c->data);
+        free(c);
+    }
+    return arg;
+}
+
+// Takes `path` and `data` over
+static void queue(char * path, uint8_t * data, size_t len) {
+    pthread_mutex_lock(&s_lock);
+    for (writebehind_commit * c = s_head; c; c = c->next) {
+        if (strcmp(c->path, path) == 0) {
+            s_pending += len - c->len;
+            free(c->data);
+            free(path);
+            c->data = data;
+            c->len = len;
+            pthread_mutex_unlock(&s_lock);
+            return;
+        }
+    }
+
+    writebehind_commit * c = malloc(sizeof(*c));
+    while (c && s_pending > WRITEBEHIND_MAX_PENDING && s_head)
+        pthread_cond_wait(&s_done, &s_lock);
+
+    if (!c) {
+        pthread_mutex_unlock(&s_lock);
+        commit(path, data, len);
+        free(path);
+        free(data);
+        return;
+    }
+
+    c->next = NULL;
+    c->path = path;
+    c->data = data;
+    c->len = len;
+    if (s_tail)
+        s_tail->next = c;
+    else
+        s_head = c;
+    s_tail = c;
+    s_pending += len;
+    pthread_cond_signal(&s_queued);
+    pthread_mutex_unlock(&s_lock);
+}
+
+static void sync_all(void) {
+    writebehind_sync(NULL);
+}
+
+void writebehind_init(const char * root, writebehind_committed_fn committed) {
+    if (s_ready || strlen(root) >= sizeof(s_root))
+        return;
+
+    atomicfile_recover();
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, WRITEBEHIND_STACK_SIZE);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    pthread_t thread;
+    if (pthread_create(&thread, &attr, commit_thread, NULL) != 0) {
+        log_error("[writebehind] could not start the commit thread");
+    } else {
+        strcpy(s_root, root);
+        s_root_len = strlen(root);
+        s_committed = committed;
+        s_ready = true;
+        atexit(sync_all);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+writebehind_file * writebehind_open(const char * path, const char * mode) {
+    if (!s_ready || strncmp(path, s_root, s_root_len) != 0
+        || mode[0] != 'w' || strchr(mode, '+'))
+        return NULL;
+
+    for (int i = 0; i < WRITEBEHIND_MAX_FILES; i++) {
+        writebehind_file * f = &s_files[i];
+        if (!__sync_bool_compare_and_swap(&f->used, 0, 1))
+            continue;
+
+        f->path = strdup(path);
+        if (!f->path) {
+            __sync_lock_release(&f->used);
+            return NULL;
+        }
+        f->data = NULL;
+        f->len = 0;
+        f->size = 0;
+        f->pos = 0;
+        f->dirty = true; // even empty, it replaces what was there
+        f->incomplete = false;
+        f->error = false;
+        return f;
+    }
+    return NULL;
+}
+
+int writebehind_close(writebehind_file * f) {
+    // A write that failed would leave the file cut short; keep the old one
+    int ret = f->incomplete ? EOF : 0;
+    if (f->incomplete)
+        logv_error("[writebehind] %s not saved after a failed write", f->path);
+
+    if (f->dirty && !f->incomplete)
+        queue(f->path, f->data, f->len);
+    else {
+        free(f->path);
+        free(f->data);
+    }
+
+    f->path = NULL;
+    f->data = NULL;
+    __sync_lock_release(&f->used);
+    return ret;
+}
+
+bool writebehind_owns(const void * handle) {
+    uintptr_t p = (uintptr_t)handle;
+    uintptr_t base = (uintptr_t)s_files;
+    return p >= base && p < base + sizeof(s_files)
+           && (p - base) % sizeof(writebehind_file) == 0;
+}
+
+size_t writebehind_write(writebehind_file * f, const void * src, size_t len) {
+    if (!len)
+        return 0;
+
+    if (f->pos + len > f->size) {
+        size_t size = f->size ? f->size : WRITEBEHIND_MIN_SIZE;
+        while (size < f->pos + len)
+            size *= 2;
+
+        uint8_t * data = realloc(f->data, size);
+        if (!data) {
+            f->incomplete = f->error = true;
+            errno = ENOMEM;
+            return 0;
+        }
+        f->data = data;
+        f->size = size;
+    }
+
+    // Seeking past the end leaves a hole
+    if (f->pos > f->len)
+        memset(f->data + f->len, 0, f->pos - f->len);
+
+    memcpy(f->data + f->pos, src, len);
+    f->pos += len;
+    if (f->pos > f->len)
+        f->len = f->pos;
+    f->dirty = true;
+    return len;
+}
+
+int writebehind_putc(int c, writebehind_file * f) {
+    uint8_t b = (uint8_t)c;
+    return writebehind_write(f, &b, 1) ? b : EOF;
+}
+
+int writebehind_puts(const char * str, writebehind_file * f) {
+    size_t len = strlen(str);
+    return writebehind_write(f, str, len) == len ? 0 : EOF;
+}
+
+int writebehind_vprintf(writebehind_file * f, const char * format,
+                        va_list args) {
+    char buf[WRITEBEHIND_PRINTF_SIZE];
+    va_list again;
+    va_copy(again, args);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+
+    char * out = buf;
+    if (len >= (int)sizeof(buf)) {
+        out = malloc(len + 1);
+        if (out)
+            vsnprintf(out, len + 1, format, again);
+    }
+    va_end(again);
+
+    if (len < 0 || !out) {
+        f->incomplete = f->error = true;
+        return -1;
+    }
+
+    size_t written = writebehind_write(f, out, len);
+    if (out != buf)
+        free(out);
+    return written == (size_t)len ? len : -1;
+}
+
+int writebehind_seek(writebehind_file * f, int64_t offset, int whence) {
+    int64_t pos;
+    switch (whence) {
+        case SEEK_SET: pos = offset; break;
+        case SEEK_CUR: pos = (int64_t)f->pos + offset; break;
+        case SEEK_END: pos = (int64_t)f->len + offset; break;
+        default: pos = -1; break;
+    }
+
+    if (pos < 0 || (uint64_t)pos > SIZE_MAX / 2) {
+        errno = EINVAL;
+        return -1;
+    }
+    f->pos = (size_t)pos;
+    return 0;
+}
+
+int64_t writebehind_tell(const writebehind_file * f) {
+    return f->pos;
+}
+
+bool writebehind_error(const writebehind_file * f) {
+    return f->error;
+}
+
+int writebehind_flush(writebehind_file * f) {
+    if (f->incomplete)
+        return EOF;
+    if (!f->dirty)
+        return 0;
+
+    // What was queued before goes first
+    writebehind_sync(f->path);
+
+    writebehind_commit flushing = { .path = f->path };
+    pthread_mutex_lock(&s_lock);
+    flushing.next = s_flushing;
+    s_flushing = &flushing;
+    pthread_mutex_unlock(&s_lock);
+
+    bool ok = commit(f->path, f->data, f->len);
+
+    pthread_mutex_lock(&s_lock);
+    writebehind_commit ** p = &s_flushing;
+    while (*p != &flushing)
+        p = &(*p)->next;
+    *p = flushing.next;
+    pthread_cond_broadcast(&s_done);
+    pthread_mutex_unlock(&s_lock);
+
+    if (!ok) {
+        f->error = true;
+        return EOF;
+    }
+    f->dirty = false;
+    return 0;
+}
+
+void writebehind_sync(const char * path) {
+    if (!s_ready)
+        return;
+
+    pthread_mutex_lock(&s_lock);
+    while (busy(path))
+        pthread_cond_wait(&s_done, &s_lock);
+    pthread_mutex_unlock(&s_lock);
+}
@@ -0,0 +1,61 @@
+/*
+ * utils/writebehind.h
+ *
+ * Files written in memory and committed to the card in the background.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_WRITEBEHIND_H
+#define SOLOADER_WRITEBEHIND_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct writebehind_file writebehind_file;
+
+// A file under the root just got its new contents on the card
+typedef void (*writebehind_committed_fn)(const char * path);
+
+/*
+ * Files opened for writing under `root` (a real path) are written behind
+ * from now on. Recovers whatever a crash cut short first.
+ */
+void writebehind_init(const char * root, writebehind_committed_fn committed);
+
+/*
+ * NULL unless `path` (a real path) is under the root and `mode` only
+ * writes, truncating ("w", "wb"); those files are left to stdio.
+ */
+writebehind_file * writebehind_open(const char * path, const char * mode);
+
+/*
+ * Queues the contents to be committed, unless nothing changed since fflush.
+ * After a failed write, the file is left as it was and this returns EOF.
+ */
+int writebehind_close(writebehind_file * f);
+
+bool writebehind_owns(const void * handle);
+
+size_t writebehind_write(writebehind_file * f, const void * src, size_t len);
+int writebehind_putc(int c, writebehind_file * f);
+int writebehind_puts(const char * str, writebehind_file * f);
+int writebehind_vprintf(writebehind_file * f, const char * format,
+                        va_list args);
+
+int writebehind_seek(writebehind_file * f, int64_t offset, int whence);
+int64_t writebehind_tell(const writebehind_file * f);
+bool writebehind_error(const writebehind_file * f);
+
+// Commits the contents so far and waits for them to be on the card
+int writebehind_flush(writebehind_file * f);
+
+// Waits for what was written to `path` to be on the card; NULL for all
+void writebehind_sync(const char * path);
+
+#endif // SOLOADER_WRITEBEHIND_H
@@ -0,0 +1,778 @@
+/*
+ * utils/zipvfs.c
+ *
+ * Read-only access to the files of a zip archive (the game's .apk) as if
+ * they were extracted to a directory.
+ *
+ * The central directory is walked once with minizip, resolving where the
+ * data of every entry starts, and turned into an open-addressing hash table
+ * keyed by entry name. Parent directories get entries of their own, so
+ * stat() works on them too. The table is stored next to the archive and
+ * read back on later boots for as long as the archive's size and mtime
+ * match.
+ *
+ * Entries are read with positional reads on a single archive descriptor,
+ * through the block cache.
+ * Large reads of STORED entries go straight into the caller's buffer,
+ * DEFLATE entries are inflated as a stream. Small reads go through a
+ * per-file window so that fgetc()/fgets() don't cost a read each. Seeking
+ * back in a DEFLATE entry restarts the stream.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "utils/zipvfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <psp2/io/fcntl.h>
+
+#include <unzip/unzip.h>
+#include <zlib.h>
+
+#include "utils/blockcache.h"
+#include "utils/logger.h"
+
+#define ZIPVFS_MAGIC        "ZVFS"
+#define ZIPVFS_VERSION      1
+#define ZIPVFS_MAX_FILES    32
+#define ZIPVFS_BUF_SIZE     4096  // window per open entry, for small reads
+#define ZIPVFS_IN_SIZE      16384 // compressed input per read
+#define ZIPVFS_NAME_MAX     512
+#define ZIPVFS_METHOD_DIR   0xFFFF
+
+typedef struct zipvfs_entry {
+    uint32_t hash;
+    uint32_t name;      // offset in the names blob
+    uint16_t name_len;
+    uint16_t method;    // 0 (STORED), Z_DEFLATED or ZIPVFS_METHOD_DIR
+    uint32_t offset;    // of the data in the archive
+    uint32_t csize;
+    uint32_t usize;
+    uint32_t mtime;
+} zipvfs_entry;
+
+typedef struct zipvfs_index_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t archive_size;
+    uint32_t archive_mtime;
+    uint32_t entries;
+    uint32_t slots;     // power of two
+    uint32_t names_size;
+} zipvfs_index_header;
+
+struct zipvfs_file {
+    volatile int used;
+    const zipvfs_entry * entry;
+    uint32_t pos;
+    int unget;
+    bool eof;
+    bool error;
+
+    // Bytes [buf_start, buf_start + buf_len) of the entry
+    uint32_t buf_start;
+    uint32_t buf_len;
+    uint8_t buf[ZIPVFS_BUF_SIZE];
+
+    // Inflater for DEFLATE entries, out_pos bytes into the entry
+    z_stream zs;
+    bool zs_ready;
+    uint8_t * in;
+    uint32_t in_pos;
+    uint32_t out_pos;
+};
+
+static SceUID s_archive = -1;
+static uint32_t s_archive_file; // for the block cache
+
+static zipvfs_entry * s_entries;
+static uint32_t * s_slots; // entry index + 1, 0 for an empty slot
+static char * s_names;
+static uint32_t s_entry_count;
+static uint32_t s_slot_count;
+static uint32_t s_names_size;
+
+static char s_root[64];
+static size_t s_root_len;
+static char s_mountpoint[256];
+static size_t s_mountpoint_len;
+
+static zipvfs_file s_files[ZIPVFS_MAX_FILES];
+
+static uint32_t name_hash(const char * name, size_t len) {
+    uint32_t h = 0x811C9DC5u;
+    while (len--) {
+        h ^= (uint8_t)*name++;
+        h *= 0x01000193u;
+    }
+    return h;
+}
+
+static const zipvfs_entry * find(const char * name, size_t len) {
+    if (!s_slots)
+        return NULL;
+
+    uint32_t h = name_hash(name, len);
+    uint32_t mask = s_slot_count - 1;
+    for (uint32_t i = h & mask; s_slots[i]; i = (i + 1) & mask) {
+        const zipvfs_entry * e = &s_entries[s_slots[i] - 1];
+        if (e->hash == h && e->name_len == len
+            && memcmp(s_names + e->name, name, len) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+static void insert(uint32_t index) {
+    uint32_t mask = s_slot_count - 1;
+    uint32_t i = s_entries[index].hash & mask;
+    while (s_slots[i])
+        i = (i + 1) & mask;
+    s_slots[i] = index + 1;
+}
+
+static const zipvfs_entry * find_path(const char * path) {
+    if (!s_slots || strncmp(path, s_mountpoint, s_mountpoint_len) != 0)
+        return NULL;
+
+    const char * rel = path + s_mountpoint_len;
+    while (*rel == '/')
+        rel++;
+    size_t rel_len = strlen(rel);
+    while (rel_len && rel[rel_len - 1] == '/')
+        rel_len--;
+
+    char name[ZIPVFS_NAME_MAX];
+    if (s_root_len + rel_len >= sizeof(name))
+        return NULL;
+    memcpy(name, s_root, s_root_len);
+    memcpy(name + s_root_len, rel, rel_len);
+    return find(name, s_root_len + rel_len);
+}
+
+static void index_free(void) {
+    free(s_entries);
+    free(s_slots);
+    free(s_names);
+    s_entries = NULL;
+    s_slots = NULL;
+    s_names = NULL;
+    s_entry_count = s_slot_count = s_names_size = 0;
+}
+
+static uint32_t unix_time(const tm_unz * t) {
+    struct tm tm = {
+        .tm_sec = (int)t->tm_sec,
+        .tm_min = (int)t->tm_min,
+        .tm_hour = (int)t->tm_hour,
+        .tm_mday = (int)t->tm_mday,
+        .tm_mon = (int)t->tm_mon,
+        .tm_year = (int)t->tm_year - 1900,
+        .tm_isdst = -1,
+    };
+    time_t ret = mktime(&tm);
+    return ret < 0 ? 0 : (uint32_t)ret;
+}
+
+// Adds the parent directories of the first `files` entries
+static void index_add_dirs(uint32_t files) {
+    for (uint32_t i = 0; i < files; i++) {
+        const char * name = s_names + s_entries[i].name;
+        for (uint16_t len = 1; len < s_entries[i].name_len; len++) {
+            if (name[len] != '/' || find(name, len))
+                continue;
+
+            zipvfs_entry * dir = &s_entries[s_entry_count];
+            memset(dir, 0, sizeof(*dir));
+            dir->hash = name_hash(name, len);
+            dir->name = s_entries[i].name; // a prefix of the file's name
+            dir->name_len = len;
+            dir->method = ZIPVFS_METHOD_DIR;
+            dir->mtime = s_entries[i].mtime;
+            insert(s_entry_count++);
+        }
+    }
+}
+
+static bool index_build(const char * archive) {
+    unzFile uf = unzOpen(archive);
+    if (!uf)
+        return false;
+
+    uint32_t cap = 0, names_cap = 0, slashes = 0, skipped = 0;
+    char name[ZIPVFS_NAME_MAX];
+    unz_file_info info;
+
+    int err = unzGoToFirstFile(uf);
+    while (err == UNZ_OK) {
+        err = unzGetCurrentFileInfo(uf, &info, name, sizeof(name),
+                                    NULL, 0, NULL, 0);
+        if (err != UNZ_OK)
+            break;
+
+        size_t len = strlen(name);
+        bool usable = len && len < ZIPVFS_NAME_MAX - 1 && name[len - 1] != '/'
+                      && !(info.flag & 1) // encrypted
+                      && (info.compression_method == 0
+                          || info.compression_method == Z_DEFLATED);
+        int method, level;
+
+        if (usable && unzOpenCurrentFile2(uf, &method, &level, 1) == UNZ_OK) {
+            uint32_t offset = (uint32_t)unzGetCurrentFileZStreamPos64(uf);
+            unzCloseCurrentFile(uf);
+
+            if (s_entry_count == cap) {
+                cap = cap ? cap * 2 : 1024;
+                void * p = realloc(s_entries, cap * sizeof(zipvfs_entry));
+                if (!p)
+                    break;
+                s_entries = p;
+            }
+            if (s_names_size + len > names_cap) {
+                names_cap = names_cap ? names_cap * 2 : 64 * 1024;
+                if (names_cap < s_names_size + len)
+                    names_cap = s_names_size + len;
+                void * p = realloc(s_names, names_cap);
+                if (!p)
+                    break;
+                s_names = p;
+            }
+
+            zipvfs_entry * e = &s_entries[s_entry_count++];
+            e->hash = name_hash(name, len);
+            e->name = s_names_size;
+            e->name_len = (uint16_t)len;
+            e->method = (uint16_t)info.compression_method;
+            e->offset = offset;
+            e->csize = info.compressed_size;
+            e->usize = info.uncompressed_size;
+            e->mtime = unix_time(&info.tmu_date);
+
+            memcpy(s_names + s_names_size, name, len);
+            s_names_size += len;
+            for (size_t i = 0; i < len; i++)
+                slashes += name[i] == '/';
+        } else if (usable || (len && name[len - 1] != '/')) {
+            skipped++;
+        }
+
+        err = unzGoToNextFile(uf);
+    }
+    unzClose(uf);
+
+    if (err != UNZ_END_OF_LIST_OF_FILE) {
+        index_free();
+        return false;
+    }
+
+    // Every slash may add a directory
+    uint32_t files = s_entry_count;
+    uint32_t total = files + slashes;
+    s_slot_count = 16;
+    while (s_slot_count < total * 2)
+        s_slot_count <<= 1;
+
+    void * p = realloc(s_entries, (total ? total : 1) * sizeof(zipvfs_entry));
+    s_slots = calloc(s_slot_count, sizeof(uint32_t));
+    if (!p || !s_slots) {
+        if (p)
+            s_entries = p;
+        index_free();
+        return false;
+    }
+    s_entries = p;
+
+    for (uint32_t i = 0; i < files; i++) {
+        if (!find(s_names + s_entries[i].name, s_entries[i].name_len))
+            insert(i);
+    }
+    index_add_dirs(files);
+
+    logv_info("[zipvfs] indexed %u files, %u directories; %u entries skipped",
+              files, s_entry_count - files, skipped);
+    return true;
+}
+
+static bool index_load(const char * path, const struct stat * st) {
+    FILE * f = fopen(path, "rb");
+    if (!f)
+        return false;
+
+    zipvfs_index_header h;
+    bool ok = fread(&h, sizeof(h), 1, f) == 1
+              && memcmp(h.magic, ZIPVFS_MAGIC, 4) == 0
+              && h.version == ZIPVFS_VERSION
+              && h.archive_size == (uint32_t)st->st_size
+              && h.archive_mtime == (uint32_t)st->st_mtime
+              && h.slots && (h.slots & (h.slots - 1)) == 0
+              && h.entries < h.slots;
+
+    if (ok) {
+        s_entries = malloc((h.entries ? h.entries : 1) * sizeof(zipvfs_entry));
+        s_slots = malloc(h.slots * sizeof(uint32_t));
+        s_names = malloc(h.names_size ? h.names_size : 1);
+        s_entry_count = h.entries;
+        s_slot_count = h.slots;
+        s_names_size = h.names_size;
+
+        ok = s_entries && s_slots && s_names
+             && fread(s_entries, sizeof(zipvfs_entry), h.entries, f) == h.entries
+             && fread(s_slots, sizeof(uint32_t), h.slots, f) == h.slots
+             && fread(s_names, 1, h.names_size, f) == h.names_size;
+    }
+    fclose(f);
+
+    for (uint32_t i = 0; ok && i < s_entry_count; i++) {
+        ok = (uint64_t)s_entries[i].name + s_entries[i].name_len <= s_names_size;
+    }
+    for (uint32_t i = 0; ok && i < s_slot_count; i++) {
+        ok = s_slots[i] <= s_entry_count;
+    }
+
+    if (!ok)
+        index_free();
+    return ok;
+}
+
+static void index_store(const char * path, const struct stat * st) {
+    FILE * f = fopen(path, "wb");
+    if (!f)
+        return;
+
+    zipvfs_index_header h;
+    memcpy(h.magic, ZIPVFS_MAGIC, 4);
+    h.version = ZIPVFS_VERSION;
+    h.archive_size = (uint32_t)st->st_size;
+    h.archive_mtime = (uint32_t)st->st_mtime;
+    h.entries = s_entry_count;
+    h.slots = s_slot_count;
+    h.names_size = s_names_size;
+
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+              && fwrite(s_entries, sizeof(zipvfs_entry), s_entry_count, f) == s_entry_count
+              && fwrite(s_slots, sizeof(uint32_t), s_slot_count, f) == s_slot_count
+              && fwrite(s_names, 1, s_names_size, f) == s_names_size;
+    fclose(f);
+
+    if (!ok)
+        remove(path);
+}
+
+bool zipvfs_mount(const char * archive, const char * root,
+                  const char * mountpoint) {
+    if (s_archive >= 0 || strlen(root) >= sizeof(s_root)
+        || strlen(mountpoint) >= sizeof(s_mountpoint))
+        return false;
+
+    struct stat st;
+    if (stat(archive, &st) != 0)
+        return false;
+
+    char index_path[512];
+    snprintf(index_path, sizeof(index_path), "%s.idx", archive);
+
+    if (!index_load(index_path, &st)) {
+        if (!index_build(archive)) {
+            logv_error("[zipvfs] could not read %s", archive);
+            return false;
+        }
+        index_store(index_path, &st);
+    }
+
+    s_archive = sceIoOpen(archive, SCE_O_RDONLY, 0);
+    if (s_archive < 0) {
+        index_free();
+        return false;
+    }
+
+    s_archive_file = blockcache_file(archive);
+
+    strcpy(s_root, root);
+    s_root_len = strlen(root);
+    strcpy(s_mountpoint, mountpoint);
+    s_mountpoint_len = strlen(mountpoint);
+
+    logv_info("[zipvfs] %s (%u entries) mounted at %s", archive, s_entry_count,
+              mountpoint);
+    return true;
+}
+
+bool zipvfs_mounted(void) {
+    return s_archive >= 0;
+}
+
+bool zipvfs_path_stat(const char * path, zipvfs_stat * st) {
+    const zipvfs_entry * e = find_path(path);
+    if (!e)
+        return false;
+
+    st->size = e->usize;
+    st->mtime = e->mtime;
+    st->dir = e->method == ZIPVFS_METHOD_DIR;
+    return true;
+}
+
+static void file_init(zipvfs_file * f, const zipvfs_entry * e) {
+    f->entry = e;
+    f->pos = 0;
+    f->unget = -1;
+    f->eof = false;
+    f->error = false;
+    f->buf_start = 0;
+    f->buf_len = 0;
+    f->zs_ready = false;
+    f->in = NULL;
+    f->in_pos = 0;
+    f->out_pos = 0;
+}
+
+static void file_release(zipvfs_file * f) {
+    if (f->zs_ready)
+        inflateEnd(&f->zs);
+    free(f->in);
+    f->zs_ready = false;
+    f->in = NULL;
+}
+
+zipvfs_file * zipvfs_open(const char * path) {
+    const zipvfs_entry * e = find_path(path);
+    if (!e || e->method == ZIPVFS_METHOD_DIR)
+        return NULL;
+
+    for (int i = 0; i < ZIPVFS_MAX_FILES; i++) {
+        if (__sync_bool_compare_and_swap(&s_files[i].used, 0, 1)) {
+            file_init(&s_files[i], e);
+            return &s_files[i];
+        }
+    }
+
+    log_warn("[zipvfs] too many open files");
+    return NULL;
+}
+
+void zipvfs_close(zipvfs_file * f) {
+    file_release(f);
+    __sync_lock_release(&f->used);
+}
+
+bool zipvfs_owns(const void * handle) {
+    uintptr_t p = (uintptr_t)handle;
+    uintptr_t base = (uintptr_t)s_files;
+    return p >= base && p < base + sizeof(s_files)
+           && (p - base) % sizeof(zipvfs_file) == 0;
+}
+
+int zipvfs_fd(const zipvfs_file * f) {
+    return ZIPVFS_FD_BASE + (int)(f - s_files);
+}
+
+zipvfs_file * zipvfs_from_fd(int fd) {
+    int i = fd - ZIPVFS_FD_BASE;
+    if (i < 0 || i >= ZIPVFS_MAX_FILES || !s_files[i].used)
+        return NULL;
+    return &s_files[i];
+}
+
+// Back to the start of the entry's DEFLATE stream
+static bool inflate_restart(zipvfs_file * f) {
+    if (!f->in && !(f->in = malloc(ZIPVFS_IN_SIZE)))
+        return false;
+
+    if (f->zs_ready) {
+        inflateReset(&f->zs);
+    } else {
+        memset(&f->zs, 0, sizeof(f->zs));
+        if (inflateInit2(&f->zs, -MAX_WBITS) != Z_OK)
+            return false;
+        f->zs_ready = true;
+    }
+
+    f->zs.avail_in = 0;
+    f->in_pos = 0;
+    f->out_pos = 0;
+    return true;
+}
+
+static int archive_read(void * dst, uint32_t len, uint32_t offset) {
+    return blockcache_pread(s_archive_file, s_archive, dst, len, offset);
+}
+
+// Next `len` bytes of the stream, fewer at its end
+static uint32_t inflate_next(zipvfs_file * f, uint8_t * dst, uint32_t len) {
+    const zipvfs_entry * e = f->entry;
+
+    f->zs.next_out = dst;
+    f->zs.avail_out = len;
+
+    while (f->zs.avail_out) {
+        if (!f->zs.avail_in && f->in_pos < e->csize) {
+            uint32_t n = e->csize - f->in_pos;
+            if (n > ZIPVFS_IN_SIZE)
+                n = ZIPVFS_IN_SIZE;
+
+            int got = archive_read(f->in, n, e->offset + f->in_pos);
+            if (got <= 0) {
+                f->error = true;
+                break;
+            }
+            f->in_pos += got;
+            f->zs.next_in = f->in;
+            f->zs.avail_in = got;
+        }
+
+        int ret = inflate(&f->zs, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END)
+            break;
+        if (ret != Z_OK) {
+            f->error = true;
+            break;
+        }
+    }
+
+    uint32_t produced = len - f->zs.avail_out;
+    f->out_pos += produced;
+    return produced;
+}
+
+// Loads the window with the bytes at f->pos, which is before the end
+static bool fill(zipvfs_file * f) {
+    const zipvfs_entry * e = f->entry;
+
+    if (e->method == 0) {
+        uint32_t n = e->usize - f->pos;
+        if (n > ZIPVFS_BUF_SIZE)
+            n = ZIPVFS_BUF_SIZE;
+
+        int got = archive_read(f->buf, n, e->offset + f->pos);
+        if (got <= 0) {
+            f->error = true;
+            return false;
+        }
+        f->buf_start = f->pos;
+        f->buf_len = got;
+        return true;
+    }
+
+    if (!f->zs_ready || f->pos < f->out_pos) {
+        if (!inflate_restart(f)) {
+            f->error = true;
+            return false;
+        }
+    }
+
+    do {
+        f->buf_start = f->out_pos;
+        f->buf_len = inflate_next(f, f->buf, ZIPVFS_BUF_SIZE);
+        if (!f->buf_len) {
+            f->error = true;
+            return false;
+        }
+    } while (f->pos >= f->out_pos);
+
+    return true;
+}
+
+size_t zipvfs_read(zipvfs_file * f, void * dst, size_t len) {
+    const zipvfs_entry * e = f->entry;
+    uint8_t * out = dst;
+    size_t done = 0;
+
+    if (len && f->unget >= 0) {
+        out[done++] = (uint8_t)f->unget;
+        f->unget = -1;
+        f->pos++;
+    }
+
+    while (done < len) {
+        if (f->pos >= e->usize) {
+            f->eof = true;
+            break;
+        }
+
+        uint32_t want = e->usize - f->pos;
+        if (want > len - done)
+            want = (uint32_t)(len - done);
+
+        if (f->pos >= f->buf_start && f->pos - f->buf_start < f->buf_len) {
+            uint32_t n = f->buf_start + f->buf_len - f->pos;
+            if (n > want)
+                n = want;
+            memcpy(out + done, f->buf + (f->pos - f->buf_start), n);
+            f->pos += n;
+            done += n;
+            continue;
+        }
+
+        // Large reads skip the window
+        if (want >= ZIPVFS_BUF_SIZE) {
+            int got = -1;
+            if (e->method == 0)
+                got = archive_read(out + done, want, e->offset + f->pos);
+            else if (f->zs_ready && f->pos == f->out_pos)
+                got = (int)inflate_next(f, out + done, want);
+
+            if (got > 0) {
+                f->pos += got;
+                done += got;
+                continue;
+            }
+            if (got == 0 || e->method == 0) {
+                f->error = true;
+                break;
+            }
+        }
+
+        if (!fill(f))
+            break;
+    }
+
+    return done;
+}
+
+int zipvfs_pread(const zipvfs_file * f, void * dst, uint32_t len,
+                 int64_t offset) {
+    const zipvfs_entry * e = f->entry;
+    if (offset < 0)
+        return -1;
+    if (offset >= e->usize)
+        return 0;
+    if (len > e->usize - offset)
+        len = e->usize - (uint32_t)offset;
+
+    if (e->method == 0)
+        return archive_read(dst, len, e->offset + (uint32_t)offset);
+
+    zipvfs_file * own = malloc(sizeof(zipvfs_file));
+    if (!own)
+        return -1;
+    file_init(own, e);
+    own->pos = (uint32_t)offset;
+    size_t got = zipvfs_read(own, dst, len);
+    bool error = own->error;
+    file_release(own);
+    free(own);
+    return got || !error ? (int)got : -1;
+}
+
+bool zipvfs_prefetch(const char * path, int64_t offset, uint32_t len) {
+    const zipvfs_entry * e = find_path(path);
+    if (!e || e->method == ZIPVFS_METHOD_DIR || s_archive < 0)
+        return false;
+    if (offset < 0 || offset >= e->usize || !len)
+        return true;
+
+    uint64_t start = (uint64_t)offset;
+    uint64_t end = start + len < e->usize ? start + len : e->usize;
+    if (e->method != 0) {
+        start = start * e->csize / e->usize;
+        end = (end * e->csize + e->usize - 1) / e->usize;
+    }
+    if (end > start)
+        blockcache_prefetch(s_archive_file, s_archive, e->offset + start,
+                            (uint32_t)(end - start));
+    return true;
+}
+
+int zipvfs_seek(zipvfs_file * f, int64_t offset, int whence) {
+    int64_t pos;
+    switch (whence) {
+        case SEEK_SET: pos = offset; break;
+        case SEEK_CUR: pos = (int64_t)f->pos + offset; break;
+        case SEEK_END: pos = (int64_t)f->entry->usize + offset; break;
+        default: return -1;
+    }
+
+    if (pos < 0 || pos > UINT32_MAX)
+        return -1;
+
+    f->pos = (uint32_t)pos;
+    f->unget = -1;
+    f->eof = false;
+    return 0;
+}
+
+int64_t zipvfs_tell(const zipvfs_file * f) {
+    return f->pos;
+}
+
+uint32_t zipvfs_size(const zipvfs_file * f) {
+    return f->entry->usize;
+}
+
+int zipvfs_getc(zipvfs_file * f) {
+    uint8_t c;
+    return zipvfs_read(f, &c, 1) ? c : EOF;
+}
+
+int zipvfs_ungetc(int c, zipvfs_file * f) {
+    if (c == EOF || f->unget >= 0 || f->pos == 0)
+        return EOF;
+
+    f->unget = (uint8_t)c;
+    f->pos--;
+    f->eof = false;
+    return (uint8_t)c;
+}
+
+char * zipvfs_gets(char * s, int n, zipvfs_file * f) {
+    if (n <= 0)
+        return NULL;
+
+    int i = 0;
+    while (i < n - 1) {
+        int c = zipvfs_getc(f);
+        if (c == EOF)
+            break;
+        s[i++] = (char)c;
+        if (c == '\n')
+            break;
+    }
+
+    if (i == 0 && n > 1)
+        return NULL;
+    s[i] = '\0';
+    return s;
+}
+
+bool zipvfs_eof(const zipvfs_file * f) {
+    return f->eof;
+}
+
+bool zipvfs_error(const zipvfs_file * f) {
+    return f->error;
+}
+
+void * zipvfs_load(const char * name, size_t * size) {
+    const zipvfs_entry * e = find(name, strlen(name));
+    if (!e || e->method == ZIPVFS_METHOD_DIR || s_archive < 0)
+        return NULL;
+
+    zipvfs_file * f = malloc(sizeof(zipvfs_file));
+    void * data = malloc(e->usize ? e->usize : 1);
+    if (!f || !data) {
+        free(f);
+        free(data);
+        return NULL;
+    }
+
+    file_init(f, e);
+    size_t got = zipvfs_read(f, data, e->usize);
+    file_release(f);
+    free(f);
+
+    if (got != e->usize) {
+        free(data);
+        return NULL;
+    }
+
+    *size = got;
+    return data;
+}
@@ -0,0 +1,81 @@
+/*
+ * utils/zipvfs.h
+ *
+ * Read-only access to the files of a zip archive (the game's .apk) as if
+ * they were extracted to a directory.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_ZIPVFS_H
+#define SOLOADER_ZIPVFS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// File descriptors of open entries start here, above any real descriptor
+#define ZIPVFS_FD_BASE 0x4000
+
+typedef struct zipvfs_file zipvfs_file;
+
+typedef struct zipvfs_stat {
+    uint32_t size;
+    uint32_t mtime; // unix time
+    bool dir;
+} zipvfs_stat;
+
+/*
+ * Index `archive` and make the entries under `root` (e.g. "assets/")
+ * visible under `mountpoint`. The index is cached next to the archive.
+ */
+bool zipvfs_mount(const char * archive, const char * root,
+                  const char * mountpoint);
+bool zipvfs_mounted(void);
+
+// Whole entry by its name in the archive, regardless of the mount. free() it.
+void * zipvfs_load(const char * name, size_t * size);
+
+// `path` is a full path under the mountpoint
+bool zipvfs_path_stat(const char * path, zipvfs_stat * st);
+
+zipvfs_file * zipvfs_open(const char * path);
+void zipvfs_close(zipvfs_file * f);
+
+// Whether `handle`, as seen by the game, is one of ours
+bool zipvfs_owns(const void * handle);
+
+int zipvfs_fd(const zipvfs_file * f);
+zipvfs_file * zipvfs_from_fd(int fd);
+
+size_t zipvfs_read(zipvfs_file * f, void * dst, size_t len);
+
+/*
+ * pread(): bytes at `offset`, 0 at the end, < 0 on error. Leaves `f` as it
+ * is, so it's safe while another thread reads from it; DEFLATE entries are
+ * inflated from the start on a stream of its own.
+ */
+int zipvfs_pread(const zipvfs_file * f, void * dst, uint32_t len,
+                 int64_t offset);
+
+/*
+ * Reads the archive blocks holding `len` bytes at `offset` of the entry at
+ * `path` into the block cache. For DEFLATE entries it's the same share of
+ * the compressed data. False if `path` isn't an entry.
+ */
+bool zipvfs_prefetch(const char * path, int64_t offset, uint32_t len);
+
+int zipvfs_seek(zipvfs_file * f, int64_t offset, int whence);
+int64_t zipvfs_tell(const zipvfs_file * f);
+uint32_t zipvfs_size(const zipvfs_file * f);
+
+int zipvfs_getc(zipvfs_file * f);
+int zipvfs_ungetc(int c, zipvfs_file * f);
+char * zipvfs_gets(char * s, int n, zipvfs_file * f);
+bool zipvfs_eof(const zipvfs_file * f);
+bool zipvfs_error(const zipvfs_file * f);
+
+#endif // SOLOADER_ZIPVFS_H
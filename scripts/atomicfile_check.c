@@ -0,0 +1,377 @@
+/*
+ * scripts/atomicfile_check.c
+ *
+ * Checks loader/utils/atomicfile.c by cutting a write short at every step:
+ * rename(), remove(), fwrite() and fclose() are wrapped at link time, and
+ * the Nth call of a write either kills the process (fwrite() leaves half
+ * its data behind first) or fails. rename() also refuses to replace a
+ * file, as on the card. After each cut:
+ *
+ * - recovery, itself cut short at every step and then run to the end,
+ *   leaves the old or the new file and no staging files;
+ * - once the data was staged as ready, it's the new file;
+ * - a write that returned true left the new file;
+ * - the next write to another file puts the cut one in place first,
+ *   never over the wrong file.
+ *
+ * Recovery is also made to fail at every step. A ready file whose target
+ * path was lost or damaged is kept aside. Built by the host
+ * project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/atomicfile_check
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "utils/atomicfile.h"
+#include "utils/utils.h"
+
+#define FILES       DATA_PATH "atomicfile_check/"
+#define SAVE        FILES "save.dat"
+#define OTHER       FILES "other.dat"
+
+// ATOMICFILE_* in atomicfile.c
+#define STAGED_PATH DATA_PATH ".commit.path"
+#define STAGED_TEMP DATA_PATH ".commit.tmp"
+#define STAGED_NEW  DATA_PATH ".commit.new"
+#define STAGED_LOST DATA_PATH ".commit.lost"
+
+#define CRASHED     42 // exit code of a child killed by a fault
+
+static int s_failed;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+    } \
+} while (0)
+
+/*
+ * Faults: with s_budget at N, the Nth wrapped call from now on crashes or
+ * fails. -1 turns them off.
+ */
+typedef enum fault {
+    FAULT_CRASH,
+    FAULT_FAIL,
+} fault;
+
+static fault s_fault;
+static int s_budget = -1;
+static bool s_fired;
+
+static bool fault_now(void) {
+    if (s_budget < 0 || s_budget-- > 0)
+        return false;
+    s_fired = true;
+    return true;
+}
+
+int __real_rename(const char * from, const char * to);
+int __real_remove(const char * path);
+size_t __real_fwrite(const void * src, size_t size, size_t n, FILE * f);
+int __real_fclose(FILE * f);
+
+int __wrap_rename(const char * from, const char * to) {
+    if (fault_now()) {
+        if (s_fault == FAULT_CRASH)
+            _exit(CRASHED);
+        errno = EIO;
+        return -1;
+    }
+
+    struct stat st;
+    if (stat(to, &st) == 0) {
+        errno = EEXIST;
+        return -1;
+    }
+    return __real_rename(from, to);
+}
+
+int __wrap_remove(const char * path) {
+    if (fault_now()) {
+        if (s_fault == FAULT_CRASH)
+            _exit(CRASHED);
+        errno = EIO;
+        return -1;
+    }
+    return __real_remove(path);
+}
+
+size_t __wrap_fwrite(const void * src, size_t size, size_t n, FILE * f) {
+    if (fault_now()) {
+        size_t half = size * n / 2;
+        __real_fwrite(src, 1, half, f);
+        fflush(f);
+        if (s_fault == FAULT_CRASH)
+            _exit(CRASHED);
+        return half / (size ? size : 1);
+    }
+    return __real_fwrite(src, size, n, f);
+}
+
+int __wrap_fclose(FILE * f) {
+    if (fault_now()) {
+        // Whatever is still buffered never reaches the card, and a close
+        // that fails didn't get all of it there either
+        if (s_fault == FAULT_CRASH)
+            _exit(CRASHED);
+        int fd = fileno(f);
+        if ((fcntl(fd, F_GETFL) & O_ACCMODE) != O_RDONLY) {
+            fflush(f);
+            if (ftruncate(fd, lseek(fd, 0, SEEK_END) / 2) != 0)
+                perror("ftruncate");
+        }
+        __real_fclose(f);
+        return EOF;
+    }
+    return __real_fclose(f);
+}
+
+static char s_old[5000], s_new[7000], s_other[3000];
+
+static void fill(char * data, size_t len, char c) {
+    for (size_t i = 0; i < len; i++)
+        data[i] = (char)(c + i % 7);
+}
+
+// Contents of `path`, or -1 if it isn't there
+static long slurp(const char * path, char * buf, size_t size) {
+    FILE * f = fopen(path, "rb");
+    if (!f)
+        return -1;
+    long len = (long)fread(buf, 1, size, f);
+    __real_fclose(f);
+    return len;
+}
+
+static bool has(const char * path, const char * data, size_t len) {
+    static char buf[16 * 1024];
+    return slurp(path, buf, sizeof(buf)) == (long)len
+           && !memcmp(buf, data, len);
+}
+
+static bool exists(const char * path) {
+    struct stat st;
+    return stat(path, &st) == 0;
+}
+
+static bool staging_left(void) {
+    return exists(STAGED_PATH) || exists(STAGED_TEMP) || exists(STAGED_NEW);
+}
+
+// All files involved, to put everything back as a crash left it
+static const char * s_files[] = {
+    SAVE, OTHER, STAGED_PATH, STAGED_TEMP, STAGED_NEW, STAGED_LOST,
+};
+#define FILE_COUNT (int)(sizeof(s_files) / sizeof(s_files[0]))
+
+typedef struct snapshot {
+    char data[FILE_COUNT][16 * 1024];
+    long len[FILE_COUNT];
+} snapshot;
+
+static void take(snapshot * s) {
+    for (int i = 0; i < FILE_COUNT; i++)
+        s->len[i] = slurp(s_files[i], s->data[i], sizeof(s->data[i]));
+}
+
+static void put_back(const snapshot * s) {
+    for (int i = 0; i < FILE_COUNT; i++) {
+        __real_remove(s_files[i]);
+        if (s->len[i] < 0)
+            continue;
+        FILE * f = fopen(s_files[i], "wb");
+        __real_fwrite(s->data[i], 1, (size_t)s->len[i], f);
+        __real_fclose(f);
+    }
+}
+
+static void reset(void) {
+    for (int i = 0; i < FILE_COUNT; i++)
+        __real_remove(s_files[i]);
+    CHECK(atomicfile_write(SAVE, s_old, sizeof(s_old)), "first write");
+}
+
+/*
+ * Runs `what` in a child that crashes at its `budget`th step: 0 if it
+ * returned true, 1 if false, CRASHED if it didn't finish
+ */
+static int crash_at(int budget, bool (* what)(void)) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        s_fault = FAULT_CRASH;
+        s_budget = budget;
+        _exit(what() ? 0 : 1);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static bool write_new(void) {
+    return atomicfile_write(SAVE, s_new, sizeof(s_new));
+}
+
+static bool recover(void) {
+    atomicfile_recover();
+    return true;
+}
+
+// Runs `what` with its `budget`th step failing; whether a step did
+static bool fail_at(int budget, bool (* what)(void), bool * ok) {
+    s_fault = FAULT_FAIL;
+    s_budget = budget;
+    s_fired = false;
+    *ok = what();
+    s_budget = -1;
+    return s_fired;
+}
+
+// After a cut write, and whatever came after it
+static void check_save(const char * when, int n, bool done, bool ready) {
+    bool old = has(SAVE, s_old, sizeof(s_old));
+    bool new = has(SAVE, s_new, sizeof(s_new));
+    CHECK(old || new, "%s %d: the save is neither old nor new", when, n);
+    CHECK(new || !done, "%s %d: returned true with the old save", when, n);
+    CHECK(new || !ready, "%s %d: staged data was dropped", when, n);
+    CHECK(!staging_left(), "%s %d: staging files left", when, n);
+}
+
+static void check_crashes(void) {
+    static snapshot crashed;
+    int points = 0, recoveries = 0;
+
+    for (int n = 0; ; n++) {
+        reset();
+        int code = crash_at(n, write_new);
+        CHECK(code == 0 || code == CRASHED, "crash %d: exit %d", n, code);
+        bool ready = exists(STAGED_NEW);
+        take(&crashed);
+
+        // Recovery cut short itself, at every step, and then finished
+        for (int m = 0; ; m++) {
+            put_back(&crashed);
+            int rc = crash_at(m, recover);
+            atomicfile_recover();
+            check_save("crash", n, code == 0, ready);
+            recoveries++;
+            if (rc != CRASHED)
+                break;
+        }
+
+        // Or failing at every step
+        for (int m = 0; ; m++) {
+            put_back(&crashed);
+            bool ok;
+            bool fired = fail_at(m, recover, &ok);
+            atomicfile_recover();
+            check_save("crash, failed recovery,", n, code == 0, ready);
+            recoveries++;
+            if (!fired)
+                break;
+        }
+
+        // Or the next write comes first
+        put_back(&crashed);
+        CHECK(atomicfile_write(OTHER, s_other, sizeof(s_other)), "crash %d: "
+              "next write failed", n);
+        CHECK(has(OTHER, s_other, sizeof(s_other)), "crash %d: next write "
+              "not there", n);
+        check_save("crash, then another write,", n, code == 0, ready);
+
+        if (code == 0)
+            break;
+        points++;
+    }
+    printf("   %d crash points, %d recoveries\n", points, recoveries);
+}
+
+static void check_failures(void) {
+    int points = 0;
+    for (int n = 0; ; n++) {
+        reset();
+        bool ok;
+        bool fired = fail_at(n, write_new, &ok);
+        bool ready = exists(STAGED_NEW);
+
+        // Nothing half-written in place, whether it failed or not; the save
+        // is only ever missing with the new one ready to take its place
+        bool old = has(SAVE, s_old, sizeof(s_old));
+        CHECK(old || has(SAVE, s_new, sizeof(s_new))
+              || (ready && !exists(SAVE)), "failure %d: the save is neither "
+              "old nor new", n);
+        CHECK(!ok || !old, "failure %d: returned true with the old save", n);
+        CHECK(ok || ready || old, "failure %d: the save changed, but the "
+              "write failed", n);
+
+        CHECK(atomicfile_write(OTHER, s_other, sizeof(s_other)), "failure "
+              "%d: next write failed", n);
+        CHECK(has(OTHER, s_other, sizeof(s_other)), "failure %d: next write "
+              "not there", n);
+        check_save("failure, then another write,", n, ok, ready);
+
+        if (!fired)
+            break;
+        points++;
+    }
+    printf("   %d failure points\n", points);
+}
+
+static void check_lost(void) {
+    // A ready file with no path to go to, or a damaged one: kept aside,
+    // not put anywhere
+    static const char damaged[] = FILES "save.dat\0\xFF";
+    for (int i = 0; i < 2; i++) {
+        reset();
+        FILE * f = fopen(STAGED_NEW, "wb");
+        __real_fwrite(s_new, 1, sizeof(s_new), f);
+        __real_fclose(f);
+        f = fopen(STAGED_PATH, "wb");
+        __real_fwrite(damaged, 1, i ? sizeof(damaged) - 1 : 0, f);
+        __real_fclose(f);
+
+        atomicfile_recover();
+        CHECK(has(STAGED_LOST, s_new, sizeof(s_new)), "%d: lost data not "
+              "kept", i);
+        CHECK(has(SAVE, s_old, sizeof(s_old)), "%d: save changed", i);
+        CHECK(!staging_left(), "%d: staging files left", i);
+    }
+
+    // Empty files are files too
+    CHECK(atomicfile_write(SAVE, "", 0) && has(SAVE, "", 0), "empty file");
+}
+
+int main(void) {
+    char dir[] = FILES;
+    mkpath(dir, 0755);
+    fill(s_old, sizeof(s_old), 'a');
+    fill(s_new, sizeof(s_new), 'n');
+    fill(s_other, sizeof(s_other), '0');
+
+    check_crashes();
+    check_failures();
+    check_lost();
+
+    if (s_failed)
+        return 1;
+    printf("ok: writes and recoveries cut short at every step\n");
+    return 0;
+}
@@ -0,0 +1,756 @@
+/*
+ * scripts/bench.c
+ *
+ * Times the loader's hot paths that build on Linux and prints the results
+ * as JSON. Built by the host project next to the checks:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/bench [name...] > bench.json
+ *
+ * With names, only the benchmarks whose name starts with one of them run.
+ * Each benchmark is run five times and the fastest run is reported. The
+ * numbers come from the host CPU and libc, so they are only good for
+ * comparing two builds of the loader with each other.
+ *
+ * What the game provides around those paths is stood in for here: a
+ * hand-built module for so_util to load, the game's JNI methods, and a
+ * scripted pad for the controls. Paths that can't be built on the host are
+ * listed under "not_covered" with the reason.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <psp2/ctrl.h>
+#include <psp2/touch.h>
+#include <FalsoJNI/FalsoJNI.h>
+#include <FalsoJNI/FalsoJNI_Impl.h>
+#include <so_util/so_util.h>
+
+#include "reimpl/controls.h"
+#include "utils/mounts.h"
+#include "utils/settings.h"
+#include "utils/utils.h"
+
+#define FILES_PATH DATA_PATH"com.gameloft.android.ANMP.GloftSDHM/files/"
+
+#define BENCH_RUNS       5
+#define BENCH_PATHS      4096   // more than the mount cache holds
+#define BENCH_HOT_PATHS  256
+
+#define BENCH_SYMBOLS    8192   // exported by the module
+#define BENCH_IMPORTS    320    // imported by it, all from the dynlib table
+#define BENCH_RELATIVE   4096   // relocations so_resolve goes past
+#define BENCH_DYNLIB     378    // as many as loader/dynlib.c has
+#define BENCH_BUCKETS    4099
+#define BENCH_IMAGE_SIZE (2 << 20)
+
+#define BENCH_ARRAYS     48     // live Java arrays
+#define BENCH_ARRAY_LEN  4096   // bytes, an audio buffer
+
+#define BENCH_PAD_STATES 256
+
+typedef struct bench {
+    const char * name;
+    size_t iterations;
+    size_t bytes;               // per iteration, 0 if it's not about size
+    void (* setup)(void);
+    void (* run)(size_t iterations);
+} bench;
+
+static volatile uint32_t s_sink;
+
+static char * s_paths[BENCH_PATHS];
+static uint8_t * s_buf;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Paths the way the game spells them: through /sdcard, relative, and with
+// the odd repeated slash or "./"
+static void setup_paths(void) {
+    static const char * prefixes[] = {
+        "/sdcard/gameloft/games/GloftSDHM/",
+        "/sdcard/Android/data/com.gameloft.android.ANMP.GloftSDHM/files/",
+        "data//",
+        "./data/sounds/",
+    };
+    static const char * exts[] = { ".pvr", ".bsprite", ".ogg", ".lvl" };
+
+    mounts_add("/", FILES_PATH);
+    mounts_add("/sdcard", FILES_PATH);
+    mounts_add("/sdcard/Android/data", DATA_PATH);
+
+    for (int i = 0; i < BENCH_PATHS; i++) {
+        char path[256];
+        snprintf(path, sizeof(path), "%slevel%02d/asset_%04d%s",
+                 prefixes[i % 4], i / 64, i, exts[(i / 4) % 4]);
+        s_paths[i] = strdup(path);
+    }
+}
+
+static void translate(size_t iterations, size_t count) {
+    char out[1024];
+    for (size_t i = 0; i < iterations; i++) {
+        mounts_translate(s_paths[i % count], out, sizeof(out));
+        s_sink += (uint8_t)out[0];
+    }
+}
+
+// The same few hundred files opened over and over, as in a level
+static void run_mounts_hot(size_t iterations) {
+    translate(iterations, BENCH_HOT_PATHS);
+}
+
+// A new path every time, so every lookup misses the cache
+static void run_mounts_cold(size_t iterations) {
+    translate(iterations, BENCH_PATHS);
+}
+
+static void setup_buf(void) {
+    s_buf = malloc(64 * 1024);
+    for (int i = 0; i < 64 * 1024; i++)
+        s_buf[i] = (uint8_t)(i * 7 + (i >> 8));
+}
+
+// A shader's worth of source, the way the gxp cache used to key them
+static void run_string_sha1(size_t iterations) {
+    for (size_t i = 0; i < iterations; i++) {
+        char * hash = get_string_sha1(s_buf + (i & 63), 4096);
+        s_sink += (uint8_t)hash[0];
+        free(hash);
+    }
+}
+
+static void setup_settings(void) {
+    char dir[] = DATA_PATH;
+    mkpath(dir, 0755);
+
+    settings_reset();
+    setting_fpsLock = 60;
+    settings_save();
+}
+
+static void run_settings_load(size_t iterations) {
+    for (size_t i = 0; i < iterations; i++) {
+        settings_load();
+        s_sink += (uint32_t)setting_fpsLock;
+    }
+}
+
+// A module laid out the way so_util expects the game's: one PT_LOAD holding
+// everything, with .dynsym, .dynstr, .hash, .rel.dyn, .rel.plt, .dynamic
+// and a GOT. Addresses are offsets, the segment is linked at 0.
+so_module so_mod;
+
+static char * s_symbols[BENCH_SYMBOLS];
+static so_default_dynlib s_dynlib[BENCH_DYNLIB];
+static uint8_t * s_image;
+static size_t s_image_len;
+
+// so_util reports what it can't load through the loader's
+void fatal_error(const char * fmt, ...) {
+    va_list list;
+    va_start(list, fmt);
+    vfprintf(stderr, fmt, list);
+    va_end(list);
+    exit(1);
+}
+
+static uint32_t elf_hash(const char * name) {
+    uint32_t h = 0;
+    while (*name) {
+        h = (h << 4) + (uint8_t)*name++;
+        uint32_t g = h & 0xf0000000;
+        if (g)
+            h ^= g >> 24;
+        h &= ~g;
+    }
+    return h;
+}
+
+static uint32_t image_add(const void * data, size_t len) {
+    uint32_t off = (uint32_t)s_image_len;
+    if (s_image_len + len > BENCH_IMAGE_SIZE)
+        fatal_error("bench: the module outgrew %d bytes\n", BENCH_IMAGE_SIZE);
+    if (data)
+        memcpy(s_image + off, data, len);
+    s_image_len = (s_image_len + len + 3) & ~(size_t)3;
+    return off;
+}
+
+static uint32_t image_string(char * strtab, uint32_t * len, const char * str) {
+    uint32_t off = *len;
+    strcpy(strtab + off, str);
+    *len += (uint32_t)strlen(str) + 1;
+    return off;
+}
+
+static void build_module(void) {
+    static const char * classes[] = {
+        "CLevel", "PlayerComponent", "CGameObject", "CAnimatedMesh",
+        "CSoundManager", "CMenuScreen", "CCameraController", "Application",
+    };
+    static const char * prefixes[] = {
+        "gl", "str", "mem", "pthread_", "sce", "f", "__cxa_", "_ZNSs",
+    };
+    static const char * needed[] = {
+        "libc.so", "libm.so", "libdl.so", "liblog.so", "libstdc++.so",
+        "libGLESv1_CM.so",
+    };
+    const int nsyms = 1 + BENCH_SYMBOLS + BENCH_IMPORTS;
+
+    for (int i = 0; i < BENCH_SYMBOLS; i++) {
+        char name[96];
+        const char * c = classes[i % 8];
+        snprintf(name, sizeof(name), "_ZN%zu%s10Update%04dEv", strlen(c), c,
+                 i);
+        s_symbols[i] = strdup(name);
+    }
+    for (int i = 0; i < BENCH_DYNLIB; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "%simport%d", prefixes[i % 8], i);
+        s_dynlib[i].symbol = strdup(name);
+        s_dynlib[i].func = (uintptr_t)&s_dynlib[i];
+    }
+
+    char * strtab = calloc(1, BENCH_IMAGE_SIZE / 2);
+    uint32_t strtab_len = 1;
+    Elf32_Sym * syms = calloc(nsyms, sizeof(*syms));
+    for (int i = 0; i < BENCH_SYMBOLS; i++) {
+        Elf32_Sym * sym = &syms[1 + i];
+        sym->st_name = image_string(strtab, &strtab_len, s_symbols[i]);
+        sym->st_value = 0x1000 + i * 16;
+        sym->st_size = 16;
+        sym->st_info = ELF32_ST_INFO(STB_GLOBAL, STT_FUNC);
+        sym->st_shndx = 1;
+    }
+    // Imports, spread over the table: so_resolve scans it for each
+    for (int i = 0; i < BENCH_IMPORTS; i++) {
+        Elf32_Sym * sym = &syms[1 + BENCH_SYMBOLS + i];
+        sym->st_name = image_string(strtab, &strtab_len,
+                                    s_dynlib[i * 37 % BENCH_DYNLIB].symbol);
+        sym->st_info = ELF32_ST_INFO(STB_GLOBAL, STT_FUNC);
+        sym->st_shndx = SHN_UNDEF;
+    }
+
+    Elf32_Dyn dyn[sizeof(needed) / sizeof(needed[0]) + 2];
+    int ndyn = 0;
+    for (size_t i = 0; i < sizeof(needed) / sizeof(needed[0]); i++) {
+        dyn[ndyn].d_tag = DT_NEEDED;
+        dyn[ndyn++].d_un.d_ptr = image_string(strtab, &strtab_len, needed[i]);
+    }
+    dyn[ndyn].d_tag = DT_SONAME;
+    dyn[ndyn++].d_un.d_ptr = image_string(strtab, &strtab_len,
+                                          "libGloftSDHM.so");
+    dyn[ndyn].d_tag = DT_NULL;
+    dyn[ndyn++].d_un.d_ptr = 0;
+
+    uint32_t * hash = calloc(2 + BENCH_BUCKETS + nsyms, sizeof(uint32_t));
+    uint32_t * bucket = &hash[2];
+    uint32_t * chain = &bucket[BENCH_BUCKETS];
+    hash[0] = BENCH_BUCKETS;
+    hash[1] = nsyms;
+    for (int i = 1; i < nsyms; i++) {
+        uint32_t h = elf_hash(strtab + syms[i].st_name) % BENCH_BUCKETS;
+        chain[i] = bucket[h];
+        bucket[h] = i;
+    }
+
+    s_image = calloc(1, BENCH_IMAGE_SIZE);
+    s_image_len = 0;
+    image_add(NULL, sizeof(Elf32_Ehdr));
+    image_add(NULL, sizeof(Elf32_Phdr));
+    uint32_t dynsym_off = image_add(syms, nsyms * sizeof(*syms));
+    uint32_t dynstr_off = image_add(strtab, strtab_len);
+    uint32_t hash_off = image_add(hash, (2 + BENCH_BUCKETS + nsyms) * 4);
+    uint32_t dynamic_off = image_add(dyn, ndyn * sizeof(*dyn));
+
+    // so_resolve writes host pointers into the GOT: 8 bytes a slot here
+    uint32_t got_off = image_add(NULL, BENCH_IMPORTS * sizeof(uintptr_t));
+    int nrel_dyn = BENCH_RELATIVE + BENCH_IMPORTS / 8;
+    int nrel_plt = BENCH_IMPORTS - BENCH_IMPORTS / 8;
+    Elf32_Rel * rel = calloc(nrel_dyn + nrel_plt, sizeof(*rel));
+    for (int i = 0; i < BENCH_RELATIVE; i++) {
+        rel[i].r_offset = got_off;
+        rel[i].r_info = ELF32_R_INFO(0, R_ARM_RELATIVE);
+    }
+    for (int i = 0; i < BENCH_IMPORTS; i++) {
+        Elf32_Rel * r = &rel[BENCH_RELATIVE + i];
+        r->r_offset = got_off + i * sizeof(uintptr_t);
+        r->r_info = ELF32_R_INFO(1 + BENCH_SYMBOLS + i,
+                                 i < BENCH_IMPORTS / 8 ? R_ARM_GLOB_DAT
+                                                       : R_ARM_JUMP_SLOT);
+    }
+    uint32_t reldyn_off = image_add(rel, nrel_dyn * sizeof(*rel));
+    uint32_t relplt_off = image_add(rel + nrel_dyn, nrel_plt * sizeof(*rel));
+
+    static const char shstr[] =
+        "\0.dynsym\0.dynstr\0.hash\0.dynamic\0.got\0.rel.dyn\0.rel.plt"
+        "\0.shstrtab";
+    uint32_t shstr_off = image_add(shstr, sizeof(shstr));
+    const struct {
+        uint32_t name, type, off, size;
+    } sections[] = {
+        { 0, 0, 0, 0 },
+        { 1, SHT_DYNSYM, dynsym_off, nsyms * sizeof(*syms) },
+        { 9, SHT_STRTAB, dynstr_off, strtab_len },
+        { 17, SHT_HASH, hash_off, (2 + BENCH_BUCKETS + nsyms) * 4 },
+        { 23, SHT_DYNAMIC, dynamic_off, ndyn * sizeof(*dyn) },
+        { 32, SHT_PROGBITS, got_off, BENCH_IMPORTS * sizeof(uintptr_t) },
+        { 37, SHT_REL, reldyn_off, nrel_dyn * sizeof(*rel) },
+        { 46, SHT_REL, relplt_off, nrel_plt * sizeof(*rel) },
+        { 55, SHT_STRTAB, shstr_off, sizeof(shstr) },
+    };
+    const int nsections = sizeof(sections) / sizeof(sections[0]);
+    uint32_t shdr_off = image_add(NULL, nsections * sizeof(Elf32_Shdr));
+    Elf32_Shdr * shdr = (Elf32_Shdr *)(s_image + shdr_off);
+    for (int i = 0; i < nsections; i++) {
+        shdr[i].sh_name = sections[i].name;
+        shdr[i].sh_type = sections[i].type;
+        shdr[i].sh_addr = sections[i].off;
+        shdr[i].sh_offset = sections[i].off;
+        shdr[i].sh_size = sections[i].size;
+    }
+
+    Elf32_Ehdr * ehdr = (Elf32_Ehdr *)s_image;
+    memcpy(ehdr->e_ident, ELFMAG, SELFMAG);
+    ehdr->e_ident[EI_CLASS] = ELFCLASS32;
+    ehdr->e_type = ET_DYN;
+    ehdr->e_machine = EM_ARM;
+    ehdr->e_version = EV_CURRENT;
+    ehdr->e_phoff = sizeof(Elf32_Ehdr);
+    ehdr->e_shoff = shdr_off;
+    ehdr->e_ehsize = sizeof(Elf32_Ehdr);
+    ehdr->e_phentsize = sizeof(Elf32_Phdr);
+    ehdr->e_phnum = 1;
+    ehdr->e_shentsize = sizeof(Elf32_Shdr);
+    ehdr->e_shnum = nsections;
+    ehdr->e_shstrndx = nsections - 1;
+
+    Elf32_Phdr * phdr = (Elf32_Phdr *)(s_image + sizeof(Elf32_Ehdr));
+    phdr->p_type = PT_LOAD;
+    phdr->p_filesz = phdr->p_memsz = (Elf32_Word)s_image_len;
+    phdr->p_flags = PF_R | PF_X;
+    phdr->p_align = 0x1000;
+
+    free(rel);
+    free(hash);
+    free(syms);
+    free(strtab);
+}
+
+static void setup_so(void) {
+    build_module();
+    int ret = so_mem_load(&so_mod, s_image, s_image_len, 0x98000000);
+    if (ret < 0)
+        fatal_error("bench: so_mem_load failed: %d\n", ret);
+
+    // Timing a module so_util misreads would mean nothing
+    for (int i = 0; i < BENCH_SYMBOLS; i++) {
+        uintptr_t addr = so_mod.text_base + 0x1000 + (uintptr_t)i * 16;
+        if (so_symbol(&so_mod, s_symbols[i]) != addr)
+            fatal_error("bench: so_symbol(\"%s\") is wrong\n", s_symbols[i]);
+    }
+    so_resolve(&so_mod, s_dynlib, sizeof(s_dynlib), 0);
+    const uintptr_t * got = (const uintptr_t *)
+        (so_mod.text_base + so_mod.relplt[0].r_offset);
+    if (*got != s_dynlib[BENCH_IMPORTS / 8 * 37 % BENCH_DYNLIB].func)
+        fatal_error("bench: so_resolve left the GOT alone\n");
+}
+
+// The lookups the loader makes when it patches and starts the game
+static void run_so_symbol(size_t iterations) {
+    for (size_t i = 0; i < iterations; i++)
+        s_sink += (uint32_t)so_symbol(&so_mod,
+                                      s_symbols[i * 7919 % BENCH_SYMBOLS]);
+}
+
+static void run_so_resolve(size_t iterations) {
+    for (size_t i = 0; i < iterations; i++) {
+        so_resolve(&so_mod, s_dynlib, sizeof(s_dynlib), 0);
+        s_sink += (uint32_t)so_mod.num_relplt;
+    }
+}
+
+// The game's JNI methods with the ids and types of falsojni_impl.c, doing
+// nothing, so that only FalsoJNI's dispatch is timed
+static void jni_void(jmethodID id, va_list args) {
+    (void)args;
+    s_sink += (uint32_t)(uintptr_t)id;
+}
+
+static jint jni_int(jmethodID id, va_list args) {
+    (void)args;
+    return (jint)(uintptr_t)id;
+}
+
+static jlong jni_long(jmethodID id, va_list args) {
+    (void)args;
+    return (jlong)(uintptr_t)id;
+}
+
+static jfloat jni_float(jmethodID id, va_list args) {
+    (void)args;
+    return (jfloat)(uintptr_t)id;
+}
+
+static jobject jni_object(jmethodID id, va_list args) {
+    (void)args;
+    return (jobject)id;
+}
+
+NameToMethodID nameToMethodId[] = {
+    { 1, "Exit", METHOD_TYPE_VOID },
+    { 2, "openBrowser", METHOD_TYPE_VOID },
+    { 3, "isWifiEnabled", METHOD_TYPE_INT },
+    { 4, "Pause", METHOD_TYPE_VOID },
+    { 5, "GetPhoneLanguage", METHOD_TYPE_INT },
+    { 6, "launchGLLive", METHOD_TYPE_VOID },
+    { 7, "getManufacture", METHOD_TYPE_INT },
+    { 8, "notifyTrophy", METHOD_TYPE_VOID },
+    { 9, "launchIGP", METHOD_TYPE_VOID },
+    { 10, "GetCurrentTime", METHOD_TYPE_LONG },
+    { 11, "GetTextureFormat", METHOD_TYPE_INT },
+    { 12, "PrintDebug", METHOD_TYPE_VOID },
+    { 13, "GetPhoneManufacturer", METHOD_TYPE_OBJECT },
+    { 14, "GetPhoneModel", METHOD_TYPE_OBJECT },
+    { 15, "GetPhoneCPUName", METHOD_TYPE_OBJECT },
+    { 16, "GetPhoneCPUFreq", METHOD_TYPE_FLOAT },
+    { 17, "GetPhoneGPUName", METHOD_TYPE_OBJECT },
+    { 18, "GC", METHOD_TYPE_VOID },
+    { 19, "GetOSVersion", METHOD_TYPE_INT },
+    { 20, "GameTracking", METHOD_TYPE_VOID },
+    { 21, "sendAppToBackground", METHOD_TYPE_VOID },
+    { 22, "android/media/AudioTrack/<init>", METHOD_TYPE_OBJECT },
+    { 23, "getMinBufferSize", METHOD_TYPE_INT },
+    { 24, "play", METHOD_TYPE_VOID },
+    { 25, "pause", METHOD_TYPE_VOID },
+    { 26, "stop", METHOD_TYPE_VOID },
+    { 27, "release", METHOD_TYPE_VOID },
+    { 28, "write", METHOD_TYPE_INT },
+};
+
+MethodsBoolean methodsBoolean[] = {};
+MethodsByte methodsByte[] = {};
+MethodsChar methodsChar[] = {};
+MethodsDouble methodsDouble[] = {};
+MethodsFloat methodsFloat[] = {
+    { 16, jni_float },
+};
+MethodsInt methodsInt[] = {
+    { 3, jni_int }, { 5, jni_int }, { 7, jni_int }, { 11, jni_int },
+    { 19, jni_int }, { 23, jni_int }, { 28, jni_int },
+};
+MethodsLong methodsLong[] = {
+    { 10, jni_long },
+};
+MethodsObject methodsObject[] = {
+    { 13, jni_object }, { 14, jni_object }, { 15, jni_object },
+    { 17, jni_object }, { 22, jni_object },
+};
+MethodsShort methodsShort[] = {};
+MethodsVoid methodsVoid[] = {
+    { 1, jni_void }, { 2, jni_void }, { 4, jni_void }, { 6, jni_void },
+    { 8, jni_void }, { 9, jni_void }, { 20, jni_void }, { 18, jni_void },
+    { 12, jni_void }, { 21, jni_void }, { 24, jni_void }, { 25, jni_void },
+    { 26, jni_void }, { 27, jni_void },
+};
+
+NameToFieldID nameToFieldId[] = {};
+
+FieldsBoolean fieldsBoolean[] = {};
+FieldsByte fieldsByte[] = {};
+FieldsChar fieldsChar[] = {};
+FieldsDouble fieldsDouble[] = {};
+FieldsFloat fieldsFloat[] = {};
+FieldsInt fieldsInt[] = {};
+FieldsObject fieldsObject[] = {};
+FieldsLong fieldsLong[] = {};
+FieldsShort fieldsShort[] = {};
+
+__FALSOJNI_IMPL_CONTAINER_SIZES
+
+extern JavaDynArray * javaDynArrays; // FalsoJNI_ImplBridge.c
+
+static JavaDynArray * s_arrays[BENCH_ARRAYS];
+
+static void setup_jni(void) {
+    jni_init();
+
+    // Growing the table moves it, and with it the arrays handed out before.
+    // Grow it once up front and leave room, so the runs never do.
+    for (int i = 0; i < BENCH_ARRAYS + 16; i++)
+        jda_alloc(BENCH_ARRAY_LEN, FIELD_TYPE_BYTE);
+    for (int i = 0; i < BENCH_ARRAYS + 16; i++)
+        jda_free(&javaDynArrays[i]);
+    for (int i = 0; i < BENCH_ARRAYS; i++)
+        s_arrays[i] = jda_alloc(BENCH_ARRAY_LEN, FIELD_TYPE_BYTE);
+}
+
+// Calls the way the game's C++ makes them, through the JNIEnv table, going
+// round every method in turn
+static void run_falsojni_dispatch(size_t iterations) {
+    JNIEnv * env = &jni;
+    const int count = sizeof(nameToMethodId) / sizeof(nameToMethodId[0]);
+    for (size_t i = 0; i < iterations; i++) {
+        const NameToMethodID * m = &nameToMethodId[i % count];
+        jmethodID id = (jmethodID)(uintptr_t)m->id;
+        switch (m->f) {
+            case METHOD_TYPE_VOID:
+                (*env)->CallVoidMethod(env, NULL, id);
+                break;
+            case METHOD_TYPE_INT:
+                s_sink += (uint32_t)(*env)->CallIntMethod(env, NULL, id);
+                break;
+            case METHOD_TYPE_LONG:
+                s_sink += (uint32_t)(*env)->CallLongMethod(env, NULL, id);
+                break;
+            case METHOD_TYPE_FLOAT:
+                s_sink += (uint32_t)(*env)->CallFloatMethod(env, NULL, id);
+                break;
+            default:
+                s_sink += (uint32_t)(uintptr_t)
+                    (*env)->CallObjectMethod(env, NULL, id);
+                break;
+        }
+    }
+}
+
+// Every Get/Set<Type>ArrayRegion looks its array up
+static void run_jda_find(size_t iterations) {
+    for (size_t i = 0; i < iterations; i++)
+        s_sink += (uint32_t)jda_find(s_arrays[i * 7 % BENCH_ARRAYS])->len;
+}
+
+static void run_jda_alloc_free(size_t iterations) {
+    for (size_t i = 0; i < iterations; i++) {
+        JavaDynArray * jda = jda_alloc(BENCH_ARRAY_LEN, FIELD_TYPE_BYTE);
+        s_sink += (uint32_t)jda->len;
+        jda_free(jda);
+    }
+}
+
+// The pad, as a script: the left stick going round, the right one nudged
+// now and then, and the mapped buttons pressed in turn, some together
+static SceCtrlData s_pad[BENCH_PAD_STATES];
+static size_t s_pad_polls;
+static int s_press_key;
+
+int sceCtrlSetSamplingModeExt(SceCtrlPadInputMode mode) {
+    (void)mode;
+    return 0;
+}
+
+int sceCtrlPeekBufferPositiveExt2(int port, SceCtrlData * pad_data,
+                                  int count) {
+    (void)port; (void)count;
+    *pad_data = s_pad[s_pad_polls++ % BENCH_PAD_STATES];
+    return 1;
+}
+
+int sceTouchSetSamplingState(SceUInt32 port, SceUInt32 state) {
+    (void)port; (void)state;
+    return 0;
+}
+
+// Nobody touches the screen while playing with the buttons
+int sceTouchPeek(SceUInt32 port, SceTouchData * data, SceUInt32 count) {
+    (void)port; (void)count;
+    memset(data, 0, sizeof(*data));
+    return 1;
+}
+
+static unsigned int held_buttons(void) {
+    return s_pad[(s_pad_polls - 1) % BENCH_PAD_STATES].buttons;
+}
+
+// The game, as seen by reimpl/controls.c: what patch/controls.c looks up
+// in it, answering from the script
+static int on_touch(void * env, void * obj, int action, int x, int y,
+                    int index) {
+    (void)env; (void)obj;
+    s_sink += (uint32_t)(action + x + y + index);
+    return 0;
+}
+
+static void check_input_key(int keycode, int action, int repeats,
+                            int scancode) {
+    (void)repeats; (void)scancode;
+    s_sink += (uint32_t)(keycode + action);
+}
+
+static int absorb_key(int keycode) {
+    return keycode != 0;
+}
+
+static void * get_instance(void) {
+    return &s_press_key;
+}
+
+extern int (* nativeOnTouch)(void * env, void * obj, int action, int x,
+                             int y, int index);
+
+void (* CheckInputKey)(int keycode, int action, int repeats, int scancode);
+int (* AbsorbKey)(int keycode);
+void * (* Application__GetInstance)();
+int * isPressKey;
+
+int isInAimMode(void) {
+    return (held_buttons() & SCE_CTRL_L1) != 0;
+}
+
+int isOnCannon(void) {
+    return s_pad_polls / 512 % 4 == 3;
+}
+
+int isOnHorse(void) {
+    return s_pad_polls / 512 % 4 == 1;
+}
+
+int canCallHorse(void) {
+    return !isOnHorse();
+}
+
+int callHorse(void) {
+    s_sink++;
+    return 1;
+}
+
+int canUseVengeance(void) {
+    return 0;
+}
+
+void nextGrenade(void) {
+    s_sink++;
+}
+
+static void setup_controls(void) {
+    static const unsigned int buttons[] = {
+        0, SCE_CTRL_CROSS, 0, SCE_CTRL_SQUARE, SCE_CTRL_R1,
+        SCE_CTRL_R1 | SCE_CTRL_SQUARE, SCE_CTRL_L1,
+        SCE_CTRL_L1 | SCE_CTRL_TRIANGLE, SCE_CTRL_UP, SCE_CTRL_LEFT,
+        SCE_CTRL_CIRCLE, SCE_CTRL_START, 0, SCE_CTRL_SELECT,
+        SCE_CTRL_TRIANGLE, SCE_CTRL_DOWN,
+    };
+
+    for (int i = 0; i < BENCH_PAD_STATES; i++) {
+        SceCtrlData * pad = &s_pad[i];
+        float a = (float)i * 0.1f;
+        pad->lx = (unsigned char)(128 + 127 * cosf(a));
+        pad->ly = (unsigned char)(128 + 127 * sinf(a));
+        pad->rx = (unsigned char)(i / 32 % 2 ? 128 + 100 * cosf(a * 3) : 128);
+        pad->ry = 128;
+        pad->buttons = buttons[i / 4 % (sizeof(buttons) / sizeof(buttons[0]))];
+    }
+
+    settings_reset();
+    CheckInputKey = check_input_key;
+    AbsorbKey = absorb_key;
+    Application__GetInstance = get_instance;
+    isPressKey = &s_press_key;
+
+    controls_init();
+    nativeOnTouch = (void *)on_touch;
+}
+
+// One poll a frame: pad to the game's key and touch events
+static void run_controls_mapping(size_t iterations) {
+    for (size_t i = 0; i < iterations; i++)
+        controls_poll();
+}
+
+static const bench s_benches[] = {
+    { "mounts_translate_hot", 2000000, 0, setup_paths, run_mounts_hot },
+    { "mounts_translate_cold", 500000, 0, setup_paths, run_mounts_cold },
+    { "get_string_sha1_4k", 20000, 4096, setup_buf, run_string_sha1 },
+    { "settings_load", 20000, 0, setup_settings, run_settings_load },
+    { "so_symbol", 1000000, 0, setup_so, run_so_symbol },
+    { "so_resolve", 200, 0, setup_so, run_so_resolve },
+    { "falsojni_dispatch", 2000000, 0, setup_jni, run_falsojni_dispatch },
+    { "jda_find", 2000000, 0, setup_jni, run_jda_find },
+    { "jda_alloc_free", 500000, 0, setup_jni, run_jda_alloc_free },
+    { "controls_mapping", 500000, 0, setup_controls, run_controls_mapping },
+};
+
+static const struct {
+    const char * name;
+    const char * reason;
+} s_not_covered[] = {
+    { "hash128",
+      "NEON code; the host build only emulates the intrinsics" },
+};
+
+static bool selected(const char * name, int argc, char ** argv) {
+    if (argc < 2)
+        return true;
+    for (int i = 1; i < argc; i++)
+        if (strncmp(name, argv[i], strlen(argv[i])) == 0)
+            return true;
+    return false;
+}
+
+int main(int argc, char ** argv) {
+    size_t count = sizeof(s_benches) / sizeof(s_benches[0]);
+    bool set_up[sizeof(s_benches) / sizeof(s_benches[0])] = { false };
+    bool first = true;
+
+    printf("{\n  \"benchmarks\": [");
+    for (size_t b = 0; b < count; b++) {
+        const bench * bench = &s_benches[b];
+        if (!selected(bench->name, argc, argv))
+            continue;
+
+        // Benchmarks sharing a setup only run it once
+        bool done = false;
+        for (size_t i = 0; i < b; i++)
+            if (set_up[i] && s_benches[i].setup == bench->setup)
+                done = true;
+        if (!done)
+            bench->setup();
+        set_up[b] = true;
+
+        bench->run(bench->iterations / 10); // warm up
+
+        uint64_t best = UINT64_MAX;
+        for (int r = 0; r < BENCH_RUNS; r++) {
+            uint64_t start = now_ns();
+            bench->run(bench->iterations);
+            uint64_t elapsed = now_ns() - start;
+            if (elapsed < best)
+                best = elapsed;
+        }
+
+        double ns = (double)best / (double)bench->iterations;
+        printf("%s\n    { \"name\": \"%s\", \"iterations\": %zu, "
+               "\"ns_per_op\": %.1f", first ? "" : ",", bench->name,
+               bench->iterations, ns);
+        if (bench->bytes)
+            printf(", \"mb_per_s\": %.1f", (double)bench->bytes / ns * 1e3);
+        printf(" }");
+        first = false;
+    }
+
+    printf("\n  ],\n  \"not_covered\": [");
+    count = sizeof(s_not_covered) / sizeof(s_not_covered[0]);
+    for (size_t i = 0; i < count; i++)
+        printf("%s\n    { \"name\": \"%s\", \"reason\": \"%s\" }",
+               i ? "," : "", s_not_covered[i].name, s_not_covered[i].reason);
+    printf("\n  ]\n}\n");
+
+    return 0;
+}
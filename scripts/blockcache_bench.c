@@ -0,0 +1,273 @@
+/*
+ * scripts/blockcache_bench.c
+ *
+ * Replays the reads of an I/O trace (see loader/reimpl/iotrace.c) through
+ * loader/utils/blockcache.c on a simulated card, for a few cache sizes, and
+ * compares it with a plain LRU cache of the same size. Built by the host
+ * project next to bench:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/blockcache_bench iotrace.bin [size in MB...]
+ *
+ * Sizes are 8, 16, 32 and 64 MB by default.
+ *
+ * Files are told apart by their path id; writes to a file drop it from both
+ * caches, like the loader does. Every read with a known offset is replayed,
+ * including ones that the loader doesn't send through the cache (text
+ * files, plain read()s), so the numbers are an upper bound.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "utils/blockcache.h"
+
+#define OP_READ   2
+#define OP_WRITE  3
+
+#define RECORD_SIZE 48
+#define MAX_FILES   4096
+
+typedef struct bench_op {
+    uint8_t op;
+    uint16_t file;      // index in s_sizes
+    int64_t offset;
+    uint32_t len;
+} bench_op;
+
+static bench_op * s_ops;
+static size_t s_op_count;
+
+static uint32_t s_ids[MAX_FILES];   // path id of each file
+static int64_t s_sizes[MAX_FILES];  // furthest byte any read got to
+static uint32_t s_file_count;
+
+static uint64_t s_device_reads;
+static uint64_t s_device_bytes;
+
+static uint16_t file_index(uint32_t id) {
+    for (uint32_t i = 0; i < s_file_count; i++)
+        if (s_ids[i] == id)
+            return (uint16_t)i;
+
+    if (s_file_count == MAX_FILES) {
+        fprintf(stderr, "too many files in the trace\n");
+        exit(1);
+    }
+    s_ids[s_file_count] = id;
+    return (uint16_t)s_file_count++;
+}
+
+static uint32_t u32_at(const uint8_t * p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static bool load(const char * path) {
+    FILE * f = fopen(path, "rb");
+    if (!f)
+        return false;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t * data = malloc(size > 0 ? size : 1);
+    bool ok = data && fread(data, 1, size, f) == (size_t)size;
+    fclose(f);
+
+    ok = ok && size >= 12 && memcmp(data, "IOTR", 4) == 0
+         && u32_at(data + 4) == 1 && u32_at(data + 8) == RECORD_SIZE;
+    if (!ok) {
+        free(data);
+        return false;
+    }
+
+    s_ops = malloc(sizeof(bench_op) * (size / RECORD_SIZE + 1));
+    for (long off = 12; s_ops && off + RECORD_SIZE <= size;) {
+        const uint8_t * r = data + off;
+        uint8_t op = r[0];
+        uint16_t path_len = r[2] | r[3] << 8;
+        int64_t offset;
+        uint32_t len;
+        int32_t result;
+        memcpy(&offset, r + 24, 8);
+        memcpy(&len, r + 32, 4);
+        memcpy(&result, r + 36, 4);
+        off += RECORD_SIZE + ((path_len + 3) & ~3);
+
+        bool read = op == OP_READ && offset >= 0 && result > 0;
+        if (!read && op != OP_WRITE)
+            continue;
+
+        bench_op * o = &s_ops[s_op_count++];
+        o->op = op;
+        o->file = file_index(u32_at(r + 8));
+        o->offset = offset;
+        o->len = read ? (uint32_t)result : 0;
+        if (read && offset + result > s_sizes[o->file])
+            s_sizes[o->file] = offset + result;
+    }
+
+    free(data);
+    return s_ops != NULL;
+}
+
+// The card; `fd` is the file index
+static int device_read(int fd, void * dst, uint32_t len, int64_t offset) {
+    int64_t left = s_sizes[fd] - offset;
+    if (left <= 0)
+        return 0;
+    if (len > left)
+        len = (uint32_t)left;
+
+    memset(dst, 0, len);
+    s_device_reads++;
+    s_device_bytes += len;
+    return (int)len;
+}
+
+typedef struct lru_block {
+    uint64_t key;       // file << 32 | index, 0 when empty
+    uint64_t used;
+} lru_block;
+
+typedef struct lru_result {
+    uint64_t hits;
+    uint64_t misses;
+} lru_result;
+
+static lru_result run_lru(uint32_t capacity) {
+    lru_result res = { 0, 0 };
+    lru_block * blocks = calloc(capacity ? capacity : 1, sizeof(lru_block));
+    uint64_t clock = 0;
+
+    for (size_t i = 0; i < s_op_count; i++) {
+        const bench_op * o = &s_ops[i];
+        uint64_t file = (uint64_t)o->file + 1;
+
+        if (o->op == OP_WRITE) {
+            for (uint32_t j = 0; j < capacity; j++)
+                if (blocks[j].key >> 32 == file)
+                    blocks[j].key = 0;
+            continue;
+        }
+
+        uint32_t first = (uint32_t)(o->offset / BLOCKCACHE_BLOCK_SIZE);
+        uint32_t last = (uint32_t)((o->offset + o->len - 1)
+                                   / BLOCKCACHE_BLOCK_SIZE);
+        for (uint32_t index = first; index <= last; index++) {
+            uint64_t key = file << 32 | index;
+            uint32_t found = capacity, oldest = 0;
+            for (uint32_t j = 0; j < capacity && found == capacity; j++) {
+                if (blocks[j].key == key)
+                    found = j;
+                else if (!blocks[j].key
+                         || (blocks[oldest].key
+                             && blocks[j].used < blocks[oldest].used))
+                    oldest = j;
+            }
+
+            if (found < capacity) {
+                res.hits++;
+            } else {
+                res.misses++;
+                found = oldest;
+                blocks[found].key = key;
+            }
+            blocks[found].used = ++clock;
+        }
+    }
+
+    free(blocks);
+    return res;
+}
+
+static void run(uint32_t mb) {
+    static uint8_t buf[16 * 1024 * 1024];
+    char name[16];
+
+    blockcache_init(device_read);
+    blockcache_set_capacity((size_t)mb * 1024 * 1024);
+
+    uint32_t files[MAX_FILES];
+    for (uint32_t i = 0; i < s_file_count; i++) {
+        snprintf(name, sizeof(name), "%08x", s_ids[i]);
+        files[i] = blockcache_file(name);
+    }
+
+    uint64_t asked = 0;
+    for (size_t i = 0; i < s_op_count; i++) {
+        const bench_op * o = &s_ops[i];
+        if (o->op == OP_WRITE) {
+            snprintf(name, sizeof(name), "%08x", s_ids[o->file]);
+            blockcache_forget(name);
+            continue;
+        }
+
+        for (uint32_t done = 0; done < o->len;) {
+            uint32_t n = o->len - done;
+            if (n > sizeof(buf))
+                n = sizeof(buf);
+            blockcache_pread(files[o->file], o->file, buf, n,
+                             o->offset + done);
+            done += n;
+        }
+        asked += o->len;
+    }
+
+    blockcache_stats st;
+    blockcache_get_stats(&st);
+    lru_result lru = run_lru(st.capacity);
+
+    uint64_t uses = st.hits + st.misses;
+    uint64_t lru_uses = lru.hits + lru.misses;
+    printf("%5u MB  %6.2f%% %10llu %10llu %10llu  %6.2f%%  %u/%u\n", mb,
+           uses ? 100.0 * st.hits / uses : 0.0,
+           (unsigned long long)(st.bytes_saved >> 10),
+           (unsigned long long)(s_device_bytes >> 10),
+           (unsigned long long)(asked >> 10),
+           lru_uses ? 100.0 * lru.hits / lru_uses : 0.0,
+           st.recent, st.target);
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s iotrace.bin [size in MB...]\n", argv[0]);
+        return 2;
+    }
+    if (!load(argv[1])) {
+        fprintf(stderr, "%s: not a version 1 I/O trace\n", argv[1]);
+        return 1;
+    }
+
+    printf("%zu reads and writes, %u files\n\n", s_op_count, s_file_count);
+    printf("   size  hit rate   saved KB  device KB   asked KB  LRU hit  "
+           "recent/target\n");
+    fflush(stdout);
+
+    // The first capacity set is the most the cache can ever have; a process
+    // for each size starts it over
+    static const uint32_t defaults[] = { 8, 16, 32, 64 };
+    int count = argc > 2 ? argc - 2 : 4;
+    for (int i = 0; i < count; i++) {
+        uint32_t mb = argc > 2 ? (uint32_t)atoi(argv[i + 2]) : defaults[i];
+        pid_t pid = fork();
+        if (pid == 0) {
+            run(mb);
+            fflush(stdout);
+            _exit(0);
+        }
+        waitpid(pid, NULL, 0);
+    }
+    return 0;
+}
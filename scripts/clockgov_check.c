@@ -0,0 +1,289 @@
+/*
+ * scripts/clockgov_check.c
+ *
+ * Drives loader/utils/clockgov.c with synthetic frame traces: a game with
+ * so much CPU and GPU work per frame, which take longer at lower clocks,
+ * behind an FPS lock. The apply callback is a mock that remembers what the
+ * hardware was set to, so the frame times follow the governor's choices.
+ * Checks that:
+ *
+ * - it starts at the old fixed clocks, and only applies real changes;
+ * - a light scene ends at the lowest clocks without missing a frame;
+ * - a GPU-bound scene finds the lowest GPU level that holds, and probes
+ *   the one below less and less often;
+ * - a sudden CPU load raises the ARM within a couple of frames;
+ * - misses the CPU accounts for don't raise the GPU;
+ * - menus cap both at the middle level, and gameplay gets its levels back.
+ *
+ * Random traces are then checked against the callback rules. Built by the
+ * host project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/clockgov_check [random frames]
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/clockgov.h"
+
+#define FPS         30.f
+#define BUDGET_US   33333u
+#define MISS_US     (BUDGET_US * 110 / 100)
+#define WINDOW      30
+
+static uint32_t s_rng = 1;
+
+static uint32_t rnd(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static int s_failed;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+    } \
+} while (0)
+
+static const clockgov_clocks s_levels[CLOCKGOV_LEVELS] = {
+    { 222, 166, 111, 111 },
+    { 333, 166, 166, 111 },
+    { 444, 222, 222, 166 },
+};
+
+// Mock hardware
+static clockgov_clocks s_hw;
+static int s_applies;
+
+static void apply(const clockgov_clocks * c) {
+    CHECK(memcmp(c, &s_hw, sizeof(s_hw)) != 0 || s_applies == 0,
+          "applied %u/%u/%u/%u again", c->arm, c->bus, c->gpu, c->xbar);
+
+    int gpu_ok = 0, arm_ok = 0;
+    for (int l = 0; l < CLOCKGOV_LEVELS; l++) {
+        arm_ok |= c->arm == s_levels[l].arm;
+        gpu_ok |= c->gpu == s_levels[l].gpu && c->bus == s_levels[l].bus
+                  && c->xbar == s_levels[l].xbar;
+    }
+    CHECK(arm_ok && gpu_ok, "applied %u/%u/%u/%u, not a level", c->arm,
+          c->bus, c->gpu, c->xbar);
+
+    s_hw = *c;
+    s_applies++;
+}
+
+static int arm_level(void) {
+    for (int l = 0; l < CLOCKGOV_LEVELS; l++) {
+        if (s_hw.arm == s_levels[l].arm)
+            return l;
+    }
+    return -1;
+}
+
+static int gpu_level(void) {
+    for (int l = 0; l < CLOCKGOV_LEVELS; l++) {
+        if (s_hw.gpu == s_levels[l].gpu)
+            return l;
+    }
+    return -1;
+}
+
+typedef struct run {
+    clockgov g;
+    long frame;
+    long misses;
+} run;
+
+static void run_init(run * r) {
+    memset(&s_hw, 0, sizeof(s_hw));
+    s_applies = 0;
+    clockgov_init(&r->g, FPS, apply);
+    r->frame = 0;
+    r->misses = 0;
+
+    CHECK(s_applies == 1 && !memcmp(&s_hw, &s_levels[CLOCKGOV_LEVELS - 1],
+                                    sizeof(s_hw)),
+          "started at %u/%u/%u/%u", s_hw.arm, s_hw.bus, s_hw.gpu, s_hw.xbar);
+}
+
+/*
+ * One frame with `cpu` and `gpu` microseconds of work at the top clocks.
+ * The FPS lock waits out whatever is left of the budget.
+ */
+static void frame(run * r, uint32_t cpu, uint32_t gpu, bool menu) {
+    uint32_t cpu_us = (uint32_t)((uint64_t)cpu * 444 / s_hw.arm);
+    uint32_t gpu_us = (uint32_t)((uint64_t)gpu * 222 / s_hw.gpu);
+    uint32_t frame_us = cpu_us > gpu_us ? cpu_us : gpu_us;
+    if (frame_us < BUDGET_US)
+        frame_us = BUDGET_US;
+
+    clockgov_frame(&r->g, cpu_us, frame_us, menu);
+    r->frame++;
+    r->misses += frame_us > MISS_US;
+
+    clockgov_clocks now;
+    clockgov_clocks_get(&r->g, &now);
+    CHECK(!memcmp(&now, &s_hw, sizeof(now)), "frame %ld: governor is at "
+          "%u/%u, hardware at %u/%u", r->frame, now.arm, now.gpu, s_hw.arm,
+          s_hw.gpu);
+}
+
+// `seconds` of a scene, with 10% noise on both costs
+static void scene(run * r, float seconds, uint32_t cpu, uint32_t gpu,
+                  bool menu) {
+    long frames = (long)(seconds * FPS);
+    for (long i = 0; i < frames; i++) {
+        uint32_t c = cpu - cpu / 20 + rnd() % (cpu / 10 + 1);
+        uint32_t g = gpu - gpu / 20 + rnd() % (gpu / 10 + 1);
+        frame(r, c, g, menu);
+    }
+}
+
+static void check_light(void) {
+    run r;
+    run_init(&r);
+
+    scene(&r, 60, 8000, 8000, false);
+    CHECK(arm_level() == 0 && gpu_level() == 0, "light scene ends at ARM "
+          "%u, GPU %u", s_hw.arm, s_hw.gpu);
+    CHECK(r.misses == 0, "light scene: %ld missed frames", r.misses);
+    printf("   light: %d applies, %ld misses\n", s_applies, r.misses);
+}
+
+static void check_gpu_bound(void) {
+    run r;
+    run_init(&r);
+
+    // 20 ms of GPU work: 166 MHz holds, 111 MHz doesn't
+    scene(&r, 60, 8000, 20000, false);
+    CHECK(gpu_level() == 1, "GPU-bound scene at GPU %u after a minute",
+          s_hw.gpu);
+
+    // Each failed probe keeps the GPU off the low level for longer
+    long last_probe = -1, last_gap = 0;
+    int probes = 0;
+    long misses = r.misses;
+    for (long i = 0; i < 30L * 60 * 30; i++) {
+        int before = gpu_level();
+        scene(&r, 1.f / FPS, 8000, 20000, false);
+        if (before == 1 && gpu_level() == 0) {
+            if (last_probe >= 0) {
+                long gap = r.frame - last_probe;
+                CHECK(gap >= last_gap || gap >= 960 * WINDOW,
+                      "probe %d came %ld frames after the last, which "
+                      "came %ld after its own", probes, gap, last_gap);
+                last_gap = gap;
+            }
+            last_probe = r.frame;
+            probes++;
+        }
+        CHECK(gpu_level() >= 0 && gpu_level() <= 1, "GPU-bound scene went "
+              "to GPU %u", s_hw.gpu);
+    }
+    misses = r.misses - misses;
+    CHECK(probes >= 3 && probes <= 8, "%d probes in 30 minutes", probes);
+    CHECK(misses < 30L * 60 * 30 / 200, "%ld missed frames in 30 minutes",
+          misses);
+    printf("   GPU-bound: %d probes in 30 minutes, %ld missed frames\n",
+           probes, misses);
+}
+
+static void check_cpu(void) {
+    run r;
+    run_init(&r);
+
+    scene(&r, 60, 5000, 5000, false);
+    CHECK(arm_level() == 0, "idle ARM at %u", s_hw.arm);
+    int gpu = gpu_level();
+
+    // Sudden load that needs the top clock: at most two slow frames
+    long misses = r.misses;
+    scene(&r, 10, 20000, 5000, false);
+    CHECK(arm_level() == 2, "loaded ARM at %u", s_hw.arm);
+    CHECK(r.misses - misses <= 2, "%ld missed frames on a CPU jump",
+          r.misses - misses);
+
+    // More than the CPU can do at any clock: misses, but not the GPU's
+    scene(&r, 60, 40000, 5000, false);
+    CHECK(arm_level() == 2 && gpu_level() <= gpu, "CPU-bound scene moved "
+          "the GPU from level %d to %d", gpu, gpu_level());
+
+    // Back to idle: the ARM comes down within a window
+    scene(&r, 2, 5000, 5000, false);
+    CHECK(arm_level() == 0, "ARM at %u after the load", s_hw.arm);
+}
+
+static void check_menu(void) {
+    run r;
+    run_init(&r);
+
+    // Gameplay that needs the top levels, then a menu
+    scene(&r, 30, 20000, 28000, false);
+    int arm = arm_level(), gpu = gpu_level();
+    CHECK(arm == 2 && gpu == 2, "heavy gameplay at ARM %u, GPU %u", s_hw.arm,
+          s_hw.gpu);
+
+    /*
+     * The world keeps rendering behind the menu: enough work to want the
+     * top ARM level, but not enough to be urgent at the middle one
+     */
+    scene(&r, 2, 18000, 20000, true);
+    for (int i = 0; i < 60 * WINDOW; i++) {
+        frame(&r, 18000, 20000, true);
+        CHECK(arm_level() <= 1 && gpu_level() <= 1, "menu at ARM %u, GPU %u",
+              s_hw.arm, s_hw.gpu);
+    }
+    // The GPU isn't probed while in the menu
+    CHECK(r.g.gpu_level == gpu, "menu probed the GPU to %d", r.g.gpu_level);
+
+    /*
+     * The GPU is back where it was after a window of gameplay, the ARM
+     * after the window that measures it
+     */
+    scene(&r, 2, 20000, 28000, false);
+    CHECK(gpu_level() == gpu && arm_level() == 2, "after the menu: ARM %u, "
+          "GPU %u", s_hw.arm, s_hw.gpu);
+}
+
+// Random scenes; the callback and state rules are checked on every frame
+static void check_random(long frames) {
+    run r;
+    run_init(&r);
+
+    while (r.frame < frames) {
+        uint32_t cpu = 1000 + rnd() % 45000;
+        uint32_t gpu = 1000 + rnd() % 45000;
+        float seconds = 0.1f + (float)(rnd() % 600) / 10.f;
+        scene(&r, seconds, cpu, gpu, rnd() % 5 == 0);
+    }
+    printf("   random: %ld frames, %d applies, %ld misses\n", r.frame,
+           s_applies, r.misses);
+}
+
+int main(int argc, char ** argv) {
+    long frames = argc > 1 ? atol(argv[1]) : 2000000;
+
+    check_light();
+    check_gpu_bound();
+    check_cpu();
+    check_menu();
+    check_random(frames);
+
+    if (s_failed)
+        return 1;
+    printf("ok: scripted scenes and %ld random frames\n", frames);
+    return 0;
+}
@@ -0,0 +1,472 @@
+/*
+ * scripts/dirtree_check.c
+ *
+ * Checks loader/utils/dirtree.c against the real filesystem, walked with
+ * nftw(): every path in a folder of a few thousand files and nested
+ * directories has to be found with the right type, size and mtime, every
+ * directory listed with the same entries, and made-up names next to and
+ * under them reported missing. Files are created while the snapshot is
+ * being taken, then random creates, rewrites, removes and renames (of
+ * directories too, over existing entries and out of the folder) are made
+ * on disk and passed on the way the I/O shims do, and the comparison is
+ * repeated as they go. Removing the root or renaming something in from
+ * outside has to drop the snapshot.
+ * Built by the host project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/dirtree_check [operations]
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "utils/dirtree.h"
+#include "utils/utils.h"
+
+#define ROOT        DATA_PATH "dirtree_check"
+#define OUTSIDE     DATA_PATH "dirtree_check_out"
+#define MAX_PATHS   16384
+
+static uint32_t s_rng = 1;
+
+static uint32_t rnd(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static int s_failed;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+    } \
+} while (0)
+
+// What nftw() last found under the root
+static char * s_paths[MAX_PATHS];
+static bool s_dirs[MAX_PATHS];
+static int s_count;
+
+static bool make_file(const char * path, uint32_t size) {
+    FILE * f = fopen(path, "wb");
+    if (!f)
+        return false;
+    for (uint32_t i = 0; i < size; i++)
+        fputc((int)i, f);
+    fclose(f);
+    return true;
+}
+
+static int remove_one(const char * path, const struct stat * st, int flag,
+                      struct FTW * ftw) {
+    (void)st; (void)flag; (void)ftw;
+    return remove(path);
+}
+
+static void remove_tree(const char * path) {
+    nftw(path, remove_one, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static int by_name(const void * a, const void * b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+// Names in a directory, sorted; `dirs` gets which of them are directories
+static int list_real(const char * path, char ** names, bool * dirs) {
+    DIR * d = opendir(path);
+    struct dirent * e;
+    int n = 0;
+    while ((e = readdir(d))) {
+        if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, ".."))
+            continue;
+        names[n++] = strdup(e->d_name);
+    }
+    closedir(d);
+    qsort(names, n, sizeof(char *), by_name);
+
+    for (int i = 0; i < n; i++) {
+        char full[2048];
+        struct stat st;
+        snprintf(full, sizeof(full), "%s/%s", path, names[i]);
+        dirs[i] = lstat(full, &st) == 0 && S_ISDIR(st.st_mode);
+    }
+    return n;
+}
+
+static int list_tree(const char * path, char ** names, bool * dirs) {
+    dirtree_dir * d = dirtree_opendir(path);
+    if (!d)
+        return -1;
+
+    char name[256];
+    bool dir;
+    int n = 0;
+    while (n < MAX_PATHS && dirtree_readdir(d, name, sizeof(name), &dir))
+        names[n++] = strdup(name);
+    dirtree_closedir(d);
+    qsort(names, n, sizeof(char *), by_name);
+
+    for (int i = 0; i < n; i++) {
+        char full[2048];
+        dirtree_stat st;
+        snprintf(full, sizeof(full), "%s/%s", path, names[i]);
+        dirs[i] = dirtree_lookup(full, &st) == DIRTREE_FOUND && st.dir;
+    }
+    return n;
+}
+
+static void check_listing(const char * path) {
+    static char * real[MAX_PATHS], * tree[MAX_PATHS];
+    static bool real_dirs[MAX_PATHS], tree_dirs[MAX_PATHS];
+
+    int n = list_real(path, real, real_dirs);
+    int m = list_tree(path, tree, tree_dirs);
+    CHECK(m == n, "%s: %d entries listed, %d on disk", path, m, n);
+
+    for (int i = 0; i < n && i < m; i++) {
+        if (strcmp(real[i], tree[i]) || real_dirs[i] != tree_dirs[i]) {
+            CHECK(0, "%s: entry %d is %s (dir %d), on disk %s (dir %d)",
+                  path, i, tree[i], tree_dirs[i], real[i], real_dirs[i]);
+            break;
+        }
+    }
+    for (int i = 0; i < n; i++)
+        free(real[i]);
+    for (int i = 0; i < m; i++)
+        free(tree[i]);
+}
+
+static int visit(const char * path, const struct stat * st, int flag,
+                 struct FTW * ftw) {
+    (void)flag; (void)ftw;
+    bool dir = S_ISDIR(st->st_mode);
+
+    dirtree_stat ds;
+    dirtree_result r = dirtree_lookup(path, &ds);
+    CHECK(r == DIRTREE_FOUND, "%s not found", path);
+    if (r != DIRTREE_FOUND)
+        return 0;
+
+    CHECK(ds.dir == dir, "%s: dir %d, on disk %d", path, ds.dir, dir);
+    if (!dir && !ds.stale) {
+        CHECK(ds.size == st->st_size && ds.mtime == (uint32_t)st->st_mtime,
+              "%s: size %u, mtime %u; on disk %lld, %lld", path, ds.size,
+              ds.mtime, (long long)st->st_size, (long long)st->st_mtime);
+    }
+
+    // Names that aren't there, next to it and under it
+    char missing[2048];
+    if (strcmp(path, ROOT)) {
+        snprintf(missing, sizeof(missing), "%s~", path);
+        CHECK(dirtree_lookup(missing, NULL) == DIRTREE_MISSING, "%s found",
+              missing);
+    }
+    snprintf(missing, sizeof(missing), "%s/x~/y", path);
+    CHECK(dirtree_lookup(missing, NULL) == DIRTREE_MISSING, "%s found",
+          missing);
+
+    if (dir)
+        check_listing(path);
+
+    if (s_count < MAX_PATHS && strcmp(path, ROOT)) {
+        s_paths[s_count] = strdup(path);
+        s_dirs[s_count++] = dir;
+    }
+    return 0;
+}
+
+// Compares everything, and takes the new list of paths
+static void compare(void) {
+    for (int i = 0; i < s_count; i++)
+        free(s_paths[i]);
+    s_count = 0;
+    nftw(ROOT, visit, 16, FTW_PHYS);
+}
+
+static void make_tree(void) {
+    remove_tree(ROOT);
+    remove_tree(OUTSIDE);
+
+    static const char * dirs[] = {
+        "data/levels", "data/tex/hd", "sounds", "empty", "late", "a/b/c/d",
+    };
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+        char path[1024];
+        snprintf(path, sizeof(path), ROOT "/%s/", dirs[i]);
+        mkpath(path, 0755);
+    }
+    char path[1024] = OUTSIDE "/";
+    mkpath(path, 0755);
+    for (int i = 0; i < 20; i++) {
+        sprintf(path, ROOT "/empty/e%d/", i);
+        mkpath(path, 0755);
+    }
+
+    for (int i = 0; i < 3000; i++) {
+        sprintf(path, ROOT "/data/tex/t%04d.pvr", i);
+        make_file(path, rnd() % 300);
+
+        // Any time in the range the snapshot keeps
+        struct timespec times[2] = { { 0, 0 }, { rnd() % 0xF0000000u, 0 } };
+        utimensat(AT_FDCWD, path, times, 0);
+    }
+    for (int i = 0; i < 50; i++) {
+        sprintf(path, ROOT "/data/tex/hd/h%d.pvr", i);
+        make_file(path, 3);
+    }
+    make_file(ROOT "/actors.gla", 1000);
+    make_file(ROOT "/data/levels/l1.bin", 55);
+    make_file(ROOT "/a/b/c/d/deep", 1);
+    make_file(ROOT "/sounds/a.ogg", 7);
+}
+
+static void wait_ready(void) {
+    for (int i = 0; i < 60000; i++) {
+        if (dirtree_lookup(ROOT, NULL) != DIRTREE_UNKNOWN)
+            return;
+        usleep(1000);
+    }
+    CHECK(0, "no snapshot after a minute");
+    exit(1);
+}
+
+static void check_snapshot(void) {
+    CHECK(dirtree_lookup(ROOT "/actors.gla", NULL) == DIRTREE_UNKNOWN,
+          "found before the snapshot");
+    dirtree_build_async(ROOT "/");
+
+    // Created while the snapshot is taken: it has to be taken again
+    for (int i = 0; i < 50; i++) {
+        char path[1024];
+        sprintf(path, ROOT "/late/f%d", i);
+        make_file(path, 10);
+        dirtree_created(path);
+    }
+    wait_ready();
+    compare();
+    printf("   snapshot: %d paths\n", s_count);
+
+    static const struct {
+        const char * path;
+        dirtree_result want;
+    } cases[] = {
+        { ROOT, DIRTREE_FOUND },
+        { ROOT "/", DIRTREE_FOUND },
+        { ROOT "//data//levels/l1.bin", DIRTREE_FOUND },
+        { ROOT "/data/levels/", DIRTREE_FOUND },
+        { ROOT "/nope.txt", DIRTREE_MISSING },
+        { ROOT "/data/nope/x", DIRTREE_MISSING },
+        { ROOT "/actors.gla/x", DIRTREE_MISSING },
+        { ROOT "x/actors.gla", DIRTREE_UNKNOWN },
+        { DATA_PATH "actors.gla", DIRTREE_UNKNOWN },
+        { "ux0:data/actors.gla", DIRTREE_UNKNOWN },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        dirtree_result r = dirtree_lookup(cases[i].path, NULL);
+        CHECK(r == cases[i].want, "%s: %d, want %d", cases[i].path, r,
+              cases[i].want);
+    }
+    CHECK(!dirtree_opendir(ROOT "/actors.gla"), "opened a file");
+    CHECK(!dirtree_opendir(ROOT "/nope"), "opened a missing directory");
+}
+
+static void check_handles(void) {
+    dirtree_dir * d[DIRTREE_MAX_DIRS];
+    for (int i = 0; i < DIRTREE_MAX_DIRS; i++) {
+        d[i] = dirtree_opendir(ROOT "/a");
+        CHECK(d[i] && dirtree_owns(d[i]) && dirtree_slot(d[i]) >= 0
+              && dirtree_slot(d[i]) < DIRTREE_MAX_DIRS, "open number %d",
+              i);
+    }
+    CHECK(!dirtree_opendir(ROOT "/a"), "more directories open than slots");
+    CHECK(!dirtree_owns((char *)d[0] + 1) && !dirtree_owns(&s_count),
+          "owns something else");
+
+    // Names are cut to the buffer
+    char name[4];
+    bool dir;
+    CHECK(dirtree_readdir(d[0], name, sizeof(name), &dir) && !strcmp(name,
+          "b") && dir, "read %s", name);
+    CHECK(!dirtree_readdir(d[0], name, sizeof(name), &dir), "read past the "
+          "end");
+    dirtree_closedir(d[1]);
+    d[1] = dirtree_opendir(ROOT);
+    CHECK(d[1], "reopen");
+    bool cut = false;
+    while (dirtree_readdir(d[1], name, sizeof(name), &dir)) {
+        cut |= !strcmp(name, "act");
+        CHECK(strlen(name) <= 3, "%s doesn't fit", name);
+    }
+    CHECK(cut, "actors.gla isn't listed as act");
+
+    for (int i = 0; i < DIRTREE_MAX_DIRS; i++)
+        dirtree_closedir(d[i]);
+}
+
+// Any listed file, or any directory with the root among them
+static const char * random_path(bool dir) {
+    int matches = dir;
+    for (int i = 0; i < s_count; i++)
+        matches += s_dirs[i] == dir;
+    if (!matches)
+        return NULL;
+
+    int pick = (int)(rnd() % (uint32_t)matches);
+    if (dir && pick-- == 0)
+        return ROOT;
+    for (int i = 0; i < s_count; i++) {
+        if (s_dirs[i] == dir && pick-- == 0)
+            return s_paths[i];
+    }
+    return NULL;
+}
+
+// Changes made on disk and passed on like io.c does, when they worked
+static void check_updates(long ops) {
+    long done[6] = { 0 };
+
+    for (long n = 0; n < ops; n++) {
+        char path[2048];
+        const char * from = NULL;
+        uint32_t op = rnd() % 100;
+
+        if (op < 25) {
+            snprintf(path, sizeof(path), "%s/n%u", random_path(true),
+                     rnd() % 1000);
+            FILE * f = fopen(path, "wb");
+            if (f) {
+                fputs("new", f);
+                fclose(f);
+                dirtree_created(path);
+                done[0]++;
+            }
+        } else if (op < 35 && (from = random_path(false))) {
+            // Paths listed since the last compare may have moved away
+            if (make_file(from, rnd() % 100)) {
+                dirtree_created(from);
+                done[1]++;
+            }
+        } else if (op < 55 && (from = random_path(false))) {
+            if (unlink(from) == 0) {
+                dirtree_removed(from);
+                done[2]++;
+            }
+        } else if (op < 60) {
+            from = random_path(true);
+            if (from && strcmp(from, ROOT) && rmdir(from) == 0) {
+                dirtree_removed(from);
+                done[3]++;
+            }
+        } else if (op < 95) {
+            from = random_path(rnd() % 4 == 0);
+            const char * to = random_path(rnd() % 2);
+            if (rnd() % 3 == 0)
+                snprintf(path, sizeof(path), "%s", to ? to : ROOT);
+            else
+                snprintf(path, sizeof(path), "%s/r%u", random_path(true),
+                         rnd() % 1000);
+            if (from && strcmp(from, ROOT) && rename(from, path) == 0) {
+                dirtree_renamed(from, path);
+                done[4]++;
+            }
+        } else if ((from = random_path(false))) {
+            snprintf(path, sizeof(path), OUTSIDE "/o%ld", n);
+            if (rename(from, path) == 0) {
+                dirtree_renamed(from, path);
+                done[5]++;
+            }
+        }
+
+        if (n % 100 == 99) {
+            CHECK(dirtree_lookup(ROOT, NULL) == DIRTREE_FOUND, "op %ld: the "
+                  "snapshot was dropped", n);
+            compare();
+        }
+    }
+    compare();
+
+    printf("   %ld ops: %ld creates, %ld rewrites, %ld removes, %ld rmdirs, "
+           "%ld renames, %ld moved out; %d paths left\n", ops, done[0],
+           done[1], done[2], done[3], done[4], done[5], s_count);
+}
+
+/*
+ * Many more files than the snapshot was sized for, in the one directory
+ * the updates can't have moved. The table grows on the way; then enough
+ * names that aren't there are looked up to walk every bucket to its end.
+ */
+static void check_growth(void) {
+    char path[1024];
+    for (int i = 0; i < 6000; i++) {
+        sprintf(path, ROOT "/g%d", i);
+        make_file(path, 1);
+        dirtree_created(path);
+    }
+    for (int i = 0; i < 1 << 18; i++) {
+        sprintf(path, ROOT "/m%d", i);
+        CHECK(dirtree_lookup(path, NULL) == DIRTREE_MISSING, "%s found", path);
+    }
+    compare();
+}
+
+static void check_drop(void) {
+    // The root itself going away, in a child so the snapshot stays here
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        dirtree_removed(ROOT);
+        CHECK(dirtree_lookup(ROOT "/actors.gla", NULL) == DIRTREE_UNKNOWN,
+              "removing the root didn't drop the snapshot");
+        fflush(stdout);
+        _exit(s_failed ? 1 : 0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0, "the child failed");
+
+    make_file(OUTSIDE "/in", 1);
+    rename(OUTSIDE "/in", ROOT "/in");
+    dirtree_renamed(OUTSIDE "/in", ROOT "/in");
+    CHECK(dirtree_lookup(ROOT "/in", NULL) == DIRTREE_UNKNOWN
+          && dirtree_lookup(ROOT "/actors.gla", NULL) == DIRTREE_UNKNOWN,
+          "a rename from outside didn't drop the snapshot");
+    CHECK(!dirtree_opendir(ROOT), "opened a directory after the drop");
+}
+
+int main(int argc, char ** argv) {
+    long ops = argc > 1 ? atol(argv[1]) : 3000;
+
+    make_tree();
+    check_snapshot();
+    check_handles();
+    check_updates(ops);
+    check_growth();
+    check_drop();
+
+    remove_tree(ROOT);
+    remove_tree(OUTSIDE);
+
+    if (s_failed)
+        return 1;
+    printf("ok: snapshot, %ld updates and %d paths compared with the disk\n",
+           ops, s_count);
+    return 0;
+}
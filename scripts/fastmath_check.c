@@ -0,0 +1,163 @@
+/*
+ * scripts/fastmath_check.c
+ *
+ * Sweeps loader/reimpl/fastmath.c over the float range and checks the
+ * error budgets given at the top of that file, in ulp against the double
+ * precision libm result rounded to float. Built by the host project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/fastmath_check [step]
+ *
+ * Every step-th bit pattern is tried (4099 by default; 1 tries them all
+ * and takes a while), along with the values at the edges of the fast
+ * domains. Outside of those the functions fall back to libm, which has to
+ * keep to the same budget, and to the sign of zero.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reimpl/fastmath.h"
+
+typedef struct sweep {
+    const char * name;
+    double budget;  // ulp
+    float (* fast)(float x);
+    double (* ref)(double x);
+} sweep;
+
+static float sincos_s(float x) {
+    float s, c;
+    sincosf_soloader(x, &s, &c);
+    return s;
+}
+
+static float sincos_c(float x) {
+    float s, c;
+    sincosf_soloader(x, &s, &c);
+    return c;
+}
+
+// Two-argument functions, swept over one argument with the other fixed
+static float pow_x_2_5(float x) { return powf_soloader(x, 2.5f); }
+static float pow_x_m0_7(float x) { return powf_soloader(x, -0.7f); }
+static float pow_x_13(float x) { return powf_soloader(x, 13.f); }
+static float pow_3_y(float y) { return powf_soloader(3.f, y); }
+static float pow_near1_y(float y) { return powf_soloader(1.0001f, y); }
+static float atan2_1_x(float x) { return atan2f_soloader(1.f, x); }
+static float atan2_y_m1(float y) { return atan2f_soloader(y, -1.f); }
+static float atan2_y_y(float y) { return atan2f_soloader(y, y * 0.37f - 1.f); }
+
+static double ref_pow_x_2_5(double x) { return pow(x, 2.5); }
+static double ref_pow_x_m0_7(double x) { return pow(x, (double)-0.7f); }
+static double ref_pow_x_13(double x) { return pow(x, 13.); }
+static double ref_pow_3_y(double y) { return pow(3., y); }
+static double ref_pow_near1_y(double y) { return pow((double)1.0001f, y); }
+static double ref_atan2_1_x(double x) { return atan2(1., x); }
+static double ref_atan2_y_m1(double y) { return atan2(y, -1.); }
+static double ref_atan2_y_y(double y) {
+    return atan2(y, (double)((float)y * 0.37f - 1.f));
+}
+
+static float fast_sqrtf(float x) { return sqrtf_soloader(x); }
+static double ref_sqrt(double x) { return sqrt(x); }
+
+static const sweep s_sweeps[] = {
+    { "sinf", 2, sinf_soloader, sin },
+    { "cosf", 2, cosf_soloader, cos },
+    { "sincosf (sin)", 2, sincos_s, sin },
+    { "sincosf (cos)", 2, sincos_c, cos },
+    { "expf", 1, expf_soloader, exp },
+    { "logf", 1, logf_soloader, log },
+    { "powf(x, 2.5)", 1, pow_x_2_5, ref_pow_x_2_5 },
+    { "powf(x, -0.7)", 1, pow_x_m0_7, ref_pow_x_m0_7 },
+    { "powf(x, 13)", 1, pow_x_13, ref_pow_x_13 },
+    { "powf(3, y)", 1, pow_3_y, ref_pow_3_y },
+    { "powf(1.0001, y)", 1, pow_near1_y, ref_pow_near1_y },
+    { "atan2f(1, x)", 3, atan2_1_x, ref_atan2_1_x },
+    { "atan2f(y, -1)", 3, atan2_y_m1, ref_atan2_y_m1 },
+    { "atan2f(y, 0.37y - 1)", 3, atan2_y_y, ref_atan2_y_y },
+    { "sqrtf", 0, fast_sqrtf, ref_sqrt },
+};
+
+// Position of a float on a line where neighbours differ by one
+static int64_t order(float f) {
+    int32_t i;
+    memcpy(&i, &f, sizeof(i));
+    return i < 0 ? (int64_t)INT32_MIN - i : i;
+}
+
+static double ulp_error(float got, double ref) {
+    float want = (float)ref;
+    if (isnan(got) || isnan(want))
+        return isnan(got) && isnan(want) ? 0 : INFINITY;
+    if (isinf(want) || isinf(got))
+        return got == want ? 0 : INFINITY;
+    if (got == 0 && want == 0)
+        return signbit(got) == signbit(want) ? 0 : INFINITY;
+    int64_t d = order(got) - order(want);
+    return (double)(d < 0 ? -d : d);
+}
+
+// Values around and past the edges of the fast domains, which the sweep
+// may step over
+static const float s_specials[] = {
+    0.f, -0.f, INFINITY, -INFINITY, NAN, 1e-40f, -1e-40f, 1.17549435e-38f,
+    8192.f, -8192.f, 8192.5f, -1e6f, 3e38f, -1.f, -2.5f, 88.7f, 88.8f,
+    -87.3f, -104.f, 100.f, -100.f,
+};
+
+static void try(const sweep * sw, float x, double * worst, float * worst_at) {
+    double err = ulp_error(sw->fast(x), sw->ref(x));
+    if (err > *worst) {
+        *worst = err;
+        *worst_at = x;
+    }
+}
+
+int main(int argc, char ** argv) {
+    uint64_t step = argc > 1 ? strtoull(argv[1], NULL, 0) : 4099;
+    if (step == 0)
+        step = 1;
+
+    int failed = 0;
+
+    for (size_t s = 0; s < sizeof(s_sweeps) / sizeof(s_sweeps[0]); s++) {
+        const sweep * sw = &s_sweeps[s];
+        double worst = 0;
+        float worst_at = 0;
+
+        size_t specials = sizeof(s_specials) / sizeof(s_specials[0]);
+        for (size_t i = 0; i < specials; i++)
+            try(sw, s_specials[i], &worst, &worst_at);
+
+        for (uint64_t bits = 0; bits <= UINT32_MAX; bits += step) {
+            uint32_t b = (uint32_t)bits;
+            float x;
+            memcpy(&x, &b, sizeof(x));
+            try(sw, x, &worst, &worst_at);
+        }
+
+        bool ok = worst <= sw->budget;
+        printf("%s %-22s max %.0f ulp (budget %.0f) at %a\n",
+               ok ? "  " : "FAIL", sw->name, worst, sw->budget,
+               (double)worst_at);
+        if (!ok)
+            failed++;
+    }
+
+    if (failed)
+        return 1;
+    printf("ok: every %llu-th float and the domain edges\n",
+           (unsigned long long)step);
+    return 0;
+}
@@ -0,0 +1,484 @@
+/*
+ * scripts/filemap_check.c
+ *
+ * Checks loader/utils/filemap.c against the real mmap(): maps of a file at
+ * page offsets before, across and past its end, of many lengths, have to
+ * hold the same bytes, with zeros where the real map has them, and bad
+ * arguments have to fail with the same errno. Then what the real thing
+ * doesn't need to do is checked on its own: read-only maps of the same
+ * pages are one block, read once, while writable maps and maps made after
+ * the file changed aren't shared; munmap() of part of a map, of a shared
+ * map, and of several maps at once frees each block when its last page
+ * goes. Blocks are counted by wrapping memalign() and free() at link
+ * time. Several threads map and unmap at once last. Built by the host
+ * project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/filemap_check [operations]
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "utils/filemap.h"
+
+#define FILE_PATH   DATA_PATH "filemap_check.bin"
+#define OTHER_PATH  DATA_PATH "filemap_check.other"
+#define PAGE        FILEMAP_PAGE_SIZE
+#define FILE_SIZE   (5 * PAGE + 1234)
+#define THREADS     4
+
+static uint32_t s_rng = 1;
+
+static uint32_t rnd_r(uint32_t * state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static uint32_t rnd(void) {
+    return rnd_r(&s_rng);
+}
+
+static int s_failed;
+static pthread_mutex_t s_fail_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        pthread_mutex_lock(&s_fail_lock); \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+        pthread_mutex_unlock(&s_fail_lock); \
+    } \
+} while (0)
+
+static volatile long s_reads;
+
+// Like the loader's fd_pread(), it reads through the path when it's given,
+// and doesn't set errno
+static int host_read(int fd, const char * path, void * dst, uint32_t len,
+                     int64_t offset) {
+    __sync_fetch_and_add(&s_reads, 1);
+    int saved = errno;
+    int own = path ? open(path, O_RDONLY) : fd;
+    int ret = own < 0 ? -1 : (int)pread(own, dst, len, offset);
+    if (path && own >= 0)
+        close(own);
+    errno = saved;
+    return ret;
+}
+
+static uint8_t s_data[FILE_SIZE];
+
+static void write_file(void) {
+    for (int i = 0; i < FILE_SIZE; i++)
+        s_data[i] = (uint8_t)rnd();
+    FILE * f = fopen(FILE_PATH, "wb");
+    fwrite(s_data, 1, FILE_SIZE, f);
+    fclose(f);
+
+    f = fopen(OTHER_PATH, "wb");
+    fputs("other", f);
+    fclose(f);
+}
+
+/*
+ * Blocks from memalign() not freed yet, which are the maps: linked with
+ * --wrap, filemap.c's calls come here
+ */
+void * __real_memalign(size_t alignment, size_t size);
+void __real_free(void * p);
+
+static pthread_mutex_t s_blocks_lock = PTHREAD_MUTEX_INITIALIZER;
+static void * s_blocks[1024];
+static int s_block_count;
+
+void * __wrap_memalign(size_t alignment, size_t size) {
+    void * p = __real_memalign(alignment, size);
+    pthread_mutex_lock(&s_blocks_lock);
+    if (p && s_block_count < 1024)
+        s_blocks[s_block_count++] = p;
+    pthread_mutex_unlock(&s_blocks_lock);
+    return p;
+}
+
+void __wrap_free(void * p) {
+    pthread_mutex_lock(&s_blocks_lock);
+    for (int i = 0; p && i < s_block_count; i++) {
+        if (s_blocks[i] == p) {
+            s_blocks[i] = s_blocks[--s_block_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_blocks_lock);
+    __real_free(p);
+}
+
+static int blocks(void) {
+    pthread_mutex_lock(&s_blocks_lock);
+    int n = s_block_count;
+    pthread_mutex_unlock(&s_blocks_lock);
+    return n;
+}
+
+// Every byte the real map can be read at, and zeros after it
+static void check_contents(void) {
+    static const int64_t offsets[] = { 0, PAGE, 4 * PAGE, 5 * PAGE, 6 * PAGE };
+    static const size_t lengths[] = {
+        1, 100, PAGE - 1, PAGE, PAGE + 1, 3 * PAGE, FILE_SIZE, 10 * PAGE,
+    };
+    int fd = open(FILE_PATH, O_RDONLY);
+    int maps = 0;
+
+    for (size_t o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++) {
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            int64_t off = offsets[o];
+            size_t len = lengths[l];
+            int prot = l % 2 ? PROT_READ : PROT_READ | PROT_WRITE;
+            uint8_t * ours = filemap_map(len, prot, MAP_PRIVATE, fd, off);
+            uint8_t * real = mmap(NULL, len, prot, MAP_PRIVATE, fd, off);
+            CHECK(ours && real != MAP_FAILED, "%zu at %lld: mapped %p, %p",
+                  len, (long long)off, (void *)ours, (void *)real);
+            if (!ours || real == MAP_FAILED)
+                continue;
+            CHECK((uintptr_t)ours % PAGE == 0, "%p isn't page-aligned",
+                  (void *)ours);
+
+            // Past the page holding the end of the file, the real map faults
+            size_t mapped = (len + PAGE - 1) / PAGE * PAGE;
+            int64_t readable = (FILE_SIZE + PAGE - 1) / PAGE * PAGE - off;
+            for (size_t i = 0; i < mapped; i++) {
+                uint8_t want = (int64_t)i < readable ? real[i] : 0;
+                if (ours[i] != want) {
+                    CHECK(0, "%zu at %lld: byte %zu is %u, want %u", len,
+                          (long long)off, i, ours[i], want);
+                    break;
+                }
+            }
+
+            // Writes stay in a private map
+            if (prot & PROT_WRITE) {
+                ours[0] ^= 0xFF;
+                CHECK(s_data[off < FILE_SIZE ? off : 0] != ours[0]
+                      || off >= FILE_SIZE, "write reached the data");
+            }
+            CHECK(filemap_unmap(ours, len) == 0, "unmap");
+            munmap(real, len);
+            maps++;
+        }
+    }
+    close(fd);
+    printf("   %d maps compared with mmap()\n", maps);
+}
+
+// The same errno as the real mmap() and munmap()
+static void check_errors(void) {
+    int fd = open(FILE_PATH, O_RDONLY);
+    static const struct {
+        const char * what;
+        size_t length;
+        int flags;
+        int fd;
+        int64_t offset;
+    } cases[] = {
+        { "no length", 0, MAP_PRIVATE, 0, 0 },
+        { "no type", PAGE, 0, 0, 0 },
+        { "odd offset", PAGE, MAP_PRIVATE, 0, 100 },
+        { "bad descriptor", PAGE, MAP_PRIVATE, -1, 0 },
+        { "anonymous, no length", 0, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        int f = cases[i].fd < 0 ? cases[i].fd : fd;
+        errno = 0;
+        void * ours = filemap_map(cases[i].length, PROT_READ, cases[i].flags,
+                                  f, cases[i].offset);
+        int ours_errno = errno;
+        errno = 0;
+        void * real = mmap(NULL, cases[i].length, PROT_READ, cases[i].flags,
+                           f, cases[i].offset);
+        int real_errno = errno;
+        CHECK(!ours && real == MAP_FAILED && ours_errno == real_errno,
+              "%s: %p errno %d, real %p errno %d", cases[i].what, ours,
+              ours_errno, real, real_errno);
+        if (real != MAP_FAILED)
+            munmap(real, cases[i].length);
+    }
+
+    // Linux says EOVERFLOW, bionic's mmap64() EINVAL
+    errno = 0;
+    CHECK(!filemap_map(PAGE, PROT_READ, MAP_PRIVATE, fd, -PAGE)
+          && errno == EINVAL, "negative offset: errno %d", errno);
+
+    // Not supported here: there is no choosing where memory goes
+    uint8_t * p = filemap_map(PAGE, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS,
+                              -1, 0);
+    errno = 0;
+    CHECK(!filemap_map(PAGE, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0)
+          && errno == EINVAL, "MAP_FIXED: errno %d", errno);
+
+    static const struct {
+        const char * what;
+        size_t offset;
+        size_t length;
+    } unmaps[] = {
+        { "odd address", 1, PAGE },
+        { "no length", 0, 0 },
+        { "wrapping around", 0, SIZE_MAX },
+    };
+    for (size_t i = 0; i < sizeof(unmaps) / sizeof(unmaps[0]); i++) {
+        errno = 0;
+        int ours = filemap_unmap(p + unmaps[i].offset, unmaps[i].length);
+        int ours_errno = errno;
+        errno = 0;
+        int real = munmap(p + unmaps[i].offset, unmaps[i].length);
+        CHECK(ours == -1 && real == -1 && ours_errno == errno, "%s: %d errno "
+              "%d, real %d errno %d", unmaps[i].what, ours, ours_errno, real,
+              errno);
+    }
+    filemap_unmap(p, PAGE);
+    close(fd);
+}
+
+static uint8_t * map_file(int fd, int prot, size_t len, int64_t offset) {
+    uint8_t * p = filemap_map(len, prot, MAP_PRIVATE, fd, offset);
+    CHECK(p && !memcmp(p, s_data + offset, len), "map of %zu at %lld",
+          len, (long long)offset);
+    return p;
+}
+
+static void check_sharing(void) {
+    int fd = open(FILE_PATH, O_RDONLY);
+    filemap_opened(fd, FILE_PATH);
+
+    // Once read, the same pages of the same file don't cost a thing
+    s_reads = 0;
+    uint8_t * a = map_file(fd, PROT_READ, 2 * PAGE, PAGE);
+    long reads = s_reads;
+    uint8_t * b = map_file(fd, PROT_READ, 2 * PAGE - 10, PAGE);
+    CHECK(a == b && s_reads == reads, "second map: %p, %p; %ld reads",
+          (void *)a, (void *)b, s_reads - reads);
+
+    // Through another descriptor on the same file too
+    int fd2 = open(FILE_PATH, O_RDONLY);
+    filemap_opened(fd2, FILE_PATH);
+    uint8_t * c = map_file(fd2, PROT_READ, 2 * PAGE, PAGE);
+    CHECK(c == a, "map through another descriptor not shared");
+
+    // But not other pages, or writable maps
+    uint8_t * d = map_file(fd, PROT_READ, 2 * PAGE, 2 * PAGE);
+    uint8_t * e = map_file(fd, PROT_READ, 3 * PAGE, PAGE);
+    uint8_t * w = map_file(fd, PROT_READ | PROT_WRITE, 2 * PAGE, PAGE);
+    CHECK(d != a && e != a && w != a, "different maps shared");
+    w[0] ^= 0xFF;
+    CHECK(a[0] == s_data[PAGE], "a write reached a shared map");
+
+    // Unmapped by all but one, the block stays
+    filemap_unmap(a, 2 * PAGE);
+    filemap_unmap(b, 2 * PAGE);
+    CHECK(!memcmp(c, s_data + PAGE, 2 * PAGE), "shared block freed early");
+
+    // The file changes: new maps see it, old ones keep what they had
+    s_data[PAGE] ^= 0xFF;
+    int out = open(FILE_PATH, O_WRONLY);
+    pwrite(out, &s_data[PAGE], 1, PAGE);
+    close(out);
+    filemap_forget(FILE_PATH);
+    uint8_t * f = map_file(fd, PROT_READ, 2 * PAGE, PAGE);
+    CHECK(f != c && c[0] != s_data[PAGE], "map after a change shared");
+
+    // A closed descriptor isn't a file any more, even if its number is
+    filemap_closed(fd2);
+    close(fd2);
+    uint8_t * g = filemap_map(2 * PAGE, PROT_READ, MAP_PRIVATE, fd2, PAGE);
+    CHECK(!g, "map of a closed descriptor");
+    uint8_t * h = map_file(fd, PROT_READ, 2 * PAGE, PAGE);
+    CHECK(h == f, "map after another descriptor closed not shared");
+
+    /*
+     * A descriptor nobody told filemap about, which lands in the same slot
+     * of its table: its maps are its own, and closing it changes nothing
+     */
+    int other = open(OTHER_PATH, O_RDONLY);
+    int alias = fd + 1;
+    while (((alias ^ (alias >> 8)) & 255) != ((fd ^ (fd >> 8)) & 255))
+        alias++;
+    CHECK(dup2(other, alias) == alias, "dup2 to %d", alias);
+    close(other);
+    uint8_t * o = filemap_map(2 * PAGE, PROT_READ, MAP_PRIVATE, alias, PAGE);
+    CHECK(o && o != f && !o[0], "map of another file shared");
+    filemap_unmap(o, 2 * PAGE);
+    filemap_closed(alias);
+    close(alias);
+    CHECK(map_file(fd, PROT_READ, 2 * PAGE, PAGE) == f, "closing another "
+          "descriptor stopped sharing");
+    filemap_unmap(f, 2 * PAGE);
+    CHECK(blocks() == 5, "%d blocks for 5 different maps", blocks());
+
+    filemap_unmap(c, 2 * PAGE);
+    filemap_unmap(d, 2 * PAGE);
+    filemap_unmap(e, 3 * PAGE);
+    filemap_unmap(w, 2 * PAGE);
+    filemap_unmap(f, 2 * PAGE);
+    filemap_unmap(h, 2 * PAGE);
+    filemap_closed(fd);
+    close(fd);
+    CHECK(blocks() == 0, "%d blocks left after unmapping everything",
+          blocks());
+}
+
+static void check_unmap(void) {
+    int fd = open(FILE_PATH, O_RDONLY);
+    filemap_opened(fd, FILE_PATH);
+
+    // Part by part, the middle first, with partial pages counting whole
+    uint8_t * p = map_file(fd, PROT_READ, 5 * PAGE, 0);
+    filemap_unmap(p + 2 * PAGE, 1);
+    filemap_unmap(p + 3 * PAGE, 10);
+    CHECK(!memcmp(p, s_data, 2 * PAGE)
+          && !memcmp(p + 4 * PAGE, s_data + 4 * PAGE, PAGE),
+          "mapped pages changed");
+    filemap_unmap(p, 2 * PAGE);
+    CHECK(blocks() == 1, "freed with a page left");
+    filemap_unmap(p + 4 * PAGE, 100);
+    CHECK(blocks() == 0, "not freed with no page left");
+
+    // Two maps of one block, unmapped a page at a time in turns
+    p = map_file(fd, PROT_READ, 3 * PAGE, 0);
+    uint8_t * q = map_file(fd, PROT_READ, 3 * PAGE, 0);
+    filemap_unmap(p, PAGE);
+    filemap_unmap(q + PAGE, 2 * PAGE);
+    filemap_unmap(p + 2 * PAGE, PAGE);
+    CHECK(p == q && blocks() == 1 && !memcmp(q, s_data, PAGE)
+          && !memcmp(p + PAGE, s_data + PAGE, PAGE), "shared block freed "
+          "with pages left");
+    filemap_unmap(q, PAGE);
+    CHECK(blocks() == 1, "shared block freed with a page left");
+    filemap_unmap(p + PAGE, PAGE);
+    CHECK(blocks() == 0, "shared block not freed");
+
+    // Mapped again after a page went, twice, the block is whole again
+    p = map_file(fd, PROT_READ, 2 * PAGE, 0);
+    filemap_unmap(p, PAGE);
+    filemap_unmap(p, PAGE);
+    q = map_file(fd, PROT_READ, 2 * PAGE, 0);
+    filemap_unmap(q + PAGE, PAGE);
+    filemap_unmap(p + PAGE, PAGE);
+    CHECK(p == q && blocks() == 1 && !memcmp(q, s_data, PAGE),
+          "block freed with a page mapped again");
+    filemap_unmap(q, PAGE);
+    CHECK(blocks() == 0, "block mapped again not freed");
+
+    // One call over several maps, and the space between them
+    uint8_t * maps[8];
+    uintptr_t low = UINTPTR_MAX, high = 0;
+    for (int i = 0; i < 8; i++) {
+        maps[i] = i % 2 ? map_file(fd, PROT_READ, (size_t)(i + 1) * 100,
+                                   (int64_t)(i / 2) * PAGE)
+                        : filemap_map(PAGE * (i + 1), PROT_READ | PROT_WRITE,
+                                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if ((uintptr_t)maps[i] < low)
+            low = (uintptr_t)maps[i];
+        if ((uintptr_t)maps[i] + PAGE * 8 > high)
+            high = (uintptr_t)maps[i] + PAGE * 8;
+    }
+    CHECK(blocks() == 8, "%d blocks for 8 maps", blocks());
+    CHECK(filemap_unmap((void *)low, high - low) == 0, "unmap of everything");
+    CHECK(blocks() == 0, "%d blocks left", blocks());
+
+    filemap_closed(fd);
+    close(fd);
+}
+
+static long s_thread_ops;
+
+static void * thread_main(void * arg) {
+    uint32_t state = (uint32_t)(uintptr_t)arg * 7919 + 1;
+    int fd = open(FILE_PATH, O_RDONLY);
+    filemap_opened(fd, FILE_PATH);
+
+    enum { LIVE = 16 };
+    uint8_t * live[LIVE] = { 0 };
+    size_t lens[LIVE];
+    int64_t offsets[LIVE];
+
+    for (long n = 0; n < s_thread_ops; n++) {
+        int i = (int)(rnd_r(&state) % LIVE);
+        if (live[i]) {
+            // Everything still reads as the file, or zero for anonymous maps
+            uint8_t * p = live[i];
+            size_t k = rnd_r(&state) % lens[i];
+            uint8_t want = offsets[i] < 0 ? 0
+                         : offsets[i] + (int64_t)k < FILE_SIZE
+                           ? s_data[offsets[i] + k] : 0;
+            CHECK(p[k] == want, "byte %zu of a map at %lld is %u, want %u", k,
+                  (long long)offsets[i], p[k], want);
+            filemap_unmap(p, lens[i]);
+            live[i] = NULL;
+        } else if (rnd_r(&state) % 4 == 0) {
+            lens[i] = 1 + rnd_r(&state) % (3 * PAGE);
+            offsets[i] = -1;
+            live[i] = filemap_map(lens[i], PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            CHECK(live[i], "anonymous map failed");
+        } else {
+            lens[i] = 1 + rnd_r(&state) % (3 * PAGE);
+            offsets[i] = (int64_t)(rnd_r(&state) % 7) * PAGE;
+            live[i] = filemap_map(lens[i], PROT_READ, MAP_SHARED, fd,
+                                  offsets[i]);
+            CHECK(live[i], "file map failed");
+        }
+    }
+    for (int i = 0; i < LIVE; i++) {
+        if (live[i])
+            filemap_unmap(live[i], lens[i]);
+    }
+    filemap_closed(fd);
+    close(fd);
+    return NULL;
+}
+
+static void check_threads(long ops) {
+    pthread_t threads[THREADS];
+    s_thread_ops = ops / THREADS;
+    for (int i = 0; i < THREADS; i++)
+        pthread_create(&threads[i], NULL, thread_main, (void *)(uintptr_t)i);
+    for (int i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    CHECK(blocks() == 0, "%d blocks left after the threads", blocks());
+    printf("   %d threads: %ld maps and unmaps\n", THREADS, ops);
+}
+
+int main(int argc, char ** argv) {
+    long ops = argc > 1 ? atol(argv[1]) : 400000;
+
+    filemap_init(host_read);
+    write_file();
+
+    check_contents();
+    check_errors();
+    check_sharing();
+    check_unmap();
+    check_threads(ops);
+
+    if (s_failed)
+        return 1;
+    printf("ok: mmap() compared and %ld threaded operations\n", ops);
+    return 0;
+}
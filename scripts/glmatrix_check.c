@@ -0,0 +1,426 @@
+/*
+ * scripts/glmatrix_check.c
+ *
+ * Drives loader/reimpl/glmatrix.c with random matrix call sequences and
+ * compares what reaches vitaGL with a scalar, double precision GL that
+ * gets the same calls directly. Also checks that matrices are only
+ * uploaded when consumed and when they changed. Built by the host
+ * project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/glmatrix_check [sequences]
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reimpl/glmatrix.h"
+
+#define DEPTH 32
+
+// A plain GL matrix state: one stack per mode, column-major
+typedef struct machine {
+    GLenum mode;
+    int top[3];
+    double stack[3][DEPTH][16];
+} machine;
+
+static machine s_gl;    // what vitaGL would hold
+static machine s_ref;   // what the game asked for
+
+static int s_uploads;   // glLoadMatrixf calls that reached "vitaGL"
+static int s_queries;   // glGet* calls that reached it
+
+static uint32_t s_rng = 1;
+
+static uint32_t rnd(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static float rndf(float lo, float hi) {
+    return lo + (hi - lo) * (float)(rnd() % 100000) / 100000.f;
+}
+
+static int s_failed;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+    } \
+} while (0)
+
+static double * cur(machine * m) {
+    int i = (int)(m->mode - GL_MODELVIEW);
+    return m->stack[i][m->top[i]];
+}
+
+static void m_identity(double * out) {
+    memset(out, 0, 16 * sizeof(double));
+    out[0] = out[5] = out[10] = out[15] = 1;
+}
+
+static void m_mult(machine * m, const double * b) {
+    double * a = cur(m);
+    double r[16];
+    for (int c = 0; c < 4; c++)
+        for (int row = 0; row < 4; row++) {
+            r[c * 4 + row] = 0;
+            for (int k = 0; k < 4; k++)
+                r[c * 4 + row] += a[k * 4 + row] * b[c * 4 + k];
+        }
+    memcpy(a, r, sizeof(r));
+}
+
+static void m_reset(machine * m) {
+    m->mode = GL_MODELVIEW;
+    for (int i = 0; i < 3; i++) {
+        m->top[i] = 0;
+        m_identity(m->stack[i][0]);
+    }
+}
+
+static void m_load(machine * m, const GLfloat * f) {
+    for (int i = 0; i < 16; i++)
+        cur(m)[i] = f[i];
+}
+
+static void m_push(machine * m) {
+    int i = (int)(m->mode - GL_MODELVIEW);
+    memcpy(m->stack[i][m->top[i] + 1], m->stack[i][m->top[i]],
+           16 * sizeof(double));
+    m->top[i]++;
+}
+
+static void m_pop(machine * m) {
+    m->top[m->mode - GL_MODELVIEW]--;
+}
+
+static void m_rotate(machine * m, double a, double x, double y, double z) {
+    double len = sqrt(x * x + y * y + z * z);
+    if (len == 0)
+        return;
+    x /= len; y /= len; z /= len;
+    double s = sin(a * M_PI / 180), c = cos(a * M_PI / 180), ic = 1 - c;
+    double r[16] = {
+        x * x * ic + c,     y * x * ic + z * s, x * z * ic - y * s, 0,
+        x * y * ic - z * s, y * y * ic + c,     y * z * ic + x * s, 0,
+        x * z * ic + y * s, y * z * ic - x * s, z * z * ic + c,     0,
+        0,                  0,                  0,                  1,
+    };
+    m_mult(m, r);
+}
+
+static void m_translate(machine * m, double x, double y, double z) {
+    double t[16];
+    m_identity(t);
+    t[12] = x; t[13] = y; t[14] = z;
+    m_mult(m, t);
+}
+
+static void m_scale(machine * m, double x, double y, double z) {
+    double s[16];
+    m_identity(s);
+    s[0] = x; s[5] = y; s[10] = z;
+    m_mult(m, s);
+}
+
+static void m_frustum(machine * m, double l, double r, double b, double t,
+                      double n, double f) {
+    double fr[16] = {
+        2 * n / (r - l), 0, 0, 0,
+        0, 2 * n / (t - b), 0, 0,
+        (r + l) / (r - l), (t + b) / (t - b), -(f + n) / (f - n), -1,
+        0, 0, -2 * f * n / (f - n), 0,
+    };
+    m_mult(m, fr);
+}
+
+static void m_ortho(machine * m, double l, double r, double b, double t,
+                    double n, double f) {
+    double o[16] = {
+        2 / (r - l), 0, 0, 0,
+        0, 2 / (t - b), 0, 0,
+        0, 0, -2 / (f - n), 0,
+        -(r + l) / (r - l), -(t + b) / (t - b), -(f + n) / (f - n), 1,
+    };
+    m_mult(m, o);
+}
+
+// The mock vitaGL
+
+void glMatrixMode(GLenum mode) { s_gl.mode = mode; }
+void glLoadIdentity(void) { m_identity(cur(&s_gl)); }
+void glPushMatrix(void) { m_push(&s_gl); }
+void glPopMatrix(void) { m_pop(&s_gl); }
+
+void glLoadMatrixf(const GLfloat * m) {
+    m_load(&s_gl, m);
+    s_uploads++;
+}
+
+void glMultMatrixf(const GLfloat * m) {
+    double d[16];
+    for (int i = 0; i < 16; i++)
+        d[i] = m[i];
+    m_mult(&s_gl, d);
+}
+
+void glRotatef(GLfloat a, GLfloat x, GLfloat y, GLfloat z) {
+    m_rotate(&s_gl, a, x, y, z);
+}
+
+void glTranslatef(GLfloat x, GLfloat y, GLfloat z) {
+    m_translate(&s_gl, x, y, z);
+}
+
+void glScalef(GLfloat x, GLfloat y, GLfloat z) {
+    m_scale(&s_gl, x, y, z);
+}
+
+void glFrustumf(GLfloat l, GLfloat r, GLfloat b, GLfloat t, GLfloat n,
+                GLfloat f) {
+    m_frustum(&s_gl, l, r, b, t, n, f);
+}
+
+void glOrthox(GLfixed l, GLfixed r, GLfixed b, GLfixed t, GLfixed n,
+              GLfixed f) {
+    m_ortho(&s_gl, l / 65536., r / 65536., b / 65536., t / 65536.,
+            n / 65536., f / 65536.);
+}
+
+void glLightfv(GLenum light, GLenum pname, const GLfloat * params) {
+    (void)light; (void)pname; (void)params;
+}
+
+void glClipPlanef(GLenum plane, const GLfloat * equation) {
+    (void)plane; (void)equation;
+}
+
+void glGetFloatv(GLenum pname, GLfloat * data) {
+    (void)pname;
+    *data = 0;
+    s_queries++;
+}
+
+void glGetIntegerv(GLenum pname, GLint * data) {
+    (void)pname;
+    *data = 0;
+    s_queries++;
+}
+
+// What vitaGL holds must be what the game asked for
+static void compare(const char * when) {
+    for (int i = 0; i < 3; i++) {
+        const double * got = s_gl.stack[i][s_gl.top[i]];
+        const double * want = s_ref.stack[i][s_ref.top[i]];
+
+        double scale = 1, err = 0;
+        for (int k = 0; k < 16; k++)
+            scale = fmax(scale, fabs(want[k]));
+        for (int k = 0; k < 16; k++)
+            err = fmax(err, fabs(got[k] - want[k]));
+
+        CHECK(err <= 1e-4 * scale, "%s: mode 0x%x off by %g (scale %g)",
+              when, GL_MODELVIEW + i, err, scale);
+    }
+    CHECK(s_gl.top[2] == s_ref.top[2], "%s: texture stack depth", when);
+}
+
+static void random_op(void) {
+    static const GLenum modes[] = { GL_MODELVIEW, GL_PROJECTION, GL_TEXTURE };
+    int mode = (int)(s_ref.mode - GL_MODELVIEW);
+    int depth = s_ref.top[mode];
+
+    switch (rnd() % 12) {
+        case 0: {
+            GLenum m = modes[rnd() % 3];
+            glMatrixMode_soloader(m);
+            s_ref.mode = m;
+            break;
+        }
+        case 1:
+            glLoadIdentity_soloader();
+            m_identity(cur(&s_ref));
+            break;
+        case 2: {
+            GLfloat m[16];
+            for (int i = 0; i < 16; i++)
+                m[i] = rndf(-2, 2);
+            glLoadMatrixf_soloader(m);
+            m_load(&s_ref, m);
+            break;
+        }
+        case 3: {
+            // Unaligned, like the game's pointers can be
+            GLfloat buf[17];
+            GLfloat * m = buf + 1;
+            double d[16];
+            for (int i = 0; i < 16; i++)
+                d[i] = m[i] = rndf(-1, 1);
+            glMultMatrixf_soloader(m);
+            m_mult(&s_ref, d);
+            break;
+        }
+        case 4:
+            if (depth + 1 < DEPTH - 1) {
+                glPushMatrix_soloader();
+                m_push(&s_ref);
+            }
+            break;
+        case 5:
+            if (depth > 0) {
+                glPopMatrix_soloader();
+                m_pop(&s_ref);
+            }
+            break;
+        case 6: {
+            float a = rndf(-360, 360), x = rndf(-1, 1), y = rndf(-1, 1),
+                  z = rndf(-1, 1);
+            glRotatef_soloader(a, x, y, z);
+            m_rotate(&s_ref, a, x, y, z);
+            break;
+        }
+        case 7: {
+            float x = rndf(-10, 10), y = rndf(-10, 10), z = rndf(-10, 10);
+            glTranslatef_soloader(x, y, z);
+            m_translate(&s_ref, x, y, z);
+            break;
+        }
+        case 8: {
+            float x = rndf(0.5f, 2), y = rndf(0.5f, 2), z = rndf(0.5f, 2);
+            glScalef_soloader(x, y, z);
+            m_scale(&s_ref, x, y, z);
+            break;
+        }
+        case 9: {
+            float w = rndf(0.5f, 2), h = rndf(0.5f, 2), n = rndf(0.5f, 2);
+            float f = n + rndf(10, 100);
+            glFrustumf_soloader(-w, w, -h, h, n, f);
+            m_frustum(&s_ref, -w, w, -h, h, n, f);
+            break;
+        }
+        case 10: {
+            GLfixed w = (GLfixed)(rnd() % (960 << 16)) + (1 << 16);
+            GLfixed h = (GLfixed)(rnd() % (544 << 16)) + (1 << 16);
+            glOrthox_soloader(0, w, h, 0, -(1 << 16), 1 << 16);
+            m_ortho(&s_ref, 0, w / 65536., h / 65536., 0, -1, 1);
+            break;
+        }
+        case 11: {
+            // Consumers: each of them must leave vitaGL up to date
+            GLfloat eq[4] = { 0, 0, 1, 0 };
+            GLint v;
+            switch (rnd() % 4) {
+                case 0: glmatrix_flush(); break;
+                case 1: glClipPlanef_soloader(GL_CLIP_PLANE0, eq); break;
+                case 2: glLightfv_soloader(GL_LIGHT0, GL_POSITION, eq); break;
+                case 3: glGetIntegerv_soloader(GL_VIEWPORT, &v); break;
+            }
+            compare("consumer");
+            break;
+        }
+    }
+}
+
+static void check_random(int sequences) {
+    for (int s = 0; s < sequences; s++) {
+        glMatrixMode_soloader(GL_MODELVIEW);
+        s_ref.mode = GL_MODELVIEW;
+        for (int op = 0; op < 40; op++)
+            random_op();
+        glmatrix_flush();
+        compare("end of sequence");
+
+        // Start the next sequence from identities, as a frame would
+        for (int i = 0; i < 3; i++) {
+            GLenum mode = GL_MODELVIEW + (GLenum)i;
+            glMatrixMode_soloader(mode);
+            s_ref.mode = mode;
+            while (s_ref.top[i] > 0) {
+                glPopMatrix_soloader();
+                m_pop(&s_ref);
+            }
+            glLoadIdentity_soloader();
+            m_identity(cur(&s_ref));
+        }
+    }
+}
+
+static void check_lazy(void) {
+    glMatrixMode_soloader(GL_MODELVIEW);
+    glLoadIdentity_soloader();
+    glTranslatef_soloader(1, 2, 3);
+    glmatrix_flush();
+
+    int uploads = s_uploads;
+    glmatrix_flush();
+    CHECK(s_uploads == uploads, "a clean flush uploaded");
+
+    glPushMatrix_soloader();
+    glRotatef_soloader(30, 0, 1, 0);
+    glScalef_soloader(2, 2, 2);
+    glPopMatrix_soloader();
+    glmatrix_flush();
+    CHECK(s_uploads == uploads, "push/modify/pop uploaded");
+
+    glTranslatef_soloader(0, 0, 0);
+    glTranslatef_soloader(0, 0, 1);
+    glTranslatef_soloader(0, 0, 1);
+    CHECK(s_uploads == uploads, "uploaded before a consumer");
+    glmatrix_flush();
+    CHECK(s_uploads == uploads + 1, "%d uploads for one change",
+          s_uploads - uploads);
+
+    // Lights only need the matrix for positions and directions
+    uploads = s_uploads;
+    GLfloat v[4] = { 1, 1, 1, 1 };
+    glTranslatef_soloader(1, 0, 0);
+    glLightfv_soloader(GL_LIGHT0, GL_AMBIENT, v);
+    CHECK(s_uploads == uploads, "glLightfv(GL_AMBIENT) uploaded");
+    glLightfv_soloader(GL_LIGHT0, GL_SPOT_DIRECTION, v);
+    CHECK(s_uploads == uploads + 1, "glLightfv(GL_SPOT_DIRECTION) didn't");
+
+    // Matrix queries come from the CPU copy
+    int queries = s_queries;
+    GLint depth = 0, mode = 0;
+    GLfloat m[16];
+    glPushMatrix_soloader();
+    glGetIntegerv_soloader(GL_MODELVIEW_STACK_DEPTH, &depth);
+    glGetIntegerv_soloader(GL_MATRIX_MODE, &mode);
+    glGetFloatv_soloader(GL_MODELVIEW_MATRIX, m);
+    glPopMatrix_soloader();
+    CHECK(s_queries == queries, "matrix queries reached vitaGL");
+    CHECK(depth == 2, "stack depth %d", depth);
+    CHECK(mode == GL_MODELVIEW, "matrix mode 0x%x", mode);
+    CHECK(m[12] == 2 && m[13] == 2 && m[14] == 5, "modelview %g %g %g",
+          m[12], m[13], m[14]);
+}
+
+int main(int argc, char ** argv) {
+    int sequences = argc > 1 ? atoi(argv[1]) : 20000;
+
+    m_reset(&s_gl);
+    m_reset(&s_ref);
+    check_random(sequences);
+    check_lazy();
+
+    if (s_failed)
+        return 1;
+    printf("ok: %d sequences, %d uploads\n", sequences, s_uploads);
+    return 0;
+}
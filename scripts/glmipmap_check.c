@@ -0,0 +1,417 @@
+/*
+ * scripts/glmipmap_check.c
+ *
+ * Checks loader/reimpl/glmipmap.c against a mock GL. Random images of 1 to
+ * 4 bytes per pixel, of odd and even sizes and with every unpack
+ * alignment, get their chain built; each level the mock receives has to
+ * match a plain 2x2 box filter that averages an odd last row or column
+ * with itself. That covers both the NEON path (RGBA, eight pixels at a
+ * time) and the scalar one next to it.
+ *
+ * Chains big enough for the disk cache are read back on the next upload of
+ * the same image, which a byte changed in the stored chain gives away. A
+ * stored chain whose header doesn't match, or that's cut short, is built
+ * again and stored over. glGenerateMipmap is skipped only for textures
+ * with a chain. Built by the host project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/glmipmap_check [images]
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <ftw.h>
+#include <glob.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "reimpl/glmipmap.h"
+#include "reimpl/glstate.h"
+#include "reimpl/gltexture.h"
+
+#define MIPS        DATA_PATH "mips"
+#define MAX_LEVELS  16
+#define MAX_SIZE    300
+#define HEADER_SIZE 24 // glmipmap_header
+#define NAMES       8192 // GLMIPMAP_NAMES in glmipmap.c
+
+static uint32_t s_rng = 1;
+
+static uint32_t rnd(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static int s_failed;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+    } \
+} while (0)
+
+static const GLenum s_formats[5] = {
+    0, GL_LUMINANCE, GL_LUMINANCE_ALPHA, GL_RGB, GL_RGBA
+};
+
+// Mock GL, and the parts of glstate and gltexture glmipmap asks
+typedef struct upload {
+    GLint level;
+    GLint internal_format;
+    GLsizei width;
+    GLsizei height;
+    GLenum format;
+    GLenum type;
+    uint8_t * data;
+} upload;
+
+static upload s_uploads[MAX_LEVELS];
+static int s_upload_count;
+static int s_generated;
+static uint32_t s_align = 4;
+static GLuint s_bound;
+
+static inline uint32_t stride_of(uint32_t width, uint32_t bpp) {
+    return (width * bpp + s_align - 1) & ~(s_align - 1);
+}
+
+void glTexImage2D(GLenum target, GLint level, GLint internalFormat,
+                  GLsizei width, GLsizei height, GLint border, GLenum format,
+                  GLenum type, const GLvoid * data) {
+    (void)target;
+    (void)border;
+    if (s_upload_count == MAX_LEVELS)
+        return;
+
+    uint32_t bpp = 0;
+    while (bpp < 4 && s_formats[bpp] != format)
+        bpp++;
+    size_t size = (size_t)stride_of(width, bpp) * height;
+
+    upload * u = &s_uploads[s_upload_count++];
+    *u = (upload){ level, internalFormat, width, height, format, type,
+                   malloc(size) };
+    memcpy(u->data, data, size);
+}
+
+void glGenerateMipmap(GLenum target) {
+    (void)target;
+    s_generated++;
+}
+
+uint32_t glstate_bound_texture(GLenum target) {
+    return target == GL_TEXTURE_2D ? s_bound : GLSTATE_UNKNOWN;
+}
+
+uint32_t glstate_unpack_alignment(void) {
+    return s_align;
+}
+
+size_t glstate_unpack_size(uint32_t width, uint32_t height, uint32_t bpp) {
+    return (size_t)stride_of(width, bpp) * (height - 1) + width * bpp;
+}
+
+GLuint gltexture_storage(GLuint texture) {
+    return texture;
+}
+
+static void uploads_clear(void) {
+    for (int i = 0; i < s_upload_count; i++)
+        free(s_uploads[i].data);
+    s_upload_count = 0;
+}
+
+// A client image with rows padded to s_align; only the last row isn't
+static uint8_t * make_image(uint32_t width, uint32_t height, uint32_t bpp) {
+    size_t size = glstate_unpack_size(width, height, bpp);
+    uint8_t * data = malloc(size);
+    for (size_t i = 0; i < size; i++)
+        data[i] = (uint8_t)rnd();
+    return data;
+}
+
+// Next level of a packed image, into a packed one
+static void reference_half(const uint8_t * src, uint32_t width,
+                           uint32_t height, uint32_t bpp, uint8_t * dst) {
+    uint32_t dw = width > 1 ? width / 2 : 1;
+    uint32_t dh = height > 1 ? height / 2 : 1;
+    for (uint32_t y = 0; y < dh; y++) {
+        uint32_t y0 = 2 * y, y1 = 2 * y + 1 < height ? 2 * y + 1 : 2 * y;
+        for (uint32_t x = 0; x < dw; x++) {
+            uint32_t x0 = 2 * x, x1 = 2 * x + 1 < width ? 2 * x + 1 : 2 * x;
+            for (uint32_t c = 0; c < bpp; c++) {
+                uint32_t sum = src[(y0 * width + x0) * bpp + c]
+                               + src[(y0 * width + x1) * bpp + c]
+                               + src[(y1 * width + x0) * bpp + c]
+                               + src[(y1 * width + x1) * bpp + c];
+                dst[(y * dw + x) * bpp + c] = (uint8_t)((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+/*
+ * The uploads of the last chain match the reference built from `image`,
+ * comparing pixels only: row padding is left as it is
+ */
+static bool chain_matches(const uint8_t * image, uint32_t width,
+                          uint32_t height, uint32_t bpp, const char * what) {
+    static uint8_t a[MAX_SIZE * MAX_SIZE * 4], b[MAX_SIZE * MAX_SIZE * 4];
+    uint32_t w = width, h = height;
+    for (uint32_t y = 0; y < h; y++)
+        memcpy(a + y * w * bpp, image + y * stride_of(w, bpp), w * bpp);
+
+    uint8_t * cur = a, * next = b;
+    int level = 0;
+    while (w > 1 || h > 1) {
+        reference_half(cur, w, h, bpp, next);
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+        level++;
+
+        upload * u = level <= s_upload_count ? &s_uploads[level - 1] : NULL;
+        if (!u || u->level != level || u->width != (GLsizei)w
+            || u->height != (GLsizei)h || u->format != s_formats[bpp]
+            || u->type != GL_UNSIGNED_BYTE || u->internal_format != 7) {
+            CHECK(false, "%s: level %d: wrong upload", what, level);
+            return false;
+        }
+        for (uint32_t y = 0; y < h; y++) {
+            const uint8_t * row = u->data + y * stride_of(w, bpp);
+            if (memcmp(row, next + y * w * bpp, w * bpp) != 0) {
+                uint32_t x = 0;
+                while (row[x] == next[y * w * bpp + x])
+                    x++;
+                CHECK(false, "%s: level %d (%ux%u), byte %u of row %u: %u, "
+                      "not %u", what, level, w, h, x, y, row[x],
+                      next[y * w * bpp + x]);
+                return false;
+            }
+        }
+
+        uint8_t * t = cur;
+        cur = next;
+        next = t;
+    }
+    CHECK(s_upload_count == level, "%s: %d levels uploaded, not %d", what,
+          s_upload_count, level);
+    return s_upload_count == level;
+}
+
+static void upload_image(GLuint storage, const uint8_t * image,
+                         uint32_t width, uint32_t height, uint32_t bpp) {
+    uploads_clear();
+    glmipmap_upload(storage, GL_TEXTURE_2D, 7, width, height, s_formats[bpp],
+                    GL_UNSIGNED_BYTE, image);
+}
+
+static int remove_entry(const char * path, const struct stat * st, int flag,
+                        struct FTW * ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+static void clear_cache(void) {
+    nftw(MIPS, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+// The one stored chain, "" if there's none or more
+static void stored_chain(char * path, size_t size) {
+    glob_t g;
+    path[0] = '\0';
+    if (glob(MIPS "/*/*.mip", 0, NULL, &g) == 0) {
+        if (g.gl_pathc == 1)
+            snprintf(path, size, "%s", g.gl_pathv[0]);
+        globfree(&g);
+    }
+}
+
+static void check_chains(int images) {
+    static const uint32_t sizes[][2] = {
+        { 1, 2 }, { 2, 1 }, { 2, 2 }, { 3, 5 }, { 7, 3 }, { 8, 8 }, { 9, 17 },
+        { 17, 9 }, { 16, 1 }, { 1, 33 }, { 33, 31 }, { 100, 37 }, { 64, 64 },
+    };
+    static const uint32_t aligns[] = { 1, 2, 4, 8 };
+    int chains = 0;
+
+    for (int i = 0; i < images; i++) {
+        uint32_t bpp = 1 + i % 4;
+        s_align = aligns[(i / 4) % 4];
+        uint32_t k = (uint32_t)i / 16;
+        uint32_t width, height;
+        if (k < sizeof(sizes) / sizeof(sizes[0])) {
+            width = sizes[k][0];
+            height = sizes[k][1];
+        } else {
+            width = rnd() % 140 + 1;
+            height = rnd() % 140 + 1;
+        }
+
+        char what[64];
+        snprintf(what, sizeof(what), "%ux%u, %u bpp, aligned to %u", width,
+                 height, bpp, s_align);
+        uint8_t * image = make_image(width, height, bpp);
+        upload_image(1, image, width, height, bpp);
+        chains += chain_matches(image, width, height, bpp, what);
+        free(image);
+    }
+
+    // Nothing to add to a single pixel, or to what isn't 8 bits a channel
+    uint8_t pixel[4] = { 1, 2, 3, 4 };
+    upload_image(1, pixel, 1, 1, 4);
+    CHECK(s_upload_count == 0, "a chain for a single pixel");
+    uploads_clear();
+    glmipmap_upload(1, GL_TEXTURE_2D, 7, 2, 2, GL_RGB,
+                    GL_UNSIGNED_SHORT_5_6_5, pixel);
+    CHECK(s_upload_count == 0, "a chain for 16-bit pixels");
+    s_align = 4;
+    printf("   %d chains built\n", chains);
+}
+
+static bool stored_is(const char * path, const uint8_t * data, size_t size) {
+    static uint8_t buf[256 * 1024];
+    FILE * f = fopen(path, "rb");
+    size_t got = f ? fread(buf, 1, sizeof(buf), f) : 0;
+    if (f)
+        fclose(f);
+    return got == size && !memcmp(buf, data, size);
+}
+
+static void patch(const char * path, long at, uint8_t value) {
+    FILE * f = fopen(path, "r+b");
+    fseek(f, at, SEEK_SET);
+    fputc(value, f);
+    fclose(f);
+}
+
+static void check_cache(void) {
+    clear_cache();
+
+    // Under GLMIPMAP_CACHE_MIN: nothing stored
+    uint8_t * image = make_image(32, 32, 4);
+    upload_image(1, image, 32, 32, 4);
+    char path[256];
+    stored_chain(path, sizeof(path));
+    CHECK(!path[0], "small chain stored");
+    free(image);
+
+    // 128x128 RGBA: 21844 bytes of chain
+    image = make_image(128, 128, 4);
+    upload_image(1, image, 128, 128, 4);
+    chain_matches(image, 128, 128, 4, "cached, built");
+    stored_chain(path, sizeof(path));
+    CHECK(path[0], "chain not stored");
+    if (!path[0]) {
+        free(image);
+        return;
+    }
+
+    static uint8_t file[HEADER_SIZE + 21844];
+    FILE * f = fopen(path, "rb");
+    size_t size = f ? fread(file, 1, sizeof(file) + 1, f) : 0;
+    if (f)
+        fclose(f);
+    CHECK(size == sizeof(file) && !memcmp(file, "MIPC", 4), "%zu bytes "
+          "stored", size);
+
+    // Read back: a byte changed in the file shows up in level 1
+    uint8_t changed = (uint8_t)~file[HEADER_SIZE];
+    patch(path, HEADER_SIZE, changed);
+    upload_image(1, image, 128, 128, 4);
+    CHECK(s_upload_count == 7 && s_uploads[0].data[0] == changed,
+          "chain not read back");
+
+    // Anything off in the header, or too short: built and stored again
+    static const struct { const char * what; long at; } damage[] = {
+        { "magic", 0 }, { "version", 4 }, { "width", 8 }, { "height", 12 },
+        { "format", 16 }, { "levels", 20 },
+    };
+    for (size_t i = 0; i < sizeof(damage) / sizeof(damage[0]); i++) {
+        patch(path, damage[i].at, file[damage[i].at] ^ 0x40);
+        upload_image(1, image, 128, 128, 4);
+        chain_matches(image, 128, 128, 4, damage[i].what);
+        CHECK(stored_is(path, file, sizeof(file)), "%s: not stored again",
+              damage[i].what);
+    }
+
+    CHECK(truncate(path, sizeof(file) - 1) == 0, "truncate");
+    upload_image(1, image, 128, 128, 4);
+    chain_matches(image, 128, 128, 4, "cut short");
+    CHECK(stored_is(path, file, sizeof(file)), "cut short: not stored again");
+
+    // The same bytes with other row padding are another image
+    s_align = 8;
+    upload_image(1, image, 128, 128, 4);
+    chain_matches(image, 128, 128, 4, "aligned to 8");
+    s_align = 4;
+    stored_chain(path, sizeof(path));
+    CHECK(!path[0], "one chain stored for both alignments");
+
+    free(image);
+    uploads_clear();
+    clear_cache();
+}
+
+static void check_generate(void) {
+    uint8_t * image = make_image(16, 16, 4);
+    static const GLuint names[] = { 1, NAMES - 1, NAMES };
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        GLuint name = names[i];
+        bool tracked = name < NAMES;
+        s_bound = name;
+
+        s_generated = 0;
+        upload_image(name, image, 16, 16, 4);
+        glGenerateMipmap_soloader(GL_TEXTURE_2D);
+        CHECK(s_generated == !tracked, "texture %u: generated %d times with "
+              "a chain", name, s_generated);
+
+        s_generated = 0;
+        glmipmap_forget(name);
+        glGenerateMipmap_soloader(GL_TEXTURE_2D);
+        CHECK(s_generated == 1, "texture %u: not generated without a chain",
+              name);
+
+        // A new image that gets no chain of ours loses the old one too
+        upload_image(name, image, 16, 16, 4);
+        glmipmap_upload(name, GL_TEXTURE_2D, 7, 16, 16, GL_RGBA,
+                        GL_UNSIGNED_SHORT_4_4_4_4, image);
+        s_generated = 0;
+        glGenerateMipmap_soloader(GL_TEXTURE_2D);
+        CHECK(s_generated == 1, "texture %u: not generated after a 16-bit "
+              "image", name);
+    }
+
+    s_bound = 0;
+    free(image);
+    uploads_clear();
+}
+
+int main(int argc, char ** argv) {
+    int images = argc > 1 ? atoi(argv[1]) : 2000;
+
+    clear_cache();
+    check_chains(images);
+    check_cache();
+    check_generate();
+
+    if (s_failed)
+        return 1;
+    printf("ok: mip chains built, cached and read back\n");
+    return 0;
+}
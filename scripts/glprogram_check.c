@@ -0,0 +1,409 @@
+/*
+ * scripts/glprogram_check.c
+ *
+ * Checks the lookups of loader/reimpl/glprogram.c against a mock of
+ * vitaGL's program reflection, on random programs that get linked,
+ * relinked with other contents, and fail to link. Every answer has to be
+ * the one vitaGL gives, with its "_texture" and bone palette quirks fixed
+ * up, and a name looked up once more since the last link must not reach
+ * vitaGL again. Built by the host project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/glprogram_check [iterations]
+ *
+ * There are a few more program names than glprogram keeps, so the
+ * uncached path gets its share.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reimpl/glprogram.h"
+
+#define PROGRAMS        520 // a few past the ones glprogram keeps
+#define CACHED          512
+#define MAX_UNIFORMS    48
+#define MAX_ATTRIBS     8
+#define MAX_SEEN        32
+#define NAME_MAX        48
+
+typedef struct variable {
+    char name[NAME_MAX];
+    GLint location;
+    GLint size;
+    GLenum type;
+} variable;
+
+typedef struct reflection {
+    bool ok;
+    int uniforms;
+    int attribs;
+    variable u[MAX_UNIFORMS];
+    variable a[MAX_ATTRIBS];
+} reflection;
+
+static reflection s_pending[PROGRAMS + 1]; // attached, linked next
+static reflection s_linked[PROGRAMS + 1];  // what vitaGL has
+
+// Test side: names looked up since the last link, and which ids are cached
+static char s_seen[PROGRAMS + 1][MAX_SEEN][NAME_MAX];
+static int s_seen_count[PROGRAMS + 1];
+static bool s_cached[PROGRAMS + 1];
+static bool s_ever_linked[PROGRAMS + 1];
+static int s_distinct_linked;
+
+static uint32_t s_queries; // location queries that reached vitaGL
+static uint32_t s_lookup_queries; // of those, made by lookups
+
+static uint32_t s_rng = 1;
+
+static uint32_t rnd(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static int s_failed;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+    } \
+} while (0)
+
+// Mock vitaGL
+
+// Array uniforms are found by "name[0]", "name" and "name[i]"
+static GLint find(const variable * v, int count, const char * name) {
+    for (int i = 0; i < count; i++) {
+        if (!strcmp(v[i].name, name))
+            return v[i].location;
+
+        size_t base = strlen(v[i].name);
+        if (base < 3 || strcmp(v[i].name + base - 3, "[0]") != 0)
+            continue;
+        base -= 3;
+        if (strncmp(v[i].name, name, base) != 0)
+            continue;
+        if (name[base] == '\0')
+            return v[i].location;
+
+        char * end;
+        long k = name[base] == '[' ? strtol(name + base + 1, &end, 10) : -1;
+        if (k >= 0 && k < v[i].size && end[0] == ']' && end[1] == '\0')
+            return v[i].location + (GLint)k;
+    }
+    return -1;
+}
+
+void glLinkProgram(GLuint program) {
+    s_linked[program] = s_pending[program];
+}
+
+void glGetProgramiv(GLuint program, GLenum pname, GLint * params) {
+    const reflection * p = &s_linked[program];
+    switch (pname) {
+        case GL_LINK_STATUS: *params = p->ok ? GL_TRUE : GL_FALSE; break;
+        case GL_ACTIVE_UNIFORMS: *params = p->ok ? p->uniforms : 0; break;
+        case GL_ACTIVE_ATTRIBUTES: *params = p->ok ? p->attribs : 0; break;
+    }
+}
+
+static void active(const variable * v, int count, GLuint index,
+                   GLsizei bufSize, GLsizei * length, GLint * size,
+                   GLenum * type, GLchar * name) {
+    if (index >= (GLuint)count)
+        return; // GL_INVALID_VALUE
+
+    *size = v[index].size;
+    *type = v[index].type;
+    GLsizei n = (GLsizei)strlen(v[index].name);
+    if (bufSize <= 0)
+        n = 0;
+    else if (n > bufSize - 1)
+        n = bufSize - 1;
+    if (bufSize > 0) {
+        memcpy(name, v[index].name, n);
+        name[n] = '\0';
+    }
+    if (length)
+        *length = n;
+}
+
+void glGetActiveUniform(GLuint program, GLuint index, GLsizei bufSize,
+                        GLsizei * length, GLint * size, GLenum * type,
+                        GLchar * name) {
+    const reflection * p = &s_linked[program];
+    active(p->u, p->ok ? p->uniforms : 0, index, bufSize, length, size, type,
+           name);
+}
+
+void glGetActiveAttrib(GLuint program, GLuint index, GLsizei bufSize,
+                       GLsizei * length, GLint * size, GLenum * type,
+                       GLchar * name) {
+    const reflection * p = &s_linked[program];
+    active(p->a, p->ok ? p->attribs : 0, index, bufSize, length, size, type,
+           name);
+}
+
+GLint glGetUniformLocation(GLuint program, const GLchar * name) {
+    s_queries++;
+    const reflection * p = &s_linked[program];
+    return p->ok ? find(p->u, p->uniforms, name) : -1;
+}
+
+GLint glGetAttribLocation(GLuint program, const GLchar * name) {
+    s_queries++;
+    const reflection * p = &s_linked[program];
+    return p->ok ? find(p->a, p->attribs, name) : -1;
+}
+
+// What the game should see
+
+static GLint want_uniform_location(GLuint program, const char * name) {
+    const reflection * p = &s_linked[program];
+    if (!p->ok)
+        return -1;
+    return find(p->u, p->uniforms, strcmp(name, "texture") ? name
+                                                           : "_texture");
+}
+
+static GLint want_attrib_location(GLuint program, const char * name) {
+    const reflection * p = &s_linked[program];
+    return p->ok ? find(p->a, p->attribs, name) : -1;
+}
+
+// The uniform as the game knows it
+static variable game_uniform(const variable * v) {
+    variable g = *v;
+    if (!strcmp(g.name, "_texture"))
+        strcpy(g.name, "texture");
+    if (!strcmp(g.name, "BoneMatrices")) {
+        g.type = GL_FLOAT_MAT4;
+        g.size = 48;
+    }
+    return g;
+}
+
+// Random programs
+
+static const char * s_names[] = {
+    "u_mvp", "_texture", "BoneMatrices", "u_color", "fogColor", "lights[0]",
+    "u_normalMatrix", "alphaRef", "u_time", "texture2", "costarring",
+};
+
+#define NAMES (sizeof(s_names) / sizeof(s_names[0]))
+
+static void random_program(reflection * p) {
+    memset(p, 0, sizeof(*p));
+    p->ok = rnd() % 10 != 0;
+
+    // Locations go up in steps wide enough for the arrays
+    GLint location = (GLint)(rnd() % 4);
+    p->uniforms = (int)(rnd() % MAX_UNIFORMS);
+    for (int i = 0; i < p->uniforms; i++) {
+        variable * v = &p->u[i];
+        if (i < (int)NAMES && rnd() % 4)
+            strcpy(v->name, s_names[i]);
+        else
+            snprintf(v->name, NAME_MAX, "u%d_%u%s", i, rnd() % 1000,
+                     rnd() % 4 ? "" : "[0]");
+        v->size = strstr(v->name, "[0]") ? 1 + (GLint)(rnd() % 8) : 1;
+        v->type = !strcmp(v->name, "_texture") ? GL_SAMPLER_2D
+                  : !strcmp(v->name, "BoneMatrices") ? GL_FLOAT_MAT4 - 1
+                  : rnd() % 2 ? GL_FLOAT_VEC4 : GL_FLOAT_MAT4;
+        v->location = location;
+        location += v->size + (GLint)(rnd() % 3);
+    }
+
+    static const char * attribs[] = {
+        "position", "normal", "texcoord", "color", "boneIndices",
+    };
+    p->attribs = (int)(rnd() % MAX_ATTRIBS);
+    for (int i = 0; i < p->attribs; i++) {
+        variable * v = &p->a[i];
+        if (i < 5)
+            strcpy(v->name, attribs[i]);
+        else
+            snprintf(v->name, NAME_MAX, "a%d", i);
+        v->size = 1;
+        v->type = GL_FLOAT_VEC4;
+        v->location = (GLint)((i + rnd() % 2) % MAX_ATTRIBS);
+    }
+}
+
+// A name the game might ask for
+static void random_name(GLuint id, bool uniform, char * name) {
+    const reflection * p = &s_linked[id];
+    int count = uniform ? p->uniforms : p->attribs;
+
+    if (count == 0 || rnd() % 4 == 0) {
+        // "liquid" has the same name hash as "costarring"
+        static const char * others[] = {
+            "texture", "_texture", "nope", "u_mvp[0]", "lights", "", "liquid",
+        };
+        strcpy(name, others[rnd() % 7]);
+        return;
+    }
+
+    const variable * v = uniform ? &p->u[rnd() % count] : &p->a[rnd() % count];
+    variable g = uniform ? game_uniform(v) : *v;
+    strcpy(name, g.name);
+
+    char * bracket = strstr(name, "[0]");
+    if (bracket && rnd() % 2) {
+        if (rnd() % 2)
+            *bracket = '\0';
+        else
+            snprintf(bracket, NAME_MAX - (bracket - name), "[%u]",
+                     rnd() % (g.size + 1));
+    }
+}
+
+static void link_program(GLuint id, bool change) {
+    if (!s_ever_linked[id]) {
+        s_ever_linked[id] = true;
+        s_cached[id] = s_distinct_linked++ < CACHED;
+    }
+    if (change)
+        random_program(&s_pending[id]);
+    glLinkProgram_soloader(id);
+    s_seen_count[id] = 0;
+}
+
+// Whether a lookup is to be answered without asking vitaGL
+static bool answered_from_cache(GLuint id, bool uniform, const char * name) {
+    if (!s_cached[id])
+        return false;
+
+    const reflection * p = &s_linked[id];
+    if (uniform && p->ok) {
+        for (int i = 0; i < p->uniforms; i++) {
+            if (!strcmp(game_uniform(&p->u[i]).name, name))
+                return true;
+        }
+    }
+    if (!uniform && p->ok) {
+        for (int i = 0; i < p->attribs; i++) {
+            if (!strcmp(p->a[i].name, name))
+                return true;
+        }
+    }
+
+    // Looked up before; uniform and attribute names share the list here,
+    // so they're told apart by a prefix
+    for (int i = 0; i < s_seen_count[id]; i++) {
+        if (s_seen[id][i][0] == (uniform ? 'u' : 'a')
+            && !strcmp(s_seen[id][i] + 1, name))
+            return true;
+    }
+    return false;
+}
+
+static void remember(GLuint id, bool uniform, const char * name) {
+    if (s_seen_count[id] < MAX_SEEN) {
+        snprintf(s_seen[id][s_seen_count[id]++], NAME_MAX, "%c%s",
+                 uniform ? 'u' : 'a', name);
+    }
+}
+
+static void check_location(GLuint id, bool uniform, long step) {
+    char name[NAME_MAX];
+    random_name(id, uniform, name);
+
+    bool cached = answered_from_cache(id, uniform, name);
+    uint32_t queries = s_queries;
+    GLint got = uniform ? glGetUniformLocation_soloader(id, name)
+                        : glGetAttribLocation_soloader(id, name);
+    GLint want = uniform ? want_uniform_location(id, name)
+                         : want_attrib_location(id, name);
+
+    CHECK(got == want, "step %ld: program %u %s \"%s\" at %d, want %d", step,
+          id, uniform ? "uniform" : "attribute", name, got, want);
+    s_lookup_queries += s_queries - queries;
+    CHECK(!cached || s_queries == queries,
+          "step %ld: program %u \"%s\" asked vitaGL again", step, id, name);
+    remember(id, uniform, name);
+}
+
+static void check_active_uniform(GLuint id, long step) {
+    static const GLsizei sizes[] = { 0, 1, 4, 8, NAME_MAX, 256 };
+    const reflection * p = &s_linked[id];
+    int count = p->ok ? p->uniforms : 0;
+    GLuint index = rnd() % (count + 2);
+    GLsizei bufSize = sizes[rnd() % 6];
+
+    char got[256] = "untouched", want[256] = "untouched";
+    GLsizei got_len = -1, want_len = -1;
+    GLint got_size = -1, want_size = -1;
+    GLenum got_type = 0, want_type = 0;
+
+    glGetActiveUniform_soloader(id, index, bufSize,
+                                rnd() % 4 ? &got_len : NULL, &got_size,
+                                &got_type, got);
+    if (index < (GLuint)count) {
+        variable g = game_uniform(&p->u[index]);
+        want_size = g.size;
+        want_type = g.type;
+        want_len = (GLsizei)strlen(g.name);
+        if (bufSize <= 0)
+            want_len = 0;
+        else if (want_len > bufSize - 1)
+            want_len = bufSize - 1;
+        if (bufSize > 0) {
+            memcpy(want, g.name, want_len);
+            want[want_len] = '\0';
+        }
+    }
+
+    CHECK(!strcmp(got, want) && got_size == want_size
+          && got_type == want_type && (got_len == -1 || got_len == want_len),
+          "step %ld: program %u uniform %u (bufSize %d): \"%s\" %d %d %#x, "
+          "want \"%s\" %d %d %#x", step, id, index, bufSize, got, got_len,
+          got_size, got_type, want, want_len, want_size, want_type);
+}
+
+int main(int argc, char ** argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 300000;
+
+    for (GLuint id = 1; id <= PROGRAMS; id++)
+        link_program(id, true);
+
+    uint64_t lookups = 0;
+
+    for (long i = 0; i < iterations; i++) {
+        GLuint id = 1 + rnd() % PROGRAMS;
+        uint32_t r = rnd() % 100;
+
+        if (r < 2)
+            link_program(id, true);
+        else if (r < 3)
+            link_program(id, false);
+        else if (r < 50)
+            check_location(id, true, i), lookups++;
+        else if (r < 70)
+            check_location(id, false, i), lookups++;
+        else
+            check_active_uniform(id, i);
+    }
+
+    printf("   %u of %llu lookups reached vitaGL\n", s_lookup_queries,
+           (unsigned long long)lookups);
+
+    if (s_failed)
+        return 1;
+    printf("ok: %ld random calls on %d programs\n", iterations, PROGRAMS);
+    return 0;
+}
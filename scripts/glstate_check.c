@@ -0,0 +1,619 @@
+/*
+ * scripts/glstate_check.c
+ *
+ * Replays random GL state calls through loader/reimpl/glstate.c into a
+ * mock GL, and the same calls straight into a second mock, and checks that
+ * both always end up in the same state. Built by the host project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/glstate_check [iterations]
+ *
+ * Along the way the context is lost now and then (both mocks get the same
+ * random state and the filter is invalidated), textures, buffers and
+ * programs get deleted, and the per frame count of dropped calls has to
+ * match the number of calls that didn't reach the filtered mock.
+ *
+ * gltexture.c is replaced with a model of its image sharing: names
+ * ALIAS_BASE.. keep their image in the GL texture of another name, which
+ * stays alive while they use it even if its own name gets deleted.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reimpl/glstate.h"
+#include "reimpl/gltexture.h"
+
+#define UNITS           20  // a few past the ones glstate keeps
+#define TEXTURES        16
+#define ALIASES         8
+#define ALIAS_BASE      64  // shares the image of name - ALIAS_OFFSET
+#define ALIAS_OFFSET    60
+#define BUFFERS         6
+#define PROGRAMS        5
+#define DELETED         0x80000000u // current program whose name was freed
+
+#define GL_TEXTURE_OTHER 0x8C1A // passed through, not shadowed
+#define GL_BUFFER_OTHER  0x88EC
+
+enum { T_2D, T_CUBE, T_OTHER, T_NUM };
+enum { B_ARRAY, B_ELEMENT, B_OTHER, B_NUM };
+
+static const GLenum s_tex_targets[T_NUM] = {
+    GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_OTHER
+};
+
+static const GLenum s_buf_targets[B_NUM] = {
+    GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_OTHER
+};
+
+// GL_DITHER is not shadowed; GL_TEXTURE_2D is kept per unit
+static const GLenum s_caps[] = {
+    GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_ALPHA_TEST, GL_SCISSOR_TEST,
+    GL_STENCIL_TEST, GL_POLYGON_OFFSET_FILL, GL_FOG, GL_LIGHTING, GL_DITHER
+};
+
+#define CAPS (sizeof(s_caps) / sizeof(s_caps[0]))
+
+static const GLenum s_factors[] = {
+    GL_ZERO, GL_ONE, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA
+};
+
+static const GLenum s_faces[] = { GL_FRONT, GL_BACK, GL_FRONT_AND_BACK };
+
+typedef struct machine {
+    uint32_t unit;
+    uint32_t texture[UNITS][T_NUM];  // GL texture, not the name
+    uint8_t texture_2d[UNITS];
+    uint32_t buffer[B_NUM];
+    uint32_t program;
+    uint8_t caps[CAPS];
+    uint32_t blend_src;
+    uint32_t blend_dst;
+    uint8_t depth_mask;
+    uint32_t cull_face;
+    int32_t unpack_alignment;
+    int32_t pack_alignment;
+
+    // gltexture model
+    uint8_t alias_alive[ALIASES];
+    uint8_t host_dead[ALIASES];
+
+    uint32_t calls; // must stay last, see same()
+} machine;
+
+static machine s_gl;    // behind glstate
+static machine s_ref;   // every call
+static machine * s_cur = &s_gl;
+
+static uint32_t s_rng = 1;
+
+static uint32_t rnd(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static int s_failed;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+    } \
+} while (0)
+
+static int tex_index(GLenum target) {
+    for (int t = 0; t < T_NUM; t++) {
+        if (s_tex_targets[t] == target)
+            return t;
+    }
+    return -1;
+}
+
+static int buf_index(GLenum target) {
+    for (int t = 0; t < B_NUM; t++) {
+        if (s_buf_targets[t] == target)
+            return t;
+    }
+    return -1;
+}
+
+static int cap_index(GLenum cap) {
+    for (size_t c = 0; c < CAPS; c++) {
+        if (s_caps[c] == cap)
+            return (int)c;
+    }
+    return -1;
+}
+
+// Mock vitaGL
+
+void glActiveTexture(GLenum texture) {
+    s_cur->calls++;
+    s_cur->unit = texture - GL_TEXTURE0;
+}
+
+void glBindTexture(GLenum target, GLuint texture) {
+    s_cur->calls++;
+    s_cur->texture[s_cur->unit][tex_index(target)] = texture;
+}
+
+void glDeleteTextures(GLsizei n, const GLuint * textures) {
+    for (GLsizei i = 0; i < n; i++) {
+        for (int u = 0; u < UNITS; u++) {
+            for (int t = 0; t < T_NUM; t++) {
+                if (s_cur->texture[u][t] == textures[i])
+                    s_cur->texture[u][t] = 0;
+            }
+        }
+    }
+}
+
+void glBindBuffer(GLenum target, GLuint buffer) {
+    s_cur->calls++;
+    s_cur->buffer[buf_index(target)] = buffer;
+}
+
+void glDeleteBuffers(GLsizei n, const GLuint * buffers) {
+    s_cur->calls++;
+    for (GLsizei i = 0; i < n; i++) {
+        for (int t = 0; t < B_NUM; t++) {
+            if (buffers[i] && s_cur->buffer[t] == buffers[i])
+                s_cur->buffer[t] = 0;
+        }
+    }
+}
+
+void glUseProgram(GLuint program) {
+    s_cur->calls++;
+    s_cur->program = program;
+}
+
+void glDeleteProgram(GLuint program) {
+    s_cur->calls++;
+    // Stays current, but the next program made may get the same name
+    if (program && s_cur->program == program)
+        s_cur->program = DELETED | program;
+}
+
+static void set_cap(GLenum cap, uint8_t enabled) {
+    s_cur->calls++;
+    if (cap == GL_TEXTURE_2D)
+        s_cur->texture_2d[s_cur->unit] = enabled;
+    else
+        s_cur->caps[cap_index(cap)] = enabled;
+}
+
+void glEnable(GLenum cap) {
+    set_cap(cap, 1);
+}
+
+void glDisable(GLenum cap) {
+    set_cap(cap, 0);
+}
+
+void glBlendFunc(GLenum sfactor, GLenum dfactor) {
+    s_cur->calls++;
+    s_cur->blend_src = sfactor;
+    s_cur->blend_dst = dfactor;
+}
+
+void glDepthMask(GLboolean flag) {
+    s_cur->calls++;
+    s_cur->depth_mask = flag != 0;
+}
+
+void glCullFace(GLenum mode) {
+    s_cur->calls++;
+    s_cur->cull_face = mode;
+}
+
+void glPixelStorei(GLenum pname, GLint param) {
+    s_cur->calls++;
+    if (param != 1 && param != 2 && param != 4 && param != 8)
+        return; // GL_INVALID_VALUE
+    if (pname == GL_UNPACK_ALIGNMENT)
+        s_cur->unpack_alignment = param;
+    else if (pname == GL_PACK_ALIGNMENT)
+        s_cur->pack_alignment = param;
+}
+
+// Model of reimpl/gltexture.c
+
+static int alias_of(GLuint texture) {
+    int a = (int)texture - ALIAS_BASE;
+    return (a >= 0 && a < ALIASES) ? a : -1;
+}
+
+static int host_of(GLuint texture) {
+    int a = (int)texture + ALIAS_OFFSET - ALIAS_BASE;
+    return (texture != 0 && a >= 0 && a < ALIASES) ? a : -1;
+}
+
+GLuint gltexture_storage(GLuint texture) {
+    int a = alias_of(texture);
+    return (a >= 0 && s_cur->alias_alive[a]) ? texture - ALIAS_OFFSET
+                                             : texture;
+}
+
+void gltexture_bind(GLenum target, GLuint texture) {
+    glBindTexture(target, gltexture_storage(texture));
+}
+
+void gltexture_delete(GLsizei n, const GLuint * textures) {
+    s_cur->calls++;
+    for (GLsizei i = 0; i < n; i++) {
+        GLuint texture = textures[i];
+        int a = alias_of(texture);
+        int h = host_of(texture);
+
+        if (a >= 0 && s_cur->alias_alive[a]) {
+            // The last user of a dead host's image frees it
+            s_cur->alias_alive[a] = 0;
+            if (s_cur->host_dead[a]) {
+                s_cur->host_dead[a] = 0;
+                GLuint host = texture - ALIAS_OFFSET;
+                glDeleteTextures(1, &host);
+            }
+        } else if (h >= 0 && s_cur->alias_alive[h]) {
+            s_cur->host_dead[h] = 1;
+        } else if (texture != 0) {
+            glDeleteTextures(1, &texture);
+        }
+    }
+}
+
+// Replay
+
+static int same(const machine * a, const machine * b) {
+    return memcmp(a, b, offsetof(machine, calls)) == 0;
+}
+
+static GLuint random_texture(void) {
+    if (rnd() % 4 == 0)
+        return ALIAS_BASE + rnd() % ALIASES;
+    return rnd() % TEXTURES;
+}
+
+// What the context looks like after it was lost and made current again
+static void scramble(machine * m) {
+    m->unit = rnd() % UNITS;
+    for (int u = 0; u < UNITS; u++) {
+        for (int t = 0; t < T_NUM; t++)
+            m->texture[u][t] = rnd() % TEXTURES;
+        m->texture_2d[u] = rnd() % 2;
+    }
+    for (int t = 0; t < B_NUM; t++)
+        m->buffer[t] = rnd() % BUFFERS;
+    m->program = rnd() % PROGRAMS;
+    for (size_t c = 0; c < CAPS; c++)
+        m->caps[c] = rnd() % 2;
+    m->blend_src = s_factors[rnd() % 4];
+    m->blend_dst = s_factors[rnd() % 4];
+    m->depth_mask = rnd() % 2;
+    m->cull_face = s_faces[rnd() % 3];
+}
+
+typedef struct op {
+    int kind;
+    GLenum a;
+    GLuint b;
+    GLuint names[3];
+    GLsizei n;
+} op;
+
+enum {
+    OP_ACTIVE_TEXTURE,
+    OP_BIND_TEXTURE,
+    OP_BIND_BUFFER,
+    OP_USE_PROGRAM,
+    OP_ENABLE,
+    OP_DISABLE,
+    OP_BLEND_FUNC,
+    OP_DEPTH_MASK,
+    OP_CULL_FACE,
+    OP_PIXEL_STORE,
+    OP_DELETE_TEXTURES,
+    OP_DELETE_BUFFERS,
+    OP_DELETE_PROGRAM,
+    OP_NUM
+};
+
+static op random_op(void) {
+    static const GLint alignments[] = { 1, 2, 4, 8, 3 };
+    op o = { .kind = rnd() % OP_NUM };
+
+    switch (o.kind) {
+        case OP_ACTIVE_TEXTURE:
+            o.a = GL_TEXTURE0 + rnd() % UNITS;
+            break;
+        case OP_BIND_TEXTURE:
+            o.a = s_tex_targets[rnd() % T_NUM];
+            o.b = random_texture();
+            break;
+        case OP_BIND_BUFFER:
+            o.a = s_buf_targets[rnd() % B_NUM];
+            o.b = rnd() % BUFFERS;
+            break;
+        case OP_USE_PROGRAM:
+        case OP_DELETE_PROGRAM:
+            o.b = rnd() % PROGRAMS;
+            break;
+        case OP_ENABLE:
+        case OP_DISABLE:
+            o.a = rnd() % (CAPS + 1) == CAPS ? GL_TEXTURE_2D
+                                             : s_caps[rnd() % CAPS];
+            break;
+        case OP_BLEND_FUNC:
+            o.a = s_factors[rnd() % 4];
+            o.b = s_factors[rnd() % 4];
+            break;
+        case OP_DEPTH_MASK:
+            o.b = rnd() % 3; // 2 is true as well
+            break;
+        case OP_CULL_FACE:
+            o.a = s_faces[rnd() % 3];
+            break;
+        case OP_PIXEL_STORE:
+            o.a = rnd() % 2 ? GL_UNPACK_ALIGNMENT : GL_PACK_ALIGNMENT;
+            o.b = (GLuint)alignments[rnd() % 5];
+            break;
+        case OP_DELETE_TEXTURES:
+        case OP_DELETE_BUFFERS:
+            o.n = 1 + rnd() % 3;
+            for (GLsizei i = 0; i < o.n; i++) {
+                o.names[i] = o.kind == OP_DELETE_TEXTURES ? random_texture()
+                                                          : rnd() % BUFFERS;
+            }
+            break;
+    }
+    return o;
+}
+
+static void run_filtered(const op * o) {
+    s_cur = &s_gl;
+    switch (o->kind) {
+        case OP_ACTIVE_TEXTURE: glActiveTexture_soloader(o->a); break;
+        case OP_BIND_TEXTURE: glBindTexture_soloader(o->a, o->b); break;
+        case OP_BIND_BUFFER: glBindBuffer_soloader(o->a, o->b); break;
+        case OP_USE_PROGRAM: glUseProgram_soloader(o->b); break;
+        case OP_ENABLE: glEnable_soloader(o->a); break;
+        case OP_DISABLE: glDisable_soloader(o->a); break;
+        case OP_BLEND_FUNC: glBlendFunc_soloader(o->a, o->b); break;
+        case OP_DEPTH_MASK: glDepthMask_soloader((GLboolean)o->b); break;
+        case OP_CULL_FACE: glCullFace_soloader(o->a); break;
+        case OP_PIXEL_STORE: glPixelStorei_soloader(o->a, (GLint)o->b); break;
+        case OP_DELETE_TEXTURES:
+            glDeleteTextures_soloader(o->n, o->names);
+            break;
+        case OP_DELETE_BUFFERS: glDeleteBuffers_soloader(o->n, o->names); break;
+        case OP_DELETE_PROGRAM: glDeleteProgram_soloader(o->b); break;
+    }
+}
+
+static void run_direct(const op * o) {
+    s_cur = &s_ref;
+    switch (o->kind) {
+        case OP_ACTIVE_TEXTURE: glActiveTexture(o->a); break;
+        case OP_BIND_TEXTURE: gltexture_bind(o->a, o->b); break;
+        case OP_BIND_BUFFER: glBindBuffer(o->a, o->b); break;
+        case OP_USE_PROGRAM: glUseProgram(o->b); break;
+        case OP_ENABLE: glEnable(o->a); break;
+        case OP_DISABLE: glDisable(o->a); break;
+        case OP_BLEND_FUNC: glBlendFunc(o->a, o->b); break;
+        case OP_DEPTH_MASK: glDepthMask((GLboolean)o->b); break;
+        case OP_CULL_FACE: glCullFace(o->a); break;
+        case OP_PIXEL_STORE: glPixelStorei(o->a, (GLint)o->b); break;
+        case OP_DELETE_TEXTURES: gltexture_delete(o->n, o->names); break;
+        case OP_DELETE_BUFFERS: glDeleteBuffers(o->n, o->names); break;
+        case OP_DELETE_PROGRAM: glDeleteProgram(o->b); break;
+    }
+    s_cur = &s_gl;
+}
+
+// What glstate reports has to match the filtered mock, unless unknown
+static void check_queries(long step) {
+    s_cur = &s_gl;
+    for (int t = 0; t < T_NUM; t++) {
+        uint32_t q = glstate_bound_texture(s_tex_targets[t]);
+        CHECK(q == GLSTATE_UNKNOWN || (s_gl.unit < UNITS
+              && gltexture_storage(q) == s_gl.texture[s_gl.unit][t]),
+              "step %ld: texture target %d reported %u, bound %u", step, t,
+              q, s_gl.texture[s_gl.unit][t]);
+    }
+    for (int t = 0; t < B_NUM; t++) {
+        uint32_t q = glstate_bound_buffer(s_buf_targets[t]);
+        CHECK(q == GLSTATE_UNKNOWN || q == s_gl.buffer[t],
+              "step %ld: buffer target %d reported %u, bound %u", step, t,
+              q, s_gl.buffer[t]);
+    }
+    CHECK(glstate_unpack_alignment() == (uint32_t)s_gl.unpack_alignment,
+          "step %ld: unpack alignment %u, GL has %d", step,
+          glstate_unpack_alignment(), s_gl.unpack_alignment);
+}
+
+static void reset(void) {
+    memset(&s_gl, 0, sizeof(s_gl));
+    s_gl.unpack_alignment = 4;
+    s_gl.pack_alignment = 4;
+    scramble(&s_gl);
+    memset(s_gl.alias_alive, 1, sizeof(s_gl.alias_alive));
+    s_ref = s_gl;
+    glstate_invalidate();
+    glPixelStorei_soloader(GL_UNPACK_ALIGNMENT, 4);
+    s_ref.calls = s_gl.calls;
+}
+
+static void check_replay(long iterations) {
+    reset();
+    uint32_t frame_gl = s_gl.calls;
+    uint32_t frame_ref = s_ref.calls;
+    uint64_t dropped = 0, total = 0;
+
+    for (long i = 0; i < iterations; i++) {
+        uint32_t r = rnd() % 1000;
+
+        if (r < 3) {
+            // Lost context: same random state in both, filter forgets it
+            scramble(&s_gl);
+            machine keep = s_ref;
+            s_ref = s_gl;
+            s_ref.calls = keep.calls;
+            memcpy(s_ref.alias_alive, keep.alias_alive,
+                   sizeof(keep.alias_alive));
+            memcpy(s_ref.host_dead, keep.host_dead, sizeof(keep.host_dead));
+            glstate_invalidate();
+        } else if (r < 20) {
+            glstate_frame_end();
+            uint32_t want = (s_ref.calls - frame_ref) - (s_gl.calls - frame_gl);
+            CHECK(glstate_dropped_last_frame() == want,
+                  "step %ld: %u dropped, %u calls missing", i,
+                  glstate_dropped_last_frame(), want);
+            dropped += want;
+            total += s_ref.calls - frame_ref;
+            frame_gl = s_gl.calls;
+            frame_ref = s_ref.calls;
+        } else if (r < 25) {
+            // Names that shared an image get one again
+            for (int a = 0; a < ALIASES; a++) {
+                if (!s_gl.alias_alive[a] && !s_gl.host_dead[a]
+                    && rnd() % 2) {
+                    s_gl.alias_alive[a] = s_ref.alias_alive[a] = 1;
+                    // The upload that shares it rebinds the name
+                    uint32_t n = ALIAS_BASE + a;
+                    for (int u = 0; u < UNITS; u++) {
+                        for (int t = 0; t < T_NUM; t++) {
+                            if (s_gl.texture[u][t] == n)
+                                s_gl.texture[u][t] = n - ALIAS_OFFSET;
+                            if (s_ref.texture[u][t] == n)
+                                s_ref.texture[u][t] = n - ALIAS_OFFSET;
+                        }
+                    }
+                }
+            }
+        } else {
+            op o = random_op();
+            run_filtered(&o);
+            run_direct(&o);
+            if (!same(&s_gl, &s_ref)) {
+                CHECK(0, "step %ld: op %d (%#x, %u) left a different state",
+                      i, o.kind, o.a, o.b);
+                s_ref.calls = s_gl.calls;
+                s_gl = s_ref; // go on from the correct state
+                glstate_invalidate();
+            }
+        }
+
+        check_queries(i);
+    }
+
+    CHECK(dropped > 0 && dropped < total, "dropped %llu of %llu calls",
+          (unsigned long long)dropped, (unsigned long long)total);
+    printf("   dropped %llu of %llu calls\n", (unsigned long long)dropped,
+           (unsigned long long)total);
+}
+
+// Every kind of filtered call, twice in a row and after an invalidate
+static void check_repeats(void) {
+    static const op ops[] = {
+        { OP_ACTIVE_TEXTURE, GL_TEXTURE0 + 3, 0, { 0 }, 0 },
+        { OP_BIND_TEXTURE, GL_TEXTURE_2D, 5, { 0 }, 0 },
+        { OP_BIND_TEXTURE, GL_TEXTURE_CUBE_MAP, 6, { 0 }, 0 },
+        { OP_BIND_BUFFER, GL_ARRAY_BUFFER, 2, { 0 }, 0 },
+        { OP_BIND_BUFFER, GL_ELEMENT_ARRAY_BUFFER, 3, { 0 }, 0 },
+        { OP_USE_PROGRAM, 0, 4, { 0 }, 0 },
+        { OP_ENABLE, GL_BLEND, 0, { 0 }, 0 },
+        { OP_DISABLE, GL_DEPTH_TEST, 0, { 0 }, 0 },
+        { OP_ENABLE, GL_TEXTURE_2D, 0, { 0 }, 0 },
+        { OP_BLEND_FUNC, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, { 0 }, 0 },
+        { OP_DEPTH_MASK, 0, 1, { 0 }, 0 },
+        { OP_CULL_FACE, GL_FRONT, 0, { 0 }, 0 },
+    };
+    static const size_t count = sizeof(ops) / sizeof(ops[0]);
+
+    reset();
+    for (size_t i = 0; i < count; i++) {
+        uint32_t calls = s_gl.calls;
+        run_filtered(&ops[i]);
+        CHECK(s_gl.calls == calls + 1, "first call %zu dropped", i);
+        run_filtered(&ops[i]);
+        CHECK(s_gl.calls == calls + 1, "second call %zu not dropped", i);
+    }
+
+    glstate_invalidate();
+    for (size_t i = 0; i < count; i++) {
+        uint32_t calls = s_gl.calls;
+        run_filtered(&ops[i]);
+        CHECK(s_gl.calls == calls + 1, "call %zu after invalidate dropped", i);
+    }
+
+    // Past the units glstate keeps, and targets it doesn't know
+    static const op unknown[] = {
+        { OP_BIND_TEXTURE, GL_TEXTURE_OTHER, 5, { 0 }, 0 },
+        { OP_BIND_BUFFER, GL_BUFFER_OTHER, 2, { 0 }, 0 },
+        { OP_ENABLE, GL_DITHER, 0, { 0 }, 0 },
+        { OP_ACTIVE_TEXTURE, GL_TEXTURE0 + 17, 0, { 0 }, 0 },
+        { OP_BIND_TEXTURE, GL_TEXTURE_2D, 5, { 0 }, 0 },
+        { OP_ENABLE, GL_TEXTURE_2D, 0, { 0 }, 0 },
+    };
+    for (size_t i = 0; i < sizeof(unknown) / sizeof(unknown[0]); i++) {
+        for (int k = 0; k < 2; k++) {
+            uint32_t calls = s_gl.calls;
+            run_filtered(&unknown[i]);
+            CHECK(s_gl.calls == calls + 1, "unshadowed call %zu dropped", i);
+        }
+    }
+    glstate_frame_end();
+}
+
+static void check_unpack_size(void) {
+    static const GLint alignments[] = { 1, 2, 4, 8 };
+    for (int a = 0; a < 4; a++) {
+        glPixelStorei_soloader(GL_UNPACK_ALIGNMENT, alignments[a]);
+        for (uint32_t w = 0; w < 20; w++) {
+            for (uint32_t h = 0; h < 4; h++) {
+                for (uint32_t bpp = 1; bpp <= 4; bpp++) {
+                    size_t want = 0;
+                    for (uint32_t y = 0; y < h; y++) {
+                        size_t row = (size_t)w * bpp;
+                        want = y + 1 < h ? want + (row + alignments[a] - 1)
+                                           / alignments[a] * alignments[a]
+                                         : want + row;
+                    }
+                    if (!w)
+                        want = 0;
+                    CHECK(glstate_unpack_size(w, h, bpp) == want,
+                          "unpack size %ux%ux%u align %d: %zu, want %zu",
+                          w, h, bpp, alignments[a],
+                          glstate_unpack_size(w, h, bpp), want);
+                }
+            }
+        }
+    }
+    glPixelStorei_soloader(GL_UNPACK_ALIGNMENT, 4);
+}
+
+int main(int argc, char ** argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 200000;
+
+    check_repeats();
+    check_unpack_size();
+    check_replay(iterations);
+
+    if (s_failed)
+        return 1;
+    printf("ok: %ld random calls against a pass-through GL\n", iterations);
+    return 0;
+}
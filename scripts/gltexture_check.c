@@ -0,0 +1,884 @@
+/*
+ * scripts/gltexture_check.c
+ *
+ * Checks the texture sharing of loader/reimpl/gltexture.c, with glstate.c
+ * and glmipmap.c in front of it as in the loader, against a mock GL that
+ * keeps the image and sampler parameters of every texture. Built by the
+ * host project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/gltexture_check [steps]
+ *
+ * The directed cases go through the ways an image changes hands: an upload
+ * matching a live image, deleting the name that holds the image or one that
+ * uses it, respecifying the holder, partial updates of a shared image (a
+ * copy of its own for the updated name, or the update for every name when
+ * the format can't be rendered to), parameters set through one name and
+ * then bound through another, and names handed out again.
+ *
+ * Then random uploads, updates, parameter changes and deletes over a few
+ * names and images are checked against what each name should show: bound,
+ * every name's GL texture holds its image and parameters. The GL never
+ * hands out a name the game still holds, no GL texture is deleted while it
+ * is in use, and none is left once the game deleted its names. Everything
+ * runs with mipmaps off and on.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reimpl/glstate.h"
+#include "reimpl/gltexture.h"
+
+#define TABLE_NAMES 8192 // GLTEXTURE_NAMES in gltexture.c
+#define GL_NAMES    (TABLE_NAMES + 64)
+#define FRAMEBUFFERS 8
+#define MAX_BYTES   (8 * 8 * 4)
+#define LIVE        12   // names the random game holds at most
+#define POOL        6
+
+#define GL_COMPRESSED 0x8C00 // any compressed format; the mock only copies
+
+bool setting_enableMipMaps;
+
+static int s_failed;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+    } \
+} while (0)
+
+static uint32_t s_rng = 0x7E47u;
+
+static uint32_t rnd(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+enum { P_MIN, P_MAG, P_WRAP_S, P_WRAP_T, P_NUM };
+
+static const GLint s_defaults[P_NUM] = {
+    GL_NEAREST_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT, GL_REPEAT
+};
+
+static int param_slot(GLenum pname) {
+    switch (pname) {
+        case GL_TEXTURE_MIN_FILTER: return P_MIN;
+        case GL_TEXTURE_MAG_FILTER: return P_MAG;
+        case GL_TEXTURE_WRAP_S: return P_WRAP_S;
+        case GL_TEXTURE_WRAP_T: return P_WRAP_T;
+        default: return -1;
+    }
+}
+
+static uint32_t bpp_of(GLenum format) {
+    switch (format) {
+        case GL_RGBA: return 4;
+        case GL_RGB: return 3;
+        case GL_LUMINANCE: return 1;
+        default: return 0;
+    }
+}
+
+// An image as the GL holds it, or as the game expects a name to show it
+typedef struct image {
+    GLenum format; // GL_COMPRESSED, or 0 for none
+    uint32_t width;
+    uint32_t height;
+    uint32_t size;
+    uint8_t data[MAX_BYTES];
+} image;
+
+static void image_patch(image * dst, uint32_t x, uint32_t y, uint32_t w,
+                        uint32_t h, const uint8_t * src, uint32_t stride) {
+    uint32_t bpp = bpp_of(dst->format);
+    for (uint32_t row = 0; row < h; row++) {
+        memcpy(dst->data + ((y + row) * dst->width + x) * bpp,
+               src + row * stride, w * bpp);
+    }
+}
+
+/*
+ * Mock GL: texture names from 1 up, lowest free first, from s_gen_base to
+ * put them past the name table of gltexture.c. One texture unit.
+ */
+typedef struct texture {
+    bool alive;
+    image img;
+    GLint params[P_NUM];
+} texture;
+
+static texture s_gl[GL_NAMES];
+static GLuint s_gen_base = 1;
+static GLuint s_bound;
+static GLuint s_framebuffer;
+static bool s_fb_alive[FRAMEBUFFERS];
+static GLuint s_attached[FRAMEBUFFERS];
+static uint32_t s_uploads; // level 0 images with data, and copies
+
+static texture * bound(const char * what) {
+    CHECK(s_bound && s_gl[s_bound].alive, "%s on texture %u, not alive",
+          what, s_bound);
+    return &s_gl[s_bound];
+}
+
+void glGenTextures(GLsizei n, GLuint * textures) {
+    for (GLsizei i = 0; i < n; i++) {
+        GLuint t = s_gen_base;
+        while (s_gl[t].alive)
+            t++;
+        if (t >= GL_NAMES) {
+            printf("FAIL %s: out of texture names\n", __func__);
+            exit(1);
+        }
+        memset(&s_gl[t], 0, sizeof(s_gl[t]));
+        s_gl[t].alive = true;
+        memcpy(s_gl[t].params, s_defaults, sizeof(s_defaults));
+        textures[i] = t;
+    }
+}
+
+void glDeleteTextures(GLsizei n, const GLuint * textures) {
+    for (GLsizei i = 0; i < n; i++) {
+        GLuint t = textures[i];
+        CHECK(t < GL_NAMES && s_gl[t].alive, "deleting texture %u, not "
+              "alive", t);
+        if (t >= GL_NAMES)
+            continue;
+        s_gl[t].alive = false;
+        if (s_bound == t)
+            s_bound = 0;
+        for (int f = 0; f < FRAMEBUFFERS; f++) {
+            if (s_attached[f] == t)
+                s_attached[f] = 0;
+        }
+    }
+}
+
+void glBindTexture(GLenum target, GLuint texture) {
+    CHECK(target == GL_TEXTURE_2D, "target 0x%x", target);
+    CHECK(texture < GL_NAMES && (!texture || s_gl[texture].alive),
+          "binding texture %u, not alive", texture);
+    s_bound = texture < GL_NAMES ? texture : 0;
+}
+
+void glTexImage2D(GLenum target, GLint level, GLint internalFormat,
+                  GLsizei width, GLsizei height, GLint border, GLenum format,
+                  GLenum type, const GLvoid * data) {
+    (void)border;
+    (void)type;
+    texture * t = bound("glTexImage2D");
+    if (target != GL_TEXTURE_2D || level > 0)
+        return;
+
+    CHECK((GLenum)internalFormat == format, "internal format 0x%x",
+          internalFormat);
+    t->img.format = format;
+    t->img.width = width;
+    t->img.height = height;
+    t->img.size = width * height * bpp_of(format);
+    if (data) {
+        memcpy(t->img.data, data, t->img.size);
+        s_uploads++;
+    } else {
+        memset(t->img.data, 0, t->img.size);
+    }
+}
+
+void glCompressedTexImage2D(GLenum target, GLint level,
+                            GLenum internalformat, GLsizei width,
+                            GLsizei height, GLint border, GLsizei imageSize,
+                            const void * data) {
+    (void)internalformat;
+    (void)border;
+    texture * t = bound("glCompressedTexImage2D");
+    if (target != GL_TEXTURE_2D || level > 0)
+        return;
+
+    t->img.format = GL_COMPRESSED;
+    t->img.width = width;
+    t->img.height = height;
+    t->img.size = imageSize;
+    memcpy(t->img.data, data, imageSize);
+    s_uploads++;
+}
+
+void glTexSubImage2D(GLenum target, GLint level, GLint xoffset,
+                     GLint yoffset, GLsizei width, GLsizei height,
+                     GLenum format, GLenum type, const GLvoid * pixels) {
+    (void)target;
+    (void)type;
+    texture * t = bound("glTexSubImage2D");
+    if (level > 0)
+        return;
+
+    CHECK(format == t->img.format, "sub-image of 0x%x into 0x%x", format,
+          t->img.format);
+    image_patch(&t->img, xoffset, yoffset, width, height, pixels,
+                width * bpp_of(format));
+}
+
+void glCopyTexSubImage2D(GLenum target, GLint level, GLint xoffset,
+                         GLint yoffset, GLint x, GLint y, GLsizei width,
+                         GLsizei height) {
+    (void)target;
+    texture * t = bound("glCopyTexSubImage2D");
+    GLuint from = s_attached[s_framebuffer];
+    CHECK(s_framebuffer && from && s_gl[from].alive, "copy from "
+          "framebuffer %u, texture %u", s_framebuffer, from);
+    if (level > 0 || !from)
+        return;
+
+    // Stored as the texture's format: RGBA read into RGB loses its alpha
+    const image * src = &s_gl[from].img;
+    uint32_t bpp = bpp_of(t->img.format), src_bpp = bpp_of(src->format);
+    uint8_t rows[MAX_BYTES];
+    for (GLsizei r = 0; r < height; r++) {
+        for (GLsizei c = 0; c < width; c++) {
+            memcpy(rows + (r * width + c) * bpp,
+                   src->data + ((y + r) * src->width + x + c) * src_bpp, bpp);
+        }
+    }
+    image_patch(&t->img, xoffset, yoffset, width, height, rows, width * bpp);
+    s_uploads++;
+}
+
+static void set_param(GLenum pname, GLint param) {
+    texture * t = bound("glTexParameter");
+    int p = param_slot(pname);
+    if (p >= 0)
+        t->params[p] = param;
+}
+
+void glTexParameteri(GLenum target, GLenum pname, GLint param) {
+    (void)target;
+    set_param(pname, param);
+}
+
+void glTexParameterf(GLenum target, GLenum pname, GLfloat param) {
+    (void)target;
+    set_param(pname, (GLint)param);
+}
+
+void glTexParameterx(GLenum target, GLenum pname, GLfixed param) {
+    (void)target;
+    set_param(pname, param);
+}
+
+void glGenerateMipmap(GLenum target) {
+    (void)target;
+    bound("glGenerateMipmap");
+}
+
+void glGenFramebuffers(GLsizei n, GLuint * framebuffers) {
+    for (GLsizei i = 0; i < n; i++) {
+        GLuint f = 1;
+        while (f < FRAMEBUFFERS && s_fb_alive[f])
+            f++;
+        if (f == FRAMEBUFFERS) {
+            printf("FAIL %s: out of framebuffers\n", __func__);
+            exit(1);
+        }
+        s_fb_alive[f] = true;
+        s_attached[f] = 0;
+        framebuffers[i] = f;
+    }
+}
+
+void glDeleteFramebuffers(GLsizei n, const GLuint * framebuffers) {
+    for (GLsizei i = 0; i < n; i++) {
+        GLuint f = framebuffers[i];
+        CHECK(f < FRAMEBUFFERS && s_fb_alive[f], "deleting framebuffer %u",
+              f);
+        if (f >= FRAMEBUFFERS)
+            continue;
+        s_fb_alive[f] = false;
+        if (s_framebuffer == f)
+            s_framebuffer = 0;
+    }
+}
+
+void glBindFramebuffer(GLenum target, GLuint framebuffer) {
+    (void)target;
+    CHECK(framebuffer < FRAMEBUFFERS && (!framebuffer
+          || s_fb_alive[framebuffer]), "binding framebuffer %u",
+          framebuffer);
+    s_framebuffer = framebuffer < FRAMEBUFFERS ? framebuffer : 0;
+}
+
+void glFramebufferTexture2D(GLenum target, GLenum attachment,
+                            GLenum textarget, GLuint texture, GLint level) {
+    (void)target;
+    (void)attachment;
+    (void)textarget;
+    (void)level;
+    CHECK(s_framebuffer, "attaching to framebuffer 0");
+    CHECK(texture < GL_NAMES && s_gl[texture].alive, "attaching texture "
+          "%u, not alive", texture);
+    s_attached[s_framebuffer] = texture;
+}
+
+// Only colour formats can be rendered to
+GLenum glCheckFramebufferStatus(GLenum target) {
+    (void)target;
+    GLuint t = s_attached[s_framebuffer];
+    GLenum format = t ? s_gl[t].img.format : 0;
+    return (format == GL_RGBA || format == GL_RGB) ? GL_FRAMEBUFFER_COMPLETE
+                                                   : GL_FRAMEBUFFER_UNSUPPORTED;
+}
+
+void glGetIntegerv(GLenum pname, GLint * data) {
+    CHECK(pname == GL_FRAMEBUFFER_BINDING, "glGetIntegerv(0x%x)", pname);
+    *data = (GLint)s_framebuffer;
+}
+
+void glActiveTexture(GLenum texture) { (void)texture; }
+void glBindBuffer(GLenum target, GLuint buffer) { (void)target; (void)buffer; }
+void glUseProgram(GLuint program) { (void)program; }
+void glEnable(GLenum cap) { (void)cap; }
+void glDisable(GLenum cap) { (void)cap; }
+void glBlendFunc(GLenum s, GLenum d) { (void)s; (void)d; }
+void glDepthMask(GLboolean flag) { (void)flag; }
+void glCullFace(GLenum mode) { (void)mode; }
+void glPixelStorei(GLenum pname, GLint param) { (void)pname; (void)param; }
+void glDeleteBuffers(GLsizei n, const GLuint * b) { (void)n; (void)b; }
+void glDeleteProgram(GLuint program) { (void)program; }
+
+static int alive_textures(void) {
+    int alive = 0;
+    for (int t = 0; t < GL_NAMES; t++)
+        alive += s_gl[t].alive;
+    return alive;
+}
+
+/*
+ * The game: what each of its names should show. The helpers make the
+ * calls through the loader's reimplementations and update the model.
+ */
+typedef struct name {
+    bool live;
+    image img;
+    GLint params[P_NUM];
+} name;
+
+static name s_names[GL_NAMES];
+
+static GLuint game_gen(void) {
+    GLuint t;
+    glGenTextures(1, &t);
+    CHECK(!s_names[t].live, "texture %u handed out, but the game holds it",
+          t);
+    memset(&s_names[t], 0, sizeof(s_names[t]));
+    s_names[t].live = true;
+    memcpy(s_names[t].params, s_defaults, sizeof(s_defaults));
+    return t;
+}
+
+static void game_delete(GLuint t) {
+    glDeleteTextures_soloader(1, &t);
+    s_names[t].live = false;
+}
+
+// Binds `t` and checks that the GL texture behind it shows what it should
+static void game_bind(GLuint t) {
+    glBindTexture_soloader(GL_TEXTURE_2D, t);
+    CHECK(s_bound == gltexture_storage(t), "texture %u: %u bound, not its "
+          "storage %u", t, s_bound, gltexture_storage(t));
+
+    const name * n = &s_names[t];
+    const texture * gl = bound("game_bind");
+    if (n->img.format) {
+        CHECK(gl->img.format == n->img.format
+              && gl->img.width == n->img.width
+              && gl->img.height == n->img.height
+              && gl->img.size == n->img.size
+              && !memcmp(gl->img.data, n->img.data, n->img.size),
+              "texture %u (storage %u): wrong image", t, s_bound);
+    }
+    for (int p = 0; p < P_NUM; p++) {
+        CHECK(gl->params[p] == n->params[p], "texture %u (storage %u): "
+              "parameter %d is 0x%x, not 0x%x", t, s_bound, p, gl->params[p],
+              n->params[p]);
+    }
+}
+
+static void game_upload(GLuint t, const image * img) {
+    glBindTexture_soloader(GL_TEXTURE_2D, t);
+    if (img->format == GL_COMPRESSED) {
+        glCompressedTexImage2D_soloader(GL_TEXTURE_2D, 0, GL_COMPRESSED,
+                                        img->width, img->height, 0, img->size,
+                                        img->data);
+    } else {
+        glTexImage2D_soloader(GL_TEXTURE_2D, 0, img->format, img->width,
+                              img->height, 0, img->format, GL_UNSIGNED_BYTE,
+                              img->data);
+    }
+    s_names[t].img = *img;
+}
+
+// Every name holding the same image as `t`, if the update reaches them all
+static void model_patch(GLuint t, bool all, uint32_t x, uint32_t y,
+                        uint32_t w, uint32_t h, const uint8_t * src) {
+    image before = s_names[t].img;
+    uint32_t stride = w * bpp_of(before.format);
+    for (GLuint o = 1; o < GL_NAMES; o++) {
+        name * n = &s_names[o];
+        if (o == t || (all && n->live && gltexture_storage(o)
+                       == gltexture_storage(t) && n->img.size == before.size
+                       && !memcmp(n->img.data, before.data, before.size)))
+            image_patch(&n->img, x, y, w, h, src, stride);
+    }
+}
+
+static void game_sub_image(GLuint t, uint32_t x, uint32_t y, uint32_t w,
+                           uint32_t h, const uint8_t * src, bool all) {
+    glBindTexture_soloader(GL_TEXTURE_2D, t);
+    model_patch(t, all, x, y, w, h, src);
+    GLenum format = s_names[t].img.format;
+    glTexSubImage2D_soloader(GL_TEXTURE_2D, 0, x, y, w, h, format,
+                             GL_UNSIGNED_BYTE, src);
+}
+
+// Copies from the RGBA texture `from`, through a framebuffer of the game's
+static void game_copy(GLuint t, GLuint from, uint32_t x, uint32_t y,
+                      uint32_t w, uint32_t h) {
+    GLuint prev = s_framebuffer, fb;
+    glGenFramebuffers(1, &fb);
+    glBindFramebuffer(GL_FRAMEBUFFER, fb);
+    glFramebufferTexture2D_soloader(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                    GL_TEXTURE_2D, from, 0);
+
+    uint32_t bpp = bpp_of(s_names[t].img.format);
+    uint8_t rows[MAX_BYTES];
+    const image * src = &s_names[from].img;
+    for (uint32_t r = 0; r < h; r++) {
+        for (uint32_t c = 0; c < w; c++)
+            memcpy(rows + (r * w + c) * bpp, src->data + (r * src->width + c)
+                   * 4, bpp);
+    }
+
+    glBindTexture_soloader(GL_TEXTURE_2D, t);
+    model_patch(t, false, x, y, w, h, rows);
+    glCopyTexSubImage2D_soloader(GL_TEXTURE_2D, 0, x, y, 0, 0, w, h);
+    CHECK(s_framebuffer == fb, "framebuffer %u bound, not the game's %u",
+          s_framebuffer, fb);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, prev);
+    glDeleteFramebuffers(1, &fb);
+}
+
+static void game_param(GLuint t, int p, GLint value) {
+    static const GLenum pnames[P_NUM] = {
+        GL_TEXTURE_MIN_FILTER, GL_TEXTURE_MAG_FILTER, GL_TEXTURE_WRAP_S,
+        GL_TEXTURE_WRAP_T
+    };
+    glBindTexture_soloader(GL_TEXTURE_2D, t);
+    switch (rnd() % 3) {
+        case 0:
+            glTexParameteri_soloader(GL_TEXTURE_2D, pnames[p], value);
+            break;
+        case 1:
+            glTexParameterf_soloader(GL_TEXTURE_2D, pnames[p],
+                                     (GLfloat)value);
+            break;
+        default:
+            glTexParameterx_soloader(GL_TEXTURE_2D, pnames[p], value);
+            break;
+    }
+    s_names[t].params[p] = value;
+}
+
+static void game_bind_all(void) {
+    for (GLuint t = 1; t < GL_NAMES; t++) {
+        if (s_names[t].live)
+            game_bind(t);
+    }
+}
+
+static void game_delete_all(void) {
+    for (GLuint t = 1; t < GL_NAMES; t++) {
+        if (s_names[t].live)
+            game_delete(t);
+    }
+    CHECK(alive_textures() == 0, "%d textures left", alive_textures());
+}
+
+static void make_image(image * img, GLenum format, uint32_t width,
+                       uint32_t height) {
+    img->format = format;
+    img->width = width;
+    img->height = height;
+    img->size = format == GL_COMPRESSED ? width * height / 2
+                                        : width * height * bpp_of(format);
+    for (uint32_t i = 0; i < img->size; i++)
+        img->data[i] = (uint8_t)rnd();
+}
+
+static image s_a, s_b, s_lum, s_packed;
+
+static void check_alias(void) {
+    GLuint a = game_gen(), b = game_gen();
+    uint32_t uploads = s_uploads;
+    game_upload(a, &s_a);
+    game_upload(b, &s_a);
+    CHECK(s_uploads == uploads + 1, "%u uploads of one image",
+          s_uploads - uploads);
+    CHECK(gltexture_storage(b) == a && gltexture_storage(a) == a, "alias "
+          "in %u, not %u", gltexture_storage(b), a);
+    game_bind_all();
+
+    // Another image moves it to a texture of its own
+    game_upload(b, &s_b);
+    CHECK(gltexture_storage(b) == b, "new image still in %u",
+          gltexture_storage(b));
+    game_bind_all();
+
+    // Compressed images are shared too
+    GLuint c = game_gen(), d = game_gen();
+    game_upload(c, &s_packed);
+    game_upload(d, &s_packed);
+    CHECK(gltexture_storage(d) == c, "compressed image in %u, not %u",
+          gltexture_storage(d), c);
+
+    // Not single colour fills, nor the same bytes with other row padding
+    image fill = s_a;
+    memset(fill.data, 0x40, fill.size);
+    game_upload(c, &fill);
+    game_upload(d, &fill);
+    CHECK(gltexture_storage(d) == d, "fill shared");
+    glPixelStorei_soloader(GL_UNPACK_ALIGNMENT, 1);
+    game_upload(d, &s_a);
+    glPixelStorei_soloader(GL_UNPACK_ALIGNMENT, 4);
+    CHECK(gltexture_storage(d) == d, "shared across row alignments");
+    game_bind_all();
+
+    game_delete_all();
+}
+
+static void check_deletes(void) {
+    // An alias going leaves the image
+    GLuint a = game_gen(), b = game_gen();
+    game_upload(a, &s_a);
+    game_upload(b, &s_a);
+    game_delete(b);
+    game_bind_all();
+    game_delete(a);
+    CHECK(alive_textures() == 0, "%d textures left", alive_textures());
+
+    // The holder going keeps its GL texture for the alias, and its name
+    // isn't handed out until then
+    a = game_gen();
+    b = game_gen();
+    game_upload(a, &s_a);
+    game_upload(b, &s_a);
+    game_delete(a);
+    CHECK(s_gl[a].alive, "image deleted with its holder");
+    game_bind(b);
+    GLuint c = game_gen();
+    CHECK(c != a, "texture %u handed out while in use", a);
+    game_upload(c, &s_a);
+    CHECK(gltexture_storage(c) == a, "image not shared after its holder "
+          "went");
+    game_bind_all();
+    game_delete(b);
+    CHECK(s_gl[a].alive, "image deleted with a user left");
+    game_delete(c);
+    CHECK(!s_gl[a].alive, "image left behind");
+
+    // Handed out again, a name starts over
+    GLuint d = game_gen();
+    CHECK(d == a, "texture %u handed out, not %u", d, a);
+    game_bind(d);
+    game_upload(d, &s_b);
+    game_bind(d);
+
+    game_delete_all();
+}
+
+static void check_respecify(void) {
+    GLuint a = game_gen(), b = game_gen();
+    game_upload(a, &s_a);
+    game_param(a, P_MIN, GL_LINEAR);
+    game_upload(b, &s_a);
+
+    // The holder gets a texture of its own for its next image
+    game_upload(a, &s_b);
+    CHECK(gltexture_storage(a) != a && gltexture_storage(b) == a, "storages "
+          "%u and %u", gltexture_storage(a), gltexture_storage(b));
+    game_bind_all();
+
+    // Both images can still be shared
+    GLuint c = game_gen(), d = game_gen();
+    game_upload(c, &s_a);
+    game_upload(d, &s_b);
+    CHECK(gltexture_storage(c) == a && gltexture_storage(d)
+          == gltexture_storage(a), "images not shared after a respecify");
+    game_bind_all();
+
+    // Back to its own texture once nobody else uses it
+    game_delete(b);
+    game_delete(c);
+    CHECK(s_gl[a].alive, "texture of a live name deleted");
+    game_upload(a, &s_lum);
+    CHECK(gltexture_storage(a) == a, "image in %u, not its own texture",
+          gltexture_storage(a));
+    game_bind_all();
+
+    game_delete_all();
+}
+
+static void check_detach(void) {
+    uint8_t patch[MAX_BYTES];
+    for (int i = 0; i < MAX_BYTES; i++)
+        patch[i] = (uint8_t)rnd();
+
+    // The game renders to a framebuffer of its own meanwhile
+    GLuint target = game_gen();
+    game_upload(target, &s_b);
+    GLuint fb;
+    glGenFramebuffers(1, &fb);
+    glBindFramebuffer(GL_FRAMEBUFFER, fb);
+    glFramebufferTexture2D_soloader(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                    GL_TEXTURE_2D, target, 0);
+
+    // An alias updating the image gets a copy of its own
+    GLuint a = game_gen(), b = game_gen();
+    game_upload(a, &s_a);
+    game_upload(b, &s_a);
+    game_sub_image(b, 1, 1, 2, 2, patch, false);
+    CHECK(gltexture_storage(b) != a, "updated alias still in %u", a);
+    CHECK(s_framebuffer == fb, "framebuffer %u bound, not the game's %u",
+          s_framebuffer, fb);
+    game_bind_all();
+
+    // The image as uploaded is still found; the updated one isn't
+    GLuint c = game_gen(), d = game_gen();
+    game_upload(c, &s_a);
+    CHECK(gltexture_storage(c) == a, "image lost after an update");
+    game_upload(d, &s_names[b].img);
+    CHECK(gltexture_storage(d) == d, "updated image shared");
+
+    // So does the holder, leaving its texture to the alias
+    game_sub_image(a, 0, 0, 4, 1, patch + 16, false);
+    CHECK(gltexture_storage(a) != a && gltexture_storage(c) == a, "storages "
+          "%u and %u", gltexture_storage(a), gltexture_storage(c));
+    game_bind_all();
+
+    // And so does a copy from the game's framebuffer
+    game_upload(d, &s_a);
+    game_copy(d, target, 2, 0, 2, 2);
+    CHECK(gltexture_storage(d) != gltexture_storage(c), "copied into a "
+          "shared image");
+    game_bind_all();
+
+    // Luminance can't be rendered to: the update reaches every name
+    GLuint e = game_gen(), f = game_gen(), g = game_gen();
+    game_upload(e, &s_lum);
+    game_upload(f, &s_lum);
+    game_sub_image(f, 0, 2, 8, 2, patch, true);
+    CHECK(gltexture_storage(f) == e, "luminance image copied");
+    CHECK(s_framebuffer == fb, "framebuffer %u bound, not the game's %u",
+          s_framebuffer, fb);
+    game_bind_all();
+    game_upload(g, &s_lum);
+    CHECK(gltexture_storage(g) == g, "updated image shared");
+    game_bind_all();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fb);
+    game_delete_all();
+}
+
+static void check_params(void) {
+    // Set through the holder, then an alias with its own
+    GLuint a = game_gen(), b = game_gen();
+    game_upload(a, &s_a);
+    game_param(a, P_MIN, GL_LINEAR);
+    game_param(a, P_WRAP_S, GL_CLAMP_TO_EDGE);
+    game_upload(b, &s_a);
+    game_bind_all();
+    game_param(b, P_MAG, GL_NEAREST);
+    game_bind_all();
+    game_bind(b);
+
+    // The alias going last bound leaves the holder's
+    game_delete(b);
+    game_bind(a);
+
+    // Set through an alias, then the alias moves to its own texture
+    GLuint c = game_gen();
+    game_upload(c, &s_a);
+    game_param(c, P_WRAP_T, GL_MIRRORED_REPEAT);
+    game_upload(c, &s_b);
+    game_bind_all();
+
+    // Or to a copy of its own
+    GLuint d = game_gen();
+    game_upload(d, &s_a);
+    game_param(d, P_MIN, GL_LINEAR_MIPMAP_LINEAR);
+    game_sub_image(d, 0, 0, 1, 1, s_b.data, false);
+    game_bind_all();
+
+    // Or back to its own texture
+    game_upload(d, &s_lum);
+    game_bind_all();
+
+    game_delete_all();
+}
+
+static void check_past_table(void) {
+    // Names gltexture.c has no entry for pass straight through
+    s_gen_base = TABLE_NAMES - 2;
+    GLuint a = game_gen(), b = game_gen(), c = game_gen();
+    CHECK(a == TABLE_NAMES - 2 && c == TABLE_NAMES, "names %u..%u", a, c);
+    uint32_t uploads = s_uploads;
+    game_upload(a, &s_a);
+    game_upload(b, &s_a);
+    game_upload(c, &s_a);
+    CHECK(s_uploads == uploads + 2, "%u uploads", s_uploads - uploads);
+    CHECK(gltexture_storage(b) == a && gltexture_storage(c) == c,
+          "storages %u and %u", gltexture_storage(b), gltexture_storage(c));
+    game_param(c, P_MAG, GL_NEAREST);
+    game_bind_all();
+
+    // A holder whose new texture is past the table keeps its image there,
+    // unshared, and the texture goes with it
+    game_upload(a, &s_b);
+    CHECK(gltexture_storage(a) > c, "new image in %u", gltexture_storage(a));
+    game_bind_all();
+    GLuint storage = gltexture_storage(a);
+    game_delete(a);
+    CHECK(!s_gl[storage].alive, "texture %u left", storage);
+    game_bind_all();
+
+    game_delete_all();
+    s_gen_base = 1;
+}
+
+// Random calls; `steps` of them
+static void check_random(int steps, uint32_t * uploads, uint32_t * reached) {
+    image pool[POOL];
+    make_image(&pool[0], GL_RGBA, 4, 4);
+    make_image(&pool[1], GL_RGBA, 8, 2);
+    make_image(&pool[2], GL_RGB, 4, 4);
+    make_image(&pool[3], GL_LUMINANCE, 8, 8);
+    make_image(&pool[4], GL_COMPRESSED, 8, 8);
+    make_image(&pool[5], GL_RGBA, 8, 8);
+
+    // What the copies read from, kept out of the rest
+    GLuint source = game_gen();
+    game_upload(source, &pool[5]);
+    image kept = pool[5];
+    pool[5].data[0] ^= 1;
+
+    GLuint live[LIVE];
+    int count = 0;
+    uint32_t start = s_uploads;
+
+    for (int step = 0; step < steps; step++) {
+        uint32_t op = rnd() % 16;
+        GLuint t = count ? live[rnd() % count] : 0;
+
+        if (!count || (op < 2 && count < LIVE)) {
+            live[count++] = game_gen();
+        } else if (op < 3) {
+            int i = rnd() % count;
+            game_delete(live[i]);
+            live[i] = live[--count];
+        } else if (op < 8) {
+            image img = pool[rnd() % POOL];
+            if (rnd() % 8 == 0)
+                img.data[rnd() % img.size] ^= 0x80;
+            game_upload(t, &img);
+            (*uploads)++;
+        } else if (op < 10) {
+            GLenum format = s_names[t].img.format;
+            const image * img = &s_names[t].img;
+            if (format != GL_RGBA && format != GL_RGB) {
+                game_bind(t);
+                continue;
+            }
+            uint32_t w = rnd() % img->width + 1;
+            uint32_t h = rnd() % img->height + 1;
+            uint32_t x = rnd() % (img->width - w + 1);
+            uint32_t y = rnd() % (img->height - h + 1);
+            if (op == 8) {
+                uint8_t data[MAX_BYTES];
+                for (int i = 0; i < MAX_BYTES; i++)
+                    data[i] = (uint8_t)rnd();
+                game_sub_image(t, x, y, w, h, data, false);
+            } else {
+                game_copy(t, source, x, y, w, h);
+            }
+        } else if (op < 12) {
+            static const GLint values[P_NUM][2] = {
+                { GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR },
+                { GL_NEAREST, GL_LINEAR },
+                { GL_CLAMP_TO_EDGE, GL_REPEAT },
+                { GL_MIRRORED_REPEAT, GL_CLAMP_TO_EDGE },
+            };
+            int p = rnd() % P_NUM;
+            game_param(t, p, values[p][rnd() % 2]);
+        } else {
+            game_bind(t);
+        }
+
+        if (step % 1000 == 999) {
+            game_bind_all();
+            CHECK(!memcmp(s_gl[gltexture_storage(source)].img.data,
+                          kept.data, kept.size), "copy source changed");
+        }
+        if (step % 5000 == 4999) {
+            game_delete_all();
+            count = 0;
+            source = game_gen();
+            game_upload(source, &kept);
+        }
+    }
+
+    game_bind_all();
+    game_delete_all();
+    *reached += s_uploads - start;
+}
+
+int main(int argc, char ** argv) {
+    int steps = argc > 1 ? atoi(argv[1]) : 40000;
+
+    make_image(&s_a, GL_RGBA, 4, 4);
+    make_image(&s_b, GL_RGBA, 4, 4);
+    make_image(&s_lum, GL_LUMINANCE, 8, 4);
+    make_image(&s_packed, GL_COMPRESSED, 8, 8);
+
+    uint32_t uploads = 0, reached = 0;
+    for (int mips = 0; mips < 2; mips++) {
+        setting_enableMipMaps = mips;
+        check_alias();
+        check_deletes();
+        check_respecify();
+        check_detach();
+        check_params();
+        check_past_table();
+        check_random(steps / 2, &uploads, &reached);
+    }
+
+    printf("   %u random uploads, %u images and copies reached the GL\n",
+           uploads, reached);
+    if (s_failed)
+        return 1;
+    printf("ok: texture names share, update and let go of images\n");
+    return 0;
+}
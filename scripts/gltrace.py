@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+#
+# Reads GL traces recorded by loader/reimpl/gltrace.c (build the loader with
+# -DGLTRACE_FRAMES=N, the trace ends up in DATA_PATH/gltrace.bin).
+#
+#   gltrace.py trace.bin             per-frame and per-function summary
+#   gltrace.py before.bin after.bin  the same, side by side
+#
+# Record layout is documented at the top of gltrace.c. To replay a trace
+# against a null GL, see scripts/gltrace_replay.c.
+
+import struct
+import sys
+from collections import Counter, defaultdict
+
+REC_CALL = 1
+REC_DATA = 2
+REC_FRAME = 3
+ARGS = 9
+
+DRAW_CALLS = {"glDrawArrays", "glDrawElements"}
+STATE_CALLS = {
+    "glActiveTexture", "glBindTexture", "glBindBuffer", "glUseProgram",
+    "glEnable", "glDisable", "glBlendFunc", "glDepthMask", "glCullFace",
+    "glEnableClientState", "glDisableClientState", "glClientActiveTexture",
+    "glEnableVertexAttribArray", "glDisableVertexAttribArray",
+    "glMatrixMode", "glTexEnvf", "glTexEnvi", "glTexParameteri",
+    "glTexParameterf", "glColor4f", "glColor4ub", "glDepthFunc",
+    "glAlphaFunc", "glShadeModel",
+}
+
+
+class Frame:
+    def __init__(self):
+        self.calls = 0
+        self.draws = 0
+        self.state = 0
+        self.data_bytes = 0
+        self.us = 0
+
+
+class Trace:
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            buf = f.read()
+
+        magic, version, nfuncs = struct.unpack_from("<4sII", buf, 0)
+        if magic != b"GLTR" or version != 1:
+            raise SystemExit("%s: not a version 1 GL trace" % path)
+
+        off = 12
+        self.names = []
+        for _ in range(nfuncs):
+            n = buf[off]
+            self.names.append(buf[off + 1:off + 1 + n].decode())
+            off += 1 + n
+
+        self.frames = []
+        self.func_calls = Counter()
+        self.func_us = defaultdict(int)
+
+        frame = Frame()
+        call_fmt = "<BxH%dIIII" % ARGS
+        call_size = struct.calcsize(call_fmt)
+
+        while off < len(buf):
+            kind = buf[off]
+            if kind == REC_CALL:
+                rec = struct.unpack_from(call_fmt, buf, off)
+                name = self.names[rec[1]]
+                duration = rec[-1]
+                frame.calls += 1
+                frame.us += duration
+                if name in DRAW_CALLS:
+                    frame.draws += 1
+                if name in STATE_CALLS:
+                    frame.state += 1
+                self.func_calls[name] += 1
+                self.func_us[name] += duration
+                off += call_size
+            elif kind == REC_DATA:
+                length = struct.unpack_from("<I", buf, off + 4)[0]
+                frame.data_bytes += length
+                off += 8 + ((length + 3) & ~3)
+            elif kind == REC_FRAME:
+                self.frames.append(frame)
+                frame = Frame()
+                off += 8
+            else:
+                raise SystemExit("%s: bad record 0x%x at %d" % (path, kind, off))
+
+
+def print_frames(traces):
+    cols = "  calls  draws  state  data KiB  GL ms"
+    print("frame" + cols * len(traces))
+    for i in range(max(len(t.frames) for t in traces)):
+        line = "%5d" % i
+        for t in traces:
+            if i < len(t.frames):
+                f = t.frames[i]
+                line += "  %5d  %5d  %5d  %8.1f  %5.2f" % (
+                    f.calls, f.draws, f.state, f.data_bytes / 1024, f.us / 1000)
+            else:
+                line += " " * len(cols)
+        print(line)
+
+
+def print_funcs(traces):
+    names = set()
+    for t in traces:
+        names.update(t.func_calls)
+
+    def total_us(name):
+        return max(t.func_us.get(name, 0) for t in traces)
+
+    print()
+    print("%-32s" % "function" + "   calls/frame  us/call" * len(traces))
+    for name in sorted(names, key=total_us, reverse=True):
+        line = "%-32s" % name
+        for t in traces:
+            calls = t.func_calls.get(name, 0)
+            frames = max(len(t.frames), 1)
+            per_call = t.func_us.get(name, 0) / calls if calls else 0
+            line += "   %11.1f  %7.1f" % (calls / frames, per_call)
+        print(line)
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        print("usage: %s trace.bin [other.bin]" % sys.argv[0])
+        sys.exit(1)
+
+    traces = [Trace(p) for p in sys.argv[1:]]
+    print_frames(traces)
+    print_funcs(traces)
+
+
+if __name__ == "__main__":
+    main()
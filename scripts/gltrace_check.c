@@ -0,0 +1,480 @@
+/*
+ * scripts/gltrace_check.c
+ *
+ * Records a few synthetic GL calls with loader/reimpl/gltrace.c and replays
+ * the trace with the reader of gltrace_replay.c. Built by the host project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/gltrace_check
+ *
+ * The GL functions are fakes in a dynlib table that log what they get. The
+ * calls go through the recording thunks, before, during and after a two
+ * frame capture, and have to reach the fakes as they were made, returning
+ * what the fakes return. The replay has to give back the captured calls in
+ * order with their arguments, return values and frame ends, and exactly the
+ * memory each one read: texture data with the unpack alignment, uniform and
+ * buffer data, shader sources, the names glGen* produced, and the range of
+ * client-side vertex arrays a draw call reads, including arrays that were
+ * set up before the capture started. Every cut of the trace replays a
+ * prefix of it or fails, and damaged records fail.
+ *
+ * The recorder passes addresses as 32-bit words, as on the Vita, so all
+ * the memory the calls point to comes from below 4 GB.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <vitaGL.h>
+
+#include "gltrace_replay.h"
+#include "reimpl/gltrace.h"
+
+#define TRACE_PATH      DATA_PATH "gltrace.bin" // GLTRACE_PATH in gltrace.c
+#define ARENA_SIZE      (64 * 1024)
+#define MAX_CALLS       64
+
+#define SLOT_VERTEX     16 // SLOT_* in gltrace.c
+
+static int s_failed;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+    } \
+} while (0)
+
+// The GL functions, in the order of the dynlib table
+enum {
+    F_GEN_TEXTURES,
+    F_BIND_TEXTURE,
+    F_PIXEL_STORE,
+    F_TEX_IMAGE,
+    F_VERTEX_POINTER,
+    F_ENABLE_CLIENT_STATE,
+    F_DRAW_ARRAYS,
+    F_DRAW_ELEMENTS,
+    F_UNIFORM4FV,
+    F_GET_UNIFORM_LOCATION,
+    F_SHADER_SOURCE,
+    F_BIND_BUFFER,
+    F_BUFFER_DATA,
+    F_FLUSH,
+    F_NUM
+};
+
+typedef struct call {
+    int func;
+    uint32_t args[REPLAY_ARGS];
+    uint32_t ret;
+    int data_num;
+    replay_data data[4]; // what the recorder should have taken
+} call;
+
+// What reached the fakes, and what was made during the capture
+static call s_seen[MAX_CALLS];
+static int s_seen_num;
+static call s_made[MAX_CALLS];
+static int s_made_num;
+static uint32_t s_frame_after[3]; // calls made before each frame end
+
+static uint32_t fake(int func, const uint32_t * a) {
+    if (s_seen_num < MAX_CALLS) {
+        call * c = &s_seen[s_seen_num++];
+        c->func = func;
+        memcpy(c->args, a, sizeof(c->args));
+    }
+    if (func == F_GEN_TEXTURES) {
+        GLuint * names = (GLuint *)(uintptr_t)a[1];
+        for (uint32_t i = 0; i < a[0]; i++)
+            names[i] = 100 + i;
+    }
+    return 0x5EED0000u + (uint32_t)func;
+}
+
+#define FAKE(f) \
+    static uint32_t fake_##f(uint32_t a0, uint32_t a1, uint32_t a2, \
+                             uint32_t a3, uint32_t a4, uint32_t a5, \
+                             uint32_t a6, uint32_t a7, uint32_t a8) { \
+        uint32_t a[REPLAY_ARGS] = { a0, a1, a2, a3, a4, a5, a6, a7, a8 }; \
+        return fake(f, a); \
+    }
+
+FAKE(F_GEN_TEXTURES) FAKE(F_BIND_TEXTURE) FAKE(F_PIXEL_STORE)
+FAKE(F_TEX_IMAGE) FAKE(F_VERTEX_POINTER) FAKE(F_ENABLE_CLIENT_STATE)
+FAKE(F_DRAW_ARRAYS) FAKE(F_DRAW_ELEMENTS) FAKE(F_UNIFORM4FV)
+FAKE(F_GET_UNIFORM_LOCATION) FAKE(F_SHADER_SOURCE) FAKE(F_BIND_BUFFER)
+FAKE(F_BUFFER_DATA) FAKE(F_FLUSH)
+
+static so_default_dynlib s_dynlib[] = {
+    { "glGenTextures", (uintptr_t)&fake_F_GEN_TEXTURES },
+    { "glBindTexture", (uintptr_t)&fake_F_BIND_TEXTURE },
+    { "glPixelStorei", (uintptr_t)&fake_F_PIXEL_STORE },
+    { "glTexImage2D", (uintptr_t)&fake_F_TEX_IMAGE },
+    { "glVertexPointer", (uintptr_t)&fake_F_VERTEX_POINTER },
+    { "glEnableClientState", (uintptr_t)&fake_F_ENABLE_CLIENT_STATE },
+    { "glDrawArrays", (uintptr_t)&fake_F_DRAW_ARRAYS },
+    { "glDrawElements", (uintptr_t)&fake_F_DRAW_ELEMENTS },
+    { "glUniform4fv", (uintptr_t)&fake_F_UNIFORM4FV },
+    { "glGetUniformLocation", (uintptr_t)&fake_F_GET_UNIFORM_LOCATION },
+    { "glShaderSource", (uintptr_t)&fake_F_SHADER_SOURCE },
+    { "glBindBuffer", (uintptr_t)&fake_F_BIND_BUFFER },
+    { "glBufferData", (uintptr_t)&fake_F_BUFFER_DATA },
+    { "glFlush", (uintptr_t)&fake_F_FLUSH },
+    { "strlen", (uintptr_t)&strlen }, // not GL, left alone
+};
+
+#define DYNLIB_NUM (int)(sizeof(s_dynlib) / sizeof(s_dynlib[0]))
+
+typedef uint32_t (* gl_fn)(uint32_t, uint32_t, uint32_t, uint32_t, uint32_t,
+                           uint32_t, uint32_t, uint32_t, uint32_t);
+
+static bool s_capturing;
+
+// Calls `func` the way the game does, through the table
+static call * gl(int func, const uint32_t * a) {
+    static call ignored;
+    gl_fn fn = (gl_fn)s_dynlib[func].func;
+    uint32_t ret = fn(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8]);
+    CHECK(ret == 0x5EED0000u + (uint32_t)func, "call %d returned 0x%x",
+          func, ret);
+
+    if (!s_capturing || s_made_num == MAX_CALLS)
+        return &ignored;
+    call * c = &s_made[s_made_num++];
+    memset(c, 0, sizeof(*c));
+    c->func = func;
+    memcpy(c->args, a, sizeof(c->args));
+    c->ret = ret;
+    return c;
+}
+
+#define GL(f, ...) gl(f, (const uint32_t[REPLAY_ARGS]){ __VA_ARGS__ })
+
+static void expect(call * c, uint8_t slot, const void * bytes, uint32_t len) {
+    c->data[c->data_num++] = (replay_data){ slot, len, bytes };
+}
+
+// Memory the calls point to, at addresses that fit in an argument word
+static uint8_t * s_arena;
+static size_t s_arena_used;
+
+static void * arena(size_t size) {
+    void * p = s_arena + s_arena_used;
+    s_arena_used += (size + 15) & ~(size_t)15;
+    return p;
+}
+
+static uint32_t word(const void * p) {
+    return (uint32_t)(uintptr_t)p;
+}
+
+static void frame_end(int frame) {
+    gltrace_frame_end();
+    if (frame > 0)
+        s_frame_after[frame] = s_made_num;
+    s_capturing = true;
+}
+
+static void record(void) {
+    float * verts = arena(8 * 3 * sizeof(float));
+    for (int i = 0; i < 8 * 3; i++)
+        verts[i] = (float)i * 0.5f;
+    float * verts2 = arena(8 * 4 * sizeof(float));
+    for (int i = 0; i < 8 * 4; i++)
+        verts2[i] = (float)i * -0.25f;
+    uint8_t * pixels = arena(64);
+    for (int i = 0; i < 64; i++)
+        pixels[i] = (uint8_t)(i * 7 + 1);
+    GLuint * names = arena(2 * sizeof(GLuint));
+    float * vec = arena(8 * sizeof(float));
+    for (int i = 0; i < 8; i++)
+        vec[i] = (float)i;
+    char * uniform = arena(8);
+    strcpy(uniform, "u_mvp");
+    uint16_t * indices = arena(4 * sizeof(uint16_t));
+    memcpy(indices, (const uint16_t[]){ 5, 1, 3, 1 }, 8);
+    uint8_t * data = arena(10);
+    memcpy(data, "0123456789", 10);
+
+    char * src1 = arena(16);
+    char * src2 = arena(16);
+    strcpy(src1, "void main() {");
+    strcpy(src2, "}   ignored");
+    const char ** strings = arena(2 * sizeof(char *));
+    strings[0] = src1;
+    strings[1] = src2;
+    GLint * lengths = arena(2 * sizeof(GLint));
+    lengths[0] = -1;
+    lengths[1] = 1;
+    char * source = arena(16);
+    strcpy(source, "void main() {}");
+
+    // Client state set up before the capture still counts
+    GL(F_VERTEX_POINTER, 3, GL_FLOAT, 0, word(verts));
+    GL(F_ENABLE_CLIENT_STATE, GL_VERTEX_ARRAY);
+    GL(F_FLUSH);
+    frame_end(0);
+
+    static const GLuint generated[] = { 100, 101 };
+    call * c = GL(F_GEN_TEXTURES, 2, word(names));
+    expect(c, 1, generated, sizeof(generated));
+    GL(F_BIND_TEXTURE, GL_TEXTURE_2D, 100);
+    GL(F_PIXEL_STORE, GL_UNPACK_ALIGNMENT, 1);
+    c = GL(F_TEX_IMAGE, GL_TEXTURE_2D, 0, GL_RGB, 3, 2, 0, GL_RGB,
+           GL_UNSIGNED_BYTE, word(pixels));
+    expect(c, 8, pixels, 3 * 3 * 2);
+    GL(F_PIXEL_STORE, GL_UNPACK_ALIGNMENT, 4);
+    c = GL(F_TEX_IMAGE, GL_TEXTURE_2D, 0, GL_RGB, 3, 2, 0, GL_RGB,
+           GL_UNSIGNED_BYTE, word(pixels));
+    expect(c, 8, pixels, 12 * 2);
+    c = GL(F_DRAW_ARRAYS, GL_TRIANGLES, 2, 3);
+    expect(c, SLOT_VERTEX, verts + 2 * 3, 3 * 3 * sizeof(float));
+    c = GL(F_UNIFORM4FV, 5, 2, word(vec));
+    expect(c, 2, vec, 8 * sizeof(float));
+    c = GL(F_GET_UNIFORM_LOCATION, 7, word(uniform));
+    expect(c, 1, "u_mvp", 6);
+    GL(F_FLUSH);
+    frame_end(1);
+
+    c = GL(F_SHADER_SOURCE, 3, 2, word(strings), word(lengths));
+    expect(c, 2, source, 14);
+
+    // Arrays in a buffer object are not recorded, client ones are
+    GL(F_BIND_BUFFER, GL_ARRAY_BUFFER, 9);
+    GL(F_VERTEX_POINTER, 3, GL_FLOAT, 0, 0);
+    GL(F_DRAW_ARRAYS, GL_TRIANGLES, 0, 3);
+    GL(F_BIND_BUFFER, GL_ARRAY_BUFFER, 0);
+    GL(F_VERTEX_POINTER, 2, GL_FLOAT, 16, word(verts2));
+    c = GL(F_DRAW_ELEMENTS, GL_TRIANGLES, 4, GL_UNSIGNED_SHORT,
+           word(indices));
+    expect(c, 3, indices, 8);
+    expect(c, SLOT_VERTEX, verts2 + 4, 4 * 16 + 8);
+    c = GL(F_BUFFER_DATA, GL_ARRAY_BUFFER, 10, word(data), GL_STATIC_DRAW);
+    expect(c, 2, data, 10);
+    frame_end(2);
+
+    // Done: calls still go through, unrecorded
+    s_capturing = false;
+    GL(F_FLUSH);
+}
+
+static void check_forwarded(void) {
+    // Everything made reached the fakes as it was, past the capture too
+    int captured = 0;
+    for (int i = 0; i < s_seen_num; i++) {
+        const call * seen = &s_seen[i];
+        if (captured < s_made_num && seen->func == s_made[captured].func
+            && !memcmp(seen->args, s_made[captured].args, sizeof(seen->args)))
+            captured++;
+    }
+    CHECK(captured == s_made_num, "%d of %d captured calls reached the GL",
+          captured, s_made_num);
+    CHECK(s_seen_num == s_made_num + 4, "%d calls reached the GL, not %d",
+          s_seen_num, s_made_num + 4);
+    CHECK(s_dynlib[DYNLIB_NUM - 1].func == (uintptr_t)&strlen, "non-GL "
+          "import replaced");
+}
+
+// Replay backend comparing the calls with the ones made
+typedef struct replayed {
+    const replay_trace * trace;
+    bool report;        // each difference, or just where the first one is
+    int differs;        // first call that isn't as made, -1 if none
+    bool frames_ok;
+    int calls;
+    uint32_t frames[4]; // calls replayed before each frame end
+    int frames_num;
+    uint32_t last_start;
+} replayed;
+
+static bool same_call(const replayed * p, const replay_call * r,
+                      const call * c, int n) {
+    const char * name = p->trace->names[r->func];
+    bool same = strcmp(name, s_dynlib[c->func].symbol) == 0
+                && !memcmp(r->args, c->args, sizeof(c->args))
+                && r->ret == c->ret && r->data_num == c->data_num;
+    if (p->report) {
+        CHECK(same, "call %d: %s with other arguments, return value or "
+              "data than %s as made", n, name, s_dynlib[c->func].symbol);
+    }
+    if (!same)
+        return false;
+
+    for (int i = 0; i < c->data_num; i++) {
+        const replay_data * d = replay_arg(r, c->data[i].slot);
+        bool ok = d && d->len == c->data[i].len
+                  && !memcmp(d->bytes, c->data[i].bytes, d->len);
+        if (p->report) {
+            CHECK(ok, "call %d (%s): slot %u isn't what it read", n, name,
+                  c->data[i].slot);
+        }
+        same = same && ok;
+    }
+    return same;
+}
+
+static void on_call(void * ctx, const replay_call * r) {
+    replayed * p = ctx;
+    int n = p->calls++;
+    if ((n >= s_made_num || !same_call(p, r, &s_made[n], n)
+         || r->start < p->last_start) && p->differs < 0)
+        p->differs = n;
+    p->last_start = r->start;
+}
+
+static void on_frame(void * ctx, uint32_t frame) {
+    replayed * p = ctx;
+    if (p->frames_num < 4)
+        p->frames[p->frames_num++] = p->calls;
+    if (frame != (uint32_t)p->frames_num)
+        p->frames_ok = false;
+}
+
+static bool replay(replay_trace * t, replayed * p, bool report) {
+    memset(p, 0, sizeof(*p));
+    p->trace = t;
+    p->report = report;
+    p->differs = -1;
+    p->frames_ok = true;
+    replay_backend backend = { on_call, on_frame, p };
+    return replay_run(t, &backend);
+}
+
+static void check_replay(const uint8_t * file, size_t len) {
+    replay_trace t;
+    if (!replay_load(&t, file, len)) {
+        CHECK(false, "%s", t.error);
+        return;
+    }
+    CHECK(t.funcs_num == F_NUM, "%d functions, not %d", t.funcs_num, F_NUM);
+    for (int f = 0; f < t.funcs_num && f < F_NUM; f++) {
+        CHECK(strcmp(t.names[f], s_dynlib[f].symbol) == 0, "function %d "
+              "is %s, not %s", f, t.names[f], s_dynlib[f].symbol);
+    }
+
+    replayed p;
+    CHECK(replay(&t, &p, true), "%s", t.error);
+    CHECK(p.differs < 0 && p.frames_ok, "replay differs from the calls "
+          "made");
+    CHECK(p.calls == s_made_num, "%d calls replayed, not %d", p.calls,
+          s_made_num);
+    CHECK(p.frames_num == 2 && p.frames[0] == s_frame_after[1]
+          && p.frames[1] == s_frame_after[2], "frame ends after %u and %u "
+          "calls, not %u and %u", p.frames[0], p.frames[1],
+          s_frame_after[1], s_frame_after[2]);
+    replay_close(&t);
+}
+
+// Every cut replays a prefix of the calls, or fails
+static void check_cuts(const uint8_t * file, size_t len) {
+    int complete = 0;
+    for (size_t cut = 0; cut < len; cut++) {
+        replay_trace t;
+        if (!replay_load(&t, file, cut)) {
+            replay_close(&t);
+            continue;
+        }
+        // The last call may have lost some of its data
+        replayed p;
+        bool ok = replay(&t, &p, false);
+        CHECK(!ok || ((p.differs < 0 || p.differs == p.calls - 1)
+                      && p.frames_ok), "cut at %zu: call %d isn't as made",
+              cut, p.differs);
+        CHECK(p.calls <= s_made_num, "cut at %zu: %d calls", cut, p.calls);
+        complete += ok;
+        replay_close(&t);
+    }
+    CHECK(complete > 0 && complete < (int)len / 4, "%d cuts replayed "
+          "without an error", complete);
+    printf("   %zu cuts, %d of them at a record boundary\n", len, complete);
+}
+
+static void check_damage(const uint8_t * file, size_t len) {
+    uint8_t * copy = malloc(len);
+    replay_trace t;
+
+    // Header, function names, then the first call record
+    size_t first = 12;
+    for (int f = 0; f < F_NUM; f++)
+        first += 1 + file[first];
+
+    static const struct {
+        size_t at;
+        uint8_t value;
+        const char * what;
+    } damage[] = {
+        { 0, 'X', "magic" },
+        { 4, 2, "version" },
+        { 0, 9, "record kind" },
+        { 2, F_NUM, "function" },
+        { 0, 2, "data first" },
+    };
+
+    for (size_t i = 0; i < sizeof(damage) / sizeof(damage[0]); i++) {
+        memcpy(copy, file, len);
+        copy[damage[i].at + (i >= 2 ? first : 0)] = damage[i].value;
+        bool ok = replay_load(&t, copy, len);
+        if (ok) {
+            replayed p;
+            ok = replay(&t, &p, false);
+        }
+        CHECK(!ok, "damaged %s replayed", damage[i].what);
+        replay_close(&t);
+    }
+    free(copy);
+}
+
+int main(void) {
+    s_arena = mmap((void *)0x20000000, ARENA_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS
+#ifdef MAP_32BIT
+                   | MAP_32BIT
+#endif
+                   , -1, 0);
+    if (s_arena == MAP_FAILED || (uintptr_t)s_arena + ARENA_SIZE
+        > UINT32_MAX) {
+        printf("FAIL: no memory below 4 GB for the calls to point to\n");
+        return 1;
+    }
+
+    char dir[] = DATA_PATH;
+    mkdir(dir, 0755);
+    remove(TRACE_PATH);
+
+    gltrace_install(s_dynlib, DYNLIB_NUM);
+    record();
+    check_forwarded();
+
+    FILE * f = fopen(TRACE_PATH, "rb");
+    if (!f) {
+        printf("FAIL: no trace written to " TRACE_PATH "\n");
+        return 1;
+    }
+    static uint8_t file[64 * 1024];
+    size_t len = fread(file, 1, sizeof(file), f);
+    fclose(f);
+
+    check_replay(file, len);
+    check_cuts(file, len);
+    check_damage(file, len);
+
+    if (s_failed)
+        return 1;
+    printf("ok: %d calls recorded over 2 frames and replayed as made\n",
+           s_made_num);
+    return 0;
+}
@@ -0,0 +1,510 @@
+/*
+ * scripts/gltrace_replay.c
+ *
+ * Replays GL traces recorded by loader/reimpl/gltrace.c (build the loader
+ * with -DGLTRACE_FRAMES=N) on the host, against a null GL. Built by the
+ * host project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/gltrace_replay [-n runs] trace.bin [other.bin]
+ *
+ * Every call is dispatched through a table of GL stubs, looked up by name
+ * when the trace is loaded. The stubs do no rendering: they count the calls,
+ * draws and state changes, read every byte recorded for a call the way a
+ * driver copies it, and hand out names for glGen* that binds are mapped
+ * through. Binds of names created before the capture are counted, as a
+ * replay can't know what they held.
+ *
+ * The trace is replayed `runs` times (20 by default) and the fastest time
+ * of each frame is printed next to its counts, with a second trace side by
+ * side to compare two builds. The times come from the host CPU and the null
+ * GL, so like bench.c they only compare traces with each other; the device
+ * timings are in the trace, see scripts/gltrace.py.
+ *
+ * The reader itself (gltrace_replay.h) is also used by gltrace_check.c,
+ * which builds this file with GLTRACE_REPLAY_NO_MAIN.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include "gltrace_replay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Record layout, see the top of gltrace.c
+#define REC_CALL        1
+#define REC_DATA        2
+#define REC_FRAME       3
+#define CALL_SIZE       (4 + REPLAY_ARGS * 4 + 12)
+#define HEADER_SIZE     12
+
+static uint32_t read_u32(const uint8_t * p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static bool fail(replay_trace * t, size_t off, const char * what) {
+    snprintf(t->error, sizeof(t->error), "%s at %zu", what, off);
+    return false;
+}
+
+// Frees what replay_load() took so far, keeping the error
+static bool load_failed(replay_trace * t, size_t off, const char * what) {
+    char error[sizeof(t->error)];
+    fail(t, off, what);
+    memcpy(error, t->error, sizeof(error));
+    replay_close(t);
+    memcpy(t->error, error, sizeof(error));
+    return false;
+}
+
+bool replay_load(replay_trace * t, const void * data, size_t len) {
+    memset(t, 0, sizeof(*t));
+    if (len < HEADER_SIZE || memcmp(data, "GLTR", 4) != 0)
+        return fail(t, 0, "not a GL trace");
+    if (read_u32((const uint8_t *)data + 4) != 1)
+        return fail(t, 4, "not a version 1 GL trace");
+
+    t->buf = malloc(len ? len : 1);
+    if (!t->buf)
+        return fail(t, 0, "out of memory");
+    memcpy(t->buf, data, len);
+    t->len = len;
+
+    uint32_t count = read_u32(t->buf + 8);
+    if (count > 0xFFFF)
+        return load_failed(t, 8, "bad function count");
+    t->names = calloc(count ? count : 1, sizeof(*t->names));
+    if (!t->names)
+        return load_failed(t, 8, "out of memory");
+
+    size_t off = HEADER_SIZE;
+    for (uint32_t i = 0; i < count; i++) {
+        if (off >= len || off + 1 + t->buf[off] > len)
+            return load_failed(t, off, "function names cut short");
+        uint8_t n = t->buf[off];
+        t->names[i] = strndup((const char *)t->buf + off + 1, n);
+        if (!t->names[i])
+            return load_failed(t, off, "out of memory");
+        t->funcs_num++;
+        off += 1 + n;
+    }
+    t->records = off;
+    return true;
+}
+
+bool replay_open(replay_trace * t, const char * path) {
+    memset(t, 0, sizeof(*t));
+    FILE * f = fopen(path, "rb");
+    if (!f) {
+        snprintf(t->error, sizeof(t->error), "could not open %s", path);
+        return false;
+    }
+
+    uint8_t * data = NULL;
+    size_t len = 0, size = 0;
+    for (;;) {
+        if (len == size) {
+            size = size ? size * 2 : 1 << 20;
+            uint8_t * grown = realloc(data, size);
+            if (!grown)
+                break;
+            data = grown;
+        }
+        size_t got = fread(data + len, 1, size - len, f);
+        len += got;
+        if (got == 0)
+            break;
+    }
+    fclose(f);
+
+    bool ok = data && replay_load(t, data, len);
+    if (!data)
+        snprintf(t->error, sizeof(t->error), "out of memory");
+    free(data);
+    return ok;
+}
+
+void replay_close(replay_trace * t) {
+    for (int i = 0; i < t->funcs_num; i++)
+        free(t->names[i]);
+    free(t->names);
+    free(t->buf);
+    memset(t, 0, sizeof(*t));
+}
+
+const replay_data * replay_arg(const replay_call * call, uint8_t slot) {
+    for (int i = 0; i < call->data_num; i++) {
+        if (call->data[i].slot == slot)
+            return &call->data[i];
+    }
+    return NULL;
+}
+
+bool replay_run(replay_trace * t, const replay_backend * backend) {
+    replay_call call;
+    size_t off = t->records;
+
+    while (off < t->len) {
+        const uint8_t * rec = t->buf + off;
+        if (rec[0] == REC_FRAME) {
+            if (off + 8 > t->len)
+                return fail(t, off, "frame record cut short");
+            if (backend->frame)
+                backend->frame(backend->ctx, read_u32(rec + 4));
+            off += 8;
+            continue;
+        }
+        if (rec[0] == REC_DATA)
+            return fail(t, off, "data without a call");
+        if (rec[0] != REC_CALL)
+            return fail(t, off, "bad record");
+        if (off + CALL_SIZE > t->len)
+            return fail(t, off, "call record cut short");
+
+        memcpy(&call.func, rec + 2, 2);
+        if (call.func >= t->funcs_num)
+            return fail(t, off, "bad function");
+        memcpy(call.args, rec + 4, sizeof(call.args));
+        call.ret = read_u32(rec + 4 + REPLAY_ARGS * 4);
+        call.start = read_u32(rec + 8 + REPLAY_ARGS * 4);
+        call.duration = read_u32(rec + 12 + REPLAY_ARGS * 4);
+        call.data_num = 0;
+        off += CALL_SIZE;
+
+        // The memory the call referenced follows it
+        while (off < t->len && t->buf[off] == REC_DATA) {
+            if (off + 8 > t->len)
+                return fail(t, off, "data record cut short");
+            uint32_t len = read_u32(t->buf + off + 4);
+            size_t padded = ((size_t)len + 3) & ~(size_t)3;
+            if (padded > t->len - off - 8)
+                return fail(t, off, "data record cut short");
+            if (call.data_num == REPLAY_MAX_DATA)
+                return fail(t, off, "too many data records");
+
+            replay_data * d = &call.data[call.data_num++];
+            d->slot = t->buf[off + 1];
+            d->len = len;
+            d->bytes = t->buf + off + 8;
+            off += 8 + padded;
+        }
+
+        backend->call(backend->ctx, &call);
+    }
+    return true;
+}
+
+#ifndef GLTRACE_REPLAY_NO_MAIN
+
+#define NAMES           65536 // GL names mapped; larger ones count as unknown
+#define DEFAULT_RUNS    20
+
+enum {
+    STUB_DRAW = 1,
+    STUB_STATE = 2,
+};
+
+enum {
+    KIND_TEXTURE,
+    KIND_BUFFER,
+    KIND_FRAMEBUFFER,
+    KIND_RENDERBUFFER,
+    KIND_NUM
+};
+
+typedef struct frame_stats {
+    uint32_t calls;
+    uint32_t draws;
+    uint32_t state;
+    uint64_t data_bytes;
+    uint64_t best_ns;
+} frame_stats;
+
+typedef struct null_gl {
+    const struct stub ** stubs; // per function of the trace
+    uint32_t * map[KIND_NUM];   // trace name -> our name, 0 if unknown
+    uint32_t next_name[KIND_NUM];
+    uint32_t unknown_names;
+    uint32_t sink;
+
+    frame_stats * frames;
+    int frames_num;
+    int frames_size;
+    int frame;
+    uint64_t frame_start;
+    bool counting;              // first run only; the others are timed
+} null_gl;
+
+typedef struct stub {
+    const char * name;
+    int flags;
+    void (* fn)(null_gl * gl, const replay_call * call, int kind);
+    int kind;
+} stub;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void stub_gen(null_gl * gl, const replay_call * call, int kind) {
+    const replay_data * d = replay_arg(call, 1);
+    if (!d)
+        return;
+    for (uint32_t i = 0; i + 4 <= d->len; i += 4) {
+        uint32_t name = read_u32(d->bytes + i);
+        if (name < NAMES)
+            gl->map[kind][name] = ++gl->next_name[kind];
+    }
+}
+
+static void stub_bind(null_gl * gl, const replay_call * call, int kind) {
+    uint32_t name = call->args[1];
+    if (name == 0)
+        return;
+    if (name >= NAMES || !gl->map[kind][name])
+        gl->unknown_names++;
+    else
+        gl->sink += gl->map[kind][name];
+}
+
+static void stub_draw(null_gl * gl, const replay_call * call, int kind) {
+    (void)kind;
+    gl->sink += call->args[0] + call->args[1];
+}
+
+static const stub s_stubs[] = {
+    { "glDrawArrays", STUB_DRAW, stub_draw, 0 },
+    { "glDrawElements", STUB_DRAW, stub_draw, 0 },
+    { "glGenTextures", 0, stub_gen, KIND_TEXTURE },
+    { "glGenBuffers", 0, stub_gen, KIND_BUFFER },
+    { "glGenFramebuffers", 0, stub_gen, KIND_FRAMEBUFFER },
+    { "glGenRenderbuffers", 0, stub_gen, KIND_RENDERBUFFER },
+    { "glBindTexture", STUB_STATE, stub_bind, KIND_TEXTURE },
+    { "glBindBuffer", STUB_STATE, stub_bind, KIND_BUFFER },
+    { "glBindFramebuffer", 0, stub_bind, KIND_FRAMEBUFFER },
+    { "glBindRenderbuffer", 0, stub_bind, KIND_RENDERBUFFER },
+    // The state changes scripts/gltrace.py counts
+    { "glActiveTexture", STUB_STATE, NULL, 0 },
+    { "glUseProgram", STUB_STATE, NULL, 0 },
+    { "glEnable", STUB_STATE, NULL, 0 },
+    { "glDisable", STUB_STATE, NULL, 0 },
+    { "glBlendFunc", STUB_STATE, NULL, 0 },
+    { "glDepthMask", STUB_STATE, NULL, 0 },
+    { "glCullFace", STUB_STATE, NULL, 0 },
+    { "glEnableClientState", STUB_STATE, NULL, 0 },
+    { "glDisableClientState", STUB_STATE, NULL, 0 },
+    { "glClientActiveTexture", STUB_STATE, NULL, 0 },
+    { "glEnableVertexAttribArray", STUB_STATE, NULL, 0 },
+    { "glDisableVertexAttribArray", STUB_STATE, NULL, 0 },
+    { "glMatrixMode", STUB_STATE, NULL, 0 },
+    { "glTexEnvf", STUB_STATE, NULL, 0 },
+    { "glTexEnvi", STUB_STATE, NULL, 0 },
+    { "glTexParameteri", STUB_STATE, NULL, 0 },
+    { "glTexParameterf", STUB_STATE, NULL, 0 },
+    { "glColor4f", STUB_STATE, NULL, 0 },
+    { "glColor4ub", STUB_STATE, NULL, 0 },
+    { "glDepthFunc", STUB_STATE, NULL, 0 },
+    { "glAlphaFunc", STUB_STATE, NULL, 0 },
+    { "glShadeModel", STUB_STATE, NULL, 0 },
+};
+
+static const stub s_other = { "", 0, NULL, 0 };
+
+static frame_stats * current_frame(null_gl * gl) {
+    if (gl->frame == gl->frames_size) {
+        gl->frames_size = gl->frames_size ? gl->frames_size * 2 : 64;
+        gl->frames = realloc(gl->frames,
+                             gl->frames_size * sizeof(*gl->frames));
+        if (!gl->frames) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    if (gl->frame == gl->frames_num) {
+        memset(&gl->frames[gl->frame], 0, sizeof(gl->frames[0]));
+        gl->frames[gl->frame].best_ns = UINT64_MAX;
+        gl->frames_num++;
+    }
+    return &gl->frames[gl->frame];
+}
+
+static void null_call(void * ctx, const replay_call * call) {
+    null_gl * gl = ctx;
+    const stub * s = gl->stubs[call->func];
+
+    // Read what the call passed, as the driver would copy it
+    uint32_t sum = 0;
+    uint32_t bytes = 0;
+    for (int i = 0; i < call->data_num; i++) {
+        const replay_data * d = &call->data[i];
+        for (uint32_t j = 0; j < d->len; j++)
+            sum = sum * 31 + d->bytes[j];
+        bytes += d->len;
+    }
+    gl->sink += sum;
+
+    if (s->fn)
+        s->fn(gl, call, s->kind);
+
+    if (gl->counting) {
+        frame_stats * f = current_frame(gl);
+        f->calls++;
+        f->draws += (s->flags & STUB_DRAW) != 0;
+        f->state += (s->flags & STUB_STATE) != 0;
+        f->data_bytes += bytes;
+    }
+}
+
+static void null_frame(void * ctx, uint32_t frame) {
+    (void)frame;
+    null_gl * gl = ctx;
+    uint64_t now = now_ns();
+    frame_stats * f = current_frame(gl);
+    if (now - gl->frame_start < f->best_ns)
+        f->best_ns = now - gl->frame_start;
+    gl->frame++;
+    gl->frame_start = now_ns();
+}
+
+static bool replay_null(replay_trace * t, null_gl * gl, int runs) {
+    memset(gl, 0, sizeof(*gl));
+    gl->stubs = calloc(t->funcs_num ? t->funcs_num : 1, sizeof(*gl->stubs));
+    bool ok = gl->stubs != NULL;
+    for (int k = 0; k < KIND_NUM; k++) {
+        gl->map[k] = calloc(NAMES, sizeof(uint32_t));
+        ok = ok && gl->map[k];
+    }
+    if (!ok) {
+        snprintf(t->error, sizeof(t->error), "out of memory");
+        return false;
+    }
+
+    for (int f = 0; f < t->funcs_num; f++) {
+        gl->stubs[f] = &s_other;
+        for (size_t s = 0; s < sizeof(s_stubs) / sizeof(s_stubs[0]); s++) {
+            if (strcmp(s_stubs[s].name, t->names[f]) == 0)
+                gl->stubs[f] = &s_stubs[s];
+        }
+    }
+
+    replay_backend backend = { null_call, null_frame, gl };
+    for (int r = 0; r < runs; r++) {
+        gl->counting = (r == 0);
+        gl->frame = 0;
+        gl->unknown_names = 0;
+        for (int k = 0; k < KIND_NUM; k++) {
+            memset(gl->map[k], 0, NAMES * sizeof(uint32_t));
+            gl->next_name[k] = 0;
+        }
+
+        gl->frame_start = now_ns();
+        if (!replay_run(t, &backend))
+            return false;
+    }
+    return true;
+}
+
+static void null_free(null_gl * gl) {
+    free(gl->stubs);
+    for (int k = 0; k < KIND_NUM; k++)
+        free(gl->map[k]);
+    free(gl->frames);
+}
+
+static void print_frames(null_gl * gls, int traces) {
+    const char * cols = "  calls  draws  state  data KiB  replay us";
+    printf("frame");
+    for (int i = 0; i < traces; i++)
+        printf("%s", cols);
+    printf("\n");
+
+    int frames = 0;
+    for (int i = 0; i < traces; i++) {
+        if (gls[i].frames_num > frames)
+            frames = gls[i].frames_num;
+    }
+
+    for (int n = 0; n < frames; n++) {
+        printf("%5d", n);
+        for (int i = 0; i < traces; i++) {
+            if (n >= gls[i].frames_num) {
+                printf("%*s", (int)strlen(cols), "");
+                continue;
+            }
+            const frame_stats * f = &gls[i].frames[n];
+            printf("  %5u  %5u  %5u  %8.1f  %9.1f", f->calls, f->draws,
+                   f->state, f->data_bytes / 1024.0,
+                   f->best_ns == UINT64_MAX ? 0.0 : f->best_ns / 1000.0);
+        }
+        printf("\n");
+    }
+}
+
+static void print_totals(const char * path, const null_gl * gl) {
+    uint64_t calls = 0, draws = 0, state = 0, ns = 0;
+    for (int n = 0; n < gl->frames_num; n++) {
+        const frame_stats * f = &gl->frames[n];
+        calls += f->calls;
+        draws += f->draws;
+        state += f->state;
+        if (f->best_ns != UINT64_MAX)
+            ns += f->best_ns;
+    }
+
+    int frames = gl->frames_num ? gl->frames_num : 1;
+    printf("%s: %d frames, %.1f calls, %.1f draws, %.1f state changes per "
+           "frame; %.1f ns per call", path, gl->frames_num,
+           (double)calls / frames, (double)draws / frames,
+           (double)state / frames, calls ? (double)ns / calls : 0.0);
+    if (gl->unknown_names)
+        printf("; %u binds of names from before the capture",
+               gl->unknown_names);
+    printf("\n");
+}
+
+int main(int argc, char ** argv) {
+    int runs = DEFAULT_RUNS;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        runs = atoi(argv[2]);
+        first = 3;
+    }
+
+    int traces = argc - first;
+    if (traces < 1 || traces > 2 || runs < 1) {
+        fprintf(stderr, "usage: %s [-n runs] trace.bin [other.bin]\n",
+                argv[0]);
+        return 1;
+    }
+
+    replay_trace t[2];
+    null_gl gls[2];
+    for (int i = 0; i < traces; i++) {
+        const char * path = argv[first + i];
+        if (!replay_open(&t[i], path) || !replay_null(&t[i], &gls[i], runs)) {
+            fprintf(stderr, "%s: %s\n", path, t[i].error);
+            return 1;
+        }
+    }
+
+    print_frames(gls, traces);
+    printf("\n");
+    for (int i = 0; i < traces; i++) {
+        print_totals(argv[first + i], &gls[i]);
+        null_free(&gls[i]);
+        replay_close(&t[i]);
+    }
+    return 0;
+}
+
+#endif // GLTRACE_REPLAY_NO_MAIN
@@ -0,0 +1,70 @@
+/*
+ * scripts/gltrace_replay.h
+ *
+ * Reader for the GL traces recorded by loader/reimpl/gltrace.c: goes
+ * through a trace and hands every call, with the memory recorded for it,
+ * to a backend. Used by gltrace_replay.c and gltrace_check.c.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_GLTRACE_REPLAY_H
+#define SOLOADER_GLTRACE_REPLAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define REPLAY_ARGS     9  // GLTRACE_ARGS in gltrace.c
+#define REPLAY_MAX_DATA 48 // per call; a draw reads at most 29 arrays
+
+typedef struct replay_data {
+    uint8_t slot; // argument the pointer came from, or a client array
+    uint32_t len;
+    const uint8_t * bytes;
+} replay_data;
+
+typedef struct replay_call {
+    uint16_t func;
+    uint32_t args[REPLAY_ARGS];
+    uint32_t ret;
+    uint32_t start;    // us since the capture started
+    uint32_t duration; // us, on the device
+    int data_num;
+    replay_data data[REPLAY_MAX_DATA];
+} replay_call;
+
+typedef struct replay_trace {
+    uint8_t * buf;
+    size_t len;
+    size_t records; // offset of the first record
+    int funcs_num;
+    char ** names;
+    char error[128];
+} replay_trace;
+
+typedef struct replay_backend {
+    void (* call)(void * ctx, const replay_call * call);
+    void (* frame)(void * ctx, uint32_t frame);
+    void * ctx;
+} replay_backend;
+
+// Takes a copy of the trace; false with t->error set if the header is bad
+bool replay_load(replay_trace * t, const void * data, size_t len);
+bool replay_open(replay_trace * t, const char * path);
+void replay_close(replay_trace * t);
+
+/*
+ * Hands the calls and frame ends of the trace to the backend, in order.
+ * False with t->error set at the first record that is damaged or cut
+ * short; everything before it was replayed.
+ */
+bool replay_run(replay_trace * t, const replay_backend * backend);
+
+// The memory recorded for argument or client array `slot`, or NULL
+const replay_data * replay_arg(const replay_call * call, uint8_t slot);
+
+#endif // SOLOADER_GLTRACE_REPLAY_H
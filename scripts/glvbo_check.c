@@ -0,0 +1,732 @@
+/*
+ * scripts/glvbo_check.c
+ *
+ * Drives loader/reimpl/glvbo.c (and glstate.c under it) with a random game
+ * that draws from client arrays and its own buffers, into a mock GL that
+ * resolves every vertex a draw reads. The bytes have to be the ones the
+ * game's pointers point at right then, whether glvbo passed the client
+ * memory on or drew from a buffer it promoted. Built by the host project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/glvbo_check [frames]
+ *
+ * Part of the client memory is rewritten in place between draws, now and
+ * then or all the time. The mock also fails a draw that reads a deleted
+ * buffer, and a buffer that gets refilled after a draw of the same frame
+ * used it, since that draw may not have been executed yet.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reimpl/glstate.h"
+#include "reimpl/gltexture.h"
+#include "reimpl/glvbo.h"
+
+#define TEX_UNITS       8   // as many as glvbo keeps
+#define ATTRIBS         20  // a few past the ones glvbo keeps
+#define GAME_UNITS      3
+#define GAME_ATTRIBS    4
+#define BUFFERS         65536
+#define REGIONS         6
+#define REGION_SIZE     16384
+#define MAX_INDICES     48
+
+enum {
+    A_VERTEX,
+    A_NORMAL,
+    A_COLOR,
+    A_TEXCOORD,
+    A_ATTRIB = A_TEXCOORD + TEX_UNITS,
+    A_NUM = A_ATTRIB + ATTRIBS
+};
+
+typedef struct array_state {
+    bool enabled;
+    bool set;   // game only: has a pointer since the context was made
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    GLsizei stride;
+    GLuint buffer;
+    uint32_t generation; // of the buffer
+    const uint8_t * ptr;
+} array_state;
+
+typedef struct gl_state {
+    array_state arrays[A_NUM];
+    GLuint array_buffer;
+    GLuint element_buffer;
+    uint32_t client_unit;
+} gl_state;
+
+typedef struct buffer {
+    uint8_t * data;
+    size_t size;
+    bool alive;
+    uint32_t generation; // names get reused
+    uint32_t drawn_frame;
+} buffer;
+
+static gl_state s_gl;   // mock vitaGL
+static gl_state s_game; // what the game has set
+
+static buffer s_buffers[BUFFERS];
+static uint32_t s_made;
+static uint32_t s_frame = 1;
+static uint32_t s_deleted;
+
+static uint8_t s_regions[REGIONS][REGION_SIZE];
+
+static uint32_t s_rng = 1;
+
+static uint32_t rnd(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static int s_failed;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+    } \
+} while (0)
+
+static uint32_t type_size(GLenum type) {
+    switch (type) {
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE:
+            return 1;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+        case GL_HALF_FLOAT:
+            return 2;
+        default:
+            return 4;
+    }
+}
+
+static int client_state_index(GLenum array, uint32_t unit) {
+    switch (array) {
+        case GL_VERTEX_ARRAY: return A_VERTEX;
+        case GL_NORMAL_ARRAY: return A_NORMAL;
+        case GL_COLOR_ARRAY: return A_COLOR;
+        case GL_TEXTURE_COORD_ARRAY: return A_TEXCOORD + (int)unit;
+        default: return -1;
+    }
+}
+
+// Mock vitaGL
+
+// Lowest free name first, like vitaGL, so that deleted names come back soon
+void glGenBuffers(GLsizei n, GLuint * buffers) {
+    GLuint b = 1;
+    for (GLsizei i = 0; i < n; i++) {
+        while (b < BUFFERS && s_buffers[b].alive)
+            b++;
+        if (b >= BUFFERS) {
+            printf("FAIL out of buffer names\n");
+            exit(1);
+        }
+        s_buffers[b].alive = true;
+        s_buffers[b].generation++;
+        s_buffers[b].drawn_frame = 0;
+        s_buffers[b].size = 0;
+        buffers[i] = b;
+        s_made++;
+    }
+}
+
+static buffer * bound_buffer(GLenum target) {
+    GLuint b = target == GL_ARRAY_BUFFER ? s_gl.array_buffer
+                                         : s_gl.element_buffer;
+    CHECK(b && s_buffers[b].alive, "no buffer bound to %#x", target);
+    if (!b)
+        return NULL;
+    CHECK(s_buffers[b].drawn_frame != s_frame,
+          "buffer %u written after a draw of this frame read it", b);
+    return &s_buffers[b];
+}
+
+void glBufferData(GLenum target, GLsizeiptr size, const void * data,
+                  GLenum usage) {
+    (void)usage;
+    buffer * b = bound_buffer(target);
+    if (!b)
+        return;
+    free(b->data);
+    b->data = malloc(size);
+    b->size = size;
+    if (data)
+        memcpy(b->data, data, size);
+}
+
+void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size,
+                     const void * data) {
+    buffer * b = bound_buffer(target);
+    if (b && offset + size <= (GLintptr)b->size)
+        memcpy(b->data + offset, data, size);
+}
+
+void glDeleteBuffers(GLsizei n, const GLuint * buffers) {
+    for (GLsizei i = 0; i < n; i++) {
+        GLuint b = buffers[i];
+        if (!b || b >= BUFFERS || !s_buffers[b].alive)
+            continue;
+        // The data is kept, so that reading it can be reported
+        s_buffers[b].alive = false;
+        s_deleted++;
+        if (s_gl.array_buffer == b)
+            s_gl.array_buffer = 0;
+        if (s_gl.element_buffer == b)
+            s_gl.element_buffer = 0;
+    }
+}
+
+void glBindBuffer(GLenum target, GLuint buffer) {
+    if (target == GL_ARRAY_BUFFER)
+        s_gl.array_buffer = buffer;
+    else if (target == GL_ELEMENT_ARRAY_BUFFER)
+        s_gl.element_buffer = buffer;
+}
+
+void glGetIntegerv(GLenum pname, GLint * data) {
+    if (pname == GL_ARRAY_BUFFER_BINDING)
+        *data = (GLint)s_gl.array_buffer;
+}
+
+static void set_array(int i, GLint size, GLenum type, GLboolean normalized,
+                      GLsizei stride, const void * pointer) {
+    array_state * a = &s_gl.arrays[i];
+    a->size = size;
+    a->type = type;
+    a->normalized = normalized;
+    a->stride = stride;
+    a->buffer = s_gl.array_buffer;
+    a->generation = s_buffers[a->buffer].generation;
+    a->ptr = pointer;
+}
+
+void glVertexPointer(GLint size, GLenum type, GLsizei stride,
+                     const void * pointer) {
+    set_array(A_VERTEX, size, type, GL_FALSE, stride, pointer);
+}
+
+void glNormalPointer(GLenum type, GLsizei stride, const void * pointer) {
+    set_array(A_NORMAL, 3, type, GL_FALSE, stride, pointer);
+}
+
+void glColorPointer(GLint size, GLenum type, GLsizei stride,
+                    const void * pointer) {
+    set_array(A_COLOR, size, type, GL_FALSE, stride, pointer);
+}
+
+void glTexCoordPointer(GLint size, GLenum type, GLsizei stride,
+                       const void * pointer) {
+    set_array(A_TEXCOORD + (int)s_gl.client_unit, size, type, GL_FALSE,
+              stride, pointer);
+}
+
+void glVertexAttribPointer(GLuint index, GLint size, GLenum type,
+                           GLboolean normalized, GLsizei stride,
+                           const void * pointer) {
+    set_array(A_ATTRIB + (int)index, size, type, normalized, stride, pointer);
+}
+
+void glClientActiveTexture(GLenum texture) {
+    s_gl.client_unit = texture - GL_TEXTURE0;
+}
+
+void glEnableClientState(GLenum array) {
+    s_gl.arrays[client_state_index(array, s_gl.client_unit)].enabled = true;
+}
+
+void glDisableClientState(GLenum array) {
+    s_gl.arrays[client_state_index(array, s_gl.client_unit)].enabled = false;
+}
+
+void glEnableVertexAttribArray(GLuint index) {
+    s_gl.arrays[A_ATTRIB + index].enabled = true;
+}
+
+void glDisableVertexAttribArray(GLuint index) {
+    s_gl.arrays[A_ATTRIB + index].enabled = false;
+}
+
+// State glstate filters, not looked at here
+void glActiveTexture(GLenum texture) { (void)texture; }
+void glBindTexture(GLenum target, GLuint texture) {
+    (void)target; (void)texture;
+}
+void glDeleteTextures(GLsizei n, const GLuint * textures) {
+    (void)n; (void)textures;
+}
+void glUseProgram(GLuint program) { (void)program; }
+void glDeleteProgram(GLuint program) { (void)program; }
+void glEnable(GLenum cap) { (void)cap; }
+void glDisable(GLenum cap) { (void)cap; }
+void glBlendFunc(GLenum sfactor, GLenum dfactor) {
+    (void)sfactor; (void)dfactor;
+}
+void glDepthMask(GLboolean flag) { (void)flag; }
+void glCullFace(GLenum mode) { (void)mode; }
+void glPixelStorei(GLenum pname, GLint param) { (void)pname; (void)param; }
+
+GLuint gltexture_storage(GLuint texture) {
+    return texture;
+}
+
+void gltexture_bind(GLenum target, GLuint texture) {
+    glBindTexture(target, texture);
+}
+
+void gltexture_delete(GLsizei n, const GLuint * textures) {
+    glDeleteTextures(n, textures);
+}
+
+// The game
+
+static void game_bind(GLenum target, GLuint b) {
+    glBindBuffer_soloader(target, b);
+    if (target == GL_ARRAY_BUFFER)
+        s_game.array_buffer = b;
+    else
+        s_game.element_buffer = b;
+}
+
+static void game_unit(uint32_t unit) {
+    glClientActiveTexture_soloader(GL_TEXTURE0 + unit);
+    s_game.client_unit = unit;
+}
+
+static void game_pointer(int i, GLint size, GLenum type, GLsizei stride,
+                         const void * ptr) {
+    array_state * a = &s_game.arrays[i];
+    a->set = true;
+    a->size = i == A_NORMAL ? 3 : size;
+    a->type = type;
+    a->normalized = i >= A_ATTRIB && (rnd() % 2);
+    a->stride = stride;
+    a->buffer = s_game.array_buffer;
+    a->ptr = ptr;
+
+    if (i == A_VERTEX) {
+        glVertexPointer_soloader(size, type, stride, ptr);
+    } else if (i == A_NORMAL) {
+        glNormalPointer_soloader(type, stride, ptr);
+    } else if (i == A_COLOR) {
+        glColorPointer_soloader(size, type, stride, ptr);
+    } else if (i < A_ATTRIB) {
+        game_unit(i - A_TEXCOORD);
+        glTexCoordPointer_soloader(size, type, stride, ptr);
+    } else {
+        glVertexAttribPointer_soloader(i - A_ATTRIB, size, type,
+                                       a->normalized, stride, ptr);
+    }
+}
+
+static void game_enable(int i, bool on) {
+    s_game.arrays[i].enabled = on;
+
+    if (i >= A_ATTRIB) {
+        if (on)
+            glEnableVertexAttribArray_soloader(i - A_ATTRIB);
+        else
+            glDisableVertexAttribArray_soloader(i - A_ATTRIB);
+        return;
+    }
+
+    static const GLenum names[] = {
+        GL_VERTEX_ARRAY, GL_NORMAL_ARRAY, GL_COLOR_ARRAY
+    };
+    GLenum array = GL_TEXTURE_COORD_ARRAY;
+    if (i < A_TEXCOORD)
+        array = names[i];
+    else
+        game_unit(i - A_TEXCOORD);
+
+    if (on)
+        glEnableClientState_soloader(array);
+    else
+        glDisableClientState_soloader(array);
+}
+
+static void frame_end(void) {
+    glstate_frame_end();
+    glvbo_frame_end();
+    s_frame++;
+}
+
+/*
+ * eglCreateContext() and eglMakeCurrent() only invalidate what the loader
+ * knows: vitaGL has the one context, whose state stays as it was.
+ */
+static void context_event(void) {
+    glstate_invalidate();
+    glvbo_invalidate();
+}
+
+// Draw checks
+
+static const uint8_t * vertex_at(const array_state * a, uint32_t v,
+                                 bool mock) {
+    uint32_t elem = a->size * type_size(a->type);
+    uint32_t stride = a->stride ? (uint32_t)a->stride : elem;
+    uintptr_t offset = (uintptr_t)a->ptr + (uintptr_t)v * stride;
+
+    if (!a->buffer)
+        return (const uint8_t *)offset;
+
+    buffer * b = &s_buffers[a->buffer];
+    if (mock) {
+        CHECK(b->alive && b->generation == a->generation,
+              "draw reads deleted buffer %u", a->buffer);
+        b->drawn_frame = s_frame;
+    }
+    if (offset + elem > b->size) {
+        CHECK(0, "vertex %u past the end of buffer %u", v, a->buffer);
+        return NULL;
+    }
+    return b->data + offset;
+}
+
+// Returns the number of arrays drawn from a buffer the game didn't bind
+static int check_draw(const uint32_t * verts, uint32_t count) {
+    int promoted = 0;
+
+    CHECK(s_gl.array_buffer == s_game.array_buffer,
+          "array buffer %u bound after the draw, game has %u",
+          s_gl.array_buffer, s_game.array_buffer);
+    CHECK(s_gl.element_buffer == s_game.element_buffer,
+          "element buffer %u bound, game has %u",
+          s_gl.element_buffer, s_game.element_buffer);
+    CHECK(s_gl.client_unit == s_game.client_unit,
+          "client unit %u after the draw, game has %u",
+          s_gl.client_unit, s_game.client_unit);
+
+    for (int i = 0; i < A_NUM; i++) {
+        const array_state * g = &s_game.arrays[i];
+        const array_state * m = &s_gl.arrays[i];
+
+        CHECK(g->enabled == m->enabled, "array %d enabled %d, game has %d",
+              i, m->enabled, g->enabled);
+        if (!g->enabled || !m->enabled)
+            continue;
+
+        CHECK(g->size == m->size && g->type == m->type
+              && g->stride == m->stride && g->normalized == m->normalized,
+              "array %d format differs", i);
+        if (g->size != m->size || g->type != m->type)
+            continue;
+
+        if (m->buffer != g->buffer)
+            promoted++;
+
+        uint32_t elem = g->size * type_size(g->type);
+        for (uint32_t k = 0; k < count; k++) {
+            const uint8_t * want = vertex_at(g, verts[k], false);
+            const uint8_t * got = vertex_at(m, verts[k], true);
+            if (want && got && memcmp(want, got, elem) != 0) {
+                CHECK(0, "frame %u: array %d vertex %u differs (buffer %u, "
+                      "game buffer %u)", s_frame, i, verts[k], m->buffer,
+                      g->buffer);
+                break;
+            }
+        }
+    }
+
+    return promoted;
+}
+
+static int draw_arrays(uint32_t first, uint32_t count) {
+    uint32_t verts[256];
+    for (uint32_t i = 0; i < count; i++)
+        verts[i] = first + i;
+    glvbo_prepare_draw_arrays((GLint)first, (GLsizei)count);
+    return check_draw(verts, count);
+}
+
+// Indices from client memory, or from the game's element buffer
+static int draw_elements(GLenum type, const uint32_t * verts, uint32_t count,
+                         GLuint element_buffer) {
+    static uint8_t indices[MAX_INDICES * 4];
+    uint32_t size = type_size(type);
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t v = verts[i];
+        memcpy(indices + i * size, size == 1 ? (void *)&(uint8_t){ v }
+               : size == 2 ? (void *)&(uint16_t){ v } : (void *)&v, size);
+    }
+
+    // The buffer can't be refilled once a draw of this frame used it
+    const void * ptr = indices;
+    if (element_buffer && s_buffers[element_buffer].drawn_frame != s_frame) {
+        uint32_t offset = (rnd() % 8) * 4;
+        game_bind(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, count * size,
+                        indices);
+        s_buffers[element_buffer].drawn_frame = s_frame;
+        ptr = (const void *)(uintptr_t)offset;
+    } else {
+        element_buffer = 0;
+    }
+
+    glvbo_prepare_draw_elements((GLsizei)count, type, ptr);
+    int promoted = check_draw(verts, count);
+
+    if (element_buffer)
+        game_bind(GL_ELEMENT_ARRAY_BUFFER, 0);
+    return promoted;
+}
+
+// A static array drawn three times a frame, rewritten in place at frame 8,
+// and every frame from 12 on
+static void check_promotion(void) {
+    static float v[300];
+    for (int i = 0; i < 300; i++)
+        v[i] = (float)i;
+
+    context_event();
+    game_bind(GL_ARRAY_BUFFER, 0);
+    game_bind(GL_ELEMENT_ARRAY_BUFFER, 0);
+    game_pointer(A_VERTEX, 3, GL_FLOAT, 12, v);
+    game_enable(A_VERTEX, true);
+
+    int promoted[20];
+    for (int f = 0; f < 20; f++) {
+        if (f == 8)
+            v[5] = -1;
+        if (f >= 12)
+            v[7] = (float)f;
+
+        for (int d = 0; d < 3; d++) {
+            game_pointer(A_VERTEX, 3, GL_FLOAT, 12, v);
+            if (d == 2) {
+                uint32_t verts[3] = { 0, 50, 99 };
+                promoted[f] = draw_elements(GL_UNSIGNED_SHORT, verts, 3, 0);
+            } else {
+                promoted[f] = draw_arrays(0, 100);
+            }
+        }
+        frame_end();
+    }
+
+    CHECK(!promoted[0], "drawn from a buffer in the first frame");
+    CHECK(promoted[1] && promoted[7], "not promoted after two frames");
+    CHECK(!promoted[8], "drawn from a buffer after changing");
+    CHECK(promoted[10], "not promoted again after changing once");
+    CHECK(!promoted[15], "drawn from a buffer while changing every frame");
+
+    game_enable(A_VERTEX, false);
+}
+
+// Pointers set and drawn while glstate doesn't know the game's binding
+static void check_unknown_binding(void) {
+    static float v[300];
+    GLuint b;
+    glGenBuffers(1, &b);
+    game_bind(GL_ARRAY_BUFFER, b);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(v), v, GL_STATIC_DRAW);
+
+    for (int f = 0; f < 4; f++) {
+        for (int i = 0; i < 300; i++)
+            v[i] = (float)(i * (f + 1));
+
+        // Into the game's buffer, then from client memory with it bound
+        context_event();
+        game_pointer(A_VERTEX, 3, GL_FLOAT, 12, (const void *)(uintptr_t)48);
+        game_enable(A_VERTEX, true);
+        draw_arrays(0, 50);
+
+        context_event();
+        game_bind(GL_ARRAY_BUFFER, 0);
+        game_pointer(A_COLOR, 4, GL_FLOAT, 0, v);
+        game_enable(A_COLOR, true);
+        game_bind(GL_ARRAY_BUFFER, b);
+        context_event();
+        draw_arrays(0, 50);
+        frame_end();
+    }
+
+    game_enable(A_VERTEX, false);
+    game_enable(A_COLOR, false);
+    game_bind(GL_ARRAY_BUFFER, 0);
+    GLuint gone = b;
+    glDeleteBuffers_soloader(1, &gone);
+}
+
+// Random game
+
+typedef struct layout {
+    int region;
+    uint32_t offset;
+    GLint size;
+    GLenum type;
+    GLsizei stride;
+} layout;
+
+static const GLenum s_types[] = {
+    GL_FLOAT, GL_SHORT, GL_UNSIGNED_BYTE, GL_HALF_FLOAT
+};
+
+static layout random_layout(void) {
+    layout l;
+    l.region = rnd() % REGIONS;
+    l.offset = rnd() % 1024;
+    l.size = 1 + rnd() % 4;
+    l.type = s_types[rnd() % 4];
+    uint32_t elem = l.size * type_size(l.type);
+    l.stride = rnd() % 3 == 0 ? 0 : (GLsizei)(elem + rnd() % 24);
+    return l;
+}
+
+static void pointer_to(int i, const layout * l, GLuint game_buffer) {
+    if (game_buffer) {
+        game_bind(GL_ARRAY_BUFFER, game_buffer);
+        game_pointer(i, l->size, l->type, l->stride,
+                     (const void *)(uintptr_t)l->offset);
+        if (rnd() % 2)
+            game_bind(GL_ARRAY_BUFFER, 0);
+        return;
+    }
+
+    if (s_game.array_buffer != 0 && rnd() % 4)
+        game_bind(GL_ARRAY_BUFFER, 0);
+    if (s_game.array_buffer != 0) {
+        // Set while a buffer is bound: the pointer is an offset into it
+        game_pointer(i, l->size, l->type, l->stride,
+                     (const void *)(uintptr_t)l->offset);
+        return;
+    }
+    game_pointer(i, l->size, l->type, l->stride,
+                 s_regions[l->region] + l->offset);
+}
+
+static int random_array(void) {
+    switch (rnd() % 5) {
+        case 0: return A_VERTEX;
+        case 1: return A_NORMAL;
+        case 2: return A_COLOR;
+        case 3: return A_TEXCOORD + (int)(rnd() % GAME_UNITS);
+        default: return A_ATTRIB + (int)(rnd() % GAME_ATTRIBS);
+    }
+}
+
+static void mutate(int region) {
+    uint8_t * r = s_regions[region];
+    r[rnd() % REGION_SIZE] = (uint8_t)rnd();
+}
+
+static void check_random(long frames) {
+    layout layouts[8];
+    for (int i = 0; i < 8; i++)
+        layouts[i] = random_layout();
+
+    for (int r = 0; r < REGIONS; r++) {
+        for (int i = 0; i < REGION_SIZE; i++)
+            s_regions[r][i] = (uint8_t)rnd();
+    }
+
+    // Game buffers hold a copy of a region
+    GLuint game_buffers[3];
+    glGenBuffers(3, game_buffers);
+    for (int i = 0; i < 3; i++) {
+        game_bind(i < 2 ? GL_ARRAY_BUFFER : GL_ELEMENT_ARRAY_BUFFER,
+                  game_buffers[i]);
+        glBufferData(i < 2 ? GL_ARRAY_BUFFER : GL_ELEMENT_ARRAY_BUFFER,
+                     REGION_SIZE, s_regions[i], GL_STATIC_DRAW);
+    }
+    game_bind(GL_ARRAY_BUFFER, 0);
+    game_bind(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    uint64_t draws = 0, promoted = 0;
+    uint32_t made = s_made;
+
+    for (long f = 0; f < frames; f++) {
+        if (rnd() % 40 == 0)
+            context_event();
+
+        uint32_t n = 1 + rnd() % 12;
+        for (uint32_t d = 0; d < n; d++) {
+            // The game changes some of its state between draws
+            for (uint32_t c = rnd() % 4; c > 0; c--) {
+                int i = random_array();
+                if (rnd() % 3 == 0 || !s_game.arrays[i].set) {
+                    layout l = rnd() % 5 ? layouts[rnd() % 8]
+                                         : random_layout();
+                    pointer_to(i, &l, rnd() % 8 == 0 ? game_buffers[rnd() % 2]
+                                                     : 0);
+                } else {
+                    game_enable(i, !s_game.arrays[i].enabled);
+                }
+            }
+            if (rnd() % 4 == 0)
+                game_unit(rnd() % GAME_UNITS);
+            if (rnd() % 10 == 0)
+                game_bind(GL_ARRAY_BUFFER, game_buffers[rnd() % 2]);
+            else if (rnd() % 3 == 0)
+                game_bind(GL_ARRAY_BUFFER, 0);
+
+            if (rnd() % 50 == 0)
+                mutate(3);
+            mutate(5);
+
+            if (rnd() % 2) {
+                uint32_t count = 1 + rnd() % 120;
+                promoted += draw_arrays(rnd() % 4, count) > 0;
+            } else {
+                static const GLenum types[] = {
+                    GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT, GL_UNSIGNED_INT
+                };
+                uint32_t verts[MAX_INDICES];
+                uint32_t count = 1 + rnd() % MAX_INDICES;
+                for (uint32_t i = 0; i < count; i++)
+                    verts[i] = rnd() % 150;
+                GLuint eb = rnd() % 10 == 0 ? game_buffers[2] : 0;
+                promoted += draw_elements(types[rnd() % 3], verts, count,
+                                          eb) > 0;
+            }
+            draws++;
+        }
+
+        for (int i = 0; i < 4; i++)
+            mutate(4);
+        frame_end();
+    }
+
+    made = s_made - made;
+    CHECK(promoted > 0 && promoted < draws,
+          "%llu of %llu draws used a promoted buffer",
+          (unsigned long long)promoted, (unsigned long long)draws);
+    CHECK(s_deleted > 0, "no promoted buffer was ever dropped");
+    printf("   %llu of %llu draws used a promoted buffer, %u made, "
+           "%u deleted\n", (unsigned long long)promoted,
+           (unsigned long long)draws, made, s_deleted);
+}
+
+int main(int argc, char ** argv) {
+    long frames = argc > 1 ? atol(argv[1]) : 2000;
+
+    check_promotion();
+    check_unknown_binding();
+    check_random(frames);
+
+    if (s_failed)
+        return 1;
+    printf("ok: %ld random frames against a resolving mock GL\n", frames);
+    return 0;
+}
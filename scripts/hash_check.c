@@ -0,0 +1,324 @@
+/*
+ * scripts/hash_check.c
+ *
+ * Checks loader/utils/hash.c: SHA1 of strings and files against the FIPS
+ * 180 test vectors and across file chunk boundaries, hex encoding against
+ * printf, and hash128 against a scalar version of its definition, fed in
+ * one go or in pieces split anywhere, with every input bit flipping every
+ * output bit about half of the time. The version 1 manifest migration
+ * that comes with the new keys is covered by shadermanifest_check.
+ * Built by the host project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/hash_check
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/hash.h"
+#include "utils/utils.h"
+
+#define FILE_PATH       DATA_PATH "hash_check.bin"
+#define BUF_MAX         (64 * 1024)
+
+static uint32_t s_rng = 1;
+
+static uint32_t rnd(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static int s_failed;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+    } \
+} while (0)
+
+static void fill(uint8_t * buf, size_t len) {
+    for (size_t i = 0; i < len; i++)
+        buf[i] = (uint8_t)rnd();
+}
+
+static void write_file(const uint8_t * data, size_t len) {
+    FILE * f = fopen(FILE_PATH, "wb");
+    fwrite(data, 1, len, f);
+    fclose(f);
+}
+
+static void check_sha1(void) {
+    static const struct {
+        const char * msg;
+        long repeat;
+        const char * sha1;
+    } vectors[] = {
+        { "abc", 1, "A9993E364706816ABA3E25717850C26C9CD0D89D" },
+        { "", 1, "DA39A3EE5E6B4B0D3255BFEF95601890AFD80709" },
+        { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+          "84983E441C3BD26EBAAE4AA1F95129E5E54670F1" },
+        { "a", 1000000, "34AA973CD4C4DAA4F61EEB2BDBAD27316534016F" },
+    };
+
+    for (size_t v = 0; v < sizeof(vectors) / sizeof(vectors[0]); v++) {
+        size_t part = strlen(vectors[v].msg);
+        size_t len = part * vectors[v].repeat;
+        uint8_t * msg = malloc(len + 1);
+        for (long i = 0; i < vectors[v].repeat; i++)
+            memcpy(msg + i * part, vectors[v].msg, part);
+
+        char * sha1 = get_string_sha1(msg, (long)len);
+        CHECK(!strcmp(sha1, vectors[v].sha1), "SHA1 of vector %zu is %s, "
+              "want %s", v, sha1, vectors[v].sha1);
+        free(sha1);
+
+        write_file(msg, len);
+        sha1 = get_file_sha1(FILE_PATH);
+        CHECK(sha1 && !strcmp(sha1, vectors[v].sha1), "SHA1 of the file "
+              "with vector %zu is %s", v, sha1 ? sha1 : "(null)");
+        free(sha1);
+        free(msg);
+    }
+
+    CHECK(get_file_sha1(DATA_PATH "hash_check.missing") == NULL,
+          "SHA1 of a missing file");
+}
+
+// Files of every size around the 8KB read chunks hash like their contents
+static void check_sha1_file(void) {
+    uint8_t * buf = malloc(BUF_MAX);
+    fill(buf, BUF_MAX);
+
+    for (size_t base = 0; base <= 4 * 8192; base += 8192) {
+        for (size_t len = base ? base - 65 : 0; len <= base + 65; len++) {
+            write_file(buf, len);
+
+            uint8_t digest[20];
+            CHECK(sha1_file(FILE_PATH, digest), "sha1_file of %zu bytes",
+                  len);
+            char from_file[41];
+            hex_encode(digest, 20, from_file);
+
+            char * from_string = get_string_sha1(buf, (long)len);
+            CHECK(!strcmp(from_file, from_string), "SHA1 of %zu bytes: %s "
+                  "from the file, %s from memory", len, from_file,
+                  from_string);
+            free(from_string);
+        }
+    }
+    free(buf);
+    remove(FILE_PATH);
+}
+
+static void check_hex(void) {
+    uint8_t data[64];
+    char out[sizeof(data) * 2 + 1];
+    char want[sizeof(data) * 2 + 1];
+
+    for (int n = 0; n < 10000; n++) {
+        size_t len = rnd() % (sizeof(data) + 1);
+        fill(data, len);
+        memset(out, 'x', sizeof(out));
+        hex_encode(data, len, out);
+
+        want[0] = '\0';
+        for (size_t i = 0; i < len; i++)
+            sprintf(want + i * 2, "%02X", data[i]);
+        CHECK(!strcmp(out, want), "hex of %zu bytes: %s, want %s", len, out,
+              want);
+    }
+}
+
+/*
+ * hash128 as the header describes it, one word at a time
+ */
+
+#define PRIME1 0x9E3779B1u
+#define PRIME2 0x85EBCA77u
+#define PRIME3 0xC2B2AE3Du
+#define PRIME5 0x165667B1u
+
+static uint32_t rotl(uint32_t x, int r) {
+    return (x << r) | (x >> (32 - r));
+}
+
+static uint32_t mix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static void reference(const uint8_t * p, size_t len, uint8_t out[16]) {
+    uint32_t h[4] = { PRIME1 + PRIME2, PRIME2, 0, 0u - PRIME1 };
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        for (int l = 0; l < 4; l++) {
+            const uint8_t * w = p + i + l * 4;
+            uint32_t word = w[0] | w[1] << 8 | w[2] << 16
+                            | (uint32_t)w[3] << 24;
+            h[l] = rotl(h[l] + word * PRIME2, 13) * PRIME1;
+        }
+    }
+    for (uint32_t k = 0; i < len; i++, k++)
+        h[k & 3] = rotl(h[k & 3] ^ (p[i] * PRIME5), 11) * PRIME1;
+
+    h[0] ^= (uint32_t)len;
+    h[1] ^= (uint32_t)((uint64_t)len >> 32) ^ PRIME3;
+    for (int r = 0; r < 3; r++) {
+        h[0] = mix(h[0] + h[1]);
+        h[1] = mix(h[1] + h[2]);
+        h[2] = mix(h[2] + h[3]);
+        h[3] = mix(h[3] + h[0]);
+    }
+    for (int l = 0; l < 4; l++) {
+        for (int b = 0; b < 4; b++)
+            out[l * 4 + b] = (uint8_t)(h[l] >> (b * 8));
+    }
+}
+
+static void hash_pieces(const uint8_t * data, size_t len, const size_t * cuts,
+                        int count, uint8_t out[16]) {
+    hash128_ctx ctx;
+    hash128_init(&ctx);
+    size_t off = 0;
+    for (int i = 0; i < count; i++) {
+        hash128_update(&ctx, data + off, cuts[i] - off);
+        off = cuts[i];
+    }
+    hash128_update(&ctx, data + off, len - off);
+    hash128_final(&ctx, out);
+}
+
+static void check_hash128(void) {
+    uint8_t * buf = malloc(BUF_MAX + 16);
+    fill(buf, BUF_MAX + 16);
+
+    // Every length up to a few stripes, at every alignment, split anywhere
+    for (size_t len = 0; len <= 80; len++) {
+        for (size_t align = 0; align < 16; align++) {
+            const uint8_t * data = buf + align;
+            uint8_t want[16], got[16];
+            reference(data, len, want);
+
+            hash128(data, len, got);
+            CHECK(!memcmp(got, want, 16), "hash128 of %zu bytes at +%zu",
+                  len, align);
+
+            for (size_t cut = 0; cut <= len; cut++) {
+                hash_pieces(data, len, &cut, 1, got);
+                CHECK(!memcmp(got, want, 16), "hash128 of %zu bytes split "
+                      "at %zu", len, cut);
+            }
+        }
+    }
+
+    // Longer inputs in many pieces, empty ones included
+    for (int n = 0; n < 2000; n++) {
+        size_t len = rnd() % BUF_MAX;
+        size_t cuts[32];
+        int count = rnd() % 32;
+        for (int i = 0; i < count; i++)
+            cuts[i] = len ? rnd() % (len + 1) : 0;
+        for (int i = 1; i < count; i++) {
+            for (int k = i; k > 0 && cuts[k - 1] > cuts[k]; k--) {
+                size_t t = cuts[k];
+                cuts[k] = cuts[k - 1];
+                cuts[k - 1] = t;
+            }
+        }
+
+        uint8_t want[16], got[16];
+        reference(buf, len, want);
+        hash_pieces(buf, len, cuts, count, got);
+        CHECK(!memcmp(got, want, 16), "hash128 of %zu bytes in %d pieces",
+              len, count + 1);
+    }
+    free(buf);
+}
+
+/*
+ * Flipping any input bit flips each output bit about half of the time, at
+ * lengths that end in the tail and in a stripe. One and two byte inputs
+ * are tried in full, longer ones sampled; the limit is in standard
+ * deviations of the flip rate for that many pairs.
+ */
+static void check_avalanche(void) {
+    static const size_t lengths[] = { 1, 2, 4, 15, 16, 17, 32, 100 };
+    enum { SAMPLES = 1000 };
+    double worst = 0;
+
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        size_t len = lengths[l];
+        for (size_t bit = 0; bit < len * 8; bit++) {
+            int flips[128] = { 0 };
+            int pairs = 0;
+
+            for (uint32_t s = 0; ; s++) {
+                uint8_t data[100], a[16], b[16];
+                if (len <= 2) {
+                    if (s >> (len * 8))
+                        break;
+                    // Each pair once, from the side with the bit clear
+                    if ((s >> bit) & 1)
+                        continue;
+                    data[0] = (uint8_t)s;
+                    data[1] = (uint8_t)(s >> 8);
+                } else {
+                    if (s == SAMPLES)
+                        break;
+                    fill(data, len);
+                }
+
+                hash128(data, len, a);
+                data[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+                hash128(data, len, b);
+                for (int o = 0; o < 128; o++)
+                    flips[o] += ((a[o / 8] ^ b[o / 8]) >> (o % 8)) & 1;
+                pairs++;
+            }
+
+            double sigma = 0.5 / sqrt(pairs);
+            for (int o = 0; o < 128; o++) {
+                double bias = fabs(flips[o] / (double)pairs - 0.5) / sigma;
+                if (bias > worst)
+                    worst = bias;
+                CHECK(bias < 5.5, "%zu bytes: input bit %zu flips output "
+                      "bit %d %d times in %d", len, bit, o, flips[o], pairs);
+            }
+        }
+    }
+    printf("   worst avalanche bias %.2f sigma\n", worst);
+}
+
+int main(void) {
+    char dir[] = DATA_PATH;
+    mkpath(dir, 0755);
+
+    check_sha1();
+    check_sha1_file();
+    check_hex();
+    check_hash128();
+    check_avalanche();
+
+    if (s_failed)
+        return 1;
+    printf("ok: SHA1 vectors, hex, hash128 in pieces and avalanche\n");
+    return 0;
+}
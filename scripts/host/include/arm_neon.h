@@ -0,0 +1,260 @@
+/*
+ * scripts/host/include/arm_neon.h
+ *
+ * Plain C versions of the NEON intrinsics the loader uses, so that its
+ * NEON code paths can be built and checked on a desktop. Only what the
+ * loader calls is here, with the same lane order and rounding as NEON.
+ * Speed is not a goal; timings of NEON code built this way mean nothing.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_HOST_ARM_NEON_H
+#define SOLOADER_HOST_ARM_NEON_H
+
+#include <stdint.h>
+#include <string.h>
+
+typedef struct { uint8_t v[8]; } uint8x8_t;
+typedef struct { uint8_t v[16]; } uint8x16_t;
+typedef struct { uint16_t v[8]; } uint16x8_t;
+typedef struct { uint32_t v[4]; } uint32x4_t;
+typedef struct { uint64_t v[2]; } uint64x2_t;
+typedef struct { float v[2]; } float32x2_t;
+typedef struct { float v[4]; } float32x4_t;
+typedef struct { uint32x4_t val[2]; } uint32x4x2_t;
+
+// Loads and stores
+
+static inline uint8x16_t vld1q_u8(const uint8_t * p) {
+    uint8x16_t r;
+    memcpy(r.v, p, sizeof(r.v));
+    return r;
+}
+
+static inline void vst1q_u8(uint8_t * p, uint8x16_t a) {
+    memcpy(p, a.v, sizeof(a.v));
+}
+
+static inline uint32x4_t vld1q_u32(const uint32_t * p) {
+    uint32x4_t r;
+    memcpy(r.v, p, sizeof(r.v));
+    return r;
+}
+
+static inline void vst1q_u32(uint32_t * p, uint32x4_t a) {
+    memcpy(p, a.v, sizeof(a.v));
+}
+
+static inline uint32x4x2_t vld2q_u32(const uint32_t * p) {
+    uint32x4x2_t r;
+    for (int i = 0; i < 4; i++) {
+        r.val[0].v[i] = p[2 * i];
+        r.val[1].v[i] = p[2 * i + 1];
+    }
+    return r;
+}
+
+static inline float32x4_t vld1q_f32(const float * p) {
+    float32x4_t r;
+    memcpy(r.v, p, sizeof(r.v));
+    return r;
+}
+
+static inline void vst1q_f32(float * p, float32x4_t a) {
+    memcpy(p, a.v, sizeof(a.v));
+}
+
+// Bytes
+
+static inline uint8x16_t vdupq_n_u8(uint8_t c) {
+    uint8x16_t r;
+    memset(r.v, c, sizeof(r.v));
+    return r;
+}
+
+static inline uint8x16_t vceqq_u8(uint8x16_t a, uint8x16_t b) {
+    for (int i = 0; i < 16; i++)
+        a.v[i] = a.v[i] == b.v[i] ? 0xFF : 0;
+    return a;
+}
+
+static inline uint8x16_t vmvnq_u8(uint8x16_t a) {
+    for (int i = 0; i < 16; i++)
+        a.v[i] = (uint8_t)~a.v[i];
+    return a;
+}
+
+static inline uint8x16_t vandq_u8(uint8x16_t a, uint8x16_t b) {
+    for (int i = 0; i < 16; i++)
+        a.v[i] &= b.v[i];
+    return a;
+}
+
+static inline uint8x16_t vorrq_u8(uint8x16_t a, uint8x16_t b) {
+    for (int i = 0; i < 16; i++)
+        a.v[i] |= b.v[i];
+    return a;
+}
+
+static inline uint8x8_t vget_low_u8(uint8x16_t a) {
+    uint8x8_t r;
+    memcpy(r.v, a.v, 8);
+    return r;
+}
+
+static inline uint8x8_t vget_high_u8(uint8x16_t a) {
+    uint8x8_t r;
+    memcpy(r.v, a.v + 8, 8);
+    return r;
+}
+
+static inline uint8x16_t vcombine_u8(uint8x8_t lo, uint8x8_t hi) {
+    uint8x16_t r;
+    memcpy(r.v, lo.v, 8);
+    memcpy(r.v + 8, hi.v, 8);
+    return r;
+}
+
+static inline uint16x8_t vaddl_u8(uint8x8_t a, uint8x8_t b) {
+    uint16x8_t r;
+    for (int i = 0; i < 8; i++)
+        r.v[i] = (uint16_t)(a.v[i] + b.v[i]);
+    return r;
+}
+
+static inline uint16x8_t vaddq_u16(uint16x8_t a, uint16x8_t b) {
+    for (int i = 0; i < 8; i++)
+        a.v[i] = (uint16_t)(a.v[i] + b.v[i]);
+    return a;
+}
+
+// Rounding shift right and narrow
+static inline uint8x8_t vrshrn_n_u16(uint16x8_t a, int n) {
+    uint8x8_t r;
+    for (int i = 0; i < 8; i++)
+        r.v[i] = (uint8_t)((a.v[i] + (1u << (n - 1))) >> n);
+    return r;
+}
+
+// Words
+
+static inline uint32x4_t vdupq_n_u32(uint32_t c) {
+    uint32x4_t r = {{ c, c, c, c }};
+    return r;
+}
+
+static inline uint32x4_t vaddq_u32(uint32x4_t a, uint32x4_t b) {
+    for (int i = 0; i < 4; i++)
+        a.v[i] += b.v[i];
+    return a;
+}
+
+static inline uint32x4_t vmulq_u32(uint32x4_t a, uint32x4_t b) {
+    for (int i = 0; i < 4; i++)
+        a.v[i] *= b.v[i];
+    return a;
+}
+
+static inline uint32x4_t vmlaq_u32(uint32x4_t acc, uint32x4_t a,
+                                   uint32x4_t b) {
+    for (int i = 0; i < 4; i++)
+        acc.v[i] += a.v[i] * b.v[i];
+    return acc;
+}
+
+static inline uint32x4_t veorq_u32(uint32x4_t a, uint32x4_t b) {
+    for (int i = 0; i < 4; i++)
+        a.v[i] ^= b.v[i];
+    return a;
+}
+
+static inline uint32x4_t vorrq_u32(uint32x4_t a, uint32x4_t b) {
+    for (int i = 0; i < 4; i++)
+        a.v[i] |= b.v[i];
+    return a;
+}
+
+static inline uint32x4_t vshlq_n_u32(uint32x4_t a, int n) {
+    for (int i = 0; i < 4; i++)
+        a.v[i] <<= n;
+    return a;
+}
+
+static inline uint32x4_t vshrq_n_u32(uint32x4_t a, int n) {
+    for (int i = 0; i < 4; i++)
+        a.v[i] >>= n;
+    return a;
+}
+
+// Shift b right by n and insert it under the top n bits of a
+static inline uint32x4_t vsriq_n_u32(uint32x4_t a, uint32x4_t b, int n) {
+    uint32_t keep = ~(0xFFFFFFFFu >> n);
+    for (int i = 0; i < 4; i++)
+        a.v[i] = (a.v[i] & keep) | (b.v[i] >> n);
+    return a;
+}
+
+// Reinterpretations (little-endian, like the Vita)
+
+static inline uint32x4_t vreinterpretq_u32_u8(uint8x16_t a) {
+    uint32x4_t r;
+    memcpy(r.v, a.v, sizeof(r.v));
+    return r;
+}
+
+static inline uint8x16_t vreinterpretq_u8_u32(uint32x4_t a) {
+    uint8x16_t r;
+    memcpy(r.v, a.v, sizeof(r.v));
+    return r;
+}
+
+static inline uint64x2_t vreinterpretq_u64_u8(uint8x16_t a) {
+    uint64x2_t r;
+    memcpy(r.v, a.v, sizeof(r.v));
+    return r;
+}
+
+static inline uint64_t vgetq_lane_u64(uint64x2_t a, int lane) {
+    return a.v[lane];
+}
+
+// Floats
+
+static inline float32x2_t vget_low_f32(float32x4_t a) {
+    float32x2_t r = {{ a.v[0], a.v[1] }};
+    return r;
+}
+
+static inline float32x2_t vget_high_f32(float32x4_t a) {
+    float32x2_t r = {{ a.v[2], a.v[3] }};
+    return r;
+}
+
+static inline float32x4_t vmulq_n_f32(float32x4_t a, float s) {
+    for (int i = 0; i < 4; i++)
+        a.v[i] *= s;
+    return a;
+}
+
+static inline float32x4_t vmlaq_n_f32(float32x4_t acc, float32x4_t a,
+                                      float s) {
+    for (int i = 0; i < 4; i++)
+        acc.v[i] += a.v[i] * s;
+    return acc;
+}
+
+static inline float32x4_t vmulq_lane_f32(float32x4_t a, float32x2_t b,
+                                         int lane) {
+    return vmulq_n_f32(a, b.v[lane]);
+}
+
+static inline float32x4_t vmlaq_lane_f32(float32x4_t acc, float32x4_t a,
+                                         float32x2_t b, int lane) {
+    return vmlaq_n_f32(acc, a, b.v[lane]);
+}
+
+#endif // SOLOADER_HOST_ARM_NEON_H
@@ -0,0 +1,46 @@
+/*
+ * scripts/host/include/kubridge.h
+ *
+ * Nothing is write-protected on the host: kubridge's unrestricted copies
+ * are plain ones, and its memory blocks are the SDK's, placed anywhere.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_HOST_KUBRIDGE_H
+#define SOLOADER_HOST_KUBRIDGE_H
+
+#include <string.h>
+
+#include <psp2/kernel/sysmem.h>
+
+typedef struct SceKernelAllocMemBlockKernelOpt {
+    SceSize size;
+    SceUInt32 field_4;
+    SceUInt32 attr;
+    SceUInt32 field_C;          // the address asked for; ignored here
+} SceKernelAllocMemBlockKernelOpt;
+
+static inline SceUID kuKernelAllocMemBlock(const char * name,
+                                           SceKernelMemBlockType type,
+                                           SceSize size,
+                                           SceKernelAllocMemBlockKernelOpt *
+                                           opt) {
+    (void)opt;
+    return sceKernelAllocMemBlock(name, type, size, NULL);
+}
+
+static inline void kuKernelFlushCaches(const void * ptr, SceSize len) {
+    (void)ptr; (void)len;
+}
+
+static inline int kuKernelCpuUnrestrictedMemcpy(void * dst, const void * src,
+                                                SceSize len) {
+    memcpy(dst, src, len);
+    return 0;
+}
+
+#endif // SOLOADER_HOST_KUBRIDGE_H
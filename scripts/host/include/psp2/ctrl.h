@@ -0,0 +1,61 @@
+/*
+ * scripts/host/include/psp2/ctrl.h
+ *
+ * The pad as reimpl/controls.c reads it. The host has no pad: the reads
+ * are only declared, and a program that polls the controls supplies the
+ * input itself (see bench.c).
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_HOST_PSP2_CTRL_H
+#define SOLOADER_HOST_PSP2_CTRL_H
+
+#include <psp2/types.h>
+
+enum {
+    SCE_CTRL_SELECT   = 0x00000001,
+    SCE_CTRL_L3       = 0x00000002,
+    SCE_CTRL_R3       = 0x00000004,
+    SCE_CTRL_START    = 0x00000008,
+    SCE_CTRL_UP       = 0x00000010,
+    SCE_CTRL_RIGHT    = 0x00000020,
+    SCE_CTRL_DOWN     = 0x00000040,
+    SCE_CTRL_LEFT     = 0x00000080,
+    SCE_CTRL_LTRIGGER = 0x00000100,
+    SCE_CTRL_RTRIGGER = 0x00000200,
+    SCE_CTRL_L1       = 0x00000400,
+    SCE_CTRL_R1       = 0x00000800,
+    SCE_CTRL_TRIANGLE = 0x00001000,
+    SCE_CTRL_CIRCLE   = 0x00002000,
+    SCE_CTRL_CROSS    = 0x00004000,
+    SCE_CTRL_SQUARE   = 0x00008000,
+};
+
+typedef enum SceCtrlPadInputMode {
+    SCE_CTRL_MODE_DIGITAL     = 0,
+    SCE_CTRL_MODE_ANALOG      = 1,
+    SCE_CTRL_MODE_ANALOG_WIDE = 2,
+} SceCtrlPadInputMode;
+
+typedef struct SceCtrlData {
+    uint64_t timeStamp;
+    unsigned int buttons;
+    unsigned char lx;
+    unsigned char ly;
+    unsigned char rx;
+    unsigned char ry;
+    uint8_t up, right, down, left;
+    uint8_t lt, rt, l1, r1;
+    uint8_t triangle, circle, cross, square;
+    uint8_t reserved[4];
+} SceCtrlData;
+
+int sceCtrlSetSamplingModeExt(SceCtrlPadInputMode mode);
+int sceCtrlPeekBufferPositiveExt2(int port, SceCtrlData * pad_data,
+                                  int count);
+
+#endif // SOLOADER_HOST_PSP2_CTRL_H
@@ -0,0 +1,69 @@
+/*
+ * scripts/host/include/psp2/io/dirent.h
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_HOST_PSP2_IO_DIRENT_H
+#define SOLOADER_HOST_PSP2_IO_DIRENT_H
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <psp2/io/stat.h>
+#include <psp2/types.h>
+
+#define SCE_IO_MAX_DIRS 64
+
+typedef struct SceIoDirent {
+    SceIoStat d_stat;
+    char d_name[256];
+    void * d_private;
+    int dummy;
+} SceIoDirent;
+
+// Directories open in this file, and their paths for the stat of entries
+static DIR * s_sce_io_dirs[SCE_IO_MAX_DIRS];
+static char s_sce_io_dir_paths[SCE_IO_MAX_DIRS][1024];
+
+static inline SceUID sceIoDopen(const char * path) {
+    for (int i = 0; i < SCE_IO_MAX_DIRS; i++) {
+        if (s_sce_io_dirs[i])
+            continue;
+        if (strlen(path) >= sizeof(s_sce_io_dir_paths[i])
+            || !(s_sce_io_dirs[i] = opendir(path)))
+            return -1;
+        strcpy(s_sce_io_dir_paths[i], path);
+        return i;
+    }
+    return -1;
+}
+
+static inline int sceIoDread(SceUID fd, SceIoDirent * e) {
+    struct dirent * de = readdir(s_sce_io_dirs[fd]);
+    if (!de)
+        return 0;
+
+    memset(e, 0, sizeof(*e));
+    snprintf(e->d_name, sizeof(e->d_name), "%s", de->d_name);
+
+    char path[2048];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", s_sce_io_dir_paths[fd], de->d_name);
+    if (lstat(path, &st) == 0)
+        sce_io_stat_from_host(&st, &e->d_stat);
+    return 1;
+}
+
+static inline int sceIoDclose(SceUID fd) {
+    closedir(s_sce_io_dirs[fd]);
+    s_sce_io_dirs[fd] = NULL;
+    return 0;
+}
+
+#endif // SOLOADER_HOST_PSP2_IO_DIRENT_H
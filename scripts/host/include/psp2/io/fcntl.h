@@ -0,0 +1,80 @@
+/*
+ * scripts/host/include/psp2/io/fcntl.h
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_HOST_PSP2_IO_FCNTL_H
+#define SOLOADER_HOST_PSP2_IO_FCNTL_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <psp2/types.h>
+
+#define SCE_O_RDONLY  0x0001
+#define SCE_O_WRONLY  0x0002
+#define SCE_O_RDWR    (SCE_O_RDONLY | SCE_O_WRONLY)
+#define SCE_O_APPEND  0x0100
+#define SCE_O_CREAT   0x0200
+#define SCE_O_TRUNC   0x0400
+#define SCE_O_EXCL    0x0800
+
+#define SCE_SEEK_SET  SEEK_SET
+#define SCE_SEEK_CUR  SEEK_CUR
+#define SCE_SEEK_END  SEEK_END
+
+static inline SceUID sceIoOpen(const char * path, int flags, SceMode mode) {
+    int o = (flags & SCE_O_RDWR) == SCE_O_RDWR ? O_RDWR
+            : (flags & SCE_O_WRONLY) ? O_WRONLY : O_RDONLY;
+    if (flags & SCE_O_APPEND)
+        o |= O_APPEND;
+    if (flags & SCE_O_CREAT)
+        o |= O_CREAT;
+    if (flags & SCE_O_TRUNC)
+        o |= O_TRUNC;
+    if (flags & SCE_O_EXCL)
+        o |= O_EXCL;
+
+    // SceIo leaves errno alone, its error codes carry it in the low bits
+    int saved = errno;
+    int fd = open(path, o, mode);
+    int error = errno;
+    errno = saved;
+    return fd < 0 ? (SceUID)(0x80010000u | error) : fd;
+}
+
+static inline int sceIoClose(SceUID fd) {
+    return close(fd);
+}
+
+static inline int sceIoRead(SceUID fd, void * buf, SceSize len) {
+    return (int)read(fd, buf, len);
+}
+
+static inline int sceIoWrite(SceUID fd, const void * buf, SceSize len) {
+    return (int)write(fd, buf, len);
+}
+
+static inline int sceIoPread(SceUID fd, void * buf, SceSize len, SceOff off) {
+    return (int)pread(fd, buf, len, off);
+}
+
+static inline int sceIoPwrite(SceUID fd, const void * buf, SceSize len,
+                              SceOff off) {
+    return (int)pwrite(fd, buf, len, off);
+}
+
+static inline SceOff sceIoLseek(SceUID fd, SceOff off, int whence) {
+    return lseek(fd, off, whence);
+}
+
+static inline int sceIoLseek32(SceUID fd, int off, int whence) {
+    return (int)lseek(fd, off, whence);
+}
+
+#endif // SOLOADER_HOST_PSP2_IO_FCNTL_H
@@ -0,0 +1,73 @@
+/*
+ * scripts/host/include/psp2/io/stat.h
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_HOST_PSP2_IO_STAT_H
+#define SOLOADER_HOST_PSP2_IO_STAT_H
+
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <psp2/types.h>
+
+#define SCE_S_IFDIR  S_IFDIR
+#define SCE_S_IFREG  S_IFREG
+#define SCE_S_ISDIR(m) S_ISDIR(m)
+#define SCE_S_ISREG(m) S_ISREG(m)
+
+// glibc defines st_mtime as st_mtim.tv_sec, so the times are laid out to
+// match that spelling when it's in effect
+#ifdef st_mtime
+#define SCE_IO_STAT_TIME(name) struct { SceDateTime tv_sec; } name
+#define SCE_IO_STAT_TIMES \
+    SCE_IO_STAT_TIME(st_ctim); \
+    SCE_IO_STAT_TIME(st_atim); \
+    SCE_IO_STAT_TIME(st_mtim)
+#else
+#define SCE_IO_STAT_TIMES \
+    SceDateTime st_ctime; \
+    SceDateTime st_atime; \
+    SceDateTime st_mtime
+#endif
+
+typedef struct SceIoStat {
+    SceMode st_mode;
+    unsigned int st_attr;
+    SceOff st_size;
+    SCE_IO_STAT_TIMES;
+    unsigned int st_private[6];
+} SceIoStat;
+
+static inline void sce_io_stat_from_host(const struct stat * st,
+                                         SceIoStat * out) {
+    memset(out, 0, sizeof(*out));
+    out->st_mode = (SceMode)st->st_mode;
+    out->st_size = st->st_size;
+
+    struct tm tm;
+    gmtime_r(&st->st_mtim.tv_sec, &tm);
+    out->st_mtime.year = (unsigned short)(tm.tm_year + 1900);
+    out->st_mtime.month = (unsigned short)(tm.tm_mon + 1);
+    out->st_mtime.day = (unsigned short)tm.tm_mday;
+    out->st_mtime.hour = (unsigned short)tm.tm_hour;
+    out->st_mtime.minute = (unsigned short)tm.tm_min;
+    out->st_mtime.second = (unsigned short)tm.tm_sec;
+    out->st_mtime.microsecond = (unsigned int)(st->st_mtim.tv_nsec / 1000);
+    out->st_ctime = out->st_atime = out->st_mtime;
+}
+
+static inline int sceIoGetstat(const char * path, SceIoStat * out) {
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return -1;
+    sce_io_stat_from_host(&st, out);
+    return 0;
+}
+
+#endif // SOLOADER_HOST_PSP2_IO_STAT_H
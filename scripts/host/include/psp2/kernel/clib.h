@@ -0,0 +1,24 @@
+/*
+ * scripts/host/include/psp2/kernel/clib.h
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_HOST_PSP2_KERNEL_CLIB_H
+#define SOLOADER_HOST_PSP2_KERNEL_CLIB_H
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#define sceClibPrintf    printf
+#define sceClibSnprintf  snprintf
+#define sceClibVsnprintf vsnprintf
+#define sceClibMemcpy    memcpy
+#define sceClibMemset    memset
+#define sceClibStrncmp   strncmp
+
+#endif // SOLOADER_HOST_PSP2_KERNEL_CLIB_H
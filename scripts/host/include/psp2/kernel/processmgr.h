@@ -0,0 +1,23 @@
+/*
+ * scripts/host/include/psp2/kernel/processmgr.h
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_HOST_PSP2_KERNEL_PROCESSMGR_H
+#define SOLOADER_HOST_PSP2_KERNEL_PROCESSMGR_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Microseconds; the wrap-around of the low word is what the Vita has too
+static inline uint32_t sceKernelGetProcessTimeLow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+#endif // SOLOADER_HOST_PSP2_KERNEL_PROCESSMGR_H
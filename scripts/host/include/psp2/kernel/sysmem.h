@@ -0,0 +1,29 @@
+/*
+ * scripts/host/include/psp2/kernel/sysmem.h
+ *
+ * Memory blocks are anonymous mappings below 4 GB, where so_util can keep
+ * addresses in Elf32 fields as it does on the Vita; see sdk.c.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_HOST_PSP2_KERNEL_SYSMEM_H
+#define SOLOADER_HOST_PSP2_KERNEL_SYSMEM_H
+
+#include <psp2/types.h>
+
+typedef int SceKernelMemBlockType;
+
+#define SCE_KERNEL_MEMBLOCK_TYPE_USER_RW 0x0C20D060
+
+typedef struct SceKernelAllocMemBlockOpt SceKernelAllocMemBlockOpt;
+
+SceUID sceKernelAllocMemBlock(const char * name, SceKernelMemBlockType type,
+                              SceSize size, SceKernelAllocMemBlockOpt * opt);
+int sceKernelFreeMemBlock(SceUID uid);
+int sceKernelGetMemBlockBase(SceUID uid, void ** base);
+
+#endif // SOLOADER_HOST_PSP2_KERNEL_SYSMEM_H
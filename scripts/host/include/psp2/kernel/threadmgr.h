@@ -0,0 +1,92 @@
+/*
+ * scripts/host/include/psp2/kernel/threadmgr.h
+ *
+ * Lightweight mutexes and condition variables on top of pthreads, and the
+ * few thread calls the loader's utilities make.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_HOST_PSP2_KERNEL_THREADMGR_H
+#define SOLOADER_HOST_PSP2_KERNEL_THREADMGR_H
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <psp2/types.h>
+
+typedef pthread_mutex_t SceKernelLwMutexWork;
+typedef struct SceKernelLwMutexOptParam SceKernelLwMutexOptParam;
+
+static inline int sceKernelCreateLwMutex(SceKernelLwMutexWork * work,
+                                         const char * name, unsigned attr,
+                                         int count,
+                                         const SceKernelLwMutexOptParam * opt) {
+    (void)name; (void)attr; (void)count; (void)opt;
+    return pthread_mutex_init(work, NULL) == 0 ? 0 : -1;
+}
+
+static inline int sceKernelDeleteLwMutex(SceKernelLwMutexWork * work) {
+    return pthread_mutex_destroy(work);
+}
+
+static inline int sceKernelLockLwMutex(SceKernelLwMutexWork * work, int count,
+                                       unsigned * timeout) {
+    (void)count; (void)timeout;
+    return pthread_mutex_lock(work);
+}
+
+static inline int sceKernelUnlockLwMutex(SceKernelLwMutexWork * work,
+                                         int count) {
+    (void)count;
+    return pthread_mutex_unlock(work);
+}
+
+typedef struct SceKernelLwCondWork {
+    pthread_cond_t cond;
+    SceKernelLwMutexWork * mutex;
+} SceKernelLwCondWork;
+typedef struct SceKernelLwCondOptParam SceKernelLwCondOptParam;
+
+static inline int sceKernelCreateLwCond(SceKernelLwCondWork * work,
+                                        const char * name, unsigned attr,
+                                        SceKernelLwMutexWork * mutex,
+                                        const SceKernelLwCondOptParam * opt) {
+    (void)name; (void)attr; (void)opt;
+    work->mutex = mutex;
+    return pthread_cond_init(&work->cond, NULL) == 0 ? 0 : -1;
+}
+
+static inline int sceKernelDeleteLwCond(SceKernelLwCondWork * work) {
+    return pthread_cond_destroy(&work->cond);
+}
+
+// With the mutex held, as on the Vita
+static inline int sceKernelWaitLwCond(SceKernelLwCondWork * work,
+                                      unsigned * timeout) {
+    (void)timeout;
+    return pthread_cond_wait(&work->cond, work->mutex);
+}
+
+static inline int sceKernelSignalLwCondAll(SceKernelLwCondWork * work) {
+    return pthread_cond_broadcast(&work->cond);
+}
+
+static inline int sceKernelDelayThread(unsigned usec) {
+    return usleep(usec);
+}
+
+static inline SceUID sceKernelGetThreadId(void) {
+    return (SceUID)syscall(SYS_gettid);
+}
+
+static inline int sceKernelChangeThreadPriority(SceUID thid, int priority) {
+    (void)thid; (void)priority;
+    return 0;
+}
+
+#endif // SOLOADER_HOST_PSP2_KERNEL_THREADMGR_H
@@ -0,0 +1,44 @@
+/*
+ * scripts/host/include/psp2/touch.h
+ *
+ * The touch panels as reimpl/controls.c reads them; like the pad in
+ * psp2/ctrl.h, only declared.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_HOST_PSP2_TOUCH_H
+#define SOLOADER_HOST_PSP2_TOUCH_H
+
+#include <psp2/types.h>
+
+#define SCE_TOUCH_MAX_REPORT 8
+
+enum {
+    SCE_TOUCH_PORT_FRONT = 0,
+    SCE_TOUCH_PORT_BACK  = 1,
+};
+
+typedef struct SceTouchReport {
+    uint8_t id;
+    uint8_t force;
+    uint16_t x;
+    uint16_t y;
+    uint8_t reserved[8];
+    uint16_t info;
+} SceTouchReport;
+
+typedef struct SceTouchData {
+    uint64_t timeStamp;
+    uint32_t status;
+    uint32_t reportNum;
+    SceTouchReport report[SCE_TOUCH_MAX_REPORT];
+} SceTouchData;
+
+int sceTouchSetSamplingState(SceUInt32 port, SceUInt32 state);
+int sceTouchPeek(SceUInt32 port, SceTouchData * data, SceUInt32 count);
+
+#endif // SOLOADER_HOST_PSP2_TOUCH_H
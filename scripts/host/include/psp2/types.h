@@ -0,0 +1,32 @@
+/*
+ * scripts/host/include/psp2/types.h
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_HOST_PSP2_TYPES_H
+#define SOLOADER_HOST_PSP2_TYPES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int SceUID;
+typedef int SceMode;
+typedef int64_t SceOff;
+typedef unsigned int SceSize;
+typedef uint32_t SceUInt32;
+
+typedef struct SceDateTime {
+    unsigned short year;
+    unsigned short month;
+    unsigned short day;
+    unsigned short hour;
+    unsigned short minute;
+    unsigned short second;
+    unsigned int microsecond;
+} SceDateTime;
+
+#endif // SOLOADER_HOST_PSP2_TYPES_H
@@ -0,0 +1,17 @@
+/*
+ * scripts/host/include/sys/dirent.h
+ *
+ * newlib's name for what glibc has in <dirent.h>.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_HOST_SYS_DIRENT_H
+#define SOLOADER_HOST_SYS_DIRENT_H
+
+#include <dirent.h>
+
+#endif // SOLOADER_HOST_SYS_DIRENT_H
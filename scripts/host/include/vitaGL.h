@@ -0,0 +1,278 @@
+/*
+ * scripts/host/include/vitaGL.h
+ *
+ * The GL types, enums and entry points that the loader's GL code uses.
+ * Nothing implements them here: each check defines the calls it needs as
+ * a mock of vitaGL.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_HOST_VITAGL_H
+#define SOLOADER_HOST_VITAGL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int GLenum;
+typedef unsigned char GLboolean;
+typedef unsigned int GLbitfield;
+typedef void GLvoid;
+typedef signed char GLbyte;
+typedef unsigned char GLubyte;
+typedef short GLshort;
+typedef unsigned short GLushort;
+typedef int GLint;
+typedef unsigned int GLuint;
+typedef int32_t GLfixed;
+typedef int GLsizei;
+typedef float GLfloat;
+typedef float GLclampf;
+typedef char GLchar;
+typedef intptr_t GLintptr;
+typedef intptr_t GLsizeiptr;
+
+#define GL_FALSE                        0
+#define GL_TRUE                         1
+
+// Matrices
+
+#define GL_MATRIX_MODE                  0x0BA0
+#define GL_MODELVIEW_STACK_DEPTH        0x0BA3
+#define GL_PROJECTION_STACK_DEPTH       0x0BA4
+#define GL_MODELVIEW_MATRIX             0x0BA6
+#define GL_PROJECTION_MATRIX            0x0BA7
+#define GL_MODELVIEW                    0x1700
+#define GL_PROJECTION                   0x1701
+#define GL_TEXTURE                      0x1702
+#define GL_LIGHT0                       0x4000
+#define GL_AMBIENT                      0x1200
+#define GL_POSITION                     0x1203
+#define GL_SPOT_DIRECTION               0x1204
+#define GL_CLIP_PLANE0                  0x3000
+#define GL_VIEWPORT                     0x0BA2
+
+void glMatrixMode(GLenum mode);
+void glLoadIdentity(void);
+void glLoadMatrixf(const GLfloat * m);
+void glMultMatrixf(const GLfloat * m);
+void glPushMatrix(void);
+void glPopMatrix(void);
+void glRotatef(GLfloat angle, GLfloat x, GLfloat y, GLfloat z);
+void glTranslatef(GLfloat x, GLfloat y, GLfloat z);
+void glScalef(GLfloat x, GLfloat y, GLfloat z);
+void glFrustumf(GLfloat left, GLfloat right, GLfloat bottom, GLfloat top,
+                GLfloat near, GLfloat far);
+void glOrthox(GLfixed left, GLfixed right, GLfixed bottom, GLfixed top,
+              GLfixed near, GLfixed far);
+void glLightfv(GLenum light, GLenum pname, const GLfloat * params);
+void glClipPlanef(GLenum plane, const GLfloat * equation);
+void glGetFloatv(GLenum pname, GLfloat * data);
+void glGetIntegerv(GLenum pname, GLint * data);
+
+// State
+
+#define GL_TEXTURE_2D                   0x0DE1
+#define GL_TEXTURE_CUBE_MAP             0x8513
+#define GL_TEXTURE0                     0x84C0
+#define GL_ARRAY_BUFFER                 0x8892
+#define GL_ELEMENT_ARRAY_BUFFER         0x8893
+#define GL_ARRAY_BUFFER_BINDING         0x8894
+#define GL_BLEND                        0x0BE2
+#define GL_DEPTH_TEST                   0x0B71
+#define GL_CULL_FACE                    0x0B44
+#define GL_ALPHA_TEST                   0x0BC0
+#define GL_SCISSOR_TEST                 0x0C11
+#define GL_STENCIL_TEST                 0x0B90
+#define GL_POLYGON_OFFSET_FILL          0x8037
+#define GL_FOG                          0x0B60
+#define GL_LIGHTING                     0x0B50
+#define GL_DITHER                       0x0BD0
+#define GL_FRONT                        0x0404
+#define GL_BACK                         0x0405
+#define GL_FRONT_AND_BACK               0x0408
+#define GL_ZERO                         0
+#define GL_ONE                          1
+#define GL_SRC_ALPHA                    0x0302
+#define GL_ONE_MINUS_SRC_ALPHA          0x0303
+#define GL_UNPACK_ALIGNMENT             0x0CF5
+#define GL_PACK_ALIGNMENT               0x0D05
+
+void glActiveTexture(GLenum texture);
+void glBindTexture(GLenum target, GLuint texture);
+void glBindBuffer(GLenum target, GLuint buffer);
+void glUseProgram(GLuint program);
+void glEnable(GLenum cap);
+void glDisable(GLenum cap);
+void glBlendFunc(GLenum sfactor, GLenum dfactor);
+void glDepthMask(GLboolean flag);
+void glCullFace(GLenum mode);
+void glPixelStorei(GLenum pname, GLint param);
+void glDeleteTextures(GLsizei n, const GLuint * textures);
+void glDeleteBuffers(GLsizei n, const GLuint * buffers);
+void glDeleteProgram(GLuint program);
+
+// Textures
+
+#define GL_ALPHA                        0x1906
+#define GL_RGB                          0x1907
+#define GL_RGBA                         0x1908
+#define GL_LUMINANCE                    0x1909
+#define GL_LUMINANCE_ALPHA              0x190A
+#define GL_UNSIGNED_SHORT_4_4_4_4       0x8033
+#define GL_UNSIGNED_SHORT_5_5_5_1       0x8034
+#define GL_UNSIGNED_SHORT_5_6_5         0x8363
+#define GL_TEXTURE_MAG_FILTER           0x2800
+#define GL_TEXTURE_MIN_FILTER           0x2801
+#define GL_TEXTURE_WRAP_S               0x2802
+#define GL_TEXTURE_WRAP_T               0x2803
+#define GL_NEAREST                      0x2600
+#define GL_LINEAR                       0x2601
+#define GL_NEAREST_MIPMAP_LINEAR        0x2702
+#define GL_LINEAR_MIPMAP_LINEAR         0x2703
+#define GL_REPEAT                       0x2901
+#define GL_CLAMP_TO_EDGE                0x812F
+#define GL_MIRRORED_REPEAT              0x8370
+#define GL_FRAMEBUFFER                  0x8D40
+#define GL_FRAMEBUFFER_BINDING          0x8CA6
+#define GL_FRAMEBUFFER_COMPLETE         0x8CD5
+#define GL_FRAMEBUFFER_UNSUPPORTED      0x8CDD
+#define GL_COLOR_ATTACHMENT0            0x8CE0
+
+void glGenTextures(GLsizei n, GLuint * textures);
+void glTexImage2D(GLenum target, GLint level, GLint internalFormat,
+                  GLsizei width, GLsizei height, GLint border, GLenum format,
+                  GLenum type, const GLvoid * data);
+void glCompressedTexImage2D(GLenum target, GLint level,
+                            GLenum internalformat, GLsizei width,
+                            GLsizei height, GLint border, GLsizei imageSize,
+                            const void * data);
+void glTexSubImage2D(GLenum target, GLint level, GLint xoffset,
+                     GLint yoffset, GLsizei width, GLsizei height,
+                     GLenum format, GLenum type, const GLvoid * pixels);
+void glCopyTexSubImage2D(GLenum target, GLint level, GLint xoffset,
+                         GLint yoffset, GLint x, GLint y, GLsizei width,
+                         GLsizei height);
+void glTexParameteri(GLenum target, GLenum pname, GLint param);
+void glTexParameterf(GLenum target, GLenum pname, GLfloat param);
+void glTexParameterx(GLenum target, GLenum pname, GLfixed param);
+void glGenerateMipmap(GLenum target);
+void glGenFramebuffers(GLsizei n, GLuint * framebuffers);
+void glDeleteFramebuffers(GLsizei n, const GLuint * framebuffers);
+void glBindFramebuffer(GLenum target, GLuint framebuffer);
+void glFramebufferTexture2D(GLenum target, GLenum attachment,
+                            GLenum textarget, GLuint texture, GLint level);
+GLenum glCheckFramebufferStatus(GLenum target);
+
+// Vertex arrays
+
+#define GL_BYTE                         0x1400
+#define GL_UNSIGNED_BYTE                0x1401
+#define GL_SHORT                        0x1402
+#define GL_UNSIGNED_SHORT               0x1403
+#define GL_UNSIGNED_INT                 0x1405
+#define GL_FLOAT                        0x1406
+#define GL_HALF_FLOAT                   0x140B
+#define GL_VERTEX_ARRAY                 0x8074
+#define GL_NORMAL_ARRAY                 0x8075
+#define GL_COLOR_ARRAY                  0x8076
+#define GL_TEXTURE_COORD_ARRAY          0x8078
+#define GL_STATIC_DRAW                  0x88E4
+#define GL_TRIANGLES                    0x0004
+
+void glGenBuffers(GLsizei n, GLuint * buffers);
+void glBufferData(GLenum target, GLsizeiptr size, const void * data,
+                  GLenum usage);
+void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size,
+                     const void * data);
+void glVertexPointer(GLint size, GLenum type, GLsizei stride,
+                     const void * pointer);
+void glNormalPointer(GLenum type, GLsizei stride, const void * pointer);
+void glColorPointer(GLint size, GLenum type, GLsizei stride,
+                    const void * pointer);
+void glTexCoordPointer(GLint size, GLenum type, GLsizei stride,
+                       const void * pointer);
+void glVertexAttribPointer(GLuint index, GLint size, GLenum type,
+                           GLboolean normalized, GLsizei stride,
+                           const void * pointer);
+void glClientActiveTexture(GLenum texture);
+void glEnableClientState(GLenum array);
+void glDisableClientState(GLenum array);
+void glEnableVertexAttribArray(GLuint index);
+void glDisableVertexAttribArray(GLuint index);
+
+// Programs
+
+#define GL_FLOAT_VEC4                   0x8B52
+#define GL_FLOAT_MAT4                   0x8B5C
+#define GL_SAMPLER_2D                   0x8B5E
+#define GL_LINK_STATUS                  0x8B82
+#define GL_ACTIVE_UNIFORMS              0x8B86
+#define GL_ACTIVE_ATTRIBUTES            0x8B89
+
+void glLinkProgram(GLuint program);
+void glGetProgramiv(GLuint program, GLenum pname, GLint * params);
+void glGetActiveUniform(GLuint program, GLuint index, GLsizei bufSize,
+                        GLsizei * length, GLint * size, GLenum * type,
+                        GLchar * name);
+void glGetActiveAttrib(GLuint program, GLuint index, GLsizei bufSize,
+                       GLsizei * length, GLint * size, GLenum * type,
+                       GLchar * name);
+GLint glGetUniformLocation(GLuint program, const GLchar * name);
+GLint glGetAttribLocation(GLuint program, const GLchar * name);
+
+// Shaders
+
+#define GL_SHADER_TYPE                  0x8B4F
+#define GL_COMPILE_STATUS               0x8B81
+#define GL_FRAGMENT_SHADER              0x8B30
+#define GL_VERTEX_SHADER                0x8B31
+
+GLuint glCreateShader(GLenum type);
+void glDeleteShader(GLuint shader);
+void glShaderSource(GLuint shader, GLsizei count,
+                    const GLchar * const * string, const GLint * length);
+void glCompileShader(GLuint shader);
+void glGetShaderiv(GLuint shader, GLenum pname, GLint * params);
+void glShaderBinary(GLsizei count, const GLuint * handles,
+                    GLenum binaryFormat, const void * binary, GLsizei length);
+void vglGetShaderBinary(GLuint handle, GLsizei bufSize, GLsizei * length,
+                        void * binary);
+
+// Context
+
+typedef unsigned int EGLBoolean;
+typedef int32_t EGLint;
+typedef void * EGLDisplay;
+typedef void * EGLConfig;
+typedef void * EGLContext;
+typedef void * EGLSurface;
+
+#define EGL_FALSE                       0
+#define EGL_TRUE                        1
+
+typedef enum SceGxmMultisampleMode {
+    SCE_GXM_MULTISAMPLE_NONE,
+    SCE_GXM_MULTISAMPLE_2X,
+    SCE_GXM_MULTISAMPLE_4X
+} SceGxmMultisampleMode;
+
+typedef enum vglSemanticType {
+    VGL_TYPE_TEXCOORD,
+    VGL_TYPE_COLOR,
+    VGL_TYPE_FOG,
+    VGL_TYPE_CLIP
+} vglSemanticType;
+
+GLboolean vglInitExtended(int legacy_pool_size, int width, int height,
+                          int ram_threshold, SceGxmMultisampleMode msaa);
+void vglAddSemanticBinding(const char * varying, int index,
+                           vglSemanticType type);
+void vglSwapBuffers(GLboolean has_commondialog);
+void * vglMalloc(uint32_t size);
+void vglFree(void * addr);
+
+#endif // SOLOADER_HOST_VITAGL_H
@@ -0,0 +1,18 @@
+/*
+ * scripts/host/include/vitasdk.h
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#ifndef SOLOADER_HOST_VITASDK_H
+#define SOLOADER_HOST_VITASDK_H
+
+#include <psp2/io/fcntl.h>
+#include <psp2/io/stat.h>
+#include <psp2/kernel/clib.h>
+#include <psp2/kernel/sysmem.h>
+
+#endif // SOLOADER_HOST_VITASDK_H
@@ -0,0 +1,65 @@
+/*
+ * scripts/host/sdk.c
+ *
+ * SDK functions that the loader declares itself instead of getting them
+ * from a header, and the ones that need state of their own, so that the
+ * files using them link on the host.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include <psp2/kernel/sysmem.h>
+#include <psp2/types.h>
+
+#define MEMBLOCKS 64
+
+static struct {
+    void * base;
+    size_t size;
+} s_blocks[MEMBLOCKS];
+
+// No modules are loaded on the host
+SceUID _vshKernelSearchModuleByName(const char * name, int * unk) {
+    (void)name; (void)unk;
+    return -1;
+}
+
+SceUID sceKernelAllocMemBlock(const char * name, SceKernelMemBlockType type,
+                              SceSize size, SceKernelAllocMemBlockOpt * opt) {
+    (void)name; (void)type; (void)opt;
+    for (SceUID uid = 1; uid < MEMBLOCKS; uid++) {
+        if (s_blocks[uid].base)
+            continue;
+
+        // Below 4 GB, the loader keeps block addresses in 32 bits
+        void * base = mmap((void *)0x20000000, size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+        if (base == MAP_FAILED)
+            return (SceUID)0x80020000;  // out of memory
+        s_blocks[uid].base = base;
+        s_blocks[uid].size = size;
+        return uid;
+    }
+    return (SceUID)0x80020000;
+}
+
+int sceKernelFreeMemBlock(SceUID uid) {
+    if (uid <= 0 || uid >= MEMBLOCKS || !s_blocks[uid].base)
+        return -1;
+    munmap(s_blocks[uid].base, s_blocks[uid].size);
+    s_blocks[uid].base = NULL;
+    return 0;
+}
+
+int sceKernelGetMemBlockBase(SceUID uid, void ** base) {
+    if (uid <= 0 || uid >= MEMBLOCKS || !s_blocks[uid].base)
+        return -1;
+    *base = s_blocks[uid].base;
+    return 0;
+}
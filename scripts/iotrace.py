@@ -0,0 +1,237 @@
+#!/usr/bin/env python3
+#
+# Reads I/O traces recorded by loader/reimpl/iotrace.c (build the loader with
+# -DIOTRACE=1, the trace ends up in DATA_PATH/iotrace.bin).
+#
+#   iotrace.py trace.bin                     per-file summary
+#   iotrace.py trace.bin --from 12 --to 20   only what started in that window
+#                                            (seconds since the first record)
+#   iotrace.py trace.bin --timeline          every operation, in order
+#
+# Record layout is documented at the top of iotrace.c.
+
+import argparse
+import struct
+
+OP_DROPPED = 0
+OP_OPEN = 1
+OP_READ = 2
+OP_WRITE = 3
+OP_SEEK = 4
+OP_CLOSE = 5
+OP_STAT = 6
+
+OP_NAMES = {
+    OP_DROPPED: "dropped", OP_OPEN: "open", OP_READ: "read",
+    OP_WRITE: "write", OP_SEEK: "seek", OP_CLOSE: "close", OP_STAT: "stat",
+}
+
+RECORD_FMT = "<BxHIIIQqIiIxxxx"
+
+
+class Record:
+    __slots__ = ("op", "thread", "path_id", "handle", "start", "offset",
+                 "size", "result", "duration", "path")
+
+
+class FileStats:
+    def __init__(self, path):
+        self.path = path
+        self.opens = 0
+        self.failed_opens = 0
+        self.stats = 0
+        self.reads = 0
+        self.bytes = 0
+        self.sequential = 0
+        self.forward = 0
+        self.backward = 0
+        self.seeks = 0
+        self.us = 0
+        self.first = None
+        self.last = None
+        self.ranges = []  # (start, end) of every read
+
+    def touch(self, rec):
+        end = rec.start + rec.duration
+        self.first = rec.start if self.first is None else min(self.first, rec.start)
+        self.last = end if self.last is None else max(self.last, end)
+        self.us += rec.duration
+
+    def unique_bytes(self):
+        total = 0
+        cur_start = cur_end = None
+        for start, end in sorted(self.ranges):
+            if cur_end is None or start > cur_end:
+                if cur_end is not None:
+                    total += cur_end - cur_start
+                cur_start, cur_end = start, end
+            else:
+                cur_end = max(cur_end, end)
+        if cur_end is not None:
+            total += cur_end - cur_start
+        return total
+
+
+def read_trace(path):
+    with open(path, "rb") as f:
+        buf = f.read()
+
+    magic, version, rec_size = struct.unpack_from("<4sII", buf, 0)
+    if magic != b"IOTR" or version != 1 or rec_size != struct.calcsize(RECORD_FMT):
+        raise SystemExit("%s: not a version 1 I/O trace" % path)
+
+    off = 12
+    records = []
+    while off + rec_size <= len(buf):
+        fields = struct.unpack_from(RECORD_FMT, buf, off)
+        rec = Record()
+        (rec.op, path_len, rec.thread, rec.path_id, rec.handle, rec.start,
+         rec.offset, rec.size, rec.result, rec.duration) = fields
+        off += rec_size
+        rec.path = None
+        if path_len:
+            rec.path = buf[off:off + path_len].decode(errors="replace")
+            off += (path_len + 3) & ~3
+        if rec.op not in OP_NAMES:
+            raise SystemExit("%s: bad record %d at %d" % (path, rec.op, off))
+        records.append(rec)
+    return records
+
+
+def analyze(records, t_from, t_to):
+    files = {}
+    handles = {}        # handle -> path of what it has open
+    last_end = {}       # handle -> where its previous read stopped
+    dropped = 0
+
+    def stats_for(path):
+        if path not in files:
+            files[path] = FileStats(path)
+        return files[path]
+
+    base = next((r.start for r in records if r.op != OP_DROPPED), 0)
+    for rec in records:
+        if rec.op == OP_DROPPED:
+            dropped += rec.size
+            continue
+
+        # Handles are followed over the whole trace, even outside the window
+        path = rec.path if rec.path is not None else handles.get(rec.handle)
+        if rec.op == OP_OPEN and rec.handle:
+            handles[rec.handle] = rec.path
+            last_end[rec.handle] = 0
+        elif rec.op == OP_CLOSE:
+            handles.pop(rec.handle, None)
+            last_end.pop(rec.handle, None)
+
+        t = (rec.start - base) / 1e6
+        inside = t >= t_from and (t_to is None or t < t_to)
+        if path is None:
+            path = "<handle 0x%x>" % rec.handle
+
+        if rec.op == OP_READ:
+            prev = last_end.get(rec.handle)
+            got = max(rec.result, 0)
+            if rec.offset >= 0:
+                last_end[rec.handle] = rec.offset + got
+        if not inside:
+            continue
+
+        s = stats_for(path)
+        s.touch(rec)
+        if rec.op == OP_OPEN:
+            s.opens += 1
+            if not rec.handle:
+                s.failed_opens += 1
+        elif rec.op == OP_STAT:
+            s.stats += 1
+        elif rec.op == OP_SEEK:
+            s.seeks += 1
+        elif rec.op == OP_READ:
+            s.reads += 1
+            s.bytes += got
+            if rec.offset >= 0:
+                s.ranges.append((rec.offset, rec.offset + got))
+                if prev is None or rec.offset == prev:
+                    s.sequential += 1
+                elif rec.offset > prev:
+                    s.forward += 1
+                else:
+                    s.backward += 1
+
+    return files, dropped
+
+
+def print_summary(files, dropped, top):
+    loaded = [f for f in files.values() if f.reads]
+    loaded.sort(key=lambda f: f.us, reverse=True)
+
+    total_us = sum(f.us for f in files.values())
+    total_bytes = sum(f.bytes for f in loaded)
+    redundant = sum(f.bytes - f.unique_bytes() for f in loaded)
+    print("%d files read, %.1f KiB, %.1f ms in I/O calls, %.1f KiB read more "
+          "than once" % (len(loaded), total_bytes / 1024, total_us / 1000,
+                         redundant / 1024))
+    if dropped:
+        print("warning: %d records were dropped while recording" % dropped)
+
+    print()
+    print("   ms  span ms  opens  reads  avg B    KiB  reread KiB  "
+          "seq  fwd  back  seeks  path")
+    for f in loaded[:top]:
+        span = (f.last - f.first) / 1000
+        reread = (f.bytes - f.unique_bytes()) / 1024
+        print("%5.1f  %7.1f  %5d  %5d  %5d  %5.0f  %10.1f  %3d  %3d  %4d  %5d  %s" % (
+            f.us / 1000, span, f.opens, f.reads, f.bytes // max(f.reads, 1),
+            f.bytes / 1024, reread, f.sequential, f.forward, f.backward,
+            f.seeks, f.path))
+
+    missing = [f for f in files.values() if f.failed_opens]
+    if missing:
+        missing.sort(key=lambda f: f.failed_opens, reverse=True)
+        print()
+        print("failed opens  ms  path")
+        for f in missing[:top]:
+            print("%12d  %4.1f  %s" % (f.failed_opens, f.us / 1000, f.path))
+
+
+def print_timeline(records, t_from, t_to):
+    handles = {}
+    base = next((r.start for r in records if r.op != OP_DROPPED), 0)
+    for rec in records:
+        if rec.op == OP_OPEN and rec.handle:
+            handles[rec.handle] = rec.path
+        path = rec.path if rec.path is not None else handles.get(rec.handle, "")
+        if rec.op == OP_CLOSE:
+            handles.pop(rec.handle, None)
+
+        t = (rec.start - base) / 1e6
+        if t < t_from or (t_to is not None and t >= t_to):
+            continue
+
+        print("%10.6f  %08x  %-7s  %8d us  off %10d  size %8d  -> %10d  %s" % (
+            t, rec.thread, OP_NAMES[rec.op], rec.duration, rec.offset,
+            rec.size, rec.result, path))
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("trace")
+    parser.add_argument("--from", dest="t_from", type=float, default=0.0,
+                        help="seconds since the first record")
+    parser.add_argument("--to", dest="t_to", type=float, default=None)
+    parser.add_argument("--top", type=int, default=40)
+    parser.add_argument("--timeline", action="store_true")
+    args = parser.parse_args()
+
+    records = read_trace(args.trace)
+    if args.timeline:
+        print_timeline(records, args.t_from, args.t_to)
+        return
+
+    files, dropped = analyze(records, args.t_from, args.t_to)
+    print_summary(files, dropped, args.top)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,467 @@
+/*
+ * scripts/leveltrace_check.c
+ *
+ * Checks loader/utils/leveltrace.c, the bookkeeping behind the level
+ * prefetcher:
+ *
+ * - sets of random traces survive a save and a load unchanged, and save
+ *   back to the same bytes; truncated, padded and damaged data is
+ *   rejected and leaves the set empty;
+ * - a merge keeps the order of the latest run, with blocks it didn't read
+ *   following the block they used to follow;
+ * - a block that goes unread is kept for two more runs and dropped on the
+ *   third, unless it's read again;
+ * - the schedule hands out up to four blocks that follow each other in the
+ *   same file at once, never more than 256 outstanding, and writes off
+ *   what the game is well past.
+ *
+ * Built by the host project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/leveltrace_check [rounds]
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/leveltrace.h"
+
+#define B           LEVELTRACE_BLOCK_SIZE
+#define NAMES       40
+
+static uint32_t s_rng = 1;
+
+static uint32_t rnd(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static int s_failed;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+    } \
+} while (0)
+
+static char s_names[NAMES][64];
+
+// The game read block `index` of `path`
+static void read_block(leveltrace * t, const char * path, uint32_t index) {
+    int file = leveltrace_file_add(t, path);
+    leveltrace_record(t, (uint16_t)file, (int64_t)index * B, 1);
+}
+
+static leveltrace * random_trace(uint32_t key) {
+    leveltrace * t = leveltrace_new(key);
+    uint32_t reads = rnd() % 200;
+    for (uint32_t i = 0; i < reads && !leveltrace_full(t); i++) {
+        int file = leveltrace_file_add(t, s_names[rnd() % NAMES]);
+        int64_t offset = (int64_t)(rnd() % 4000) * 1000;
+        leveltrace_record(t, (uint16_t)file, offset, rnd() % (3 * B) + 1);
+    }
+    for (uint32_t i = 0; i < t->block_count; i++)
+        t->blocks[i].misses = (uint8_t)(rnd() % LEVELTRACE_MAX_MISSES);
+    return t;
+}
+
+static bool same(const leveltrace * a, const leveltrace * b) {
+    if (a->key != b->key || a->last_run != b->last_run
+        || a->file_count != b->file_count || a->block_count != b->block_count)
+        return false;
+    for (uint32_t f = 0; f < a->file_count; f++) {
+        if (strcmp(a->files[f], b->files[f]) != 0)
+            return false;
+    }
+    for (uint32_t i = 0; i < a->block_count; i++) {
+        const leveltrace_block * x = &a->blocks[i];
+        const leveltrace_block * y = &b->blocks[i];
+        if (x->file != y->file || x->index != y->index
+            || x->misses != y->misses
+            || leveltrace_find(b, y->file, y->index) != (int)i)
+            return false;
+    }
+    return true;
+}
+
+static void check_round_trip(int rounds) {
+    leveltrace_set set = { 0 }, loaded = { 0 };
+    size_t bytes = 0;
+
+    for (int round = 0; round < rounds; round++) {
+        uint32_t levels = rnd() % (LEVELTRACE_MAX_LEVELS + 1);
+        for (uint32_t i = 0; i < levels; i++)
+            leveltrace_set_put(&set, random_trace(rnd() % 100 + 1));
+
+        size_t len;
+        uint8_t * data = leveltrace_set_save(&set, &len);
+        CHECK(data && leveltrace_set_load(&loaded, data, len), "round %d: "
+              "%zu bytes not loaded", round, len);
+        CHECK(loaded.count == set.count && loaded.runs == set.runs,
+              "round %d: %u of %u levels, run %u of %u", round, loaded.count,
+              set.count, loaded.runs, set.runs);
+        for (uint32_t i = 0; i < set.count; i++) {
+            const leveltrace * t = set.traces[i];
+            const leveltrace * u = leveltrace_set_get(&loaded, t->key);
+            CHECK(u && same(t, u), "round %d: level %08x differs", round,
+                  t->key);
+        }
+
+        size_t again_len;
+        uint8_t * again = leveltrace_set_save(&loaded, &again_len);
+        CHECK(again && again_len == len && !memcmp(again, data, len),
+              "round %d: saved back differently", round);
+
+        // Cut short or with anything after it, it's not what was saved
+        for (size_t cut = 0; cut < len; cut += rnd() % (len / 16) + 1) {
+            CHECK(!leveltrace_set_load(&loaded, data, cut)
+                  && loaded.count == 0, "round %d: loaded %zu of %zu bytes",
+                  round, cut, len);
+        }
+        uint8_t * longer = malloc(len + 1);
+        memcpy(longer, data, len);
+        longer[len] = 0;
+        CHECK(!leveltrace_set_load(&loaded, longer, len + 1)
+              && loaded.count == 0, "round %d: loaded with a byte more",
+              round);
+
+        bytes += len;
+        free(longer);
+        free(again);
+        free(data);
+        leveltrace_set_clear(&set);
+    }
+    leveltrace_set_clear(&loaded);
+    printf("   %d sets saved and loaded, %zu bytes\n", rounds, bytes);
+}
+
+static void check_damage(void) {
+    // Two levels of one file "x" with two blocks each; the first trace is
+    // at 16, its blocks at 31 and 39, and the second trace at 47
+    leveltrace_set set = { 0 };
+    for (uint32_t key = 1; key <= 2; key++) {
+        leveltrace * t = leveltrace_new(key);
+        read_block(t, "x", 5);
+        read_block(t, "x", 9);
+        leveltrace_set_put(&set, t);
+    }
+    size_t len;
+    uint8_t * data = leveltrace_set_save(&set, &len);
+    CHECK(len == 78, "%zu bytes saved, the offsets below are off", len);
+
+    static const struct { const char * what; size_t at; uint8_t value; }
+    damage[] = {
+        { "magic", 0, 'X' },
+        { "version", 4, 2 },
+        { "too many levels", 12, LEVELTRACE_MAX_LEVELS + 1 },
+        { "file count", 24, 0 },
+        { "empty path", 28, 0 },
+        { "block of a missing file", 31, 1 },
+        { "block twice", 43, 5 },
+        { "key twice", 47, 1 },
+    };
+
+    uint8_t * bad = malloc(len);
+    for (size_t i = 0; i < sizeof(damage) / sizeof(damage[0]); i++) {
+        memcpy(bad, data, len);
+        bad[damage[i].at] = damage[i].value;
+        CHECK(leveltrace_set_load(&set, data, len) && set.count == 2,
+              "%s: undamaged data not loaded", damage[i].what);
+        CHECK(!leveltrace_set_load(&set, bad, len) && set.count == 0,
+              "%s: loaded", damage[i].what);
+    }
+    free(bad);
+    free(data);
+
+    // The least recently run level makes room for a new one
+    for (uint32_t key = 1; key <= LEVELTRACE_MAX_LEVELS + 1; key++) {
+        leveltrace_set_put(&set, leveltrace_new(key));
+        if (key == 1)
+            leveltrace_set_put(&set, leveltrace_new(2));
+        if (key == 2)
+            leveltrace_set_put(&set, leveltrace_new(1));
+    }
+    CHECK(set.count == LEVELTRACE_MAX_LEVELS
+          && leveltrace_set_get(&set, 1) && !leveltrace_set_get(&set, 2)
+          && leveltrace_set_get(&set, LEVELTRACE_MAX_LEVELS + 1),
+          "wrong level evicted");
+    leveltrace_set_clear(&set);
+}
+
+// `t` is made of `count` blocks "path:index/misses", in this order
+static bool trace_is(const leveltrace * t, const char * const * blocks,
+                     uint32_t count) {
+    if (t->block_count != count)
+        return false;
+    for (uint32_t i = 0; i < count; i++) {
+        char name[80];
+        const leveltrace_block * b = &t->blocks[i];
+        snprintf(name, sizeof(name), "%s:%u/%u", t->files[b->file],
+                 b->index, b->misses);
+        if (strcmp(name, blocks[i]) != 0)
+            return false;
+    }
+    return true;
+}
+
+static void check_merge(int rounds) {
+    // a:0 a:1 a:2 b:0, then the game reads b:0 a:1 c:7
+    leveltrace * old = leveltrace_new(7);
+    read_block(old, "a", 0);
+    read_block(old, "a", 1);
+    read_block(old, "a", 2);
+    read_block(old, "b", 0);
+    leveltrace * run = leveltrace_new(7);
+    read_block(run, "b", 0);
+    read_block(run, "a", 1);
+    read_block(run, "c", 7);
+
+    static const char * const merged[] = {
+        "a:0/1", "b:0/0", "a:1/0", "a:2/1", "c:7/0",
+    };
+    leveltrace * t = leveltrace_merge(old, run);
+    CHECK(t && t->key == 7 && trace_is(t, merged, 5), "latest order lost");
+    leveltrace_free(t);
+    t = leveltrace_merge(NULL, run);
+    CHECK(t && same(t, run), "first run not taken as it is");
+    leveltrace_free(t);
+    leveltrace_free(old);
+    leveltrace_free(run);
+
+    // Any two traces: the run comes out in its order, and every block it
+    // didn't read that's kept comes after the block it was behind before
+    uint32_t kept = 0;
+    for (int round = 0; round < rounds; round++) {
+        old = random_trace(1);
+        run = random_trace(1);
+        t = leveltrace_merge(old, run);
+
+        int last_run = -1; // position in `run` of the last block of it seen
+        uint32_t run_seen = 0, old_only = 0;
+        for (uint32_t i = 0; t && i < t->block_count; i++) {
+            const leveltrace_block * b = &t->blocks[i];
+            const char * path = t->files[b->file];
+            int file = leveltrace_file(run, path);
+            int pos = file >= 0 ? leveltrace_find(run, file, b->index) : -1;
+            if (pos >= 0) {
+                CHECK(pos == last_run + 1 && b->misses == 0, "round %d: "
+                      "run block %d at %u", round, pos, i);
+                last_run = pos;
+                run_seen++;
+                continue;
+            }
+
+            // The closest block before it in `old` that the run read too
+            int at = leveltrace_find(old, leveltrace_file(old, path),
+                                     b->index);
+            int anchor = -1;
+            for (int k = at - 1; k >= 0 && anchor < 0; k--) {
+                const leveltrace_block * o = &old->blocks[k];
+                int f = leveltrace_file(run, old->files[o->file]);
+                anchor = f >= 0 ? leveltrace_find(run, f, o->index) : -1;
+            }
+            CHECK(at >= 0 && anchor == last_run
+                  && b->misses == old->blocks[at].misses + 1
+                  && b->misses < LEVELTRACE_MAX_MISSES, "round %d: old "
+                  "block %d at %u, after %d instead of %d", round, at, i,
+                  last_run, anchor);
+            old_only++;
+        }
+        CHECK(t && run_seen == run->block_count, "round %d: %u of %u run "
+              "blocks", round, run_seen, run->block_count);
+
+        // Nothing young enough is dropped while there's room
+        uint32_t young = 0;
+        for (uint32_t i = 0; i < old->block_count; i++) {
+            const leveltrace_block * o = &old->blocks[i];
+            int f = leveltrace_file(run, old->files[o->file]);
+            if ((f < 0 || leveltrace_find(run, f, o->index) < 0)
+                && o->misses + 1 < LEVELTRACE_MAX_MISSES)
+                young++;
+        }
+        uint32_t room = LEVELTRACE_MAX_BLOCKS - run->block_count;
+        CHECK(old_only == (young < room ? young : room), "round %d: %u old "
+              "blocks kept, %u young", round, old_only, young);
+
+        kept += old_only;
+        leveltrace_free(t);
+        leveltrace_free(old);
+        leveltrace_free(run);
+    }
+    printf("   %d random merges, %u old blocks kept\n", rounds, kept);
+}
+
+static void check_aging(void) {
+    leveltrace * t = leveltrace_new(1);
+    read_block(t, "a", 0);
+    read_block(t, "a", 1);
+    read_block(t, "a", 2);
+    leveltrace * run = leveltrace_new(1);
+    read_block(run, "a", 0);
+    read_block(run, "a", 2);
+
+    static const char * const aged[][3] = {
+        { "a:0/0", "a:1/1", "a:2/0" },
+        { "a:0/0", "a:1/2", "a:2/0" },
+        { "a:0/0", "a:2/0" },
+    };
+    for (int r = 0; r < 3; r++) {
+        leveltrace * merged = leveltrace_merge(t, run);
+        leveltrace_free(t);
+        t = merged;
+        CHECK(trace_is(t, aged[r], r < 2 ? 3 : 2), "run %d without a:1",
+              r + 1);
+
+        // Read again on the last chance, it starts over
+        if (r == 1) {
+            leveltrace * back = leveltrace_new(1);
+            read_block(back, "a", 0);
+            read_block(back, "a", 1);
+            leveltrace * again = leveltrace_merge(t, back);
+            static const char * const fresh[] = { "a:0/0", "a:1/0", "a:2/1" };
+            CHECK(trace_is(again, fresh, 3), "read again, still aging");
+            leveltrace_free(again);
+            leveltrace_free(back);
+        }
+    }
+    leveltrace_free(t);
+
+    // A full run leaves no room for the old blocks
+    t = leveltrace_new(1);
+    read_block(t, "old", 0);
+    for (uint32_t i = 0; i < LEVELTRACE_MAX_BLOCKS; i++)
+        read_block(run, "a", 100 + i);
+    CHECK(leveltrace_full(run), "run not full");
+    leveltrace * merged = leveltrace_merge(t, run);
+    CHECK(merged->block_count == LEVELTRACE_MAX_BLOCKS
+          && leveltrace_file(merged, "old") < 0, "old block over the limit");
+    leveltrace_free(merged);
+    leveltrace_free(t);
+    leveltrace_free(run);
+}
+
+// The next run is `count` blocks from `index` of file `path`
+static bool next_is(leveltrace_sched * s, const char * path, uint32_t index,
+                    uint32_t count) {
+    leveltrace_run run;
+    return leveltrace_sched_next(s, &run) == LEVELTRACE_RUN
+           && strcmp(s->trace->files[run.file], path) == 0
+           && run.index == index && run.count == count;
+}
+
+static void check_runs(void) {
+    // a:10-15 b:16 a:17 a:19-29
+    leveltrace * t = leveltrace_new(1);
+    for (uint32_t i = 10; i <= 15; i++)
+        read_block(t, "a", i);
+    read_block(t, "b", 16);
+    read_block(t, "a", 17);
+    for (uint32_t i = 19; i <= 29; i++)
+        read_block(t, "a", i);
+
+    leveltrace_sched s;
+    leveltrace_run run;
+    leveltrace_sched_start(&s, t, 1000);
+    CHECK(next_is(&s, "a", 10, 4), "a:10");
+    CHECK(next_is(&s, "a", 14, 2), "a:14");
+    CHECK(next_is(&s, "b", 16, 1), "b:16");
+    CHECK(next_is(&s, "a", 17, 1), "a:17");
+    CHECK(next_is(&s, "a", 19, 4), "a:19");
+    CHECK(next_is(&s, "a", 23, 4), "a:23");
+    CHECK(next_is(&s, "a", 27, 3), "a:27");
+    CHECK(leveltrace_sched_next(&s, &run) == LEVELTRACE_DONE, "not done");
+    CHECK(s.outstanding == 19, "%u outstanding", s.outstanding);
+
+    // What the game already read splits a run, and isn't fetched
+    uint16_t a = (uint16_t)leveltrace_file(t, "a");
+    leveltrace_sched_start(&s, t, 1000);
+    leveltrace_sched_read(&s, a, 12 * B + 100, 10);
+    CHECK(next_is(&s, "a", 10, 2), "a:10 before a read a:12");
+    CHECK(next_is(&s, "a", 13, 3), "a:13 after a read a:12");
+
+    // Nor more than asked for at once
+    leveltrace_sched_start(&s, t, 3);
+    CHECK(next_is(&s, "a", 10, 3), "a:10, 3 at most");
+    CHECK(leveltrace_sched_next(&s, &run) == LEVELTRACE_WAIT, "not waiting");
+    leveltrace_sched_read(&s, a, 10 * B, 2 * B);
+    CHECK(next_is(&s, "a", 13, 2), "a:13, after two were read");
+    leveltrace_free(t);
+}
+
+static void check_window(void) {
+    leveltrace * t = leveltrace_new(1);
+    for (uint32_t i = 0; i < LEVELTRACE_MAX_BLOCKS; i++)
+        read_block(t, "a", 2 * i); // a gap after each, one block per run
+
+    // However big the cache, no more than LEVELTRACE_AHEAD go out
+    leveltrace_sched s;
+    leveltrace_run run;
+    leveltrace_sched_start(&s, t, 100000);
+    uint32_t sent = 0;
+    while (leveltrace_sched_next(&s, &run) == LEVELTRACE_RUN)
+        sent += run.count;
+    CHECK(sent == LEVELTRACE_AHEAD && s.outstanding == LEVELTRACE_AHEAD,
+          "%u blocks out at once", sent);
+
+    // Each one read lets another one out
+    leveltrace_sched_read(&s, 0, 0, 1);
+    CHECK(next_is(&s, "a", 2 * LEVELTRACE_AHEAD, 1), "no block after a "
+          "read");
+    CHECK(leveltrace_sched_next(&s, &run) == LEVELTRACE_WAIT, "more out "
+          "after a read");
+
+    // Far behind what the game reads, the rest is written off
+    uint32_t at = 200;
+    leveltrace_sched_read(&s, 0, (int64_t)2 * at * B, 1);
+    uint32_t done = at + 1 - LEVELTRACE_BEHIND + 1;
+    CHECK(s.outstanding == LEVELTRACE_AHEAD + 1 - done, "%u outstanding "
+          "after a read at %u", s.outstanding, at);
+
+    // Blocks read before they went out aren't fetched at all
+    leveltrace_sched_start(&s, t, 100000);
+    leveltrace_sched_read(&s, 0, 0, 10 * B);
+    CHECK(next_is(&s, "a", 10, 1), "fetched blocks already read");
+
+    // A smaller cache keeps fewer out
+    leveltrace_sched_start(&s, t, 8);
+    sent = 0;
+    while (leveltrace_sched_next(&s, &run) == LEVELTRACE_RUN)
+        sent += run.count;
+    CHECK(sent == 8, "%u blocks out with room for 8", sent);
+
+    leveltrace_sched_start(&s, NULL, 8);
+    CHECK(leveltrace_sched_next(&s, &run) == LEVELTRACE_DONE, "no trace");
+    leveltrace_free(t);
+}
+
+int main(int argc, char ** argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 200;
+    for (int i = 0; i < NAMES; i++)
+        snprintf(s_names[i], sizeof(s_names[i]), "ux0:data/gloft/%02d/%s.bin",
+                 i, i % 3 ? "pack" : "level");
+
+    check_round_trip(rounds);
+    check_damage();
+    check_merge(rounds * 10);
+    check_aging();
+    check_runs();
+    check_window();
+
+    if (s_failed)
+        return 1;
+    printf("ok: traces saved, loaded, merged, aged and scheduled\n");
+    return 0;
+}
@@ -0,0 +1,422 @@
+/*
+ * scripts/mounts_check.c
+ *
+ * Checks loader/utils/mounts.c: a table of normalization and prefix
+ * boundary cases with the mappings init.c sets up, then random paths made
+ * of the segments that trip those up, translated twice (the second time
+ * from the cache) and compared with a plain version that keeps segments on
+ * a stack and tries every mount, and pairs of paths whose hashes, the
+ * cache's key, collide. The random paths are then done from several
+ * threads at once, with more distinct paths than the cache has slots. The
+ * time per cached translation is printed. Built by the host project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/mounts_check [random paths]
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "utils/mounts.h"
+
+#define DATA        "ux0:data/backstab/"
+#define FILES       DATA "com.gameloft.android.ANMP.GloftSDHM/files/"
+#define OBB         "uma0:obb"  // without a trailing slash
+#define PATH_MAX_   1024        // MOUNTS_PATH_MAX in mounts.c
+#define THREADS     4
+
+static uint32_t s_rng = 1;
+
+static uint32_t rnd_r(uint32_t * state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static uint32_t rnd(void) {
+    return rnd_r(&s_rng);
+}
+
+static int s_failed;
+static pthread_mutex_t s_fail_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        pthread_mutex_lock(&s_fail_lock); \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+        pthread_mutex_unlock(&s_fail_lock); \
+    } \
+} while (0)
+
+/*
+ * The plain version
+ */
+
+typedef struct ref_mount {
+    const char * prefix;
+    const char * root;
+} ref_mount;
+
+static ref_mount s_ref[8];
+static int s_ref_count;
+
+// Normalized `path`, false if it's too long for mounts.c to take
+static bool ref_normalize(const char * path, char * out) {
+    const char * segs[PATH_MAX_];
+    size_t lens[PATH_MAX_];
+    int count = 0;
+
+    const char * colon = strchr(path, ':');
+    const char * slash = strchr(path, '/');
+    size_t n = 0;
+    if (colon && (!slash || colon < slash)) {
+        n = colon - path + 1 + (colon[1] == '/');
+        memcpy(out, path, n);
+    } else {
+        out[n++] = '/';
+    }
+
+    for (const char * p = path + (out[0] == '/' ? 0 : n); *p; ) {
+        const char * seg = p;
+        while (*p && *p != '/')
+            p++;
+        size_t len = p - seg;
+        if (*p)
+            p++;
+
+        if (len == 0 || (len == 1 && seg[0] == '.'))
+            continue;
+        if (len == 2 && seg[0] == '.' && seg[1] == '.') {
+            if (count)
+                count--;
+            continue;
+        }
+        segs[count] = seg;
+        lens[count++] = len;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (n + 1 + lens[i] >= PATH_MAX_)
+            return false;
+        if (i)
+            out[n++] = '/';
+        memcpy(out + n, segs[i], lens[i]);
+        n += lens[i];
+    }
+    out[n] = '\0';
+    return true;
+}
+
+static bool ref_translate(const char * path, char * out, size_t size) {
+    char norm[PATH_MAX_ * 2];
+    if (!ref_normalize(path, norm))
+        return false;
+
+    const ref_mount * best = NULL;
+    size_t best_len = 0;
+    for (int i = 0; norm[0] == '/' && i < s_ref_count; i++) {
+        size_t len = strlen(s_ref[i].prefix);
+        bool boundary = len == 1 || norm[len] == '/' || norm[len] == '\0';
+        if (!strncmp(norm, s_ref[i].prefix, len) && boundary
+            && (!best || len > best_len)) {
+            best = &s_ref[i];
+            best_len = len;
+        }
+    }
+
+    char real[PATH_MAX_ * 3];
+    if (best) {
+        const char * rest = norm + best_len;
+        while (*rest == '/')
+            rest++;
+        size_t root_len = strlen(best->root);
+        bool sep = *rest && root_len && best->root[root_len - 1] != '/';
+        sprintf(real, "%s%s%s", best->root, sep ? "/" : "", rest);
+    } else {
+        strcpy(real, norm);
+    }
+
+    if (strlen(real) >= size)
+        return false;
+    strcpy(out, real);
+    return true;
+}
+
+static bool add(const char * prefix, const char * root) {
+    if (!mounts_add(prefix, root))
+        return false;
+
+    // The plain version wants the prefix normalized too
+    char norm[PATH_MAX_ * 2];
+    ref_normalize(prefix, norm);
+    s_ref[s_ref_count].prefix = strdup(norm);
+    s_ref[s_ref_count++].root = root;
+    return true;
+}
+
+static void check_cases(void) {
+    static const struct {
+        const char * path;
+        const char * want;
+    } cases[] = {
+        { "/sdcard/Android/data/x.bin", DATA "x.bin" },
+        { "/sdcard//Android/./data/x.bin", DATA "x.bin" },
+        { "/sdcard/Android/data", DATA },
+        { "/sdcard/Android/data/", DATA },
+        { "/sdcard/Android/database", FILES "Android/database" },
+        { "/sdcard/Android/dat", FILES "Android/dat" },
+        { "/sdcard/Android/data/../obb/a", FILES "Android/obb/a" },
+        { "/sdcard/x/../Android/data/y", DATA "y" },
+        { "/sdcard", FILES },
+        { "/sdcard/", FILES },
+        { "/sdcardx/a", FILES "sdcardx/a" },
+        { "/", FILES },
+        { "", FILES },
+        { "save.dat", FILES "save.dat" },
+        { "./a/./b", FILES "a/b" },
+        { "a/b/../c", FILES "a/c" },
+        { "/../../etc/x", FILES "etc/x" },
+        { "..", FILES },
+        { "/a/b/..", FILES "a" },
+        { "/a/b/.../c", FILES "a/b/.../c" },
+        { "/a/.b/c.", FILES "a/.b/c." },
+        { "/obb/main.obb", OBB "/main.obb" },
+        { "/obb", OBB },
+        { "/obbx", FILES "obbx" },
+        { "ux0:data/x/../y", "ux0:data/y" },
+        { "ux0:/a//b/./c", "ux0:/a/b/c" },
+        { "ux0:", "ux0:" },
+        { "ux0:../a", "ux0:a" },
+        { "/sdcard/ux0:x", FILES "ux0:x" },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        for (int pass = 0; pass < 2; pass++) {
+            char out[PATH_MAX_];
+            bool ok = mounts_translate(cases[i].path, out, sizeof(out));
+            CHECK(ok && !strcmp(out, cases[i].want), "'%s' is '%s', want "
+                  "'%s' (pass %d)", cases[i].path, ok ? out : "(false)",
+                  cases[i].want, pass);
+        }
+    }
+
+    // Results that don't fit, with and without the cache
+    char out[PATH_MAX_];
+    size_t need = strlen(DATA "x.bin") + 1;
+    for (int pass = 0; pass < 2; pass++) {
+        CHECK(!mounts_translate("/sdcard/Android/data/x.bin", out, need - 1),
+              "fit in %zu bytes", need - 1);
+        CHECK(mounts_translate("/sdcard/Android/data/x.bin", out, need),
+              "didn't fit in %zu bytes", need);
+    }
+    CHECK(!mounts_translate("ux0:data", out, 8) && mounts_translate(
+          "ux0:data", out, 9), "device path in 8 and 9 bytes");
+
+    char * longest = malloc(PATH_MAX_ * 2 + 1);
+    memset(longest, 'a', PATH_MAX_ * 2);
+    longest[PATH_MAX_ * 2] = '\0';
+    CHECK(!mounts_translate(longest, out, sizeof(out)), "translated a path "
+          "of %d bytes", PATH_MAX_ * 2);
+    free(longest);
+}
+
+static void check_add(void) {
+    CHECK(!mounts_add("ux0:data", "ux0:other/"), "mounted a device path");
+
+    // Adding a mount drops what the cache knew about its paths
+    char out[PATH_MAX_];
+    mounts_translate("/late/a", out, sizeof(out));
+    CHECK(!strcmp(out, FILES "late/a"), "/late/a before: %s", out);
+    CHECK(add("/late/", "ux0:late/"), "add /late");
+    mounts_translate("/late/a", out, sizeof(out));
+    CHECK(!strcmp(out, "ux0:late/a"), "/late/a after: %s", out);
+
+    while (add("/m/x", "ux0:m/"))
+        ;
+    CHECK(s_ref_count == 8, "%d mounts taken", s_ref_count);
+}
+
+static const char * s_segments[] = {
+    "sdcard", "Android", "data", "obb", "late", "m", "x", "save.dat", ".",
+    "..", "", "ux0:", "a.txt", "sdcardx", "dat", "...",
+};
+
+static void random_path(uint32_t * state, char * path) {
+    size_t n = 0;
+    if (rnd_r(state) % 4 == 0)
+        n += sprintf(path, "ux0:");
+    else if (rnd_r(state) % 4)
+        path[n++] = '/';
+
+    int count = rnd_r(state) % 8;
+    for (int i = 0; i < count; i++) {
+        const char * seg = s_segments[rnd_r(state)
+                                      % (sizeof(s_segments)
+                                         / sizeof(s_segments[0]))];
+        n += sprintf(path + n, "%s%s", i ? "/" : "", seg);
+    }
+    if (rnd_r(state) % 4 == 0)
+        path[n++] = '/';
+    path[n] = '\0';
+}
+
+static void check_path(const char * path, size_t size) {
+    char out[PATH_MAX_], want[PATH_MAX_];
+    memset(out, 0, sizeof(out));
+    bool ok = mounts_translate(path, out, size);
+    bool want_ok = ref_translate(path, want, size);
+    CHECK(ok == want_ok && (!ok || !strcmp(out, want)), "'%s' in %zu: '%s', "
+          "want '%s'", path, size, ok ? out : "(false)",
+          want_ok ? want : "(false)");
+}
+
+static uint32_t fnv1a(const char * s) {
+    uint32_t h = 0x811C9DC5u;
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 0x01000193u;
+    }
+    return h;
+}
+
+static int by_hash(const void * a, const void * b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void collision_path(uint32_t i, char * path) {
+    uint32_t state = i * 2654435761u + 1;
+    strcpy(path, "/c/");
+    for (int k = 0; k < 8; k++)
+        path[3 + k] = (char)('a' + rnd_r(&state) % 26);
+    path[11] = '\0';
+}
+
+// Two paths with the same hash, the cache's key, don't share a result
+static void check_collision(void) {
+    enum { PATHS = 1 << 18 };
+    uint64_t * keys = malloc(PATHS * sizeof(uint64_t));
+    char a[64], b[64];
+    for (uint32_t i = 0; i < PATHS; i++) {
+        collision_path(i, a);
+        keys[i] = (uint64_t)fnv1a(a) << 32 | i;
+    }
+    qsort(keys, PATHS, sizeof(uint64_t), by_hash);
+
+    int pairs = 0;
+    for (uint32_t i = 1; i < PATHS && pairs < 4; i++) {
+        if (keys[i] >> 32 != keys[i - 1] >> 32)
+            continue;
+        collision_path((uint32_t)keys[i - 1], a);
+        collision_path((uint32_t)keys[i], b);
+        if (!strcmp(a, b))
+            continue;
+        check_path(a, PATH_MAX_);
+        check_path(b, PATH_MAX_);
+        check_path(a, PATH_MAX_);
+        pairs++;
+    }
+    CHECK(pairs, "no colliding paths found");
+    free(keys);
+}
+
+static void check_random(long paths) {
+    for (long i = 0; i < paths; i++) {
+        char path[256];
+        random_path(&s_rng, path);
+        size_t size = rnd() % 8 ? PATH_MAX_ : rnd() % 64;
+        check_path(path, size);
+        check_path(path, size);
+    }
+}
+
+static long s_thread_paths;
+
+static void * thread_main(void * arg) {
+    uint32_t state = (uint32_t)(uintptr_t)arg;
+    for (long i = 0; i < s_thread_paths; i++) {
+        char path[256];
+        random_path(&state, path);
+        check_path(path, PATH_MAX_);
+    }
+    return NULL;
+}
+
+static void check_threads(long paths) {
+    pthread_t threads[THREADS];
+    s_thread_paths = paths / THREADS;
+    for (int i = 0; i < THREADS; i++)
+        pthread_create(&threads[i], NULL, thread_main,
+                       (void *)(uintptr_t)(i * 7919 + 1));
+    for (int i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// A few hundred game-like paths, over and over
+static void bench(void) {
+    enum { PATHS = 300, ROUNDS = 2000 };
+    static char paths[PATHS][128];
+    for (int i = 0; i < PATHS; i++) {
+        sprintf(paths[i], "%s/data/%s/%04u.%s", i % 3 ? "/sdcard/Android/"
+                "data" : "/sdcard", i % 2 ? "textures" : "sounds", rnd() %
+                10000, i % 2 ? "pvr" : "ogg");
+    }
+
+    char out[PATH_MAX_];
+    double t0 = now_ns();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < PATHS; i++)
+            mounts_translate(paths[i], out, sizeof(out));
+    }
+    double t1 = now_ns();
+    printf("   cached translation: %.1f ns/path\n",
+           (t1 - t0) / (PATHS * ROUNDS));
+}
+
+int main(int argc, char ** argv) {
+    long paths = argc > 1 ? atol(argv[1]) : 200000;
+
+    // Uncached until the first mount
+    char out[PATH_MAX_];
+    CHECK(mounts_translate("/a/../b", out, sizeof(out))
+          && !strcmp(out, "/b"), "'/a/../b' with no mounts is '%s'", out);
+
+    // As init.c sets them up, and a root without a trailing slash
+    add("/", FILES);
+    add("/sdcard", FILES);
+    add("/sdcard/Android/data", DATA);
+    add("/obb", OBB);
+
+    check_cases();
+    check_add();
+    check_collision();
+    check_random(paths);
+    check_threads(paths);
+    bench();
+
+    if (s_failed)
+        return 1;
+    printf("ok: path cases, %ld random paths on one thread and %ld on %d\n",
+           paths, paths, THREADS);
+    return 0;
+}
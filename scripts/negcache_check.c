@@ -0,0 +1,298 @@
+/*
+ * scripts/negcache_check.c
+ *
+ * Checks loader/utils/negcache.c against a model of its direct-mapped
+ * table: random adds, lookups, forgets and clears over more paths than
+ * it has slots, with every lookup answer and the stats compared. Paths
+ * whose hashes collide must not stand in for each other. Then several
+ * threads work on paths of their own at once; a path may be evicted by
+ * another thread's, but must never be reported missing unless its own
+ * thread added it. Built by the host project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/negcache_check [operations]
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/negcache.h"
+
+#define SLOTS       2048 // NEGCACHE_SIZE in negcache.c
+#define PATHS       5000
+#define THREADS     4
+#define THREAD_PATHS 1000
+
+static uint32_t s_rng = 1;
+
+static uint32_t rnd_r(uint32_t * state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static uint32_t rnd(void) {
+    return rnd_r(&s_rng);
+}
+
+static int s_failed;
+static pthread_mutex_t s_fail_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        pthread_mutex_lock(&s_fail_lock); \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+        pthread_mutex_unlock(&s_fail_lock); \
+    } \
+} while (0)
+
+static uint32_t fnv1a(const char * s) {
+    uint32_t h = 0x811C9DC5u;
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 0x01000193u;
+    }
+    return h;
+}
+
+// Which path each slot holds, -1 for none
+static int s_model[SLOTS];
+static negcache_stats s_expected;
+
+static char s_paths[PATHS][64];
+
+static void model_clear(void) {
+    for (int i = 0; i < SLOTS; i++)
+        s_model[i] = -1;
+    s_expected.entries = 0;
+}
+
+static int slot_of(int path) {
+    return fnv1a(s_paths[path]) & (SLOTS - 1);
+}
+
+static void check_stats(const char * when) {
+    negcache_stats st;
+    negcache_get_stats(&st);
+    CHECK(st.hits == s_expected.hits && st.misses == s_expected.misses
+          && st.entries == s_expected.entries, "%s: %u hits, %u misses, %u "
+          "entries; want %u, %u, %u", when, st.hits, st.misses, st.entries,
+          s_expected.hits, s_expected.misses, s_expected.entries);
+}
+
+static void check_uninitialized(void) {
+    negcache_add("ux0:data/x");
+    CHECK(!negcache_missing("ux0:data/x"), "missing before init");
+    negcache_forget("ux0:data/x");
+    negcache_clear();
+
+    negcache_stats st;
+    memset(&st, 0xFF, sizeof(st));
+    negcache_get_stats(&st);
+    CHECK(!st.hits && !st.misses && !st.entries, "stats before init");
+}
+
+static void check_model(long ops) {
+    for (int i = 0; i < PATHS; i++) {
+        sprintf(s_paths[i], "ux0:data/backstab/files/%s/%d.%s",
+                i % 3 ? "tex" : "snd", i, i % 2 ? "pvr" : "ogg");
+    }
+    model_clear();
+
+    long adds = 0, evictions = 0;
+    for (long n = 0; n < ops; n++) {
+        int p = rnd() % PATHS;
+        int s = slot_of(p);
+        uint32_t op = rnd() % 100;
+
+        if (op < 30) {
+            negcache_add(s_paths[p]);
+            if (s_model[s] < 0)
+                s_expected.entries++;
+            else
+                evictions += s_model[s] != p;
+            s_model[s] = p;
+            adds++;
+        } else if (op < 40) {
+            negcache_forget(s_paths[p]);
+            if (s_model[s] == p) {
+                s_model[s] = -1;
+                s_expected.entries--;
+            }
+        } else if (op == 40 && rnd() % 100 == 0) {
+            negcache_clear();
+            model_clear();
+        } else {
+            bool want = s_model[s] == p;
+            CHECK(negcache_missing(s_paths[p]) == want, "op %ld: %s missing "
+                  "%d, want %d", n, s_paths[p], !want, want);
+            if (want)
+                s_expected.hits++;
+            else
+                s_expected.misses++;
+        }
+
+        if (n % 1000 == 0)
+            check_stats("random ops");
+    }
+    check_stats("after random ops");
+
+    negcache_clear();
+    model_clear();
+    check_stats("after clear");
+    for (int p = 0; p < PATHS; p++) {
+        CHECK(!negcache_missing(s_paths[p]), "%s missing after clear",
+              s_paths[p]);
+        s_expected.misses++;
+    }
+
+    printf("   %ld ops: %ld adds, %ld evictions, %u hits, %u misses\n", ops,
+           adds, evictions, s_expected.hits, s_expected.misses);
+}
+
+static void collision_path(uint32_t i, char * path) {
+    uint32_t state = i * 2654435761u + 1;
+    strcpy(path, "ux0:c/");
+    for (int k = 0; k < 8; k++)
+        path[6 + k] = (char)('a' + rnd_r(&state) % 26);
+    path[14] = '\0';
+}
+
+static int by_hash(const void * a, const void * b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// A path doesn't pass for another with the same hash, in any operation
+static void check_collision(void) {
+    enum { COUNT = 1 << 18 };
+    uint64_t * keys = malloc(COUNT * sizeof(uint64_t));
+    char a[64], b[64];
+    for (uint32_t i = 0; i < COUNT; i++) {
+        collision_path(i, a);
+        keys[i] = (uint64_t)fnv1a(a) << 32 | i;
+    }
+    qsort(keys, COUNT, sizeof(uint64_t), by_hash);
+
+    int pairs = 0;
+    for (uint32_t i = 1; i < COUNT && pairs < 4; i++) {
+        if (keys[i] >> 32 != keys[i - 1] >> 32)
+            continue;
+        collision_path((uint32_t)keys[i - 1], a);
+        collision_path((uint32_t)keys[i], b);
+        if (!strcmp(a, b))
+            continue;
+
+        negcache_add(a);
+        CHECK(!negcache_missing(b), "%s passes for %s", b, a);
+        negcache_forget(b);
+        CHECK(negcache_missing(a), "forgetting %s dropped %s", b, a);
+        negcache_add(b);
+        CHECK(!negcache_missing(a) && negcache_missing(b), "%s didn't "
+              "replace %s", b, a);
+        pairs++;
+    }
+    CHECK(pairs, "no colliding paths found");
+    free(keys);
+}
+
+static long s_thread_ops;
+static long s_thread_lookups[THREADS];
+
+static void * thread_main(void * arg) {
+    int t = (int)(uintptr_t)arg;
+    uint32_t state = t * 7919 + 1;
+    static char paths[THREADS][THREAD_PATHS][48];
+    static bool added[THREADS][THREAD_PATHS];
+
+    for (int i = 0; i < THREAD_PATHS; i++)
+        sprintf(paths[t][i], "ux0:t%d/%d", t, i);
+
+    for (long n = 0; n < s_thread_ops; n++) {
+        int p = rnd_r(&state) % THREAD_PATHS;
+        uint32_t op = rnd_r(&state) % 10;
+        if (op < 3) {
+            negcache_add(paths[t][p]);
+            added[t][p] = true;
+        } else if (op < 4) {
+            negcache_forget(paths[t][p]);
+            added[t][p] = false;
+        } else {
+            CHECK(!negcache_missing(paths[t][p]) || added[t][p], "thread %d: "
+                  "%s missing without being added", t, paths[t][p]);
+            s_thread_lookups[t]++;
+        }
+    }
+    return NULL;
+}
+
+static void check_threads(long ops) {
+    negcache_clear();
+    negcache_stats before, after;
+    negcache_get_stats(&before);
+
+    pthread_t threads[THREADS];
+    s_thread_ops = ops / THREADS;
+    for (int i = 0; i < THREADS; i++)
+        pthread_create(&threads[i], NULL, thread_main, (void *)(uintptr_t)i);
+    for (int i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    negcache_get_stats(&after);
+    uint64_t lookups = (uint64_t)(after.hits - before.hits)
+                       + (after.misses - before.misses);
+    long want = 0;
+    for (int i = 0; i < THREADS; i++)
+        want += s_thread_lookups[i];
+    CHECK(lookups == (uint64_t)want, "%llu lookups counted, %ld made",
+          (unsigned long long)lookups, want);
+    CHECK(after.entries <= SLOTS, "%u entries", after.entries);
+
+    // The table agrees with its count
+    uint32_t found = 0;
+    for (int t = 0; t < THREADS; t++) {
+        for (int i = 0; i < THREAD_PATHS; i++) {
+            char path[48];
+            sprintf(path, "ux0:t%d/%d", t, i);
+            found += negcache_missing(path);
+        }
+    }
+    CHECK(found == after.entries, "%u entries counted, %u found",
+          after.entries, found);
+
+    negcache_clear();
+    negcache_get_stats(&after);
+    CHECK(after.entries == 0, "%u entries after clear", after.entries);
+    printf("   %d threads: %llu lookups, %u entries before the clear\n",
+           THREADS, (unsigned long long)lookups, found);
+}
+
+int main(int argc, char ** argv) {
+    long ops = argc > 1 ? atol(argv[1]) : 2000000;
+
+    check_uninitialized();
+    negcache_init();
+    negcache_init();
+    check_model(ops);
+    check_collision();
+    check_threads(ops);
+
+    if (s_failed)
+        return 1;
+    printf("ok: %ld ops against the model and %ld on %d threads\n", ops, ops,
+           THREADS);
+    return 0;
+}
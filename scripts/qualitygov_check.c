@@ -0,0 +1,226 @@
+/*
+ * scripts/qualitygov_check.c
+ *
+ * Drives loader/utils/qualitygov.c with a synthetic frame time trace: a
+ * game whose frame cost grows with the view distance, going through light
+ * and heavy sections, loading spikes and a section that sits right at the
+ * budget. Checks that the view distance is left alone where there's room,
+ * comes down far enough but no further where there isn't, doesn't
+ * oscillate, comes back up once the heavy part is over, and that every
+ * change keeps to the step sizes and spacing the governor promises. Random
+ * traces are then checked against the same rules. Built by the host
+ * project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/qualitygov_check [random frames]
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "utils/qualitygov.h"
+
+#define FPS         30.f
+#define BUDGET      (1000.f / FPS)
+#define MIN         0.40f
+#define MAX         1.00f
+
+#define WINDOW      30
+#define STEP_DOWN   0.10f
+#define STEP_UP     0.05f
+// Windows between changes: settling, then a full run over or under budget
+#define GAP_DOWN    (2 + 2)
+#define GAP_UP      (2 + 6)
+
+static uint32_t s_rng = 1;
+
+static uint32_t rnd(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static float frnd(void) {
+    return (float)(rnd() & 0xFFFFFF) / (float)0x1000000;
+}
+
+static int s_failed;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+    } \
+} while (0)
+
+// Part of the frame that scales with the view distance
+static float frame_cost(float base, float value) {
+    return base * (0.35f + 0.65f * value);
+}
+
+// The highest value the budget allows in a scene
+static float value_fit(float base) {
+    return (BUDGET / base - 0.35f) / 0.65f;
+}
+
+typedef struct run {
+    qualitygov g;
+    long frame;
+    long last_change;
+    int changes;
+    int ups;
+    int downs;
+} run;
+
+static void run_init(run * r) {
+    qualitygov_init(&r->g, FPS, MIN, MAX);
+    r->frame = 0;
+    r->last_change = -1;
+    r->changes = r->ups = r->downs = 0;
+    CHECK(r->g.value == MAX, "starts at %.2f", r->g.value);
+}
+
+// One frame, with the rules every change has to follow
+static void frame(run * r, float ms) {
+    float before = r->g.value;
+    bool changed = qualitygov_frame(&r->g, ms);
+    float after = r->g.value;
+    r->frame++;
+
+    CHECK(changed == (after != before), "frame %ld: returned %d going from "
+          "%.3f to %.3f", r->frame, changed, before, after);
+    CHECK(after >= MIN && after <= MAX, "frame %ld: value %.3f out of "
+          "bounds", r->frame, after);
+    if (!changed)
+        return;
+
+    CHECK(r->frame % WINDOW == 0, "frame %ld: changed mid-window",
+          r->frame);
+
+    int up = after > before;
+    float step = up ? STEP_UP : STEP_DOWN;
+    float want = up ? fminf(before + step, MAX) : fmaxf(before - step, MIN);
+    CHECK(fabsf(after - want) < 1e-5f, "frame %ld: %.3f to %.3f, want %.3f",
+          r->frame, before, after, want);
+
+    if (r->last_change >= 0) {
+        long gap = (r->frame - r->last_change) / WINDOW;
+        CHECK(gap >= (up ? GAP_UP : GAP_DOWN), "frame %ld: %s %ld windows "
+              "after the last change", r->frame, up ? "up" : "down", gap);
+    }
+
+    r->last_change = r->frame;
+    r->changes++;
+    r->ups += up;
+    r->downs += !up;
+}
+
+/*
+ * `seconds` of a scene, with 5% noise, and a spike every `spike_every`
+ * frames counted from the start of the trace
+ */
+static void scene(run * r, float seconds, float base, int spike_every,
+                  float spike_ms) {
+    long frames = (long)(seconds * FPS);
+    for (long i = 0; i < frames; i++) {
+        float ms = frame_cost(base, r->g.value) * (0.95f + 0.1f * frnd());
+        if (spike_every && r->frame % spike_every == spike_every - 1)
+            ms = spike_ms;
+        frame(r, ms);
+    }
+}
+
+static void check_trace(void) {
+    run r;
+    run_init(&r);
+
+    // Light: plenty of room at the full view distance
+    scene(&r, 60, 18.f, 0, 0);
+    CHECK(r.changes == 0, "%d changes in a light scene", r.changes);
+
+    /*
+     * A loading screen, and hitches right before the governor looks at
+     * every window: capped, none of them gets the average over budget
+     */
+    frame(&r, 2500.f);
+    scene(&r, 30, 18.f, 0, 0);
+    scene(&r, 60, 18.f, WINDOW, 300.f);
+    CHECK(r.changes == 0, "%d changes from loading spikes", r.changes);
+
+    // Heavy: down to what fits, within a few gaps, and not further
+    long start = r.frame;
+    float fit = value_fit(42.f);
+    scene(&r, 30, 42.f, 0, 0);
+    CHECK(r.g.value <= fit && r.g.value > fit - STEP_DOWN - 1e-5f,
+          "heavy scene: %.2f after 30 s, %.2f fits", r.g.value, fit);
+    CHECK((r.last_change - start) / WINDOW <= GAP_DOWN * 4 + 2,
+          "heavy scene: took %ld windows", (r.last_change - start) / WINDOW);
+
+    // and stays there, spikes or not
+    int changes = r.changes;
+    scene(&r, 60, 42.f, 0, 0);
+    scene(&r, 60, 42.f, 100, 150.f);
+    CHECK(r.changes == changes, "heavy scene: %d changes once settled",
+          r.changes - changes);
+
+    // Light again: back up to the full view distance, only ever up
+    int downs = r.downs;
+    scene(&r, 120, 18.f, 0, 0);
+    CHECK(r.g.value == MAX, "light scene: %.2f after 120 s", r.g.value);
+    CHECK(r.downs == downs, "light scene: went down %d times",
+          r.downs - downs);
+
+    // Right at the budget: settles under it and stays, no oscillation
+    fit = value_fit(36.f);
+    scene(&r, 30, 36.f, 0, 0);
+    CHECK(r.g.value <= fit && r.g.value > fit - STEP_DOWN - 1e-5f,
+          "scene at the budget: %.2f, %.2f fits", r.g.value, fit);
+    changes = r.changes;
+    scene(&r, 180, 36.f, 0, 0);
+    CHECK(r.changes == changes, "scene at the budget: %d changes once "
+          "settled", r.changes - changes);
+
+    // Too heavy for anything: down to the minimum and no further
+    scene(&r, 60, 120.f, 0, 0);
+    CHECK(r.g.value == MIN, "too heavy: %.2f", r.g.value);
+
+    printf("   trace: %ld frames, %d changes (%d down, %d up)\n", r.frame,
+           r.changes, r.downs, r.ups);
+}
+
+// Scenes of random length and weight; only the rules are checked
+static void check_random(long frames) {
+    run r;
+    run_init(&r);
+
+    while (r.frame < frames) {
+        float base = 10.f + frnd() * 100.f;
+        float seconds = 1.f + frnd() * 60.f;
+        int spike_every = rnd() % 3 ? 0 : 1 + (int)(rnd() % 300);
+        scene(&r, seconds, base, spike_every, 50.f + frnd() * 3000.f);
+    }
+
+    printf("   random: %ld frames, %d changes (%d down, %d up)\n", r.frame,
+           r.changes, r.downs, r.ups);
+}
+
+int main(int argc, char ** argv) {
+    long frames = argc > 1 ? atol(argv[1]) : 2000000;
+
+    check_trace();
+    check_random(frames);
+
+    if (s_failed)
+        return 1;
+    printf("ok: view distance trace and %ld random frames\n", frames);
+    return 0;
+}
@@ -0,0 +1,451 @@
+/*
+ * scripts/rastream_check.c
+ *
+ * Checks loader/utils/rastream.c against glibc's stdio: a binary file a
+ * few buffers long and a text file are read with random freads (small,
+ * and larger than a buffer), getc, ungetc, gets, seeks from all three
+ * origins (before the start and past the end too), tell and eof, through
+ * a stream and a FILE side by side, and every result has to match. The
+ * edge cases are checked on their own: ungetc at the start and twice in a
+ * row, empty files, missing files, the stream pool running out, and a read
+ * failing on the device. Several threads then stream the same file at
+ * once with read-ahead going.
+ *
+ * Last, a benchmark on a simulated memory card (LATENCY_US per request,
+ * CARD_MBPS) reads a file in chunks with a little work per chunk, through
+ * a 4 KiB stdio-like buffer and through a stream. Built by the host
+ * project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/rastream_check [operations]
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <psp2/io/fcntl.h>
+
+#include "utils/blockcache.h"
+#include "utils/rastream.h"
+#include "utils/utils.h"
+
+#define FILES       DATA_PATH "rastream_check/"
+#define BIN         FILES "bin"
+#define TEXT        FILES "text"
+#define SMALL       FILES "small"
+#define EMPTY       FILES "empty"
+
+#define BIN_SIZE    (3 * 1024 * 1024 + 123)
+#define TEXT_SIZE   200000
+#define MAX_FILES   16  // RASTREAM_MAX_FILES in rastream.c
+#define BUF_SIZE    (64 * 1024) // RASTREAM_BUF_SIZE
+#define THREADS     6
+
+#define LATENCY_US  100 // per request on the simulated card
+#define CARD_MBPS   40
+
+static uint32_t s_rng = 1;
+
+static uint32_t rnd(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static int s_failed;
+static pthread_mutex_t s_fail_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        pthread_mutex_lock(&s_fail_lock); \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+        pthread_mutex_unlock(&s_fail_lock); \
+    } \
+} while (0)
+
+// The simulated card everything reads from, through the block cache
+static int s_latency_us;
+static volatile long s_device_reads;
+static volatile bool s_broken;
+
+static void sleep_us(long us) {
+    struct timespec ts = { us / 1000000, us % 1000000 * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+static int card_read(int fd, void * dst, uint32_t len, int64_t offset) {
+    __sync_fetch_and_add(&s_device_reads, 1);
+    if (s_broken)
+        return -1;
+    if (s_latency_us)
+        sleep_us(s_latency_us + len / CARD_MBPS);
+    return (int)pread(fd, dst, len, offset);
+}
+
+static uint8_t * s_bin;
+
+static void make_file(const char * path, uint8_t * data, size_t size,
+                      bool text) {
+    for (size_t i = 0; i < size; i++) {
+        if (text)
+            data[i] = rnd() % 40 == 0 ? '\n' : (uint8_t)('a' + rnd() % 26);
+        else
+            data[i] = (uint8_t)rnd();
+    }
+    FILE * f = fopen(path, "wb");
+    fwrite(data, 1, size, f);
+    fclose(f);
+}
+
+static void make_files(void) {
+    char dir[] = FILES;
+    mkpath(dir, 0755);
+
+    s_bin = malloc(BIN_SIZE);
+    make_file(BIN, s_bin, BIN_SIZE, false);
+
+    uint8_t * text = malloc(TEXT_SIZE);
+    make_file(TEXT, text, TEXT_SIZE, true);
+    free(text);
+
+    FILE * f = fopen(SMALL, "wb");
+    fputs("0123456789", f);
+    fclose(f);
+    fclose(fopen(EMPTY, "wb"));
+}
+
+static void check_edges(void) {
+    errno = 0;
+    CHECK(!rastream_open(FILES "missing") && errno == ENOENT,
+          "missing file: errno %d", errno);
+
+    rastream * s = rastream_open(SMALL);
+    CHECK(rastream_size(s) == 10, "size %lld", (long long)rastream_size(s));
+
+    // Nothing to push back before the first byte, and only one at a time
+    CHECK(rastream_ungetc('x', s) == EOF, "ungetc at the start");
+    rastream_getc(s);
+    rastream_getc(s);
+    CHECK(rastream_ungetc('q', s) == 'q', "ungetc refused");
+    CHECK(rastream_ungetc('r', s) == EOF, "second ungetc taken");
+    CHECK(rastream_ungetc(EOF, s) == EOF, "ungetc of EOF taken");
+    CHECK(rastream_tell(s) == 1, "tell %lld after ungetc",
+          (long long)rastream_tell(s));
+    CHECK(rastream_getc(s) == 'q', "pushed back byte not read");
+    CHECK(rastream_getc(s) == '2', "read after the pushed back byte");
+
+    // Pushed back right where the last read stopped
+    rastream_seek(s, 4, SEEK_SET);
+    CHECK(rastream_ungetc('y', s) == 'y' && rastream_getc(s) == 'y',
+          "pushed back byte after a seek not read");
+    rastream_seek(s, 3, SEEK_SET);
+
+    // A seek drops the pushed back byte and the end of file
+    rastream_ungetc('z', s);
+    CHECK(rastream_seek(s, 0, SEEK_CUR) == 0 && rastream_getc(s) == '2',
+          "seek kept the pushed back byte");
+    CHECK(rastream_seek(s, -1, SEEK_SET) == -1 && rastream_tell(s) == 3,
+          "seek before the start");
+    CHECK(rastream_seek(s, 0, 42) == -1, "seek from nowhere");
+    CHECK(rastream_seek(s, 100, SEEK_SET) == 0 && rastream_getc(s) == EOF
+          && rastream_eof(s), "read past the end");
+    CHECK(rastream_seek(s, -1, SEEK_END) == 0 && !rastream_eof(s)
+          && rastream_getc(s) == '9', "seek from the end");
+
+    char line[4];
+    rastream_seek(s, 0, SEEK_SET);
+    CHECK(rastream_gets(line, 4, s) && !strcmp(line, "012"), "gets: %s",
+          line);
+    CHECK(!rastream_gets(line, 0, s), "gets into nothing");
+    CHECK(rastream_gets(line, 1, s) && !line[0], "gets into one byte");
+    CHECK(!rastream_error(s), "error set");
+    rastream_close(s);
+
+    s = rastream_open(EMPTY);
+    char c;
+    CHECK(rastream_read(s, &c, 1) == 0 && rastream_eof(s), "read of an "
+          "empty file");
+    CHECK(!rastream_gets(line, 4, s), "gets of an empty file");
+    rastream_close(s);
+}
+
+// More streams than there are slots fail cleanly, and the slots come back
+static void check_pool(void) {
+    rastream * s[MAX_FILES + 4];
+    for (int round = 0; round < 2; round++) {
+        int opened = 0;
+        for (int i = 0; i < MAX_FILES + 4; i++) {
+            errno = 0;
+            s[i] = rastream_open(BIN);
+            opened += s[i] != NULL;
+            CHECK(s[i] || errno == 0, "errno %d with no stream free", errno);
+        }
+        CHECK(opened == MAX_FILES, "round %d: %d streams opened", round,
+              opened);
+        CHECK(rastream_owns(s[0]) && !rastream_owns((char *)s[0] + 1)
+              && !rastream_owns(stdin), "owns");
+
+        // With all of them reading ahead, which takes every buffer
+        for (int i = 0; i < MAX_FILES; i++) {
+            char c;
+            for (int n = 0; n < 4; n++)
+                rastream_read(s[i], &c, 1);
+            CHECK(c == (char)s_bin[3], "stream %d read %d", i, c);
+        }
+        for (int i = 0; i < MAX_FILES + 4; i++) {
+            if (s[i])
+                rastream_close(s[i]);
+        }
+    }
+
+    // Read-ahead buffers go back to the arena too
+    for (int i = 0; i < 100; i++) {
+        s[0] = rastream_open(BIN);
+        CHECK(s[0], "open %d failed", i);
+        if (!s[0])
+            break;
+        char c;
+        for (int n = 0; n < 4; n++)
+            rastream_read(s[0], &c, 1);
+        rastream_close(s[0]);
+    }
+}
+
+// Reads past what's buffered fail, small ones and ones that skip the buffers
+static void check_failure(void) {
+    static uint8_t buf[BUF_SIZE * 2];
+    static const size_t lens[] = { 10, sizeof(buf) };
+
+    for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+        size_t len = lens[i];
+        rastream * s = rastream_open(BIN);
+        CHECK(rastream_read(s, buf, 100) == 100, "first read");
+
+        rastream_seek(s, BUF_SIZE * 8, SEEK_SET);
+        s_broken = true;
+        size_t got = rastream_read(s, buf, len);
+        s_broken = false;
+        CHECK(got == 0 && rastream_error(s), "read %zu of %zu from a broken "
+              "card", got, len);
+
+        rastream_seek(s, 0, SEEK_SET);
+        CHECK(rastream_read(s, buf, 100) == 100 && !memcmp(buf, s_bin, 100),
+              "read after the failure");
+        rastream_close(s);
+    }
+}
+
+// Reads all over the file don't read ahead what won't be read
+static void check_scattered(void) {
+    rastream * s = rastream_open(BIN);
+    s_device_reads = 0;
+    for (int i = 0; i < 20; i++) {
+        int64_t pos = (int64_t)(i * 7 % 20) * 2 * BUF_SIZE;
+        char c = 0;
+        rastream_seek(s, pos, SEEK_SET);
+        rastream_read(s, &c, 1);
+        CHECK(c == (char)s_bin[pos], "read %d at %lld", c, (long long)pos);
+    }
+    rastream_close(s);
+    CHECK(s_device_reads == 20, "%ld device reads for 20 scattered ones",
+          s_device_reads);
+}
+
+// Random operations on a stream and a FILE, which have to agree
+static void check_stdio(const char * path, long size, long ops) {
+    static char a[300000], b[300000];
+    rastream * s = rastream_open(path);
+    FILE * f = fopen(path, "rb");
+    long counts[7] = { 0 };
+
+    for (long op = 0; op < ops; op++) {
+        uint32_t k = rnd() % 100;
+        if (k < 35) {
+            size_t n = rnd() % 4 == 0 ? rnd() % 200000 : rnd() % 300;
+            size_t x = rastream_read(s, a, n), y = fread(b, 1, n, f);
+            CHECK(x == y && !memcmp(a, b, x), "op %ld: read %zu: %zu, want "
+                  "%zu", op, n, x, y);
+            counts[0]++;
+        } else if (k < 55) {
+            int x = rastream_getc(s), y = fgetc(f);
+            CHECK(x == y, "op %ld: getc %d, want %d", op, x, y);
+            counts[1]++;
+        } else if (k < 62) {
+            int x = rastream_getc(s), y = fgetc(f);
+            CHECK(x == y, "op %ld: getc %d, want %d", op, x, y);
+            if (x != EOF && y != EOF && rnd() % 2) {
+                int c = rnd() % 2 ? x : 'Z';
+                x = rastream_ungetc(c, s);
+                y = ungetc(c, f);
+                CHECK(x == y, "op %ld: ungetc %d, want %d", op, x, y);
+            }
+            counts[2]++;
+        } else if (k < 72) {
+            int n = (int)(rnd() % 200) + 1;
+            char * x = rastream_gets(a, n, s), * y = fgets(b, n, f);
+            CHECK(!x == !y && (!x || !strcmp(a, b)), "op %ld: gets %d: "
+                  "\"%s\", want \"%s\"", op, n, x ? a : "(null)",
+                  y ? b : "(null)");
+            counts[3]++;
+        } else if (k < 85) {
+            static const int origins[] = { SEEK_SET, SEEK_CUR, SEEK_END };
+            int w = (int)(rnd() % 3);
+            long off = w == 0 ? (long)(rnd() % (size + 100))
+                     : w == 1 ? (long)(rnd() % 2000) - 1000
+                     : -(long)(rnd() % (size + 1)) + (rnd() % 10 ? 0 : 50);
+            int x = rastream_seek(s, off, origins[w]);
+            int y = fseek(f, off, origins[w]);
+            CHECK(x == y, "op %ld: seek %ld from %d: %d, want %d", op, off, w,
+                  x, y);
+            counts[4]++;
+        } else if (k < 92) {
+            counts[5]++;
+        } else {
+            CHECK(rastream_eof(s) == !!feof(f), "op %ld: eof %d", op,
+                  rastream_eof(s));
+            counts[6]++;
+        }
+        CHECK(rastream_tell(s) == ftell(f), "op %ld: tell %lld, want %ld",
+              op, (long long)rastream_tell(s), ftell(f));
+    }
+    CHECK(!rastream_error(s), "%s: error set", path);
+    rastream_close(s);
+    fclose(f);
+
+    printf("   %s: %ld reads, %ld getc, %ld ungetc, %ld gets, %ld seeks, "
+           "%ld tells, %ld eofs\n", path + strlen(FILES), counts[0],
+           counts[1], counts[2], counts[3], counts[4], counts[5], counts[6]);
+}
+
+static void * thread_main(void * arg) {
+    uint64_t * sum = arg;
+    rastream * s = rastream_open(BIN);
+    int c;
+    while ((c = rastream_getc(s)) != EOF)
+        *sum = *sum * 31 + (uint64_t)c;
+    CHECK(rastream_tell(s) == BIN_SIZE, "stopped at %lld",
+          (long long)rastream_tell(s));
+    rastream_close(s);
+    return NULL;
+}
+
+static void check_threads(void) {
+    uint64_t want = 0;
+    for (long i = 0; i < BIN_SIZE; i++)
+        want = want * 31 + s_bin[i];
+
+    pthread_t threads[THREADS];
+    uint64_t sums[THREADS] = { 0 };
+    for (int i = 0; i < THREADS; i++)
+        pthread_create(&threads[i], NULL, thread_main, &sums[i]);
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        CHECK(sums[i] == want, "thread %d read something else", i);
+    }
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// What SceLibc does with its default buffer: refill it 4 KiB at a time
+static size_t stdio_read(int fd, uint8_t * dst, size_t len, int64_t * pos) {
+    static uint8_t buf[4096];
+    static int64_t start = -1, end = -1;
+    size_t done = 0;
+
+    while (done < len) {
+        if (*pos < start || *pos >= end) {
+            int got = card_read(fd, buf, sizeof(buf), *pos);
+            if (got <= 0)
+                break;
+            start = *pos;
+            end = *pos + got;
+        }
+        size_t n = (size_t)(end - *pos);
+        if (n > len - done)
+            n = len - done;
+        memcpy(dst + done, buf + (*pos - start), n);
+        *pos += n;
+        done += n;
+    }
+    return done;
+}
+
+// The game spends a little time on every chunk it reads
+static void bench(void) {
+    static uint8_t buf[16384];
+    s_latency_us = LATENCY_US;
+
+    printf("   %d us per request, %d MB/s:\n", LATENCY_US,
+           CARD_MBPS);
+    for (int chunk = 1024; chunk <= 16384; chunk *= 4) {
+        long work_us = chunk / 64;
+
+        s_device_reads = 0;
+        double t0 = now_ms();
+        int fd = open(BIN, O_RDONLY);
+        int64_t pos = 0;
+        while (stdio_read(fd, buf, chunk, &pos) == (size_t)chunk)
+            sleep_us(work_us);
+        close(fd);
+        double t1 = now_ms();
+        long stdio_reads = s_device_reads;
+
+        s_device_reads = 0;
+        rastream * s = rastream_open(BIN);
+        while (rastream_read(s, buf, chunk) == (size_t)chunk)
+            sleep_us(work_us);
+        rastream_close(s);
+        double t2 = now_ms();
+
+        printf("   %5d byte reads: 4 KiB stdio %4.0f ms, %4ld device reads; "
+               "stream %4.0f ms, %4ld device reads\n", chunk, t1 - t0,
+               stdio_reads, t2 - t1, s_device_reads);
+
+        // Every chunk read once, whether read ahead or not
+        CHECK(s_device_reads == (BIN_SIZE + BUF_SIZE - 1) / BUF_SIZE,
+              "%ld device reads", s_device_reads);
+    }
+    s_latency_us = 0;
+}
+
+int main(int argc, char ** argv) {
+    long ops = argc > 1 ? atol(argv[1]) : 200000;
+
+    // No capacity: the block cache passes every read on to the card
+    blockcache_init(card_read);
+    make_files();
+
+    check_edges();
+    check_pool();
+    check_failure();
+    check_scattered();
+    check_stdio(BIN, BIN_SIZE, ops);
+    check_stdio(TEXT, TEXT_SIZE, ops);
+    check_threads();
+    bench();
+
+    free(s_bin);
+    if (s_failed)
+        return 1;
+    printf("ok: edge cases and %ld operations per file against stdio\n", ops);
+    return 0;
+}
@@ -0,0 +1,405 @@
+/*
+ * scripts/shadermanifest_check.c
+ *
+ * Runs loader/utils/shadermanifest.c through boots with a fake compiler
+ * and a fake gxp cache: sources recorded once however often they're
+ * submitted, the ones missing from the cache precompiled on the next boot
+ * and nothing else, a manifest cut off at every byte of its last records,
+ * a version 1 manifest migrated, and files that aren't manifests at all.
+ * Built by the host project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/shadermanifest_check [boots]
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/hash.h"
+#include "utils/shadermanifest.h"
+#include "utils/utils.h"
+
+#define MANIFEST_PATH   DATA_PATH "shadermanifest_check.bin"
+#define SOURCES         64
+#define MAX_RECORDS     256
+
+typedef struct source {
+    char key[HASH128_HEX_LEN + 1];
+    uint32_t type;
+    char * src;
+    uint32_t len;
+} source;
+
+// What the manifest should hold, in order
+static source s_records[MAX_RECORDS];
+static int s_record_count;
+
+static source s_sources[SOURCES];
+
+// Fake gxp cache
+static char s_cache[MAX_RECORDS * 2][HASH128_HEX_LEN + 1];
+static int s_cache_count;
+
+static int s_compiled[MAX_RECORDS];
+
+static uint32_t s_rng = 1;
+
+static uint32_t rnd(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static int s_failed;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+    } \
+} while (0)
+
+static void make_key(const char * src, uint32_t len, char * key) {
+    uint8_t digest[HASH128_SIZE];
+    hash128(src, len, digest);
+    hex_encode(digest, HASH128_SIZE, key);
+}
+
+static void make_sources(void) {
+    for (int i = 0; i < SOURCES; i++) {
+        source * s = &s_sources[i];
+        // An empty source is as good as any other
+        s->len = i == 0 ? 0 : 1 + rnd() % 2000;
+        s->src = malloc(s->len + 1);
+        for (uint32_t k = 0; k < s->len; k++)
+            s->src[k] = (char)(rnd() % 4 ? 'a' + rnd() % 26 : rnd());
+        s->src[s->len] = '\0';
+        s->type = 0x8B30 + rnd() % 2;
+        make_key(s->src, s->len, s->key);
+    }
+}
+
+static int record_index(const char * key) {
+    for (int i = 0; i < s_record_count; i++) {
+        if (!strcmp(s_records[i].key, key))
+            return i;
+    }
+    return -1;
+}
+
+static bool in_cache(const char * key) {
+    for (int i = 0; i < s_cache_count; i++) {
+        if (!strcmp(s_cache[i], key))
+            return true;
+    }
+    return false;
+}
+
+static void cache_add(const char * key) {
+    if (!in_cache(key) && s_cache_count < MAX_RECORDS * 2)
+        strcpy(s_cache[s_cache_count++], key);
+}
+
+static void cache_remove(const char * key) {
+    for (int i = 0; i < s_cache_count; i++) {
+        if (!strcmp(s_cache[i], key)) {
+            memmove(s_cache[i], s_cache[i + 1],
+                    (s_cache_count - i - 1) * sizeof(s_cache[0]));
+            s_cache_count--;
+            return;
+        }
+    }
+}
+
+static bool cached(const char * key) {
+    CHECK(strlen(key) == HASH128_HEX_LEN, "key \"%s\"", key);
+    return in_cache(key);
+}
+
+static bool compile(const char * key, uint32_t type, const char * src,
+                    uint32_t len) {
+    char want[HASH128_HEX_LEN + 1];
+    make_key(src, len, want);
+    CHECK(!strcmp(key, want), "compile %s, source hashes to %s", key, want);
+
+    int i = record_index(key);
+    CHECK(i >= 0, "compile %s, which was never recorded", key);
+    if (i >= 0) {
+        CHECK(s_records[i].type == type && s_records[i].len == len
+              && memcmp(s_records[i].src, src, len) == 0,
+              "compile %s with other contents", key);
+        s_compiled[i]++;
+    }
+    CHECK(!in_cache(key), "compile %s, which is cached", key);
+
+    // The compiler fails now and then, and nothing is stored
+    if (rnd() % 16 == 0)
+        return false;
+    cache_add(key);
+    return true;
+}
+
+static bool rekey_none(const char * sha1, const char * key) {
+    CHECK(0, "rekey %s -> %s on a current manifest", sha1, key);
+    return false;
+}
+
+static long file_size(void) {
+    FILE * f = fopen(MANIFEST_PATH, "rb");
+    if (!f)
+        return -1;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+// Size of a manifest holding the first `count` records
+static long record_end(int count) {
+    long size = 8;
+    for (int i = 0; i < count; i++)
+        size += HASH128_HEX_LEN + 8 + s_records[i].len;
+    return size;
+}
+
+/*
+ * A boot: open, precompile everything that was queued while the game
+ * submits shaders of its own, record those.
+ */
+static void boot(long step) {
+    // Whether a record should still be precompiled this boot
+    int missing[MAX_RECORDS] = { 0 };
+    for (int i = 0; i < s_record_count; i++)
+        missing[i] = !in_cache(s_records[i].key);
+    memset(s_compiled, 0, sizeof(s_compiled));
+
+    shader_manifest_open(MANIFEST_PATH, cached, rekey_none);
+
+    int queued = 0;
+    for (int i = 0; i < s_record_count; i++) {
+        CHECK(shader_manifest_known(s_records[i].key),
+              "boot %ld: record %d not known", step, i);
+        queued += missing[i];
+    }
+    CHECK(shader_manifest_pending() == (uint32_t)queued,
+          "boot %ld: %u pending, want %d", step, shader_manifest_pending(),
+          queued);
+
+    for (int n = 0; n < 40; n++) {
+        // The game compiles one itself now and then, before its turn
+        if (rnd() % 4 == 0) {
+            source * s = &s_sources[rnd() % SOURCES];
+            if (!in_cache(s->key)) {
+                cache_add(s->key);
+                // Its turn may have come already, with a failed compile
+                int i = record_index(s->key);
+                if (i >= 0)
+                    missing[i] = s_compiled[i];
+            }
+            if (!shader_manifest_known(s->key)) {
+                CHECK(record_index(s->key) < 0, "boot %ld: known key "
+                      "reported unknown", step);
+                if (s_record_count < MAX_RECORDS)
+                    s_records[s_record_count++] = *s;
+            }
+            shader_manifest_record(s->key, s->type, s->src, s->len);
+        }
+        shader_manifest_precompile_next(compile);
+    }
+    while (shader_manifest_precompile_next(compile))
+        ;
+
+    for (int i = 0; i < s_record_count; i++) {
+        CHECK(s_compiled[i] == missing[i],
+              "boot %ld: record %d compiled %d times, missing %d", step, i,
+              s_compiled[i], missing[i]);
+    }
+    // Nothing is written before the first record
+    CHECK(file_size() == record_end(s_record_count)
+          || (s_record_count == 0 && file_size() < 0),
+          "boot %ld: manifest is %ld bytes, want %ld", step, file_size(),
+          record_end(s_record_count));
+}
+
+/*
+ * Cut the file anywhere, the way a crash mid-append would, and sometimes
+ * leave garbage after the cut. There is no checksum, so garbage is only
+ * put where it can't make a whole record: in the file header, or in the
+ * source of the first damaged record.
+ */
+static void damage(long step) {
+    long size = file_size();
+    long cut = size - 1 - (long)(rnd() % 200);
+    if (cut < 0)
+        cut = 0;
+
+    // Records that are still whole survive, unless the header went
+    int whole = 0;
+    if (cut >= 8) {
+        while (whole < s_record_count && record_end(whole + 1) <= cut)
+            whole++;
+    }
+
+    long junk = 0;
+    if (cut < 8)
+        junk = rnd() % 12;
+    else if (cut >= record_end(whole) + HASH128_HEX_LEN + 8)
+        junk = rnd() % (record_end(whole + 1) - cut);
+
+    FILE * f = fopen(MANIFEST_PATH, "rb");
+    char * data = malloc(cut + junk);
+    CHECK(fread(data, 1, cut, f) == (size_t)cut, "read back");
+    fclose(f);
+    for (long i = 0; i < junk; i++)
+        data[cut + i] = (char)rnd();
+
+    f = fopen(MANIFEST_PATH, "wb");
+    fwrite(data, 1, cut + junk, f);
+    fclose(f);
+    free(data);
+
+    s_record_count = whole;
+    shader_manifest_open(MANIFEST_PATH, cached, rekey_none);
+    while (shader_manifest_precompile_next(compile))
+        ;
+    CHECK(file_size() == record_end(whole),
+          "step %ld: cut at %ld+%ld of %ld: %ld bytes left, want %ld", step,
+          cut, junk, size, file_size(), record_end(whole));
+}
+
+// Old records, named by their index as a SHA1
+#define V1_RECORDS 12
+
+static int s_rekey_seen[V1_RECORDS];
+
+static bool rekey(const char * sha1, const char * key) {
+    int i = atoi(sha1);
+    CHECK(strlen(sha1) == 40 && i >= 0 && i < V1_RECORDS, "rekey \"%s\"",
+          sha1);
+    if (i < 0 || i >= V1_RECORDS)
+        return false;
+    CHECK(!strcmp(key, s_records[i].key), "rekey %d to %s, want %s", i, key,
+          s_records[i].key);
+    s_rekey_seen[i]++;
+    // Binaries cached under the old name move to the new one
+    if (i % 3 == 0) {
+        cache_add(key);
+        return true;
+    }
+    return false;
+}
+
+// A version 1 manifest with a damaged last record
+static void migrate(void) {
+    FILE * f = fopen(MANIFEST_PATH, "wb");
+    uint32_t version = 1;
+    fwrite("SHMF", 1, 4, f);
+    fwrite(&version, 4, 1, f);
+
+    s_record_count = 0;
+    for (int i = 0; i < V1_RECORDS; i++) {
+        source * s = &s_sources[i];
+        char sha1[41];
+        snprintf(sha1, sizeof(sha1), "%040d", i);
+        fwrite(sha1, 1, 40, f);
+        fwrite(&s->type, 4, 1, f);
+        fwrite(&s->len, 4, 1, f);
+        fwrite(s->src, 1, s->len, f);
+        s_records[s_record_count++] = *s;
+    }
+    // A record cut short by a crash
+    fwrite("0000000000000000000000000000000000000099", 1, 40, f);
+    fclose(f);
+
+    s_cache_count = 0;
+    memset(s_compiled, 0, sizeof(s_compiled));
+    memset(s_rekey_seen, 0, sizeof(s_rekey_seen));
+    shader_manifest_open(MANIFEST_PATH, cached, rekey);
+
+    for (int i = 0; i < V1_RECORDS; i++) {
+        CHECK(s_rekey_seen[i] == 1, "record %d rekeyed %d times", i,
+              s_rekey_seen[i]);
+        CHECK(shader_manifest_known(s_records[i].key), "record %d unknown",
+              i);
+    }
+    CHECK(shader_manifest_pending() == V1_RECORDS - V1_RECORDS / 3,
+          "%u pending after migrating", shader_manifest_pending());
+    CHECK(file_size() == record_end(V1_RECORDS), "migrated manifest is %ld "
+          "bytes, want %ld", file_size(), record_end(V1_RECORDS));
+
+    while (shader_manifest_precompile_next(compile))
+        ;
+    for (int i = 0; i < V1_RECORDS; i++)
+        CHECK(s_compiled[i] == (i % 3 != 0), "record %d compiled %d times "
+              "after migrating", i, s_compiled[i]);
+
+    // Current now: opening it again moves nothing
+    boot(-1);
+}
+
+// Files that aren't a manifest start over as an empty one
+static void check_foreign(void) {
+    static const char * contents[] = {
+        "", "SHM", "SHMF", "XXXX\x02\0\0\0", "SHMF\x03\0\0\0",
+        "SHMF\x02\0\0",
+    };
+    static const long lengths[] = { 0, 3, 4, 8, 8, 7 };
+
+    for (int i = 0; i < 6; i++) {
+        FILE * f = fopen(MANIFEST_PATH, "wb");
+        fwrite(contents[i], 1, lengths[i], f);
+        fclose(f);
+
+        s_record_count = 0;
+        shader_manifest_open(MANIFEST_PATH, cached, rekey_none);
+        CHECK(shader_manifest_pending() == 0, "foreign file %d queued", i);
+        CHECK(file_size() == 8, "foreign file %d left %ld bytes", i,
+              file_size());
+    }
+}
+
+int main(int argc, char ** argv) {
+    long boots = argc > 1 ? atol(argv[1]) : 300;
+
+    char dir[] = DATA_PATH;
+    mkpath(dir, 0755);
+    remove(MANIFEST_PATH);
+    make_sources();
+
+    migrate();
+    check_foreign();
+
+    // From nothing: the first record creates the file
+    remove(MANIFEST_PATH);
+    s_record_count = 0;
+    s_cache_count = 0;
+
+    for (long i = 0; i < boots; i++) {
+        boot(i);
+
+        // Some binaries get lost between boots, e.g. a cleared cache
+        for (int k = rnd() % 6; k > 0 && s_record_count; k--)
+            cache_remove(s_records[rnd() % s_record_count].key);
+        if (rnd() % 20 == 0)
+            s_cache_count = 0;
+
+        if (rnd() % 8 == 0 && file_size() > 8)
+            damage(i);
+    }
+
+    remove(MANIFEST_PATH);
+    if (s_failed)
+        return 1;
+    printf("ok: %ld boots with %d records at the end\n", boots,
+           s_record_count);
+    return 0;
+}
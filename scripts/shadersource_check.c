@@ -0,0 +1,536 @@
+/*
+ * scripts/shadersource_check.c
+ *
+ * Runs glShaderSourceHook and glCompileShaderHook from
+ * loader/utils/glutil.c against a mock vitaGL whose "binaries" spell out
+ * the source they were compiled from. The same sources are submitted
+ * over and over, split into different fragments each time, with and
+ * without lengths, and checked against the complete source assembled the
+ * way the hook used to:
+ *
+ * - the gxp path is named after the hash128 of the complete source;
+ * - a miss compiles exactly that source and stores its binary there;
+ * - a hit loads the stored binary and compiles nothing;
+ * - a binary stored under the old name, the SHA1 of the complete source,
+ *   is picked up and renamed;
+ * - every source ends up in the shader manifest, and a later boot
+ *   precompiles the ones whose binaries went missing.
+ *
+ * Built by the host project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/shadersource_check [iterations]
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <ftw.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sha1/sha1.h>
+
+#include "reimpl/glstate.h"
+#include "reimpl/gltrace.h"
+#include "reimpl/glvbo.h"
+#include "utils/dialog.h"
+#include "utils/glutil.h"
+#include "utils/hash.h"
+#include "utils/shadermanifest.h"
+#include "utils/utils.h"
+
+#define GXP_DIR         DATA_PATH "gxp"
+#define PROGRAMS        150
+#define BODY_MAX        3000
+#define FRAGMENTS_MAX   24
+#define SHADERS         8
+
+extern char next_shader_fname[128];
+
+static const char prelude[] =
+        "inline float4 glslTexture2D(samplerCUBE x, float3 s) { return texCUBE(x,s); }\n";
+
+static uint32_t s_rng = 1;
+
+static uint32_t rnd(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static int s_failed;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+    } \
+} while (0)
+
+/*
+ * Mock vitaGL. A compiled binary is the shader type in hex followed by the
+ * source, so a binary can only be loaded back for the source it was
+ * compiled from.
+ */
+
+typedef struct shader {
+    int used;
+    GLenum type;
+    char * source;
+    uint32_t source_len;
+    char * binary;
+    uint32_t binary_len;
+    int compiled;
+    int loaded;
+} shader;
+
+static shader s_shaders[SHADERS];
+static int s_compiles;
+
+// Source of the last compile, to tell which one the loader precompiled
+static char * s_last_source;
+static uint32_t s_last_source_len;
+
+static char * make_binary(GLenum type, const char * src, uint32_t len,
+                          uint32_t * out_len) {
+    char * bin = malloc(len + 5);
+    snprintf(bin, 6, "%04X:", type & 0xFFFF);
+    memcpy(bin + 5, src, len);
+    *out_len = len + 5;
+    return bin;
+}
+
+static shader * get_shader(GLuint name) {
+    CHECK(name > 0 && name <= SHADERS && s_shaders[name - 1].used,
+          "shader %u doesn't exist", name);
+    return &s_shaders[name - 1];
+}
+
+GLuint glCreateShader(GLenum type) {
+    for (int i = 0; i < SHADERS; i++) {
+        if (!s_shaders[i].used) {
+            memset(&s_shaders[i], 0, sizeof(s_shaders[i]));
+            s_shaders[i].used = 1;
+            s_shaders[i].type = type;
+            return i + 1;
+        }
+    }
+    CHECK(0, "out of shaders");
+    exit(1);
+}
+
+void glDeleteShader(GLuint name) {
+    shader * s = get_shader(name);
+    free(s->source);
+    free(s->binary);
+    memset(s, 0, sizeof(*s));
+}
+
+void glShaderSource(GLuint name, GLsizei count, const GLchar * const * string,
+                    const GLint * length) {
+    shader * s = get_shader(name);
+    CHECK(count == 1 && length && length[0] >= 0,
+          "glShaderSource with %d fragments", count);
+    free(s->source);
+    s->source = malloc(length[0] + 1);
+    memcpy(s->source, string[0], length[0]);
+    s->source_len = length[0];
+}
+
+void glCompileShader(GLuint name) {
+    shader * s = get_shader(name);
+    CHECK(s->source, "compiling shader %u without a source", name);
+    if (!s->source)
+        return;
+    free(s->binary);
+    s->binary = make_binary(s->type, s->source, s->source_len,
+                            &s->binary_len);
+    s->compiled = 1;
+    s_compiles++;
+
+    free(s_last_source);
+    s_last_source = malloc(s->source_len + 1);
+    memcpy(s_last_source, s->source, s->source_len);
+    s_last_source_len = s->source_len;
+}
+
+void glGetShaderiv(GLuint name, GLenum pname, GLint * params) {
+    shader * s = get_shader(name);
+    if (pname == GL_SHADER_TYPE)
+        *params = (GLint)s->type;
+    else if (pname == GL_COMPILE_STATUS)
+        *params = s->compiled;
+    else
+        CHECK(0, "glGetShaderiv(0x%X)", pname);
+}
+
+void glShaderBinary(GLsizei count, const GLuint * handles,
+                    GLenum binaryFormat, const void * binary, GLsizei length) {
+    CHECK(count == 1, "glShaderBinary with %d shaders", count);
+    (void)binaryFormat;
+    shader * s = get_shader(handles[0]);
+    free(s->binary);
+    s->binary = malloc(length);
+    memcpy(s->binary, binary, length);
+    s->binary_len = length;
+    s->loaded = 1;
+}
+
+void vglGetShaderBinary(GLuint name, GLsizei bufSize, GLsizei * length,
+                        void * binary) {
+    shader * s = get_shader(name);
+    CHECK(s->binary && s->binary_len <= (uint32_t)bufSize,
+          "no binary for shader %u", name);
+    memcpy(binary, s->binary, s->binary_len);
+    *length = (GLsizei)s->binary_len;
+}
+
+void * vglMalloc(uint32_t size) {
+    return malloc(size);
+}
+
+void vglFree(void * addr) {
+    free(addr);
+}
+
+GLboolean vglInitExtended(int legacy_pool_size, int width, int height,
+                          int ram_threshold, SceGxmMultisampleMode msaa) {
+    (void)legacy_pool_size; (void)width; (void)height; (void)ram_threshold;
+    (void)msaa;
+    return GL_TRUE;
+}
+
+void vglAddSemanticBinding(const char * varying, int index,
+                           vglSemanticType type) {
+    (void)varying; (void)index; (void)type;
+}
+
+void vglSwapBuffers(GLboolean has_commondialog) {
+    (void)has_commondialog;
+}
+
+// The rest of the loader that gl_init() and gl_swap() call into
+
+void glstate_invalidate(void) {}
+void glstate_frame_end(void) {}
+void glvbo_invalidate(void) {}
+void glvbo_frame_end(void) {}
+void gltrace_frame_end(void) {}
+
+void fatal_error(const char * fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    exit(1);
+}
+
+/*
+ * Sources, and what the hook should make of them
+ */
+
+typedef struct program {
+    GLenum type;
+    char * full; // prelude + body
+    uint32_t len;
+    char key[HASH128_HEX_LEN + 1];
+    char path[128];
+    int on_disk;
+    int in_manifest;
+} program;
+
+static program s_programs[PROGRAMS];
+
+// Whether the game compiled a shader since the last frame
+static int s_game_compiled;
+static int s_precompiled;
+
+static void make_programs(void) {
+    for (int i = 0; i < PROGRAMS; i++) {
+        program * p = &s_programs[i];
+        uint32_t body = i == 0 ? 0 : rnd() % BODY_MAX;
+
+        p->type = rnd() % 2 ? GL_VERTEX_SHADER : GL_FRAGMENT_SHADER;
+        p->len = sizeof(prelude) - 1 + body;
+        p->full = malloc(p->len + 1);
+        memcpy(p->full, prelude, sizeof(prelude) - 1);
+        for (uint32_t k = sizeof(prelude) - 1; k < p->len; k++)
+            p->full[k] = (char)(rnd() % 8 ? 'a' + rnd() % 26 : ' ' + rnd() % 95);
+        p->full[p->len] = '\0';
+
+        uint8_t digest[HASH128_SIZE];
+        hash128(p->full, p->len, digest);
+        hex_encode(digest, HASH128_SIZE, p->key);
+        snprintf(p->path, sizeof(p->path), GXP_DIR "/%c%c/%s.gxp",
+                 p->key[0], p->key[1], p->key);
+    }
+}
+
+// Where the hook put the binary before hash128, spelled the way it was
+static void legacy_path(const program * p, char * out, size_t size) {
+    uint8_t digest[SHA1_BLOCK_SIZE];
+    SHA1_CTX ctx;
+    sha1_init(&ctx);
+    sha1_update(&ctx, (const BYTE *)p->full, p->len);
+    sha1_final(&ctx, digest);
+
+    char name[SHA1_BLOCK_SIZE * 2 + 1];
+    for (int i = 0; i < SHA1_BLOCK_SIZE; i++)
+        sprintf(name + i * 2, "%02X", digest[i]);
+    snprintf(out, size, GXP_DIR "/%c%c/%s.gxp", name[0], name[1], name);
+}
+
+static int file_matches(const char * path, const char * data, uint32_t len) {
+    FILE * f = fopen(path, "rb");
+    if (!f)
+        return 0;
+    char * buf = malloc(len + 1);
+    size_t got = fread(buf, 1, len + 1, f);
+    fclose(f);
+    int same = got == len && memcmp(buf, data, len) == 0;
+    free(buf);
+    return same;
+}
+
+static void write_file(const char * path, const char * data, uint32_t len) {
+    char dir[128];
+    snprintf(dir, sizeof(dir), "%s", path);
+    mkpath(dir, 0755);
+    FILE * f = fopen(path, "wb");
+    fwrite(data, 1, len, f);
+    fclose(f);
+}
+
+static int remove_entry(const char * path, const struct stat * st, int flag,
+                        struct FTW * ftw) {
+    (void)st; (void)flag; (void)ftw;
+    return remove(path);
+}
+
+/*
+ * The body split at random points. Each fragment is NUL-terminated with
+ * no length, has its exact length, a length of -1, or a length that stops
+ * short of what's in the buffer.
+ */
+typedef struct fragments {
+    GLsizei count;
+    const GLchar * string[FRAGMENTS_MAX];
+    GLint length[FRAGMENTS_MAX];
+    int has_length;
+    char * storage[FRAGMENTS_MAX];
+} fragments;
+
+static void split(const program * p, fragments * out) {
+    const char * body = p->full + sizeof(prelude) - 1;
+    uint32_t body_len = p->len - (sizeof(prelude) - 1);
+
+    out->count = 1 + rnd() % FRAGMENTS_MAX;
+    out->has_length = rnd() % 3 != 0;
+
+    uint32_t cuts[FRAGMENTS_MAX + 1];
+    cuts[0] = 0;
+    cuts[out->count] = body_len;
+    for (GLsizei i = 1; i < out->count; i++)
+        cuts[i] = body_len ? rnd() % (body_len + 1) : 0;
+    // Sort the inner cuts
+    for (GLsizei i = 1; i < out->count; i++) {
+        for (GLsizei k = i; k > 1 && cuts[k - 1] > cuts[k]; k--) {
+            uint32_t t = cuts[k];
+            cuts[k] = cuts[k - 1];
+            cuts[k - 1] = t;
+        }
+    }
+
+    for (GLsizei i = 0; i < out->count; i++) {
+        uint32_t len = cuts[i + 1] - cuts[i];
+        int mode = out->has_length ? (int)(rnd() % 3) : -1;
+        uint32_t tail = mode == 2 ? 1 + rnd() % 8 : 0;
+
+        char * s = malloc(len + tail + 1);
+        memcpy(s, body + cuts[i], len);
+        for (uint32_t k = 0; k < tail; k++)
+            s[len + k] = '#';
+        s[len + tail] = '\0';
+
+        out->storage[i] = s;
+        out->string[i] = s;
+        out->length[i] = mode == 1 ? -1 : (GLint)len;
+    }
+}
+
+static void free_fragments(fragments * f) {
+    for (GLsizei i = 0; i < f->count; i++)
+        free(f->storage[i]);
+}
+
+// The game submits and compiles program `i`
+static void submit(int i, long step) {
+    program * p = &s_programs[i];
+
+    // Now and then the binary is only there under its old name
+    char old[128];
+    legacy_path(p, old, sizeof(old));
+    int legacy = !p->on_disk && rnd() % 8 == 0;
+    uint32_t bin_len;
+    char * bin = make_binary(p->type, p->full, p->len, &bin_len);
+    if (legacy)
+        write_file(old, bin, bin_len);
+
+    fragments f;
+    split(p, &f);
+
+    int compiles = s_compiles;
+    GLuint name = glCreateShader(p->type);
+    glShaderSourceHook(name, f.count, f.string,
+                       f.has_length ? f.length : NULL);
+    shader * s = get_shader(name);
+
+    CHECK(!strcmp(next_shader_fname, p->path), "step %ld: program %d at "
+          "%s, want %s", step, i, next_shader_fname, p->path);
+    CHECK(shader_manifest_known(p->key), "step %ld: program %d not in the "
+          "manifest", step, i);
+
+    int hit = p->on_disk || legacy;
+    if (hit) {
+        CHECK(s->loaded && !s->source && s->binary_len == bin_len
+              && !memcmp(s->binary, bin, bin_len),
+              "step %ld: program %d should have loaded its binary", step, i);
+    } else {
+        CHECK(!s->loaded && s->source && s->source_len == p->len
+              && !memcmp(s->source, p->full, p->len),
+              "step %ld: program %d got another source (%u bytes, want %u)",
+              step, i, s->source_len, p->len);
+    }
+
+    glCompileShaderHook(name);
+    CHECK(s_compiles == compiles + !hit, "step %ld: program %d compiled "
+          "%d times", step, i, s_compiles - compiles);
+    CHECK(file_matches(p->path, bin, bin_len), "step %ld: program %d has "
+          "no binary at its path", step, i);
+    if (legacy)
+        CHECK(!file_exists(old), "step %ld: program %d left its old binary "
+              "behind", step, i);
+    p->on_disk = 1;
+    p->in_manifest = 1;
+    s_game_compiled |= !hit;
+
+    glDeleteShader(name);
+    free_fragments(&f);
+    free(bin);
+}
+
+/*
+ * Frame boundary: the loader precompiles one shader from the manifest,
+ * unless the game compiled one itself this frame.
+ */
+static void frame(long step) {
+    int compiles = s_compiles;
+    gl_swap();
+
+    int precompiled = s_compiles - compiles;
+    CHECK(precompiled <= !s_game_compiled, "step %ld: %d precompiled in a "
+          "frame, the game compiled %d", step, precompiled, s_game_compiled);
+    s_game_compiled = 0;
+    if (!precompiled)
+        return;
+
+    int i = 0;
+    while (i < PROGRAMS && (s_programs[i].len != s_last_source_len
+           || memcmp(s_programs[i].full, s_last_source, s_last_source_len)))
+        i++;
+    CHECK(i < PROGRAMS, "step %ld: precompiled an unknown source", step);
+    if (i == PROGRAMS)
+        return;
+
+    program * p = &s_programs[i];
+    CHECK(p->in_manifest && !p->on_disk, "step %ld: precompiled program %d,"
+          " which is cached or unknown", step, i);
+
+    uint32_t bin_len;
+    char * bin = make_binary(p->type, p->full, p->len, &bin_len);
+    CHECK(file_matches(p->path, bin, bin_len), "step %ld: precompiled "
+          "program %d has no binary at its path", step, i);
+    p->on_disk = 1;
+    s_precompiled++;
+    free(bin);
+}
+
+// Frames until the manifest has nothing left to precompile
+static void drain(long step) {
+    for (int n = 0; n <= PROGRAMS && shader_manifest_pending(); n++)
+        frame(step);
+    CHECK(shader_manifest_pending() == 0, "step %ld: %u left to precompile",
+          step, shader_manifest_pending());
+
+    for (int i = 0; i < PROGRAMS; i++) {
+        CHECK(s_programs[i].on_disk || !s_programs[i].in_manifest,
+              "step %ld: program %d wasn't precompiled", step, i);
+    }
+}
+
+/*
+ * A later boot: some binaries are gone, maybe the manifest too. The ones
+ * the manifest knows get queued, and are precompiled either right away
+ * or between the game's own shaders.
+ */
+static void reboot(long step) {
+    if (rnd() % 10 == 0) {
+        remove(GXP_DIR "/manifest.bin");
+        for (int i = 0; i < PROGRAMS; i++)
+            s_programs[i].in_manifest = 0;
+    }
+
+    int queued = 0;
+    for (int i = 0; i < PROGRAMS; i++) {
+        program * p = &s_programs[i];
+        if (p->on_disk && rnd() % 6 == 0) {
+            remove(p->path);
+            p->on_disk = 0;
+        }
+        queued += p->in_manifest && !p->on_disk;
+    }
+
+    gl_init();
+    CHECK(shader_manifest_pending() == (uint32_t)queued, "step %ld: %u "
+          "queued, want %d", step, shader_manifest_pending(), queued);
+    if (rnd() % 2)
+        drain(step);
+}
+
+int main(int argc, char ** argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 20000;
+
+    nftw(GXP_DIR, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    make_programs();
+    gl_init();
+
+    long submitted = 0;
+    for (long i = 0; i < iterations; i++) {
+        if (rnd() % 500 == 0) {
+            reboot(i);
+            continue;
+        }
+
+        submit(rnd() % PROGRAMS, i);
+        submitted++;
+        if (rnd() % 4 == 0)
+            frame(i);
+    }
+    reboot(iterations);
+    drain(iterations);
+
+    nftw(GXP_DIR, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    if (s_failed)
+        return 1;
+    printf("ok: %ld sources submitted, %d compiled, %d of them ahead of "
+           "time\n", submitted, s_compiles, s_precompiled);
+    return 0;
+}
@@ -0,0 +1,186 @@
+/*
+ * scripts/strmem_check.c
+ *
+ * Compares loader/reimpl/strmem.c with the host libc on random sizes,
+ * offsets and contents, and checks that the string functions never read
+ * into the page after the string. Built by the host project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/strmem_check [iterations]
+ *
+ * The buffers are mmap()ed, since the word-at-a-time loads may read past
+ * the end of a string within its page, which is fine on the device but
+ * would upset a sanitizer.
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "reimpl/strmem.h"
+
+#define BUF_SIZE    4096
+#define MAX_LEN     600
+
+#define SIGN(x) ((x) > 0 ? 1 : (x) < 0 ? -1 : 0)
+
+static uint32_t s_rng = 1;
+
+static uint32_t rnd(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static int s_failed;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+    } \
+} while (0)
+
+// Few distinct bytes and some zeros, so that compares run into equal
+// stretches and string ends
+static void fill(uint8_t * buf, size_t len) {
+    for (size_t i = 0; i < len; i++)
+        buf[i] = rnd() % 64 == 0 ? 0 : (uint8_t)(1 + rnd() % 3);
+}
+
+static void * map(size_t len) {
+    void * p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    return p;
+}
+
+static void check_mem(uint8_t * a, uint8_t * b, uint8_t * c) {
+    fill(a, BUF_SIZE);
+    size_t n = rnd() % MAX_LEN;
+    if (rnd() % 16 == 0)
+        n = rnd() % (BUF_SIZE / 2); // large copies take the 64-byte loop
+    size_t o1 = rnd() % (BUF_SIZE - n);
+    size_t o2 = rnd() % (BUF_SIZE - n);
+
+    memcpy(b, a, BUF_SIZE);
+    memcpy(c, a, BUF_SIZE);
+    memmove(b + o1, b + o2, n);
+    CHECK(memmove_soloader(c + o1, c + o2, n) == c + o1, "memmove return");
+    CHECK(memcmp(b, c, BUF_SIZE) == 0, "memmove n=%zu dst=%zu src=%zu",
+          n, o1, o2);
+
+    if (o1 + n <= o2 || o2 + n <= o1) {
+        memcpy(b, a, BUF_SIZE);
+        memcpy(c, a, BUF_SIZE);
+        memcpy(b + o1, b + o2, n);
+        CHECK(memcpy_soloader(c + o1, c + o2, n) == c + o1, "memcpy return");
+        CHECK(memcmp(b, c, BUF_SIZE) == 0, "memcpy n=%zu dst=%zu src=%zu",
+              n, o1, o2);
+    }
+
+    int v = (int)rnd();
+    memset(b + o1, v, n);
+    CHECK(memset_soloader(c + o1, v, n) == c + o1, "memset return");
+    CHECK(memcmp(b, c, BUF_SIZE) == 0, "memset n=%zu at=%zu", n, o1);
+
+    memcpy(b, a, BUF_SIZE);
+    if (n && rnd() % 2)
+        b[o2 + rnd() % n] ^= (uint8_t)(1 + rnd() % 255);
+    CHECK(SIGN(memcmp(a + o1, b + o2, n))
+          == SIGN(memcmp_soloader(a + o1, b + o2, n)),
+          "memcmp n=%zu a=%zu b=%zu", n, o1, o2);
+    CHECK(SIGN(memcmp(a + o1, a + o1, n))
+          == SIGN(memcmp_soloader(a + o1, a + o1, n)), "memcmp same");
+
+    int ch = rnd() % 2 ? 3 : (int)(rnd() % 256) | 0x300; // only the low byte
+    CHECK(memchr(a + o1, ch, n) == memchr_soloader(a + o1, ch, n),
+          "memchr n=%zu at=%zu c=%d", n, o1, ch);
+}
+
+static void check_str(uint8_t * a, uint8_t * b) {
+    fill(a, BUF_SIZE);
+    a[BUF_SIZE - 1] = 0;
+    memcpy(b, a, BUF_SIZE);
+    if (rnd() % 2)
+        b[rnd() % BUF_SIZE] = (uint8_t)(rnd() % 4);
+    b[BUF_SIZE - 1] = 0;
+
+    size_t o1 = rnd() % BUF_SIZE;
+    size_t o2 = rnd() % 2 ? o1 : rnd() % BUF_SIZE;
+    size_t n = rnd() % MAX_LEN;
+    const char * s1 = (const char *)a + o1;
+    const char * s2 = (const char *)b + o2;
+
+    CHECK(strlen(s1) == strlen_soloader(s1), "strlen at=%zu", o1);
+    CHECK(SIGN(strcmp(s1, s2)) == SIGN(strcmp_soloader(s1, s2)),
+          "strcmp a=%zu b=%zu", o1, o2);
+    CHECK(SIGN(strncmp(s1, s2, n)) == SIGN(strncmp_soloader(s1, s2, n)),
+          "strncmp a=%zu b=%zu n=%zu", o1, o2, n);
+}
+
+// Strings that end right before an inaccessible page: reading past them
+// into it would crash
+static void check_page_end(void) {
+    long page = sysconf(_SC_PAGESIZE);
+    uint8_t * a = map(2 * page);
+    uint8_t * b = map(2 * page);
+    mprotect(a + page, page, PROT_NONE);
+    mprotect(b + page, page, PROT_NONE);
+
+    for (int len = 0; len < 100; len++) {
+        for (int shift = 0; shift < 2; shift++) {
+            char * s1 = (char *)a + page - len - 1;
+            char * s2 = (char *)b + page - len - 1 - shift;
+            memset(s1, 'x', len);
+            s1[len] = 0;
+            memset(s2, 'x', len + shift);
+            s2[len + shift] = 0;
+
+            CHECK(strlen_soloader(s1) == (size_t)len, "strlen len=%d", len);
+            CHECK(SIGN(strcmp_soloader(s1, s2)) == SIGN(strcmp(s1, s2)),
+                  "strcmp len=%d shift=%d", len, shift);
+            CHECK(SIGN(strncmp_soloader(s1, s2, 200))
+                  == SIGN(strncmp(s1, s2, 200)),
+                  "strncmp len=%d shift=%d", len, shift);
+            CHECK(memchr_soloader(s1, 'y', len) == NULL, "memchr len=%d", len);
+            CHECK(memcmp_soloader(s1, s2, len) == 0, "memcmp len=%d", len);
+        }
+    }
+
+    munmap(a, 2 * page);
+    munmap(b, 2 * page);
+}
+
+int main(int argc, char ** argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 50000;
+
+    uint8_t * a = map(BUF_SIZE);
+    uint8_t * b = map(BUF_SIZE);
+    uint8_t * c = map(BUF_SIZE);
+
+    for (long i = 0; i < iterations; i++) {
+        check_mem(a, b, c);
+        check_str(a, b);
+    }
+    check_page_end();
+
+    if (s_failed)
+        return 1;
+    printf("ok: %ld random cases, page ends\n", iterations);
+    return 0;
+}
@@ -0,0 +1,419 @@
+/*
+ * scripts/writebehind_check.c
+ *
+ * Checks loader/utils/writebehind.c: which files it takes, what printf,
+ * puts, putc and seeking past the end write, that an empty file replaces
+ * what was there, that fflush() puts the data on the card at once and a
+ * close with nothing new then commits nothing, and that a failed write
+ * keeps the old file. With the commit thread held up, closes don't wait
+ * for it, a file closed again and again is committed once, with the
+ * latest contents, and a flush neither overtakes what was queued nor is
+ * overtaken by a wait for the file. Then several threads save the same
+ * few files at once; a file read back always has the length its header
+ * says. Built by the host project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/writebehind_check [saves per thread]
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "utils/utils.h"
+#include "utils/writebehind.h"
+
+#define FILES       DATA_PATH "writebehind_check/"
+#define THREADS     8
+#define SAVES       4
+#define HEADER      "HDR:%09zu"
+#define HEADER_LEN  13
+
+static int s_failed;
+static pthread_mutex_t s_fail_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        pthread_mutex_lock(&s_fail_lock); \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+        pthread_mutex_unlock(&s_fail_lock); \
+    } \
+} while (0)
+
+static volatile int s_commits;
+
+// The commit thread can be held up in here, after a commit
+static pthread_mutex_t s_gate_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_gate_cond = PTHREAD_COND_INITIALIZER;
+static bool s_gate_closed;
+static bool s_held;
+static char s_counted[256];
+static int s_counted_commits;
+
+static void committed(const char * path) {
+    __sync_fetch_and_add(&s_commits, 1);
+
+    pthread_mutex_lock(&s_gate_lock);
+    if (strcmp(path, s_counted) == 0)
+        s_counted_commits++;
+    s_held = s_gate_closed;
+    pthread_cond_broadcast(&s_gate_cond);
+    while (s_gate_closed)
+        pthread_cond_wait(&s_gate_cond, &s_gate_lock);
+    s_held = false;
+    pthread_mutex_unlock(&s_gate_lock);
+}
+
+// Contents of `path` in a malloc()ed buffer, or NULL if it isn't there
+static char * slurp(const char * path, size_t * len) {
+    FILE * f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char * data = malloc(size + 1);
+    *len = fread(data, 1, size, f);
+    fclose(f);
+    return data;
+}
+
+static bool has(const char * path, const char * data, size_t len) {
+    size_t got;
+    char * file = slurp(path, &got);
+    bool ok = file && got == len && !memcmp(file, data, len);
+    free(file);
+    return ok;
+}
+
+static int wb_printf(writebehind_file * f, const char * format, ...) {
+    va_list args;
+    va_start(args, format);
+    int ret = writebehind_vprintf(f, format, args);
+    va_end(args);
+    return ret;
+}
+
+static void save(const char * path, const char * data) {
+    writebehind_file * f = writebehind_open(path, "wb");
+    CHECK(f, "%s not opened", path);
+    if (!f)
+        return;
+    writebehind_puts(data, f);
+    CHECK(writebehind_close(f) == 0, "%s not closed", path);
+}
+
+static void check_open(void) {
+    char other[] = DATA_PATH "writebehind_other.txt";
+    CHECK(!writebehind_open(other, "wb"), "took a file outside the root");
+    CHECK(!writebehind_open(FILES "a.txt", "ab"), "took a file to append");
+    CHECK(!writebehind_open(FILES "a.txt", "w+"), "took a file to read");
+    CHECK(!writebehind_open(FILES "a.txt", "rb"), "took a file to read");
+
+    // As many as there are slots, no more
+    writebehind_file * files[17];
+    int n = 0;
+    while (n < 17 && (files[n] = writebehind_open(FILES "a.txt", "w")))
+        n++;
+    CHECK(n == 16, "%d files open at once", n);
+    CHECK(writebehind_owns(files[0]) && !writebehind_owns((char *)files[0] + 1)
+          && !writebehind_owns(&n), "owns");
+    while (n--)
+        writebehind_close(files[n]);
+    writebehind_sync(NULL);
+}
+
+static void check_writes(void) {
+    static const char path[] = FILES "settings.txt";
+    writebehind_file * f = writebehind_open(path, "w");
+
+    // Memory used before, so the hole below isn't zeros by luck
+    char * volatile used = malloc(16 * 1024);
+    memset(used, 0xAA, 16 * 1024);
+    free(used);
+
+    CHECK(wb_printf(f, "%s %d\n", "key", 42) == 7, "printf");
+    CHECK(writebehind_puts("tail", f) == 0, "puts");
+
+    // Longer than printf's own buffer
+    char line[3000];
+    memset(line, 'L', sizeof(line) - 1);
+    line[sizeof(line) - 1] = '\0';
+    CHECK(wb_printf(f, "%s", line) == (int)sizeof(line) - 1, "long printf");
+
+    // Past the end: a hole of zeros
+    CHECK(writebehind_seek(f, 10, SEEK_END) == 0, "seek");
+    CHECK(writebehind_putc('!', f) == '!', "putc");
+    CHECK(writebehind_tell(f) == 7 + 4 + 2999 + 11, "tell %lld",
+          (long long)writebehind_tell(f));
+    CHECK(writebehind_seek(f, -1, SEEK_SET) != 0, "seek before the start");
+
+    // Then back over what was written
+    CHECK(writebehind_seek(f, 4, SEEK_SET) == 0
+          && writebehind_puts("43", f) == 0, "overwrite");
+    CHECK(writebehind_close(f) == 0, "close");
+    writebehind_sync(path);
+
+    char want[7 + 4 + 2999 + 11];
+    sprintf(want, "key 43\ntail%s", line);
+    memset(want + 7 + 4 + 2999, 0, 10);
+    want[sizeof(want) - 1] = '!';
+    CHECK(has(path, want, sizeof(want)), "contents");
+
+    // Opening it empty empties it
+    writebehind_close(writebehind_open(path, "wb"));
+    writebehind_sync(path);
+    CHECK(has(path, "", 0), "not emptied");
+}
+
+static void check_flush(void) {
+    static const char path[] = FILES "flushed.txt";
+    int before = s_commits;
+
+    writebehind_file * f = writebehind_open(path, "wb");
+    writebehind_puts("flushed", f);
+    CHECK(writebehind_flush(f) == 0, "flush");
+    CHECK(s_commits == before + 1, "%d commits on flush", s_commits - before);
+    CHECK(has(path, "flushed", 7), "flush didn't write it");
+
+    CHECK(writebehind_flush(f) == 0, "second flush");
+    CHECK(writebehind_close(f) == 0, "close");
+    writebehind_sync(NULL);
+    CHECK(s_commits == before + 1, "%d commits on a clean close",
+          s_commits - before);
+}
+
+static void check_failed_write(void) {
+    static const char path[] = FILES "failed.txt";
+    save(path, "old");
+    writebehind_sync(path);
+
+    // No memory for a file that large
+    writebehind_file * f = writebehind_open(path, "wb");
+    writebehind_puts("new", f);
+    CHECK(writebehind_seek(f, SIZE_MAX / 2, SEEK_SET) == 0, "seek far");
+    CHECK(writebehind_putc('x', f) == EOF, "huge write didn't fail");
+    CHECK(writebehind_error(f), "no error");
+    CHECK(writebehind_flush(f) == EOF, "flush after a failed write");
+    CHECK(writebehind_close(f) == EOF, "close after a failed write");
+    writebehind_sync(NULL);
+    CHECK(has(path, "old", 3), "old file not kept");
+}
+
+// Leaves the commit thread stuck after committing a file of its own
+static void hold(void) {
+    pthread_mutex_lock(&s_gate_lock);
+    s_gate_closed = true;
+    pthread_mutex_unlock(&s_gate_lock);
+
+    save(FILES "blocker.txt", "blocker");
+    pthread_mutex_lock(&s_gate_lock);
+    while (!s_held)
+        pthread_cond_wait(&s_gate_cond, &s_gate_lock);
+    pthread_mutex_unlock(&s_gate_lock);
+}
+
+static void release(void) {
+    pthread_mutex_lock(&s_gate_lock);
+    s_gate_closed = false;
+    pthread_cond_broadcast(&s_gate_cond);
+    pthread_mutex_unlock(&s_gate_lock);
+}
+
+static void * release_later(void * arg) {
+    usleep(100 * 1000);
+    release();
+    return arg;
+}
+
+static void check_coalescing(void) {
+    static const char path[] = FILES "coalesced.txt";
+    strcpy(s_counted, path);
+    s_counted_commits = 0;
+    hold();
+
+    // The thread is stuck; these only queue, and replace each other
+    char data[16];
+    for (int i = 0; i < 5; i++) {
+        sprintf(data, "version %d", i);
+        save(path, data);
+    }
+
+    release();
+    writebehind_sync(path);
+    CHECK(has(path, data, strlen(data)), "not the latest");
+    CHECK(s_counted_commits == 1, "%d commits", s_counted_commits);
+    s_counted[0] = '\0';
+}
+
+static void check_flush_order(void) {
+    static const char path[] = FILES "ordered.txt";
+    hold();
+    save(path, "queued");
+
+    // The flush waits for the queued commit, which waits for the thread
+    pthread_t thread;
+    pthread_create(&thread, NULL, release_later, NULL);
+    writebehind_file * f = writebehind_open(path, "wb");
+    writebehind_puts("flushed", f);
+    CHECK(writebehind_flush(f) == 0, "flush");
+    writebehind_close(f);
+    pthread_join(thread, NULL);
+
+    writebehind_sync(NULL);
+    CHECK(has(path, "flushed", 7), "an older commit landed after the flush");
+}
+
+static volatile bool s_synced;
+
+static void * flush_ordered(void * arg) {
+    writebehind_file * f = writebehind_open(FILES "ordered.txt", "wb");
+    writebehind_puts("flushed again", f);
+    CHECK(writebehind_flush(f) == 0, "flush");
+    writebehind_close(f);
+    return arg;
+}
+
+static void * sync_ordered(void * arg) {
+    writebehind_sync(FILES "ordered.txt");
+    s_synced = true;
+    return arg;
+}
+
+// Waiting for a file waits for a flush under way on another thread too
+static void check_flush_sync(void) {
+    pthread_mutex_lock(&s_gate_lock);
+    s_gate_closed = true;
+    pthread_mutex_unlock(&s_gate_lock);
+
+    pthread_t flusher, syncer;
+    pthread_create(&flusher, NULL, flush_ordered, NULL);
+    pthread_mutex_lock(&s_gate_lock);
+    while (!s_held)
+        pthread_cond_wait(&s_gate_cond, &s_gate_lock);
+    pthread_mutex_unlock(&s_gate_lock);
+
+    pthread_create(&syncer, NULL, sync_ordered, NULL);
+    usleep(100 * 1000);
+    CHECK(!s_synced, "sync didn't wait for the flush");
+
+    release();
+    pthread_join(flusher, NULL);
+    pthread_join(syncer, NULL);
+    CHECK(s_synced, "sync never returned");
+}
+
+static int s_saves;
+
+static void * thread_main(void * arg) {
+    int t = (int)(uintptr_t)arg;
+    uint32_t state = t * 7919 + 1;
+    char path[256];
+    sprintf(path, FILES "save%d.dat", t % SAVES);
+    char * body = malloc(70000);
+    memset(body, 'a' + t, 70000);
+
+    for (int n = 0; n < s_saves; n++) {
+        // Read back whole: what the header says, or not there mid-commit
+        size_t len;
+        char * file = slurp(path, &len);
+        if (file) {
+            file[len] = '\0';
+            bool ok = len >= HEADER_LEN && !memcmp(file, "HDR:", 4)
+                      && strtoul(file + 4, NULL, 10) == len;
+            CHECK(ok, "thread %d: %s torn, %zu bytes", t, path, len);
+            free(file);
+        }
+
+        writebehind_file * f = writebehind_open(path, "wb");
+        if (!f) {
+            n--;
+            continue;
+        }
+
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        len = 100 + state % 60000;
+
+        // Header, the end, then the middle
+        wb_printf(f, HEADER, len);
+        writebehind_seek(f, len - 1, SEEK_SET);
+        writebehind_putc('z', f);
+        writebehind_seek(f, HEADER_LEN, SEEK_SET);
+        writebehind_write(f, body, len - HEADER_LEN - 1);
+        CHECK(writebehind_tell(f) == (int64_t)len - 1, "thread %d: tell", t);
+
+        if (state % 5 == 0)
+            CHECK(writebehind_flush(f) == 0, "thread %d: flush", t);
+        CHECK(writebehind_close(f) == 0, "thread %d: close", t);
+    }
+    free(body);
+    return NULL;
+}
+
+static void check_threads(int saves) {
+    int before = s_commits;
+    s_saves = saves;
+
+    pthread_t threads[THREADS];
+    for (int i = 0; i < THREADS; i++)
+        pthread_create(&threads[i], NULL, thread_main, (void *)(uintptr_t)i);
+    for (int i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+    writebehind_sync(NULL);
+
+    for (int i = 0; i < SAVES; i++) {
+        char path[256];
+        sprintf(path, FILES "save%d.dat", i);
+        size_t len;
+        char * file = slurp(path, &len);
+        CHECK(file && strtoul(file + 4, NULL, 10) == len, "%s at the end",
+              path);
+        free(file);
+    }
+
+    int commits = s_commits - before;
+    CHECK(commits > 0 && commits <= THREADS * saves, "%d commits", commits);
+    printf("   %d threads: %d saves, %d commits\n", THREADS, THREADS * saves,
+           commits);
+}
+
+int main(int argc, char ** argv) {
+    int saves = argc > 1 ? atoi(argv[1]) : 200;
+
+    char dir[] = FILES;
+    mkpath(dir, 0755);
+
+    writebehind_file * f = writebehind_open(FILES "a.txt", "wb");
+    CHECK(!f, "took a file before init");
+    writebehind_init(FILES, committed);
+
+    check_open();
+    check_writes();
+    check_flush();
+    check_failed_write();
+    check_coalescing();
+    check_flush_order();
+    check_flush_sync();
+    check_threads(saves);
+
+    if (s_failed)
+        return 1;
+    printf("ok: %d saves on %d threads, none torn\n", THREADS * saves,
+           THREADS);
+    return 0;
+}
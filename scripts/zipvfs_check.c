@@ -0,0 +1,638 @@
+/*
+ * scripts/zipvfs_check.c
+ *
+ * Checks loader/utils/zipvfs.c against a zip archive written here, with
+ * stored, deflated and empty entries, nested and explicit directories, an
+ * encrypted entry and a file outside the mounted root. Every entry is read
+ * in full and at random offsets and lengths, with seeks both ways,
+ * positional reads that must leave the handle alone, getc, ungetc and
+ * gets, and compared with the data it was made from; directory stat,
+ * zipvfs_load() and the descriptor table are checked as well. Prefetched
+ * ranges of stored and deflated entries must be read without a miss.
+ *
+ * The archive can only be mounted once per process, so every mount is done
+ * in a child:
+ *
+ * - without an index, which builds and stores one;
+ * - with the stored index and the archive's central directory broken, which
+ *   only works if the index is used instead of the archive's own;
+ * - with a truncated index, which is rebuilt;
+ * - with the index older than the archive, which isn't trusted.
+ *
+ * Built by the host project:
+ *
+ *   cmake -S scripts/host -B build-host && cmake --build build-host
+ *   ./build-host/zipvfs_check
+ *
+ * Copyright (C) 2023 Volodymyr Atamanenko
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license. See the LICENSE file for details.
+ */
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "utils/blockcache.h"
+#include "utils/utils.h"
+#include "utils/zipvfs.h"
+
+#define ARCHIVE     DATA_PATH "zipvfs_check.apk"
+#define INDEX       ARCHIVE ".idx"
+#define LOOSE       DATA_PATH "zipvfs_check/"
+#define ROOT        "assets/"
+#define MOUNT       "/files/"
+#define MAX_FILES   32 // open at once, ZIPVFS_MAX_FILES in zipvfs.c
+
+// 2023-05-06 12:34:56 in DOS format
+#define DOS_DATE    (((2023 - 1980) << 9) | (5 << 5) | 6)
+#define DOS_TIME    ((12 << 11) | (34 << 5) | (56 / 2))
+
+static uint32_t s_rng = 1;
+
+static uint32_t rnd(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static int s_failed;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (++s_failed > 10) exit(1); \
+    } \
+} while (0)
+
+typedef struct entry {
+    const char * name;
+    uint16_t method;
+    uint16_t flags;
+    uint8_t * data;
+    uint32_t size;
+} entry;
+
+enum { TEXT, RANDOM, REPEAT, BIG, EMPTY, EMPTY_DEFLATED, DIR, SECRET, LIB,
+       ENTRIES };
+
+static entry s_entries[ENTRIES] = {
+    [TEXT] = { "assets/data/a.txt", Z_DEFLATED },
+    [RANDOM] = { "assets/data/sub/rand.bin", 0 },
+    [REPEAT] = { "assets/data/sub/rep.bin", Z_DEFLATED },
+    [BIG] = { "assets/big.bin", 0 },
+    [EMPTY] = { "assets/empty", 0 },
+    [EMPTY_DEFLATED] = { "assets/data/empty.z", Z_DEFLATED },
+    [DIR] = { "assets/data/sub/", 0 },
+    [SECRET] = { "assets/secret.bin", 0, 1 },
+    [LIB] = { "lib/armeabi-v7a/libtest.so", Z_DEFLATED },
+};
+
+#define TEXT_LINES 3000
+
+static void make_data(void) {
+    entry * e = &s_entries[TEXT];
+    e->data = malloc(TEXT_LINES * 32);
+    for (int i = 0; i < TEXT_LINES; i++)
+        e->size += sprintf((char *)e->data + e->size, "line %d of text\n", i);
+
+    static const uint32_t sizes[ENTRIES] = {
+        [RANDOM] = 200000, [REPEAT] = 300000, [BIG] = 1500000,
+        [SECRET] = 1000, [LIB] = 150000,
+    };
+    for (int i = 0; i < ENTRIES; i++) {
+        if (i == TEXT)
+            continue;
+        e = &s_entries[i];
+        e->size = sizes[i];
+        e->data = malloc(e->size + 1);
+        for (uint32_t k = 0; k < e->size; k++) {
+            // Repetitive enough to compress, random enough not to vanish
+            e->data[k] = i == REPEAT || i == LIB ? "abcdefgh"[rnd() % 8]
+                                                 : (uint8_t)rnd();
+        }
+    }
+}
+
+static uint8_t * put16(uint8_t * p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    return p + 2;
+}
+
+static uint8_t * put32(uint8_t * p, uint32_t v) {
+    p = put16(p, v & 0xFFFF);
+    return put16(p, v >> 16);
+}
+
+static uint32_t s_central_end; // offset of the end of central directory
+
+static void write_archive(void) {
+    FILE * f = fopen(ARCHIVE, "wb");
+    uint8_t * central = malloc(ENTRIES * 512);
+    uint8_t * c = central;
+    uint32_t offset = 0;
+
+    for (int i = 0; i < ENTRIES; i++) {
+        entry * e = &s_entries[i];
+        uint32_t crc = (uint32_t)crc32(0, e->data, e->size);
+        uint8_t * out = e->data;
+        uint32_t csize = e->size;
+
+        if (e->method == Z_DEFLATED) {
+            z_stream zs = { 0 };
+            deflateInit2(&zs, 6, Z_DEFLATED, -MAX_WBITS, 8,
+                         Z_DEFAULT_STRATEGY);
+            uLong bound = deflateBound(&zs, e->size);
+            out = malloc(bound);
+            zs.next_in = e->data;
+            zs.avail_in = e->size;
+            zs.next_out = out;
+            zs.avail_out = (uInt)bound;
+            CHECK(deflate(&zs, Z_FINISH) == Z_STREAM_END, "deflate %s",
+                  e->name);
+            csize = (uint32_t)zs.total_out;
+            deflateEnd(&zs);
+        }
+
+        size_t name_len = strlen(e->name);
+        uint8_t local[30], * p = local;
+        p = put32(p, 0x04034B50);
+        p = put16(p, 20);
+        p = put16(p, e->flags);
+        p = put16(p, e->method);
+        p = put16(p, DOS_TIME);
+        p = put16(p, DOS_DATE);
+        p = put32(p, crc);
+        p = put32(p, csize);
+        p = put32(p, e->size);
+        p = put16(p, (uint32_t)name_len);
+        put16(p, 0);
+        fwrite(local, 1, sizeof(local), f);
+        fwrite(e->name, 1, name_len, f);
+        fwrite(out, 1, csize, f);
+
+        c = put32(c, 0x02014B50);
+        c = put16(c, 20);
+        c = put16(c, 20);
+        c = put16(c, e->flags);
+        c = put16(c, e->method);
+        c = put16(c, DOS_TIME);
+        c = put16(c, DOS_DATE);
+        c = put32(c, crc);
+        c = put32(c, csize);
+        c = put32(c, e->size);
+        c = put16(c, (uint32_t)name_len);
+        c = put16(c, 0);
+        c = put16(c, 0);
+        c = put16(c, 0);
+        c = put16(c, 0);
+        c = put32(c, 0);
+        c = put32(c, offset);
+        memcpy(c, e->name, name_len);
+        c += name_len;
+
+        offset += sizeof(local) + name_len + csize;
+        if (out != e->data)
+            free(out);
+    }
+
+    uint32_t central_size = (uint32_t)(c - central);
+    c = put32(c, 0x06054B50);
+    c = put16(c, 0);
+    c = put16(c, 0);
+    c = put16(c, ENTRIES);
+    c = put16(c, ENTRIES);
+    c = put32(c, central_size);
+    c = put32(c, offset);
+    c = put16(c, 0);
+    fwrite(central, 1, c - central, f);
+    fclose(f);
+    free(central);
+
+    s_central_end = offset + central_size;
+}
+
+static bool is_file(int i) {
+    return i != DIR && i != SECRET && i != LIB;
+}
+
+static void mount_path(int i, char * path) {
+    sprintf(path, MOUNT "%s", s_entries[i].name + strlen(ROOT));
+}
+
+static uint32_t entry_mtime(void) {
+    struct tm tm = {
+        .tm_sec = 56, .tm_min = 34, .tm_hour = 12,
+        .tm_mday = 6, .tm_mon = 4, .tm_year = 2023 - 1900,
+        .tm_isdst = -1,
+    };
+    return (uint32_t)mktime(&tm);
+}
+
+// Every file, in full and then piece by piece
+static void check_reads(void) {
+    uint8_t * buf = malloc(2 * 1024 * 1024);
+    uint8_t * pbuf = malloc(20000);
+    long ops = 0;
+
+    for (int i = 0; i < ENTRIES; i++) {
+        if (!is_file(i))
+            continue;
+        const entry * e = &s_entries[i];
+        char path[256];
+        mount_path(i, path);
+
+        zipvfs_stat st;
+        CHECK(zipvfs_path_stat(path, &st) && !st.dir && st.size == e->size
+              && st.mtime == entry_mtime(), "stat %s", path);
+
+        zipvfs_file * f = zipvfs_open(path);
+        CHECK(f, "open %s", path);
+        if (!f)
+            continue;
+        CHECK(zipvfs_size(f) == e->size, "size of %s", path);
+
+        size_t got = zipvfs_read(f, buf, e->size + 100);
+        CHECK(got == e->size && !memcmp(buf, e->data, got), "%s: read %zu "
+              "of %u bytes in one go", path, got, e->size);
+        CHECK(zipvfs_eof(f) && !zipvfs_error(f), "%s: eof %d, error %d at "
+              "the end", path, zipvfs_eof(f), zipvfs_error(f));
+        CHECK(zipvfs_getc(f) == EOF, "%s: getc at the end", path);
+
+        /*
+         * Mostly small reads, through the window, and some that skip it.
+         * Seeks go anywhere, so DEFLATE streams restart now and then.
+         */
+        for (int n = 0; n < 1000 && e->size; n++, ops++) {
+            uint32_t off = rnd() % e->size;
+            uint32_t len = rnd() % 3 ? rnd() % 100 : rnd() % 40000;
+
+            int whence = rnd() % 3;
+            int64_t arg = whence == SEEK_SET ? off
+                          : whence == SEEK_CUR ? (int64_t)off - zipvfs_tell(f)
+                          : (int64_t)off - e->size;
+            CHECK(zipvfs_seek(f, arg, whence) == 0, "%s: seek to %u", path,
+                  off);
+
+            // Positional reads in between leave the handle as it was
+            if (rnd() % 8 == 0) {
+                uint32_t at = rnd() % e->size;
+                uint32_t n = rnd() % 20000;
+                uint32_t in = at + n > e->size ? e->size - at : n;
+                int pgot = zipvfs_pread(f, pbuf, n, at);
+                CHECK(pgot == (int)in && !memcmp(pbuf, e->data + at, in),
+                      "%s: pread of %u at %u got %d", path, n, at, pgot);
+                CHECK(zipvfs_tell(f) == off, "%s: pread moved to %lld", path,
+                      (long long)zipvfs_tell(f));
+            }
+
+            uint32_t want = off + len > e->size ? e->size - off : len;
+            got = zipvfs_read(f, buf, len);
+            if (got != want || memcmp(buf, e->data + off, got)) {
+                CHECK(0, "%s: %u bytes at %u, got %zu", path, len, off, got);
+                break;
+            }
+            CHECK(zipvfs_tell(f) == off + got, "%s: at %lld after reading "
+                  "%zu at %u", path, (long long)zipvfs_tell(f), got, off);
+            CHECK(zipvfs_eof(f) == (len > want), "%s: eof %d after %u at %u",
+                  path, zipvfs_eof(f), len, off);
+
+            if (got && rnd() % 4 == 0) {
+                CHECK(zipvfs_ungetc('Z', f) == 'Z', "%s: ungetc", path);
+                CHECK(zipvfs_ungetc('Y', f) == EOF, "%s: second ungetc",
+                      path);
+                CHECK(zipvfs_tell(f) == off + got - 1, "%s: tell after "
+                      "ungetc", path);
+                CHECK(zipvfs_getc(f) == 'Z', "%s: getc after ungetc", path);
+                if (off + got < e->size) {
+                    CHECK(zipvfs_getc(f) == e->data[off + got], "%s: getc "
+                          "at %zu", path, off + got);
+                }
+            }
+        }
+        CHECK(!zipvfs_error(f), "%s: error set", path);
+
+        CHECK(zipvfs_pread(f, pbuf, 10, e->size) == 0
+              && zipvfs_pread(f, pbuf, 10, -1) < 0, "%s: pread out of range",
+              path);
+        CHECK(zipvfs_seek(f, -1, SEEK_SET) != 0, "%s: seek before the "
+              "start", path);
+        CHECK(zipvfs_seek(f, 0, 42) != 0, "%s: seek with a bad whence",
+              path);
+        CHECK(zipvfs_seek(f, 10, SEEK_END) == 0
+              && zipvfs_read(f, buf, 1) == 0 && zipvfs_eof(f),
+              "%s: read past the end", path);
+        zipvfs_close(f);
+    }
+
+    printf("   %ld random reads\n", ops);
+    free(buf);
+    free(pbuf);
+}
+
+static void check_gets(void) {
+    const entry * e = &s_entries[TEXT];
+    char path[256], line[64];
+    mount_path(TEXT, path);
+
+    zipvfs_file * f = zipvfs_open(path);
+    int n = 0;
+    while (zipvfs_gets(line, sizeof(line), f)) {
+        char want[64];
+        sprintf(want, "line %d of text\n", n);
+        CHECK(!strcmp(line, want), "line %d is '%s'", n, line);
+        n++;
+    }
+    CHECK(n == TEXT_LINES, "%d lines, want %d", n, TEXT_LINES);
+    CHECK(zipvfs_eof(f), "no eof after the last line");
+
+    // Lines longer than the buffer come in pieces
+    char * all = malloc(e->size + 1);
+    size_t len = 0;
+    zipvfs_seek(f, 0, SEEK_SET);
+    while (zipvfs_gets(line, 7, f)) {
+        CHECK(strlen(line) <= 6, "gets gave %zu bytes for 7", strlen(line));
+        memcpy(all + len, line, strlen(line));
+        len += strlen(line);
+    }
+    CHECK(len == e->size && !memcmp(all, e->data, len), "short gets put "
+          "together: %zu bytes", len);
+    free(all);
+
+    CHECK(zipvfs_gets(line, 0, f) == NULL, "gets with no room");
+    zipvfs_close(f);
+
+    mount_path(EMPTY, path);
+    f = zipvfs_open(path);
+    CHECK(zipvfs_gets(line, sizeof(line), f) == NULL && zipvfs_eof(f),
+          "gets from an empty file");
+    CHECK(zipvfs_ungetc('x', f) == EOF, "ungetc at the start");
+    zipvfs_close(f);
+}
+
+static void check_paths(void) {
+    zipvfs_stat st;
+    static const char * dirs[] = {
+        MOUNT "data", MOUNT "data/", MOUNT "data/sub", MOUNT "/data/sub//",
+    };
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+        CHECK(zipvfs_path_stat(dirs[i], &st) && st.dir, "%s is not a "
+              "directory", dirs[i]);
+        CHECK(!zipvfs_open(dirs[i]), "opened directory %s", dirs[i]);
+    }
+
+    static const char * missing[] = {
+        MOUNT "dat", MOUNT "data/a.tx", MOUNT "data/sub/rand.bin/x",
+        MOUNT "lib", MOUNT "secret.bin", "/other/data/a.txt", "/files",
+        "data/a.txt",
+    };
+    for (size_t i = 0; i < sizeof(missing) / sizeof(missing[0]); i++) {
+        CHECK(!zipvfs_path_stat(missing[i], &st), "%s exists", missing[i]);
+        CHECK(!zipvfs_open(missing[i]), "opened %s", missing[i]);
+    }
+}
+
+static void check_load(void) {
+    static const int loads[] = { LIB, TEXT, BIG, EMPTY };
+    for (size_t i = 0; i < sizeof(loads) / sizeof(loads[0]); i++) {
+        const entry * e = &s_entries[loads[i]];
+        size_t size = 12345;
+        void * data = zipvfs_load(e->name, &size);
+        CHECK(data && size == e->size && !memcmp(data, e->data, size),
+              "load %s", e->name);
+        free(data);
+    }
+
+    size_t size;
+    CHECK(!zipvfs_load("assets/data", &size), "loaded a directory");
+    CHECK(!zipvfs_load("lib/missing.so", &size), "loaded a missing entry");
+    CHECK(!zipvfs_load(s_entries[SECRET].name, &size), "loaded an "
+          "encrypted entry");
+}
+
+// Whatever is read after the prefetch comes out of the cache
+static void check_prefetch(void) {
+    static const struct { int entry; uint32_t offset, len; } fetches[] = {
+        { BIG, 300000, 100000 },
+        { BIG, 1400000, 200000 }, // past the end
+        { REPEAT, 0, 300000 },    // all of the compressed data
+    };
+    static uint8_t buf[300000];
+    char path[256];
+
+    for (size_t i = 0; i < sizeof(fetches) / sizeof(fetches[0]); i++) {
+        const entry * e = &s_entries[fetches[i].entry];
+        uint32_t offset = fetches[i].offset;
+        uint32_t len = fetches[i].len;
+        if (len > e->size - offset)
+            len = e->size - offset;
+        mount_path(fetches[i].entry, path);
+
+        blockcache_stats before, after;
+        blockcache_get_stats(&before);
+        CHECK(zipvfs_prefetch(path, offset, fetches[i].len), "prefetch %s",
+              path);
+        blockcache_get_stats(&after);
+        if (!after.capacity)
+            continue;
+        CHECK(after.prefetched > before.prefetched, "%s: nothing prefetched",
+              path);
+
+        zipvfs_file * f = zipvfs_open(path);
+        before = after;
+        CHECK(zipvfs_pread(f, buf, len, offset) == (int)len
+              && !memcmp(buf, e->data + offset, len), "%s: read after the "
+              "prefetch", path);
+        blockcache_get_stats(&after);
+        CHECK(after.misses == before.misses, "%s: %llu misses after the "
+              "prefetch", path,
+              (unsigned long long)(after.misses - before.misses));
+        zipvfs_close(f);
+    }
+
+    mount_path(DIR, path);
+    CHECK(!zipvfs_prefetch(path, 0, 100), "prefetched a directory");
+    CHECK(!zipvfs_prefetch(MOUNT "missing.bin", 0, 100), "prefetched a "
+          "missing entry");
+}
+
+static void check_handles(void) {
+    zipvfs_file * f[MAX_FILES];
+    char path[256];
+    mount_path(TEXT, path);
+
+    for (int i = 0; i < MAX_FILES; i++) {
+        f[i] = zipvfs_open(path);
+        CHECK(f[i] && zipvfs_owns(f[i]), "open number %d", i);
+        int fd = zipvfs_fd(f[i]);
+        CHECK(fd >= ZIPVFS_FD_BASE && zipvfs_from_fd(fd) == f[i], "fd %d "
+              "of open number %d", fd, i);
+    }
+    CHECK(!zipvfs_open(path), "more files open than the table has");
+    CHECK(!zipvfs_owns((char *)f[0] + 4), "owns the middle of a file");
+    CHECK(!zipvfs_owns(path), "owns something else");
+
+    int fd = zipvfs_fd(f[3]);
+    zipvfs_close(f[3]);
+    CHECK(!zipvfs_from_fd(fd), "closed fd %d still maps", fd);
+    CHECK(!zipvfs_from_fd(ZIPVFS_FD_BASE - 1) && !zipvfs_from_fd(3),
+          "real descriptors map");
+    f[3] = zipvfs_open(path);
+    CHECK(f[3] && zipvfs_fd(f[3]) == fd, "closed slot not reused");
+
+    for (int i = 0; i < MAX_FILES; i++)
+        zipvfs_close(f[i]);
+}
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Opening and reading whole files, the archive against loose copies
+static void bench(void) {
+    static const int files[] = { TEXT, RANDOM, REPEAT };
+    uint8_t * buf = malloc(2 * 1024 * 1024);
+
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        const entry * e = &s_entries[files[i]];
+        char loose[256], path[256];
+        sprintf(loose, LOOSE "%d", files[i]);
+        mount_path(files[i], path);
+
+        FILE * out = fopen(loose, "wb");
+        fwrite(e->data, 1, e->size, out);
+        fclose(out);
+
+        double t0 = now_us();
+        for (int n = 0; n < 200; n++) {
+            FILE * in = fopen(loose, "rb");
+            fread(buf, 1, e->size, in);
+            fclose(in);
+        }
+        double t1 = now_us();
+        for (int n = 0; n < 200; n++) {
+            zipvfs_file * in = zipvfs_open(path);
+            zipvfs_read(in, buf, e->size);
+            zipvfs_close(in);
+        }
+        double t2 = now_us();
+
+        printf("   %-24s %4u KB: loose %6.1f us, archive %6.1f us\n",
+               e->name + strlen(ROOT), e->size / 1024, (t1 - t0) / 200,
+               (t2 - t1) / 200);
+    }
+    free(buf);
+}
+
+static int host_read(int fd, void * dst, uint32_t len, int64_t offset) {
+    return (int)pread(fd, dst, len, offset);
+}
+
+/*
+ * Mounts the archive in a child, with a block cache of `cache` bytes, and
+ * checks everything if it's expected to mount
+ */
+static void run(const char * what, bool mounts, size_t cache, bool timed) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        blockcache_init(host_read);
+        blockcache_set_capacity(cache);
+
+        bool ok = zipvfs_mount(ARCHIVE, ROOT, MOUNT);
+        CHECK(ok == mounts && zipvfs_mounted() == ok, "%s: mounted %d",
+              what, ok);
+        if (ok && mounts) {
+            CHECK(!zipvfs_mount(ARCHIVE, ROOT, MOUNT), "mounted twice");
+            check_prefetch();
+            check_reads();
+            check_gets();
+            check_paths();
+            check_load();
+            check_handles();
+            if (timed)
+                bench();
+        }
+        fflush(stdout);
+        _exit(s_failed ? 1 : 0);
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0, "%s: the child "
+          "failed", what);
+}
+
+static off_t file_size(const char * path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+// Overwrites the end of central directory signature, keeping the mtime
+static void break_archive(bool broken) {
+    struct stat st;
+    stat(ARCHIVE, &st);
+
+    int fd = open(ARCHIVE, O_WRONLY);
+    pwrite(fd, broken ? "XXXX" : "PK\5\6", 4, s_central_end);
+    close(fd);
+
+    struct timespec times[2] = { st.st_atim, st.st_mtim };
+    utimensat(AT_FDCWD, ARCHIVE, times, 0);
+}
+
+static void set_mtime(time_t mtime) {
+    struct timespec times[2] = { { mtime, 0 }, { mtime, 0 } };
+    utimensat(AT_FDCWD, ARCHIVE, times, 0);
+}
+
+int main(void) {
+    char dir[] = LOOSE;
+    mkpath(dir, 0755);
+
+    make_data();
+    write_archive();
+    set_mtime(1700000000);
+    remove(INDEX);
+
+    run("no index", true, 0, true);
+    off_t index_size = file_size(INDEX);
+    CHECK(index_size > 0, "no index stored");
+
+    // Only the stored index can make sense of it now
+    break_archive(true);
+    run("stored index", true, 4 * 1024 * 1024, false);
+    run("stored index, small cache", true, 256 * 1024, false);
+    break_archive(false);
+
+    CHECK(truncate(INDEX, index_size / 2) == 0, "truncate the index");
+    run("truncated index", true, 0, false);
+    CHECK(file_size(INDEX) == index_size, "index not rebuilt: %lld bytes",
+          (long long)file_size(INDEX));
+
+    // The archive changed since the index was made
+    break_archive(true);
+    set_mtime(1700000100);
+    run("stale index", false, 0, false);
+
+    if (s_failed)
+        return 1;
+    printf("ok: %d entries read through a built, stored and rebuilt index\n",
+           ENTRIES);
+    return 0;
+}